@@ -71,3 +71,102 @@ kernel void col2im(
   }
 }
 
+
+// batched variants: numImages images at once, into one wide column matrix,
+// so that one gemm covers them all.  Column row r, for image b, output
+// position p, is at data_col[r * numImages * colArea + b * colArea + p], ie
+// column-major, with numImages * colArea rows, one per image and position
+kernel void im2col_batched(
+    const int numImages,
+    global float const * im_data, int im_offset,
+    global float* data_col) {
+  const int colArea = {{colSize}} * {{colSize}};
+  const int rowStride = numImages * colArea;
+  const int n = numImages * {{channels}} * colArea;
+  CL_KERNEL_LOOP(index, n) {
+    int w_out = index % {{colSize}};
+    int h_out = (index / {{colSize}}) % {{colSize}};
+    int channel_in = (index / colArea) % {{channels}};
+    int b = index / (colArea * {{channels}});
+    int h_in = h_out * {{stride}} - {{padding}};
+    int w_in = w_out * {{stride}} - {{padding}};
+    global const float *data_im = im_data + im_offset + ((b * {{channels}} + channel_in) * {{size}} + h_in) * {{size}} + w_in;
+    global float *col = data_col + channel_in * {{filterSize}} * {{filterSize}} * rowStride
+      + b * colArea + h_out * {{colSize}} + w_out;
+    for (int i = 0; i < {{filterSize}}; ++i) {
+      for (int j = 0; j < {{filterSize}}; ++j) {
+        int h = h_in + i;
+        int w = w_in + j;
+        *col = (h >= 0 && w >= 0 && h < {{size}} && w < {{size}}) ?
+          data_im[i * {{size}} + j] : 0;
+        col += rowStride;
+      }
+    }
+  }
+}
+
+kernel void col2im_batched(
+    const int numImages,
+    global float const *data_col,
+    global float* im_data, int im_offset) {
+  const int colArea = {{colSize}} * {{colSize}};
+  const int rowStride = numImages * colArea;
+  const int n = numImages * {{channels}} * {{size}} * {{size}};
+  CL_KERNEL_LOOP(index, n) {
+    float val = 0;
+    int w = index % {{size}} + {{padding}};
+    int h = (index / {{size}}) % {{size}} + {{padding}};
+    int c = (index / ({{size}} * {{size}})) % {{channels}};
+    int b = index / ({{size}} * {{size}} * {{channels}});
+    int w_col_start = (w < {{filterSize}}) ? 0 : (w - {{filterSize}}) / {{stride}} + 1;
+    int w_col_end = min(w / {{stride}} + 1, {{colSize}});
+    int h_col_start = (h < {{filterSize}}) ? 0 : (h - {{filterSize}}) / {{stride}} + 1;
+    int h_col_end = min(h / {{stride}} + 1, {{colSize}});
+    for (int h_col = h_col_start; h_col < h_col_end; ++h_col) {
+      for (int w_col = w_col_start; w_col < w_col_end; ++w_col) {
+        int row = (c * {{filterSize}} + h - h_col * {{stride}}) * {{filterSize}} + w - w_col * {{stride}};
+        val += data_col[row * rowStride + b * colArea + h_col * {{colSize}} + w_col];
+      }
+    }
+    im_data[im_offset + index] = val;
+  }
+}
+
+// [image][filter][position] to [filter][image][position], the layout of a
+// batched gemm's output, or of its input on the way back
+kernel void to_filter_major(
+    const int numImages,
+    global float const *batch_major, int batch_offset,
+    global float *filter_major) {
+  const int colArea = {{colSize}} * {{colSize}};
+  const int n = numImages * {{numFilters}} * colArea;
+  CL_KERNEL_LOOP(index, n) {
+    int p = index % colArea;
+    int filter = (index / colArea) % {{numFilters}};
+    int b = index / (colArea * {{numFilters}});
+    filter_major[(filter * numImages + b) * colArea + p] = batch_major[batch_offset + index];
+  }
+}
+
+// the batched forward gemm's epilogue: back to [image][filter][position],
+// adding the bias on the way, if the layer is biased
+kernel void from_filter_major(
+    const int numImages,
+    global float const *filter_major,
+#if {{biased}}
+    global float const *bias,
+#endif
+    global float *batch_major, int batch_offset) {
+  const int colArea = {{colSize}} * {{colSize}};
+  const int n = numImages * {{numFilters}} * colArea;
+  CL_KERNEL_LOOP(index, n) {
+    int p = index % colArea;
+    int filter = (index / colArea) % {{numFilters}};
+    int b = index / (colArea * {{numFilters}});
+    float value = filter_major[(filter * numImages + b) * colArea + p];
+#if {{biased}}
+    value += bias[filter];
+#endif
+    batch_major[batch_offset + index] = value;
+  }
+}
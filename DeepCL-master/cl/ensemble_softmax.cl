@@ -0,0 +1,38 @@
+// Copyright Hugh Perkins 2016 hughperkins at gmail
+//
+// This Source Code Form is subject to the terms of the Mozilla Public License,
+// v. 2.0. If a copy of the MPL was not distributed with this file, You can
+// obtain one at http://mozilla.org/MPL/2.0/.
+
+// softmaxes each segment of one ensemble member's logits, and adds weight times
+// the result into out.  one workitem per segment, where a segment is the
+// softmax unit: numPlanes values per example, or one plane, for per-plane softmax
+// if first is non-zero, out is overwritten, rather than added to
+kernel void accumulate(
+        const int numSegments,
+        const int segmentSize,
+        const float weight,
+        const int first,
+        global const float *logits,
+        global float *out) {
+    const int segment = get_global_id(0);
+    if (segment >= numSegments) {
+        return;
+    }
+    global const float *segmentIn = logits + segment * segmentSize;
+    global float *segmentOut = out + segment * segmentSize;
+    float maxValue = segmentIn[0];
+    for (int i = 1; i < segmentSize; i++) {
+        maxValue = max(maxValue, segmentIn[i]);
+    }
+    float denominator = 0;
+    for (int i = 0; i < segmentSize; i++) {
+        denominator += exp(segmentIn[i] - maxValue);
+    }
+    const float multiplier = weight / denominator;
+    for (int i = 0; i < segmentSize; i++) {
+        float probability = multiplier * exp(segmentIn[i] - maxValue);
+        segmentOut[i] = first ? probability : segmentOut[i] + probability;
+    }
+}
+
@@ -0,0 +1,161 @@
+// Copyright Hugh Perkins 2016 hughperkins at gmail
+//
+// This Source Code Form is subject to the terms of the Mozilla Public License,
+// v. 2.0. If a copy of the MPL was not distributed with this file, You can
+// obtain one at http://mozilla.org/MPL/2.0/.
+
+// bias, activation, and optionally max-pooling, applied to the output of a
+// convolution in one pass, instead of AddBias, ActivationLayer and PoolingLayer
+// each reading and writing the whole output
+//
+// expected defines:
+// one of: [ TANH | RELU | LINEAR | SIGMOID | SCALEDTANH | ELU ]
+// BIASED, if the convolutional layer has bias
+// gNumFilters
+// gConvOutputSize, gConvOutputSizeSquared: size of the convolution output
+// if a pooling layer is fused too:
+//   gPoolingSize
+//   gOutputSize, gOutputSizeSquared: size of the pooled output
+
+#ifdef TANH
+    #define ACTIVATION_FUNCTION(output) (tanh(output))
+    #define ACTIVATION_DERIV(output) (1 - output * output)
+#elif defined SCALEDTANH
+    #define ACTIVATION_FUNCTION(output) (1.7159f * tanh(0.66667f * output))
+    #define ACTIVATION_DERIV(output) (0.66667f * (1.7159f - 1 / 1.7159f * output * output) )
+#elif defined SIGMOID
+    #define ACTIVATION_FUNCTION(output) (1.0f / (1 + exp(-output)))
+    #define ACTIVATION_DERIV(output) (output * (1 - output) )
+#elif defined RELU
+    #define ACTIVATION_FUNCTION(output) (output> 0 ? output : 0)
+    #define ACTIVATION_DERIV(output) (output > 0 ? 1 : 0)
+#elif defined ELU
+    #define ACTIVATION_FUNCTION(output) (output> 0 ? output : exp(output) - 1)
+    #define ACTIVATION_DERIV(output) (output > 0 ? 1 : output + 1)
+#elif defined LINEAR
+    #define ACTIVATION_FUNCTION(output) (output)
+    #define ACTIVATION_DERIV(output) (1.0f)
+#endif
+
+#ifdef ACTIVATION_FUNCTION // protect against not defined
+#ifdef gPoolingSize
+
+// one workitem per pooled output, globalid is [n][filter][outputRow][outputCol]
+// selectors are as for PoolingLayer, so the pooled output, and selectors, are
+// exactly what conv + activation + pooling would produce
+kernel void fused_forward(
+        const int batchSize,
+        global const float *convOutput,
+        global const float *bias,
+        global int *selectors,
+        global float *output) {
+    const int globalId = get_global_id(0);
+
+    const int intraImageOffset = globalId % gOutputSizeSquared;
+    const int outputRow = intraImageOffset / gOutputSize;
+    const int outputCol = intraImageOffset % gOutputSize;
+
+    const int image2dIdx = globalId / gOutputSizeSquared;
+    const int filter = image2dIdx % gNumFilters;
+    const int n = image2dIdx / gNumFilters;
+    if (n >= batchSize) {
+        return;
+    }
+#ifdef BIASED
+    const float biasValue = bias[filter];
+#else
+    const float biasValue = 0.0f;
+#endif
+
+    const int inputRow = outputRow * gPoolingSize;
+    const int inputCol = outputCol * gPoolingSize;
+    global const float *convPlane = convOutput + image2dIdx * gConvOutputSizeSquared;
+    int selector = 0;
+    float value = convPlane[inputRow * gConvOutputSize + inputCol] + biasValue;
+    float maxValue = ACTIVATION_FUNCTION(value);
+    for (int dRow = 0; dRow < gPoolingSize; dRow++) {
+        for (int dCol = 0; dCol < gPoolingSize; dCol++) {
+            bool process = (inputRow + dRow < gConvOutputSize) && (inputCol + dCol < gConvOutputSize);
+            if (process) {
+                value = convPlane[(inputRow + dRow) * gConvOutputSize + inputCol + dCol] + biasValue;
+                float thisValue = ACTIVATION_FUNCTION(value);
+                if (thisValue > maxValue) {
+                    maxValue = thisValue;
+                    selector = dRow * gPoolingSize + dCol;
+                }
+            }
+        }
+    }
+    output[globalId] = maxValue;
+    selectors[globalId] = selector;
+}
+
+// one workitem per convolution output, globalid is [n][filter][convRow][convCol]
+// only the element each pool selected gets any gradient
+kernel void fused_backward(
+        const int batchSize,
+        global const float *output,
+        global const int *selectors,
+        global const float *gradOutput,
+        global float *gradConvOutput) {
+    const int globalId = get_global_id(0);
+
+    const int intraImageOffset = globalId % gConvOutputSizeSquared;
+    const int convRow = intraImageOffset / gConvOutputSize;
+    const int convCol = intraImageOffset % gConvOutputSize;
+
+    const int image2dIdx = globalId / gConvOutputSizeSquared;
+    if (image2dIdx >= batchSize * gNumFilters) {
+        return;
+    }
+
+    const int outputRow = convRow / gPoolingSize;
+    const int outputCol = convCol / gPoolingSize;
+    float gradient = 0.0f;
+    if (outputRow < gOutputSize && outputCol < gOutputSize) {
+        const int outputIdx = image2dIdx * gOutputSizeSquared + outputRow * gOutputSize + outputCol;
+        const int selector = (convRow % gPoolingSize) * gPoolingSize + (convCol % gPoolingSize);
+        if (selectors[outputIdx] == selector) {
+            float value = output[outputIdx];
+            gradient = ACTIVATION_DERIV(value) * gradOutput[outputIdx];
+        }
+    }
+    gradConvOutput[globalId] = gradient;
+}
+
+#else
+
+// in place, on the convolution output
+kernel void fused_forward(
+        const int N,
+        global float *convOutput,
+        global const float *bias) {
+    const int globalId = get_global_id(0);
+    if (globalId >= N) {
+        return;
+    }
+#ifdef BIASED
+    const int filter = (globalId / gConvOutputSizeSquared) % gNumFilters;
+    float value = convOutput[globalId] + bias[filter];
+#else
+    float value = convOutput[globalId];
+#endif
+    convOutput[globalId] = ACTIVATION_FUNCTION(value);
+}
+
+kernel void fused_backward(
+        const int N,
+        global const float *output,
+        global const float *gradOutput,
+        global float *gradConvOutput) {
+    const int globalId = get_global_id(0);
+    if (globalId >= N) {
+        return;
+    }
+    float value = output[globalId];
+    gradConvOutput[globalId] = ACTIVATION_DERIV(value) * gradOutput[globalId];
+}
+
+#endif
+#endif
+
@@ -0,0 +1,32 @@
+// Copyright Hugh Perkins 2016 hughperkins at gmail
+//
+// This Source Code Form is subject to the terms of the Mozilla Public License,
+// v. 2.0. If a copy of the MPL was not distributed with this file, You can
+// obtain one at http://mozilla.org/MPL/2.0/.
+
+// converts between float buffers, and buffers holding half-precision values
+// uses vload_half / vstore_half, which dont need cl_khr_fp16, so this works
+// on any device; the arithmetic stays in float
+
+kernel void pack(
+        const int N,
+        global const float *in,
+        global half *out) {
+    const int globalId = get_global_id(0);
+    if (globalId >= N) {
+        return;
+    }
+    vstore_half_rte(in[globalId], globalId, out);
+}
+
+kernel void unpack(
+        const int N,
+        global const half *in,
+        global float *out) {
+    const int globalId = get_global_id(0);
+    if (globalId >= N) {
+        return;
+    }
+    out[globalId] = vload_half(globalId, in);
+}
+
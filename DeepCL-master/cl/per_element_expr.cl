@@ -0,0 +1,25 @@
+// Copyright Hugh Perkins 2016 hughperkins at gmail
+//
+// This Source Code Form is subject to the terms of the Mozilla Public License,
+// v. 2.0. If a copy of the MPL was not distributed with this file, You can
+// obtain one at http://mozilla.org/MPL/2.0/.
+
+// one whole CLMathExpr, evaluated per element.  args are the other buffers,
+// in0, in1, ..., then the scalars, s0, s1, ....  expression reads
+// target[globalId] if the expression uses the buffer being assigned to
+
+static float squared(float val_one) {
+    return val_one * val_one;
+}
+
+static float inv(float val_one) {
+    return 1.0f / val_one;
+}
+
+kernel void per_element_expr(const int N, global float *target{{args}}) {
+    const int globalId = get_global_id(0);
+    if (globalId >= N) {
+        return;
+    }
+    target[globalId] = {{expression}};
+}
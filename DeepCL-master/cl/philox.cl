@@ -0,0 +1,127 @@
+// Copyright Hugh Perkins 2016 hughperkins at gmail
+//
+// This Source Code Form is subject to the terms of the Mozilla Public License,
+// v. 2.0. If a copy of the MPL was not distributed with this file, You can
+// obtain one at http://mozilla.org/MPL/2.0/.
+
+// Philox4x32-10 counter-based random numbers (Salmon et al, "Parallel random
+// numbers: as easy as 1, 2, 3", SC11).  Each (counter, key) pair maps to 4
+// independent uint32s, so every work item can draw its own numbers, with no
+// state carried between work items or between launches.
+//
+// Callers use key = the 64-bit seed, and counter = (element or image index,
+// step, stream, 0), where step counts the launches for that generator.  Must
+// match PhiloxRandom::philox4x32 on the host.  seedLo, seedHi and step are
+// passed as ints, and used as the uints with the same bits
+
+#define PHILOX_M0 0xD2511F53u
+#define PHILOX_M1 0xCD9E8D57u
+#define PHILOX_W0 0x9E3779B9u
+#define PHILOX_W1 0xBB67AE85u
+
+uint4 philox4x32(uint4 counter, uint2 key) {
+    for(int round = 0; round < 10; round++) {
+        uint hi0 = mul_hi(PHILOX_M0, counter.x);
+        uint lo0 = PHILOX_M0 * counter.x;
+        uint hi1 = mul_hi(PHILOX_M1, counter.z);
+        uint lo1 = PHILOX_M1 * counter.z;
+        counter = (uint4)(hi1 ^ counter.y ^ key.x, lo1, hi0 ^ counter.w ^ key.y, lo0);
+        key.x += PHILOX_W0;
+        key.y += PHILOX_W1;
+    }
+    return counter;
+}
+
+// [0, 1), from the top 24 bits, so exactly representable as a float
+float philox_uniform(uint value) {
+    return (value >> 8) * (1.0f / 16777216.0f);
+}
+
+// 1 where we keep the value, 0 where we drop it, with probability dropRatio,
+// as DropoutLayer used to draw on the host.  4 masks per work item
+kernel void dropout_masks(
+        const int N,
+        const float dropRatio,
+        const int seedLo, const int seedHi, const int step,
+        global unsigned char *masks) {
+    const int globalId = get_global_id(0);
+    const int base = globalId << 2;
+    if(base >= N) {
+        return;
+    }
+    uint4 r = philox4x32((uint4)(globalId, step, 0, 0), (uint2)(seedLo, seedHi));
+    masks[base] = philox_uniform(r.x) <= dropRatio ? 0 : 1;
+    if(base + 1 < N) {
+        masks[base + 1] = philox_uniform(r.y) <= dropRatio ? 0 : 1;
+    }
+    if(base + 2 < N) {
+        masks[base + 2] = philox_uniform(r.z) <= dropRatio ? 0 : 1;
+    }
+    if(base + 3 < N) {
+        masks[base + 3] = philox_uniform(r.w) <= dropRatio ? 0 : 1;
+    }
+}
+
+// integer in [0, range), for image n.  Every work item for that image computes
+// the same value, so no offsets buffer is needed
+int philox_image_offset(uint value, int range) {
+    return (int)(value % (uint)range);
+}
+
+// output is each image shifted by its own random (rows, cols), each in
+// [-translateSize, translateSize], zero-filled, as Translator::translate.  One
+// work item per output element
+kernel void random_translations(
+        const int N,
+        const int numPlanes, const int imageSize, const int translateSize,
+        const int seedLo, const int seedHi, const int step,
+        global const float *input,
+        global float *output) {
+    const int globalId = get_global_id(0);
+    if(globalId >= N) {
+        return;
+    }
+    const int col = globalId % imageSize;
+    const int row = (globalId / imageSize) % imageSize;
+    const int n = globalId / (imageSize * imageSize * numPlanes);
+    uint4 r = philox4x32((uint4)(n, step, 0, 0), (uint2)(seedLo, seedHi));
+    const int translateRows = philox_image_offset(r.x, 2 * translateSize + 1) - translateSize;
+    const int translateCols = philox_image_offset(r.y, 2 * translateSize + 1) - translateSize;
+    const int inRow = row - translateRows;
+    const int inCol = col - translateCols;
+    float value = 0.0f;
+    if(inRow >= 0 && inRow < imageSize && inCol >= 0 && inCol < imageSize) {
+        value = input[globalId + (inRow - row) * imageSize + (inCol - col)];
+    }
+    output[globalId] = value;
+}
+
+// patchSize x patchSize crop of each image, at a random (row, col) in
+// [0, imageSize - patchSize] when training, otherwise the centre crop, as
+// PatchExtractor::extractPatch.  One work item per output element
+kernel void random_patches(
+        const int N,
+        const int numPlanes, const int imageSize, const int patchSize,
+        const int training,
+        const int seedLo, const int seedHi, const int step,
+        global const float *input,
+        global float *output) {
+    const int globalId = get_global_id(0);
+    if(globalId >= N) {
+        return;
+    }
+    const int patchMargin = imageSize - patchSize;
+    const int col = globalId % patchSize;
+    const int row = (globalId / patchSize) % patchSize;
+    const int planeIndex = globalId / (patchSize * patchSize); // n * numPlanes + plane
+    const int n = planeIndex / numPlanes;
+    int patchRow = patchMargin / 2;
+    int patchCol = patchMargin / 2;
+    if(training) {
+        uint4 r = philox4x32((uint4)(n, step, 0, 0), (uint2)(seedLo, seedHi));
+        patchRow = philox_image_offset(r.x, patchMargin + 1);
+        patchCol = philox_image_offset(r.y, patchMargin + 1);
+    }
+    output[globalId] = input[(planeIndex * imageSize + row + patchRow) * imageSize + col + patchCol];
+}
+
@@ -0,0 +1,134 @@
+// Copyright Hugh Perkins 2016 hughperkins at gmail
+//
+// This Source Code Form is subject to the terms of the Mozilla Public License,
+// v. 2.0. If a copy of the MPL was not distributed with this file, You can
+// obtain one at http://mozilla.org/MPL/2.0/.
+
+// one kernel per trainer update, reading the gradient and trainer state, and
+// writing the weights and state, in a single pass.  Same maths, in the same
+// order, as the CLMathWrapper sequences they replace
+
+kernel void plain_update(
+        const int N,
+        const float learningRate,
+        global const float *gradWeights,
+        global float *weights) {
+    const int globalId = get_global_id(0);
+    if (globalId >= N) {
+        return;
+    }
+    weights[globalId] += - learningRate * gradWeights[globalId];
+}
+
+// weightDecay of 0 means no decay
+kernel void sgd_update(
+        const int N,
+        const float learningRate,
+        const float momentum,
+        const float weightDecay,
+        global float *lastUpdate,
+        global const float *gradWeights,
+        global float *weights) {
+    const int globalId = get_global_id(0);
+    if (globalId >= N) {
+        return;
+    }
+    float update = momentum * lastUpdate[globalId] - learningRate * gradWeights[globalId];
+    lastUpdate[globalId] = update;
+    float weight = weights[globalId] + update;
+    if (weightDecay > 0) {
+        weight *= 1.0f - weightDecay;
+    }
+    weights[globalId] = weight;
+}
+
+kernel void adagrad_update(
+        const int N,
+        const float learningRate,
+        global float *sumSquares,
+        global const float *gradWeights,
+        global float *weights) {
+    const int globalId = get_global_id(0);
+    if (globalId >= N) {
+        return;
+    }
+    float grad = gradWeights[globalId];
+    float sumSquare = sumSquares[globalId] + grad * grad;
+    sumSquares[globalId] = sumSquare;
+    weights[globalId] += - learningRate * grad / sqrt(sumSquare);
+}
+
+kernel void rmsprop_update(
+        const int N,
+        const float learningRate,
+        global float *meanSquares,
+        global const float *gradWeights,
+        global float *weights) {
+    const int globalId = get_global_id(0);
+    if (globalId >= N) {
+        return;
+    }
+    float grad = gradWeights[globalId];
+    float meanSquare = 0.9f * meanSquares[globalId] + 0.1f * grad * grad;
+    meanSquares[globalId] = meanSquare;
+    weights[globalId] += - learningRate * grad / sqrt(meanSquare);
+}
+
+// http://arxiv.org/pdf/1212.5701v1.pdf , page 3, Algorithm 1
+kernel void adadelta_update(
+        const int N,
+        const float decay,
+        global float *sumGradSquared,
+        global float *sumUpdateSquared,
+        global const float *gradWeights,
+        global float *weights) {
+    const int globalId = get_global_id(0);
+    if (globalId >= N) {
+        return;
+    }
+    float grad = gradWeights[globalId];
+    float gradSquared = decay * sumGradSquared[globalId] + (1 - decay) * grad * grad;
+    sumGradSquared[globalId] = gradSquared;
+    float update = - sqrt(sumUpdateSquared[globalId] / (gradSquared + 0.0000001f)) * grad;
+    weights[globalId] += update;
+    sumUpdateSquared[globalId] = decay * sumUpdateSquared[globalId] + (1 - decay) * update * update;
+}
+
+// saves the weights in oldWeights, and moves the weights to where the
+// momentum will take them.  gradWeights still holds - learningRate * grad from
+// the last nesterov_update
+kernel void nesterov_lookahead(
+        const int N,
+        const float momentum,
+        global float *oldWeights,
+        global const float *gradWeights,
+        global float *weights) {
+    const int globalId = get_global_id(0);
+    if (globalId >= N) {
+        return;
+    }
+    float weight = weights[globalId];
+    oldWeights[globalId] = weight;
+    weights[globalId] = momentum * gradWeights[globalId] + weight;
+}
+
+// gradWeights is the gradient at the lookahead weights.  It is left scaled by
+// - learningRate, for the next nesterov_lookahead
+kernel void nesterov_update(
+        const int N,
+        const float learningRate,
+        const float momentum,
+        global float *lastUpdate,
+        global const float *oldWeights,
+        global float *gradWeights,
+        global float *weights) {
+    const int globalId = get_global_id(0);
+    if (globalId >= N) {
+        return;
+    }
+    float scaledGrad = - learningRate * gradWeights[globalId];
+    gradWeights[globalId] = scaledGrad;
+    float update = momentum * lastUpdate[globalId] + scaledGrad;
+    lastUpdate[globalId] = update;
+    weights[globalId] = oldWeights[globalId] + update;
+}
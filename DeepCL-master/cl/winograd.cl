@@ -0,0 +1,211 @@
+// Copyright Hugh Perkins 2016 hughperkins at gmail
+//
+// This Source Code Form is subject to the terms of the Mozilla Public License,
+// v. 2.0. If a copy of the MPL was not distributed with this file, You can
+// obtain one at http://mozilla.org/MPL/2.0/.
+
+// Winograd F(mxm, 3x3) convolution, stride 1, as in Lavin and Gray, "Fast
+// Algorithms for Convolutional Neural Networks", 2015.  m is gOutputTile, 2 or
+// 4, and each (gTile = m + 2) square input tile gives an m x m output tile:
+//
+//     Y = A^T [ (G g G^T) .* (B^T d B) ] A
+//
+// The sum over input planes of the element-wise products is done as gTile^2
+// independent gemms, by the host, between these kernels.
+//
+// Layouts, with e = xi * gTile + nu the position within the transformed tile,
+// and P = numImages * gTiles * gTiles:
+//   U (transformed filters) [e][outputPlane][inputPlane]
+//   V (transformed input)   [e][inputPlane][P]
+//   M (gemm output)         [e][outputPlane][P]
+//
+// expects defines:
+//   gOutputTile, gTile, gTiles: output tile size, input tile size, tiles per side
+//   gInputPlanes, gInputSize, gOutputPlanes, gOutputSize, gPadding
+//   gFlipFilters: 1 to use the filters rotated by 180 degrees, with input and
+//       output planes swapped, ie for the gradInput of a forward convolution
+//   gBiased
+
+#if gOutputTile == 2
+constant float BT[gTile * gTile] = {
+    1, 0, -1, 0,
+    0, 1, 1, 0,
+    0, -1, 1, 0,
+    0, 1, 0, -1
+};
+constant float G[gTile * 3] = {
+    1, 0, 0,
+    0.5f, 0.5f, 0.5f,
+    0.5f, -0.5f, 0.5f,
+    0, 0, 1
+};
+constant float AT[gOutputTile * gTile] = {
+    1, 1, 1, 0,
+    0, 1, -1, -1
+};
+#elif gOutputTile == 4
+constant float BT[gTile * gTile] = {
+    4, 0, -5, 0, 1, 0,
+    0, -4, -4, 1, 1, 0,
+    0, 4, -4, -1, 1, 0,
+    0, -2, -1, 2, 1, 0,
+    0, 2, -1, -2, 1, 0,
+    0, 4, 0, -5, 0, 1
+};
+constant float G[gTile * 3] = {
+    1.0f / 4, 0, 0,
+    -1.0f / 6, -1.0f / 6, -1.0f / 6,
+    -1.0f / 6, 1.0f / 6, -1.0f / 6,
+    1.0f / 24, 1.0f / 12, 1.0f / 6,
+    1.0f / 24, -1.0f / 12, 1.0f / 6,
+    0, 0, 1
+};
+constant float AT[gOutputTile * gTile] = {
+    1, 1, 1, 1, 1, 0,
+    0, 1, -1, 2, -2, 0,
+    0, 1, 1, 4, 4, 0,
+    0, 1, -1, 8, -8, 1
+};
+#endif
+
+// one work item per (outputPlane, inputPlane) filter
+kernel void filter_transform(
+        global const float *filters,
+        global float *U) {
+    const int globalId = get_global_id(0);
+    if(globalId >= gOutputPlanes * gInputPlanes) {
+        return;
+    }
+    const int outPlane = globalId / gInputPlanes;
+    const int inPlane = globalId % gInputPlanes;
+    float g[9];
+    for(int i = 0; i < 9; i++) {
+        #if gFlipFilters
+        g[i] = filters[(inPlane * gOutputPlanes + outPlane) * 9 + 8 - i];
+        #else
+        g[i] = filters[(outPlane * gInputPlanes + inPlane) * 9 + i];
+        #endif
+    }
+    float Gg[gTile * 3];
+    for(int row = 0; row < gTile; row++) {
+        for(int col = 0; col < 3; col++) {
+            float sum = 0;
+            for(int k = 0; k < 3; k++) {
+                sum += G[row * 3 + k] * g[k * 3 + col];
+            }
+            Gg[row * 3 + col] = sum;
+        }
+    }
+    for(int xi = 0; xi < gTile; xi++) {
+        for(int nu = 0; nu < gTile; nu++) {
+            float sum = 0;
+            for(int k = 0; k < 3; k++) {
+                sum += Gg[xi * 3 + k] * G[nu * 3 + k];
+            }
+            U[((xi * gTile + nu) * gOutputPlanes + outPlane) * gInputPlanes + inPlane] = sum;
+        }
+    }
+}
+
+// one work item per (image, inputPlane, tile)
+kernel void input_transform(
+        const int numImages,
+        global const float *input, const int inputOffset,
+        global float *V) {
+    const int globalId = get_global_id(0);
+    const int P = numImages * gTiles * gTiles;
+    if(globalId >= gInputPlanes * P) {
+        return;
+    }
+    const int tileCol = globalId % gTiles;
+    const int tileRow = (globalId / gTiles) % gTiles;
+    const int inPlane = (globalId / (gTiles * gTiles)) % gInputPlanes;
+    const int n = globalId / (gTiles * gTiles * gInputPlanes);
+    const int tileIndex = (n * gTiles + tileRow) * gTiles + tileCol;
+    global const float *plane = input + inputOffset + (n * gInputPlanes + inPlane) * gInputSize * gInputSize;
+    const int rowStart = tileRow * gOutputTile - gPadding;
+    const int colStart = tileCol * gOutputTile - gPadding;
+    float d[gTile * gTile];
+    for(int row = 0; row < gTile; row++) {
+        for(int col = 0; col < gTile; col++) {
+            const int inRow = rowStart + row;
+            const int inCol = colStart + col;
+            d[row * gTile + col] = (inRow >= 0 && inRow < gInputSize && inCol >= 0 && inCol < gInputSize) ?
+                plane[inRow * gInputSize + inCol] : 0.0f;
+        }
+    }
+    float BTd[gTile * gTile];
+    for(int row = 0; row < gTile; row++) {
+        for(int col = 0; col < gTile; col++) {
+            float sum = 0;
+            for(int k = 0; k < gTile; k++) {
+                sum += BT[row * gTile + k] * d[k * gTile + col];
+            }
+            BTd[row * gTile + col] = sum;
+        }
+    }
+    for(int xi = 0; xi < gTile; xi++) {
+        for(int nu = 0; nu < gTile; nu++) {
+            float sum = 0;
+            for(int k = 0; k < gTile; k++) {
+                sum += BTd[xi * gTile + k] * BT[nu * gTile + k];
+            }
+            V[((xi * gTile + nu) * gInputPlanes + inPlane) * P + tileIndex] = sum;
+        }
+    }
+}
+
+// one work item per (image, outputPlane, tile).  Writes, rather than adds to,
+// output, clipping the tiles at the right and bottom edges
+kernel void output_transform(
+        const int numImages,
+        global const float *M,
+        #if gBiased
+        global const float *bias,
+        #endif
+        global float *output, const int outputOffset) {
+    const int globalId = get_global_id(0);
+    const int P = numImages * gTiles * gTiles;
+    if(globalId >= gOutputPlanes * P) {
+        return;
+    }
+    const int tileCol = globalId % gTiles;
+    const int tileRow = (globalId / gTiles) % gTiles;
+    const int outPlane = (globalId / (gTiles * gTiles)) % gOutputPlanes;
+    const int n = globalId / (gTiles * gTiles * gOutputPlanes);
+    const int tileIndex = (n * gTiles + tileRow) * gTiles + tileCol;
+    float m[gTile * gTile];
+    for(int e = 0; e < gTile * gTile; e++) {
+        m[e] = M[(e * gOutputPlanes + outPlane) * P + tileIndex];
+    }
+    float ATm[gOutputTile * gTile];
+    for(int row = 0; row < gOutputTile; row++) {
+        for(int col = 0; col < gTile; col++) {
+            float sum = 0;
+            for(int k = 0; k < gTile; k++) {
+                sum += AT[row * gTile + k] * m[k * gTile + col];
+            }
+            ATm[row * gTile + col] = sum;
+        }
+    }
+    #if gBiased
+    const float planeBias = bias[outPlane];
+    #else
+    const float planeBias = 0.0f;
+    #endif
+    global float *plane = output + outputOffset + (n * gOutputPlanes + outPlane) * gOutputSize * gOutputSize;
+    for(int row = 0; row < gOutputTile; row++) {
+        const int outRow = tileRow * gOutputTile + row;
+        for(int col = 0; col < gOutputTile; col++) {
+            const int outCol = tileCol * gOutputTile + col;
+            if(outRow < gOutputSize && outCol < gOutputSize) {
+                float sum = planeBias;
+                for(int k = 0; k < gTile; k++) {
+                    sum += ATm[row * gTile + k] * AT[col * gTile + k];
+                }
+                plane[outRow * gOutputSize + outCol] = sum;
+            }
+        }
+    }
+}
+
@@ -40,7 +40,7 @@ def write_kernel2(kernelVarName, kernel_filename, kernelName, options):
     cog.outl('const char * ' + kernelVarName + 'Source =  ')
     write_file2(kernel_filename)
     cog.outl('"";')
-    cog.outl(kernelVarName + ' = cl->buildKernelFromString(' + kernelVarName + 'Source, "' + kernelName + '", ' + options + ', "' + kernel_filename + '");')
+    cog.outl(kernelVarName + ' = ProgramCache::buildKernelFromString(cl, ' + kernelVarName + 'Source, "' + kernelName + '", ' + options + ', "' + kernel_filename + '");')
 
 def write_kernel3(kernelVarName, kernel_filename, kernelName, options):
     # cog.outl('string kernelFilename = "'  + kernel_filename + '";')
@@ -53,5 +53,5 @@ def write_kernel3(kernelVarName, kernel_filename, kernelName, options):
         line = f.readline()
     cog.outl(')DELIM";')
     f.close()
-    cog.outl(kernelVarName + ' = cl->buildKernelFromString(' + kernelVarName + 'Source, "' + kernelName + '", ' + options + ', "' + kernel_filename + '");')
+    cog.outl(kernelVarName + ' = ProgramCache::buildKernelFromString(cl, ' + kernelVarName + 'Source, "' + kernelName + '", ' + options + ', "' + kernel_filename + '");')
 
@@ -16,6 +16,8 @@ cdef class QLearner:
         self.thisptr.setMaxSamples( maxSamples )
     def setEpsilon( self, float epsilon ):
         self.thisptr.setEpsilon( epsilon )
+    def setHistorySize( self, int historySize ):
+        self.thisptr.setHistorySize( historySize )
     # def setLearningRate( self, float learningRate ):
     #     self.thisptr.setLearningRate( learningRate )
 
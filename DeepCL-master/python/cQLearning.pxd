@@ -5,6 +5,7 @@ cdef extern from "qlearning/QLearner.h":
         void setLambda( float thislambda )
         void setMaxSamples( int maxSamples )
         void setEpsilon( float epsilon )
+        void setHistorySize( int historySize ) except +
         # void setLearningRate( float learningRate )
 
 cdef extern from "CyScenario.h":
@@ -9,6 +9,7 @@
 #include "net/Trainable.h"
 #include "net/NeuralNet.h"
 #include "net/MultiNet.h"
+#include "net/DataParallelNet.h"
 
 #include "trainers/Trainer.h"
 #include "trainers/SGD.h"
@@ -22,8 +23,11 @@
 #include "weights/OriginalInitializer.h"
 
 #include "normalize/NormalizationHelper.h"
+#include "normalize/DatasetStatistics.h"
 #include "layer/Layer.h"
 #include "conv/ConvolutionalLayer.h"
+#include "conv/TuningDatabase.h"
+#include "util/ProgramCache.h"
 #include "input/InputLayer.h"
 #include "layer/LayerMakers.h"
 
@@ -33,6 +37,7 @@
 #include "batch/NetLearnerOnDemandv2.h"
 
 #include "weights/WeightsPersister.h"
+#include "weights/CheckpointWriter.h"
 #include "util/FileHelper.h"
 #include "loaders/GenericLoader.h"
 #include "loaders/GenericLoaderv2.h"
@@ -15,6 +15,7 @@
 #include "activate/ActivationFunction.h"
 
 #include "activate/ActivationBackwardGpuNaive.h"
+#include "util/ProgramCache.h"
 
 using namespace std;
 
@@ -125,7 +126,7 @@ ActivationBackwardGpuNaive::ActivationBackwardGpuNaive(EasyCL *cl, int numPlanes
     "#endif\n"
     "\n"
     "";
-    kernel = cl->buildKernelFromString(kernelSource, "backward", options, "cl/applyActivationDeriv.cl");
+    kernel = ProgramCache::buildKernelFromString(cl, kernelSource, "backward", options, "cl/applyActivationDeriv.cl");
     // [[[end]]]
 }
 
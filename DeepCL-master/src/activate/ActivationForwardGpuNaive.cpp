@@ -14,6 +14,7 @@
 #include "activate/ActivationFunction.h"
 
 #include "activate/ActivationForwardGpuNaive.h"
+#include "util/ProgramCache.h"
 
 //#include "test/PrintBuffer.h"
 
@@ -108,7 +109,7 @@ ActivationForwardGpuNaive::ActivationForwardGpuNaive(EasyCL *cl, int numPlanes,
     "#endif\n"
     "\n"
     "";
-    kernel = cl->buildKernelFromString(kernelSource, "forwardNaive", options, "cl/activate.cl");
+    kernel = ProgramCache::buildKernelFromString(cl, kernelSource, "forwardNaive", options, "cl/activate.cl");
     // [[[end]]]
 }
 
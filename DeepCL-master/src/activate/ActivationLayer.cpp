@@ -34,7 +34,9 @@ ActivationLayer::ActivationLayer(EasyCL *cl, Layer *previousLayer, ActivationMak
 //        outputCopiedToHost(false),
 //        gradInputCopiedToHost(false),
         batchSize(0),
-        allocatedSize(0) {
+        allocatedSize(0),
+        fusedInto(0),
+        fusedOutputAvailable(false) {
     if(inputSize == 0){
 //        maker->net->print();
         throw runtime_error("Error: Activation layer " + toString(layerIndex) + ": input image size is 0");
@@ -70,7 +72,7 @@ VIRTUAL float ActivationLayer::getOutput(int n, int plane, int row, int col) {
         * numPlanes + plane)
         * outputSize + row)
         * outputSize + col;
-    return output[ index ];
+    return getOutput()[ index ];
 }
 VIRTUAL void ActivationLayer::printOutput() {
 //    float const*output = getOutput();
@@ -132,6 +134,12 @@ VIRTUAL int ActivationLayer::getOutputNumElements() {
     return batchSize * numPlanes * outputSize * outputSize;
 }
 VIRTUAL float *ActivationLayer::getOutput() {
+    if(fusedInto != 0) {
+        if(!fusedOutputAvailable) {
+            throw runtime_error("ActivationLayer " + toString(layerIndex) + " is fused with the following pooling layer, so has no output of its own");
+        }
+        return fusedInto->getOutput();
+    }
     if(outputWrapper->isDeviceDirty()) {
         outputWrapper->copyToHost();
 //        outputCopiedToHost = true;
@@ -168,6 +176,12 @@ VIRTUAL bool ActivationLayer::hasOutputWrapper() const {
     return true;
 }
 VIRTUAL CLWrapper *ActivationLayer::getOutputWrapper() {
+    if(fusedInto != 0) {
+        if(!fusedOutputAvailable) {
+            throw runtime_error("ActivationLayer " + toString(layerIndex) + " is fused with the following pooling layer, so has no output of its own");
+        }
+        return fusedInto->getOutputWrapper();
+    }
     return outputWrapper;
 }
 VIRTUAL int ActivationLayer::getWeightsSize() const {
@@ -187,6 +201,9 @@ VIRTUAL ActivationFunction const *ActivationLayer::getActivationFunction() const
     return fn;
 }
 VIRTUAL void ActivationLayer::forward() {
+    if(fusedInto != 0) {
+        return;
+    }
     CLWrapper *inputWrapper = 0;
     if(previousLayer->hasOutputWrapper()) {
         inputWrapper = previousLayer->getOutputWrapper();
@@ -203,6 +220,9 @@ VIRTUAL void ActivationLayer::forward() {
 }
 VIRTUAL void ActivationLayer::backward() {
     // have no weights to backprop to, just need to backprop the errors
+    if(fusedInto != 0) {
+        return;
+    }
 
 //    CLWrapper *imagesWrapper = 0;
 //    if(previousLayer->hasOutputWrapper()) {
@@ -233,10 +253,18 @@ VIRTUAL void ActivationLayer::backward() {
     }
 }
 VIRTUAL std::string ActivationLayer::asString() const {
+    if(fusedInto != 0) {
+        return std::string("ActivationLayer{ ") + fn->getDefineName() + " fused into layer " + toString(fusedInto->layerIndex) + " }";
+    }
     return std::string("ActivationLayer{ ") + fn->getDefineName() + " }";
 }
 VIRTUAL int ActivationLayer::getPersistSize(int version) const {
     // no weights, so:
     return 0;
 }
-
+// called by ConvolutionalLayer::fuse.  if a pooling layer is fused too, our
+// output is never written anywhere, so getOutput() throws
+void ActivationLayer::fuseInto(Layer *convLayer, bool outputAvailable) {
+    fusedInto = convLayer;
+    fusedOutputAvailable = outputAvailable;
+}
@@ -47,6 +47,9 @@ public:
     int batchSize;
     int allocatedSize;
 
+    Layer *fusedInto; // NOT owned by us; the ConvolutionalLayer doing our work, if fused
+    bool fusedOutputAvailable; // if fused, whether fusedInto's output is our output
+
     // [[[cog
     // import cog_addheaders
     // cog_addheaders.add()
@@ -78,6 +81,7 @@ public:
     VIRTUAL void backward();
     VIRTUAL std::string asString() const;
     VIRTUAL int getPersistSize(int version) const;
+    void fuseInto(Layer *convLayer, bool outputAvailable);
 
     // [[[end]]]
 };
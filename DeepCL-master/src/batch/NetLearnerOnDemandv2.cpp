@@ -57,6 +57,11 @@ VIRTUAL void NetLearnerOnDemandv2::setSchedule(int numEpochs) {
 VIRTUAL void NetLearnerOnDemandv2::setDumpTimings(bool dumpTimings) {
     this->dumpTimings = dumpTimings;
 }
+/// \brief load file batches ahead on a background thread, see OnDemandBatcherv2::setNumPrefetchBuffers
+PUBLICAPI VIRTUAL void NetLearnerOnDemandv2::setNumPrefetchBuffers(int numBuffers) {
+    learnBatcher->setNumPrefetchBuffers(numBuffers);
+    testBatcher->setNumPrefetchBuffers(numBuffers);
+}
 VIRTUAL void NetLearnerOnDemandv2::setSchedule(int numEpochs, int nextEpoch) {
     this->numEpochs = numEpochs;
     this->nextEpoch = nextEpoch;
@@ -107,6 +112,8 @@ VIRTUAL void NetLearnerOnDemandv2::postEpochTesting() {
 //    cout << "annealed learning rate: " << learnAction->getLearningRate()
     cout << " training loss: " << learnBatcher->getLoss() << endl;
     cout << " train accuracy: " << learnBatcher->getNumRight() << "/" << learnBatcher->getN() << " " << (learnBatcher->getNumRight() * 100.0f/ learnBatcher->getN()) << "%" << std::endl;
+    cout << " waiting for training data: " << learnBatcher->getStallMilliseconds() << " ms, "
+        << learnBatcher->getNumStalls() << " of " << learnBatcher->getNumTicks() << " file batches stalled" << endl;
     testBatcher->run(nextEpoch);
 //    int testNumRight = batchLearnerOnDemand.test(testFilepath, fileReadBatches, batchSize, Ntest);
     cout << "test accuracy: " << testBatcher->getNumRight() << "/" << testBatcher->getN() << " " << (testBatcher->getNumRight() * 100.0f / testBatcher->getN()) << "%" << endl;
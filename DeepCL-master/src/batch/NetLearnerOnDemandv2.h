@@ -71,6 +71,7 @@ public:
     VIRTUAL ~NetLearnerOnDemandv2();
     VIRTUAL void setSchedule(int numEpochs);
     VIRTUAL void setDumpTimings(bool dumpTimings);
+    PUBLICAPI VIRTUAL void setNumPrefetchBuffers(int numBuffers);
     VIRTUAL void setSchedule(int numEpochs, int nextEpoch);
     PUBLICAPI VIRTUAL bool getEpochDone();
     PUBLICAPI VIRTUAL int getNextEpoch();
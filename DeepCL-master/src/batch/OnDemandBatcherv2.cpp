@@ -8,6 +8,7 @@
 #include "net/Trainable.h"
 #include "loaders/GenericLoaderv2.h"
 #include "batch/Batcher.h"
+#include "util/Timer.h"
 
 #include "batch/OnDemandBatcherv2.h"
 
@@ -28,7 +29,14 @@ PUBLICAPI OnDemandBatcherv2::OnDemandBatcherv2(Trainable *net, NetAction *netAct
             fileReadBatches(fileReadBatches),
             batchSize(batchSize),
             fileBatchSize(batchSize * fileReadBatches),
-            inputCubeSize(net->getInputCubeSize())
+            inputCubeSize(net->getInputCubeSize()),
+            numPrefetchBuffers(0),
+            stopPrefetch(false),
+            numFilled(0),
+            readSlot(0),
+            writeSlot(0),
+            prefetchNextFileBatch(0),
+            expectedFileBatch(-1)
         {
     numFileBatches = (N + fileBatchSize - 1) / fileBatchSize;
     dataBuffer = new float[ fileBatchSize * inputCubeSize ];
@@ -37,10 +45,56 @@ PUBLICAPI OnDemandBatcherv2::OnDemandBatcherv2(Trainable *net, NetAction *netAct
     reset();
 }
 VIRTUAL OnDemandBatcherv2::~OnDemandBatcherv2() {
+    setNumPrefetchBuffers(0);
     delete netActionBatcher;
     delete[] dataBuffer;
     delete[] labelsBuffer;
 }
+/// \brief load file batches ahead, on a background thread, into a ring of this many buffers
+///
+/// Each buffer holds one file batch, ie fileReadBatches * batchSize examples.
+/// 0 turns prefetching off, and loads each file batch in tick(), as before.
+/// 1 would give no overlap, so is treated as 2.
+PUBLICAPI void OnDemandBatcherv2::setNumPrefetchBuffers(int numBuffers) {
+    if(numBuffers == 1) {
+        numBuffers = 2;
+    }
+    numBuffers = std::max(0, numBuffers);
+    if(numBuffers == numPrefetchBuffers) {
+        return;
+    }
+    stopPrefetchThread();
+    for(int i = 0; i < (int)prefetchData.size(); i++) {
+        delete[] prefetchData[i];
+        delete[] prefetchLabels[i];
+    }
+    prefetchData.clear();
+    prefetchLabels.clear();
+    numPrefetchBuffers = numBuffers;
+    for(int i = 0; i < numPrefetchBuffers; i++) {
+        prefetchData.push_back(new float[ fileBatchSize * inputCubeSize ]);
+        prefetchLabels.push_back(new int[ fileBatchSize ]);
+    }
+    if(numPrefetchBuffers == 0) {
+        netActionBatcher->setData(dataBuffer, labelsBuffer);
+    }
+}
+PUBLICAPI int OnDemandBatcherv2::getNumPrefetchBuffers() {
+    return numPrefetchBuffers;
+}
+/// \brief total time tick() spent waiting for data, since the last reset()
+///
+/// without prefetching, this is simply the time spent loading
+PUBLICAPI double OnDemandBatcherv2::getStallMilliseconds() {
+    return stallMilliseconds;
+}
+/// \brief how many ticks, since the last reset(), had to wait for data
+PUBLICAPI int OnDemandBatcherv2::getNumStalls() {
+    return numStalls;
+}
+PUBLICAPI int OnDemandBatcherv2::getNumTicks() {
+    return numTicks;
+}
 VIRTUAL void OnDemandBatcherv2::setBatchState(int nextBatch, int numRight, float loss) {
     this->nextFileBatch = nextBatch / fileReadBatches;
     this->numRight = numRight;
@@ -83,6 +137,9 @@ PUBLICAPI void OnDemandBatcherv2::reset() {
     loss = 0;
     nextFileBatch = 0;
     epochDone = false;
+    stallMilliseconds = 0;
+    numStalls = 0;
+    numTicks = 0;
 }
 PUBLICAPI bool OnDemandBatcherv2::tick(int epoch) {
 //    cout << "OnDemandBatcherv2::tick nextFileBatch=" << nextFileBatch << " numRight=" << numRight << 
@@ -93,16 +150,54 @@ PUBLICAPI bool OnDemandBatcherv2::tick(int epoch) {
     }
     int fileBatch = nextFileBatch;
     int fileBatchStart = fileBatch * fileBatchSize;
-    int thisFileBatchSize = fileBatchSize;
-    if(fileBatch == numFileBatches - 1) {
-        thisFileBatchSize = N - fileBatchStart;
-    }
-    netActionBatcher->setN(thisFileBatchSize);
+    netActionBatcher->setN(thisFileBatchSize(fileBatch));
+    numTicks++;
+    Timer stallTimer;
+    if(numPrefetchBuffers == 0) {
 //    cout << "batchlearnerondemand, read data... filebatchstart=" << fileBatchStart << " filebatchsize=" << thisFileBatchSize << endl;
-    loader->load(dataBuffer, labelsBuffer, fileBatchStart, thisFileBatchSize);
-    EpochResult epochResult = netActionBatcher->run(epoch);
-    loss += epochResult.loss;
-    numRight += epochResult.numRight;
+        loader->load(dataBuffer, labelsBuffer, fileBatchStart, thisFileBatchSize(fileBatch));
+        stallMilliseconds += stallTimer.lapMicroseconds() / 1000.0;
+        numStalls++;
+        EpochResult epochResult = netActionBatcher->run(epoch);
+        loss += epochResult.loss;
+        numRight += epochResult.numRight;
+    } else {
+        // setBatchState, or an abandoned epoch, can move us off the sequence
+        // the ring was loading, in which case start again from here
+        if(!prefetchThread.joinable() || fileBatch != expectedFileBatch) {
+            stopPrefetchThread();
+            startPrefetchThread(fileBatch);
+        }
+        int slot;
+        {
+            std::unique_lock<std::mutex> lock(prefetchMutex);
+            if(numFilled == 0 && !prefetchError) {
+                numStalls++;
+                while(numFilled == 0 && !prefetchError) {
+                    slotFilled.wait(lock);
+                }
+            }
+            if(numFilled == 0 && prefetchError) {
+                std::exception_ptr error = prefetchError;
+                lock.unlock();
+                stopPrefetchThread();
+                std::rethrow_exception(error);
+            }
+            slot = readSlot;
+        }
+        stallMilliseconds += stallTimer.lapMicroseconds() / 1000.0;
+        netActionBatcher->setData(prefetchData[slot], prefetchLabels[slot]);
+        EpochResult epochResult = netActionBatcher->run(epoch);
+        loss += epochResult.loss;
+        numRight += epochResult.numRight;
+        {
+            std::lock_guard<std::mutex> lock(prefetchMutex);
+            readSlot = (readSlot + 1) % numPrefetchBuffers;
+            numFilled--;
+        }
+        slotFreed.notify_one();
+        expectedFileBatch = (fileBatch + 1) % numFileBatches;
+    }
 
     nextFileBatch++;
     if(nextFileBatch == numFileBatches) {
@@ -121,4 +216,64 @@ PUBLICAPI EpochResult OnDemandBatcherv2::run(int epoch) {
     EpochResult epochResult(loss, numRight);
     return epochResult;
 }
-
+PRIVATE int OnDemandBatcherv2::thisFileBatchSize(int fileBatch) {
+    if(fileBatch == numFileBatches - 1) {
+        return N - fileBatch * fileBatchSize;
+    }
+    return fileBatchSize;
+}
+// waits for any load in progress to finish, then discards whatever was loaded
+PRIVATE void OnDemandBatcherv2::stopPrefetchThread() {
+    if(!prefetchThread.joinable()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(prefetchMutex);
+        stopPrefetch = true;
+    }
+    slotFreed.notify_all();
+    prefetchThread.join();
+    stopPrefetch = false;
+    numFilled = 0;
+    readSlot = 0;
+    writeSlot = 0;
+    expectedFileBatch = -1;
+    prefetchError = std::exception_ptr();
+}
+PRIVATE void OnDemandBatcherv2::startPrefetchThread(int fromFileBatch) {
+    prefetchNextFileBatch = fromFileBatch;
+    expectedFileBatch = fromFileBatch;
+    prefetchThread = std::thread(&OnDemandBatcherv2::prefetchLoop, this);
+}
+// runs on the background thread: keeps loading file batches in order, wrapping
+// round into the next epoch, until every slot is full, then waits for tick()
+// to release one
+PRIVATE void OnDemandBatcherv2::prefetchLoop() {
+    std::unique_lock<std::mutex> lock(prefetchMutex);
+    while(true) {
+        while(!stopPrefetch && numFilled == numPrefetchBuffers) {
+            slotFreed.wait(lock);
+        }
+        if(stopPrefetch) {
+            return;
+        }
+        const int slot = writeSlot;
+        const int fileBatch = prefetchNextFileBatch;
+        lock.unlock();
+        try {
+            loader->loadFromBackgroundThread(prefetchData[slot], prefetchLabels[slot],
+                fileBatch * fileBatchSize, thisFileBatchSize(fileBatch));
+        } catch(...) {
+            lock.lock();
+            prefetchError = std::current_exception();
+            lock.unlock();
+            slotFilled.notify_one();
+            return;
+        }
+        lock.lock();
+        writeSlot = (writeSlot + 1) % numPrefetchBuffers;
+        prefetchNextFileBatch = (fileBatch + 1) % numFileBatches;
+        numFilled++;
+        slotFilled.notify_one();
+    }
+}
@@ -6,6 +6,12 @@
 
 #pragma once
 
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+
 //#include "net/Trainable.h"
 //#include "BatchLearner.h"
 
@@ -31,6 +37,12 @@ class GenericLoaderv2;
 ///
 /// compared to v1, v2 recevies a GenericLoaderv2 loader object, instead of a filepath
 /// so we can handle imagenet manifests etc
+///
+/// By default each tick loads its file batch, then runs it.  After
+/// setNumPrefetchBuffers(n), a background thread instead keeps up to n-1 file
+/// batches loaded ahead, in a ring of n buffers, so loading overlaps with
+/// running.  Either way, getStallMilliseconds() reports how long ticks spent
+/// waiting for data, since the last reset().
 PUBLICAPI
 class OnDemandBatcherv2 {
 protected:
@@ -57,6 +69,27 @@ protected:
     float loss;
     int nextFileBatch;
 
+    // prefetch ring; only used when numPrefetchBuffers > 0
+    int numPrefetchBuffers;
+    std::vector<float *> prefetchData;
+    std::vector<int *> prefetchLabels;
+    std::thread prefetchThread;
+    std::mutex prefetchMutex;
+    std::condition_variable slotFilled;
+    std::condition_variable slotFreed;
+    std::exception_ptr prefetchError;
+    bool stopPrefetch;
+    int numFilled; // slots loaded and not yet released, including the one being run
+    int readSlot;
+    int writeSlot;
+    int prefetchNextFileBatch; // next file batch the background thread will load
+    int expectedFileBatch; // file batch at readSlot, if the ring is in sequence
+
+    // stall counters, since last reset()
+    double stallMilliseconds;
+    int numStalls;
+    int numTicks;
+
 public:
 
     // [[[cog
@@ -67,6 +100,11 @@ public:
     PUBLICAPI OnDemandBatcherv2(Trainable *net, NetAction *netAction,
     GenericLoaderv2 *loader, int N, int fileReadBatches, int batchSize);
     VIRTUAL ~OnDemandBatcherv2();
+    PUBLICAPI void setNumPrefetchBuffers(int numBuffers);
+    PUBLICAPI int getNumPrefetchBuffers();
+    PUBLICAPI double getStallMilliseconds();
+    PUBLICAPI int getNumStalls();
+    PUBLICAPI int getNumTicks();
     VIRTUAL void setBatchState(int nextBatch, int numRight, float loss);
     VIRTUAL int getBatchSize();
     PUBLICAPI VIRTUAL int getNextFileBatch();
@@ -78,6 +116,10 @@ public:
     PUBLICAPI void reset();
     PUBLICAPI bool tick(int epoch);
     PUBLICAPI EpochResult run(int epoch);
+    void stopPrefetchThread();
+    void startPrefetchThread(int fromFileBatch);
+    void prefetchLoop();
+    int thisFileBatchSize(int fileBatch);
 
     // [[[end]]]
 };
@@ -0,0 +1,226 @@
+// Copyright Hugh Perkins 2016 hughperkins at gmail
+//
+// This Source Code Form is subject to the terms of the Mozilla Public License,
+// v. 2.0. If a copy of the MPL was not distributed with this file, You can
+// obtain one at http://mozilla.org/MPL/2.0/.
+
+#include <iostream>
+#include <stdexcept>
+#include <algorithm>
+
+#include "EasyCL.h"
+#include "CLFloatWrapper.h"
+#include "util/stringhelper.h"
+#include "util/StatefulTimer.h"
+#include "templates/LuaTemplater.h"
+#include "clmath/CLMathWrapper.h"
+#include "clmath/CLMathExpr.h"
+#include "util/ProgramCache.h"
+
+using namespace std;
+
+#undef STATIC
+#undef VIRTUAL
+#define STATIC
+#define VIRTUAL
+
+// one of: a buffer, a scalar, a function of one, or an operator on two
+struct CLMathExpr::Node {
+    enum Kind { Buffer, Scalar, Unary, Binary } kind;
+    std::string op; // function name, or operator, for Unary and Binary
+    CLFloatWrapper *wrapper;
+    float scalar;
+    std::shared_ptr<Node> one;
+    std::shared_ptr<Node> two;
+};
+
+namespace {
+    // writes node as OpenCL, numbering the buffers and scalars in the order
+    // first seen.  The same buffer twice is one argument
+    std::string generate(const CLMathExpr::Node *node, CLFloatWrapper *target,
+            std::vector<CLFloatWrapper *> &inputs, std::vector<float> &scalars) {
+        switch(node->kind) {
+            case CLMathExpr::Node::Buffer: {
+                if(node->wrapper == target) {
+                    return "target[globalId]";
+                }
+                int index = (int)(find(inputs.begin(), inputs.end(), node->wrapper) - inputs.begin());
+                if(index == (int)inputs.size()) {
+                    inputs.push_back(node->wrapper);
+                }
+                return "in" + toString(index) + "[globalId]";
+            }
+            case CLMathExpr::Node::Scalar:
+                scalars.push_back(node->scalar);
+                return "s" + toString((int)scalars.size() - 1);
+            case CLMathExpr::Node::Unary:
+                return node->op + "(" + generate(node->one.get(), target, inputs, scalars) + ")";
+            default: {
+                // one before two, so the numbering follows the expression
+                string one = generate(node->one.get(), target, inputs, scalars);
+                string two = generate(node->two.get(), target, inputs, scalars);
+                return "(" + one + " " + node->op + " " + two + ")";
+            }
+        }
+    }
+}
+
+PUBLIC CLMathExpr::CLMathExpr(const CLMathWrapper &wrapper) :
+        root(new Node()),
+        N(wrapper.N) {
+    root->kind = Node::Buffer;
+    root->wrapper = wrapper.wrapper;
+}
+// the first N elements of wrapper, eg a layer buffer allocated for a larger
+// batch than the current one
+PUBLIC CLMathExpr::CLMathExpr(CLWrapper *wrapper, int N) :
+        root(new Node()),
+        N(N) {
+    CLFloatWrapper *floatWrapper = dynamic_cast< CLFloatWrapper * >(wrapper);
+    if(floatWrapper == 0) {
+        throw runtime_error("CLMathExpr only works on CLFloatWrapper objects");
+    }
+    if(N > floatWrapper->size()) {
+        throw runtime_error("CLMathExpr, " + toString(N) + " elements requested from a buffer of " + toString(floatWrapper->size()));
+    }
+    root->kind = Node::Buffer;
+    root->wrapper = floatWrapper;
+}
+PUBLIC CLMathExpr::CLMathExpr(float scalar) :
+        root(new Node()),
+        N(-1) {
+    root->kind = Node::Scalar;
+    root->scalar = scalar;
+}
+PUBLIC int CLMathExpr::getN() const {
+    return N;
+}
+// same as CLMathWrapper::sqrt(), ie native_sqrt
+PUBLIC CLMathExpr CLMathExpr::sqrt() const {
+    return unary("native_sqrt");
+}
+PUBLIC CLMathExpr CLMathExpr::inv() const {
+    return unary("inv");
+}
+PUBLIC CLMathExpr CLMathExpr::squared() const {
+    return unary("squared");
+}
+PUBLIC CLMathExpr CLMathExpr::negated() const {
+    return unary("-");
+}
+// op is one of + - * /
+PUBLIC CLMathExpr CLMathExpr::binary(std::string op, const CLMathExpr &two) const {
+    if(N != -1 && two.N != -1 && N != two.N) {
+        throw runtime_error("CLMathExpr " + op + ", array size mismatch: " + toString(N) + " vs " + toString(two.N));
+    }
+    CLMathExpr result;
+    result.root->kind = Node::Binary;
+    result.root->op = op;
+    result.root->one = root;
+    result.root->two = two.root;
+    result.N = N != -1 ? N : two.N;
+    return result;
+}
+// target[i] = this, for each i, as one kernel.  target may appear in the
+// expression
+PUBLIC void CLMathExpr::assignTo(EasyCL *cl, CLFloatWrapper *target, int targetN) const {
+    if(N != -1 && N != targetN) {
+        throw runtime_error("CLMathExpr assign, array size mismatch: " + toString(N) + " vs " + toString(targetN));
+    }
+    StatefulTimer::instance()->timeCheck("CLMathExpr::assignTo start");
+    vector<CLFloatWrapper *> inputs;
+    vector<float> scalars;
+    string expression = generate(root.get(), target, inputs, scalars);
+    string kernelName = "CLMathExpr " + expression;
+    CLKernel *kernel = 0;
+    if(cl->kernelExists(kernelName)) {
+        kernel = cl->getKernel(kernelName);
+    } else {
+        string args = "";
+        for(int i = 0; i < (int)inputs.size(); i++) {
+            args += ", global const float *in" + toString(i);
+        }
+        for(int i = 0; i < (int)scalars.size(); i++) {
+            args += ", const float s" + toString(i);
+        }
+
+        // [[[cog
+        // import stringify
+        // stringify.write_kernel("kernel", "cl/per_element_expr.cl")
+        // ]]]
+        // generated using cog, from cl/per_element_expr.cl:
+        const char * kernelSource =  
+        "// Copyright Hugh Perkins 2016 hughperkins at gmail\n"
+        "//\n"
+        "// This Source Code Form is subject to the terms of the Mozilla Public License,\n"
+        "// v. 2.0. If a copy of the MPL was not distributed with this file, You can\n"
+        "// obtain one at http://mozilla.org/MPL/2.0/.\n"
+        "\n"
+        "// one whole CLMathExpr, evaluated per element.  args are the other buffers,\n"
+        "// in0, in1, ..., then the scalars, s0, s1, ....  expression reads\n"
+        "// target[globalId] if the expression uses the buffer being assigned to\n"
+        "\n"
+        "static float squared(float val_one) {\n"
+        "    return val_one * val_one;\n"
+        "}\n"
+        "\n"
+        "static float inv(float val_one) {\n"
+        "    return 1.0f / val_one;\n"
+        "}\n"
+        "\n"
+        "kernel void per_element_expr(const int N, global float *target{{args}}) {\n"
+        "    const int globalId = get_global_id(0);\n"
+        "    if (globalId >= N) {\n"
+        "        return;\n"
+        "    }\n"
+        "    target[globalId] = {{expression}};\n"
+        "}\n"
+        "";
+        // [[[end]]]
+        LuaTemplater templater;
+        templater.set("args", args);
+        templater.set("expression", expression);
+        string renderedKernel = templater.render(kernelSource);
+        kernel = ProgramCache::buildKernelFromString(cl, renderedKernel, "per_element_expr", "", "cl/per_element_expr.cl");
+        cl->storeKernel(kernelName, kernel, true);
+    }
+    kernel->in(targetN);
+    kernel->inout(target);
+    for(int i = 0; i < (int)inputs.size(); i++) {
+        kernel->in(inputs[i]);
+    }
+    for(int i = 0; i < (int)scalars.size(); i++) {
+        kernel->in(scalars[i]);
+    }
+    int workgroupSize = 64;
+    int numWorkgroups = (targetN + workgroupSize - 1) / workgroupSize;
+    kernel->run_1d(numWorkgroups * workgroupSize, workgroupSize);
+    StatefulTimer::instance()->timeCheck("CLMathExpr::assignTo end");
+}
+PRIVATE CLMathExpr::CLMathExpr() :
+        root(new Node()),
+        N(-1) {
+}
+PRIVATE CLMathExpr CLMathExpr::unary(std::string function) const {
+    CLMathExpr result;
+    result.root->kind = Node::Unary;
+    result.root->op = function;
+    result.root->one = root;
+    result.N = N;
+    return result;
+}
+CLMathExpr operator-(const CLMathExpr &one) {
+    return one.negated();
+}
+CLMathExpr operator+(const CLMathExpr &one, const CLMathExpr &two) {
+    return one.binary("+", two);
+}
+CLMathExpr operator-(const CLMathExpr &one, const CLMathExpr &two) {
+    return one.binary("-", two);
+}
+CLMathExpr operator*(const CLMathExpr &one, const CLMathExpr &two) {
+    return one.binary("*", two);
+}
+CLMathExpr operator/(const CLMathExpr &one, const CLMathExpr &two) {
+    return one.binary("/", two);
+}
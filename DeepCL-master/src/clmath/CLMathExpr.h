@@ -0,0 +1,84 @@
+// Copyright Hugh Perkins 2016 hughperkins at gmail
+//
+// This Source Code Form is subject to the terms of the Mozilla Public License,
+// v. 2.0. If a copy of the MPL was not distributed with this file, You can
+// obtain one at http://mozilla.org/MPL/2.0/.
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+
+class CLMathWrapper;
+class CLWrapper;
+class CLFloatWrapper;
+class EasyCL;
+
+#include "DeepCLDllExport.h"
+
+#define VIRTUAL virtual
+#define STATIC static
+
+// A deferred per-element expression over CLMathWrappers and scalars.
+//
+// Arithmetic on CLMathWrappers, or on expressions, builds a tree, and does no
+// work on the gpu.  Assigning the tree to a CLMathWrapper turns it into one
+// generated kernel, from cl/per_element_expr.cl, so the whole chain is one
+// launch and one pass over memory, eg
+//
+//   working = (gradWeights * gradWeights * (1 - decay) + sumSquares * decay).sqrt().inv();
+//
+// instead of a copy, and one launch per operator, using the in-place operators.
+// Kernels are cached in the EasyCL object by the generated expression, which
+// has the scalars as kernel arguments, so changing eg a learning rate doesnt
+// rebuild anything.
+//
+// Operands are read when the expression is assigned, not when it is built.
+// CLMathWrapper's own sqrt(), inv() and squared() still run at once, in
+// place; to defer them, start from an expression, eg CLMathExpr(b).squared().
+class DeepCL_EXPORT CLMathExpr {
+public:
+    struct Node;
+
+private:
+    #ifdef _WIN32
+    #pragma warning(disable: 4251)
+    #endif
+    std::shared_ptr<Node> root;
+    #ifdef _WIN32
+    #pragma warning(default: 4251)
+    #endif
+    int N; // -1 if there are no buffers, only scalars
+
+    // [[[cog
+    // import cog_addheaders
+    // cog_addheaders.addv2()
+    // ]]]
+    // generated, using cog:
+
+    public:
+    CLMathExpr(const CLMathWrapper &wrapper);
+    CLMathExpr(CLWrapper *wrapper, int N);
+    CLMathExpr(float scalar);
+    int getN() const;
+    CLMathExpr sqrt() const;
+    CLMathExpr inv() const;
+    CLMathExpr squared() const;
+    CLMathExpr negated() const;
+    CLMathExpr binary(std::string op, const CLMathExpr &two) const;
+    void assignTo(EasyCL *cl, CLFloatWrapper *target, int targetN) const;
+
+    private:
+    CLMathExpr();
+    CLMathExpr unary(std::string function) const;
+
+    // [[[end]]]
+};
+
+DeepCL_EXPORT CLMathExpr operator-(const CLMathExpr &one);
+DeepCL_EXPORT CLMathExpr operator+(const CLMathExpr &one, const CLMathExpr &two);
+DeepCL_EXPORT CLMathExpr operator-(const CLMathExpr &one, const CLMathExpr &two);
+DeepCL_EXPORT CLMathExpr operator*(const CLMathExpr &one, const CLMathExpr &two);
+DeepCL_EXPORT CLMathExpr operator/(const CLMathExpr &one, const CLMathExpr &two);
+
@@ -11,6 +11,7 @@
 #include "util/stringhelper.h"
 #include "clmath/GpuOp.h"
 #include "clmath/CLMathWrapper.h"
+#include "clmath/CLMathExpr.h"
 
 using namespace std;
 
@@ -70,6 +71,19 @@ VIRTUAL CLMathWrapper &CLMathWrapper::operator=(const CLMathWrapper &rhs) {
     gpuOp->apply2_inplace(N, wrapper, ((CLMathWrapper &)rhs).wrapper, &op);
     return *this;
 }
+// evaluates the whole expression as one kernel
+VIRTUAL CLMathWrapper &CLMathWrapper::operator=(const CLMathExpr &expr) {
+    expr.assignTo(cl, wrapper, N);
+    return *this;
+}
+VIRTUAL CLMathWrapper &CLMathWrapper::operator+=(const CLMathExpr &expr) {
+    (CLMathExpr(*this) + expr).assignTo(cl, wrapper, N);
+    return *this;
+}
+VIRTUAL CLMathWrapper &CLMathWrapper::operator*=(const CLMathExpr &expr) {
+    (CLMathExpr(*this) * expr).assignTo(cl, wrapper, N);
+    return *this;
+}
 VIRTUAL CLMathWrapper &CLMathWrapper::sqrt() {
     Op1Sqrt op;
     gpuOp->apply1_inplace(N, wrapper, &op);
@@ -18,6 +18,7 @@ class GpuOp;
 class CLFloatBuffer;
 class EasyCL;
 class CLKernel;
+class CLMathExpr;
 
 #include "DeepCLDllExport.h"
 
@@ -25,7 +26,13 @@ class CLKernel;
 // like per-element add, inplace scalar multiply etc
 // a bit basic for now.  can extend gradually :-)
 // something to consider: pros/cons of using eg clBLAS instead?
+//
+// The operators below each run at once, as one kernel.  For a chain, build a
+// CLMathExpr instead, eg a = (b * c + 0.5f).sqrt(), which runs as one kernel
+// on assignment
 class DeepCL_EXPORT CLMathWrapper {
+    friend class CLMathExpr;
+
     EasyCL *cl; // dont delete
     GpuOp *gpuOp;
 
@@ -46,6 +53,9 @@ public:
     VIRTUAL CLMathWrapper &operator*=(const CLMathWrapper &two);
     VIRTUAL CLMathWrapper &operator+=(const CLMathWrapper &two);
     VIRTUAL CLMathWrapper &operator=(const CLMathWrapper &rhs);
+    VIRTUAL CLMathWrapper &operator=(const CLMathExpr &expr);
+    VIRTUAL CLMathWrapper &operator+=(const CLMathExpr &expr);
+    VIRTUAL CLMathWrapper &operator*=(const CLMathExpr &expr);
     VIRTUAL CLMathWrapper &sqrt();
     VIRTUAL CLMathWrapper &inv();
     VIRTUAL CLMathWrapper &squared();
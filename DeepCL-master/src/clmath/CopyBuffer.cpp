@@ -9,6 +9,7 @@
 #include "EasyCL.h"
 #include "util/StatefulTimer.h"
 #include "clmath/CopyBuffer.h"
+#include "util/ProgramCache.h"
 
 using namespace std;
 
@@ -113,7 +114,7 @@ CopyBuffer::CopyBuffer(EasyCL *cl) :
     "}\n"
     "\n"
     "";
-    kernel = cl->buildKernelFromString(kernelSource, "copy", options, "cl/copy.cl");
+    kernel = ProgramCache::buildKernelFromString(cl, kernelSource, "copy", options, "cl/copy.cl");
     // [[[end]]]
     cl->storeKernel(kernelName, kernel, true);
     this->kernel = kernel;
@@ -0,0 +1,99 @@
+// Copyright Hugh Perkins 2016 hughperkins at gmail
+//
+// This Source Code Form is subject to the terms of the Mozilla Public License,
+// v. 2.0. If a copy of the MPL was not distributed with this file, You can
+// obtain one at http://mozilla.org/MPL/2.0/.
+
+#include <iostream>
+
+#include "EasyCL.h"
+#include "util/StatefulTimer.h"
+#include "clmath/EnsembleSoftMax.h"
+#include "util/ProgramCache.h"
+
+using namespace std;
+
+#undef STATIC
+#undef VIRTUAL
+#define STATIC
+#define VIRTUAL
+
+// segments are contiguous, each segmentSize floats long
+// doesnt call finish(), so members can be queued back to back; the caller
+// reads out back, which waits for the queue anyway
+VIRTUAL void EnsembleSoftMax::accumulate(int numSegments, int segmentSize, float weight, bool first, CLWrapper *logits, CLWrapper *out) {
+    kernel  ->in(numSegments)
+            ->in(segmentSize)
+            ->in(weight)
+            ->in(first ? 1 : 0)
+            ->in(logits)
+            ->out(out);
+
+    int globalSize = numSegments;
+    int workgroupSize = 64;
+    int numWorkgroups = (globalSize + workgroupSize - 1) / workgroupSize;
+    kernel->run_1d(numWorkgroups * workgroupSize, workgroupSize);
+
+    StatefulTimer::instance()->timeCheck("EnsembleSoftMax::accumulate end");
+}
+VIRTUAL EnsembleSoftMax::~EnsembleSoftMax() {
+}
+EnsembleSoftMax::EnsembleSoftMax(EasyCL *cl) :
+        cl(cl) {
+    std::string kernelName = "ensemble_softmax.accumulate";
+    if(cl->kernelExists(kernelName) ) {
+        this->kernel = cl->getKernel(kernelName);
+        return;
+    }
+    string options = "";
+
+    // [[[cog
+    // import stringify
+    // stringify.write_kernel2("kernel", "cl/ensemble_softmax.cl", "accumulate", 'options')
+    // ]]]
+    // generated using cog, from cl/ensemble_softmax.cl:
+    const char * kernelSource =  
+    "// Copyright Hugh Perkins 2016 hughperkins at gmail\n"
+    "//\n"
+    "// This Source Code Form is subject to the terms of the Mozilla Public License,\n"
+    "// v. 2.0. If a copy of the MPL was not distributed with this file, You can\n"
+    "// obtain one at http://mozilla.org/MPL/2.0/.\n"
+    "\n"
+    "// softmaxes each segment of one ensemble member's logits, and adds weight times\n"
+    "// the result into out.  one workitem per segment, where a segment is the\n"
+    "// softmax unit: numPlanes values per example, or one plane, for per-plane softmax\n"
+    "// if first is non-zero, out is overwritten, rather than added to\n"
+    "kernel void accumulate(\n"
+    "        const int numSegments,\n"
+    "        const int segmentSize,\n"
+    "        const float weight,\n"
+    "        const int first,\n"
+    "        global const float *logits,\n"
+    "        global float *out) {\n"
+    "    const int segment = get_global_id(0);\n"
+    "    if (segment >= numSegments) {\n"
+    "        return;\n"
+    "    }\n"
+    "    global const float *segmentIn = logits + segment * segmentSize;\n"
+    "    global float *segmentOut = out + segment * segmentSize;\n"
+    "    float maxValue = segmentIn[0];\n"
+    "    for (int i = 1; i < segmentSize; i++) {\n"
+    "        maxValue = max(maxValue, segmentIn[i]);\n"
+    "    }\n"
+    "    float denominator = 0;\n"
+    "    for (int i = 0; i < segmentSize; i++) {\n"
+    "        denominator += exp(segmentIn[i] - maxValue);\n"
+    "    }\n"
+    "    const float multiplier = weight / denominator;\n"
+    "    for (int i = 0; i < segmentSize; i++) {\n"
+    "        float probability = multiplier * exp(segmentIn[i] - maxValue);\n"
+    "        segmentOut[i] = first ? probability : segmentOut[i] + probability;\n"
+    "    }\n"
+    "}\n"
+    "\n"
+    "";
+    kernel = ProgramCache::buildKernelFromString(cl, kernelSource, "accumulate", options, "cl/ensemble_softmax.cl");
+    // [[[end]]]
+    cl->storeKernel(kernelName, kernel, true);
+    this->kernel = kernel;
+}
@@ -0,0 +1,39 @@
+// Copyright Hugh Perkins 2016 hughperkins at gmail
+//
+// This Source Code Form is subject to the terms of the Mozilla Public License,
+// v. 2.0. If a copy of the MPL was not distributed with this file, You can
+// obtain one at http://mozilla.org/MPL/2.0/.
+
+#pragma once
+
+#include <stdexcept>
+#include <string>
+#include <iostream>
+#include <algorithm>
+
+class EasyCL;
+class CLKernel;
+class CLWrapper;
+
+#define VIRTUAL virtual
+#define STATIC static
+
+// softmaxes one ensemble member's logits on the gpu, and adds them, weighted,
+// into a running average, so MultiNet only needs to read back the average
+class EnsembleSoftMax {
+public:
+    EasyCL *cl;
+    CLKernel *kernel;
+
+    // [[[cog
+    // import cog_addheaders
+    // cog_addheaders.add()
+    // ]]]
+    // generated, using cog:
+    VIRTUAL void accumulate(int numSegments, int segmentSize, float weight, bool first, CLWrapper *logits, CLWrapper *out);
+    VIRTUAL ~EnsembleSoftMax();
+    EnsembleSoftMax(EasyCL *cl);
+
+    // [[[end]]]
+};
+
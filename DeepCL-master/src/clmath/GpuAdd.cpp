@@ -9,6 +9,7 @@
 #include "util/StatefulTimer.h"
 #include "EasyCL.h"
 #include "clmath/GpuAdd.h"
+#include "util/ProgramCache.h"
 
 using namespace std;
 
@@ -85,7 +86,7 @@ GpuAdd::GpuAdd(EasyCL *cl) :
     "}\n"
     "\n"
     "";
-    kernel = cl->buildKernelFromString(kernelSource, "per_element_add", options, "cl/per_element_add.cl");
+    kernel = ProgramCache::buildKernelFromString(cl, kernelSource, "per_element_add", options, "cl/per_element_add.cl");
     // [[[end]]]
     cl->storeKernel(kernelName, kernel, true);
     this->kernel = kernel;
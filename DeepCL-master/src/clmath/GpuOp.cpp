@@ -10,6 +10,7 @@
 #include "EasyCL.h"
 #include "clmath/GpuOp.h"
 #include "templates/LuaTemplater.h"
+#include "util/ProgramCache.h"
 
 using namespace std;
 
@@ -170,7 +171,7 @@ void GpuOp::buildKernel(std::string name, Op2 *op, bool inPlace) {
     if(inPlace) {
         clKernelName = "per_element_op2_inplace";
     }
-    kernel = cl->buildKernelFromString(renderedKernel, clKernelName, "", "cl/per_element_op2.cl");
+    kernel = ProgramCache::buildKernelFromString(cl, renderedKernel, clKernelName, "", "cl/per_element_op2.cl");
     cl->storeKernel(name, kernel, true);
 }
 void GpuOp::buildKernel(std::string name, Op1 *op, bool inPlace) {
@@ -219,7 +220,7 @@ void GpuOp::buildKernel(std::string name, Op1 *op, bool inPlace) {
     if(inPlace) {
         clKernelName = "per_element_op1_inplace";
     }
-    kernel = cl->buildKernelFromString(renderedKernel, clKernelName, "", "cl/per_element_op1.cl");
+    kernel = ProgramCache::buildKernelFromString(cl, renderedKernel, clKernelName, "", "cl/per_element_op1.cl");
     cl->storeKernel(name, kernel, true);
 }
 void GpuOp::buildKernelScalar(std::string name, Op2 *op, bool inPlace) {
@@ -268,7 +269,7 @@ void GpuOp::buildKernelScalar(std::string name, Op2 *op, bool inPlace) {
     if(inPlace) {
         clKernelName = "per_element_op2_inplace";
     }
-    kernel = cl->buildKernelFromString(renderedKernel, clKernelName, "", "cl/per_element_op2_scalar.cl");
+    kernel = ProgramCache::buildKernelFromString(cl, renderedKernel, clKernelName, "", "cl/per_element_op2_scalar.cl");
     cl->storeKernel(name, kernel, true);
 }
 
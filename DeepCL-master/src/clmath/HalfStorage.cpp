@@ -0,0 +1,222 @@
+// Copyright Hugh Perkins 2016 hughperkins at gmail
+//
+// This Source Code Form is subject to the terms of the Mozilla Public License,
+// v. 2.0. If a copy of the MPL was not distributed with this file, You can
+// obtain one at http://mozilla.org/MPL/2.0/.
+
+#include <iostream>
+#include <cstring>
+#include <cmath>
+
+#include "EasyCL.h"
+#include "util/StatefulTimer.h"
+#include "clmath/HalfStorage.h"
+#include "util/ProgramCache.h"
+
+using namespace std;
+
+#undef STATIC
+#undef VIRTUAL
+#define STATIC
+#define VIRTUAL
+
+VIRTUAL HalfStorage::~HalfStorage() {
+    delete scratchWrapper;
+    delete[] scratch;
+}
+// halfWrapper should be an int buffer of at least halfBufferSize(N)
+VIRTUAL void HalfStorage::pack(int N, CLWrapper *floatWrapper, CLWrapper *halfWrapper) {
+    packKernel->in(N)
+        ->in(floatWrapper)
+        ->out(halfWrapper);
+    int workgroupSize = 64;
+    int numWorkgroups = (N + workgroupSize - 1) / workgroupSize;
+    packKernel->run_1d(numWorkgroups * workgroupSize, workgroupSize);
+    cl->finish();
+    StatefulTimer::instance()->timeCheck("HalfStorage::pack end");
+}
+VIRTUAL void HalfStorage::unpack(int N, CLWrapper *halfWrapper, CLWrapper *floatWrapper) {
+    unpackKernel->in(N)
+        ->in(halfWrapper)
+        ->out(floatWrapper);
+    int workgroupSize = 64;
+    int numWorkgroups = (N + workgroupSize - 1) / workgroupSize;
+    unpackKernel->run_1d(numWorkgroups * workgroupSize, workgroupSize);
+    StatefulTimer::instance()->timeCheck("HalfStorage::unpack end");
+}
+// the result is only valid until the next call, by anyone.  since the queue is
+// in order, kernels enqueued before that next call will still see it
+VIRTUAL CLWrapper *HalfStorage::unpackToScratch(int N, CLWrapper *halfWrapper) {
+    if(N > scratchSize) {
+        delete scratchWrapper;
+        delete[] scratch;
+        scratchSize = N;
+        scratch = new float[scratchSize];
+        scratchWrapper = cl->wrap(scratchSize, scratch);
+        scratchWrapper->createOnDevice();
+    }
+    unpack(N, halfWrapper, scratchWrapper);
+    return scratchWrapper;
+}
+// number of ints needed to hold N halfs
+STATIC int HalfStorage::halfBufferSize(int N) {
+    return (N + 1) / 2;
+}
+// round to nearest even, like vstore_half_rte
+STATIC unsigned short HalfStorage::floatToHalf(float value) {
+    unsigned int bits;
+    memcpy(&bits, &value, sizeof(bits));
+    unsigned int sign = (bits >> 16) & 0x8000;
+    int floatExponent = (bits >> 23) & 0xff;
+    unsigned int mantissa = bits & 0x7fffff;
+    if(floatExponent == 0xff) { // inf or nan
+        return (unsigned short)(sign | 0x7c00 | (mantissa != 0 ? 0x200 : 0));
+    }
+    int exponent = floatExponent - 127 + 15;
+    if(exponent >= 31) {
+        return (unsigned short)(sign | 0x7c00);
+    }
+    if(exponent <= 0) {
+        // subnormal half, or zero
+        if(exponent < -10) {
+            return (unsigned short)sign;
+        }
+        mantissa |= 0x800000;
+        int shift = 14 - exponent;
+        unsigned int halfMantissa = mantissa >> shift;
+        unsigned int remainder = mantissa & ((1u << shift) - 1);
+        unsigned int halfway = 1u << (shift - 1);
+        if(remainder > halfway || (remainder == halfway && (halfMantissa & 1))) {
+            halfMantissa++;
+        }
+        return (unsigned short)(sign | halfMantissa);
+    }
+    unsigned int half = sign | (exponent << 10) | (mantissa >> 13);
+    unsigned int remainder = mantissa & 0x1fff;
+    // a carry out of the mantissa correctly bumps the exponent, up to inf
+    if(remainder > 0x1000 || (remainder == 0x1000 && (half & 1))) {
+        half++;
+    }
+    return (unsigned short)half;
+}
+STATIC float HalfStorage::halfToFloat(unsigned short value) {
+    unsigned int sign = (value & 0x8000) << 16;
+    int exponent = (value >> 10) & 0x1f;
+    unsigned int mantissa = value & 0x3ff;
+    if(exponent == 0) {
+        float result = ldexp((float)mantissa, -24);
+        return sign != 0 ? -result : result;
+    }
+    unsigned int bits = 0;
+    if(exponent == 31) {
+        bits = sign | 0x7f800000 | (mantissa << 13);
+    } else {
+        bits = sign | ((exponent - 15 + 127) << 23) | (mantissa << 13);
+    }
+    float result;
+    memcpy(&result, &bits, sizeof(result));
+    return result;
+}
+// what value will read back as, after a round trip through half storage
+STATIC float HalfStorage::roundToHalf(float value) {
+    return halfToFloat(floatToHalf(value));
+}
+HalfStorage::HalfStorage(EasyCL *cl) :
+        cl(cl),
+        packKernel(0),
+        unpackKernel(0),
+        scratch(0),
+        scratchWrapper(0),
+        scratchSize(0) {
+    if(cl->kernelExists("half_storage.pack")) {
+        packKernel = cl->getKernel("half_storage.pack");
+        unpackKernel = cl->getKernel("half_storage.unpack");
+        return;
+    }
+    string options = "";
+
+    // [[[cog
+    // import stringify
+    // stringify.write_kernel2("packKernel", "cl/half_storage.cl", "pack", 'options')
+    // ]]]
+    // generated using cog, from cl/half_storage.cl:
+    const char * packKernelSource =  
+    "// Copyright Hugh Perkins 2016 hughperkins at gmail\n"
+    "//\n"
+    "// This Source Code Form is subject to the terms of the Mozilla Public License,\n"
+    "// v. 2.0. If a copy of the MPL was not distributed with this file, You can\n"
+    "// obtain one at http://mozilla.org/MPL/2.0/.\n"
+    "\n"
+    "// converts between float buffers, and buffers holding half-precision values\n"
+    "// uses vload_half / vstore_half, which dont need cl_khr_fp16, so this works\n"
+    "// on any device; the arithmetic stays in float\n"
+    "\n"
+    "kernel void pack(\n"
+    "        const int N,\n"
+    "        global const float *in,\n"
+    "        global half *out) {\n"
+    "    const int globalId = get_global_id(0);\n"
+    "    if (globalId >= N) {\n"
+    "        return;\n"
+    "    }\n"
+    "    vstore_half_rte(in[globalId], globalId, out);\n"
+    "}\n"
+    "\n"
+    "kernel void unpack(\n"
+    "        const int N,\n"
+    "        global const half *in,\n"
+    "        global float *out) {\n"
+    "    const int globalId = get_global_id(0);\n"
+    "    if (globalId >= N) {\n"
+    "        return;\n"
+    "    }\n"
+    "    out[globalId] = vload_half(globalId, in);\n"
+    "}\n"
+    "\n"
+    "";
+    packKernel = ProgramCache::buildKernelFromString(cl, packKernelSource, "pack", options, "cl/half_storage.cl");
+    // [[[end]]]
+    // [[[cog
+    // import stringify
+    // stringify.write_kernel2("unpackKernel", "cl/half_storage.cl", "unpack", 'options')
+    // ]]]
+    // generated using cog, from cl/half_storage.cl:
+    const char * unpackKernelSource =  
+    "// Copyright Hugh Perkins 2016 hughperkins at gmail\n"
+    "//\n"
+    "// This Source Code Form is subject to the terms of the Mozilla Public License,\n"
+    "// v. 2.0. If a copy of the MPL was not distributed with this file, You can\n"
+    "// obtain one at http://mozilla.org/MPL/2.0/.\n"
+    "\n"
+    "// converts between float buffers, and buffers holding half-precision values\n"
+    "// uses vload_half / vstore_half, which dont need cl_khr_fp16, so this works\n"
+    "// on any device; the arithmetic stays in float\n"
+    "\n"
+    "kernel void pack(\n"
+    "        const int N,\n"
+    "        global const float *in,\n"
+    "        global half *out) {\n"
+    "    const int globalId = get_global_id(0);\n"
+    "    if (globalId >= N) {\n"
+    "        return;\n"
+    "    }\n"
+    "    vstore_half_rte(in[globalId], globalId, out);\n"
+    "}\n"
+    "\n"
+    "kernel void unpack(\n"
+    "        const int N,\n"
+    "        global const half *in,\n"
+    "        global float *out) {\n"
+    "    const int globalId = get_global_id(0);\n"
+    "    if (globalId >= N) {\n"
+    "        return;\n"
+    "    }\n"
+    "    out[globalId] = vload_half(globalId, in);\n"
+    "}\n"
+    "\n"
+    "";
+    unpackKernel = ProgramCache::buildKernelFromString(cl, unpackKernelSource, "unpack", options, "cl/half_storage.cl");
+    // [[[end]]]
+    cl->storeKernel("half_storage.pack", packKernel, true);
+    cl->storeKernel("half_storage.unpack", unpackKernel, true);
+}
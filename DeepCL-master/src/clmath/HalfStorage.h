@@ -0,0 +1,58 @@
+// Copyright Hugh Perkins 2016 hughperkins at gmail
+//
+// This Source Code Form is subject to the terms of the Mozilla Public License,
+// v. 2.0. If a copy of the MPL was not distributed with this file, You can
+// obtain one at http://mozilla.org/MPL/2.0/.
+
+#pragma once
+
+#include <stdexcept>
+#include <string>
+#include <iostream>
+#include <algorithm>
+
+class EasyCL;
+class CLKernel;
+class CLWrapper;
+
+#define VIRTUAL virtual
+#define STATIC static
+
+// keeps buffers on the device as half-precision, and unpacks them into a
+// float scratch buffer, shared by all users of this object, just before use,
+// so only the largest one needs a float copy at any time
+//
+// half buffers are held in int arrays, two values per int, since there is no
+// half type on the host
+//
+// the STATIC conversions do the same round-to-nearest-even as the pack kernel,
+// so results can be checked against a float run on the host, or on a cpu
+// OpenCL device
+class HalfStorage {
+public:
+    EasyCL *cl;
+    CLKernel *packKernel;
+    CLKernel *unpackKernel;
+
+    float *scratch;
+    CLWrapper *scratchWrapper;
+    int scratchSize;
+
+    // [[[cog
+    // import cog_addheaders
+    // cog_addheaders.add()
+    // ]]]
+    // generated, using cog:
+    VIRTUAL ~HalfStorage();
+    VIRTUAL void pack(int N, CLWrapper *floatWrapper, CLWrapper *halfWrapper);
+    VIRTUAL void unpack(int N, CLWrapper *halfWrapper, CLWrapper *floatWrapper);
+    VIRTUAL CLWrapper *unpackToScratch(int N, CLWrapper *halfWrapper);
+    STATIC int halfBufferSize(int N);
+    STATIC unsigned short floatToHalf(float value);
+    STATIC float halfToFloat(unsigned short value);
+    STATIC float roundToHalf(float value);
+    HalfStorage(EasyCL *cl);
+
+    // [[[end]]]
+};
+
@@ -10,6 +10,7 @@
 #include "util/StatefulTimer.h"
 #include "MultiplyBuffer.h"
 #include "util/stringhelper.h"
+#include "util/ProgramCache.h"
 
 using namespace std;
 
@@ -124,7 +125,7 @@ MultiplyBuffer::MultiplyBuffer(EasyCL *cl) :
     "}\n"
     "\n"
     "";
-    kernel = cl->buildKernelFromString(kernelSource, "multiplyConstant", options, "cl/copy.cl");
+    kernel = ProgramCache::buildKernelFromString(cl, kernelSource, "multiplyConstant", options, "cl/copy.cl");
     // [[[end]]]
     cl->storeKernel(kernelName, kernel, true);
     this->kernel = kernel;
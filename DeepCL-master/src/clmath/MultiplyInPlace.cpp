@@ -10,6 +10,7 @@
 #include "util/StatefulTimer.h"
 #include "MultiplyInPlace.h"
 #include "util/stringhelper.h"
+#include "util/ProgramCache.h"
 
 using namespace std;
 
@@ -112,7 +113,7 @@ MultiplyInPlace::MultiplyInPlace(EasyCL *cl) :
     "}\n"
     "\n"
     "";
-    kernel = cl->buildKernelFromString(kernelSource, "multiplyInplace", options, "cl/copy.cl");
+    kernel = ProgramCache::buildKernelFromString(cl, kernelSource, "multiplyInplace", options, "cl/copy.cl");
     // [[[end]]]
     cl->storeKernel(kernelName, kernel, true);
     this->kernel = kernel;
@@ -0,0 +1,258 @@
+// Copyright Hugh Perkins 2016 hughperkins at gmail
+//
+// This Source Code Form is subject to the terms of the Mozilla Public License,
+// v. 2.0. If a copy of the MPL was not distributed with this file, You can
+// obtain one at http://mozilla.org/MPL/2.0/.
+
+#include <iostream>
+
+#include "EasyCL.h"
+#include "util/StatefulTimer.h"
+#include "util/RandomSingleton.h"
+#include "clmath/PhiloxRandom.h"
+#include "util/ProgramCache.h"
+
+using namespace std;
+
+#undef STATIC
+#undef VIRTUAL
+#define STATIC
+#define VIRTUAL
+
+PUBLIC PhiloxRandom::PhiloxRandom(EasyCL *cl) :
+        cl(cl),
+        seedLo(0),
+        seedHi(0),
+        step(0) {
+    seedFromRandomSingleton();
+}
+PUBLIC void PhiloxRandom::seed(unsigned long long seed) {
+    seedLo = (unsigned int)(seed & 0xffffffffULL);
+    seedHi = (unsigned int)(seed >> 32);
+    step = 0;
+}
+// 16 bits per draw, since uniformInt is mod of a 32-bit mt19937 value
+PUBLIC void PhiloxRandom::seedFromRandomSingleton() {
+    unsigned long long value = 0;
+    for(int i = 0; i < 4; i++) {
+        value = (value << 16) | (unsigned long long)RandomSingleton::uniformInt(0, 0xffff);
+    }
+    seed(value);
+}
+PUBLIC unsigned int PhiloxRandom::getStep() {
+    return step;
+}
+PUBLIC void PhiloxRandom::setStep(unsigned int step) {
+    this->step = step;
+}
+// masks[i] is 0 with probability dropRatio, otherwise 1
+PUBLIC void PhiloxRandom::dropoutMasks(int N, float dropRatio, CLWrapper *masksWrapper) {
+    CLKernel *kernel = getKernel("dropout_masks");
+    kernel->in(N)
+        ->in(dropRatio)
+        ->in((int)seedLo)->in((int)seedHi)->in((int)step)
+        ->out(masksWrapper);
+    run(kernel, (N + 3) / 4);
+    step++;
+}
+PUBLIC void PhiloxRandom::randomTranslations(int batchSize, int numPlanes, int imageSize, int translateSize, CLWrapper *inputWrapper, CLWrapper *outputWrapper) {
+    int N = batchSize * numPlanes * imageSize * imageSize;
+    CLKernel *kernel = getKernel("random_translations");
+    kernel->in(N)
+        ->in(numPlanes)->in(imageSize)->in(translateSize)
+        ->in((int)seedLo)->in((int)seedHi)->in((int)step)
+        ->in(inputWrapper)
+        ->out(outputWrapper);
+    run(kernel, N);
+    step++;
+}
+// when not training, takes the centre patch, and leaves step alone
+PUBLIC void PhiloxRandom::randomPatches(int batchSize, int numPlanes, int imageSize, int patchSize, bool training, CLWrapper *inputWrapper, CLWrapper *outputWrapper) {
+    int N = batchSize * numPlanes * patchSize * patchSize;
+    CLKernel *kernel = getKernel("random_patches");
+    kernel->in(N)
+        ->in(numPlanes)->in(imageSize)->in(patchSize)
+        ->in(training ? 1 : 0)
+        ->in((int)seedLo)->in((int)seedHi)->in((int)step)
+        ->in(inputWrapper)
+        ->out(outputWrapper);
+    run(kernel, N);
+    if(training) {
+        step++;
+    }
+}
+// host version of philox4x32 in cl/philox.cl, for checking the kernels
+PUBLIC STATIC void PhiloxRandom::philox4x32(const unsigned int counter[4], const unsigned int key[2], unsigned int result[4]) {
+    unsigned int c0 = counter[0], c1 = counter[1], c2 = counter[2], c3 = counter[3];
+    unsigned int k0 = key[0], k1 = key[1];
+    for(int round = 0; round < 10; round++) {
+        unsigned long long product0 = 0xD2511F53ULL * c0;
+        unsigned long long product1 = 0xCD9E8D57ULL * c2;
+        unsigned int hi0 = (unsigned int)(product0 >> 32);
+        unsigned int lo0 = (unsigned int)product0;
+        unsigned int hi1 = (unsigned int)(product1 >> 32);
+        unsigned int lo1 = (unsigned int)product1;
+        c0 = hi1 ^ c1 ^ k0;
+        c1 = lo1;
+        c2 = hi0 ^ c3 ^ k1;
+        c3 = lo0;
+        k0 += 0x9E3779B9u;
+        k1 += 0xBB67AE85u;
+    }
+    result[0] = c0;
+    result[1] = c1;
+    result[2] = c2;
+    result[3] = c3;
+}
+PRIVATE CLKernel *PhiloxRandom::getKernel(std::string name) {
+    string kernelName = "philox." + name;
+    if(cl->kernelExists(kernelName)) {
+        return cl->getKernel(kernelName);
+    }
+    string options = "";
+
+    // [[[cog
+    // import stringify
+    // stringify.write_kernel("kernel", "cl/philox.cl")
+    // ]]]
+    // generated using cog, from cl/philox.cl:
+    const char * kernelSource =  
+    "// Copyright Hugh Perkins 2016 hughperkins at gmail\n"
+    "//\n"
+    "// This Source Code Form is subject to the terms of the Mozilla Public License,\n"
+    "// v. 2.0. If a copy of the MPL was not distributed with this file, You can\n"
+    "// obtain one at http://mozilla.org/MPL/2.0/.\n"
+    "\n"
+    "// Philox4x32-10 counter-based random numbers (Salmon et al, \"Parallel random\n"
+    "// numbers: as easy as 1, 2, 3\", SC11).  Each (counter, key) pair maps to 4\n"
+    "// independent uint32s, so every work item can draw its own numbers, with no\n"
+    "// state carried between work items or between launches.\n"
+    "//\n"
+    "// Callers use key = the 64-bit seed, and counter = (element or image index,\n"
+    "// step, stream, 0), where step counts the launches for that generator.  Must\n"
+    "// match PhiloxRandom::philox4x32 on the host.  seedLo, seedHi and step are\n"
+    "// passed as ints, and used as the uints with the same bits\n"
+    "\n"
+    "#define PHILOX_M0 0xD2511F53u\n"
+    "#define PHILOX_M1 0xCD9E8D57u\n"
+    "#define PHILOX_W0 0x9E3779B9u\n"
+    "#define PHILOX_W1 0xBB67AE85u\n"
+    "\n"
+    "uint4 philox4x32(uint4 counter, uint2 key) {\n"
+    "    for(int round = 0; round < 10; round++) {\n"
+    "        uint hi0 = mul_hi(PHILOX_M0, counter.x);\n"
+    "        uint lo0 = PHILOX_M0 * counter.x;\n"
+    "        uint hi1 = mul_hi(PHILOX_M1, counter.z);\n"
+    "        uint lo1 = PHILOX_M1 * counter.z;\n"
+    "        counter = (uint4)(hi1 ^ counter.y ^ key.x, lo1, hi0 ^ counter.w ^ key.y, lo0);\n"
+    "        key.x += PHILOX_W0;\n"
+    "        key.y += PHILOX_W1;\n"
+    "    }\n"
+    "    return counter;\n"
+    "}\n"
+    "\n"
+    "// [0, 1), from the top 24 bits, so exactly representable as a float\n"
+    "float philox_uniform(uint value) {\n"
+    "    return (value >> 8) * (1.0f / 16777216.0f);\n"
+    "}\n"
+    "\n"
+    "// 1 where we keep the value, 0 where we drop it, with probability dropRatio,\n"
+    "// as DropoutLayer used to draw on the host.  4 masks per work item\n"
+    "kernel void dropout_masks(\n"
+    "        const int N,\n"
+    "        const float dropRatio,\n"
+    "        const int seedLo, const int seedHi, const int step,\n"
+    "        global unsigned char *masks) {\n"
+    "    const int globalId = get_global_id(0);\n"
+    "    const int base = globalId << 2;\n"
+    "    if(base >= N) {\n"
+    "        return;\n"
+    "    }\n"
+    "    uint4 r = philox4x32((uint4)(globalId, step, 0, 0), (uint2)(seedLo, seedHi));\n"
+    "    masks[base] = philox_uniform(r.x) <= dropRatio ? 0 : 1;\n"
+    "    if(base + 1 < N) {\n"
+    "        masks[base + 1] = philox_uniform(r.y) <= dropRatio ? 0 : 1;\n"
+    "    }\n"
+    "    if(base + 2 < N) {\n"
+    "        masks[base + 2] = philox_uniform(r.z) <= dropRatio ? 0 : 1;\n"
+    "    }\n"
+    "    if(base + 3 < N) {\n"
+    "        masks[base + 3] = philox_uniform(r.w) <= dropRatio ? 0 : 1;\n"
+    "    }\n"
+    "}\n"
+    "\n"
+    "// integer in [0, range), for image n.  Every work item for that image computes\n"
+    "// the same value, so no offsets buffer is needed\n"
+    "int philox_image_offset(uint value, int range) {\n"
+    "    return (int)(value % (uint)range);\n"
+    "}\n"
+    "\n"
+    "// output is each image shifted by its own random (rows, cols), each in\n"
+    "// [-translateSize, translateSize], zero-filled, as Translator::translate.  One\n"
+    "// work item per output element\n"
+    "kernel void random_translations(\n"
+    "        const int N,\n"
+    "        const int numPlanes, const int imageSize, const int translateSize,\n"
+    "        const int seedLo, const int seedHi, const int step,\n"
+    "        global const float *input,\n"
+    "        global float *output) {\n"
+    "    const int globalId = get_global_id(0);\n"
+    "    if(globalId >= N) {\n"
+    "        return;\n"
+    "    }\n"
+    "    const int col = globalId % imageSize;\n"
+    "    const int row = (globalId / imageSize) % imageSize;\n"
+    "    const int n = globalId / (imageSize * imageSize * numPlanes);\n"
+    "    uint4 r = philox4x32((uint4)(n, step, 0, 0), (uint2)(seedLo, seedHi));\n"
+    "    const int translateRows = philox_image_offset(r.x, 2 * translateSize + 1) - translateSize;\n"
+    "    const int translateCols = philox_image_offset(r.y, 2 * translateSize + 1) - translateSize;\n"
+    "    const int inRow = row - translateRows;\n"
+    "    const int inCol = col - translateCols;\n"
+    "    float value = 0.0f;\n"
+    "    if(inRow >= 0 && inRow < imageSize && inCol >= 0 && inCol < imageSize) {\n"
+    "        value = input[globalId + (inRow - row) * imageSize + (inCol - col)];\n"
+    "    }\n"
+    "    output[globalId] = value;\n"
+    "}\n"
+    "\n"
+    "// patchSize x patchSize crop of each image, at a random (row, col) in\n"
+    "// [0, imageSize - patchSize] when training, otherwise the centre crop, as\n"
+    "// PatchExtractor::extractPatch.  One work item per output element\n"
+    "kernel void random_patches(\n"
+    "        const int N,\n"
+    "        const int numPlanes, const int imageSize, const int patchSize,\n"
+    "        const int training,\n"
+    "        const int seedLo, const int seedHi, const int step,\n"
+    "        global const float *input,\n"
+    "        global float *output) {\n"
+    "    const int globalId = get_global_id(0);\n"
+    "    if(globalId >= N) {\n"
+    "        return;\n"
+    "    }\n"
+    "    const int patchMargin = imageSize - patchSize;\n"
+    "    const int col = globalId % patchSize;\n"
+    "    const int row = (globalId / patchSize) % patchSize;\n"
+    "    const int planeIndex = globalId / (patchSize * patchSize); // n * numPlanes + plane\n"
+    "    const int n = planeIndex / numPlanes;\n"
+    "    int patchRow = patchMargin / 2;\n"
+    "    int patchCol = patchMargin / 2;\n"
+    "    if(training) {\n"
+    "        uint4 r = philox4x32((uint4)(n, step, 0, 0), (uint2)(seedLo, seedHi));\n"
+    "        patchRow = philox_image_offset(r.x, patchMargin + 1);\n"
+    "        patchCol = philox_image_offset(r.y, patchMargin + 1);\n"
+    "    }\n"
+    "    output[globalId] = input[(planeIndex * imageSize + row + patchRow) * imageSize + col + patchCol];\n"
+    "}\n"
+    "\n"
+    "";
+    // [[[end]]]
+    CLKernel *kernel = ProgramCache::buildKernelFromString(cl, kernelSource, name, options, "cl/philox.cl");
+    cl->storeKernel(kernelName, kernel, true);
+    return kernel;
+}
+PRIVATE void PhiloxRandom::run(CLKernel *kernel, int numWorkItems) {
+    int workgroupSize = 64;
+    int numWorkgroups = (numWorkItems + workgroupSize - 1) / workgroupSize;
+    kernel->run_1d(numWorkgroups * workgroupSize, workgroupSize);
+    StatefulTimer::instance()->timeCheck("PhiloxRandom::run end");
+}
@@ -0,0 +1,58 @@
+// Copyright Hugh Perkins 2016 hughperkins at gmail
+//
+// This Source Code Form is subject to the terms of the Mozilla Public License,
+// v. 2.0. If a copy of the MPL was not distributed with this file, You can
+// obtain one at http://mozilla.org/MPL/2.0/.
+
+#pragma once
+
+#include <string>
+
+class EasyCL;
+class CLKernel;
+class CLWrapper;
+
+#include "DeepCLDllExport.h"
+
+#define VIRTUAL virtual
+#define STATIC static
+
+// On-device random numbers, for DropoutLayer masks and the RandomTranslations
+// and RandomPatches offsets, using the Philox4x32-10 kernels in cl/philox.cl.
+//
+// State is just a 64-bit seed and a step count.  Each call uses the current
+// step, then increments it, so numbers are a pure function of
+// (seed, step, index): two generators with the same seed produce the same
+// sequence of calls, whatever the device, and nothing is uploaded per call.
+// The seed is drawn from RandomSingleton at construction, so seeding
+// RandomSingleton still makes whole runs reproducible.
+class DeepCL_EXPORT PhiloxRandom {
+    EasyCL *cl; // NOT delete
+    unsigned int seedLo;
+    unsigned int seedHi;
+    unsigned int step;
+
+    // [[[cog
+    // import cog_addheaders
+    // cog_addheaders.addv2()
+    // ]]]
+    // generated, using cog:
+
+    public:
+    PhiloxRandom(EasyCL *cl);
+    void seed(unsigned long long seed);
+    void seedFromRandomSingleton();
+    unsigned int getStep();
+    void setStep(unsigned int step);
+    void dropoutMasks(int N, float dropRatio, CLWrapper *masksWrapper);
+    void randomTranslations(int batchSize, int numPlanes, int imageSize, int translateSize, CLWrapper *inputWrapper, CLWrapper *outputWrapper);
+    void randomPatches(int batchSize, int numPlanes, int imageSize, int patchSize, bool training, CLWrapper *inputWrapper, CLWrapper *outputWrapper);
+    STATIC void philox4x32(const unsigned int counter[4], const unsigned int key[2], unsigned int result[4]);
+
+    private:
+    CLKernel *getKernel(std::string name);
+    void run(CLKernel *kernel, int numWorkItems);
+
+    // [[[end]]]
+};
+
@@ -8,6 +8,7 @@
 
 #include "util/StatefulTimer.h"
 #include "conv/AddBias.h"
+#include "util/ProgramCache.h"
 
 using namespace std;
 
@@ -87,7 +88,7 @@ AddBias::AddBias(EasyCL *cl) :
     "}\n"
     "\n"
     "";
-    kernel = cl->buildKernelFromString(kernelSource, "repeated_add", options, "cl/per_element_add.cl");
+    kernel = ProgramCache::buildKernelFromString(cl, kernelSource, "repeated_add", options, "cl/per_element_add.cl");
     // [[[end]]]
 
     cl->storeKernel(kernelName, kernel, true);
@@ -32,11 +32,12 @@ public:
 //    ActivationFunction const*fn;
 
     int num;
-    int *milliseconds;
+    float *milliseconds;
     bool *valid;
     int chosenIndex;
     BackpropWeights **instances;
     int nextIndex;
+    bool triedDatabase;
 
     // [[[cog
     // import cog_addheaders
@@ -45,6 +46,7 @@ public:
     // generated, using cog:
     BackpropWeightsAuto(EasyCL *cl, LayerDimensions dim);
     VIRTUAL ~BackpropWeightsAuto();
+    void chooseFromDatabase(int batchSize);
     VIRTUAL void calcGradWeights(
     int batchSize, CLWrapper *inputDataWrapper, CLWrapper *gradOutput, CLWrapper *weightsWrapper,
     CLWrapper *gradInput);
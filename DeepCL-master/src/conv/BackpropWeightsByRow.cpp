@@ -11,6 +11,7 @@
 #include "util/stringhelper.h"
 
 #include "test/PrintBuffer.h"
+#include "util/ProgramCache.h"
 
 using namespace std;
 
@@ -261,7 +262,7 @@ BackpropWeightsByRow::BackpropWeightsByRow(EasyCL *cl, LayerDimensions dim) :
     "}\n"
     "\n"
     "";
-    kernel = cl->buildKernelFromString(kernelSource, "backprop_weights", options, "cl/backpropweights_byrow.cl");
+    kernel = ProgramCache::buildKernelFromString(cl, kernelSource, "backprop_weights", options, "cl/backpropweights_byrow.cl");
     // generated using cog, from cl/reduce_segments.cl:
     const char * reduceSource =  
     "// Copyright Hugh Perkins 2015 hughperkins at gmail\n"
@@ -289,7 +290,7 @@ BackpropWeightsByRow::BackpropWeightsByRow(EasyCL *cl, LayerDimensions dim) :
     "\n"
     "\n"
     "";
-    reduce = cl->buildKernelFromString(reduceSource, "reduce_segments", "", "cl/reduce_segments.cl");
+    reduce = ProgramCache::buildKernelFromString(cl, reduceSource, "reduce_segments", "", "cl/reduce_segments.cl");
     // generated using cog, from cl/per_element_add.cl:
     const char * perElementAddSource =  
     "// Copyright Hugh Perkins 2015 hughperkins at gmail\n"
@@ -325,7 +326,7 @@ BackpropWeightsByRow::BackpropWeightsByRow(EasyCL *cl, LayerDimensions dim) :
     "}\n"
     "\n"
     "";
-    perElementAdd = cl->buildKernelFromString(perElementAddSource, "per_element_add", "", "cl/per_element_add.cl");
+    perElementAdd = ProgramCache::buildKernelFromString(cl, perElementAddSource, "per_element_add", "", "cl/per_element_add.cl");
     // [[[end]]]
 }
 
@@ -0,0 +1,42 @@
+// Copyright Hugh Perkins 2016 hughperkins at gmail
+//
+// This Source Code Form is subject to the terms of the Mozilla Public License,
+// v. 2.0. If a copy of the MPL was not distributed with this file, You can
+// obtain one at http://mozilla.org/MPL/2.0/.
+
+#include "EasyCL.h"
+
+#include "conv/BackpropWeightsCpuIm2Col.h"
+#include "conv/CpuConvolution.h"
+#include "util/StatefulTimer.h"
+
+using namespace std;
+
+#undef VIRTUAL
+#undef STATIC
+#define VIRTUAL
+#define STATIC
+
+PUBLIC BackpropWeightsCpuIm2Col::BackpropWeightsCpuIm2Col(EasyCL *cl, LayerDimensions dim) :
+            BackpropWeights(cl, dim) {
+    cpuConvolution = new CpuConvolution(dim);
+}
+PUBLIC VIRTUAL BackpropWeightsCpuIm2Col::~BackpropWeightsCpuIm2Col() {
+    delete cpuConvolution;
+}
+PUBLIC VIRTUAL void BackpropWeightsCpuIm2Col::calcGradWeights(int batchSize, CLWrapper *gradOutputWrapper, CLWrapper *inputDataWrapper, CLWrapper *gradWeightsWrapper, CLWrapper *gradBiasWrapper) {
+    StatefulTimer::timeCheck("BackpropWeightsCpuIm2Col::calcGradWeights START");
+    gradOutputWrapper->copyToHost();
+    inputDataWrapper->copyToHost();
+    float *gradBias = 0;
+    if(dim.biased) {
+        gradBias = (float *)gradBiasWrapper->getHostArray();
+    }
+    cpuConvolution->calcGradWeights(batchSize, (float *)gradOutputWrapper->getHostArray(),
+        (float *)inputDataWrapper->getHostArray(), (float *)gradWeightsWrapper->getHostArray(), gradBias);
+    gradWeightsWrapper->copyToDevice();
+    if(dim.biased) {
+        gradBiasWrapper->copyToDevice();
+    }
+    StatefulTimer::timeCheck("BackpropWeightsCpuIm2Col::calcGradWeights END");
+}
@@ -5,6 +5,7 @@
 #include <sstream>
 #include <iostream>
 #include <string>
+#include <algorithm>
 
 //#include "clblas/ClBlasInstance.h"
 #include "clblas/ClBlasHelper.h"
@@ -21,6 +22,7 @@ using namespace std;
 #define VIRTUAL 
 
 #define PUBLIC
+#define PRIVATE
 
 PUBLIC BackpropWeightsIm2Col::BackpropWeightsIm2Col(EasyCL *cl, LayerDimensions dim) :
             BackpropWeights(cl, dim)
@@ -30,29 +32,28 @@ PUBLIC BackpropWeightsIm2Col::BackpropWeightsIm2Col(EasyCL *cl, LayerDimensions
 //    addBias = new AddBias(cl);
 
     this->im2Col = new Im2Col(cl, dim);
+    this->ones = 0;
+    this->onesWrapper = 0;
+    this->onesSize = 0;
 }
 PUBLIC VIRTUAL BackpropWeightsIm2Col::~BackpropWeightsIm2Col() {
     delete im2Col;
+    delete onesWrapper;
+    delete[] ones;
 //    delete addBias;
 }
-//int batchSize, CLWrapper *gradOutputWrapper, CLWrapper *imagesWrapper, CLWrapper *gradWeightsWrapper, CLWrapper *gradBiasWrapper
+// One gemm per chunk of images, as in ForwardIm2Col::forward, with the chunk's
+// gradOutput permuted to filter-major, so the chunk's images and positions
+// together form the gemm's inner dimension
 PUBLIC VIRTUAL void BackpropWeightsIm2Col::calcGradWeights(int batchSize, CLWrapper *gradOutputWrapper, CLWrapper *inputWrapper, CLWrapper *gradWeightsWrapper, CLWrapper *gradBiasWrapper) {
     StatefulTimer::timeCheck("BackpropWeightsIm2Col::calcGradWeights START");
 
-    int columnsSize = dim.inputPlanes * dim.filterSizeSquared * dim.outputSizeSquared;
-    float *columns = new float[columnsSize];
-    CLWrapper *columnsWrapper = cl->wrap(columnsSize, columns);
-    columnsWrapper->createOnDevice();
-
-    int onesSize = dim.outputSizeSquared;
-    float *ones = new float[onesSize];
-    CLWrapper *onesWrapper = cl->wrap(onesSize, ones);
-    onesWrapper->createOnDevice();
-    CLMathWrapper ones_(onesWrapper);
-    ones_ = 1.0f;
-
-//    cout << "gradColumnsSize: " << gradColumnsSize << endl;
-//    cout << "weightsize: " << weightsWrapper->size() << endl;
+    int chunkSize = im2Col->getChunkSize(batchSize);
+    CLWrapper *columnsWrapper = im2Col->getColumnsScratch(chunkSize);
+    CLWrapper *filterMajorWrapper = im2Col->getFilterMajorScratch(chunkSize);
+    if(dim.biased) {
+        ensureOnes(chunkSize * dim.outputSizeSquared);
+    }
 
     StatefulTimer::timeCheck("BackpropWeightsIm2Col::calcGradWeights after alloc");
 
@@ -62,17 +63,14 @@ PUBLIC VIRTUAL void BackpropWeightsIm2Col::calcGradWeights(int batchSize, CLWrap
         CLMathWrapper gradBias_(gradBiasWrapper);
         gradBias_ = 0.0f;
     }
-    for (int b = 0; b < batchSize; b ++) {
-//        cout << "b=" << b << " numkernels=" << numKernels << endl;
+    for(int b = 0; b < batchSize; b += chunkSize) {
+        int thisChunkSize = std::min(chunkSize, batchSize - b);
+        im2Col->im2ColBatched(inputWrapper, b * dim.inputCubeSize, thisChunkSize, columnsWrapper);
+        im2Col->toFilterMajor(thisChunkSize, gradOutputWrapper, b * dim.outputCubeSize, filterMajorWrapper);
 
-        im2Col->im2Col(
-            inputWrapper, b * dim.inputCubeSize,
-            columnsWrapper
-        );
-        
         int64 m = dim.inputPlanes * dim.filterSizeSquared;
         int64 n = dim.numFilters;
-        int64 k = dim.outputSizeSquared;
+        int64 k = thisChunkSize * dim.outputSizeSquared;
 
         ClBlasHelper::Gemm(
             cl,
@@ -81,12 +79,12 @@ PUBLIC VIRTUAL void BackpropWeightsIm2Col::calcGradWeights(int batchSize, CLWrap
             m, k, n,
             1,
             columnsWrapper, 0,
-            gradOutputWrapper, b * dim.outputCubeSize,
+            filterMajorWrapper, 0,
             1,
             gradWeightsWrapper, 0
         );
         if(dim.biased) {
-            int64 m_ = dim.outputSizeSquared;
+            int64 m_ = thisChunkSize * dim.outputSizeSquared;
             int64 n_ = dim.numFilters;
             ClBlasHelper::Gemv(
                 cl,
@@ -94,7 +92,7 @@ PUBLIC VIRTUAL void BackpropWeightsIm2Col::calcGradWeights(int batchSize, CLWrap
                 clblasTrans,
                 m_, n_,
                 1,
-                gradOutputWrapper, b * dim.outputCubeSize,
+                filterMajorWrapper, 0,
                 onesWrapper, 0,
                 1,
                 gradBiasWrapper, 0
@@ -102,14 +100,20 @@ PUBLIC VIRTUAL void BackpropWeightsIm2Col::calcGradWeights(int batchSize, CLWrap
         }
     }
 
+    StatefulTimer::timeCheck("BackpropWeightsIm2Col::calcGradWeights END");
+}
+// ones, for summing gradOutput over images and positions with a gemv.  Kept
+// between calls, and only refilled when it grows
+PRIVATE void BackpropWeightsIm2Col::ensureOnes(int size) {
+    if(size <= onesSize) {
+        return;
+    }
     delete onesWrapper;
     delete[] ones;
-
-    delete columnsWrapper;
-    delete[] columns;
-
-    StatefulTimer::timeCheck("BackpropWeightsIm2Col::calcGradWeights after call calcGradWeights");
-
-    StatefulTimer::timeCheck("BackpropWeightsIm2Col::calcGradWeights END");
+    ones = new float[size];
+    onesWrapper = cl->wrap(size, ones);
+    onesWrapper->createOnDevice();
+    CLMathWrapper ones_(onesWrapper);
+    ones_ = 1.0f;
+    onesSize = size;
 }
-
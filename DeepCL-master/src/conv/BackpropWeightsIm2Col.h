@@ -18,9 +18,9 @@ class DeepCL_EXPORT BackpropWeightsIm2Col : public BackpropWeights {
 //    CLKernel *kernelIm2Col;
     Im2Col *im2Col;
 
-    float *columns;
-    CLWrapper *columnsWrapper;
-    int numKernels;
+    float *ones;
+    CLWrapper *onesWrapper;
+    int onesSize;
 
     // [[[cog
     // import cog_addheaders
@@ -33,6 +33,9 @@ class DeepCL_EXPORT BackpropWeightsIm2Col : public BackpropWeights {
     VIRTUAL ~BackpropWeightsIm2Col();
     VIRTUAL void calcGradWeights(int batchSize, CLWrapper *gradOutputWrapper, CLWrapper *inputWrapper, CLWrapper *gradWeightsWrapper, CLWrapper *gradBiasWrapper);
 
+    private:
+    void ensureOnes(int size);
+
     // [[[end]]]
 };
 
@@ -7,6 +7,7 @@
 #include "BackpropWeightsNaive.h"
 #include "util/StatefulTimer.h"
 #include "util/stringhelper.h"
+#include "util/ProgramCache.h"
 
 using namespace std;
 
@@ -134,7 +135,7 @@ BackpropWeightsNaive::BackpropWeightsNaive(EasyCL *cl, LayerDimensions dim) :
     "\n"
     "\n"
     "";
-    kernel = cl->buildKernelFromString(kernelSource, "backprop_floats", options, "cl/backpropweights.cl");
+    kernel = ProgramCache::buildKernelFromString(cl, kernelSource, "backprop_floats", options, "cl/backpropweights.cl");
     // [[[end]]]
 }
 
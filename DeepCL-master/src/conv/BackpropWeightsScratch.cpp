@@ -9,6 +9,7 @@
 #include "BackpropWeightsScratch.h"
 #include "util/StatefulTimer.h"
 #include "util/stringhelper.h"
+#include "util/ProgramCache.h"
 
 using namespace std;
 
@@ -191,7 +192,7 @@ BackpropWeightsScratch::BackpropWeightsScratch(EasyCL *cl, LayerDimensions dim)
     "}\n"
     "\n"
     "";
-    kernel = cl->buildKernelFromString(kernelSource, "backprop_floats_withscratch_dobias", options, "cl/BackpropWeightsScratch.cl");
+    kernel = ProgramCache::buildKernelFromString(cl, kernelSource, "backprop_floats_withscratch_dobias", options, "cl/BackpropWeightsScratch.cl");
     // [[[end]]]
 //    kernel = cl->buildKernel("backpropgradWeights2.cl", "backprop_floats_withscratch_dobias", options);
 //    kernel = cl->buildKernelFromString(kernelSource, "calcGradInput", options);
@@ -9,6 +9,7 @@
 #include "BackpropWeightsScratchLarge.h"
 #include "util/StatefulTimer.h"
 #include "util/stringhelper.h"
+#include "util/ProgramCache.h"
 
 using namespace std;
 
@@ -263,7 +264,7 @@ BackpropWeightsScratchLarge::BackpropWeightsScratchLarge(EasyCL *cl, LayerDimens
     "}\n"
     "\n"
     "";
-    kernel = cl->buildKernelFromString(kernelSource, "backprop_floats_withscratch_dobias_striped", options, "cl/BackpropWeightsScratchLarge.cl");
+    kernel = ProgramCache::buildKernelFromString(cl, kernelSource, "backprop_floats_withscratch_dobias_striped", options, "cl/BackpropWeightsScratchLarge.cl");
     // [[[end]]]
 }
 
@@ -14,6 +14,9 @@
 #include "BackwardGpuNaive.h"
 #include "BackwardGpuCached.h"
 #include "BackwardIm2Col.h"
+#include "BackwardCpuIm2Col.h"
+#include "BackwardWinograd.h"
+#include "Winograd.h"
 
 #include "Backward.h"
 
@@ -52,6 +55,15 @@ STATIC Backward *Backward::instanceSpecific(int idx, EasyCL *cl, LayerDimensions
     if(idx == 3) {
         return new BackwardIm2Col(cl, layerDimensions);
     }
+    if(idx == 4) {
+        return new BackwardCpuIm2Col(cl, layerDimensions);
+    }
+    if(idx == 5) {
+        return new BackwardWinograd(cl, layerDimensions, 2);
+    }
+    if(idx == 6) {
+        return new BackwardWinograd(cl, layerDimensions, 4);
+    }
     throw std::runtime_error("backproperrorsv2::isntancespecifc, index not known: " + toString(idx));
 }
 Backward::Backward(EasyCL *cl, LayerDimensions layerDimensions) :
@@ -59,13 +71,16 @@ Backward::Backward(EasyCL *cl, LayerDimensions layerDimensions) :
         dim(layerDimensions) {
 }
 STATIC int Backward::getNumImplementations() {
-    return 4;
+    return 7;
 }
 STATIC bool Backward::plausiblyOptimal(int index, int batchSize, LayerDimensions dim) {
     if(index == 0) { 
         return false;
     }
-    if(index >= 4) {
+    if(index == 5 || index == 6) {
+        return Winograd::supports(dim);
+    }
+    if(index >= 7) {
         return false;
     }
     return true;
@@ -7,11 +7,14 @@
 #include <iostream>
 #include <algorithm>
 #include <stdexcept>
+#include <vector>
 
 #include "conv/BackwardAuto.h"
+#include "conv/TuningDatabase.h"
 #include "util/stringhelper.h"
 #include "util/StatefulTimer.h"
 #include "util/Timer.h"
+#include "net/DeviceProfiler.h"
 
 using namespace std;
 
@@ -26,10 +29,11 @@ BackwardAuto::BackwardAuto(EasyCL *cl, LayerDimensions dim) :
         milliseconds(0),
         valid(0),
         chosenIndex(-1),
-        instances(0)
+        instances(0),
+        triedDatabase(false)
          {
     num = Backward::getNumImplementations();
-    milliseconds = new int[ num];
+    milliseconds = new float[ num];
     valid = new bool[ num ];
     instances = new Backward *[ num ];
     for(int i = 0; i < num; i++) {
@@ -46,9 +50,30 @@ VIRTUAL BackwardAuto::~BackwardAuto() {
         }
     }
 }
+// if the tuning database already knows the answer for this device and these
+// dimensions, use it, and skip the trial runs
+void BackwardAuto::chooseFromDatabase(int batchSize) {
+    triedDatabase = true;
+    int dbIndex = TuningDatabase::instance()->lookup(TuningDatabase::makeKey(cl, "backward", batchSize, dim));
+    if(dbIndex < 0 || dbIndex >= num) {
+        return;
+    }
+    try {
+        instances[dbIndex] = Backward::instanceSpecific(dbIndex, cl, dim);
+        valid[dbIndex] = true;
+        chosenIndex = dbIndex;
+        cout << StatefulTimer::instance()->prefix << "BackwardAuto: using kernel " << dbIndex << " from tuning database" << endl;
+    } catch(runtime_error &e) {
+        cout << StatefulTimer::instance()->prefix << "BackwardAuto: kernel " << dbIndex << " from tuning database cant be used: " << e.what() << endl;
+        valid[dbIndex] = false;
+    }
+}
 VIRTUAL void BackwardAuto::backward(
         int batchSize, CLWrapper *inputDataWrapper, CLWrapper *gradOutput, CLWrapper *weightsWrapper,
         CLWrapper *gradInput) {
+    if(chosenIndex == -1 && !triedDatabase) {
+        chooseFromDatabase(batchSize);
+    }
     while(chosenIndex == -1 && nextIndex < num) {
         int thisIndex = nextIndex;
         nextIndex++;
@@ -65,15 +90,21 @@ VIRTUAL void BackwardAuto::backward(
                 valid[thisIndex] = false;
             }
             if(valid[thisIndex]) {
-                Timer timer;
                 try {
+                    DeviceProfiler::annotate("backward kernel " + toString(thisIndex) + " (tuning)");
+                    // first run is the warm-up, and also gives this batch its result.  Then
+                    // take the median of several timed runs, so one noisy run cant pick the kernel
                     candidate->backward(batchSize, inputDataWrapper, gradOutput, weightsWrapper, gradInput);
-                    milliseconds[thisIndex] = (int)timer.lap();
-                    cout << StatefulTimer::instance()->prefix << "BackwardAuto: kernel " << thisIndex << " " << milliseconds[thisIndex] << "ms" << endl;
-                    if (milliseconds[thisIndex] == 0) { //we can't get better time, use this instance
-                        cout << "   backward layer selected kernel with zero time" << thisIndex << endl;
-                        this->chosenIndex = thisIndex;
+                    cl->finish();
+                    vector<float> times;
+                    for(int run = 0; run < TuningDatabase::instance()->getNumTimedRuns(); run++) {
+                        Timer timer;
+                        candidate->backward(batchSize, inputDataWrapper, gradOutput, weightsWrapper, gradInput);
+                        cl->finish();
+                        times.push_back((float)(timer.lapMicroseconds() / 1000.0));
                     }
+                    milliseconds[thisIndex] = TuningDatabase::median(times);
+                    cout << StatefulTimer::instance()->prefix << "BackwardAuto: kernel " << thisIndex << " " << milliseconds[thisIndex] << "ms" << endl;
                     return;
                 } catch(runtime_error &e) {
                     cout << StatefulTimer::instance()->prefix << "BackwardAuto: kernel " << thisIndex << " this instance cant be used: " << e.what() << endl;
@@ -91,7 +122,7 @@ VIRTUAL void BackwardAuto::backward(
     if(chosenIndex == -1) {
 //        cout << StatefulTimer::instance()->prefix + "BackwardAuto::backward choosing best instance:" << endl;
         int bestIndex = -1;
-        int bestTime = 0;
+        float bestTime = 0;
         for(int i = 0; i < num; i++) {
             if(!valid[i]) {
                 cout << "   backward kernel " << i << ": cannot be used" << endl;
@@ -111,11 +142,12 @@ VIRTUAL void BackwardAuto::backward(
         if(bestIndex != -1) {
             cout << "   backward layer selected kernel " << bestIndex << endl;
             this->chosenIndex = bestIndex;
+            TuningDatabase::instance()->record(TuningDatabase::makeKey(cl, "backward", batchSize, dim), bestIndex, bestTime);
         } else {
             throw runtime_error(StatefulTimer::instance()->prefix + "No valid backward implementations found");
         }
     }
 //    cout << "BackwardAuto::backward using instance index: " << chosenIndex << endl;
+    DeviceProfiler::annotate("backward kernel " + toString(chosenIndex));
     instances[chosenIndex]->backward(batchSize, inputDataWrapper, gradOutput, weightsWrapper, gradInput);
 }
-
@@ -0,0 +1,35 @@
+// Copyright Hugh Perkins 2016 hughperkins at gmail
+//
+// This Source Code Form is subject to the terms of the Mozilla Public License,
+// v. 2.0. If a copy of the MPL was not distributed with this file, You can
+// obtain one at http://mozilla.org/MPL/2.0/.
+
+#include "EasyCL.h"
+
+#include "conv/BackwardCpuIm2Col.h"
+#include "conv/CpuConvolution.h"
+#include "util/StatefulTimer.h"
+
+using namespace std;
+
+#undef VIRTUAL
+#undef STATIC
+#define VIRTUAL
+#define STATIC
+
+PUBLIC BackwardCpuIm2Col::BackwardCpuIm2Col(EasyCL *cl, LayerDimensions dim) :
+            Backward(cl, dim) {
+    cpuConvolution = new CpuConvolution(dim);
+}
+PUBLIC VIRTUAL BackwardCpuIm2Col::~BackwardCpuIm2Col() {
+    delete cpuConvolution;
+}
+PUBLIC VIRTUAL void BackwardCpuIm2Col::backward(int batchSize, CLWrapper *inputDataWrapper, CLWrapper *gradOutputWrapper, CLWrapper *weightsWrapper, CLWrapper *gradInputWrapper) {
+    StatefulTimer::timeCheck("BackwardCpuIm2Col::backward START");
+    gradOutputWrapper->copyToHost();
+    weightsWrapper->copyToHost();
+    cpuConvolution->backward(batchSize, (float *)gradOutputWrapper->getHostArray(),
+        (float *)weightsWrapper->getHostArray(), (float *)gradInputWrapper->getHostArray());
+    gradInputWrapper->copyToDevice();
+    StatefulTimer::timeCheck("BackwardCpuIm2Col::backward END");
+}
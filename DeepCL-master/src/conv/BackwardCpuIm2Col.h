@@ -0,0 +1,36 @@
+// Copyright Hugh Perkins 2016 hughperkins at gmail
+//
+// This Source Code Form is subject to the terms of the Mozilla Public License,
+// v. 2.0. If a copy of the MPL was not distributed with this file, You can
+// obtain one at http://mozilla.org/MPL/2.0/.
+
+#pragma once
+
+#include "Backward.h"
+
+class CpuConvolution;
+
+#include "DeepCLDllExport.h"
+
+#define VIRTUAL virtual
+#define STATIC static
+
+// multithreaded, cache-blocked im2col + gemm on the host; see CpuConvolution
+class DeepCL_EXPORT BackwardCpuIm2Col : public Backward {
+    private:
+    CpuConvolution *cpuConvolution;
+
+    // [[[cog
+    // import cog_addheaders
+    // cog_addheaders.addv2()
+    // ]]]
+    // generated, using cog:
+
+    public:
+    BackwardCpuIm2Col(EasyCL *cl, LayerDimensions dim);
+    VIRTUAL ~BackwardCpuIm2Col();
+    VIRTUAL void backward(int batchSize, CLWrapper *inputDataWrapper, CLWrapper *gradOutputWrapper, CLWrapper *weightsWrapper, CLWrapper *gradInputWrapper);
+
+    // [[[end]]]
+};
+
@@ -1,6 +1,7 @@
 #include "util/StatefulTimer.h"
 
 #include "BackwardGpuCached.h"
+#include "util/ProgramCache.h"
 
 using namespace std;
 
@@ -163,7 +164,7 @@ BackwardGpuCached::BackwardGpuCached(EasyCL *cl, LayerDimensions dim) :
     "}\n"
     "\n"
     "";
-    kernel = cl->buildKernelFromString(kernelSource, "calcGradInputCached", options, "cl/backward_cached.cl");
+    kernel = ProgramCache::buildKernelFromString(cl, kernelSource, "calcGradInputCached", options, "cl/backward_cached.cl");
     // [[[end]]]
 //    kernel = cl->buildKernel("backproperrorsv2.cl", "calcGradInput", options);
 //    kernel = cl->buildKernelFromString(kernelSource, "calcGradInput", options);
@@ -1,6 +1,7 @@
 #include "util/StatefulTimer.h"
 
 #include "BackwardGpuNaive.h"
+#include "util/ProgramCache.h"
 
 using namespace std;
 
@@ -117,7 +118,7 @@ BackwardGpuNaive::BackwardGpuNaive(EasyCL *cl, LayerDimensions dim) :
     "}\n"
     "\n"
     "";
-    kernel = cl->buildKernelFromString(kernelSource, "calcGradInput", options, "cl/backward.cl");
+    kernel = ProgramCache::buildKernelFromString(cl, kernelSource, "calcGradInput", options, "cl/backward.cl");
     // [[[end]]]
 //    kernel = cl->buildKernel("backproperrorsv2.cl", "calcGradInput", options);
 //    kernel = cl->buildKernelFromString(kernelSource, "calcGradInput", options);
@@ -4,6 +4,7 @@
 #include <sstream>
 #include <iostream>
 #include <string>
+#include <algorithm>
 
 //#include "clblas/ClBlasInstance.h"
 #include "clblas/ClBlasHelper.h"
@@ -29,48 +30,43 @@ PUBLIC BackwardIm2Col::BackwardIm2Col(EasyCL *cl, LayerDimensions dim) :
 PUBLIC VIRTUAL BackwardIm2Col::~BackwardIm2Col() {
     delete im2Col;
 }
+// Mirror of ForwardIm2Col::forward: one gemm per chunk of images, from
+// gradOutput permuted to filter-major, then col2im over the whole chunk
 PUBLIC VIRTUAL void BackwardIm2Col::backward(int batchSize, 
         CLWrapper *inputDataWrapper, CLWrapper *gradOutputWrapper, CLWrapper *weightsWrapper,
         CLWrapper *gradInputWrapper) {
     StatefulTimer::timeCheck("BackwardIm2Col::backward START");
 
-    int gradColumnsSize = dim.inputPlanes * dim.filterSizeSquared * dim.outputSizeSquared;
-    float *gradColumns = new float[gradColumnsSize];
-    CLWrapper *gradColumnsWrapper = cl->wrap(gradColumnsSize, gradColumns);
-    gradColumnsWrapper->createOnDevice();
-//    cout << "gradColumnsSize: " << gradColumnsSize << endl;
-//    cout << "weightsize: " << weightsWrapper->size() << endl;
+    int chunkSize = im2Col->getChunkSize(batchSize);
+    CLWrapper *gradColumnsWrapper = im2Col->getColumnsScratch(chunkSize);
+    CLWrapper *filterMajorWrapper = im2Col->getFilterMajorScratch(chunkSize);
 
     StatefulTimer::timeCheck("BackwardIm2Col::backward after alloc");
 
     if(!gradInputWrapper->isOnDevice()) {
         gradInputWrapper->createOnDevice();
     }
-    for (int b = 0; b < batchSize; b ++) {
-//        cout << "b=" << b << " numkernels=" << numKernels << endl;
-        long m = dim.outputSizeSquared;
+    for(int b = 0; b < batchSize; b += chunkSize) {
+        int thisChunkSize = std::min(chunkSize, batchSize - b);
+        im2Col->toFilterMajor(thisChunkSize, gradOutputWrapper, b * dim.outputCubeSize, filterMajorWrapper);
+
+        long m = thisChunkSize * dim.outputSizeSquared;
         long n = dim.inputPlanes * dim.filterSizeSquared;
         long k = dim.numFilters;
-//        cout << "m=" << m << " k=" << k << " n=" << n << endl;
 
         ClBlasHelper::Gemm(
             cl, clblasColumnMajor, clblasNoTrans, clblasTrans,
             m, k, n,
             1,
-            gradOutputWrapper, b * dim.outputCubeSize,
+            filterMajorWrapper, 0,
             weightsWrapper, 0,
             0,
             gradColumnsWrapper, 0
         );
 
-        im2Col->col2Im(gradColumnsWrapper, gradInputWrapper, b * dim.inputCubeSize);
+        im2Col->col2ImBatched(gradColumnsWrapper, thisChunkSize, gradInputWrapper, b * dim.inputCubeSize);
     }
 
-    delete gradColumnsWrapper;
-    delete[] gradColumns;
-
-    StatefulTimer::timeCheck("BackwardIm2Col::backward after call backward");
-
     StatefulTimer::timeCheck("BackwardIm2Col::backward END");
 }
 
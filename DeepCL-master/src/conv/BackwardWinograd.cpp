@@ -0,0 +1,43 @@
+// Copyright Hugh Perkins 2016 hughperkins at gmail
+//
+// This Source Code Form is subject to the terms of the Mozilla Public License,
+// v. 2.0. If a copy of the MPL was not distributed with this file, You can
+// obtain one at http://mozilla.org/MPL/2.0/.
+
+#include "util/stringhelper.h"
+#include "util/StatefulTimer.h"
+#include "conv/Winograd.h"
+#include "conv/BackwardWinograd.h"
+
+#include <iostream>
+#include <string>
+
+using namespace std;
+
+#undef STATIC
+#define STATIC
+#undef VIRTUAL
+#define VIRTUAL
+#define PUBLIC
+
+PUBLIC BackwardWinograd::BackwardWinograd(EasyCL *cl, LayerDimensions dim, int outputTile) :
+            Backward(cl, dim),
+            winograd(0) {
+    if(!Winograd::supports(dim)) {
+        throw runtime_error("BackwardWinograd only supports 3x3 filters with stride 1, not filterSize "
+            + toString(dim.filterSize) + " skip " + toString(dim.skip));
+    }
+    winograd = new Winograd(cl, outputTile, dim.numFilters, dim.outputSize, dim.inputPlanes, dim.inputSize,
+        2 - Winograd::paddingFor(dim), true, false);
+}
+PUBLIC VIRTUAL BackwardWinograd::~BackwardWinograd() {
+    delete winograd;
+}
+PUBLIC VIRTUAL void BackwardWinograd::backward(int batchSize,
+        CLWrapper *inputDataWrapper, CLWrapper *gradOutputWrapper, CLWrapper *weightsWrapper,
+        CLWrapper *gradInputWrapper) {
+    StatefulTimer::timeCheck("BackwardWinograd::backward START");
+    winograd->transformFilters(weightsWrapper);
+    winograd->convolve(batchSize, gradOutputWrapper, 0, gradInputWrapper);
+    StatefulTimer::timeCheck("BackwardWinograd::backward END");
+}
@@ -0,0 +1,41 @@
+// Copyright Hugh Perkins 2016 hughperkins at gmail
+//
+// This Source Code Form is subject to the terms of the Mozilla Public License,
+// v. 2.0. If a copy of the MPL was not distributed with this file, You can
+// obtain one at http://mozilla.org/MPL/2.0/.
+
+#pragma once
+
+#include "Backward.h"
+
+class Winograd;
+
+#include "DeepCLDllExport.h"
+
+#define STATIC static
+#define VIRTUAL virtual
+
+// gradInput by Winograd F(2x2, 3x3) or F(4x4, 3x3), for 3x3 stride 1 layers:
+// a convolution of gradOutput with the rotated, transposed, filters, see
+// Winograd.  The weights change after every backward, during training, so the
+// filter transform is redone each call
+class DeepCL_EXPORT BackwardWinograd : public Backward {
+    private:
+    Winograd *winograd;
+
+    // [[[cog
+    // import cog_addheaders
+    // cog_addheaders.addv2()
+    // ]]]
+    // generated, using cog:
+
+    public:
+    BackwardWinograd(EasyCL *cl, LayerDimensions dim, int outputTile);
+    VIRTUAL ~BackwardWinograd();
+    VIRTUAL void backward(int batchSize,
+    CLWrapper *inputDataWrapper, CLWrapper *gradOutputWrapper, CLWrapper *weightsWrapper,
+    CLWrapper *gradInputWrapper);
+
+    // [[[end]]]
+};
+
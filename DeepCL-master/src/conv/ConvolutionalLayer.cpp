@@ -18,6 +18,10 @@
 #include "clmath/GpuAdd.h"
 #include "clmath/CopyBuffer.h"
 #include "layer/Layer.h"
+#include "conv/FusedConvEpilogue.h"
+#include "activate/ActivationLayer.h"
+#include "pooling/PoolingLayer.h"
+#include "clmath/HalfStorage.h"
 
 using namespace std;
 
@@ -50,7 +54,17 @@ ConvolutionalLayer::ConvolutionalLayer(EasyCL *cl, Layer *previousLayer, Convolu
         gradBiasWrapper(0),
 
         batchSize(0),
-        allocatedSpaceNumExamples(0)
+        allocatedSpaceNumExamples(0),
+
+        fusedActivation(0),
+        fusedPooling(0),
+        fusedEpilogue(0),
+        fusedGradOutput(0),
+        fusedGradOutputWrapper(0),
+
+        halfStorage(0),
+        weightsHalf(0),
+        weightsHalfWrapper(0)
             {
     dim.setInputPlanes(previousLayer->getOutputPlanes())
         .setInputSize(previousLayer->getOutputSize())
@@ -126,6 +140,13 @@ VIRTUAL ConvolutionalLayer::~ConvolutionalLayer() {
     delete backwardImpl;
     delete trainerState;
     delete biasTrainerState;
+
+    delete fusedEpilogue;
+    delete fusedGradOutputWrapper;
+    delete[] fusedGradOutput;
+
+    delete weightsHalfWrapper;
+    delete[] weightsHalf;
 }
 VIRTUAL std::string ConvolutionalLayer::getClassName() const {
     return "ConvolutionalLayer";
@@ -161,6 +182,10 @@ VIRTUAL CLWrapper *ConvolutionalLayer::getGradInputWrapper() {
     return gradInputWrapper;
 }
 VIRTUAL CLWrapper *ConvolutionalLayer::getWeightsWrapper() {
+    if(halfStorage != 0) {
+        throw runtime_error("ConvolutionalLayer " + toString(layerIndex) + " stores its weights as half, so has no float weights on the device");
+    }
+    forwardImpl->weightsChanged(); // caller might write to them, eg the trainers
     return weightsWrapper;
 }
 VIRTUAL CLWrapper *ConvolutionalLayer::getBiasWrapper() {
@@ -296,6 +321,9 @@ VIRTUAL void ConvolutionalLayer::setBatchSize(int batchSize) {
         gradInput = new float[ previousLayer->getOutputNumElements() ];
         gradInputWrapper = cl->wrap(previousLayer->getOutputNumElements(), gradInput);
     }
+    if(fusedEpilogue != 0) {
+        allocateFusedGradOutput();
+    }
 }
 VIRTUAL void ConvolutionalLayer::setWeights(float *weights, float *bias) {
 //    cout << "setweights" << endl;
@@ -334,6 +362,14 @@ VIRTUAL void ConvolutionalLayer::initWeights(float const*weights) {
 //    cout << "initweights()" << endl;
     int weightsSize = getWeightsSize();
     memcpy(this->weights, weights, sizeof(float) * weightsSize);
+    forwardImpl->weightsChanged();
+    if(halfStorage != 0) {
+        CLWrapper *stagingWrapper = cl->wrap(weightsSize, this->weights);
+        stagingWrapper->copyToDevice();
+        halfStorage->pack(weightsSize, stagingWrapper, weightsHalfWrapper);
+        delete stagingWrapper;
+        return;
+    }
     weightsWrapper->copyToDevice();
 }
 VIRTUAL void ConvolutionalLayer::initBias(float const*bias) {
@@ -352,12 +388,18 @@ VIRTUAL int ConvolutionalLayer::getBiasSize() const {
     }
 }
 VIRTUAL float const *ConvolutionalLayer::getWeights() const {
+    if(halfStorage != 0) {
+        return weights;
+    }
     if(weightsWrapper->isDeviceDirty()) {
         throw std::runtime_error("weights not copied to host, and htis is const object, so cannot copy");
     }
     return weights;
 }
 VIRTUAL float *ConvolutionalLayer::getWeights() {
+    if(halfStorage != 0) {
+        return weights;
+    }
     if(weightsWrapper->isDeviceDirty()) {
 //        cout << "copying weights to host" << endl;
         cl->finish();
@@ -401,8 +443,21 @@ VIRTUAL void ConvolutionalLayer::forward() {
         upstreamWrapper->copyToDevice();
     }
     StatefulTimer::instance()->timeCheck("    forward layer " + toString(layerIndex) + ", copied to device");
-    forwardImpl->forward(batchSize, upstreamWrapper, weightsWrapper, biasWrapper, outputWrapper);
+    CLWrapper *forwardWeightsWrapper = weightsWrapper;
+    if(halfStorage != 0) {
+        forwardWeightsWrapper = halfStorage->unpackToScratch(getWeightsSize(), weightsHalfWrapper);
+        forwardImpl->weightsChanged(); // the scratch is shared with other layers
+    }
+    forwardImpl->forward(batchSize, upstreamWrapper, forwardWeightsWrapper, biasWrapper, outputWrapper);
     StatefulTimer::instance()->timeCheck("    forward layer " + toString(layerIndex) + ",  after clFinish");
+    if(fusedEpilogue != 0) {
+        if(fusedPooling != 0) {
+            fusedEpilogue->forward(batchSize, outputWrapper, biasWrapper, fusedPooling->selectorsWrapper, fusedPooling->outputWrapper);
+        } else {
+            fusedEpilogue->forward(batchSize, outputWrapper, biasWrapper, 0, 0);
+        }
+        StatefulTimer::instance()->timeCheck("    forward layer " + toString(layerIndex) + ",  after fused epilogue");
+    }
 
     if(!previousLayer->hasOutputWrapper()) {
         delete upstreamWrapper;
@@ -411,6 +466,9 @@ VIRTUAL void ConvolutionalLayer::forward() {
 }
 VIRTUAL void ConvolutionalLayer::backward() {
     StatefulTimer::instance()->timeCheck("backprop(): start, layer " + toString(layerIndex) );
+    if(halfStorage != 0) {
+        throw runtime_error("ConvolutionalLayer " + toString(layerIndex) + " stores its weights as half, which is for inference only");
+    }
 
     CLWrapper *inputWrapper = 0;
     if(previousLayer->hasOutputWrapper()) {
@@ -420,22 +478,38 @@ VIRTUAL void ConvolutionalLayer::backward() {
         inputWrapper->copyToDevice();
     }
 
+    // if fused, the gradient comes from whatever follows the fused layers
+    Layer *blockLastLayer = this;
+    if(fusedEpilogue != 0) {
+        blockLastLayer = fusedPooling != 0 ? (Layer *)fusedPooling : (Layer *)fusedActivation;
+    }
+    Layer *gradSourceLayer = blockLastLayer->nextLayer;
     CLWrapper *gradOutputWrapper = 0;
     bool weOwnGradOutputWrapper = false;
-    if(nextLayer->providesGradInputWrapper()) {
-        gradOutputWrapper = nextLayer->getGradInputWrapper();
+    if(gradSourceLayer->providesGradInputWrapper()) {
+        gradOutputWrapper = gradSourceLayer->getGradInputWrapper();
     } else {
-        gradOutputWrapper = cl->wrap(getOutputNumElements(), nextLayer->getGradInput());
+        gradOutputWrapper = cl->wrap(blockLastLayer->getOutputNumElements(), gradSourceLayer->getGradInput());
         gradOutputWrapper->copyToDevice();
         weOwnGradOutputWrapper = true;
     }
 
+    CLWrapper *convGradOutputWrapper = gradOutputWrapper;
+    if(fusedEpilogue != 0) {
+        if(fusedPooling != 0) {
+            fusedEpilogue->backward(batchSize, fusedPooling->outputWrapper, fusedPooling->selectorsWrapper, gradOutputWrapper, fusedGradOutputWrapper);
+        } else {
+            fusedEpilogue->backward(batchSize, outputWrapper, 0, gradOutputWrapper, fusedGradOutputWrapper);
+        }
+        convGradOutputWrapper = fusedGradOutputWrapper;
+    }
+
     if(previousLayer->needsBackProp()) {
-        backwardImpl->backward(batchSize, inputWrapper, gradOutputWrapper, weightsWrapper, gradInputWrapper);
+        backwardImpl->backward(batchSize, inputWrapper, convGradOutputWrapper, weightsWrapper, gradInputWrapper);
         StatefulTimer::instance()->timeCheck("backproperrors(): calced gradInput, layer " + ::toString(layerIndex) );
     }
 
-    backpropWeightsImpl->calcGradWeights(batchSize, gradOutputWrapper, inputWrapper,  gradWeightsWrapper, gradBiasWrapper);
+    backpropWeightsImpl->calcGradWeights(batchSize, convGradOutputWrapper, inputWrapper,  gradWeightsWrapper, gradBiasWrapper);
     StatefulTimer::instance()->timeCheck("backproperrors(): done calc gradWeights, layer " + ::toString(layerIndex) );
 
 //    gradWeightsCopiedToHost = false;
@@ -467,6 +541,9 @@ VIRTUAL void ConvolutionalLayer::backward() {
 //    StatefulTimer::instance()->timeCheck("ConvolutionalLayer::updateWeights(): updated weights, layer " + ::toString(layerIndex) );
 //}
 VIRTUAL std::string ConvolutionalLayer::asString() const {
+    if(fusedEpilogue != 0) {
+        return "ConvolutionalLayer{ " + toString(dim) + (fusedPooling != 0 ? " fused: activation, pooling" : " fused: activation") + " }";
+    }
     return "ConvolutionalLayer{ " + toString(dim) + " }";
 }
 VIRTUAL bool ConvolutionalLayer::needsTrainerState() const {
@@ -489,4 +566,65 @@ VIRTUAL void ConvolutionalLayer::setTrainerState(TrainerStateMaker *trainerState
         this->biasTrainerState = trainerStateMaker->instance(cl, getBiasSize());
     }
 }
-
+// fuses activationLayer, which must be our nextLayer, and poolingLayer, if
+// not 0, which must follow activationLayer, into this layer.  they stay in
+// the net, for persistence and shapes, but their forward and backward do nothing
+void ConvolutionalLayer::fuse(ActivationLayer *activationLayer, PoolingLayer *poolingLayer) {
+    if(fusedEpilogue != 0) {
+        throw runtime_error("ConvolutionalLayer " + toString(layerIndex) + " is already fused");
+    }
+    if(activationLayer == 0 || nextLayer != activationLayer) {
+        throw runtime_error("ConvolutionalLayer::fuse: activation layer must directly follow layer " + toString(layerIndex));
+    }
+    if(poolingLayer != 0 && activationLayer->nextLayer != poolingLayer) {
+        throw runtime_error("ConvolutionalLayer::fuse: pooling layer must directly follow activation layer " + toString(activationLayer->layerIndex));
+    }
+    if(dim.biased) {
+        LayerDimensions unbiasedDim = dim;
+        unbiasedDim.setBiased(false);
+        delete forwardImpl;
+        forwardImpl = Forward::instance(cl, unbiasedDim);
+    }
+    fusedEpilogue = new FusedConvEpilogue(cl, dim, activationLayer->getActivationFunction(),
+        poolingLayer != 0 ? poolingLayer->getPoolingSize() : 0,
+        poolingLayer != 0 ? poolingLayer->getPadZeros() : false);
+    fusedActivation = activationLayer;
+    fusedPooling = poolingLayer;
+    activationLayer->fuseInto(this, poolingLayer == 0);
+    if(poolingLayer != 0) {
+        poolingLayer->fuseInto(this);
+    }
+    if(allocatedSpaceNumExamples > 0) {
+        allocateFusedGradOutput();
+    }
+}
+bool ConvolutionalLayer::isFused() const {
+    return fusedEpilogue != 0;
+}
+void ConvolutionalLayer::allocateFusedGradOutput() {
+    delete fusedGradOutputWrapper;
+    delete[] fusedGradOutput;
+    const int numElements = allocatedSpaceNumExamples * dim.outputCubeSize;
+    fusedGradOutput = new float[numElements];
+    fusedGradOutputWrapper = cl->wrap(numElements, fusedGradOutput);
+    fusedGradOutputWrapper->createOnDevice();
+}
+// moves the weights on the device to half storage, for inference.  the float
+// device copy is freed; forward unpacks into halfStorage's shared scratch
+void ConvolutionalLayer::enableHalfStorage(HalfStorage *halfStorage) {
+    if(this->halfStorage != 0) {
+        return;
+    }
+    getWeights(); // make sure host copy is current, since it becomes the master
+    const int weightsSize = getWeightsSize();
+    weightsHalf = new int[HalfStorage::halfBufferSize(weightsSize)];
+    weightsHalfWrapper = cl->wrap(HalfStorage::halfBufferSize(weightsSize), weightsHalf);
+    weightsHalfWrapper->createOnDevice();
+    halfStorage->pack(weightsSize, weightsWrapper, weightsHalfWrapper);
+    delete weightsWrapper;
+    weightsWrapper = 0;
+    this->halfStorage = halfStorage;
+}
+bool ConvolutionalLayer::hasHalfStorage() const {
+    return halfStorage != 0;
+}
@@ -27,6 +27,10 @@ class ConvolutionalMaker;
 class GpuAdd;
 class CopyBuffer;
 class WeightsInitializer;
+class ActivationLayer;
+class PoolingLayer;
+class FusedConvEpilogue;
+class HalfStorage;
 
 class ConvolutionalLayer : public Layer {
 public:
@@ -72,6 +76,22 @@ public:
     GpuAdd *gpuAdd;
     CopyBuffer *copyBuffer;
 
+    // set by fuse().  then forwardImpl runs without bias, and fusedEpilogue
+    // applies bias + activation (+ pooling) in one pass.  output then holds the
+    // activated output if not pooling, or the convolution without bias if pooling
+    ActivationLayer *fusedActivation; // NOT owned by us
+    PoolingLayer *fusedPooling; // NOT owned by us, 0 if no pooling fused
+    FusedConvEpilogue *fusedEpilogue;
+    float *fusedGradOutput; // gradient wrt convolution + bias output
+    CLWrapper *fusedGradOutputWrapper;
+
+    // set by enableHalfStorage().  weights then live on the device only as
+    // half, in weightsHalfWrapper, and weightsWrapper is 0.  the host weights
+    // array stays float, and is the master copy
+    HalfStorage *halfStorage; // NOT owned by us
+    int *weightsHalf;
+    CLWrapper *weightsHalfWrapper;
+
     inline int getWeightIndex(int filterId, int inputPlane, int filterRow, int filterCol) const {
         return (( filterId 
             * dim.inputPlanes + inputPlane)
@@ -158,6 +178,11 @@ public:
     VIRTUAL TrainerState *getTrainerState();
     VIRTUAL TrainerState *getBiasTrainerState();
     VIRTUAL void setTrainerState(TrainerStateMaker *trainerStateMaker);
+    void fuse(ActivationLayer *activationLayer, PoolingLayer *poolingLayer);
+    bool isFused() const;
+    void allocateFusedGradOutput();
+    void enableHalfStorage(HalfStorage *halfStorage);
+    bool hasHalfStorage() const;
 
     // [[[end]]]
 };
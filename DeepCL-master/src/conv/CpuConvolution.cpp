@@ -0,0 +1,291 @@
+// Copyright Hugh Perkins 2016 hughperkins at gmail
+//
+// This Source Code Form is subject to the terms of the Mozilla Public License,
+// v. 2.0. If a copy of the MPL was not distributed with this file, You can
+// obtain one at http://mozilla.org/MPL/2.0/.
+
+#include <algorithm>
+#include <cstring>
+
+#include "conv/CpuConvolution.h"
+#include "util/ThreadPool.h"
+
+using namespace std;
+
+#undef STATIC
+#define STATIC
+#undef VIRTUAL
+#define VIRTUAL
+
+// sgemm blocking: a gemmBlockK x gemmBlockN panel of B (128KB) stays resident
+// in L2 while four rows of C at a time are accumulated against it
+static const int gemmBlockK = 128;
+static const int gemmBlockN = 256;
+
+PUBLIC CpuConvolution::CpuConvolution(LayerDimensions dim) :
+        dim(dim),
+        threadPool(sharedThreadPool()) {
+    stride = dim.skip + 1;
+    padding = dim.padZeros ? dim.halfFilterSize : 0;
+    columnRows = dim.inputPlanes * dim.filterSizeSquared;
+    columnCols = dim.outputSizeSquared;
+    const int numThreads = threadPool->getNumThreads();
+    columns.resize(numThreads);
+    gradWeightsPartial.resize(numThreads);
+    gradBiasPartial.resize(numThreads);
+}
+PUBLIC CpuConvolution::~CpuConvolution() {
+}
+PUBLIC int CpuConvolution::getNumThreads() {
+    return threadPool->getNumThreads();
+}
+PUBLIC void CpuConvolution::forward(int batchSize, const float *input, const float *weights, const float *bias, float *output) {
+    ensureColumns();
+    const int numThreads = threadPool->getNumThreads();
+    // with fewer images than threads, also split each image across filters
+    const int numChunks = batchSize >= numThreads ? 1 :
+        std::min(dim.numFilters, (numThreads + batchSize - 1) / batchSize);
+    threadPool->parallelFor(batchSize * numChunks, [&](int task, int threadId) {
+        const int n = task / numChunks;
+        const int chunk = task % numChunks;
+        const int startFilter = chunk * dim.numFilters / numChunks;
+        const int endFilter = (chunk + 1) * dim.numFilters / numChunks;
+        float *column = &columns[threadId][0];
+        im2col(input + n * dim.inputCubeSize, column);
+        float *imageOutput = output + n * dim.outputCubeSize;
+        sgemm(endFilter - startFilter, columnCols, columnRows,
+            weights + startFilter * columnRows, columnRows,
+            column, columnCols,
+            imageOutput + startFilter * columnCols, columnCols, false);
+        if(dim.biased) {
+            for(int filter = startFilter; filter < endFilter; filter++) {
+                float *outputPlane = imageOutput + filter * columnCols;
+                const float thisBias = bias[filter];
+                for(int i = 0; i < columnCols; i++) {
+                    outputPlane[i] += thisBias;
+                }
+            }
+        }
+    });
+}
+PUBLIC void CpuConvolution::backward(int batchSize, const float *gradOutput, const float *weights, float *gradInput) {
+    ensureColumns();
+    // pack the filters as [inputPlane * filterSizeSquared][filter], so the gemm
+    // walks both operands row-wise
+    weightsTransposed.resize(columnRows * dim.numFilters);
+    for(int filter = 0; filter < dim.numFilters; filter++) {
+        for(int row = 0; row < columnRows; row++) {
+            weightsTransposed[row * dim.numFilters + filter] = weights[filter * columnRows + row];
+        }
+    }
+    const int numThreads = threadPool->getNumThreads();
+    const int numChunks = batchSize >= numThreads ? 1 :
+        std::min(dim.inputPlanes, (numThreads + batchSize - 1) / batchSize);
+    threadPool->parallelFor(batchSize * numChunks, [&](int task, int threadId) {
+        const int n = task / numChunks;
+        const int chunk = task % numChunks;
+        const int startPlane = chunk * dim.inputPlanes / numChunks;
+        const int endPlane = (chunk + 1) * dim.inputPlanes / numChunks;
+        const int startRow = startPlane * dim.filterSizeSquared;
+        const int endRow = endPlane * dim.filterSizeSquared;
+        float *column = &columns[threadId][0];
+        sgemm(endRow - startRow, columnCols, dim.numFilters,
+            &weightsTransposed[startRow * dim.numFilters], dim.numFilters,
+            gradOutput + n * dim.outputCubeSize, columnCols,
+            column + startRow * columnCols, columnCols, false);
+        float *imageGradInput = gradInput + n * dim.inputCubeSize;
+        memset(imageGradInput + startPlane * dim.inputSizeSquared, 0,
+            sizeof(float) * (endPlane - startPlane) * dim.inputSizeSquared);
+        col2im(column, startPlane, endPlane, imageGradInput);
+    });
+}
+// writes gradWeights and gradBias, rather than adding to them, same as
+// BackpropWeightsCpu
+PUBLIC void CpuConvolution::calcGradWeights(int batchSize, const float *gradOutput, const float *input, float *gradWeights, float *gradBias) {
+    ensureColumns();
+    const int numThreads = threadPool->getNumThreads();
+    const int numWeights = dim.numFilters * columnRows;
+    for(int t = 0; t < numThreads; t++) {
+        gradWeightsPartial[t].assign(numWeights, 0.0f);
+        gradBiasPartial[t].assign(dim.numFilters, 0.0f);
+    }
+    // each thread accumulates into its own partial sums, which are added
+    // together afterwards.  any worker may pick up any image, so all the
+    // partials are summed, not just the first batchSize
+    threadPool->parallelFor(batchSize, [&](int n, int threadId) {
+        float *columnTransposed = &columns[threadId][0];
+        im2colTransposed(input + n * dim.inputCubeSize, columnTransposed);
+        const float *imageGradOutput = gradOutput + n * dim.outputCubeSize;
+        sgemm(dim.numFilters, columnRows, columnCols,
+            imageGradOutput, columnCols,
+            columnTransposed, columnRows,
+            &gradWeightsPartial[threadId][0], columnRows, true);
+        if(dim.biased) {
+            float *biasPartial = &gradBiasPartial[threadId][0];
+            for(int filter = 0; filter < dim.numFilters; filter++) {
+                const float *gradOutputPlane = imageGradOutput + filter * columnCols;
+                float sum = 0;
+                for(int i = 0; i < columnCols; i++) {
+                    sum += gradOutputPlane[i];
+                }
+                biasPartial[filter] += sum;
+            }
+        }
+    });
+    const int numReduceTasks = std::min(numThreads, numWeights);
+    threadPool->parallelFor(numReduceTasks, [&](int task, int threadId) {
+        const int start = task * numWeights / numReduceTasks;
+        const int end = (task + 1) * numWeights / numReduceTasks;
+        memcpy(gradWeights + start, &gradWeightsPartial[0][start], sizeof(float) * (end - start));
+        for(int t = 1; t < numThreads; t++) {
+            const float *partial = &gradWeightsPartial[t][0];
+            for(int i = start; i < end; i++) {
+                gradWeights[i] += partial[i];
+            }
+        }
+    });
+    if(dim.biased) {
+        for(int filter = 0; filter < dim.numFilters; filter++) {
+            float sum = 0;
+            for(int t = 0; t < numThreads; t++) {
+                sum += gradBiasPartial[t][filter];
+            }
+            gradBias[filter] = sum;
+        }
+    }
+}
+// one pool for all CpuConvolution instances, sized to the hardware; calls
+// into it are serialized, so per-thread scratch never sees two users at once
+PUBLIC STATIC ThreadPool *CpuConvolution::sharedThreadPool() {
+    static ThreadPool *thisPool = new ThreadPool(0);
+    return thisPool;
+}
+// row-major C[M][N] = (accumulate ? C : 0) + A[M][K] * B[K][N]
+// four rows of C are updated per pass over a row of B, and the innermost
+// loop runs along contiguous rows, so the compiler can vectorize it
+PUBLIC STATIC void CpuConvolution::sgemm(int M, int N, int K, const float *A, int lda, const float *B, int ldb, float *C, int ldc, bool accumulate) {
+    if(!accumulate) {
+        for(int i = 0; i < M; i++) {
+            memset(C + i * ldc, 0, sizeof(float) * N);
+        }
+    }
+    for(int j0 = 0; j0 < N; j0 += gemmBlockN) {
+        const int nb = std::min(gemmBlockN, N - j0);
+        for(int p0 = 0; p0 < K; p0 += gemmBlockK) {
+            const int kb = std::min(gemmBlockK, K - p0);
+            int i = 0;
+            for(; i + 4 <= M; i += 4) {
+                float *c0 = C + i * ldc + j0;
+                float *c1 = c0 + ldc;
+                float *c2 = c1 + ldc;
+                float *c3 = c2 + ldc;
+                const float *a0 = A + i * lda + p0;
+                const float *a1 = a0 + lda;
+                const float *a2 = a1 + lda;
+                const float *a3 = a2 + lda;
+                for(int p = 0; p < kb; p++) {
+                    const float *b = B + (p0 + p) * ldb + j0;
+                    const float a0p = a0[p];
+                    const float a1p = a1[p];
+                    const float a2p = a2[p];
+                    const float a3p = a3[p];
+                    for(int j = 0; j < nb; j++) {
+                        const float bj = b[j];
+                        c0[j] += a0p * bj;
+                        c1[j] += a1p * bj;
+                        c2[j] += a2p * bj;
+                        c3[j] += a3p * bj;
+                    }
+                }
+            }
+            for(; i < M; i++) {
+                float *c0 = C + i * ldc + j0;
+                const float *a0 = A + i * lda + p0;
+                for(int p = 0; p < kb; p++) {
+                    const float *b = B + (p0 + p) * ldb + j0;
+                    const float a0p = a0[p];
+                    for(int j = 0; j < nb; j++) {
+                        c0[j] += a0p * b[j];
+                    }
+                }
+            }
+        }
+    }
+}
+PRIVATE void CpuConvolution::ensureColumns() {
+    const int columnsSize = columnRows * columnCols;
+    for(int t = 0; t < (int)columns.size(); t++) {
+        if((int)columns[t].size() < columnsSize) {
+            columns[t].resize(columnsSize);
+        }
+    }
+}
+// column is [inputPlane][filterRow][filterCol][outputRow][outputCol]
+PRIVATE void CpuConvolution::im2col(const float *image, float *column) {
+    for(int plane = 0; plane < dim.inputPlanes; plane++) {
+        const float *imagePlane = image + plane * dim.inputSizeSquared;
+        for(int filterRow = 0; filterRow < dim.filterSize; filterRow++) {
+            for(int filterCol = 0; filterCol < dim.filterSize; filterCol++) {
+                float *dst = column + ((plane * dim.filterSize + filterRow) * dim.filterSize + filterCol) * columnCols;
+                for(int outRow = 0; outRow < dim.outputSize; outRow++) {
+                    const int inRow = outRow * stride - padding + filterRow;
+                    float *dstRow = dst + outRow * dim.outputSize;
+                    if(inRow < 0 || inRow >= dim.inputSize) {
+                        memset(dstRow, 0, sizeof(float) * dim.outputSize);
+                        continue;
+                    }
+                    const float *srcRow = imagePlane + inRow * dim.inputSize;
+                    for(int outCol = 0; outCol < dim.outputSize; outCol++) {
+                        const int inCol = outCol * stride - padding + filterCol;
+                        dstRow[outCol] = (inCol >= 0 && inCol < dim.inputSize) ? srcRow[inCol] : 0.0f;
+                    }
+                }
+            }
+        }
+    }
+}
+// columnTransposed is [outputRow][outputCol][inputPlane][filterRow][filterCol]
+PRIVATE void CpuConvolution::im2colTransposed(const float *image, float *columnTransposed) {
+    for(int outRow = 0; outRow < dim.outputSize; outRow++) {
+        for(int outCol = 0; outCol < dim.outputSize; outCol++) {
+            float *dst = columnTransposed + (outRow * dim.outputSize + outCol) * columnRows;
+            for(int plane = 0; plane < dim.inputPlanes; plane++) {
+                const float *imagePlane = image + plane * dim.inputSizeSquared;
+                for(int filterRow = 0; filterRow < dim.filterSize; filterRow++) {
+                    const int inRow = outRow * stride - padding + filterRow;
+                    const bool rowInside = inRow >= 0 && inRow < dim.inputSize;
+                    for(int filterCol = 0; filterCol < dim.filterSize; filterCol++) {
+                        const int inCol = outCol * stride - padding + filterCol;
+                        *dst++ = (rowInside && inCol >= 0 && inCol < dim.inputSize) ?
+                            imagePlane[inRow * dim.inputSize + inCol] : 0.0f;
+                    }
+                }
+            }
+        }
+    }
+}
+// adds column rows for planes [startPlane, endPlane) back into image
+PRIVATE void CpuConvolution::col2im(const float *column, int startPlane, int endPlane, float *image) {
+    for(int plane = startPlane; plane < endPlane; plane++) {
+        float *imagePlane = image + plane * dim.inputSizeSquared;
+        for(int filterRow = 0; filterRow < dim.filterSize; filterRow++) {
+            for(int filterCol = 0; filterCol < dim.filterSize; filterCol++) {
+                const float *src = column + ((plane * dim.filterSize + filterRow) * dim.filterSize + filterCol) * columnCols;
+                for(int outRow = 0; outRow < dim.outputSize; outRow++) {
+                    const int inRow = outRow * stride - padding + filterRow;
+                    if(inRow < 0 || inRow >= dim.inputSize) {
+                        continue;
+                    }
+                    const float *srcRow = src + outRow * dim.outputSize;
+                    float *dstRow = imagePlane + inRow * dim.inputSize;
+                    for(int outCol = 0; outCol < dim.outputSize; outCol++) {
+                        const int inCol = outCol * stride - padding + filterCol;
+                        if(inCol >= 0 && inCol < dim.inputSize) {
+                            dstRow[inCol] += srcRow[outCol];
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
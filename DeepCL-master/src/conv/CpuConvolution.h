@@ -0,0 +1,77 @@
+// Copyright Hugh Perkins 2016 hughperkins at gmail
+//
+// This Source Code Form is subject to the terms of the Mozilla Public License,
+// v. 2.0. If a copy of the MPL was not distributed with this file, You can
+// obtain one at http://mozilla.org/MPL/2.0/.
+
+#pragma once
+
+#include <vector>
+
+#include "conv/LayerDimensions.h"
+#include "DeepCLDllExport.h"
+
+class ThreadPool;
+
+#define VIRTUAL virtual
+#define STATIC static
+
+// Host-side convolution, used by ForwardCpuIm2Col, BackwardCpuIm2Col and
+// BackpropWeightsCpuIm2Col.
+//
+// Same im2col + gemm decomposition as the clBLAS Im2Col path, but on the cpu:
+// each image is unrolled into a [inputPlanes * filterSize * filterSize][outputSizeSquared]
+// column matrix, which is multiplied by the filters using a cache-blocked
+// sgemm.  Work is split across a shared ThreadPool, by image, and by filter
+// (forward) or input plane (backward) when there are fewer images than threads.
+//
+// Scratch buffers are owned by this object, per worker thread, and grown
+// once, so steady-state calls do no allocation.  All arrays are host arrays,
+// with the usual layouts:
+//   images  [n][inputPlane][inputRow][inputCol]
+//   filters [filter][inputPlane][filterRow][filterCol]
+//   output  [n][filter][outputRow][outputCol]
+class DeepCL_EXPORT CpuConvolution {
+private:
+    #ifdef _WIN32
+    #pragma warning(disable: 4251)
+    #endif
+    std::vector< std::vector<float> > columns; // per thread
+    std::vector< std::vector<float> > gradWeightsPartial; // per thread
+    std::vector< std::vector<float> > gradBiasPartial; // per thread
+    std::vector<float> weightsTransposed;
+    #ifdef _WIN32
+    #pragma warning(default: 4251)
+    #endif
+    LayerDimensions dim;
+    ThreadPool *threadPool;
+    int stride;
+    int padding;
+    int columnRows; // inputPlanes * filterSizeSquared
+    int columnCols; // outputSizeSquared
+
+    // [[[cog
+    // import cog_addheaders
+    // cog_addheaders.addv2()
+    // ]]]
+    // generated, using cog:
+
+    public:
+    CpuConvolution(LayerDimensions dim);
+    ~CpuConvolution();
+    int getNumThreads();
+    void forward(int batchSize, const float *input, const float *weights, const float *bias, float *output);
+    void backward(int batchSize, const float *gradOutput, const float *weights, float *gradInput);
+    void calcGradWeights(int batchSize, const float *gradOutput, const float *input, float *gradWeights, float *gradBias);
+    STATIC ThreadPool *sharedThreadPool();
+    STATIC void sgemm(int M, int N, int K, const float *A, int lda, const float *B, int ldb, float *C, int ldc, bool accumulate);
+
+    private:
+    void ensureColumns();
+    void im2col(const float *image, float *column);
+    void im2colTransposed(const float *image, float *columnTransposed);
+    void col2im(const float *column, int startPlane, int endPlane, float *image);
+
+    // [[[end]]]
+};
+
@@ -17,6 +17,9 @@
 #include "conv/ForwardFc.h"
 #include "conv/ForwardByInputPlane.h"
 #include "conv/ForwardIm2Col.h"
+#include "conv/ForwardCpuIm2Col.h"
+#include "conv/ForwardWinograd.h"
+#include "conv/Winograd.h"
 #include "conv/ForwardAuto.h"
 #include "util/StatefulTimer.h"
 
@@ -54,13 +57,16 @@ STATIC Forward *Forward::instanceTest(EasyCL *cl, LayerDimensions layerDimension
     return new Forward2(cl, layerDimensions);
 }
 STATIC int Forward::getNumImplementations() {
-    return 8;
+    return 11;
 }
 STATIC bool Forward::plausiblyOptimal(int index, int batchSize, LayerDimensions dim) {
     if(index == 0) { 
         return false;
     }
-    if(index > 7) {
+    if(index == 9 || index == 10) {
+        return Winograd::supports(dim);
+    }
+    if(index > 10) {
         return false;
     }
     return true;
@@ -87,6 +93,12 @@ STATIC Forward *Forward::instanceSpecific(int idx, EasyCL *cl, LayerDimensions l
         return new ForwardByInputPlane(cl, layerDimensions);
     } else if(idx == 7) {
         return new ForwardIm2Col(cl, layerDimensions);
+    } else if(idx == 8) {
+        return new ForwardCpuIm2Col(cl, layerDimensions);
+    } else if(idx == 9) {
+        return new ForwardWinograd(cl, layerDimensions, 2);
+    } else if(idx == 10) {
+        return new ForwardWinograd(cl, layerDimensions, 4);
     } else {
         throw runtime_error(string("") + __FILE__ + ":" + toString(__LINE__) + " Forward::instanceSpecific: no instance defined for index " + toString(idx));
     }
@@ -104,6 +116,12 @@ STATIC Forward *Forward::instanceSpecific(std::string name, EasyCL *cl, LayerDim
         return new ForwardFc(cl, layerDimensions);
     } else if(name == "byinplane") {
         return new ForwardByInputPlane(cl, layerDimensions);
+    } else if(name == "cpuim2col") {
+        return new ForwardCpuIm2Col(cl, layerDimensions);
+    } else if(name == "winograd2") {
+        return new ForwardWinograd(cl, layerDimensions, 2);
+    } else if(name == "winograd4") {
+        return new ForwardWinograd(cl, layerDimensions, 4);
     } else {
         throw runtime_error(string("") + __FILE__ + ":" + toString(__LINE__) + " Forward::instanceSpecific: no instance defined for name " + name);
     }
@@ -114,6 +132,11 @@ STATIC Forward *Forward::instanceSpecific(std::string name, EasyCL *cl, LayerDim
 //    forward(batchSize, inputData, filters, biases, output);
 //    return output;
 //}
+// implementations that cache something derived from the weights, such as
+// ForwardWinograd, must drop it here.  Anyone writing to the weights on the
+// device between forwards must call this
+VIRTUAL void Forward::weightsChanged() {
+}
 VIRTUAL int Forward::getOutputTotalSize(int batchSize) {
     return batchSize * dim.outputCubeSize;
 }
@@ -145,6 +168,7 @@ VIRTUAL void Forward::forward(int batchSize, float *inputData, float *filters, f
     cl->finish();
 
     StatefulTimer::timeCheck("Forward::forward after copied to device");
+    weightsChanged(); // new wrapper, which might reuse a freed one's address
     forward(batchSize, dataWrapper, weightsWrapper, biasWrapper,
             outputWrapper);
     StatefulTimer::timeCheck("Forward::forward after call forward");
@@ -8,6 +8,7 @@
 #include "util/stringhelper.h"
 #include "util/StatefulTimer.h"
 #include "conv/AddBias.h"
+#include "util/ProgramCache.h"
 
 using namespace std;
 
@@ -176,7 +177,7 @@ Forward1::Forward1(EasyCL *cl, LayerDimensions dim) :
     "}\n"
     "\n"
     "";
-    kernel = cl->buildKernelFromString(kernelSource, "convolve_imagecubes_float2", options, "cl/forward1.cl");
+    kernel = ProgramCache::buildKernelFromString(cl, kernelSource, "convolve_imagecubes_float2", options, "cl/forward1.cl");
     // [[[end]]]
 }
 
@@ -10,6 +10,7 @@
 #include "util/stringhelper.h"
 #include "util/StatefulTimer.h"
 #include "conv/AddBias.h"
+#include "util/ProgramCache.h"
 
 using namespace std;
 
@@ -170,7 +171,7 @@ Forward2::Forward2(EasyCL *cl, LayerDimensions dim) :
     "#endif\n"
     "\n"
     "";
-    kernel = cl->buildKernelFromString(kernelSource, "forward_2_by_outplane", options, "cl/forward2.cl");
+    kernel = ProgramCache::buildKernelFromString(cl, kernelSource, "forward_2_by_outplane", options, "cl/forward2.cl");
     // [[[end]]]
 }
 
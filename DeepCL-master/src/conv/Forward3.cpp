@@ -10,6 +10,7 @@
 #include "conv/AddBias.h"
 #include "util/stringhelper.h"
 #include "util/StatefulTimer.h"
+#include "util/ProgramCache.h"
 
 using namespace std;
 
@@ -157,7 +158,7 @@ Forward3::Forward3(EasyCL *cl, LayerDimensions dim) :
     "}\n"
     "\n"
     "";
-    kernel = cl->buildKernelFromString(kernelSource, "forward_3_by_n_outplane", options, "cl/forward3.cl");
+    kernel = ProgramCache::buildKernelFromString(cl, kernelSource, "forward_3_by_n_outplane", options, "cl/forward3.cl");
     // [[[end]]]
 }
 
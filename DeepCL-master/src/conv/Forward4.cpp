@@ -8,6 +8,7 @@
 #include "util/stringhelper.h"
 #include "util/StatefulTimer.h"
 #include "conv/AddBias.h"
+#include "util/ProgramCache.h"
 
 using namespace std;
 
@@ -187,7 +188,7 @@ Forward4::Forward4(EasyCL *cl, LayerDimensions dim) :
     "#endif\n"
     "\n"
     "";
-    kernel = cl->buildKernelFromString(kernelSource, "forward_4_by_n_outplane_smallercache", options, "cl/forward4.cl");
+    kernel = ProgramCache::buildKernelFromString(cl, kernelSource, "forward_4_by_n_outplane_smallercache", options, "cl/forward4.cl");
     // [[[end]]]
 }
 
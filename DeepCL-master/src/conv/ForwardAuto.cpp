@@ -7,11 +7,14 @@
 #include <iostream>
 #include <algorithm>
 #include <stdexcept>
+#include <vector>
 
 #include "conv/ForwardAuto.h"
+#include "conv/TuningDatabase.h"
 #include "util/stringhelper.h"
 #include "util/StatefulTimer.h"
 #include "util/Timer.h"
+#include "net/DeviceProfiler.h"
 
 using namespace std;
 
@@ -26,10 +29,11 @@ ForwardAuto::ForwardAuto(EasyCL *cl, LayerDimensions dim) :
         milliseconds(0),
         valid(0),
         chosenIndex(-1),
-        instances(0)
+        instances(0),
+        triedDatabase(false)
          {
     num = Forward::getNumImplementations();
-    milliseconds = new int[ num];
+    milliseconds = new float[ num];
     valid = new bool[ num ];
     instances = new Forward *[ num ];
     for(int i = 0; i < num; i++) {
@@ -46,10 +50,36 @@ VIRTUAL ForwardAuto::~ForwardAuto() {
         }
     }
 }
+VIRTUAL void ForwardAuto::weightsChanged() {
+    for(int i = 0; i < num; i++) {
+        if(instances[i] != 0) {
+            instances[i]->weightsChanged();
+        }
+    }
+}
+// if the tuning database already knows the answer for this device and these
+// dimensions, use it, and skip the trial runs
+void ForwardAuto::chooseFromDatabase(int batchSize) {
+    triedDatabase = true;
+    int dbIndex = TuningDatabase::instance()->lookup(TuningDatabase::makeKey(cl, "forward", batchSize, dim));
+    if(dbIndex < 0 || dbIndex >= num) {
+        return;
+    }
+    try {
+        instances[dbIndex] = Forward::instanceSpecific(dbIndex, cl, dim);
+        valid[dbIndex] = true;
+        chosenIndex = dbIndex;
+        cout << StatefulTimer::instance()->prefix << "ForwardAuto: using kernel " << dbIndex << " from tuning database" << endl;
+    } catch(runtime_error &e) {
+        cout << StatefulTimer::instance()->prefix << "ForwardAuto: kernel " << dbIndex << " from tuning database cant be used: " << e.what() << endl;
+        valid[dbIndex] = false;
+    }
+}
 VIRTUAL void ForwardAuto::forward(int batchSize, CLWrapper *dataWrapper, CLWrapper *weightsWrapper, 
         CLWrapper *biasWrapper, CLWrapper *outputWrapper) {
-//    Forward *instance = 0;
-//    cout << "ForwardAuto::forward" << endl;
+    if(chosenIndex == -1 && !triedDatabase) {
+        chooseFromDatabase(batchSize);
+    }
     while(chosenIndex == -1 && nextIndex < num) {
         int thisIndex = nextIndex;
         nextIndex++;
@@ -66,15 +96,21 @@ VIRTUAL void ForwardAuto::forward(int batchSize, CLWrapper *dataWrapper, CLWrapp
                 valid[thisIndex] = false;
             }
             if(valid[thisIndex]) {
-                Timer timer;
                 try {
+                    DeviceProfiler::annotate("forward kernel " + toString(thisIndex) + " (tuning)");
+                    // first run is the warm-up, and also gives this batch its result.  Then
+                    // take the median of several timed runs, so one noisy run cant pick the kernel
                     candidate->forward(batchSize, dataWrapper, weightsWrapper, biasWrapper, outputWrapper);
-                    milliseconds[thisIndex] = (int)timer.lap();
-                    cout << StatefulTimer::instance()->prefix << "ForwardAuto: kernel " << thisIndex << " " << milliseconds[thisIndex] << "ms" << endl;
-                    if (milliseconds[thisIndex] == 0) { //we can't get better time, use this instance
-                        cout << "   forward layer selected kernel with zero time" << thisIndex << endl;
-                        this->chosenIndex = thisIndex;
+                    cl->finish();
+                    vector<float> times;
+                    for(int run = 0; run < TuningDatabase::instance()->getNumTimedRuns(); run++) {
+                        Timer timer;
+                        candidate->forward(batchSize, dataWrapper, weightsWrapper, biasWrapper, outputWrapper);
+                        cl->finish();
+                        times.push_back((float)(timer.lapMicroseconds() / 1000.0));
                     }
+                    milliseconds[thisIndex] = TuningDatabase::median(times);
+                    cout << StatefulTimer::instance()->prefix << "ForwardAuto: kernel " << thisIndex << " " << milliseconds[thisIndex] << "ms" << endl;
                     return;
                 } catch(runtime_error &e) {
                     cout << StatefulTimer::instance()->prefix << "ForwardAuto: kernel " << thisIndex << " this instance cant be used: " << e.what() << endl;
@@ -92,7 +128,7 @@ VIRTUAL void ForwardAuto::forward(int batchSize, CLWrapper *dataWrapper, CLWrapp
     if(chosenIndex == -1) {
 //        cout << StatefulTimer::instance()->prefix + "ForwardAuto::forward choosing best instance:" << endl;
         int bestIndex = -1;
-        int bestTime = 0;
+        float bestTime = 0;
         for(int i = 0; i < num; i++) {
             if(!valid[i]) {
                 cout << "   forward kernel " << i << ": cannot be used" << endl;
@@ -112,11 +148,12 @@ VIRTUAL void ForwardAuto::forward(int batchSize, CLWrapper *dataWrapper, CLWrapp
         if(bestIndex != -1) {
             cout << "   forward layer selected kernel " << bestIndex << endl;
             this->chosenIndex = bestIndex;
+            TuningDatabase::instance()->record(TuningDatabase::makeKey(cl, "forward", batchSize, dim), bestIndex, bestTime);
         } else {
             throw runtime_error(StatefulTimer::instance()->prefix + "No valid forward implementations found");
         }
     }
 //    cout << "ForwardAuto::forward using instance index: " << chosenIndex << endl;
+    DeviceProfiler::annotate("forward kernel " + toString(chosenIndex));
     instances[chosenIndex]->forward(batchSize, dataWrapper, weightsWrapper, biasWrapper, outputWrapper);
 }
-
@@ -32,11 +32,12 @@ public:
 //    ActivationFunction const*fn;
 
     int num;
-    int *milliseconds;
+    float *milliseconds;
     bool *valid;
     int chosenIndex;
     Forward **instances;
     int nextIndex;
+    bool triedDatabase;
 
     // [[[cog
     // import cog_addheaders
@@ -45,6 +46,8 @@ public:
     // generated, using cog:
     ForwardAuto(EasyCL *cl, LayerDimensions dim);
     VIRTUAL ~ForwardAuto();
+    VIRTUAL void weightsChanged();
+    void chooseFromDatabase(int batchSize);
     VIRTUAL void forward(int batchSize, CLWrapper *dataWrapper, CLWrapper *weightsWrapper,
     CLWrapper *biasWrapper, CLWrapper *outputWrapper);
 
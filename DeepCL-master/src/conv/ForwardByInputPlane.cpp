@@ -9,6 +9,7 @@
 #include "ForwardByInputPlane.h"
 #include "util/stringhelper.h"
 #include "util/StatefulTimer.h"
+#include "util/ProgramCache.h"
 
 using namespace std;
 
@@ -219,7 +220,7 @@ ForwardByInputPlane::ForwardByInputPlane(EasyCL *cl, LayerDimensions dim) :
     "}\n"
     "\n"
     "";
-    kernel = cl->buildKernelFromString(kernelSource, "forward_byinputplane", options, "cl/forward_byinputplane.cl");
+    kernel = ProgramCache::buildKernelFromString(cl, kernelSource, "forward_byinputplane", options, "cl/forward_byinputplane.cl");
     // generated using cog, from cl/reduce_segments.cl:
     const char * reduceSegmentsSource =  
     "// Copyright Hugh Perkins 2015 hughperkins at gmail\n"
@@ -247,7 +248,7 @@ ForwardByInputPlane::ForwardByInputPlane(EasyCL *cl, LayerDimensions dim) :
     "\n"
     "\n"
     "";
-    reduceSegments = cl->buildKernelFromString(reduceSegmentsSource, "reduce_segments", options, "cl/reduce_segments.cl");
+    reduceSegments = ProgramCache::buildKernelFromString(cl, reduceSegmentsSource, "reduce_segments", options, "cl/reduce_segments.cl");
     // generated using cog, from cl/per_element_add.cl:
     const char * repeatedAddSource =  
     "// Copyright Hugh Perkins 2015 hughperkins at gmail\n"
@@ -283,7 +284,7 @@ ForwardByInputPlane::ForwardByInputPlane(EasyCL *cl, LayerDimensions dim) :
     "}\n"
     "\n"
     "";
-    repeatedAdd = cl->buildKernelFromString(repeatedAddSource, "repeated_add", options, "cl/per_element_add.cl");
+    repeatedAdd = ProgramCache::buildKernelFromString(cl, repeatedAddSource, "repeated_add", options, "cl/per_element_add.cl");
     // [[[end]]]
 }
 
@@ -0,0 +1,41 @@
+// Copyright Hugh Perkins 2016 hughperkins at gmail
+//
+// This Source Code Form is subject to the terms of the Mozilla Public License,
+// v. 2.0. If a copy of the MPL was not distributed with this file, You can
+// obtain one at http://mozilla.org/MPL/2.0/.
+
+#include "EasyCL.h"
+
+#include "conv/ForwardCpuIm2Col.h"
+#include "conv/CpuConvolution.h"
+#include "util/StatefulTimer.h"
+
+using namespace std;
+
+#undef VIRTUAL
+#undef STATIC
+#define VIRTUAL
+#define STATIC
+
+PUBLIC ForwardCpuIm2Col::ForwardCpuIm2Col(EasyCL *cl, LayerDimensions dim) :
+            Forward(cl, dim) {
+    cpuConvolution = new CpuConvolution(dim);
+}
+PUBLIC VIRTUAL ForwardCpuIm2Col::~ForwardCpuIm2Col() {
+    delete cpuConvolution;
+}
+PUBLIC VIRTUAL void ForwardCpuIm2Col::forward(int batchSize, CLWrapper *dataWrapper, CLWrapper *weightsWrapper, CLWrapper *biasWrapper, CLWrapper *outputWrapper) {
+    StatefulTimer::timeCheck("ForwardCpuIm2Col::forward START");
+    dataWrapper->copyToHost();
+    weightsWrapper->copyToHost();
+    float *bias = 0;
+    if(dim.biased) {
+        biasWrapper->copyToHost();
+        bias = (float *)biasWrapper->getHostArray();
+    }
+    // results go straight into the output wrapper's host array
+    cpuConvolution->forward(batchSize, (float *)dataWrapper->getHostArray(),
+        (float *)weightsWrapper->getHostArray(), bias, (float *)outputWrapper->getHostArray());
+    outputWrapper->copyToDevice();
+    StatefulTimer::timeCheck("ForwardCpuIm2Col::forward END");
+}
@@ -11,6 +11,7 @@
 #include "util/StatefulTimer.h"
 #include "conv/AddBias.h"
 #include "conv/ReduceSegments.h"
+#include "util/ProgramCache.h"
 
 using namespace std;
 
@@ -207,7 +208,7 @@ ForwardFc::ForwardFc(EasyCL *cl, LayerDimensions dim) :
     "#endif\n"
     "\n"
     "";
-    kernel1 = cl->buildKernelFromString(kernel1Source, "forward_fc_workgroup_perrow", options, "cl/forward_fc_wgperrow.cl");
+    kernel1 = ProgramCache::buildKernelFromString(cl, kernel1Source, "forward_fc_workgroup_perrow", options, "cl/forward_fc_wgperrow.cl");
     // [[[end]]]
 }
 
@@ -7,7 +7,6 @@
 #include "conv/ForwardIm2Col.h"
 #include "util/stringhelper.h"
 #include "util/StatefulTimer.h"
-#include "conv/AddBias.h"
 //#include "clblas/ClBlasInstance.h"
 #include "clblas/ClBlasHelper.h"
 #include "conv/Im2Col.h"
@@ -15,6 +14,7 @@
 #include <sstream>
 #include <iostream>
 #include <string>
+#include <algorithm>
 
 using namespace std;
 
@@ -29,32 +29,30 @@ PUBLIC ForwardIm2Col::ForwardIm2Col(EasyCL *cl, LayerDimensions dim) :
         {
 //    ClBlasInstance::initializeIfNecessary();
 
-    addBias = new AddBias(cl);
     im2Col = new Im2Col(cl, dim);
 }
 PUBLIC VIRTUAL ForwardIm2Col::~ForwardIm2Col() {
-    delete addBias;
     delete im2Col;
 }
+// Runs chunks of images as one wide gemm each, rather than one gemm per image,
+// see Im2Col::im2ColBatched.  The gemm output comes back filter-major, and
+// fromFilterMajor puts it back in the usual layout, adding the bias on the way
 PUBLIC VIRTUAL void ForwardIm2Col::forward(int batchSize, CLWrapper *dataWrapper, CLWrapper *weightsWrapper, CLWrapper *biasWrapper, CLWrapper *outputWrapper) {
     StatefulTimer::timeCheck("ForwardIm2Col::forward START");
 
-    int columnsSize= dim.inputPlanes * dim.filterSizeSquared * dim.outputSizeSquared;
-    float *columns = new float[columnsSize];
-    CLWrapper *columnsWrapper = cl->wrap(columnsSize, columns);
-    columnsWrapper->createOnDevice();
-//    cout << "columnsSize: " << columnsSize << endl;
-//    cout << "weightsize: " << weightsWrapper->size() << endl;
+    int chunkSize = im2Col->getChunkSize(batchSize);
+    CLWrapper *columnsWrapper = im2Col->getColumnsScratch(chunkSize);
+    CLWrapper *filterMajorWrapper = im2Col->getFilterMajorScratch(chunkSize);
 
     StatefulTimer::timeCheck("ForwardIm2Col::forward after alloc");
 
-    for (int b = 0; b < batchSize; b ++) {
-        im2Col->im2Col(dataWrapper, b * dim.inputCubeSize, columnsWrapper);
+    for(int b = 0; b < batchSize; b += chunkSize) {
+        int thisChunkSize = std::min(chunkSize, batchSize - b);
+        im2Col->im2ColBatched(dataWrapper, b * dim.inputCubeSize, thisChunkSize, columnsWrapper);
 
-        long m = dim.outputSizeSquared;
+        long m = thisChunkSize * dim.outputSizeSquared;
         long n = dim.numFilters;
         long k = dim.inputPlanes * dim.filterSizeSquared;
-//        cout << "m=" << m << " n=" << n << " k=" << k << endl;
 
         ClBlasHelper::Gemm(
             cl, clblasColumnMajor, clblasNoTrans, clblasNoTrans,
@@ -63,20 +61,11 @@ PUBLIC VIRTUAL void ForwardIm2Col::forward(int batchSize, CLWrapper *dataWrapper
             columnsWrapper, 0,
             weightsWrapper, 0,
             0,
-            outputWrapper, b * dim.outputCubeSize
+            filterMajorWrapper, 0
         );
-    }
-
-    delete columnsWrapper;
-    delete[] columns;
-
-    StatefulTimer::timeCheck("ForwardIm2Col::forward after call forward");
 
-    if(dim.biased) {
-        addBias->forward(
-            batchSize, dim.numFilters, dim.outputSize,
-            outputWrapper, biasWrapper);
+        im2Col->fromFilterMajor(thisChunkSize, filterMajorWrapper, biasWrapper, outputWrapper, b * dim.outputCubeSize);
     }
+
     StatefulTimer::timeCheck("ForwardIm2Col::forward END");
 }
-
@@ -8,7 +8,6 @@
 
 #include "Forward.h"
 
-class AddBias;
 class Im2Col;
 
 #include "DeepCLDllExport.h"
@@ -20,7 +19,6 @@ class DeepCL_EXPORT ForwardIm2Col : public Forward {
     private:
 //    CLKernel *kernelIm2Col;
 //    CLKernel *kernelCol2Im;
-    AddBias *addBias;
     Im2Col *im2Col;
 
     float *columns;
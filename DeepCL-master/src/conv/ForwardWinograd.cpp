@@ -0,0 +1,50 @@
+// Copyright Hugh Perkins 2016 hughperkins at gmail
+//
+// This Source Code Form is subject to the terms of the Mozilla Public License,
+// v. 2.0. If a copy of the MPL was not distributed with this file, You can
+// obtain one at http://mozilla.org/MPL/2.0/.
+
+#include "conv/ForwardWinograd.h"
+#include "conv/Winograd.h"
+#include "util/stringhelper.h"
+#include "util/StatefulTimer.h"
+
+#include <iostream>
+#include <string>
+
+using namespace std;
+
+#undef VIRTUAL
+#undef STATIC
+#define VIRTUAL
+#define STATIC
+#define PUBLIC
+
+PUBLIC ForwardWinograd::ForwardWinograd(EasyCL *cl, LayerDimensions dim, int outputTile) :
+            Forward(cl, dim),
+            winograd(0),
+            transformedWeightsWrapper(0),
+            filtersTransformed(false) {
+    if(!Winograd::supports(dim)) {
+        throw runtime_error("ForwardWinograd only supports 3x3 filters with stride 1, not filterSize "
+            + toString(dim.filterSize) + " skip " + toString(dim.skip));
+    }
+    winograd = new Winograd(cl, outputTile, dim.inputPlanes, dim.inputSize, dim.numFilters, dim.outputSize,
+        Winograd::paddingFor(dim), false, dim.biased);
+}
+PUBLIC VIRTUAL ForwardWinograd::~ForwardWinograd() {
+    delete winograd;
+}
+PUBLIC VIRTUAL void ForwardWinograd::weightsChanged() {
+    filtersTransformed = false;
+}
+PUBLIC VIRTUAL void ForwardWinograd::forward(int batchSize, CLWrapper *dataWrapper, CLWrapper *weightsWrapper, CLWrapper *biasWrapper, CLWrapper *outputWrapper) {
+    StatefulTimer::timeCheck("ForwardWinograd::forward START");
+    if(!filtersTransformed || weightsWrapper != transformedWeightsWrapper) {
+        winograd->transformFilters(weightsWrapper);
+        transformedWeightsWrapper = weightsWrapper;
+        filtersTransformed = true;
+    }
+    winograd->convolve(batchSize, dataWrapper, biasWrapper, outputWrapper);
+    StatefulTimer::timeCheck("ForwardWinograd::forward END");
+}
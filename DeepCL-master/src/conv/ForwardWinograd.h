@@ -0,0 +1,41 @@
+// Copyright Hugh Perkins 2016 hughperkins at gmail
+//
+// This Source Code Form is subject to the terms of the Mozilla Public License,
+// v. 2.0. If a copy of the MPL was not distributed with this file, You can
+// obtain one at http://mozilla.org/MPL/2.0/.
+
+#pragma once
+
+#include "Forward.h"
+
+class Winograd;
+
+#include "DeepCLDllExport.h"
+
+#define VIRTUAL virtual
+#define STATIC static
+
+// Winograd F(2x2, 3x3) or F(4x4, 3x3) forward, for 3x3 stride 1 layers, see
+// Winograd.  The filter transform is kept between batches, and only redone
+// when weightsChanged() has been called, or the weights wrapper changes
+class DeepCL_EXPORT ForwardWinograd : public Forward {
+    private:
+    Winograd *winograd;
+    CLWrapper *transformedWeightsWrapper; // the weights the transform is from, NOT owned
+    bool filtersTransformed;
+
+    // [[[cog
+    // import cog_addheaders
+    // cog_addheaders.addv2()
+    // ]]]
+    // generated, using cog:
+
+    public:
+    ForwardWinograd(EasyCL *cl, LayerDimensions dim, int outputTile);
+    VIRTUAL ~ForwardWinograd();
+    VIRTUAL void weightsChanged();
+    VIRTUAL void forward(int batchSize, CLWrapper *dataWrapper, CLWrapper *weightsWrapper, CLWrapper *biasWrapper, CLWrapper *outputWrapper);
+
+    // [[[end]]]
+};
+
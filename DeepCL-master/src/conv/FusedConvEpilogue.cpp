@@ -0,0 +1,448 @@
+// Copyright Hugh Perkins 2016 hughperkins at gmail
+//
+// This Source Code Form is subject to the terms of the Mozilla Public License,
+// v. 2.0. If a copy of the MPL was not distributed with this file, You can
+// obtain one at http://mozilla.org/MPL/2.0/.
+
+#include <iostream>
+
+#include "EasyCL.h"
+#include "util/StatefulTimer.h"
+#include "util/stringhelper.h"
+#include "activate/ActivationFunction.h"
+#include "conv/FusedConvEpilogue.h"
+#include "util/ProgramCache.h"
+
+using namespace std;
+
+#undef STATIC
+#undef VIRTUAL
+#define STATIC
+#define VIRTUAL
+
+VIRTUAL FusedConvEpilogue::~FusedConvEpilogue() {
+    delete forwardKernel;
+    delete backwardKernel;
+    delete noBiasWrapper;
+}
+// selectorsWrapper and outputWrapper are only used if pooling, otherwise
+// convOutputWrapper is updated in place, and they can be 0
+VIRTUAL void FusedConvEpilogue::forward(int batchSize, CLWrapper *convOutputWrapper, CLWrapper *biasWrapper, CLWrapper *selectorsWrapper, CLWrapper *outputWrapper) {
+    StatefulTimer::timeCheck("FusedConvEpilogue::forward begin");
+
+    CLWrapper *bias = dim.biased ? biasWrapper : noBiasWrapper;
+    int globalSize = 0;
+    if(poolingSize == 0) {
+        globalSize = batchSize * dim.outputCubeSize;
+        forwardKernel->in(globalSize)
+            ->inout(convOutputWrapper)
+            ->in(bias);
+    } else {
+        globalSize = batchSize * dim.numFilters * outputSize * outputSize;
+        forwardKernel->in(batchSize)
+            ->in(convOutputWrapper)
+            ->in(bias)
+            ->out(selectorsWrapper)
+            ->out(outputWrapper);
+    }
+    int workgroupSize = 64;
+    int numWorkgroups = (globalSize + workgroupSize - 1) / workgroupSize;
+    forwardKernel->run_1d(numWorkgroups * workgroupSize, workgroupSize);
+    cl->finish();
+
+    StatefulTimer::timeCheck("FusedConvEpilogue::forward end");
+}
+// outputWrapper is the fused block's output, ie the convolution output itself,
+// after forward, if not pooling, or the pooled output
+VIRTUAL void FusedConvEpilogue::backward(int batchSize, CLWrapper *outputWrapper, CLWrapper *selectorsWrapper, CLWrapper *gradOutputWrapper, CLWrapper *gradConvOutputWrapper) {
+    StatefulTimer::timeCheck("FusedConvEpilogue::backward begin");
+
+    int globalSize = batchSize * dim.outputCubeSize;
+    if(poolingSize == 0) {
+        backwardKernel->in(globalSize)
+            ->in(outputWrapper)
+            ->in(gradOutputWrapper)
+            ->out(gradConvOutputWrapper);
+    } else {
+        backwardKernel->in(batchSize)
+            ->in(outputWrapper)
+            ->in(selectorsWrapper)
+            ->in(gradOutputWrapper)
+            ->out(gradConvOutputWrapper);
+    }
+    int workgroupSize = 64;
+    int numWorkgroups = (globalSize + workgroupSize - 1) / workgroupSize;
+    backwardKernel->run_1d(numWorkgroups * workgroupSize, workgroupSize);
+    cl->finish();
+
+    StatefulTimer::timeCheck("FusedConvEpilogue::backward end");
+}
+FusedConvEpilogue::FusedConvEpilogue(EasyCL *cl, LayerDimensions dim, ActivationFunction const *fn, int poolingSize, bool poolingPadZeros) :
+        cl(cl),
+        forwardKernel(0),
+        backwardKernel(0),
+        noBiasWrapper(0),
+        dim(dim),
+        poolingSize(poolingSize),
+        outputSize(poolingSize == 0 ? dim.outputSize :
+            (poolingPadZeros ? (dim.outputSize + poolingSize - 1) / poolingSize : dim.outputSize / poolingSize)) {
+    if(!dim.biased) {
+        noBias[0] = 0.0f;
+        noBiasWrapper = cl->wrap(1, noBias);
+        noBiasWrapper->copyToDevice();
+    }
+    string options = "";
+    options += " -DgNumFilters=" + toString(dim.numFilters);
+    options += " -DgConvOutputSize=" + toString(dim.outputSize);
+    options += " -DgConvOutputSizeSquared=" + toString(dim.outputSizeSquared);
+    if(poolingSize != 0) {
+        options += " -DgPoolingSize=" + toString(poolingSize);
+        options += " -DgOutputSize=" + toString(outputSize);
+        options += " -DgOutputSizeSquared=" + toString(outputSize * outputSize);
+    }
+    if(dim.biased) {
+        options += " -DBIASED";
+    }
+    options += string(" -D ") + fn->getDefineName();
+
+    // [[[cog
+    // import stringify
+    // stringify.write_kernel2("forwardKernel", "cl/fused_conv_epilogue.cl", "fused_forward", 'options')
+    // ]]]
+    // generated using cog, from cl/fused_conv_epilogue.cl:
+    const char * forwardKernelSource =  
+    "// Copyright Hugh Perkins 2016 hughperkins at gmail\n"
+    "//\n"
+    "// This Source Code Form is subject to the terms of the Mozilla Public License,\n"
+    "// v. 2.0. If a copy of the MPL was not distributed with this file, You can\n"
+    "// obtain one at http://mozilla.org/MPL/2.0/.\n"
+    "\n"
+    "// bias, activation, and optionally max-pooling, applied to the output of a\n"
+    "// convolution in one pass, instead of AddBias, ActivationLayer and PoolingLayer\n"
+    "// each reading and writing the whole output\n"
+    "//\n"
+    "// expected defines:\n"
+    "// one of: [ TANH | RELU | LINEAR | SIGMOID | SCALEDTANH | ELU ]\n"
+    "// BIASED, if the convolutional layer has bias\n"
+    "// gNumFilters\n"
+    "// gConvOutputSize, gConvOutputSizeSquared: size of the convolution output\n"
+    "// if a pooling layer is fused too:\n"
+    "//   gPoolingSize\n"
+    "//   gOutputSize, gOutputSizeSquared: size of the pooled output\n"
+    "\n"
+    "#ifdef TANH\n"
+    "    #define ACTIVATION_FUNCTION(output) (tanh(output))\n"
+    "    #define ACTIVATION_DERIV(output) (1 - output * output)\n"
+    "#elif defined SCALEDTANH\n"
+    "    #define ACTIVATION_FUNCTION(output) (1.7159f * tanh(0.66667f * output))\n"
+    "    #define ACTIVATION_DERIV(output) (0.66667f * (1.7159f - 1 / 1.7159f * output * output) )\n"
+    "#elif defined SIGMOID\n"
+    "    #define ACTIVATION_FUNCTION(output) (1.0f / (1 + exp(-output)))\n"
+    "    #define ACTIVATION_DERIV(output) (output * (1 - output) )\n"
+    "#elif defined RELU\n"
+    "    #define ACTIVATION_FUNCTION(output) (output> 0 ? output : 0)\n"
+    "    #define ACTIVATION_DERIV(output) (output > 0 ? 1 : 0)\n"
+    "#elif defined ELU\n"
+    "    #define ACTIVATION_FUNCTION(output) (output> 0 ? output : exp(output) - 1)\n"
+    "    #define ACTIVATION_DERIV(output) (output > 0 ? 1 : output + 1)\n"
+    "#elif defined LINEAR\n"
+    "    #define ACTIVATION_FUNCTION(output) (output)\n"
+    "    #define ACTIVATION_DERIV(output) (1.0f)\n"
+    "#endif\n"
+    "\n"
+    "#ifdef ACTIVATION_FUNCTION // protect against not defined\n"
+    "#ifdef gPoolingSize\n"
+    "\n"
+    "// one workitem per pooled output, globalid is [n][filter][outputRow][outputCol]\n"
+    "// selectors are as for PoolingLayer, so the pooled output, and selectors, are\n"
+    "// exactly what conv + activation + pooling would produce\n"
+    "kernel void fused_forward(\n"
+    "        const int batchSize,\n"
+    "        global const float *convOutput,\n"
+    "        global const float *bias,\n"
+    "        global int *selectors,\n"
+    "        global float *output) {\n"
+    "    const int globalId = get_global_id(0);\n"
+    "\n"
+    "    const int intraImageOffset = globalId % gOutputSizeSquared;\n"
+    "    const int outputRow = intraImageOffset / gOutputSize;\n"
+    "    const int outputCol = intraImageOffset % gOutputSize;\n"
+    "\n"
+    "    const int image2dIdx = globalId / gOutputSizeSquared;\n"
+    "    const int filter = image2dIdx % gNumFilters;\n"
+    "    const int n = image2dIdx / gNumFilters;\n"
+    "    if (n >= batchSize) {\n"
+    "        return;\n"
+    "    }\n"
+    "#ifdef BIASED\n"
+    "    const float biasValue = bias[filter];\n"
+    "#else\n"
+    "    const float biasValue = 0.0f;\n"
+    "#endif\n"
+    "\n"
+    "    const int inputRow = outputRow * gPoolingSize;\n"
+    "    const int inputCol = outputCol * gPoolingSize;\n"
+    "    global const float *convPlane = convOutput + image2dIdx * gConvOutputSizeSquared;\n"
+    "    int selector = 0;\n"
+    "    float value = convPlane[inputRow * gConvOutputSize + inputCol] + biasValue;\n"
+    "    float maxValue = ACTIVATION_FUNCTION(value);\n"
+    "    for (int dRow = 0; dRow < gPoolingSize; dRow++) {\n"
+    "        for (int dCol = 0; dCol < gPoolingSize; dCol++) {\n"
+    "            bool process = (inputRow + dRow < gConvOutputSize) && (inputCol + dCol < gConvOutputSize);\n"
+    "            if (process) {\n"
+    "                value = convPlane[(inputRow + dRow) * gConvOutputSize + inputCol + dCol] + biasValue;\n"
+    "                float thisValue = ACTIVATION_FUNCTION(value);\n"
+    "                if (thisValue > maxValue) {\n"
+    "                    maxValue = thisValue;\n"
+    "                    selector = dRow * gPoolingSize + dCol;\n"
+    "                }\n"
+    "            }\n"
+    "        }\n"
+    "    }\n"
+    "    output[globalId] = maxValue;\n"
+    "    selectors[globalId] = selector;\n"
+    "}\n"
+    "\n"
+    "// one workitem per convolution output, globalid is [n][filter][convRow][convCol]\n"
+    "// only the element each pool selected gets any gradient\n"
+    "kernel void fused_backward(\n"
+    "        const int batchSize,\n"
+    "        global const float *output,\n"
+    "        global const int *selectors,\n"
+    "        global const float *gradOutput,\n"
+    "        global float *gradConvOutput) {\n"
+    "    const int globalId = get_global_id(0);\n"
+    "\n"
+    "    const int intraImageOffset = globalId % gConvOutputSizeSquared;\n"
+    "    const int convRow = intraImageOffset / gConvOutputSize;\n"
+    "    const int convCol = intraImageOffset % gConvOutputSize;\n"
+    "\n"
+    "    const int image2dIdx = globalId / gConvOutputSizeSquared;\n"
+    "    if (image2dIdx >= batchSize * gNumFilters) {\n"
+    "        return;\n"
+    "    }\n"
+    "\n"
+    "    const int outputRow = convRow / gPoolingSize;\n"
+    "    const int outputCol = convCol / gPoolingSize;\n"
+    "    float gradient = 0.0f;\n"
+    "    if (outputRow < gOutputSize && outputCol < gOutputSize) {\n"
+    "        const int outputIdx = image2dIdx * gOutputSizeSquared + outputRow * gOutputSize + outputCol;\n"
+    "        const int selector = (convRow % gPoolingSize) * gPoolingSize + (convCol % gPoolingSize);\n"
+    "        if (selectors[outputIdx] == selector) {\n"
+    "            float value = output[outputIdx];\n"
+    "            gradient = ACTIVATION_DERIV(value) * gradOutput[outputIdx];\n"
+    "        }\n"
+    "    }\n"
+    "    gradConvOutput[globalId] = gradient;\n"
+    "}\n"
+    "\n"
+    "#else\n"
+    "\n"
+    "// in place, on the convolution output\n"
+    "kernel void fused_forward(\n"
+    "        const int N,\n"
+    "        global float *convOutput,\n"
+    "        global const float *bias) {\n"
+    "    const int globalId = get_global_id(0);\n"
+    "    if (globalId >= N) {\n"
+    "        return;\n"
+    "    }\n"
+    "#ifdef BIASED\n"
+    "    const int filter = (globalId / gConvOutputSizeSquared) % gNumFilters;\n"
+    "    float value = convOutput[globalId] + bias[filter];\n"
+    "#else\n"
+    "    float value = convOutput[globalId];\n"
+    "#endif\n"
+    "    convOutput[globalId] = ACTIVATION_FUNCTION(value);\n"
+    "}\n"
+    "\n"
+    "kernel void fused_backward(\n"
+    "        const int N,\n"
+    "        global const float *output,\n"
+    "        global const float *gradOutput,\n"
+    "        global float *gradConvOutput) {\n"
+    "    const int globalId = get_global_id(0);\n"
+    "    if (globalId >= N) {\n"
+    "        return;\n"
+    "    }\n"
+    "    float value = output[globalId];\n"
+    "    gradConvOutput[globalId] = ACTIVATION_DERIV(value) * gradOutput[globalId];\n"
+    "}\n"
+    "\n"
+    "#endif\n"
+    "#endif\n"
+    "\n"
+    "";
+    forwardKernel = ProgramCache::buildKernelFromString(cl, forwardKernelSource, "fused_forward", options, "cl/fused_conv_epilogue.cl");
+    // [[[end]]]
+    // [[[cog
+    // import stringify
+    // stringify.write_kernel2("backwardKernel", "cl/fused_conv_epilogue.cl", "fused_backward", 'options')
+    // ]]]
+    // generated using cog, from cl/fused_conv_epilogue.cl:
+    const char * backwardKernelSource =  
+    "// Copyright Hugh Perkins 2016 hughperkins at gmail\n"
+    "//\n"
+    "// This Source Code Form is subject to the terms of the Mozilla Public License,\n"
+    "// v. 2.0. If a copy of the MPL was not distributed with this file, You can\n"
+    "// obtain one at http://mozilla.org/MPL/2.0/.\n"
+    "\n"
+    "// bias, activation, and optionally max-pooling, applied to the output of a\n"
+    "// convolution in one pass, instead of AddBias, ActivationLayer and PoolingLayer\n"
+    "// each reading and writing the whole output\n"
+    "//\n"
+    "// expected defines:\n"
+    "// one of: [ TANH | RELU | LINEAR | SIGMOID | SCALEDTANH | ELU ]\n"
+    "// BIASED, if the convolutional layer has bias\n"
+    "// gNumFilters\n"
+    "// gConvOutputSize, gConvOutputSizeSquared: size of the convolution output\n"
+    "// if a pooling layer is fused too:\n"
+    "//   gPoolingSize\n"
+    "//   gOutputSize, gOutputSizeSquared: size of the pooled output\n"
+    "\n"
+    "#ifdef TANH\n"
+    "    #define ACTIVATION_FUNCTION(output) (tanh(output))\n"
+    "    #define ACTIVATION_DERIV(output) (1 - output * output)\n"
+    "#elif defined SCALEDTANH\n"
+    "    #define ACTIVATION_FUNCTION(output) (1.7159f * tanh(0.66667f * output))\n"
+    "    #define ACTIVATION_DERIV(output) (0.66667f * (1.7159f - 1 / 1.7159f * output * output) )\n"
+    "#elif defined SIGMOID\n"
+    "    #define ACTIVATION_FUNCTION(output) (1.0f / (1 + exp(-output)))\n"
+    "    #define ACTIVATION_DERIV(output) (output * (1 - output) )\n"
+    "#elif defined RELU\n"
+    "    #define ACTIVATION_FUNCTION(output) (output> 0 ? output : 0)\n"
+    "    #define ACTIVATION_DERIV(output) (output > 0 ? 1 : 0)\n"
+    "#elif defined ELU\n"
+    "    #define ACTIVATION_FUNCTION(output) (output> 0 ? output : exp(output) - 1)\n"
+    "    #define ACTIVATION_DERIV(output) (output > 0 ? 1 : output + 1)\n"
+    "#elif defined LINEAR\n"
+    "    #define ACTIVATION_FUNCTION(output) (output)\n"
+    "    #define ACTIVATION_DERIV(output) (1.0f)\n"
+    "#endif\n"
+    "\n"
+    "#ifdef ACTIVATION_FUNCTION // protect against not defined\n"
+    "#ifdef gPoolingSize\n"
+    "\n"
+    "// one workitem per pooled output, globalid is [n][filter][outputRow][outputCol]\n"
+    "// selectors are as for PoolingLayer, so the pooled output, and selectors, are\n"
+    "// exactly what conv + activation + pooling would produce\n"
+    "kernel void fused_forward(\n"
+    "        const int batchSize,\n"
+    "        global const float *convOutput,\n"
+    "        global const float *bias,\n"
+    "        global int *selectors,\n"
+    "        global float *output) {\n"
+    "    const int globalId = get_global_id(0);\n"
+    "\n"
+    "    const int intraImageOffset = globalId % gOutputSizeSquared;\n"
+    "    const int outputRow = intraImageOffset / gOutputSize;\n"
+    "    const int outputCol = intraImageOffset % gOutputSize;\n"
+    "\n"
+    "    const int image2dIdx = globalId / gOutputSizeSquared;\n"
+    "    const int filter = image2dIdx % gNumFilters;\n"
+    "    const int n = image2dIdx / gNumFilters;\n"
+    "    if (n >= batchSize) {\n"
+    "        return;\n"
+    "    }\n"
+    "#ifdef BIASED\n"
+    "    const float biasValue = bias[filter];\n"
+    "#else\n"
+    "    const float biasValue = 0.0f;\n"
+    "#endif\n"
+    "\n"
+    "    const int inputRow = outputRow * gPoolingSize;\n"
+    "    const int inputCol = outputCol * gPoolingSize;\n"
+    "    global const float *convPlane = convOutput + image2dIdx * gConvOutputSizeSquared;\n"
+    "    int selector = 0;\n"
+    "    float value = convPlane[inputRow * gConvOutputSize + inputCol] + biasValue;\n"
+    "    float maxValue = ACTIVATION_FUNCTION(value);\n"
+    "    for (int dRow = 0; dRow < gPoolingSize; dRow++) {\n"
+    "        for (int dCol = 0; dCol < gPoolingSize; dCol++) {\n"
+    "            bool process = (inputRow + dRow < gConvOutputSize) && (inputCol + dCol < gConvOutputSize);\n"
+    "            if (process) {\n"
+    "                value = convPlane[(inputRow + dRow) * gConvOutputSize + inputCol + dCol] + biasValue;\n"
+    "                float thisValue = ACTIVATION_FUNCTION(value);\n"
+    "                if (thisValue > maxValue) {\n"
+    "                    maxValue = thisValue;\n"
+    "                    selector = dRow * gPoolingSize + dCol;\n"
+    "                }\n"
+    "            }\n"
+    "        }\n"
+    "    }\n"
+    "    output[globalId] = maxValue;\n"
+    "    selectors[globalId] = selector;\n"
+    "}\n"
+    "\n"
+    "// one workitem per convolution output, globalid is [n][filter][convRow][convCol]\n"
+    "// only the element each pool selected gets any gradient\n"
+    "kernel void fused_backward(\n"
+    "        const int batchSize,\n"
+    "        global const float *output,\n"
+    "        global const int *selectors,\n"
+    "        global const float *gradOutput,\n"
+    "        global float *gradConvOutput) {\n"
+    "    const int globalId = get_global_id(0);\n"
+    "\n"
+    "    const int intraImageOffset = globalId % gConvOutputSizeSquared;\n"
+    "    const int convRow = intraImageOffset / gConvOutputSize;\n"
+    "    const int convCol = intraImageOffset % gConvOutputSize;\n"
+    "\n"
+    "    const int image2dIdx = globalId / gConvOutputSizeSquared;\n"
+    "    if (image2dIdx >= batchSize * gNumFilters) {\n"
+    "        return;\n"
+    "    }\n"
+    "\n"
+    "    const int outputRow = convRow / gPoolingSize;\n"
+    "    const int outputCol = convCol / gPoolingSize;\n"
+    "    float gradient = 0.0f;\n"
+    "    if (outputRow < gOutputSize && outputCol < gOutputSize) {\n"
+    "        const int outputIdx = image2dIdx * gOutputSizeSquared + outputRow * gOutputSize + outputCol;\n"
+    "        const int selector = (convRow % gPoolingSize) * gPoolingSize + (convCol % gPoolingSize);\n"
+    "        if (selectors[outputIdx] == selector) {\n"
+    "            float value = output[outputIdx];\n"
+    "            gradient = ACTIVATION_DERIV(value) * gradOutput[outputIdx];\n"
+    "        }\n"
+    "    }\n"
+    "    gradConvOutput[globalId] = gradient;\n"
+    "}\n"
+    "\n"
+    "#else\n"
+    "\n"
+    "// in place, on the convolution output\n"
+    "kernel void fused_forward(\n"
+    "        const int N,\n"
+    "        global float *convOutput,\n"
+    "        global const float *bias) {\n"
+    "    const int globalId = get_global_id(0);\n"
+    "    if (globalId >= N) {\n"
+    "        return;\n"
+    "    }\n"
+    "#ifdef BIASED\n"
+    "    const int filter = (globalId / gConvOutputSizeSquared) % gNumFilters;\n"
+    "    float value = convOutput[globalId] + bias[filter];\n"
+    "#else\n"
+    "    float value = convOutput[globalId];\n"
+    "#endif\n"
+    "    convOutput[globalId] = ACTIVATION_FUNCTION(value);\n"
+    "}\n"
+    "\n"
+    "kernel void fused_backward(\n"
+    "        const int N,\n"
+    "        global const float *output,\n"
+    "        global const float *gradOutput,\n"
+    "        global float *gradConvOutput) {\n"
+    "    const int globalId = get_global_id(0);\n"
+    "    if (globalId >= N) {\n"
+    "        return;\n"
+    "    }\n"
+    "    float value = output[globalId];\n"
+    "    gradConvOutput[globalId] = ACTIVATION_DERIV(value) * gradOutput[globalId];\n"
+    "}\n"
+    "\n"
+    "#endif\n"
+    "#endif\n"
+    "\n"
+    "";
+    backwardKernel = ProgramCache::buildKernelFromString(cl, backwardKernelSource, "fused_backward", options, "cl/fused_conv_epilogue.cl");
+    // [[[end]]]
+}
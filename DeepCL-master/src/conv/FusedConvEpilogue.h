@@ -0,0 +1,54 @@
+// Copyright Hugh Perkins 2016 hughperkins at gmail
+//
+// This Source Code Form is subject to the terms of the Mozilla Public License,
+// v. 2.0. If a copy of the MPL was not distributed with this file, You can
+// obtain one at http://mozilla.org/MPL/2.0/.
+
+#pragma once
+
+#include "conv/LayerDimensions.h"
+
+class EasyCL;
+class CLKernel;
+class CLWrapper;
+class ActivationFunction;
+
+#define VIRTUAL virtual
+#define STATIC static
+
+// bias + activation (+ max-pooling), in one kernel, after a convolution
+// that was run without its bias.  Used by ConvolutionalLayer, once
+// NeuralNet::fuseLayers has fused the following ActivationLayer, and maybe
+// PoolingLayer, into it.
+//
+// poolingSize 0 means no pooling: forward then works in place on the
+// convolution output.  Otherwise forward writes the pooled output and
+// selectors, in the same layout as PoolingLayer.
+//
+// backward takes the gradient wrt the fused block's output, and gives the
+// gradient wrt the convolution+bias output, for Backward and BackpropWeights
+class FusedConvEpilogue {
+public:
+    EasyCL *cl; // NOT delete
+    CLKernel *forwardKernel;
+    CLKernel *backwardKernel;
+    CLWrapper *noBiasWrapper; // placeholder kernel argument, if unbiased
+    float noBias[1];
+
+    LayerDimensions dim;
+    const int poolingSize;
+    const int outputSize;
+
+    // [[[cog
+    // import cog_addheaders
+    // cog_addheaders.add()
+    // ]]]
+    // generated, using cog:
+    VIRTUAL ~FusedConvEpilogue();
+    VIRTUAL void forward(int batchSize, CLWrapper *convOutputWrapper, CLWrapper *biasWrapper, CLWrapper *selectorsWrapper, CLWrapper *outputWrapper);
+    VIRTUAL void backward(int batchSize, CLWrapper *outputWrapper, CLWrapper *selectorsWrapper, CLWrapper *gradOutputWrapper, CLWrapper *gradConvOutputWrapper);
+    FusedConvEpilogue(EasyCL *cl, LayerDimensions dim, ActivationFunction const *fn, int poolingSize, bool poolingPadZeros);
+
+    // [[[end]]]
+};
+
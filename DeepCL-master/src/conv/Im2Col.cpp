@@ -1,12 +1,14 @@
 //#include "clblas/ClBlasInstance.h"
 #include "clblas/ClBlasHelper.h"
 #include "EasyCL.h"
-#include "templates/TemplatedKernel.h"
+#include "templates/LuaTemplater.h"
+#include "util/ProgramCache.h"
 
 #include "Im2Col.h"
 
 #include <iostream>
 #include <stdexcept>
+#include <algorithm>
 using namespace std;
 
 #undef STATIC
@@ -14,6 +16,11 @@ using namespace std;
 #define STATIC
 #define VIRTUAL
 #define PUBLIC
+#define PRIVATE
+
+// batched calls process as many images at once as fit in this many floats of
+// columns, ie 128MB
+static const int maxBatchedColumnsSize = 32 * 1024 * 1024;
 
 PUBLIC Im2Col::Im2Col(EasyCL *cl, LayerDimensions dim) :
         cl(cl),
@@ -21,12 +28,30 @@ PUBLIC Im2Col::Im2Col(EasyCL *cl, LayerDimensions dim) :
 //    ClBlasInstance::initializeIfNecessary();
     this->kernelIm2Col = 0;
     this->kernelCol2Im = 0;
+    this->kernelIm2ColBatched = 0;
+    this->kernelCol2ImBatched = 0;
+    this->kernelToFilterMajor = 0;
+    this->kernelFromFilterMajor = 0;
+    this->columns = 0;
+    this->columnsWrapper = 0;
+    this->columnsSize = 0;
+    this->filterMajor = 0;
+    this->filterMajorWrapper = 0;
+    this->filterMajorSize = 0;
 }
 PUBLIC VIRTUAL Im2Col::~Im2Col() {
     delete kernelIm2Col;
     delete kernelCol2Im;
+    delete kernelIm2ColBatched;
+    delete kernelCol2ImBatched;
+    delete kernelToFilterMajor;
+    delete kernelFromFilterMajor;
+    delete columnsWrapper;
+    delete[] columns;
+    delete filterMajorWrapper;
+    delete[] filterMajor;
 }
-void Im2Col::setupBuilder(TemplatedKernel *builder) {
+void Im2Col::setupBuilder(LuaTemplater *builder) {
     int size = dim.inputSize;
     int padding = dim.padZeros ? dim.halfFilterSize : 0;
     int stride = 1;
@@ -42,28 +67,14 @@ void Im2Col::setupBuilder(TemplatedKernel *builder) {
     builder->set("channels", dim.inputPlanes);
     builder->set("filterSize", dim.filterSize);
     builder->set("size", dim.inputSize);
+    builder->set("numFilters", dim.numFilters);
+    builder->set("biased", dim.biased ? 1 : 0);
 }
 void Im2Col::buildKernelIm2Col() {
-    TemplatedKernel builder(cl);
-    setupBuilder(&builder);
-    this->kernelIm2Col = builder.buildKernel(
-        "im2col",
-        "ForwardIm2Col.cl",
-        getKernelTemplate(),
-        "im2col",
-        false
-    );
+    this->kernelIm2Col = buildKernel("im2col");
 }
 void Im2Col::buildKernelCol2Im() {
-    TemplatedKernel builder(cl);
-    setupBuilder(&builder);
-    this->kernelCol2Im = builder.buildKernel(
-        "col2im",
-        "ForwardIm2Col.cl",
-        getKernelTemplate(),
-        "col2im",
-        false
-    );
+    this->kernelCol2Im = buildKernel("col2im");
 }
 PUBLIC void Im2Col::im2Col(CLWrapper *imagesWrapper, int imagesOffset, CLWrapper *columnsWrapper) {
     if(kernelIm2Col == 0) {
@@ -94,6 +105,95 @@ PUBLIC void Im2Col::col2Im(CLWrapper *columnsWrapper, CLWrapper *imagesWrapper,
 //        cout << "numworkgroups=" << numWorkgroups << " workgorupSize=" << workgroupSize << endl;
     kernelCol2Im->run_1d(numWorkgroups * workgroupSize, workgroupSize);
 }
+// how many images each batched call should take, so the columns fit in
+// maxBatchedColumnsSize.  At least 1: an image whose columns alone are bigger
+// still goes through the batched calls, and its scratch, one image at a time
+PUBLIC int Im2Col::getChunkSize(int batchSize) {
+    int columnsPerImage = dim.inputPlanes * dim.filterSizeSquared * dim.outputSizeSquared;
+    return std::max(1, std::min(batchSize, maxBatchedColumnsSize / columnsPerImage));
+}
+// columns for numImages images, as one [inputPlanes * filterSizeSquared] x
+// [numImages * outputSizeSquared] column-major matrix, for one gemm
+PUBLIC void Im2Col::im2ColBatched(CLWrapper *imagesWrapper, int imagesOffset, int numImages, CLWrapper *columnsWrapper) {
+    if(kernelIm2ColBatched == 0) {
+        kernelIm2ColBatched = buildKernel("im2col_batched");
+    }
+    kernelIm2ColBatched->in(numImages);
+    kernelIm2ColBatched->in(imagesWrapper);
+    kernelIm2ColBatched->in(imagesOffset);
+    kernelIm2ColBatched->out(columnsWrapper);
+    run(kernelIm2ColBatched, numImages * dim.inputPlanes * dim.outputSizeSquared);
+}
+// writes, doesnt add to, the numImages images
+PUBLIC void Im2Col::col2ImBatched(CLWrapper *columnsWrapper, int numImages, CLWrapper *imagesWrapper, int imagesOffset) {
+    if(kernelCol2ImBatched == 0) {
+        kernelCol2ImBatched = buildKernel("col2im_batched");
+    }
+    kernelCol2ImBatched->in(numImages);
+    kernelCol2ImBatched->in(columnsWrapper);
+    kernelCol2ImBatched->out(imagesWrapper);
+    kernelCol2ImBatched->in(imagesOffset);
+    run(kernelCol2ImBatched, numImages * dim.inputPlanes * dim.inputSizeSquared);
+}
+// numImages [numFilters][outputSizeSquared] cubes, from batchOffset, to
+// [numFilters][numImages][outputSizeSquared]
+PUBLIC void Im2Col::toFilterMajor(int numImages, CLWrapper *batchMajorWrapper, int batchOffset, CLWrapper *filterMajorWrapper) {
+    if(kernelToFilterMajor == 0) {
+        kernelToFilterMajor = buildKernel("to_filter_major");
+    }
+    kernelToFilterMajor->in(numImages);
+    kernelToFilterMajor->in(batchMajorWrapper);
+    kernelToFilterMajor->in(batchOffset);
+    kernelToFilterMajor->out(filterMajorWrapper);
+    run(kernelToFilterMajor, numImages * dim.numFilters * dim.outputSizeSquared);
+}
+// the reverse of toFilterMajor, plus the bias, if dim.biased
+PUBLIC void Im2Col::fromFilterMajor(int numImages, CLWrapper *filterMajorWrapper, CLWrapper *biasWrapper, CLWrapper *batchMajorWrapper, int batchOffset) {
+    if(kernelFromFilterMajor == 0) {
+        kernelFromFilterMajor = buildKernel("from_filter_major");
+    }
+    kernelFromFilterMajor->in(numImages);
+    kernelFromFilterMajor->in(filterMajorWrapper);
+    if(dim.biased) {
+        kernelFromFilterMajor->in(biasWrapper);
+    }
+    kernelFromFilterMajor->out(batchMajorWrapper);
+    kernelFromFilterMajor->in(batchOffset);
+    run(kernelFromFilterMajor, numImages * dim.numFilters * dim.outputSizeSquared);
+}
+// scratch for numImages images' columns, kept between calls.  Only valid until
+// the next call
+PUBLIC CLWrapper *Im2Col::getColumnsScratch(int numImages) {
+    growScratch(numImages * dim.inputPlanes * dim.filterSizeSquared * dim.outputSizeSquared,
+        &columns, &columnsWrapper, &columnsSize);
+    return columnsWrapper;
+}
+PUBLIC CLWrapper *Im2Col::getFilterMajorScratch(int numImages) {
+    growScratch(numImages * dim.numFilters * dim.outputSizeSquared,
+        &filterMajor, &filterMajorWrapper, &filterMajorSize);
+    return filterMajorWrapper;
+}
+PRIVATE CLKernel *Im2Col::buildKernel(std::string kernelName) {
+    LuaTemplater builder;
+    setupBuilder(&builder);
+    return ProgramCache::buildKernelFromString(cl, builder.render(getKernelTemplate()), kernelName, "", "ForwardIm2Col.cl");
+}
+PRIVATE void Im2Col::run(CLKernel *kernel, int numWorkItems) {
+    int workgroupSize = cl->getMaxWorkgroupSize();
+    int numWorkgroups = (numWorkItems + workgroupSize - 1) / workgroupSize;
+    kernel->run_1d(numWorkgroups * workgroupSize, workgroupSize);
+}
+PRIVATE void Im2Col::growScratch(int size, float **array, CLWrapper **wrapper, int *allocatedSize) {
+    if(size <= *allocatedSize) {
+        return;
+    }
+    delete *wrapper;
+    delete[] *array;
+    *array = new float[size];
+    *wrapper = cl->wrap(size, *array);
+    (*wrapper)->createOnDevice();
+    *allocatedSize = size;
+}
 STATIC std::string Im2Col::getKernelTemplate() {
     // [[[cog
     // import stringify
@@ -174,6 +274,105 @@ STATIC std::string Im2Col::getKernelTemplate() {
     "  }\n"
     "}\n"
     "\n"
+    "\n"
+    "// batched variants: numImages images at once, into one wide column matrix,\n"
+    "// so that one gemm covers them all.  Column row r, for image b, output\n"
+    "// position p, is at data_col[r * numImages * colArea + b * colArea + p], ie\n"
+    "// column-major, with numImages * colArea rows, one per image and position\n"
+    "kernel void im2col_batched(\n"
+    "    const int numImages,\n"
+    "    global float const * im_data, int im_offset,\n"
+    "    global float* data_col) {\n"
+    "  const int colArea = {{colSize}} * {{colSize}};\n"
+    "  const int rowStride = numImages * colArea;\n"
+    "  const int n = numImages * {{channels}} * colArea;\n"
+    "  CL_KERNEL_LOOP(index, n) {\n"
+    "    int w_out = index % {{colSize}};\n"
+    "    int h_out = (index / {{colSize}}) % {{colSize}};\n"
+    "    int channel_in = (index / colArea) % {{channels}};\n"
+    "    int b = index / (colArea * {{channels}});\n"
+    "    int h_in = h_out * {{stride}} - {{padding}};\n"
+    "    int w_in = w_out * {{stride}} - {{padding}};\n"
+    "    global const float *data_im = im_data + im_offset + ((b * {{channels}} + channel_in) * {{size}} + h_in) * {{size}} + w_in;\n"
+    "    global float *col = data_col + channel_in * {{filterSize}} * {{filterSize}} * rowStride\n"
+    "      + b * colArea + h_out * {{colSize}} + w_out;\n"
+    "    for (int i = 0; i < {{filterSize}}; ++i) {\n"
+    "      for (int j = 0; j < {{filterSize}}; ++j) {\n"
+    "        int h = h_in + i;\n"
+    "        int w = w_in + j;\n"
+    "        *col = (h >= 0 && w >= 0 && h < {{size}} && w < {{size}}) ?\n"
+    "          data_im[i * {{size}} + j] : 0;\n"
+    "        col += rowStride;\n"
+    "      }\n"
+    "    }\n"
+    "  }\n"
+    "}\n"
+    "\n"
+    "kernel void col2im_batched(\n"
+    "    const int numImages,\n"
+    "    global float const *data_col,\n"
+    "    global float* im_data, int im_offset) {\n"
+    "  const int colArea = {{colSize}} * {{colSize}};\n"
+    "  const int rowStride = numImages * colArea;\n"
+    "  const int n = numImages * {{channels}} * {{size}} * {{size}};\n"
+    "  CL_KERNEL_LOOP(index, n) {\n"
+    "    float val = 0;\n"
+    "    int w = index % {{size}} + {{padding}};\n"
+    "    int h = (index / {{size}}) % {{size}} + {{padding}};\n"
+    "    int c = (index / ({{size}} * {{size}})) % {{channels}};\n"
+    "    int b = index / ({{size}} * {{size}} * {{channels}});\n"
+    "    int w_col_start = (w < {{filterSize}}) ? 0 : (w - {{filterSize}}) / {{stride}} + 1;\n"
+    "    int w_col_end = min(w / {{stride}} + 1, {{colSize}});\n"
+    "    int h_col_start = (h < {{filterSize}}) ? 0 : (h - {{filterSize}}) / {{stride}} + 1;\n"
+    "    int h_col_end = min(h / {{stride}} + 1, {{colSize}});\n"
+    "    for (int h_col = h_col_start; h_col < h_col_end; ++h_col) {\n"
+    "      for (int w_col = w_col_start; w_col < w_col_end; ++w_col) {\n"
+    "        int row = (c * {{filterSize}} + h - h_col * {{stride}}) * {{filterSize}} + w - w_col * {{stride}};\n"
+    "        val += data_col[row * rowStride + b * colArea + h_col * {{colSize}} + w_col];\n"
+    "      }\n"
+    "    }\n"
+    "    im_data[im_offset + index] = val;\n"
+    "  }\n"
+    "}\n"
+    "\n"
+    "// [image][filter][position] to [filter][image][position], the layout of a\n"
+    "// batched gemm's output, or of its input on the way back\n"
+    "kernel void to_filter_major(\n"
+    "    const int numImages,\n"
+    "    global float const *batch_major, int batch_offset,\n"
+    "    global float *filter_major) {\n"
+    "  const int colArea = {{colSize}} * {{colSize}};\n"
+    "  const int n = numImages * {{numFilters}} * colArea;\n"
+    "  CL_KERNEL_LOOP(index, n) {\n"
+    "    int p = index % colArea;\n"
+    "    int filter = (index / colArea) % {{numFilters}};\n"
+    "    int b = index / (colArea * {{numFilters}});\n"
+    "    filter_major[(filter * numImages + b) * colArea + p] = batch_major[batch_offset + index];\n"
+    "  }\n"
+    "}\n"
+    "\n"
+    "// the batched forward gemm's epilogue: back to [image][filter][position],\n"
+    "// adding the bias on the way, if the layer is biased\n"
+    "kernel void from_filter_major(\n"
+    "    const int numImages,\n"
+    "    global float const *filter_major,\n"
+    "#if {{biased}}\n"
+    "    global float const *bias,\n"
+    "#endif\n"
+    "    global float *batch_major, int batch_offset) {\n"
+    "  const int colArea = {{colSize}} * {{colSize}};\n"
+    "  const int n = numImages * {{numFilters}} * colArea;\n"
+    "  CL_KERNEL_LOOP(index, n) {\n"
+    "    int p = index % colArea;\n"
+    "    int filter = (index / colArea) % {{numFilters}};\n"
+    "    int b = index / (colArea * {{numFilters}});\n"
+    "    float value = filter_major[(filter * numImages + b) * colArea + p];\n"
+    "#if {{biased}}\n"
+    "    value += bias[filter];\n"
+    "#endif\n"
+    "    batch_major[batch_offset + index] = value;\n"
+    "  }\n"
+    "}\n"
     "";
     // [[[end]]]
     return kernelSource;
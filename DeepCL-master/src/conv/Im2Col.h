@@ -5,7 +5,7 @@
 class EasyCL;
 class CLWrapper;
 class CLKernel;
-class TemplatedKernel;
+class LuaTemplater;
 
 #include "DeepCLDllExport.h"
 
@@ -18,10 +18,21 @@ class Im2Col {
 
     CLKernel *kernelIm2Col;
     CLKernel *kernelCol2Im;
+    CLKernel *kernelIm2ColBatched;
+    CLKernel *kernelCol2ImBatched;
+    CLKernel *kernelToFilterMajor;
+    CLKernel *kernelFromFilterMajor;
 
     int numKernelsIm2Col;
     int numKernelsCol2Im;
 
+    float *columns;
+    CLWrapper *columnsWrapper;
+    int columnsSize;
+    float *filterMajor;
+    CLWrapper *filterMajorWrapper;
+    int filterMajorSize;
+
     // [[[cog
     // import cog_addheaders
     // cog_addheaders.addv2()
@@ -33,11 +44,21 @@ class Im2Col {
     VIRTUAL ~Im2Col();
     void im2Col(CLWrapper *imagesWrapper, int imagesOffset, CLWrapper *columnsWrapper);
     void col2Im(CLWrapper *columnsWrapper, CLWrapper *imagesWrapper, int imagesOffset);
+    int getChunkSize(int batchSize);
+    void im2ColBatched(CLWrapper *imagesWrapper, int imagesOffset, int numImages, CLWrapper *columnsWrapper);
+    void col2ImBatched(CLWrapper *columnsWrapper, int numImages, CLWrapper *imagesWrapper, int imagesOffset);
+    void toFilterMajor(int numImages, CLWrapper *batchMajorWrapper, int batchOffset, CLWrapper *filterMajorWrapper);
+    void fromFilterMajor(int numImages, CLWrapper *filterMajorWrapper, CLWrapper *biasWrapper, CLWrapper *batchMajorWrapper, int batchOffset);
+    CLWrapper *getColumnsScratch(int numImages);
+    CLWrapper *getFilterMajorScratch(int numImages);
 
     private:
-    void setupBuilder(TemplatedKernel *builder);
+    void setupBuilder(LuaTemplater *builder);
     void buildKernelIm2Col();
     void buildKernelCol2Im();
+    CLKernel *buildKernel(std::string kernelName);
+    void run(CLKernel *kernel, int numWorkItems);
+    void growScratch(int size, float **array, CLWrapper **wrapper, int *allocatedSize);
     STATIC std::string getKernelTemplate();
 
     // [[[end]]]
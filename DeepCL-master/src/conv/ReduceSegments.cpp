@@ -8,6 +8,7 @@
 
 #include "util/StatefulTimer.h"
 #include "conv/ReduceSegments.h"
+#include "util/ProgramCache.h"
 
 using namespace std;
 
@@ -83,7 +84,7 @@ ReduceSegments::ReduceSegments(EasyCL *cl) :
     "\n"
     "\n"
     "";
-    kernel = cl->buildKernelFromString(kernelSource, "reduce_segments", options, "cl/reduce_segments.cl");
+    kernel = ProgramCache::buildKernelFromString(cl, kernelSource, "reduce_segments", options, "cl/reduce_segments.cl");
     // [[[end]]]
 
     cl->storeKernel(kernelName, kernel, true);
@@ -0,0 +1,182 @@
+// Copyright Hugh Perkins 2016 hughperkins at gmail
+//
+// This Source Code Form is subject to the terms of the Mozilla Public License,
+// v. 2.0. If a copy of the MPL was not distributed with this file, You can
+// obtain one at http://mozilla.org/MPL/2.0/.
+
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <stdexcept>
+
+#include "EasyCL.h"
+#include "conv/TuningDatabase.h"
+#include "util/FileHelper.h"
+#include "util/stringhelper.h"
+
+using namespace std;
+
+#undef STATIC
+#define STATIC
+#undef VIRTUAL
+#define VIRTUAL
+
+PUBLIC TuningDatabase::TuningDatabase() :
+        filepath(""),
+        loaded(false),
+        retune(false),
+        numTimedRuns(5) {
+}
+PUBLIC STATIC TuningDatabase *TuningDatabase::instance() {
+    static TuningDatabase *thisinstance = new TuningDatabase();
+    return thisinstance;
+}
+PUBLIC void TuningDatabase::setFilepath(std::string filepath) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if(filepath != this->filepath) {
+        this->filepath = filepath;
+        entries.clear();
+        loaded = false;
+    }
+}
+PUBLIC std::string TuningDatabase::getFilepath() {
+    return filepath;
+}
+PUBLIC void TuningDatabase::setRetune(bool retune) {
+    this->retune = retune;
+}
+PUBLIC void TuningDatabase::setNumTimedRuns(int numTimedRuns) {
+    this->numTimedRuns = std::max(1, numTimedRuns);
+}
+PUBLIC int TuningDatabase::getNumTimedRuns() {
+    return numTimedRuns;
+}
+PUBLIC bool TuningDatabase::enabled() {
+    return filepath != "";
+}
+// returns the recorded implementation index, or -1 if nothing recorded
+PUBLIC int TuningDatabase::lookup(std::string key) {
+    if(!enabled() || retune) {
+        return -1;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    _loadIfNecessary();
+    map< string, TuningEntry >::iterator it = entries.find(key);
+    if(it == entries.end()) {
+        return -1;
+    }
+    return it->second.chosenIndex;
+}
+// records the choice, and rewrites the file straight away, so that a crash
+// later in training doesnt lose it
+PUBLIC void TuningDatabase::record(std::string key, int chosenIndex, float medianMilliseconds) {
+    if(!enabled()) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    _loadIfNecessary();
+    entries[key] = TuningEntry(chosenIndex, medianMilliseconds);
+    _save();
+}
+PUBLIC int TuningDatabase::size() {
+    std::lock_guard<std::mutex> lock(mutex);
+    _loadIfNecessary();
+    return (int)entries.size();
+}
+PUBLIC void TuningDatabase::load() {
+    std::lock_guard<std::mutex> lock(mutex);
+    loaded = false;
+    _loadIfNecessary();
+}
+PUBLIC void TuningDatabase::save() {
+    std::lock_guard<std::mutex> lock(mutex);
+    _save();
+}
+PRIVATE void TuningDatabase::_loadIfNecessary() {
+    if(loaded || !enabled()) {
+        return;
+    }
+    loaded = true;
+    entries.clear();
+    if(!FileHelper::exists(filepath)) {
+        return;
+    }
+    ifstream f(FileHelper::localizePath(filepath).c_str());
+    string line;
+    while(getline(f, line)) {
+        if(line == "" || line[0] == '#') {
+            continue;
+        }
+        vector<string> splitLine = split(line, "\t");
+        if(splitLine.size() != 7) {
+            cout << "TuningDatabase: ignoring malformed line in " << filepath << ": " << line << endl;
+            continue;
+        }
+        string key = splitLine[0];
+        for(int i = 1; i < 5; i++) {
+            key += "\t" + splitLine[i];
+        }
+        entries[key] = TuningEntry(atoi(splitLine[5]), atof(splitLine[6]));
+    }
+    cout << "TuningDatabase: loaded " << entries.size() << " entries from " << filepath << endl;
+}
+// write to a temporary file first, then rename, so a concurrent reader never
+// sees a half-written file
+PRIVATE void TuningDatabase::_save() {
+    if(!enabled()) {
+        return;
+    }
+    string tempPath = filepath + "~";
+    {
+        ofstream f(FileHelper::localizePath(tempPath).c_str());
+        if(!f.is_open()) {
+            throw runtime_error("TuningDatabase: cannot open " + tempPath + " for writing");
+        }
+        f << "# device\tdriver\tdirection\tbatchsize\tdims\tchosenindex\tmedianms" << endl;
+        for(map< string, TuningEntry >::iterator it = entries.begin(); it != entries.end(); it++) {
+            f << it->first << "\t" << it->second.chosenIndex << "\t" << it->second.medianMilliseconds << endl;
+        }
+    }
+    if(FileHelper::exists(filepath)) {
+        FileHelper::remove(filepath);
+    }
+    FileHelper::rename(tempPath, filepath);
+}
+PUBLIC STATIC std::string TuningDatabase::makeKey(EasyCL *cl, std::string direction, int batchSize, LayerDimensions dim) {
+    string key = getDeviceString(cl, CL_DEVICE_NAME);
+    key += "\t" + getDeviceString(cl, CL_DRIVER_VERSION);
+    key += "\t" + direction;
+    key += "\t" + toString(batchSize);
+    key += "\t" + dimensionsKey(dim);
+    return key;
+}
+PUBLIC STATIC std::string TuningDatabase::dimensionsKey(LayerDimensions dim) {
+    return "i" + toString(dim.inputPlanes) + "x" + toString(dim.inputSize)
+        + "f" + toString(dim.numFilters) + "x" + toString(dim.filterSize)
+        + "p" + toString(dim.padZeros ? 1 : 0)
+        + "b" + toString(dim.biased ? 1 : 0)
+        + "s" + toString(dim.skip);
+}
+PUBLIC STATIC float TuningDatabase::median(std::vector<float> values) {
+    if(values.size() == 0) {
+        return 0;
+    }
+    std::sort(values.begin(), values.end());
+    int n = (int)values.size();
+    if(n % 2 == 1) {
+        return values[n / 2];
+    }
+    return (values[n / 2 - 1] + values[n / 2]) / 2.0f;
+}
+PRIVATE STATIC std::string TuningDatabase::getDeviceString(EasyCL *cl, int info) {
+    char buffer[1024];
+    size_t size = 0;
+    cl_int err = clGetDeviceInfo(cl->device, (cl_device_info)info, sizeof(buffer) - 1, buffer, &size);
+    if(err != CL_SUCCESS) {
+        return "unknown";
+    }
+    buffer[std::min(size, sizeof(buffer) - 1)] = 0;
+    // tabs are our field separator
+    return replaceGlobal(trim(string(buffer)), "\t", " ");
+}
+
@@ -0,0 +1,95 @@
+// Copyright Hugh Perkins 2016 hughperkins at gmail
+//
+// This Source Code Form is subject to the terms of the Mozilla Public License,
+// v. 2.0. If a copy of the MPL was not distributed with this file, You can
+// obtain one at http://mozilla.org/MPL/2.0/.
+
+#pragma once
+
+#include <string>
+#include <map>
+#include <vector>
+#include <mutex>
+
+#include "conv/LayerDimensions.h"
+#include "DeepCLDllExport.h"
+
+class EasyCL;
+
+#define VIRTUAL virtual
+#define STATIC static
+
+// one entry in the tuning database: which implementation index the Auto class
+// chose, and the median of its warm timed runs, in milliseconds
+class DeepCL_EXPORT TuningEntry {
+public:
+    int chosenIndex;
+    float medianMilliseconds;
+    TuningEntry() :
+        chosenIndex(-1),
+        medianMilliseconds(0) {
+    }
+    TuningEntry(int chosenIndex, float medianMilliseconds) :
+        chosenIndex(chosenIndex),
+        medianMilliseconds(medianMilliseconds) {
+    }
+};
+
+// Persistent record of which Forward/Backward/BackpropWeights implementation
+// ForwardAuto, BackwardAuto and BackpropWeightsAuto picked, keyed by device name,
+// driver version, direction, batch size and LayerDimensions.
+//
+// The Auto classes consult this before running any trial kernels, and record
+// their choice once they have made one.  Nothing is read or written until a
+// filepath has been set, eg via `tuningfile=` in deepcl_train, or by running
+// deepcl_tune.
+//
+// file format is one line per entry, tab-separated:
+//   device  driver  direction  batchSize  dims  chosenIndex  medianMilliseconds
+class DeepCL_EXPORT TuningDatabase {
+private:
+    #ifdef _WIN32
+    #pragma warning(disable: 4251)
+    #endif
+    std::map< std::string, TuningEntry > entries;
+    std::mutex mutex;
+    #ifdef _WIN32
+    #pragma warning(default: 4251)
+    #endif
+    std::string filepath;
+    bool loaded;
+    bool retune; // if true, ignore existing entries, but still record new ones
+    int numTimedRuns;
+
+    // [[[cog
+    // import cog_addheaders
+    // cog_addheaders.addv2()
+    // ]]]
+    // generated, using cog:
+
+    public:
+    TuningDatabase();
+    STATIC TuningDatabase *instance();
+    void setFilepath(std::string filepath);
+    std::string getFilepath();
+    void setRetune(bool retune);
+    void setNumTimedRuns(int numTimedRuns);
+    int getNumTimedRuns();
+    bool enabled();
+    int lookup(std::string key);
+    void record(std::string key, int chosenIndex, float medianMilliseconds);
+    int size();
+    void load();
+    void save();
+    STATIC std::string makeKey(EasyCL *cl, std::string direction, int batchSize, LayerDimensions dim);
+    STATIC std::string dimensionsKey(LayerDimensions dim);
+    STATIC float median(std::vector<float> values);
+
+    private:
+    void _loadIfNecessary();
+    void _save();
+    STATIC std::string getDeviceString(EasyCL *cl, int info);
+
+    // [[[end]]]
+};
+
@@ -0,0 +1,386 @@
+// Copyright Hugh Perkins 2016 hughperkins at gmail
+//
+// This Source Code Form is subject to the terms of the Mozilla Public License,
+// v. 2.0. If a copy of the MPL was not distributed with this file, You can
+// obtain one at http://mozilla.org/MPL/2.0/.
+
+#include <iostream>
+#include <stdexcept>
+#include <algorithm>
+
+#include "clblas/ClBlasHelper.h"
+#include "EasyCL.h"
+#include "util/stringhelper.h"
+#include "util/StatefulTimer.h"
+#include "conv/Winograd.h"
+#include "util/ProgramCache.h"
+
+using namespace std;
+
+#undef STATIC
+#define STATIC
+#undef VIRTUAL
+#define VIRTUAL
+#define PUBLIC
+#define PRIVATE
+
+// transformed input per chunk, in floats, ie 128MB
+static const int maxTransformedInputSize = 32 * 1024 * 1024;
+
+PUBLIC Winograd::Winograd(EasyCL *cl, int outputTile, int inputPlanes, int inputSize, int outputPlanes, int outputSize, int padding, bool flipFilters, bool biased) :
+        cl(cl),
+        outputTile(outputTile),
+        tile(outputTile + 2),
+        inputPlanes(inputPlanes),
+        inputSize(inputSize),
+        outputPlanes(outputPlanes),
+        outputSize(outputSize),
+        padding(padding),
+        tilesPerSide((outputSize + outputTile - 1) / outputTile),
+        biased(biased),
+        kernelFilterTransform(0),
+        kernelInputTransform(0),
+        kernelOutputTransform(0),
+        transformedInput(0),
+        transformedInputWrapper(0),
+        transformedInputSize(0),
+        gemmOutput(0),
+        gemmOutputWrapper(0),
+        gemmOutputSize(0) {
+    if(outputTile != 2 && outputTile != 4) {
+        throw runtime_error("Winograd: output tile must be 2 or 4, not " + toString(outputTile));
+    }
+    string options = "";
+    options += " -D gOutputTile=" + toString(outputTile);
+    options += " -D gTile=" + toString(tile);
+    options += " -D gTiles=" + toString(tilesPerSide);
+    options += " -D gInputPlanes=" + toString(inputPlanes);
+    options += " -D gInputSize=" + toString(inputSize);
+    options += " -D gOutputPlanes=" + toString(outputPlanes);
+    options += " -D gOutputSize=" + toString(outputSize);
+    options += " -D gPadding=" + toString(padding);
+    options += " -D gFlipFilters=" + toString(flipFilters ? 1 : 0);
+    options += " -D gBiased=" + toString(biased ? 1 : 0);
+    kernelFilterTransform = buildKernel("filter_transform", options);
+    kernelInputTransform = buildKernel("input_transform", options);
+    kernelOutputTransform = buildKernel("output_transform", options);
+
+    int transformedFiltersSize = tile * tile * outputPlanes * inputPlanes;
+    transformedFilters = new float[transformedFiltersSize];
+    transformedFiltersWrapper = cl->wrap(transformedFiltersSize, transformedFilters);
+    transformedFiltersWrapper->createOnDevice();
+}
+PUBLIC VIRTUAL Winograd::~Winograd() {
+    delete kernelFilterTransform;
+    delete kernelInputTransform;
+    delete kernelOutputTransform;
+    delete transformedFiltersWrapper;
+    delete[] transformedFilters;
+    delete transformedInputWrapper;
+    delete[] transformedInput;
+    delete gemmOutputWrapper;
+    delete[] gemmOutput;
+}
+// 3x3 filters, stride 1
+PUBLIC STATIC bool Winograd::supports(LayerDimensions dim) {
+    return dim.filterSize == 3 && dim.skip == 0;
+}
+PUBLIC STATIC int Winograd::paddingFor(LayerDimensions dim) {
+    return dim.padZeros ? 1 : 0;
+}
+PUBLIC void Winograd::transformFilters(CLWrapper *filtersWrapper) {
+    kernelFilterTransform->in(filtersWrapper);
+    kernelFilterTransform->out(transformedFiltersWrapper);
+    run(kernelFilterTransform, outputPlanes * inputPlanes);
+    StatefulTimer::timeCheck("Winograd::transformFilters END");
+}
+// uses the filters from the last transformFilters.  biasWrapper is only read
+// if biased
+PUBLIC void Winograd::convolve(int batchSize, CLWrapper *inputWrapper, CLWrapper *biasWrapper, CLWrapper *outputWrapper) {
+    int chunkSize = getChunkSize(batchSize);
+    int tilesPerImage = tilesPerSide * tilesPerSide;
+    growScratch(tile * tile * inputPlanes * chunkSize * tilesPerImage,
+        &transformedInput, &transformedInputWrapper, &transformedInputSize);
+    growScratch(tile * tile * outputPlanes * chunkSize * tilesPerImage,
+        &gemmOutput, &gemmOutputWrapper, &gemmOutputSize);
+    if(!outputWrapper->isOnDevice()) {
+        outputWrapper->createOnDevice();
+    }
+    for(int b = 0; b < batchSize; b += chunkSize) {
+        int thisChunkSize = std::min(chunkSize, batchSize - b);
+        int P = thisChunkSize * tilesPerImage;
+
+        kernelInputTransform->in(thisChunkSize);
+        kernelInputTransform->in(inputWrapper);
+        kernelInputTransform->in(b * inputPlanes * inputSize * inputSize);
+        kernelInputTransform->out(transformedInputWrapper);
+        run(kernelInputTransform, inputPlanes * P);
+
+        for(int e = 0; e < tile * tile; e++) {
+            ClBlasHelper::Gemm(
+                cl, clblasRowMajor, clblasNoTrans, clblasNoTrans,
+                outputPlanes, inputPlanes, P,
+                1,
+                transformedFiltersWrapper, e * outputPlanes * inputPlanes,
+                transformedInputWrapper, e * inputPlanes * P,
+                0,
+                gemmOutputWrapper, e * outputPlanes * P
+            );
+        }
+
+        kernelOutputTransform->in(thisChunkSize);
+        kernelOutputTransform->in(gemmOutputWrapper);
+        if(biased) {
+            kernelOutputTransform->in(biasWrapper);
+        }
+        kernelOutputTransform->out(outputWrapper);
+        kernelOutputTransform->in(b * outputPlanes * outputSize * outputSize);
+        run(kernelOutputTransform, outputPlanes * P);
+    }
+    StatefulTimer::timeCheck("Winograd::convolve END");
+}
+PRIVATE int Winograd::getChunkSize(int batchSize) {
+    int perImage = tile * tile * std::max(inputPlanes, outputPlanes) * tilesPerSide * tilesPerSide;
+    return std::max(1, std::min(batchSize, maxTransformedInputSize / perImage));
+}
+PRIVATE CLKernel *Winograd::buildKernel(std::string kernelName, std::string options) {
+    return ProgramCache::buildKernelFromString(cl, getKernelSource(), kernelName, options, "cl/winograd.cl");
+}
+PRIVATE void Winograd::run(CLKernel *kernel, int numWorkItems) {
+    int workgroupSize = 64;
+    int numWorkgroups = (numWorkItems + workgroupSize - 1) / workgroupSize;
+    kernel->run_1d(numWorkgroups * workgroupSize, workgroupSize);
+}
+PRIVATE void Winograd::growScratch(int size, float **array, CLWrapper **wrapper, int *allocatedSize) {
+    if(size <= *allocatedSize) {
+        return;
+    }
+    delete *wrapper;
+    delete[] *array;
+    *array = new float[size];
+    *wrapper = cl->wrap(size, *array);
+    (*wrapper)->createOnDevice();
+    *allocatedSize = size;
+}
+PRIVATE STATIC std::string Winograd::getKernelSource() {
+    // [[[cog
+    // import stringify
+    // stringify.write_kernel("kernel", "cl/winograd.cl")
+    // ]]]
+    // generated using cog, from cl/winograd.cl:
+    const char * kernelSource =  
+    "// Copyright Hugh Perkins 2016 hughperkins at gmail\n"
+    "//\n"
+    "// This Source Code Form is subject to the terms of the Mozilla Public License,\n"
+    "// v. 2.0. If a copy of the MPL was not distributed with this file, You can\n"
+    "// obtain one at http://mozilla.org/MPL/2.0/.\n"
+    "\n"
+    "// Winograd F(mxm, 3x3) convolution, stride 1, as in Lavin and Gray, \"Fast\n"
+    "// Algorithms for Convolutional Neural Networks\", 2015.  m is gOutputTile, 2 or\n"
+    "// 4, and each (gTile = m + 2) square input tile gives an m x m output tile:\n"
+    "//\n"
+    "//     Y = A^T [ (G g G^T) .* (B^T d B) ] A\n"
+    "//\n"
+    "// The sum over input planes of the element-wise products is done as gTile^2\n"
+    "// independent gemms, by the host, between these kernels.\n"
+    "//\n"
+    "// Layouts, with e = xi * gTile + nu the position within the transformed tile,\n"
+    "// and P = numImages * gTiles * gTiles:\n"
+    "//   U (transformed filters) [e][outputPlane][inputPlane]\n"
+    "//   V (transformed input)   [e][inputPlane][P]\n"
+    "//   M (gemm output)         [e][outputPlane][P]\n"
+    "//\n"
+    "// expects defines:\n"
+    "//   gOutputTile, gTile, gTiles: output tile size, input tile size, tiles per side\n"
+    "//   gInputPlanes, gInputSize, gOutputPlanes, gOutputSize, gPadding\n"
+    "//   gFlipFilters: 1 to use the filters rotated by 180 degrees, with input and\n"
+    "//       output planes swapped, ie for the gradInput of a forward convolution\n"
+    "//   gBiased\n"
+    "\n"
+    "#if gOutputTile == 2\n"
+    "constant float BT[gTile * gTile] = {\n"
+    "    1, 0, -1, 0,\n"
+    "    0, 1, 1, 0,\n"
+    "    0, -1, 1, 0,\n"
+    "    0, 1, 0, -1\n"
+    "};\n"
+    "constant float G[gTile * 3] = {\n"
+    "    1, 0, 0,\n"
+    "    0.5f, 0.5f, 0.5f,\n"
+    "    0.5f, -0.5f, 0.5f,\n"
+    "    0, 0, 1\n"
+    "};\n"
+    "constant float AT[gOutputTile * gTile] = {\n"
+    "    1, 1, 1, 0,\n"
+    "    0, 1, -1, -1\n"
+    "};\n"
+    "#elif gOutputTile == 4\n"
+    "constant float BT[gTile * gTile] = {\n"
+    "    4, 0, -5, 0, 1, 0,\n"
+    "    0, -4, -4, 1, 1, 0,\n"
+    "    0, 4, -4, -1, 1, 0,\n"
+    "    0, -2, -1, 2, 1, 0,\n"
+    "    0, 2, -1, -2, 1, 0,\n"
+    "    0, 4, 0, -5, 0, 1\n"
+    "};\n"
+    "constant float G[gTile * 3] = {\n"
+    "    1.0f / 4, 0, 0,\n"
+    "    -1.0f / 6, -1.0f / 6, -1.0f / 6,\n"
+    "    -1.0f / 6, 1.0f / 6, -1.0f / 6,\n"
+    "    1.0f / 24, 1.0f / 12, 1.0f / 6,\n"
+    "    1.0f / 24, -1.0f / 12, 1.0f / 6,\n"
+    "    0, 0, 1\n"
+    "};\n"
+    "constant float AT[gOutputTile * gTile] = {\n"
+    "    1, 1, 1, 1, 1, 0,\n"
+    "    0, 1, -1, 2, -2, 0,\n"
+    "    0, 1, 1, 4, 4, 0,\n"
+    "    0, 1, -1, 8, -8, 1\n"
+    "};\n"
+    "#endif\n"
+    "\n"
+    "// one work item per (outputPlane, inputPlane) filter\n"
+    "kernel void filter_transform(\n"
+    "        global const float *filters,\n"
+    "        global float *U) {\n"
+    "    const int globalId = get_global_id(0);\n"
+    "    if(globalId >= gOutputPlanes * gInputPlanes) {\n"
+    "        return;\n"
+    "    }\n"
+    "    const int outPlane = globalId / gInputPlanes;\n"
+    "    const int inPlane = globalId % gInputPlanes;\n"
+    "    float g[9];\n"
+    "    for(int i = 0; i < 9; i++) {\n"
+    "        #if gFlipFilters\n"
+    "        g[i] = filters[(inPlane * gOutputPlanes + outPlane) * 9 + 8 - i];\n"
+    "        #else\n"
+    "        g[i] = filters[(outPlane * gInputPlanes + inPlane) * 9 + i];\n"
+    "        #endif\n"
+    "    }\n"
+    "    float Gg[gTile * 3];\n"
+    "    for(int row = 0; row < gTile; row++) {\n"
+    "        for(int col = 0; col < 3; col++) {\n"
+    "            float sum = 0;\n"
+    "            for(int k = 0; k < 3; k++) {\n"
+    "                sum += G[row * 3 + k] * g[k * 3 + col];\n"
+    "            }\n"
+    "            Gg[row * 3 + col] = sum;\n"
+    "        }\n"
+    "    }\n"
+    "    for(int xi = 0; xi < gTile; xi++) {\n"
+    "        for(int nu = 0; nu < gTile; nu++) {\n"
+    "            float sum = 0;\n"
+    "            for(int k = 0; k < 3; k++) {\n"
+    "                sum += Gg[xi * 3 + k] * G[nu * 3 + k];\n"
+    "            }\n"
+    "            U[((xi * gTile + nu) * gOutputPlanes + outPlane) * gInputPlanes + inPlane] = sum;\n"
+    "        }\n"
+    "    }\n"
+    "}\n"
+    "\n"
+    "// one work item per (image, inputPlane, tile)\n"
+    "kernel void input_transform(\n"
+    "        const int numImages,\n"
+    "        global const float *input, const int inputOffset,\n"
+    "        global float *V) {\n"
+    "    const int globalId = get_global_id(0);\n"
+    "    const int P = numImages * gTiles * gTiles;\n"
+    "    if(globalId >= gInputPlanes * P) {\n"
+    "        return;\n"
+    "    }\n"
+    "    const int tileCol = globalId % gTiles;\n"
+    "    const int tileRow = (globalId / gTiles) % gTiles;\n"
+    "    const int inPlane = (globalId / (gTiles * gTiles)) % gInputPlanes;\n"
+    "    const int n = globalId / (gTiles * gTiles * gInputPlanes);\n"
+    "    const int tileIndex = (n * gTiles + tileRow) * gTiles + tileCol;\n"
+    "    global const float *plane = input + inputOffset + (n * gInputPlanes + inPlane) * gInputSize * gInputSize;\n"
+    "    const int rowStart = tileRow * gOutputTile - gPadding;\n"
+    "    const int colStart = tileCol * gOutputTile - gPadding;\n"
+    "    float d[gTile * gTile];\n"
+    "    for(int row = 0; row < gTile; row++) {\n"
+    "        for(int col = 0; col < gTile; col++) {\n"
+    "            const int inRow = rowStart + row;\n"
+    "            const int inCol = colStart + col;\n"
+    "            d[row * gTile + col] = (inRow >= 0 && inRow < gInputSize && inCol >= 0 && inCol < gInputSize) ?\n"
+    "                plane[inRow * gInputSize + inCol] : 0.0f;\n"
+    "        }\n"
+    "    }\n"
+    "    float BTd[gTile * gTile];\n"
+    "    for(int row = 0; row < gTile; row++) {\n"
+    "        for(int col = 0; col < gTile; col++) {\n"
+    "            float sum = 0;\n"
+    "            for(int k = 0; k < gTile; k++) {\n"
+    "                sum += BT[row * gTile + k] * d[k * gTile + col];\n"
+    "            }\n"
+    "            BTd[row * gTile + col] = sum;\n"
+    "        }\n"
+    "    }\n"
+    "    for(int xi = 0; xi < gTile; xi++) {\n"
+    "        for(int nu = 0; nu < gTile; nu++) {\n"
+    "            float sum = 0;\n"
+    "            for(int k = 0; k < gTile; k++) {\n"
+    "                sum += BTd[xi * gTile + k] * BT[nu * gTile + k];\n"
+    "            }\n"
+    "            V[((xi * gTile + nu) * gInputPlanes + inPlane) * P + tileIndex] = sum;\n"
+    "        }\n"
+    "    }\n"
+    "}\n"
+    "\n"
+    "// one work item per (image, outputPlane, tile).  Writes, rather than adds to,\n"
+    "// output, clipping the tiles at the right and bottom edges\n"
+    "kernel void output_transform(\n"
+    "        const int numImages,\n"
+    "        global const float *M,\n"
+    "        #if gBiased\n"
+    "        global const float *bias,\n"
+    "        #endif\n"
+    "        global float *output, const int outputOffset) {\n"
+    "    const int globalId = get_global_id(0);\n"
+    "    const int P = numImages * gTiles * gTiles;\n"
+    "    if(globalId >= gOutputPlanes * P) {\n"
+    "        return;\n"
+    "    }\n"
+    "    const int tileCol = globalId % gTiles;\n"
+    "    const int tileRow = (globalId / gTiles) % gTiles;\n"
+    "    const int outPlane = (globalId / (gTiles * gTiles)) % gOutputPlanes;\n"
+    "    const int n = globalId / (gTiles * gTiles * gOutputPlanes);\n"
+    "    const int tileIndex = (n * gTiles + tileRow) * gTiles + tileCol;\n"
+    "    float m[gTile * gTile];\n"
+    "    for(int e = 0; e < gTile * gTile; e++) {\n"
+    "        m[e] = M[(e * gOutputPlanes + outPlane) * P + tileIndex];\n"
+    "    }\n"
+    "    float ATm[gOutputTile * gTile];\n"
+    "    for(int row = 0; row < gOutputTile; row++) {\n"
+    "        for(int col = 0; col < gTile; col++) {\n"
+    "            float sum = 0;\n"
+    "            for(int k = 0; k < gTile; k++) {\n"
+    "                sum += AT[row * gTile + k] * m[k * gTile + col];\n"
+    "            }\n"
+    "            ATm[row * gTile + col] = sum;\n"
+    "        }\n"
+    "    }\n"
+    "    #if gBiased\n"
+    "    const float planeBias = bias[outPlane];\n"
+    "    #else\n"
+    "    const float planeBias = 0.0f;\n"
+    "    #endif\n"
+    "    global float *plane = output + outputOffset + (n * gOutputPlanes + outPlane) * gOutputSize * gOutputSize;\n"
+    "    for(int row = 0; row < gOutputTile; row++) {\n"
+    "        const int outRow = tileRow * gOutputTile + row;\n"
+    "        for(int col = 0; col < gOutputTile; col++) {\n"
+    "            const int outCol = tileCol * gOutputTile + col;\n"
+    "            if(outRow < gOutputSize && outCol < gOutputSize) {\n"
+    "                float sum = planeBias;\n"
+    "                for(int k = 0; k < gTile; k++) {\n"
+    "                    sum += ATm[row * gTile + k] * AT[col * gTile + k];\n"
+    "                }\n"
+    "                plane[outRow * gOutputSize + outCol] = sum;\n"
+    "            }\n"
+    "        }\n"
+    "    }\n"
+    "}\n"
+    "\n"
+    "";
+    // [[[end]]]
+    return kernelSource;
+}
@@ -0,0 +1,83 @@
+// Copyright Hugh Perkins 2016 hughperkins at gmail
+//
+// This Source Code Form is subject to the terms of the Mozilla Public License,
+// v. 2.0. If a copy of the MPL was not distributed with this file, You can
+// obtain one at http://mozilla.org/MPL/2.0/.
+
+#pragma once
+
+#include <string>
+
+#include "LayerDimensions.h"
+
+class EasyCL;
+class CLWrapper;
+class CLKernel;
+
+#include "DeepCLDllExport.h"
+
+#define STATIC static
+#define VIRTUAL virtual
+
+// Winograd F(mxm, 3x3) convolution engine, for stride 1 3x3 filters, shared by
+// ForwardWinograd and BackwardWinograd.  See cl/winograd.cl.
+//
+// One instance convolves inputPlanes x inputSize images to outputPlanes x
+// outputSize, with the given zero padding.  The gradInput of a forward
+// convolution is itself such a convolution, from gradOutput, with the filters
+// rotated and transposed (flipFilters), and padding 2 - the forward padding.
+//
+// transformFilters writes the transformed filters into a buffer owned by this
+// object, which convolve then uses, so callers can reuse one transform for as
+// long as the weights dont change.  Images are processed in chunks, so the
+// transformed input stays under 128MB, with the gemm over input planes done
+// by clBLAS, once per position in the transformed tile.
+class Winograd {
+    EasyCL *cl;
+    int outputTile;
+    int tile;
+    int inputPlanes;
+    int inputSize;
+    int outputPlanes;
+    int outputSize;
+    int padding;
+    int tilesPerSide;
+    bool biased;
+
+    CLKernel *kernelFilterTransform;
+    CLKernel *kernelInputTransform;
+    CLKernel *kernelOutputTransform;
+
+    float *transformedFilters;
+    CLWrapper *transformedFiltersWrapper;
+    float *transformedInput;
+    CLWrapper *transformedInputWrapper;
+    int transformedInputSize;
+    float *gemmOutput;
+    CLWrapper *gemmOutputWrapper;
+    int gemmOutputSize;
+
+    // [[[cog
+    // import cog_addheaders
+    // cog_addheaders.addv2()
+    // ]]]
+    // generated, using cog:
+
+    public:
+    Winograd(EasyCL *cl, int outputTile, int inputPlanes, int inputSize, int outputPlanes, int outputSize, int padding, bool flipFilters, bool biased);
+    VIRTUAL ~Winograd();
+    STATIC bool supports(LayerDimensions dim);
+    STATIC int paddingFor(LayerDimensions dim);
+    void transformFilters(CLWrapper *filtersWrapper);
+    void convolve(int batchSize, CLWrapper *inputWrapper, CLWrapper *biasWrapper, CLWrapper *outputWrapper);
+
+    private:
+    int getChunkSize(int batchSize);
+    CLKernel *buildKernel(std::string kernelName, std::string options);
+    void run(CLKernel *kernel, int numWorkItems);
+    void growScratch(int size, float **array, CLWrapper **wrapper, int *allocatedSize);
+    STATIC std::string getKernelSource();
+
+    // [[[end]]]
+};
+
@@ -14,6 +14,7 @@
 #include "util/stringhelper.h"
 
 #include "DropoutBackwardGpuNaive.h"
+#include "util/ProgramCache.h"
 
 using namespace std;
 
@@ -114,7 +115,7 @@ DropoutBackwardGpuNaive::DropoutBackwardGpuNaive(EasyCL *cl, int numPlanes, int
     "}\n"
     "\n"
     "";
-    kernel = cl->buildKernelFromString(kernelSource, "backpropNaive", options, "cl/dropout.cl");
+    kernel = ProgramCache::buildKernelFromString(cl, kernelSource, "backpropNaive", options, "cl/dropout.cl");
     // [[[end]]]
 }
 
@@ -26,6 +26,7 @@ DropoutForwardCpu::DropoutForwardCpu(EasyCL *cl, int numPlanes, int inputSize, f
 VIRTUAL void DropoutForwardCpu::forward(int batchSize, CLWrapper *masksWrapper, CLWrapper *inputWrapper, CLWrapper *outputWrapper) {
 //    cout << "DropoutForwardCpu::forward(CLWrapper *)" << endl;
 
+    masksWrapper->copyToHost();
     inputWrapper->copyToHost();
 
     unsigned char *masks = reinterpret_cast<unsigned char *>(masksWrapper->getHostArray());
@@ -13,6 +13,7 @@
 #include "util/stringhelper.h"
 
 #include "DropoutForwardGpuNaive.h"
+#include "util/ProgramCache.h"
 
 //#include "test/PrintBuffer.h"
 
@@ -101,7 +102,7 @@ DropoutForwardGpuNaive::DropoutForwardGpuNaive(EasyCL *cl, int numPlanes, int in
     "}\n"
     "\n"
     "";
-    kernel = cl->buildKernelFromString(kernelSource, "forwardNaive", options, "cl/dropout.cl");
+    kernel = ProgramCache::buildKernelFromString(cl, kernelSource, "forwardNaive", options, "cl/dropout.cl");
     // [[[end]]]
 //    kernel = cl->buildKernel("dropout.cl", "forwardNaive", options);
 }
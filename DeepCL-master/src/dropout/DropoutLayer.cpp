@@ -12,7 +12,7 @@
 #include "dropout/DropoutMaker.h"
 #include "dropout/DropoutForward.h"
 #include "dropout/DropoutBackward.h"
-#include "util/RandomSingleton.h"
+#include "clmath/PhiloxRandom.h"
 #include "clmath/MultiplyBuffer.h"
 
 //#include "test/PrintBuffer.h"
@@ -30,7 +30,6 @@ DropoutLayer::DropoutLayer(EasyCL *cl, Layer *previousLayer, DropoutMaker *maker
         inputSize(previousLayer->getOutputSize()),
         dropRatio(maker->_dropRatio),
         outputSize(previousLayer->getOutputSize()),
-        random(RandomSingleton::instance()),
         cl(cl),
         masks(0),
         output(0),
@@ -53,9 +52,11 @@ DropoutLayer::DropoutLayer(EasyCL *cl, Layer *previousLayer, DropoutMaker *maker
     dropoutForwardImpl = DropoutForward::instance(cl, numPlanes, inputSize, dropRatio);
     dropoutBackwardImpl = DropoutBackward::instance(cl, numPlanes, inputSize, dropRatio);
     multiplyBuffer = new MultiplyBuffer(cl);
+    random = new PhiloxRandom(cl);
 }
 VIRTUAL DropoutLayer::~DropoutLayer() {
     delete multiplyBuffer;
+    delete random;
     delete dropoutForwardImpl;
     delete dropoutBackwardImpl;
     if(maskWrapper != 0) {
@@ -80,8 +81,9 @@ VIRTUAL DropoutLayer::~DropoutLayer() {
 VIRTUAL std::string DropoutLayer::getClassName() const {
     return "DropoutLayer";
 }
-VIRTUAL void DropoutLayer::fortesting_setRandomSingleton(RandomSingleton *random) {
-    this->random = random;
+// masks then depend only on seed and the number of forwards since
+VIRTUAL void DropoutLayer::fortesting_seed(unsigned long long seed) {
+    random->seed(seed);
 }
 VIRTUAL void DropoutLayer::setBatchSize(int batchSize) {
 //    cout << "DropoutLayer::setBatchSize" << endl;
@@ -110,8 +112,8 @@ VIRTUAL void DropoutLayer::setBatchSize(int batchSize) {
     this->batchSize = batchSize;
     this->allocatedSize = batchSize;
     masks = new unsigned char[ getOutputNumElements() ];
-    generateMasks();
     maskWrapper = cl->wrap(getOutputNumElements(), masks);
+    maskWrapper->createOnDevice();
     output = new float[ getOutputNumElements() ];
     outputWrapper = cl->wrap(getOutputNumElements(), output);
     outputWrapper->createOnDevice();
@@ -189,11 +191,10 @@ VIRTUAL ActivationFunction const *DropoutLayer::getActivationFunction() {
 //        }
 //    }
 //}
+// on the device, so the masks never need uploading.  masks, on the host, is
+// only filled if someone calls maskWrapper->copyToHost()
 VIRTUAL void DropoutLayer::generateMasks() {
-    int totalInputLinearSize = getOutputNumElements();
-    for(int i = 0; i < totalInputLinearSize; i++) {
-        masks[i] = random->_uniform() <= dropRatio ? 0 : 1;
-    }
+    random->dropoutMasks(getOutputNumElements(), dropRatio, maskWrapper);
 }
 VIRTUAL void DropoutLayer::forward() {
     CLWrapper *upstreamOutputWrapper = 0;
@@ -209,7 +210,6 @@ VIRTUAL void DropoutLayer::forward() {
     if(training) {
         // create new masks...
         generateMasks();
-        maskWrapper->copyToDevice();
         dropoutForwardImpl->forward(batchSize, maskWrapper, upstreamOutputWrapper, outputWrapper);
     } else {
         // if not training, then simply skip the dropout bit, copy the buffers directly
@@ -231,7 +231,6 @@ VIRTUAL void DropoutLayer::backward() {
         gradOutputWrapper->copyToDevice();
         weOwnErrorsWrapper = true;
     }
-    maskWrapper->copyToDevice();
     dropoutBackwardImpl->backward(batchSize, maskWrapper, gradOutputWrapper, gradInputWrapper);
     if(weOwnErrorsWrapper) {
         delete gradOutputWrapper;
@@ -15,7 +15,7 @@ class CLKernel;
 class CLWrapper;
 class DropoutForward;
 class DropoutBackward;
-class RandomSingleton;
+class PhiloxRandom;
 class DropoutMaker;
 class MultiplyBuffer;
 
@@ -27,7 +27,7 @@ public:
 
     const int outputSize;
 
-    RandomSingleton *random;
+    PhiloxRandom *random; // masks are drawn on the device
 
     EasyCL *const cl; // NOT owned by us
     DropoutForward *dropoutForwardImpl;
@@ -56,7 +56,7 @@ public:
     DropoutLayer(EasyCL *cl, Layer *previousLayer, DropoutMaker *maker);
     VIRTUAL ~DropoutLayer();
     VIRTUAL std::string getClassName() const;
-    VIRTUAL void fortesting_setRandomSingleton(RandomSingleton *random);
+    VIRTUAL void fortesting_seed(unsigned long long seed);
     VIRTUAL void setBatchSize(int batchSize);
     VIRTUAL int getOutputNumElements();
     VIRTUAL float *getOutput();
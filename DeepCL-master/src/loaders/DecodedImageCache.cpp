@@ -0,0 +1,182 @@
+// Copyright Hugh Perkins 2016 hughperkins at gmail
+//
+// This Source Code Form is subject to the terms of the Mozilla Public License,
+// v. 2.0. If a copy of the MPL was not distributed with this file, You can
+// obtain one at http://mozilla.org/MPL/2.0/.
+
+#include <iostream>
+#include <cstring>
+#include <cstdio>
+#include <stdexcept>
+
+#include "loaders/DecodedImageCache.h"
+#include "util/FileHelper.h"
+#include "util/stringhelper.h"
+
+using namespace std;
+
+#undef STATIC
+#undef VIRTUAL
+#define STATIC
+#define VIRTUAL
+
+static const int headerSize = 256;
+
+// signature should change whenever the decoded contents would, eg a hash of
+// the manifest's file list, planes and size
+PUBLIC DecodedImageCache::DecodedImageCache(std::string filepath, int N, int imageCubeSize, std::string signature) :
+        filepath(filepath),
+        N(N),
+        imageCubeSize(imageCubeSize),
+        numPresent(0) {
+    string header = "deepcl-decoded-cache-v1 N=" + toString(N) + " cubesize=" + toString(imageCubeSize)
+        + " signature=" + signature + "\n";
+    if((int)header.size() > headerSize) {
+        throw runtime_error("DecodedImageCache: signature too long: " + signature);
+    }
+    if(!openExisting(header)) {
+        create(header);
+    }
+    cout << "DecodedImageCache: " << filepath << " has " << numPresent << " of " << N << " images" << endl;
+}
+PUBLIC DecodedImageCache::~DecodedImageCache() {
+    file.close();
+}
+PUBLIC std::string DecodedImageCache::getFilepath() {
+    return filepath;
+}
+PUBLIC int DecodedImageCache::getNumPresent() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return numPresent;
+}
+// reads whichever of the records are in the cache into data, and sets
+// recordPresent[i] for each one.  returns the number read
+PUBLIC int DecodedImageCache::read(int startRecord, int numRecords, unsigned char *data, std::vector<char> &recordPresent) {
+    std::lock_guard<std::mutex> lock(mutex);
+    recordPresent.assign(numRecords, 0);
+    int numRead = 0;
+    int i = 0;
+    while(i < numRecords) {
+        if(!present[startRecord + i]) {
+            i++;
+            continue;
+        }
+        int runEnd = i;
+        while(runEnd < numRecords && present[startRecord + runEnd]) {
+            recordPresent[runEnd] = 1;
+            runEnd++;
+        }
+        file.seekg(recordOffset(startRecord + i));
+        file.read((char *)(data + (long long)i * imageCubeSize), (long long)(runEnd - i) * imageCubeSize);
+        if(!file) {
+            throw runtime_error("DecodedImageCache: failed reading " + filepath);
+        }
+        numRead += runEnd - i;
+        i = runEnd;
+    }
+    return numRead;
+}
+// writes the records not already marked in recordPresent, then marks them
+// present on disk
+PUBLIC void DecodedImageCache::write(int startRecord, int numRecords, const unsigned char *data, const std::vector<char> &recordPresent) {
+    std::lock_guard<std::mutex> lock(mutex);
+    bool anyWritten = false;
+    int i = 0;
+    while(i < numRecords) {
+        if(recordPresent[i] || present[startRecord + i]) {
+            i++;
+            continue;
+        }
+        int runEnd = i;
+        while(runEnd < numRecords && !recordPresent[runEnd] && !present[startRecord + runEnd]) {
+            runEnd++;
+        }
+        file.seekp(recordOffset(startRecord + i));
+        file.write((const char *)(data + (long long)i * imageCubeSize), (long long)(runEnd - i) * imageCubeSize);
+        for(int j = i; j < runEnd; j++) {
+            present[startRecord + j] = 1;
+        }
+        numPresent += runEnd - i;
+        anyWritten = true;
+        i = runEnd;
+    }
+    if(!anyWritten) {
+        return;
+    }
+    // flags go after the data, so a crash mid-write leaves them unset
+    file.flush();
+    file.seekp(headerSize + startRecord);
+    file.write(&present[startRecord], numRecords);
+    file.flush();
+    if(!file) {
+        throw runtime_error("DecodedImageCache: failed writing " + filepath);
+    }
+}
+// 64-bit FNV-1a, as hex
+PUBLIC STATIC std::string DecodedImageCache::hashString(std::string value) {
+    unsigned long long hash = 14695981039346656037ULL;
+    for(int i = 0; i < (int)value.size(); i++) {
+        hash ^= (unsigned char)value[i];
+        hash *= 1099511628211ULL;
+    }
+    char hex[17];
+    sprintf(hex, "%016llx", hash);
+    return string(hex);
+}
+PRIVATE bool DecodedImageCache::openExisting(std::string header) {
+    if(!FileHelper::exists(filepath)) {
+        return false;
+    }
+    file.open(FileHelper::localizePath(filepath).c_str(), ios::in | ios::out | ios::binary);
+    if(!file.is_open()) {
+        return false;
+    }
+    char headerBytes[headerSize];
+    file.read(headerBytes, headerSize);
+    if(!file || memcmp(headerBytes, header.c_str(), header.size()) != 0) {
+        cout << "DecodedImageCache: " << filepath << " is for a different manifest, recreating" << endl;
+        file.close();
+        return false;
+    }
+    present.resize(N);
+    file.read(&present[0], N);
+    if(!file) {
+        file.close();
+        return false;
+    }
+    numPresent = 0;
+    for(int i = 0; i < N; i++) {
+        if(present[i]) {
+            numPresent++;
+        }
+    }
+    return true;
+}
+PRIVATE void DecodedImageCache::create(std::string header) {
+    {
+        ofstream out(FileHelper::localizePath(filepath).c_str(), ios::out | ios::binary | ios::trunc);
+        if(!out.is_open()) {
+            throw runtime_error("DecodedImageCache: cannot create " + filepath);
+        }
+        vector<char> headerBytes(headerSize, 0);
+        memcpy(&headerBytes[0], header.c_str(), header.size());
+        out.write(&headerBytes[0], headerSize);
+        vector<char> flags(N, 0);
+        out.write(&flags[0], N);
+        // extend to full size, without writing the records themselves
+        out.seekp(recordOffset(N) - 1);
+        out.put(0);
+        if(!out) {
+            throw runtime_error("DecodedImageCache: cannot create " + filepath);
+        }
+    }
+    present.assign(N, 0);
+    numPresent = 0;
+    file.open(FileHelper::localizePath(filepath).c_str(), ios::in | ios::out | ios::binary);
+    if(!file.is_open()) {
+        throw runtime_error("DecodedImageCache: cannot open " + filepath);
+    }
+}
+PRIVATE long long DecodedImageCache::recordOffset(int record) {
+    return (long long)headerSize + N + (long long)record * imageCubeSize;
+}
@@ -0,0 +1,67 @@
+// Copyright Hugh Perkins 2016 hughperkins at gmail
+//
+// This Source Code Form is subject to the terms of the Mozilla Public License,
+// v. 2.0. If a copy of the MPL was not distributed with this file, You can
+// obtain one at http://mozilla.org/MPL/2.0/.
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <mutex>
+
+#include "DeepCLDllExport.h"
+
+#define VIRTUAL virtual
+#define STATIC static
+
+// On-disk cache of decoded images, as fixed-size unsigned char records, so
+// that ManifestLoaderv1 only has to run each jpeg through libjpeg once.
+//
+// One cache file per manifest.  Layout:
+//   header, padded to headerSize bytes: signature, N, imageCubeSize, and a hash
+//       of the manifest's file list, so a changed manifest invalidates the cache
+//   N bytes: 1 if that record has been written, 0 otherwise
+//   N * imageCubeSize bytes: the records, in manifest order
+// Records are filled in as they are first decoded, so the cache is usable
+// after a partial epoch.
+class DeepCL_EXPORT DecodedImageCache {
+private:
+    #ifdef _WIN32
+    #pragma warning(disable: 4251)
+    #endif
+    std::fstream file;
+    std::mutex mutex;
+    std::vector<char> present;
+    #ifdef _WIN32
+    #pragma warning(default: 4251)
+    #endif
+    std::string filepath;
+    int N;
+    int imageCubeSize;
+    int numPresent;
+
+    // [[[cog
+    // import cog_addheaders
+    // cog_addheaders.addv2()
+    // ]]]
+    // generated, using cog:
+
+    public:
+    DecodedImageCache(std::string filepath, int N, int imageCubeSize, std::string signature);
+    ~DecodedImageCache();
+    std::string getFilepath();
+    int getNumPresent();
+    int read(int startRecord, int numRecords, unsigned char *data, std::vector<char> &recordPresent);
+    void write(int startRecord, int numRecords, const unsigned char *data, const std::vector<char> &recordPresent);
+    STATIC std::string hashString(std::string value);
+
+    private:
+    bool openExisting(std::string header);
+    void create(std::string header);
+    long long recordOffset(int record);
+
+    // [[[end]]]
+};
+
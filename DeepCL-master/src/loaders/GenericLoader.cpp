@@ -70,6 +70,12 @@ PUBLIC STATIC void GenericLoader::load(const char * trainFilepath, unsigned char
 // for now, if pass in 0 for labels, it wont read labels
 PUBLIC STATIC void GenericLoader::load(const char * trainFilepath, unsigned char *images, int *labels, int startN, int numExamples) {
     StatefulTimer::timeCheck("GenericLoader::load start");
+    loadUntimed(trainFilepath, images, labels, startN, numExamples);
+    StatefulTimer::timeCheck("GenericLoader::load end");
+}
+// same as load(), but without the StatefulTimer checkpoints, since StatefulTimer
+// is not thread-safe, eg for loading on a background thread
+PUBLIC STATIC void GenericLoader::loadUntimed(const char * trainFilepath, unsigned char *images, int *labels, int startN, int numExamples) {
     char *headerBytes = FileHelper::readBinaryChunk(trainFilepath, 0, 1024);
     char type[1025];
     strncpy(type, headerBytes, 4);
@@ -88,7 +94,6 @@ PUBLIC STATIC void GenericLoader::load(const char * trainFilepath, unsigned char
         cout << "headstring" << type << endl;
         throw runtime_error(string("Filetype of ") + trainFilepath + " not recognised");
     }
-    StatefulTimer::timeCheck("GenericLoader::load end");
 }
 
 
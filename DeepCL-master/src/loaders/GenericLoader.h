@@ -36,6 +36,7 @@ class DeepCL_EXPORT GenericLoader {
     PUBLICAPI STATIC void load(const char * imagesFilePath, float *images, int *labels, int startN, int numExamples);
     STATIC void load(const char * trainFilepath, unsigned char *images, int *labels);
     STATIC void load(const char * trainFilepath, unsigned char *images, int *labels, int startN, int numExamples);
+    STATIC void loadUntimed(const char * trainFilepath, unsigned char *images, int *labels, int startN, int numExamples);
 
     // [[[end]]]
 };
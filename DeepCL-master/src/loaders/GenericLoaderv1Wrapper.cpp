@@ -37,7 +37,9 @@ PUBLIC GenericLoaderv1Wrapper::GenericLoaderv1Wrapper(std::string imagesFilepath
 PUBLIC VIRTUAL int GenericLoaderv1Wrapper::getImageCubeSize() {
     return planes * size * size;
 }
+// untimed, since GenericLoaderv2 times its own loads, and calls this from its
+// background loads too
 PUBLIC VIRTUAL void GenericLoaderv1Wrapper::load(unsigned char *data, int *labels, int startRecord, int numRecords) {
-    GenericLoader::load(imagesFilepath.c_str(), data, labels, startRecord, numRecords);
+    GenericLoader::loadUntimed(imagesFilepath.c_str(), data, labels, startRecord, numRecords);
 }
 
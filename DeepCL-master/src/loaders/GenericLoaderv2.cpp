@@ -10,6 +10,7 @@
 #include "util/StatefulTimer.h"
 #include "loaders/Loader.h"
 #include "loaders/GenericLoaderv1Wrapper.h"
+#include "loaders/MappedLoader.h"
 #include "loaders/GenericLoaderv2.h"
 
 #ifdef LIBJPEG_FOUND
@@ -27,28 +28,68 @@ using namespace std;
 #define STATIC
 #define VIRTUAL
 
+bool GenericLoaderv2::useMappedFiles = false;
+
 PUBLIC GenericLoaderv2::GenericLoaderv2(std::string imagesFilepath) {
     loader = 0;
+    mappedLoader = 0;
     #ifdef LIBJPEG_FOUND
     if(ManifestLoaderv1::isFormatFor(imagesFilepath) ) {
         loader = new ManifestLoaderv1(imagesFilepath);
     }
     #endif
+    if(loader == 0 && useMappedFiles && MappedLoader::isFormatFor(imagesFilepath)) {
+        mappedLoader = new MappedLoader(imagesFilepath);
+        loader = mappedLoader;
+    }
     if(loader == 0) {
         loader = new GenericLoaderv1Wrapper(imagesFilepath);
     }
 }
-
+PUBLIC GenericLoaderv2::~GenericLoaderv2() {
+    delete loader;
+}
+// jpeg manifests only: threads used to decode each load() call, 0 for one per core
+PUBLIC STATIC void GenericLoaderv2::setNumDecodeThreads(int numThreads) {
+    #ifdef LIBJPEG_FOUND
+    ManifestLoaderv1::setNumDecodeThreads(numThreads);
+    #endif
+}
+// jpeg manifests only: directory to keep decoded images in, between epochs and runs.
+// empty string disables the cache
+PUBLIC STATIC void GenericLoaderv2::setDecodeCacheDirectory(std::string directory) {
+    #ifdef LIBJPEG_FOUND
+    ManifestLoaderv1::setCacheDirectory(directory);
+    #endif
+}
+// mnist, norb and kgsgo v2 files only: read through a memory mapping, instead
+// of stream reads.  applies to loaders created after the call
+PUBLIC STATIC void GenericLoaderv2::setUseMappedFiles(bool useMappedFiles) {
+    GenericLoaderv2::useMappedFiles = useMappedFiles;
+}
+PUBLIC bool GenericLoaderv2::isMapped() {
+    return mappedLoader != 0;
+}
+// pointer to the image cubes for [startN, startN + numExamples), straight out of
+// the mapped file, or 0 if this loader isnt mapped, or its records arent stored
+// as plain image cubes.  valid as long as this loader is
+PUBLIC const unsigned char *GenericLoaderv2::getRecords(int startN, int numExamples) {
+    if(mappedLoader == 0) {
+        return 0;
+    }
+    return mappedLoader->getRecords(startN, numExamples);
+}
 PUBLIC void GenericLoaderv2::load(float *images, int *labels, int startN, int numExamples) {
-    int linearSize =  numExamples * loader->getImageCubeSize();
-    unsigned char *ucImages = new unsigned char[ linearSize ];
+    StatefulTimer::timeCheck("GenericLoaderv2::load start");
 
-    load(ucImages, labels, startN, numExamples);
+    loadFloats(images, labels, startN, numExamples);
 
-    for(int i = 0; i < linearSize; i++) {
-        images[i] = ucImages[i];
-    }
-    delete[] ucImages;
+    StatefulTimer::timeCheck("GenericLoaderv2::load end");
+}
+// same as load(), but without the StatefulTimer checkpoints, since StatefulTimer
+// is not thread-safe.  None of the loaders under us touch it either
+PUBLIC void GenericLoaderv2::loadFromBackgroundThread(float *images, int *labels, int startN, int numExamples) {
+    loadFloats(images, labels, startN, numExamples);
 }
 PUBLIC int GenericLoaderv2::getN() {
     return loader->getN();
@@ -70,5 +111,36 @@ PUBLIC void GenericLoaderv2::load(unsigned char *images, int *labels, int startN
 
     StatefulTimer::timeCheck("GenericLoaderv2::load end");
 }
+// the body of both float loads: from the mapping if we can, otherwise through
+// an unsigned char staging buffer
+PRIVATE void GenericLoaderv2::loadFloats(float *images, int *labels, int startN, int numExamples) {
+    if(loadFromMapping(images, labels, startN, numExamples)) {
+        return;
+    }
+    int linearSize =  numExamples * loader->getImageCubeSize();
+    unsigned char *ucImages = new unsigned char[ linearSize ];
+
+    loader->load(ucImages, labels, startN, numExamples);
 
+    for(int i = 0; i < linearSize; i++) {
+        images[i] = ucImages[i];
+    }
+    delete[] ucImages;
+}
+// converts straight from the mapped file into images, without the unsigned char
+// staging buffer.  returns false, having done nothing, if that isnt possible
+PRIVATE bool GenericLoaderv2::loadFromMapping(float *images, int *labels, int startN, int numExamples) {
+    const unsigned char *records = getRecords(startN, numExamples);
+    if(records == 0) {
+        return false;
+    }
+    long linearSize = (long)numExamples * loader->getImageCubeSize();
+    for(long i = 0; i < linearSize; i++) {
+        images[i] = records[i];
+    }
+    if(labels != 0) {
+        mappedLoader->loadLabels(labels, startN, numExamples);
+    }
+    return true;
+}
 
@@ -14,6 +14,7 @@
 #include "DeepCLDllExport.h"
 
 class Loader;
+class MappedLoader;
 
 #define VIRTUAL virtual
 #define STATIC static
@@ -24,6 +25,9 @@ class Loader;
 class DeepCL_EXPORT GenericLoaderv2 {
     private:
     Loader *loader;
+    MappedLoader *mappedLoader; // same object as loader, if mapped, otherwise 0
+
+    STATIC bool useMappedFiles;
 
     // [[[cog
     // import cog_addheaders
@@ -33,13 +37,24 @@ class DeepCL_EXPORT GenericLoaderv2 {
 
     public:
     GenericLoaderv2(std::string imagesFilepath);
+    ~GenericLoaderv2();
+    STATIC void setNumDecodeThreads(int numThreads);
+    STATIC void setDecodeCacheDirectory(std::string directory);
+    STATIC void setUseMappedFiles(bool useMappedFiles);
+    bool isMapped();
+    const unsigned char *getRecords(int startN, int numExamples);
     void load(float *images, int *labels, int startN, int numExamples);
+    void loadFromBackgroundThread(float *images, int *labels, int startN, int numExamples);
     int getN();
     int getPlanes();
     int getImageSize();
     void load(unsigned char *images, int *labels);
     void load(unsigned char *images, int *labels, int startN, int numExamples);
 
+    private:
+    void loadFloats(float *images, int *labels, int startN, int numExamples);
+    bool loadFromMapping(float *images, int *labels, int startN, int numExamples);
+
     // [[[end]]]
 };
 
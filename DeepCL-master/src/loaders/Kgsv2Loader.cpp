@@ -8,6 +8,7 @@
 #include <string>
 #include <vector>
 #include <stdexcept>
+#include <cstring>
 
 #include "util/FileHelper.h"
 #include "util/stringhelper.h"
@@ -66,16 +67,26 @@ STATIC void Kgsv2Loader::load(std::string filepath, unsigned char *data, int *la
     if(numRecords == 0) {
         numRecords = N - startRecord;
     }
-    const int imageSizeSquared = imageSize * imageSize;
     const long recordSize = getRecordSize(numPlanes, imageSize);
     long pos = (long)startRecord * recordSize + 1024 /* for header */;
     long chunkByteSize = (long)numRecords * recordSize;
 //    cout << "chunkByteSize: " << chunkByteSize << endl;
     unsigned char *kgsData = reinterpret_cast<unsigned char *>(FileHelper::readBinaryChunk(filepath, pos, chunkByteSize) );
+    decodeRecords(kgsData, numPlanes, imageSize, data, labels, numRecords);
+    delete[] kgsData;
+//    return numRecords;
+}
+
+// unpacks numRecords bit-packed records, starting at kgsData, into one unsigned
+// char per bit, and their labels, if labels isnt 0.  kgsData can point
+// straight into a mapped file
+STATIC void Kgsv2Loader::decodeRecords(const unsigned char *kgsData, int numPlanes, int imageSize, unsigned char *data, int *labels, int numRecords) {
+    const int imageSizeSquared = imageSize * imageSize;
+    const long recordSize = getRecordSize(numPlanes, imageSize);
     for(int n = 0; n < numRecords; n++) {
         long recordOffset = (long)n * recordSize;
 //        cout << "recordOffset: " << recordOffset << endl;
-        unsigned char *record = kgsData + recordOffset;
+        const unsigned char *record = kgsData + recordOffset;
         if(record[ 0 ] != 'G') {
             throw std::runtime_error("alignment error, for record " + toString(n));
         }
@@ -83,20 +94,26 @@ STATIC void Kgsv2Loader::load(std::string filepath, unsigned char *data, int *la
             throw std::runtime_error("alignment error, for record " + toString(n));
         }
         if(labels != 0) {
-            int *p_label = reinterpret_cast< int * >(record + 2);
-            int label = p_label[0];
+            // records are unaligned, and can come straight from a mapped file
+            int label;
+            memcpy(&label, record + 2, sizeof(int));
             labels[n] = label;
             if(label < 0) {
                 throw runtime_error("Error: label " + toString(labels) + " is negative");
             }
         }
-        unsigned char *recordImage = record + 6;
+        const unsigned char *recordImage = record + 6;
         int bitPos = 0;
         int intraRecordPos = 0;
-        unsigned char thisrecordbyte = recordImage[ intraRecordPos ];
+        unsigned char thisrecordbyte = 0;
         for(int plane = 0; plane < numPlanes; plane++) {
             unsigned char *dataPlane = data + ((long)n * numPlanes + plane) * imageSizeSquared;
             for(int intraImagePos = 0; intraImagePos < imageSizeSquared; intraImagePos++) {
+                // fetch each byte only once we need it, so we dont read past the
+                // end of the last record
+                if(bitPos == 0) {
+                    thisrecordbyte = recordImage[ intraRecordPos ];
+                }
                 unsigned char thisbyte = (thisrecordbyte >> (7 - bitPos) ) & 1;
 //                cout << "thisbyte: " << (int)thisbyte << endl;
                 dataPlane[ intraImagePos ] = thisbyte * 255;
@@ -104,13 +121,10 @@ STATIC void Kgsv2Loader::load(std::string filepath, unsigned char *data, int *la
                 if(bitPos == 8) {
                     bitPos = 0;
                     intraRecordPos++;
-                    thisrecordbyte = recordImage[ intraRecordPos ];
                 }
             }
         }
     }
-    delete[] kgsData;
-//    return numRecords;
 }
 
 //STATIC int Kgsv2Loader::loadKgs(std::string filepath, int *p_numPlanes, int *p_imageSize, unsigned char *data, int *labels, int recordStart, int numRecords) {
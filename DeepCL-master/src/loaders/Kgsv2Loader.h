@@ -24,6 +24,7 @@ public:
     STATIC void getDimensions(std::string filepath, int *p_N, int *p_numPlanes, int *p_imageSize);
     STATIC void load(std::string filepath, unsigned char *data, int *labels);
     STATIC void load(std::string filepath, unsigned char *data, int *labels, int startRecord, int numRecords);
+    STATIC void decodeRecords(const unsigned char *kgsData, int numPlanes, int imageSize, unsigned char *data, int *labels, int numRecords);
     STATIC int getRecordSize(int numPlanes, int imageSize);
 
     // [[[end]]]
@@ -14,6 +14,8 @@
 #include "util/stringhelper.h"
 #include "ManifestLoaderv1.h"
 #include "util/JpegHelper.h"
+#include "util/ThreadPool.h"
+#include "loaders/DecodedImageCache.h"
 
 #include "DeepCLDllExport.h"
 
@@ -33,8 +35,34 @@ PUBLIC STATIC bool ManifestLoaderv1::isFormatFor(std::string imagesFilepath) {
     cout << "matched: " << matched << endl;
     return matched;
 }
-PUBLIC ManifestLoaderv1::ManifestLoaderv1(std::string imagesFilepath) {
+int ManifestLoaderv1::numDecodeThreads = 0;
+std::string ManifestLoaderv1::cacheDirectory = "";
+
+// number of threads decoding jpegs in each load() call.  0 means one per core.
+// applies to loaders created after the call
+PUBLIC STATIC void ManifestLoaderv1::setNumDecodeThreads(int numThreads) {
+    numDecodeThreads = numThreads;
+}
+// if set, decoded images are kept in a cache file in this directory, one per
+// manifest, and later epochs read from there instead of decoding again.
+// applies to loaders created after the call
+PUBLIC STATIC void ManifestLoaderv1::setCacheDirectory(std::string directory) {
+    cacheDirectory = directory;
+}
+PUBLIC ManifestLoaderv1::ManifestLoaderv1(std::string imagesFilepath) :
+        files(0),
+        labels(0),
+        decodePool(0),
+        cache(0) {
     init(imagesFilepath);
+    decodePool = new ThreadPool(numDecodeThreads);
+    openCache();
+}
+PUBLIC VIRTUAL ManifestLoaderv1::~ManifestLoaderv1() {
+    delete cache;
+    delete decodePool;
+    delete[] files;
+    delete[] labels;
 }
 PRIVATE void ManifestLoaderv1::init(std::string imagesFilepath) {
     this->imagesFilepath = imagesFilepath;
@@ -155,6 +183,24 @@ PUBLIC VIRTUAL int ManifestLoaderv1::getPlanes() {
 PUBLIC VIRTUAL int ManifestLoaderv1::getImageSize() {
     return size;
 }
+PRIVATE void ManifestLoaderv1::openCache() {
+    if(cacheDirectory == "" || N == 0) {
+        return;
+    }
+    if(!FileHelper::folderExists(cacheDirectory)) {
+        FileHelper::createDirectory(cacheDirectory);
+    }
+    // a different file list, or different dimensions, gives a different signature,
+    // so a stale cache gets rebuilt rather than returning the wrong images
+    string fileList = toString(planes) + " " + toString(size) + "\n";
+    for(int n = 0; n < N; n++) {
+        fileList += files[n] + "\n";
+    }
+    vector<string> splitManifestPath = split(replaceGlobal(imagesFilepath, "\\", "/"), "/");
+    string manifestName = splitManifestPath[splitManifestPath.size() - 1];
+    string cachePath = cacheDirectory + "/" + manifestName + "-" + DecodedImageCache::hashString(imagesFilepath) + ".decoded";
+    cache = new DecodedImageCache(cachePath, N, getImageCubeSize(), DecodedImageCache::hashString(fileList));
+}
 int ManifestLoaderv1::readIntValue(std::vector< std::string > splitLine, std::string key) {
     for(int i = 0; i < (int)splitLine.size(); i++) {
         vector<string> splitPair = split(splitLine[i], "=");
@@ -168,18 +214,35 @@ int ManifestLoaderv1::readIntValue(std::vector< std::string > splitLine, std::st
 }
 PUBLIC VIRTUAL void ManifestLoaderv1::load(unsigned char *data, int *labels, int startRecord, int numRecords) {
     int imageCubeSize = planes * size * size;
+    numRecords = std::min(numRecords, N - startRecord);
+    if(numRecords <= 0) {
+        return;
+    }
+    if(labels != 0 && !hasLabels) {
+        throw runtime_error("ManifestLoaderv1: labels reqested in load() method, but none found in file");
+    }
 //    cout << "ManifestLoaderv1, loading " << numRecords << " jpegs" << endl;
+    vector<char> recordPresent(numRecords, 0);
+    if(cache != 0) {
+        cache->read(startRecord, numRecords, data, recordPresent);
+    }
+    vector<int> toDecode;
     for(int localN = 0; localN < numRecords; localN++) {
-        int globalN = localN + startRecord;
-        if(globalN >= N) {
-            return;
+        if(!recordPresent[localN]) {
+            toDecode.push_back(localN);
         }
-        JpegHelper::read(files[globalN], planes, size, size, data + localN * imageCubeSize);
-        if(labels != 0) {
-            if(!hasLabels) {
-                throw runtime_error("ManifestLoaderv1: labels reqested in load() method, but none found in file");
-            }
-            labels[localN] = this->labels[globalN];
+    }
+    // each worker decodes straight into its own slot in data
+    decodePool->parallelFor((int)toDecode.size(), [&](int task, int threadId) {
+        int localN = toDecode[task];
+        JpegHelper::read(files[localN + startRecord], planes, size, size, data + (long long)localN * imageCubeSize);
+    });
+    if(cache != 0 && toDecode.size() > 0) {
+        cache->write(startRecord, numRecords, data, recordPresent);
+    }
+    if(labels != 0) {
+        for(int localN = 0; localN < numRecords; localN++) {
+            labels[localN] = this->labels[localN + startRecord];
         }
     }
-}
\ No newline at end of file
+}
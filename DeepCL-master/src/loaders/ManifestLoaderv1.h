@@ -8,11 +8,15 @@
 
 #include <stdexcept>
 #include <string>
+#include <vector>
 #include <iostream>
 #include <algorithm>
 
 #include "loaders/Loader.h"
 
+class ThreadPool;
+class DecodedImageCache;
+
 #define VIRTUAL virtual
 #define STATIC static
 
@@ -27,6 +31,12 @@ class ManifestLoaderv1 : public Loader {
     std::string *files;
     int *labels;
 
+    ThreadPool *decodePool;
+    DecodedImageCache *cache; // 0 unless setCacheDirectory was called
+
+    STATIC int numDecodeThreads;
+    STATIC std::string cacheDirectory;
+
     // [[[cog
     // import cog_addheaders
     // cog_addheaders.addv2()
@@ -35,7 +45,10 @@ class ManifestLoaderv1 : public Loader {
 
     public:
     STATIC bool isFormatFor(std::string imagesFilepath);
+    STATIC void setNumDecodeThreads(int numThreads);
+    STATIC void setCacheDirectory(std::string directory);
     ManifestLoaderv1(std::string imagesFilepath);
+    VIRTUAL ~ManifestLoaderv1();
     VIRTUAL std::string getType();
     VIRTUAL int getImageCubeSize();
     VIRTUAL int getN();
@@ -45,6 +58,7 @@ class ManifestLoaderv1 : public Loader {
 
     private:
     void init(std::string imagesFilepath);
+    void openCache();
     int readIntValue(std::vector< std::string > splitLine, std::string key);
 
     // [[[end]]]
@@ -0,0 +1,168 @@
+// Copyright Hugh Perkins 2016 hughperkins at gmail
+//
+// This Source Code Form is subject to the terms of the Mozilla Public License,
+// v. 2.0. If a copy of the MPL was not distributed with this file, You can
+// obtain one at http://mozilla.org/MPL/2.0/.
+
+#include <iostream>
+#include <cstring>
+#include <stdexcept>
+
+#include "util/FileHelper.h"
+#include "util/MappedFile.h"
+#include "util/stringhelper.h"
+#include "loaders/Kgsv2Loader.h"
+#include "loaders/NorbLoader.h"
+#include "loaders/MnistLoader.h"
+#include "loaders/MappedLoader.h"
+
+using namespace std;
+
+#undef STATIC
+#undef VIRTUAL
+#define STATIC
+#define VIRTUAL
+
+// same formats as GenericLoader handles, detected the same way
+PUBLIC STATIC bool MappedLoader::isFormatFor(std::string imagesFilepath) {
+    if(FileHelper::getFilesize(imagesFilepath) < 4) {
+        return false;
+    }
+    char *headerBytes = FileHelper::readBinaryChunk(imagesFilepath, 0, 4);
+    unsigned int magic = *reinterpret_cast< unsigned int *>(headerBytes);
+    bool matched = strncmp(headerBytes, "mlv2", 4) == 0 || magic == 0x1e3d4c55 || magic == 0x03080000;
+    delete[] headerBytes;
+    return matched;
+}
+PUBLIC MappedLoader::MappedLoader(std::string imagesFilepath) :
+        imagesFilepath(imagesFilepath),
+        imagesFile(0),
+        labelsFile(0),
+        packed(false),
+        labelsOffset(0),
+        labelSize(0) {
+    imagesFile = new MappedFile(imagesFilepath);
+    try {
+        init();
+    } catch(...) {
+        delete labelsFile;
+        delete imagesFile;
+        throw;
+    }
+}
+PUBLIC VIRTUAL MappedLoader::~MappedLoader() {
+    delete labelsFile;
+    delete imagesFile;
+}
+PUBLIC VIRTUAL std::string MappedLoader::getType() {
+    return "MappedLoader";
+}
+PUBLIC VIRTUAL int MappedLoader::getImageCubeSize() {
+    return planes * size * size;
+}
+PUBLIC VIRTUAL int MappedLoader::getN() {
+    return N;
+}
+PUBLIC VIRTUAL int MappedLoader::getPlanes() {
+    return planes;
+}
+PUBLIC VIRTUAL int MappedLoader::getImageSize() {
+    return size;
+}
+// same contract as the other loaders: numRecords 0 means up to the end, and
+// labels 0 means dont read labels
+PUBLIC VIRTUAL void MappedLoader::load(unsigned char *data, int *labels, int startRecord, int numRecords) {
+    if(numRecords == 0) {
+        numRecords = N - startRecord;
+    }
+    if(packed) {
+        imagesFile->checkRange(imagesOffset + startRecord * recordSize, numRecords * recordSize);
+        Kgsv2Loader::decodeRecords(imagesFile->getData() + imagesOffset + startRecord * recordSize,
+            planes, size, data, labels, numRecords);
+        readAhead(startRecord + numRecords, numRecords);
+        return;
+    }
+    memcpy(data, getRecords(startRecord, numRecords), (size_t)(numRecords * recordSize));
+    if(labels != 0) {
+        loadLabels(labels, startRecord, numRecords);
+    }
+}
+// pointer to numRecords image cubes, [n][plane][row][col], inside the mapping,
+// valid for as long as this loader is.  0 for kgsgo v2, whose records arent
+// laid out that way
+PUBLIC const unsigned char *MappedLoader::getRecords(int startRecord, int numRecords) {
+    if(packed) {
+        return 0;
+    }
+    if(startRecord < 0 || numRecords < 0 || startRecord + numRecords > N) {
+        throw runtime_error("MappedLoader: cannot read records " + toString(startRecord) + " to "
+            + toString(startRecord + numRecords) + " from " + imagesFilepath + ", which has " + toString(N));
+    }
+    readAhead(startRecord + numRecords, numRecords);
+    return imagesFile->getData() + imagesOffset + startRecord * recordSize;
+}
+PUBLIC void MappedLoader::loadLabels(int *labels, int startRecord, int numRecords) {
+    if(packed) {
+        // kgsgo v2 keeps each label inside its record, after the "GO"
+        const unsigned char *records = imagesFile->getData() + imagesOffset + startRecord * recordSize;
+        for(int i = 0; i < numRecords; i++) {
+            memcpy(labels + i, records + i * recordSize + 2, 4);
+        }
+        return;
+    }
+    if(labelsFile == 0) {
+        throw runtime_error("MappedLoader: no labels file found for " + imagesFilepath);
+    }
+    const unsigned char *labelsData = labelsFile->getData() + labelsOffset + (long long)startRecord * labelSize;
+    if(labelSize == 4) {
+        memcpy(labels, labelsData, (size_t)numRecords * 4);
+    } else {
+        for(int i = 0; i < numRecords; i++) {
+            labels[i] = labelsData[i];
+        }
+    }
+    labelsFile->willNeed(labelsOffset + (long long)(startRecord + numRecords) * labelSize, (long long)numRecords * labelSize);
+}
+// hints the os to read in records [startRecord, startRecord + numRecords),
+// wrapping round to the start of the file, for the next epoch
+PRIVATE void MappedLoader::readAhead(int startRecord, int numRecords) {
+    if(startRecord >= N) {
+        startRecord = 0;
+    }
+    imagesFile->willNeed(imagesOffset + startRecord * recordSize, numRecords * recordSize);
+}
+// reads the dimensions and offsets for whichever format imagesFile is, and
+// maps the labels file, if there is one
+PRIVATE void MappedLoader::init() {
+    const unsigned char *header = imagesFile->getData();
+    unsigned int magic = imagesFile->getSize() >= 4 ? *reinterpret_cast< const unsigned int *>(header) : 0;
+    string labelsFilepath = "";
+    if(imagesFile->getSize() >= 4 && strncmp((const char *)header, "mlv2", 4) == 0) {
+        Kgsv2Loader::getDimensions(imagesFilepath, &N, &planes, &size);
+        packed = true;
+        imagesOffset = 1024;
+        recordSize = Kgsv2Loader::getRecordSize(planes, size);
+    } else if(magic == 0x1e3d4c55) {
+        NorbLoader::getDimensions(imagesFilepath, &N, &planes, &size);
+        imagesOffset = 6 * 4;
+        recordSize = (long long)planes * size * size;
+        labelsFilepath = replace(imagesFilepath, "-dat.mat","-cat.mat");
+        labelsOffset = 5 * 4;
+        labelSize = 4;
+    } else if(magic == 0x03080000) {
+        MnistLoader::getDimensions(imagesFilepath, &N, &planes, &size);
+        imagesOffset = 4 * 4;
+        recordSize = (long long)planes * size * size;
+        labelsFilepath = replace(imagesFilepath, "-images-idx3-ubyte", "-labels-idx1-ubyte");
+        labelsFilepath = replace(labelsFilepath, "-images.idx3-ubyte", "-labels.idx1-ubyte");
+        labelsOffset = 2 * 4;
+        labelSize = 1;
+    } else {
+        throw runtime_error("MappedLoader: filetype of " + imagesFilepath + " not recognised");
+    }
+    imagesFile->checkRange(imagesOffset, (long long)N * recordSize);
+    if(labelsFilepath != "" && labelsFilepath != imagesFilepath && FileHelper::exists(labelsFilepath)) {
+        labelsFile = new MappedFile(labelsFilepath);
+        labelsFile->checkRange(labelsOffset, (long long)N * labelSize);
+    }
+}
@@ -0,0 +1,68 @@
+// Copyright Hugh Perkins 2016 hughperkins at gmail
+//
+// This Source Code Form is subject to the terms of the Mozilla Public License,
+// v. 2.0. If a copy of the MPL was not distributed with this file, You can
+// obtain one at http://mozilla.org/MPL/2.0/.
+
+#pragma once
+
+#include <string>
+
+#include "loaders/Loader.h"
+
+class MappedFile;
+
+#define VIRTUAL virtual
+#define STATIC static
+
+// Loader for the mnist, norb and kgsgo v2 formats, reading through a memory
+// mapping of the file, instead of stream reads into a fresh buffer per call.
+//
+// For mnist and norb, each record is just its image cube, as unsigned chars,
+// back to back, so getRecords() can hand out a pointer straight into the
+// mapping, and callers can convert from there without any staging copy.
+// kgsgo v2 records are bit-packed, so getRecords() returns 0 for those, and
+// load() unpacks them from the mapping.
+//
+// Each access hints the os to start reading the following range of the same
+// size, since training walks the file in order.
+class MappedLoader : public Loader {
+    private:
+    std::string imagesFilepath;
+    MappedFile *imagesFile;
+    MappedFile *labelsFile; // 0 for kgsgo v2, or if there is no labels file
+    bool packed; // kgsgo v2
+    int N;
+    int planes;
+    int size;
+    long long imagesOffset; // header bytes, before the first record
+    long long recordSize; // on disk
+    long long labelsOffset;
+    int labelSize; // 1 for mnist, 4 for norb
+
+    // [[[cog
+    // import cog_addheaders
+    // cog_addheaders.addv2()
+    // ]]]
+    // generated, using cog:
+
+    public:
+    STATIC bool isFormatFor(std::string imagesFilepath);
+    MappedLoader(std::string imagesFilepath);
+    VIRTUAL ~MappedLoader();
+    VIRTUAL std::string getType();
+    VIRTUAL int getImageCubeSize();
+    VIRTUAL int getN();
+    VIRTUAL int getPlanes();
+    VIRTUAL int getImageSize();
+    VIRTUAL void load(unsigned char *data, int *labels, int startRecord, int numRecords);
+    const unsigned char *getRecords(int startRecord, int numRecords);
+    void loadLabels(int *labels, int startRecord, int numRecords);
+
+    private:
+    void readAhead(int startRecord, int numRecords);
+    void init();
+
+    // [[[end]]]
+};
+
@@ -7,6 +7,7 @@
 
 #include "DeepCL.h"
 #include "loss/SoftMaxLayer.h"
+#include "net/StreamingPredictor.h"
 #ifdef _WIN32
 #include <stdio.h>
 #include <fcntl.h>
@@ -31,7 +32,13 @@ using namespace std;
         {'name': 'outputFile', 'type': 'string', 'description': 'file to write outputs to, if empty, write to stdout', 'default': ''},
         {'name': 'outputLayer', 'type': 'int', 'description': 'layer to write output from, default -1 means: last layer', 'default': -1},
         {'name': 'writeLabels', 'type': 'int', 'description': 'write integer labels, instead of probabilities etc (default 0)', 'default': 0},
-        {'name': 'outputFormat', 'type': 'string', 'description': 'output format [binary|text]', 'default': 'text'}
+        {'name': 'outputFormat', 'type': 'string', 'description': 'output format [binary|text]', 'default': 'text'},
+        {'name': 'tuningFile', 'type': 'string', 'description': 'file to read chosen convolution kernels from, and record new choices to; empty means no tuning file', 'default': ''},
+        {'name': 'decodeThreads', 'type': 'int', 'description': 'threads decoding jpeg manifest images; 0 means one per core', 'default': 0},
+        {'name': 'fuseLayers', 'type': 'int', 'description': 'fuse conv-activation(-maxpool) chains into single kernels [0|1]', 'default': 0},
+        {'name': 'fp16', 'type': 'int', 'description': 'store weights on the device as half precision, computing in float [0|1]', 'default': 0},
+        {'name': 'kernelCacheDir', 'type': 'string', 'description': 'directory to cache compiled OpenCL programs in, so later runs skip kernel compilation; empty means no cache', 'default': ''},
+        {'name': 'pipelineDepth', 'type': 'int', 'description': 'run reading, the net and writing as overlapping stages, with this many batches in flight per stage, and print throughput and latency; 0 means no pipelining', 'default': 0}
     ]
 *///]]]
 // [[[end]]]
@@ -52,6 +59,12 @@ public:
     int outputLayer;
     int writeLabels;
     string outputFormat;
+    string tuningFile;
+    int decodeThreads;
+    int fuseLayers;
+    int fp16;
+    string kernelCacheDir;
+    int pipelineDepth;
     // [[[end]]]
 
     Config() {
@@ -81,10 +94,63 @@ public:
         outputLayer = -1;
         writeLabels = 0;
         outputFormat = "text";
+        tuningFile = "";
+        decodeThreads = 0;
+        fuseLayers = 0;
+        fp16 = 0;
+        kernelCacheDir = "";
+        pipelineDepth = 0;
         // [[[end]]]
     }
 };
 
+// reads, forwards and writes as overlapping stages, see StreamingPredictor.
+// Unlike the blocking loop in go(), a short final batch from stdin is written
+// too
+void goPipelined(Config config, NeuralNet *net, GenericLoaderv2 *loader, int N, long inputCubeSize, ostream *outFile) {
+    StreamingPredictor predictor(net, config.batchSize, config.outputLayer, config.writeLabels != 0, config.pipelineDepth);
+    const int numFields = predictor.getOutputCubeSize();
+    int numLoaded = 0;
+    // runs on the reader thread, while the net runs on this one
+    StreamingPredictor::Reader reader = [&](float *inputData, int maxImages) -> int {
+        if(loader == NULL) {
+            cin.read(reinterpret_cast< char * >(inputData), inputCubeSize * maxImages * 4l);
+            return (int)(cin.gcount() / (inputCubeSize * 4l));
+        }
+        int numImages = std::min(maxImages, N - numLoaded);
+        if(numImages > 0) {
+            loader->loadFromBackgroundThread(inputData, 0, numLoaded, numImages);
+            numLoaded += numImages;
+        }
+        return numImages;
+    };
+    StreamingPredictor::Writer writer = [&](int numImages, float const *output, int const *labels) {
+        if(config.outputFormat == "text") {
+            for(int i = 0; i < numImages; i++) {
+                if(config.writeLabels) {
+                    *outFile << labels[i] << "\n";
+                    continue;
+                }
+                for(int f = 0; f < numFields; f++) {
+                    if(f > 0) {
+                        *outFile << " ";
+                    }
+                    *outFile << output[ i * numFields + f ];
+                }
+                *outFile << "\n";
+            }
+        } else if(config.writeLabels) {
+            outFile->write(reinterpret_cast< const char * >(labels), numImages * 4l);
+        } else {
+            outFile->write(reinterpret_cast< const char * >(output), numImages * numFields * 4l);
+        }
+        outFile->flush();
+    };
+    predictor.run(reader, writer);
+    // stdout may be carrying the outputs
+    predictor.printStats(cerr);
+}
+
 void go(Config config) {
     bool verbose = true;
     if(config.outputFile == "") {
@@ -106,6 +172,7 @@ void go(Config config) {
             throw std::runtime_error("imageSize doesnt match imageSizeCheck, image not square");
         }
     } else {
+        GenericLoaderv2::setNumDecodeThreads(config.decodeThreads);
         loader = new GenericLoaderv2(config.inputFile);
         N = loader->getN();
         numPlanes = loader->getPlanes();
@@ -127,6 +194,8 @@ void go(Config config) {
         cl = EasyCL::createForFirstGpuOtherwiseCpu(verbose);
     }
     ClBlasInstance blasInstance;
+    TuningDatabase::instance()->setFilepath(config.tuningFile);
+    ProgramCache::instance()->setDirectory(config.kernelCacheDir);
 
     NeuralNet *net;
     net = new NeuralNet(cl);
@@ -152,6 +221,10 @@ void go(Config config) {
     if(!NetdefToNet::createNetFromNetdef(net, netDef, weightsInitializer) ) {
         return;
     }
+    if(config.fuseLayers) {
+        int numFused = net->fuseLayers();
+        if(verbose) cout << "fused " << numFused << " layer chains" << endl;
+    }
 
     // ignored int and float, s.t. we can use loadWeights
     int ignI;
@@ -164,6 +237,9 @@ void go(Config config) {
         return;
     }
 
+    if(config.fp16) {
+        net->enableHalfStorage();
+    }
     if(verbose) {
         net->print();
     }
@@ -203,7 +279,10 @@ void go(Config config) {
         config.outputLayer = net->getNumLayers() - 1;
     }
     if(verbose) cout << "inputFile: '" << config.inputFile << "'"<< endl;
-    if(config.inputFile == "") {
+    if(config.pipelineDepth > 0) {
+        goPipelined(config, net, loader, N, inputCubeSize, outFile);
+        more = false;
+    } else if(config.inputFile == "") {
         cin.read(reinterpret_cast< char * >(inputData), inputCubeSize * config.batchSize * 4l);
         more = !cin.eof();
     } else {
@@ -321,6 +400,12 @@ void printUsage(char *argv[], Config config) {
     cout << "    outputlayer=[layer to write output from, default -1 means: last layer] (" << config.outputLayer << ")" << endl;
     cout << "    writelabels=[write integer labels, instead of probabilities etc (default 0)] (" << config.writeLabels << ")" << endl;
     cout << "    outputformat=[output format [binary|text]] (" << config.outputFormat << ")" << endl;
+    cout << "    tuningfile=[file to read chosen convolution kernels from, and record new choices to; empty means no tuning file] (" << config.tuningFile << ")" << endl;
+    cout << "    decodethreads=[threads decoding jpeg manifest images; 0 means one per core] (" << config.decodeThreads << ")" << endl;
+    cout << "    fuselayers=[fuse conv-activation(-maxpool) chains into single kernels [0|1]] (" << config.fuseLayers << ")" << endl;
+    cout << "    fp16=[store weights on the device as half precision, computing in float [0|1]] (" << config.fp16 << ")" << endl;
+    cout << "    kernelcachedir=[directory to cache compiled OpenCL programs in, so later runs skip kernel compilation; empty means no cache] (" << config.kernelCacheDir << ")" << endl;
+    cout << "    pipelinedepth=[run reading, the net and writing as overlapping stages, with this many batches in flight per stage, and print throughput and latency; 0 means no pipelining] (" << config.pipelineDepth << ")" << endl;
     // [[[end]]]
 }
 
@@ -370,6 +455,18 @@ int main(int argc, char *argv[]) {
                 config.writeLabels = atoi(value);
             } else if(key == "outputformat") {
                 config.outputFormat = (value);
+            } else if(key == "tuningfile") {
+                config.tuningFile = (value);
+            } else if(key == "decodethreads") {
+                config.decodeThreads = atoi(value);
+            } else if(key == "fuselayers") {
+                config.fuseLayers = atoi(value);
+            } else if(key == "fp16") {
+                config.fp16 = atoi(value);
+            } else if(key == "kernelcachedir") {
+                config.kernelCacheDir = (value);
+            } else if(key == "pipelinedepth") {
+                config.pipelineDepth = atoi(value);
             // [[[end]]]
             } else {
                 cout << endl;
@@ -11,6 +11,9 @@
 #include "DeepCL.h"
 //#include "test/Sampler.h"  // TODO: REMOVE THIS
 #include "clblas/ClBlasInstance.h"
+#include "net/DeviceProfiler.h"
+#include "normalize/DatasetStatistics.h"
+#include "util/ThreadPool.h"
 
 using namespace std;
 
@@ -46,7 +49,19 @@ using namespace std;
         ('rho', 'float', 'rho decay, in adadelta trainer. 1 is no decay. 0 is full decay (default 0.9)', 0.9, False),
         ('momentum', 'float', 'momentum, used by sgd and nesterov trainers', 0.0, True),
         ('weightDecay', 'float', 'weight decay, 0 means no decay; 1 means full decay, used by sgd trainer', 0.0, True),
-        ('anneal', 'float', 'multiply learningrate by this amount each epoch, used by anneal trainer, default 1.0', 1.0, False)
+        ('anneal', 'float', 'multiply learningrate by this amount each epoch, used by anneal trainer, default 1.0', 1.0, False),
+        ('tuningFile', 'string', 'file to read and record chosen convolution kernels, per device and layer dimensions; empty means no tuning file', '', False),
+        ('decodeThreads', 'int', 'threads decoding jpeg manifest images; 0 means one per core', 0, False),
+        ('decodeCacheDir', 'string', 'directory to cache decoded jpeg manifest images in, so later epochs skip decoding; empty means no cache', '', False),
+        ('prefetchBuffers', 'int', 'for loadondemand=1: number of file batches to hold in memory while loading ahead on a background thread; 0 means load each file batch only when needed', 0, False),
+        ('fuseLayers', 'int', 'fuse conv-activation(-maxpool) chains into single kernels [0|1]', 0, False),
+        ('mapFiles', 'int', 'read mnist, norb and kgsgo v2 data files through a memory mapping, instead of stream reads [0|1]', 0, False),
+        ('profileFile', 'string', 'write a chrome://tracing json of per-layer device times to this file each epoch, and print a summary; empty means no device profiling', '', False),
+        ('kernelCacheDir', 'string', 'directory to cache compiled OpenCL programs in, so later runs skip kernel compilation; empty means no cache', '', False),
+        ('dataParallelDevices', 'string', 'train on several devices at once, splitting each batch: comma-separated gpu indexes, eg 0,1, or cpu:n to split the cpu into n sub-devices; empty means just gpuindex', '', False),
+        ('asyncCheckpoint', 'int', 'write weights files on a background thread, so training only waits while the weights are copied off the device [1|0]', 1, False),
+        ('weightsFileVersion', 'int', 'weights file format [3|4]: 4 has a section per layer, which loading maps into memory, instead of reading the whole file', 3, False),
+        ('normalizationStatsFile', 'string', 'file to keep dataset mean and stddev in, so later runs with loadondemand=1 skip reading the dataset for them; empty means always compute them', '', False)
     ]
 *///]]]
 // [[[end]]]
@@ -87,6 +102,18 @@ public:
     float momentum;
     float weightDecay;
     float anneal;
+    string tuningFile;
+    int decodeThreads;
+    string decodeCacheDir;
+    int prefetchBuffers;
+    int fuseLayers;
+    int mapFiles;
+    string profileFile;
+    string kernelCacheDir;
+    string dataParallelDevices;
+    int asyncCheckpoint;
+    int weightsFileVersion;
+    string normalizationStatsFile;
     // [[[end]]]
 
     Config() {
@@ -134,6 +161,18 @@ public:
         momentum = 0.0f;
         weightDecay = 0.0f;
         anneal = 1.0f;
+        tuningFile = "";
+        decodeThreads = 0;
+        decodeCacheDir = "";
+        prefetchBuffers = 0;
+        fuseLayers = 0;
+        mapFiles = 0;
+        profileFile = "";
+        kernelCacheDir = "";
+        dataParallelDevices = "";
+        asyncCheckpoint = 1;
+        weightsFileVersion = 3;
+        normalizationStatsFile = "";
         // [[[end]]]
 
     }
@@ -152,6 +191,42 @@ public:
     }
 };
 
+// returns 0 if config.trainer is unknown
+Trainer *createTrainer(EasyCL *cl, Config config) {
+    Trainer *trainer = 0;
+    if(toLower(config.trainer) == "sgd") {
+        SGD *sgd = new SGD(cl);
+        sgd->setLearningRate(config.learningRate);
+        sgd->setMomentum(config.momentum);
+        sgd->setWeightDecay(config.weightDecay);
+        trainer = sgd;
+    } else if(toLower(config.trainer) == "anneal") {
+        Annealer *annealer = new Annealer(cl);
+        annealer->setLearningRate(config.learningRate);
+        annealer->setAnneal(config.anneal);
+        trainer = annealer;
+    } else if(toLower(config.trainer) == "nesterov") {
+        Nesterov *nesterov = new Nesterov(cl);
+        nesterov->setLearningRate(config.learningRate);
+        nesterov->setMomentum(config.momentum);
+        trainer = nesterov;
+    } else if(toLower(config.trainer) == "adagrad") {
+        Adagrad *adagrad = new Adagrad(cl);
+        adagrad->setLearningRate(config.learningRate);
+        trainer = adagrad;
+    } else if(toLower(config.trainer) == "rmsprop") {
+        Rmsprop *rmsprop = new Rmsprop(cl);
+        rmsprop->setLearningRate(config.learningRate);
+        trainer = rmsprop;
+    } else if(toLower(config.trainer) == "adadelta") {
+        Adadelta *adadelta = new Adadelta(cl, config.rho);
+        trainer = adadelta;
+    } else {
+        cout << "trainer " << config.trainer << " unknown." << endl;
+    }
+    return trainer;
+}
+
 void go(Config config) {
     Timer timer;
 
@@ -173,6 +248,10 @@ void go(Config config) {
     }
     cout << "Statefultimer enabled: " << StatefulTimer::enabled << endl;
 
+    GenericLoaderv2::setNumDecodeThreads(config.decodeThreads);
+    GenericLoaderv2::setDecodeCacheDirectory(config.decodeCacheDir);
+    GenericLoaderv2::setUseMappedFiles(config.mapFiles);
+
 //    int totalLinearSize;
     GenericLoaderv2 trainLoader(config.dataDir + "/" + config.trainFile);
     Ntrain = trainLoader.getN();
@@ -218,8 +297,10 @@ void go(Config config) {
     int normalizationExamples = config.normalizationExamples > Ntrain ? Ntrain : config.normalizationExamples;
     if(!config.loadOnDemand) {
         if(config.normalization == "stddev") {
-            float mean, stdDev;
-            NormalizationHelper::getMeanAndStdDev(trainData, normalizationExamples * inputCubeSize, &mean, &stdDev);
+            ThreadPool statisticsPool(ThreadPool::defaultNumThreads());
+            DatasetStatistics statistics = DatasetStatistics::compute(trainData, (long long)normalizationExamples * inputCubeSize, &statisticsPool);
+            float mean = statistics.getMean();
+            float stdDev = statistics.getStdDev();
             cout << " image stats mean " << mean << " stdDev " << stdDev << endl;
             translate = - mean;
             scale = 1.0f / stdDev / config.normalizationNumStds;
@@ -234,10 +315,11 @@ void go(Config config) {
         }
     } else {
         if(config.normalization == "stddev") {
-            float mean, stdDev;
-            NormalizeGetStdDev normalizeGetStdDev(trainData, trainLabels); 
-            BatchProcessv2::run(&trainLoader, 0, config.batchSize, normalizationExamples, inputCubeSize, &normalizeGetStdDev);
-            normalizeGetStdDev.calcMeanStdDev(&mean, &stdDev);
+            ThreadPool statisticsPool(ThreadPool::defaultNumThreads());
+            DatasetStatistics statistics = DatasetStatistics::computeCached(config.normalizationStatsFile, config.dataDir + "/" + config.trainFile,
+                &trainLoader, normalizationExamples, config.batchSize * config.fileReadBatches, &statisticsPool);
+            float mean = statistics.getMean();
+            float stdDev = statistics.getStdDev();
             cout << " image stats mean " << mean << " stdDev " << stdDev << endl;
             translate = - mean;
             scale = 1.0f / stdDev / config.normalizationNumStds;
@@ -257,12 +339,19 @@ void go(Config config) {
 //    const int batchSize = config.batchSize;
 
     EasyCL *cl = 0;
-    if(config.gpuIndex >= 0) {
+    vector<EasyCL *> replicaCls; // data-parallel replicas after the first, which uses cl
+    if(config.dataParallelDevices != "") {
+        replicaCls = DataParallelNet::createContexts(config.dataParallelDevices);
+        cl = replicaCls[0];
+        replicaCls.erase(replicaCls.begin());
+    } else if(config.gpuIndex >= 0) {
         cl = EasyCL::createForIndexedGpu(config.gpuIndex);
     } else {
         cl = EasyCL::createForFirstGpuOtherwiseCpu();
     }
     ClBlasInstance blasInstance;
+    TuningDatabase::instance()->setFilepath(config.tuningFile);
+    ProgramCache::instance()->setDirectory(config.kernelCacheDir);
 
     NeuralNet *net;
     net = new NeuralNet(cl);
@@ -283,37 +372,12 @@ void go(Config config) {
     if(!NetdefToNet::createNetFromNetdef(net, config.netDef, weightsInitializer)) {
         return;
     }
+    if(config.fuseLayers) {
+        cout << "fused " << net->fuseLayers() << " layer chains" << endl;
+    }
     // apply the trainer
-    Trainer *trainer = 0;
-    if(toLower(config.trainer) == "sgd") {
-        SGD *sgd = new SGD(cl);
-        sgd->setLearningRate(config.learningRate);
-        sgd->setMomentum(config.momentum);
-        sgd->setWeightDecay(config.weightDecay);
-        trainer = sgd;
-    } else if(toLower(config.trainer) == "anneal") {
-        Annealer *annealer = new Annealer(cl);
-        annealer->setLearningRate(config.learningRate);
-        annealer->setAnneal(config.anneal);
-        trainer = annealer;
-    } else if(toLower(config.trainer) == "nesterov") {
-        Nesterov *nesterov = new Nesterov(cl);
-        nesterov->setLearningRate(config.learningRate);
-        nesterov->setMomentum(config.momentum);
-        trainer = nesterov;
-    } else if(toLower(config.trainer) == "adagrad") {
-        Adagrad *adagrad = new Adagrad(cl);
-        adagrad->setLearningRate(config.learningRate);
-        trainer = adagrad;
-    } else if(toLower(config.trainer) == "rmsprop") {
-        Rmsprop *rmsprop = new Rmsprop(cl);
-        rmsprop->setLearningRate(config.learningRate);
-        trainer = rmsprop;
-    } else if(toLower(config.trainer) == "adadelta") {
-        Adadelta *adadelta = new Adadelta(cl, config.rho);
-        trainer = adadelta;
-    } else {
-        cout << "trainer " << config.trainer << " unknown." << endl;
+    Trainer *trainer = createTrainer(cl, config);
+    if(trainer == 0) {
         return;
     }
     cout << "Using trainer " << trainer->asString() << endl;
@@ -360,13 +424,46 @@ void go(Config config) {
         multiNet = new MultiNet(config.multiNet, net);
         trainable = multiNet;
     }
+    // each replica has the same layers as net, on its own device; DataParallelNet
+    // then copies net's weights into them
+    vector<NeuralNet *> replicas;
+    vector<Trainer *> replicaTrainers;
+    DataParallelNet *dataParallel = 0;
+    if(replicaCls.size() > 0) {
+        if(multiNet != 0) {
+            cout << "multinet and dataparalleldevices cant be used together" << endl;
+            return;
+        }
+        if(config.dumpTimings || config.profileFile != "") {
+            cout << "dumptimings and profilefile cant be used with dataparalleldevices, since the timers are not thread-safe" << endl;
+            return;
+        }
+        replicas.push_back(net);
+        replicaTrainers.push_back(trainer);
+        for(int i = 0; i < (int)replicaCls.size(); i++) {
+            NeuralNet *replica = new NeuralNet(replicaCls[i]);
+            replica->addLayer(InputLayerMaker::instance()->numPlanes(numPlanes)->imageSize(imageSize));
+            replica->addLayer(NormalizationLayerMaker::instance()->translate(translate)->scale(scale));
+            NetdefToNet::createNetFromNetdef(replica, config.netDef, weightsInitializer);
+            if(config.fuseLayers) {
+                replica->fuseLayers();
+            }
+            replicas.push_back(replica);
+            replicaTrainers.push_back(createTrainer(replicaCls[i], config));
+        }
+        dataParallel = new DataParallelNet(replicas, replicaTrainers);
+        trainable = dataParallel;
+        cout << "training data parallel over " << replicas.size() << " devices" << endl;
+    }
     NetLearnerBase *netLearner = 0;
     if(config.loadOnDemand) {
-        netLearner = new NetLearnerOnDemandv2(trainer, trainable,
+        NetLearnerOnDemandv2 *netLearnerOnDemand = new NetLearnerOnDemandv2(trainer, trainable,
             &trainLoader, Ntrain,
             &testLoader, Ntest,
             config.fileReadBatches, config.batchSize
         );
+        netLearnerOnDemand->setNumPrefetchBuffers(config.prefetchBuffers);
+        netLearner = netLearnerOnDemand;
     } else {
         netLearner = new NetLearner(trainer, trainable,
             Ntrain, trainData, trainLabels,
@@ -382,6 +479,17 @@ void go(Config config) {
     }
     netLearner->setDumpTimings(config.dumpTimings);
 //    netLearner->setLearningRate(config.learningRate, config.annealLearningRate);
+    if(config.profileFile != "") {
+        DeviceProfiler::enable(cl);
+    }
+    if(config.weightsFileVersion != WeightsPersister::latestVersion && config.weightsFileVersion != WeightsPersister::perLayerVersion) {
+        cout << "weightsfileversion should be " << WeightsPersister::latestVersion << " or " << WeightsPersister::perLayerVersion << endl;
+        return;
+    }
+    CheckpointWriter *checkpointWriter = 0;
+    if(config.weightsFile != "" && config.asyncCheckpoint) {
+        checkpointWriter = new CheckpointWriter(config.weightsFileVersion);
+    }
     Timer weightsWriteTimer;
     while(!netLearner->isLearningDone()) {
 //        netLearnerBase->tickEpoch();
@@ -390,7 +498,11 @@ void go(Config config) {
 //            cout << "epoch done" << endl;
             if(config.weightsFile != "") {
                 cout << "record epoch=" << netLearner->getNextEpoch() << endl;
-                WeightsPersister::persistWeights(config.weightsFile, config.getTrainingString(), net, netLearner->getNextEpoch(), 0, 0, 0, 0);
+                if(checkpointWriter != 0) {
+                    checkpointWriter->persistWeights(config.weightsFile, config.getTrainingString(), net, netLearner->getNextEpoch(), 0, 0, 0, 0);
+                } else {
+                    WeightsPersister::persistWeights(config.weightsFileVersion, config.weightsFile, config.getTrainingString(), net, netLearner->getNextEpoch(), 0, 0, 0, 0);
+                }
                 weightsWriteTimer.lap();
             }
 //            Sampler::sampleFloatWrapper("conv weights", net->getLayer(6)->getWeightsWrapper());
@@ -400,6 +512,16 @@ void go(Config config) {
             if(config.dumpTimings) {
                 StatefulTimer::dump(true);
             }
+            if(dataParallel != 0) {
+                cout << dataParallel->getScalingSummary();
+                dataParallel->resetScalingStats();
+            }
+            if(config.profileFile != "") {
+                DeviceProfiler::instance()->writeChromeTrace(config.profileFile);
+                cout << DeviceProfiler::instance()->getSummary();
+                cout << "wrote device profile to " << config.profileFile << endl;
+                DeviceProfiler::reset();
+            }
         } else {
             if(config.writeWeightsInterval > 0) {
 //                cout << "batch done" << endl;
@@ -414,20 +536,36 @@ void go(Config config) {
                         "(" << ((float)nextBatch * 100.0f / netLearner->getNTrain() * config.batchSize) << "% of epoch)" <<
                         " numRight=" << batchNumRight << "(" << (batchNumRight * 100.0f / nextBatch / config.batchSize) << "%)" <<
                         " loss=" << batchLoss << endl;
-                    WeightsPersister::persistWeights(config.weightsFile, config.getTrainingString(), net,
-                        nextEpoch, nextBatch, 0, batchNumRight, batchLoss);
+                    if(checkpointWriter != 0) {
+                        checkpointWriter->persistWeights(config.weightsFile, config.getTrainingString(), net,
+                            nextEpoch, nextBatch, 0, batchNumRight, batchLoss);
+                    } else {
+                        WeightsPersister::persistWeights(config.weightsFileVersion, config.weightsFile, config.getTrainingString(), net,
+                            nextEpoch, nextBatch, 0, batchNumRight, batchLoss);
+                    }
                     weightsWriteTimer.lap();
                 }
             }
         }
     }
 
+    if(checkpointWriter != 0) {
+        checkpointWriter->flush();
+        cout << "checkpoints: " << checkpointWriter->getNumWritten() << " written, " << checkpointWriter->getNumDropped()
+            << " superseded before writing, training paused " << checkpointWriter->getSnapshotMilliseconds() << "ms for them" << endl;
+        delete checkpointWriter;
+    }
     delete weightsInitializer;
     delete trainer;
     delete netLearner;
     if(multiNet != 0) {
         delete multiNet;
     }
+    delete dataParallel;
+    for(int i = 1; i < (int)replicas.size(); i++) {
+        delete replicaTrainers[i];
+        delete replicas[i];
+    }
     delete net;
     if(trainData != 0) {
         delete[] trainData;
@@ -441,6 +579,9 @@ void go(Config config) {
     if(trainLabels != 0) {
         delete[] trainLabels;
     }
+    for(int i = 0; i < (int)replicaCls.size(); i++) {
+        delete replicaCls[i];
+    }
     delete cl;
 }
 
@@ -492,6 +633,18 @@ void printUsage(char *argv[], Config config) {
     cout << "    initialweights=[for uniform initializer, weights will be initialized randomly within range -initialweights to +initialweights, divided by fanin, (default: 1.0f)] (" << config.initialWeights << ")" << endl;
     cout << "    rho=[rho decay, in adadelta trainer. 1 is no decay. 0 is full decay (default 0.9)] (" << config.rho << ")" << endl;
     cout << "    anneal=[multiply learningrate by this amount each epoch, used by anneal trainer, default 1.0] (" << config.anneal << ")" << endl;
+    cout << "    tuningfile=[file to read and record chosen convolution kernels, per device and layer dimensions; empty means no tuning file] (" << config.tuningFile << ")" << endl;
+    cout << "    decodethreads=[threads decoding jpeg manifest images; 0 means one per core] (" << config.decodeThreads << ")" << endl;
+    cout << "    decodecachedir=[directory to cache decoded jpeg manifest images in, so later epochs skip decoding; empty means no cache] (" << config.decodeCacheDir << ")" << endl;
+    cout << "    prefetchbuffers=[for loadondemand=1: number of file batches to hold in memory while loading ahead on a background thread; 0 means load each file batch only when needed] (" << config.prefetchBuffers << ")" << endl;
+    cout << "    fuselayers=[fuse conv-activation(-maxpool) chains into single kernels [0|1]] (" << config.fuseLayers << ")" << endl;
+    cout << "    mapfiles=[read mnist, norb and kgsgo v2 data files through a memory mapping, instead of stream reads [0|1]] (" << config.mapFiles << ")" << endl;
+    cout << "    profilefile=[write a chrome://tracing json of per-layer device times to this file each epoch, and print a summary; empty means no device profiling] (" << config.profileFile << ")" << endl;
+    cout << "    kernelcachedir=[directory to cache compiled OpenCL programs in, so later runs skip kernel compilation; empty means no cache] (" << config.kernelCacheDir << ")" << endl;
+    cout << "    dataparalleldevices=[train on several devices at once, splitting each batch: comma-separated gpu indexes, eg 0,1, or cpu:n to split the cpu into n sub-devices; empty means just gpuindex] (" << config.dataParallelDevices << ")" << endl;
+    cout << "    asynccheckpoint=[write weights files on a background thread, so training only waits while the weights are copied off the device [1|0]] (" << config.asyncCheckpoint << ")" << endl;
+    cout << "    weightsfileversion=[weights file format [3|4]: 4 has a section per layer, which loading maps into memory, instead of reading the whole file] (" << config.weightsFileVersion << ")" << endl;
+    cout << "    normalizationstatsfile=[file to keep dataset mean and stddev in, so later runs with loadondemand=1 skip reading the dataset for them; empty means always compute them] (" << config.normalizationStatsFile << ")" << endl;
     // [[[end]]]
 }
 
@@ -579,6 +732,30 @@ int main(int argc, char *argv[]) {
                 config.weightDecay = atof(value);
             } else if(key == "anneal") {
                 config.anneal = atof(value);
+            } else if(key == "tuningfile") {
+                config.tuningFile = (value);
+            } else if(key == "decodethreads") {
+                config.decodeThreads = atoi(value);
+            } else if(key == "decodecachedir") {
+                config.decodeCacheDir = (value);
+            } else if(key == "prefetchbuffers") {
+                config.prefetchBuffers = atoi(value);
+            } else if(key == "fuselayers") {
+                config.fuseLayers = atoi(value);
+            } else if(key == "mapfiles") {
+                config.mapFiles = atoi(value);
+            } else if(key == "profilefile") {
+                config.profileFile = (value);
+            } else if(key == "kernelcachedir") {
+                config.kernelCacheDir = (value);
+            } else if(key == "dataparalleldevices") {
+                config.dataParallelDevices = (value);
+            } else if(key == "asynccheckpoint") {
+                config.asyncCheckpoint = atoi(value);
+            } else if(key == "weightsfileversion") {
+                config.weightsFileVersion = atoi(value);
+            } else if(key == "normalizationstatsfile") {
+                config.normalizationStatsFile = (value);
             // [[[end]]]
             } else {
                 cout << endl;
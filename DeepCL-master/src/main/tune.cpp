@@ -0,0 +1,238 @@
+// Copyright Hugh Perkins 2016 hughperkins at gmail
+//
+// This Source Code Form is subject to the terms of the Mozilla Public License,
+// v. 2.0. If a copy of the MPL was not distributed with this file, You can
+// obtain one at http://mozilla.org/MPL/2.0/.
+
+// offline tuning: builds the network from a netdef, runs forward and backward
+// on random data until every ForwardAuto/BackwardAuto/BackpropWeightsAuto has
+// chosen a kernel, and records the choices into the tuning file.  deepcl_train
+// and deepcl_predict, given the same tuningfile=, then skip the trial runs.
+
+#include "DeepCL.h"
+#include "conv/Forward.h"
+#include "conv/Backward.h"
+#include "conv/BackpropWeights.h"
+#include "util/RandomSingleton.h"
+#include "clblas/ClBlasInstance.h"
+
+using namespace std;
+
+/* [[[cog
+    # format:
+    # (name, type, description, default, ispublicapi)
+    options = [
+        ('gpuIndex', 'int', 'gpu device index; default value is gpu if present, cpu otw.', -1, True),
+        ('netDef', 'string', 'network definition',"rt2-8c5z-relu-mp2-16c5z-relu-mp3-150n-tanh-10n", True),
+        ('numPlanes', 'int', 'number of input planes', 1, True),
+        ('imageSize', 'int', 'input image size', 28, True),
+        ('batchSize', 'int', 'batch size', 128, True),
+        ('tuningFile', 'string', 'file to record chosen convolution kernels to', 'deepcl-tuning.txt', True),
+        ('retune', 'int', 'ignore entries already in the tuning file, and measure again [1|0]', 0, True),
+        ('numTimedRuns', 'int', 'number of warm timed runs per candidate kernel, median is used', 5, True),
+        ('kernelCacheDir', 'string', 'directory to cache compiled OpenCL programs in; empty means no cache', '', False)
+    ]
+*///]]]
+// [[[end]]]
+
+class Config {
+public:
+    /* [[[cog
+        cog.outl('// generated using cog:')
+        for (name,type,description,default,_) in options:
+            cog.outl(type + ' ' + name + ';')
+    */// ]]]
+    // generated using cog:
+    int gpuIndex;
+    string netDef;
+    int numPlanes;
+    int imageSize;
+    int batchSize;
+    string tuningFile;
+    int retune;
+    int numTimedRuns;
+    string kernelCacheDir;
+    // [[[end]]]
+
+    Config() {
+        /* [[[cog
+            cog.outl('// generated using cog:')
+            for (name,type,description,default,_) in options:
+                defaultString = ''
+                if type == 'string':
+                    defaultString = '"' + default + '"'
+                elif type == 'int':
+                    defaultString = str(default)
+                elif type == 'float':
+                    defaultString = str(default)
+                    if '.' not in defaultString:
+                        defaultString += '.0'
+                    defaultString += 'f'
+                cog.outl(name + ' = ' + defaultString + ';')
+        */// ]]]
+        // generated using cog:
+        gpuIndex = -1;
+        netDef = "rt2-8c5z-relu-mp2-16c5z-relu-mp3-150n-tanh-10n";
+        numPlanes = 1;
+        imageSize = 28;
+        batchSize = 128;
+        tuningFile = "deepcl-tuning.txt";
+        retune = 0;
+        numTimedRuns = 5;
+        kernelCacheDir = "";
+        // [[[end]]]
+    }
+};
+
+void go(Config config) {
+    if(config.tuningFile == "") {
+        cout << "Please provide tuningfile=" << endl;
+        return;
+    }
+    EasyCL *cl = 0;
+    if(config.gpuIndex >= 0) {
+        cl = EasyCL::createForIndexedGpu(config.gpuIndex);
+    } else {
+        cl = EasyCL::createForFirstGpuOtherwiseCpu();
+    }
+    ClBlasInstance blasInstance;
+
+    TuningDatabase *db = TuningDatabase::instance();
+    db->setFilepath(config.tuningFile);
+    ProgramCache::instance()->setDirectory(config.kernelCacheDir);
+    db->setRetune(config.retune != 0);
+    db->setNumTimedRuns(config.numTimedRuns);
+    int entriesBefore = db->size();
+
+    NeuralNet *net = new NeuralNet(cl);
+    WeightsInitializer *weightsInitializer = new OriginalInitializer();
+    net->addLayer(InputLayerMaker::instance()->numPlanes(config.numPlanes)->imageSize(config.imageSize));
+    net->addLayer(NormalizationLayerMaker::instance()->translate(0.0f)->scale(1.0f));
+    if(!NetdefToNet::createNetFromNetdef(net, config.netDef, weightsInitializer)) {
+        delete weightsInitializer;
+        delete net;
+        delete cl;
+        return;
+    }
+    net->setBatchSize(config.batchSize);
+    net->print();
+
+    const int inputNumElements = config.batchSize * net->getInputCubeSize();
+    float *inputData = new float[inputNumElements];
+    for(int i = 0; i < inputNumElements; i++) {
+        inputData[i] = RandomSingleton::uniform() - 0.5f;
+    }
+    int *labels = new int[config.batchSize];
+    for(int i = 0; i < config.batchSize; i++) {
+        labels[i] = 0;
+    }
+
+    // each Auto instance tries at most one candidate per call, so this many
+    // iterations is always enough for every layer to settle on a choice
+    int numIterations = std::max(Forward::getNumImplementations(),
+        std::max(Backward::getNumImplementations(), BackpropWeights::getNumImplementations())) + 1;
+    Timer timer;
+    for(int it = 0; it < numIterations; it++) {
+        net->forward(inputData);
+        net->backwardFromLabels(labels);
+    }
+    cl->finish();
+    timer.timeCheck("tuning done");
+
+    db->save();
+    cout << "tuning file " << config.tuningFile << " now has " << db->size() << " entries (was " << entriesBefore << ")" << endl;
+
+    delete[] labels;
+    delete[] inputData;
+    delete weightsInitializer;
+    delete net;
+    delete cl;
+}
+
+void printUsage(char *argv[], Config config) {
+    cout << "Usage: " << argv[0] << " [key]=[value] [[key]=[value]] ..." << endl;
+    cout << endl;
+    cout << "Possible key=value pairs:" << endl;
+    /* [[[cog
+        cog.outl('// generated using cog:')
+        for (name,type,description,_, is_public_api) in options:
+            cog.outl('cout << "    ' + name.lower() + '=[' + description + '] (" << config.' + name + ' << ")" << endl;')
+    *///]]]
+    // generated using cog:
+    cout << "    gpuindex=[gpu device index; default value is gpu if present, cpu otw.] (" << config.gpuIndex << ")" << endl;
+    cout << "    netdef=[network definition] (" << config.netDef << ")" << endl;
+    cout << "    numplanes=[number of input planes] (" << config.numPlanes << ")" << endl;
+    cout << "    imagesize=[input image size] (" << config.imageSize << ")" << endl;
+    cout << "    batchsize=[batch size] (" << config.batchSize << ")" << endl;
+    cout << "    tuningfile=[file to record chosen convolution kernels to] (" << config.tuningFile << ")" << endl;
+    cout << "    retune=[ignore entries already in the tuning file, and measure again [1|0]] (" << config.retune << ")" << endl;
+    cout << "    numtimedruns=[number of warm timed runs per candidate kernel, median is used] (" << config.numTimedRuns << ")" << endl;
+    cout << "    kernelcachedir=[directory to cache compiled OpenCL programs in; empty means no cache] (" << config.kernelCacheDir << ")" << endl;
+    // [[[end]]]
+}
+
+int main(int argc, char *argv[]) {
+    Config config;
+    if(argc == 2 && (string(argv[1]) == "--help" || string(argv[1]) == "--?" || string(argv[1]) == "-?" || string(argv[1]) == "-h")) {
+        printUsage(argv, config);
+        return 0;
+    }
+    for(int i = 1; i < argc; i++) {
+        vector<string> splitkeyval = split(argv[i], "=");
+        if(splitkeyval.size() != 2) {
+          cout << "Usage: " << argv[0] << " [key]=[value] [[key]=[value]] ..." << endl;
+          exit(1);
+        } else {
+            string key = splitkeyval[0];
+            string value = splitkeyval[1];
+            /* [[[cog
+                cog.outl('// generated using cog:')
+                cog.outl('if(false) {')
+                for (name,type,description,_,_) in options:
+                    cog.outl('} else if(key == "' + name.lower() + '") {')
+                    converter = '';
+                    if type == 'int':
+                        converter = 'atoi';
+                    elif type == 'float':
+                        converter = 'atof';
+                    cog.outl('    config.' + name + ' = ' + converter + '(value);')
+            */// ]]]
+            // generated using cog:
+            if(false) {
+            } else if(key == "gpuindex") {
+                config.gpuIndex = atoi(value);
+            } else if(key == "netdef") {
+                config.netDef = (value);
+            } else if(key == "numplanes") {
+                config.numPlanes = atoi(value);
+            } else if(key == "imagesize") {
+                config.imageSize = atoi(value);
+            } else if(key == "batchsize") {
+                config.batchSize = atoi(value);
+            } else if(key == "tuningfile") {
+                config.tuningFile = (value);
+            } else if(key == "retune") {
+                config.retune = atoi(value);
+            } else if(key == "numtimedruns") {
+                config.numTimedRuns = atoi(value);
+            } else if(key == "kernelcachedir") {
+                config.kernelCacheDir = (value);
+            // [[[end]]]
+            } else {
+                cout << endl;
+                cout << "Error: key '" << key << "' not recognised" << endl;
+                cout << endl;
+                printUsage(argv, config);
+                cout << endl;
+                return -1;
+            }
+        }
+    }
+    try {
+        go(config);
+    } catch(runtime_error e) {
+        cout << "Something went wrong: " << e.what() << endl;
+        return -1;
+    }
+}
+
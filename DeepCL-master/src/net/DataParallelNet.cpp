@@ -0,0 +1,371 @@
+// Copyright Hugh Perkins 2016 hughperkins at gmail
+//
+// This Source Code Form is subject to the terms of the Mozilla Public License,
+// v. 2.0. If a copy of the MPL was not distributed with this file, You can
+// obtain one at http://mozilla.org/MPL/2.0/.
+
+#include <iostream>
+#include <sstream>
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+#include <functional>
+#include <exception>
+
+#include "EasyCL.h"
+#include "net/DataParallelNet.h"
+#include "net/NeuralNet.h"
+#include "net/GradientAllReduce.h"
+#include "net/DeviceProfiler.h"
+#include "layer/Layer.h"
+#include "trainers/Trainer.h"
+#include "trainers/TrainingContext.h"
+#include "util/ThreadPool.h"
+#include "util/StatefulTimer.h"
+#include "util/stringhelper.h"
+
+using namespace std;
+
+#undef VIRTUAL
+#define VIRTUAL
+#undef STATIC
+#define STATIC
+
+DataParallelNet::DataParallelNet(std::vector<NeuralNet *> replicas, std::vector<Trainer *> trainers) :
+        replicas(replicas),
+        trainers(trainers),
+        batchSize(0),
+        numActive(0),
+        output(0),
+        allocatedOutputSize(0),
+        outputStale(true),
+        numImagesTrained(0),
+        numBatchesTrained(0),
+        trainMilliseconds(0) {
+    const int numReplicas = (int)replicas.size();
+    if(numReplicas == 0 || (int)trainers.size() != numReplicas) {
+        throw runtime_error("DataParallelNet: need one trainer per replica, and at least one replica");
+    }
+    for(int i = 1; i < numReplicas; i++) {
+        if(replicas[i]->getNumLayers() != replicas[0]->getNumLayers()
+                || replicas[i]->getInputCubeSize() != replicas[0]->getInputCubeSize()
+                || replicas[i]->getOutputCubeSize() != replicas[0]->getOutputCubeSize()) {
+            throw runtime_error("DataParallelNet: replica " + toString(i) + " has different layers from replica 0");
+        }
+    }
+    // one thread per replica, since every replica must reach the allreduce
+    // barrier before any can leave it
+    threadPool = new ThreadPool(numReplicas);
+    allReduce = new GradientAllReduce(numReplicas);
+    if(numReplicas > 1) {
+        for(int i = 0; i < numReplicas; i++) {
+            replicas[i]->setGradientAllReduce(allReduce, i);
+        }
+    }
+    syncWeights();
+}
+VIRTUAL DataParallelNet::~DataParallelNet() {
+    for(int i = 0; i < (int)replicas.size(); i++) {
+        replicas[i]->setGradientAllReduce(0, 0);
+    }
+    delete allReduce;
+    delete threadPool;
+    delete[] output;
+}
+// devices is either a comma-separated list of gpu indexes, eg "0,1", or
+// "cpu:n", to split the first cpu device into n sub-devices, using device
+// fission.  Caller owns the returned contexts
+STATIC std::vector<EasyCL *> DataParallelNet::createContexts(std::string devices) {
+    vector<EasyCL *> contexts;
+    if(devices.find("cpu:") == 0) {
+        const int numSubDevices = atoi(devices.substr(4));
+        if(numSubDevices < 1) {
+            throw runtime_error("DataParallelNet: need at least one cpu sub-device, in " + devices);
+        }
+        cl_uint numPlatforms = 0;
+        clGetPlatformIDs(0, 0, &numPlatforms);
+        vector<cl_platform_id> platforms(std::max(1u, numPlatforms));
+        clGetPlatformIDs(numPlatforms, &platforms[0], 0);
+        cl_platform_id platform = 0;
+        cl_device_id cpu = 0;
+        for(int i = 0; i < (int)numPlatforms && cpu == 0; i++) {
+            cl_uint numDevices = 0;
+            if(clGetDeviceIDs(platforms[i], CL_DEVICE_TYPE_CPU, 1, &cpu, &numDevices) != CL_SUCCESS || numDevices == 0) {
+                cpu = 0;
+            } else {
+                platform = platforms[i];
+            }
+        }
+        if(cpu == 0) {
+            throw runtime_error("DataParallelNet: no cpu OpenCL device, for " + devices);
+        }
+        cl_uint computeUnits = 1;
+        clGetDeviceInfo(cpu, CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(computeUnits), &computeUnits, 0);
+        const cl_uint unitsPerSubDevice = std::max(1u, computeUnits / numSubDevices);
+        cl_device_partition_property properties[] = {
+            CL_DEVICE_PARTITION_EQUALLY, (cl_device_partition_property)unitsPerSubDevice, 0};
+        // an uneven split gives an extra, smaller, sub-device, which we dont use
+        cl_uint numAvailable = 0;
+        cl_int err = clCreateSubDevices(cpu, properties, 0, 0, &numAvailable);
+        if(err != CL_SUCCESS || (int)numAvailable < numSubDevices) {
+            throw runtime_error("DataParallelNet: cannot split the cpu into " + toString(numSubDevices) + " sub-devices, error " + toString(err));
+        }
+        vector<cl_device_id> subDevices(numAvailable);
+        err = clCreateSubDevices(cpu, properties, numAvailable, &subDevices[0], 0);
+        if(err != CL_SUCCESS) {
+            throw runtime_error("DataParallelNet: clCreateSubDevices failed, error " + toString(err));
+        }
+        for(int i = 0; i < (int)numAvailable; i++) {
+            if(i < numSubDevices) {
+                contexts.push_back(EasyCL::createForPlatformDeviceIds(platform, subDevices[i]));
+            } else {
+                clReleaseDevice(subDevices[i]);
+            }
+        }
+    } else {
+        vector<string> indexes = split(devices, ",");
+        for(int i = 0; i < (int)indexes.size(); i++) {
+            if(trim(indexes[i]) != "") {
+                contexts.push_back(EasyCL::createForIndexedGpu(atoi(trim(indexes[i]))));
+            }
+        }
+    }
+    if(contexts.size() == 0) {
+        throw runtime_error("DataParallelNet: no devices in '" + devices + "'");
+    }
+    return contexts;
+}
+int DataParallelNet::getNumReplicas() {
+    return (int)replicas.size();
+}
+NeuralNet *DataParallelNet::getReplica(int index) {
+    return replicas[index];
+}
+// copy replica 0's weights into all the others, eg after loading weights
+void DataParallelNet::syncWeights() {
+    for(int i = 1; i < (int)replicas.size(); i++) {
+        syncWeights(0, i);
+    }
+}
+BatchResult DataParallelNet::train(Trainer *trainer, TrainingContext *context, float const*input, float const*expectedOutput) {
+    return trainReplicas(trainer, context, input, expectedOutput, 0);
+}
+BatchResult DataParallelNet::trainFromLabels(Trainer *trainer, TrainingContext *context, float const*input, int const*labels) {
+    return trainReplicas(trainer, context, input, 0, labels);
+}
+// since the last resetScalingStats
+std::string DataParallelNet::getScalingSummary() {
+    ostringstream summary;
+    double imagesPerSecond = trainMilliseconds > 0 ? numImagesTrained * 1000.0 / trainMilliseconds : 0;
+    double allReduceMilliseconds = allReduce->getMilliseconds();
+    summary << "data parallel over " << replicas.size() << " devices: " << numImagesTrained << " images in "
+        << numBatchesTrained << " batches, " << imagesPerSecond << " images/s";
+    if(numBatchesTrained > 0 && trainMilliseconds > 0) {
+        summary << ", gradient allreduce " << (allReduceMilliseconds / numBatchesTrained) << "ms/batch ("
+            << (allReduceMilliseconds * 100.0 / trainMilliseconds) << "% of training time)";
+    }
+    summary << endl;
+    return summary.str();
+}
+void DataParallelNet::resetScalingStats() {
+    numImagesTrained = 0;
+    numBatchesTrained = 0;
+    trainMilliseconds = 0;
+    allReduce->resetMilliseconds();
+}
+VIRTUAL int DataParallelNet::getInputCubeSize() const {
+    return replicas[0]->getInputCubeSize();
+}
+VIRTUAL int DataParallelNet::getOutputCubeSize() const {
+    return replicas[0]->getOutputCubeSize();
+}
+VIRTUAL int DataParallelNet::getOutputNumElements() const {
+    return batchSize * getOutputCubeSize();
+}
+VIRTUAL int DataParallelNet::getOutputPlanes() const {
+    return replicas[0]->getOutputPlanes();
+}
+VIRTUAL int DataParallelNet::getOutputSize() const {
+    return replicas[0]->getOutputSize();
+}
+VIRTUAL LossLayerMaker *DataParallelNet::cloneLossLayerMaker() const {
+    return replicas[0]->cloneLossLayerMaker();
+}
+VIRTUAL float DataParallelNet::calcLoss(float const *expectedValues) {
+    checkNoProfiling();
+    vector<float> losses(numActive);
+    const int outputCubeSize = getOutputCubeSize();
+    threadPool->parallelFor(numActive, [&](int i, int threadId) {
+        losses[i] = replicas[i]->calcLoss(expectedValues + (long)replicaOffsets[i] * outputCubeSize);
+    });
+    float loss = 0;
+    for(int i = 0; i < numActive; i++) {
+        loss += losses[i];
+    }
+    return loss;
+}
+VIRTUAL float DataParallelNet::calcLossFromLabels(int const *labels) {
+    checkNoProfiling();
+    vector<float> losses(numActive);
+    threadPool->parallelFor(numActive, [&](int i, int threadId) {
+        losses[i] = replicas[i]->calcLossFromLabels(labels + replicaOffsets[i]);
+    });
+    float loss = 0;
+    for(int i = 0; i < numActive; i++) {
+        loss += losses[i];
+    }
+    return loss;
+}
+// splits the batch as evenly as possible, the first batchSize % numReplicas
+// replicas taking one extra example.  If there are fewer examples than
+// replicas, the idle ones replay the first example, so they and their trainers
+// stay in step, but their gradients are left out of the sum
+VIRTUAL void DataParallelNet::setBatchSize(int batchSize) {
+    const int numReplicas = (int)replicas.size();
+    this->batchSize = batchSize;
+    numActive = std::max(1, std::min(numReplicas, batchSize));
+    replicaOffsets.resize(numReplicas);
+    replicaBatchSizes.resize(numReplicas);
+    int offset = 0;
+    for(int i = 0; i < numReplicas; i++) {
+        if(i < numActive) {
+            replicaOffsets[i] = offset;
+            replicaBatchSizes[i] = batchSize / numActive + (i < batchSize % numActive ? 1 : 0);
+            offset += replicaBatchSizes[i];
+        } else {
+            replicaOffsets[i] = 0;
+            replicaBatchSizes[i] = 1;
+        }
+        replicas[i]->setBatchSize(replicaBatchSizes[i]);
+    }
+    allReduce->setNumContributors(numActive);
+    outputStale = true;
+}
+VIRTUAL void DataParallelNet::setTraining(bool training) {
+    for(int i = 0; i < (int)replicas.size(); i++) {
+        replicas[i]->setTraining(training);
+    }
+}
+VIRTUAL int DataParallelNet::calcNumRight(int const *labels) {
+    checkNoProfiling();
+    vector<int> numRights(numActive);
+    threadPool->parallelFor(numActive, [&](int i, int threadId) {
+        numRights[i] = replicas[i]->calcNumRight(labels + replicaOffsets[i]);
+    });
+    int numRight = 0;
+    for(int i = 0; i < numActive; i++) {
+        numRight += numRights[i];
+    }
+    return numRight;
+}
+VIRTUAL void DataParallelNet::forward(float const*images) {
+    checkNoProfiling();
+    const int inputCubeSize = getInputCubeSize();
+    threadPool->parallelFor((int)replicas.size(), [&](int i, int threadId) {
+        replicas[i]->forward(images + (long)replicaOffsets[i] * inputCubeSize);
+    });
+    outputStale = true;
+}
+// the gradients are allreduced as each replica finishes backward, but no
+// weights change until a trainer runs
+VIRTUAL void DataParallelNet::backwardFromLabels(int const *labels) {
+    runReplicas([&](int i) {
+        replicas[i]->backwardFromLabels(labels + replicaOffsets[i]);
+    });
+}
+VIRTUAL void DataParallelNet::backward(float const *expectedOutput) {
+    const int outputCubeSize = getOutputCubeSize();
+    runReplicas([&](int i) {
+        replicas[i]->backward(expectedOutput + (long)replicaOffsets[i] * outputCubeSize);
+    });
+}
+VIRTUAL float const *DataParallelNet::getOutput() const {
+    if(outputStale) {
+        const int outputCubeSize = getOutputCubeSize();
+        if(allocatedOutputSize < batchSize * outputCubeSize) {
+            delete[] output;
+            allocatedOutputSize = batchSize * outputCubeSize;
+            output = new float[allocatedOutputSize];
+        }
+        for(int i = 0; i < numActive; i++) {
+            memcpy(output + (long)replicaOffsets[i] * outputCubeSize, replicas[i]->getOutput(),
+                sizeof(float) * replicaBatchSizes[i] * outputCubeSize);
+        }
+        outputStale = false;
+    }
+    return output;
+}
+void DataParallelNet::syncWeights(int fromReplica, int toReplica) {
+    for(int layerIdx = 0; layerIdx < replicas[fromReplica]->getNumLayers(); layerIdx++) {
+        Layer *from = replicas[fromReplica]->getLayer(layerIdx);
+        int persistSize = from->getPersistSize();
+        if(persistSize == 0) {
+            continue;
+        }
+        vector<float> persisted(persistSize);
+        from->persistToArray(&persisted[0]);
+        replicas[toReplica]->getLayer(layerIdx)->unpersistFromArray(&persisted[0]);
+    }
+}
+// one trainer step per replica, concurrently.  trainer is the one the
+// learner was given; its learning rate goes to every replica's trainer, so
+// annealing still applies
+BatchResult DataParallelNet::trainReplicas(Trainer *trainer, TrainingContext *context, float const*input, float const*expectedOutput, int const*labels) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for(int i = 0; i < (int)trainers.size(); i++) {
+        if(trainers[i] != trainer) {
+            trainers[i]->setLearningRate(trainer->learningRate);
+        }
+    }
+    const int inputCubeSize = getInputCubeSize();
+    const int outputCubeSize = getOutputCubeSize();
+    vector<BatchResult> results(replicas.size());
+    runReplicas([&](int i) {
+        float const*replicaInput = input + (long)replicaOffsets[i] * inputCubeSize;
+        if(labels != 0) {
+            results[i] = trainers[i]->trainNetFromLabels(replicas[i], context, replicaInput, labels + replicaOffsets[i]);
+        } else {
+            results[i] = trainers[i]->trainNet(replicas[i], context, replicaInput, expectedOutput + (long)replicaOffsets[i] * outputCubeSize);
+        }
+    });
+    outputStale = true;
+    BatchResult result;
+    for(int i = 0; i < numActive; i++) {
+        result.loss += results[i].loss;
+        result.numRight += results[i].numRight;
+    }
+    numImagesTrained += batchSize;
+    numBatchesTrained++;
+    trainMilliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    return result;
+}
+// runs fn(replica) on every replica concurrently, for the phases that reach
+// the gradient allreduce.  A replica that throws aborts the allreduce, so the
+// others don't wait for it forever, and its error, not theirs, is rethrown
+void DataParallelNet::runReplicas(std::function<void(int)> fn) {
+    checkNoProfiling();
+    try {
+        threadPool->parallelFor((int)replicas.size(), [&](int i, int threadId) {
+            try {
+                fn(i);
+            } catch(...) {
+                allReduce->abort(std::current_exception());
+                throw;
+            }
+        });
+    } catch(...) {
+        std::exception_ptr error = allReduce->reset();
+        if(error) {
+            std::rethrow_exception(error);
+        }
+        throw;
+    }
+}
+// StatefulTimer and DeviceProfiler are process-wide, with no locking, and the
+// profiler only watches one device's queue, so the replicas, each on a thread
+// of its own, need them both off
+void DataParallelNet::checkNoProfiling() {
+    if(replicas.size() > 1 && (StatefulTimer::enabled || DeviceProfiler::enabled)) {
+        throw runtime_error("DataParallelNet: StatefulTimer and DeviceProfiler are not thread-safe, so must be disabled to run several replicas");
+    }
+}
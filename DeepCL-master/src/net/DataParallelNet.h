@@ -0,0 +1,107 @@
+// Copyright Hugh Perkins 2016 hughperkins at gmail
+//
+// This Source Code Form is subject to the terms of the Mozilla Public License,
+// v. 2.0. If a copy of the MPL was not distributed with this file, You can
+// obtain one at http://mozilla.org/MPL/2.0/.
+
+#pragma once
+
+#include <vector>
+#include <string>
+#include <functional>
+
+#include "net/Trainable.h"
+#include "trainers/Trainer.h"
+
+#include "DeepCLDllExport.h"
+
+class EasyCL;
+class NeuralNet;
+class GradientAllReduce;
+class ThreadPool;
+class TrainingContext;
+
+#define VIRTUAL virtual
+#define STATIC static
+
+// Data-parallel training over several devices: one replica of the same
+// network per device, each with its own trainer.  Pass it to NetLearner or
+// NetLearnerOnDemandv2 in place of the NeuralNet.
+//
+// Each batch is split across the replicas, which run forward and backward
+// concurrently, one thread each.  At the end of backward, GradientAllReduce
+// sums their gradients, so every trainer then applies the update for the whole
+// batch, and the replicas stay in step.  Batches with fewer examples than
+// replicas are trained on the first replicas only; the others replay one
+// example, to keep their trainers in step, but add nothing to the gradient.
+//
+// The replicas must have the same layers; construction copies replica 0's
+// weights into the others.  Replica 0 is the one to persist, or load weights
+// into, followed by syncWeights.
+//
+// Devices can be different gpus, or sub-devices of one cpu, see
+// createContexts.
+//
+// StatefulTimer and DeviceProfiler must be disabled while there is more than
+// one replica; the replicas throw otherwise.
+class DeepCL_EXPORT DataParallelNet : public Trainable {
+    #ifdef _WIN32
+    #pragma warning(disable: 4251)
+    #endif
+    std::vector<NeuralNet *> replicas; // NOT delete
+    std::vector<Trainer *> trainers; // NOT delete
+    std::vector<int> replicaOffsets;
+    std::vector<int> replicaBatchSizes;
+    #ifdef _WIN32
+    #pragma warning(default: 4251)
+    #endif
+    GradientAllReduce *allReduce;
+    ThreadPool *threadPool;
+    int batchSize;
+    int numActive;
+    mutable float *output; // gathered from the replicas by getOutput
+    mutable int allocatedOutputSize;
+    mutable bool outputStale;
+    long long numImagesTrained;
+    int numBatchesTrained;
+    double trainMilliseconds;
+
+public:
+    // [[[cog
+    // import cog_addheaders
+    // cog_addheaders.add()
+    // ]]]
+    // generated, using cog:
+    DataParallelNet(std::vector<NeuralNet *> replicas, std::vector<Trainer *> trainers);
+    VIRTUAL ~DataParallelNet();
+    STATIC std::vector<EasyCL *> createContexts(std::string devices);
+    int getNumReplicas();
+    NeuralNet *getReplica(int index);
+    void syncWeights();
+    BatchResult train(Trainer *trainer, TrainingContext *context, float const*input, float const*expectedOutput);
+    BatchResult trainFromLabels(Trainer *trainer, TrainingContext *context, float const*input, int const*labels);
+    std::string getScalingSummary();
+    void resetScalingStats();
+    VIRTUAL int getInputCubeSize() const;
+    VIRTUAL int getOutputCubeSize() const;
+    VIRTUAL int getOutputNumElements() const;
+    VIRTUAL int getOutputPlanes() const;
+    VIRTUAL int getOutputSize() const;
+    VIRTUAL LossLayerMaker *cloneLossLayerMaker() const;
+    VIRTUAL float calcLoss(float const *expectedValues);
+    VIRTUAL float calcLossFromLabels(int const *labels);
+    VIRTUAL void setBatchSize(int batchSize);
+    VIRTUAL void setTraining(bool training);
+    VIRTUAL int calcNumRight(int const *labels);
+    VIRTUAL void forward(float const*images);
+    VIRTUAL void backwardFromLabels(int const *labels);
+    VIRTUAL void backward(float const *expectedOutput);
+    VIRTUAL float const *getOutput() const;
+    void syncWeights(int fromReplica, int toReplica);
+    BatchResult trainReplicas(Trainer *trainer, TrainingContext *context, float const*input, float const*expectedOutput, int const*labels);
+    void runReplicas(std::function<void(int)> fn);
+    void checkNoProfiling();
+
+    // [[[end]]]
+};
+
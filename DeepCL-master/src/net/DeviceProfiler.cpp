@@ -0,0 +1,311 @@
+// Copyright Hugh Perkins 2016 hughperkins at gmail
+//
+// This Source Code Form is subject to the terms of the Mozilla Public License,
+// v. 2.0. If a copy of the MPL was not distributed with this file, You can
+// obtain one at http://mozilla.org/MPL/2.0/.
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <map>
+#include <algorithm>
+#include <cstdio>
+#include <stdexcept>
+
+#include "layer/Layer.h"
+#include "util/FileHelper.h"
+#include "util/stringhelper.h"
+#include "net/DeviceProfiler.h"
+
+using namespace std;
+
+#undef STATIC
+#undef VIRTUAL
+#define STATIC
+#define VIRTUAL
+
+bool DeviceProfiler::enabled = false;
+
+namespace {
+    // pending regions are collected once there are this many, so we dont hold
+    // on to an unbounded number of events
+    const int maxPending = 4096;
+
+    // forward, backward, update, then anything else, alphabetically
+    std::string phaseSortKey(std::string phase) {
+        if(phase == "forward") {
+            return "0";
+        } else if(phase == "backward") {
+            return "1";
+        } else if(phase == "update") {
+            return "2";
+        }
+        return "3" + phase;
+    }
+}
+
+PUBLIC STATIC DeviceProfiler *DeviceProfiler::instance() {
+    static DeviceProfiler profiler;
+    return &profiler;
+}
+PUBLIC DeviceProfiler::DeviceProfiler() :
+        cl(0),
+        inRegion(false),
+        numUnavailable(0) {
+}
+PUBLIC DeviceProfiler::~DeviceProfiler() {
+    releasePending();
+}
+// turns on profiling for cl's queue, and starts recording.  Call after the
+// net is built, and before training
+PUBLIC STATIC void DeviceProfiler::enable(EasyCL *cl) {
+    instance()->enableProfiling(cl);
+    enabled = true;
+}
+// stops recording, and forgets cl, eg before deleting it.  The queue keeps
+// profiling enabled
+PUBLIC STATIC void DeviceProfiler::disable() {
+    reset();
+    instance()->cl = 0;
+    enabled = false;
+}
+// starts a region, tagged with layer index, the layer's asString(), and phase,
+// eg "forward", "backward" or "update".  Ends any region still open
+PUBLIC STATIC void DeviceProfiler::begin(int layerIndex, Layer *layer, std::string phase) {
+    if(!enabled) {
+        return;
+    }
+    begin(layerIndex, layer->asString(), phase);
+}
+PUBLIC STATIC void DeviceProfiler::begin(int layerIndex, std::string layerName, std::string phase) {
+    if(!enabled) {
+        return;
+    }
+    DeviceProfiler *profiler = instance();
+    if(profiler->inRegion) {
+        end();
+    }
+    profiler->current.layerIndex = layerIndex;
+    profiler->current.layerName = layerName;
+    profiler->current.phase = phase;
+    profiler->current.detail = "";
+    profiler->current.beginEvent = profiler->enqueueMarker();
+    profiler->current.endEvent = 0;
+    profiler->inRegion = true;
+}
+// adds detail to the open region, eg which kernel variant ran
+PUBLIC STATIC void DeviceProfiler::annotate(std::string detail) {
+    if(!enabled || !instance()->inRegion) {
+        return;
+    }
+    std::string &regionDetail = instance()->current.detail;
+    regionDetail += (regionDetail == "" ? "" : ", ") + detail;
+}
+PUBLIC STATIC void DeviceProfiler::end() {
+    if(!enabled) {
+        return;
+    }
+    DeviceProfiler *profiler = instance();
+    if(!profiler->inRegion) {
+        return;
+    }
+    profiler->current.endEvent = profiler->enqueueMarker();
+    profiler->pending.push_back(profiler->current);
+    profiler->inRegion = false;
+    if((int)profiler->pending.size() >= maxPending) {
+        profiler->collect();
+    }
+}
+// forgets everything recorded so far, eg at the start of each epoch
+PUBLIC STATIC void DeviceProfiler::reset() {
+    DeviceProfiler *profiler = instance();
+    profiler->releasePending();
+    profiler->records.clear();
+    profiler->numUnavailable = 0;
+}
+// waits for any regions still running on the device
+PUBLIC std::vector<DeviceProfiler::Record> DeviceProfiler::getRecords() {
+    collect();
+    return records;
+}
+// one row per layer and phase, with total and average device time, and
+// which kernels ran
+PUBLIC std::string DeviceProfiler::getSummary() {
+    collect();
+    struct Totals {
+        int layerIndex;
+        std::string phase;
+        std::string layerName;
+        std::vector<std::string> details;
+        int count;
+        double milliseconds;
+    };
+    map<string, Totals> totalsByKey;
+    map<string, double> phaseMilliseconds;
+    double totalMilliseconds = 0;
+    for(int i = 0; i < (int)records.size(); i++) {
+        const Record &record = records[i];
+        char key[32];
+        sprintf(key, "%08d", record.layerIndex);
+        Totals &totals = totalsByKey[string(key) + phaseSortKey(record.phase)];
+        if(totals.count == 0) {
+            totals.layerIndex = record.layerIndex;
+            totals.phase = record.phase;
+            totals.layerName = record.layerName;
+        }
+        if(record.detail != "" && find(totals.details.begin(), totals.details.end(), record.detail) == totals.details.end()) {
+            totals.details.push_back(record.detail);
+        }
+        double milliseconds = (record.end - record.start) / 1000000.0;
+        totals.count++;
+        totals.milliseconds += milliseconds;
+        phaseMilliseconds[record.phase] += milliseconds;
+        totalMilliseconds += milliseconds;
+    }
+    ostringstream summary;
+    summary << "DeviceProfiler: " << records.size() << " regions, " << fixed << setprecision(3)
+        << totalMilliseconds << "ms on the device" << endl;
+    if(numUnavailable > 0) {
+        summary << "DeviceProfiler: " << numUnavailable << " regions had no profiling info, and are not counted" << endl;
+    }
+    summary << " layer  phase         calls    total ms     avg ms  % time  layer, kernels" << endl;
+    for(map<string, Totals>::iterator it = totalsByKey.begin(); it != totalsByKey.end(); it++) {
+        const Totals &totals = it->second;
+        summary << setw(6) << totals.layerIndex << "  " << left << setw(12) << totals.phase << right
+            << setw(7) << totals.count
+            << setw(12) << totals.milliseconds
+            << setw(11) << totals.milliseconds / totals.count
+            << setw(7) << setprecision(1) << (totalMilliseconds > 0 ? totals.milliseconds * 100 / totalMilliseconds : 0) << "%"
+            << setprecision(3) << "  " << totals.layerName;
+        for(int i = 0; i < (int)totals.details.size(); i++) {
+            summary << (i == 0 ? "  [" : "; ") << totals.details[i] << (i + 1 == (int)totals.details.size() ? "]" : "");
+        }
+        summary << endl;
+    }
+    summary << "by phase:";
+    for(map<string, double>::iterator it = phaseMilliseconds.begin(); it != phaseMilliseconds.end(); it++) {
+        summary << " " << it->first << "=" << it->second << "ms";
+    }
+    summary << endl;
+    return summary.str();
+}
+// writes the records as chrome://tracing / perfetto json.  Device time goes
+// on one track, and the wait from enqueue to device start on another, with
+// times in microseconds from the first enqueue
+PUBLIC void DeviceProfiler::writeChromeTrace(std::string filepath) {
+    collect();
+    ofstream out(FileHelper::localizePath(filepath).c_str());
+    if(!out) {
+        throw runtime_error("DeviceProfiler: cannot write " + filepath);
+    }
+    cl_ulong base = 0;
+    for(int i = 0; i < (int)records.size(); i++) {
+        if(i == 0 || records[i].queued < base) {
+            base = records[i].queued;
+        }
+    }
+    out << fixed << setprecision(3);
+    out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [" << endl;
+    out << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": 1, \"args\": {\"name\": \"device\"}}," << endl;
+    out << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": 2, \"args\": {\"name\": \"queued, waiting for device\"}}";
+    for(int i = 0; i < (int)records.size(); i++) {
+        const Record &record = records[i];
+        string name = escapeJson("layer " + toString(record.layerIndex) + " " + record.phase);
+        string args = "{\"layer\": " + toString(record.layerIndex)
+            + ", \"layerName\": \"" + escapeJson(record.layerName) + "\""
+            + ", \"kernels\": \"" + escapeJson(record.detail) + "\""
+            + ", \"submitUs\": " + toString((record.submit - record.queued) / 1000.0) + "}";
+        out << "," << endl << "{\"name\": \"" << name << "\", \"cat\": \"" << escapeJson(record.phase)
+            << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": 1, \"ts\": " << (record.start - base) / 1000.0
+            << ", \"dur\": " << (record.end - record.start) / 1000.0 << ", \"args\": " << args << "}";
+        if(record.start > record.queued) {
+            out << "," << endl << "{\"name\": \"" << name << "\", \"cat\": \"queue\", \"ph\": \"X\", \"pid\": 1, \"tid\": 2, \"ts\": "
+                << (record.queued - base) / 1000.0 << ", \"dur\": " << (record.start - record.queued) / 1000.0 << "}";
+        }
+    }
+    out << endl << "]}" << endl;
+    if(!out) {
+        throw runtime_error("DeviceProfiler: failed writing " + filepath);
+    }
+}
+PUBLIC STATIC std::string DeviceProfiler::escapeJson(std::string value) {
+    string escaped = "";
+    for(int i = 0; i < (int)value.size(); i++) {
+        char c = value[i];
+        if(c == '"' || c == '\\') {
+            escaped += '\\';
+            escaped += c;
+        } else if((unsigned char)c < 0x20) {
+            char hex[8];
+            sprintf(hex, "\\u%04x", (unsigned char)c);
+            escaped += hex;
+        } else {
+            escaped += c;
+        }
+    }
+    return escaped;
+}
+// EasyCL creates its queue without profiling, so swap it for one with
+PRIVATE void DeviceProfiler::enableProfiling(EasyCL *cl) {
+    if(this->cl == cl) {
+        return;
+    }
+    reset();
+    cl->finish();
+    cl_int err;
+    cl_command_queue queue = clCreateCommandQueue(*cl->context, cl->device, CL_QUEUE_PROFILING_ENABLE, &err);
+    if(err != CL_SUCCESS) {
+        throw runtime_error("DeviceProfiler: cannot create a profiling queue, error " + toString(err));
+    }
+    clReleaseCommandQueue(*cl->queue);
+    *cl->queue = queue;
+    this->cl = cl;
+}
+PRIVATE cl_event DeviceProfiler::enqueueMarker() {
+    cl_event event = 0;
+    cl_int err = clEnqueueMarker(*cl->queue, &event);
+    if(err != CL_SUCCESS) {
+        throw runtime_error("DeviceProfiler: cannot enqueue marker, error " + toString(err));
+    }
+    return event;
+}
+// waits for the pending regions to finish on the device, and turns them into
+// records
+PRIVATE void DeviceProfiler::collect() {
+    if(pending.size() == 0) {
+        return;
+    }
+    cl_event lastEvent = pending[pending.size() - 1].endEvent;
+    // in order queue, so once the last marker is done, they all are
+    clWaitForEvents(1, &lastEvent);
+    for(int i = 0; i < (int)pending.size(); i++) {
+        const Region &region = pending[i];
+        Record record;
+        record.layerIndex = region.layerIndex;
+        record.layerName = region.layerName;
+        record.phase = region.phase;
+        record.detail = region.detail;
+        cl_int err = clGetEventProfilingInfo(region.beginEvent, CL_PROFILING_COMMAND_QUEUED, sizeof(cl_ulong), &record.queued, 0);
+        err |= clGetEventProfilingInfo(region.beginEvent, CL_PROFILING_COMMAND_SUBMIT, sizeof(cl_ulong), &record.submit, 0);
+        err |= clGetEventProfilingInfo(region.beginEvent, CL_PROFILING_COMMAND_END, sizeof(cl_ulong), &record.start, 0);
+        err |= clGetEventProfilingInfo(region.endEvent, CL_PROFILING_COMMAND_END, sizeof(cl_ulong), &record.end, 0);
+        if(err != CL_SUCCESS || record.end < record.start) {
+            numUnavailable++;
+        } else {
+            records.push_back(record);
+        }
+    }
+    releasePending();
+}
+PRIVATE void DeviceProfiler::releasePending() {
+    for(int i = 0; i < (int)pending.size(); i++) {
+        clReleaseEvent(pending[i].beginEvent);
+        clReleaseEvent(pending[i].endEvent);
+    }
+    pending.clear();
+    if(inRegion) {
+        clReleaseEvent(current.beginEvent);
+        inRegion = false;
+    }
+}
@@ -0,0 +1,110 @@
+// Copyright Hugh Perkins 2016 hughperkins at gmail
+//
+// This Source Code Form is subject to the terms of the Mozilla Public License,
+// v. 2.0. If a copy of the MPL was not distributed with this file, You can
+// obtain one at http://mozilla.org/MPL/2.0/.
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "EasyCL.h"
+
+#include "DeepCLDllExport.h"
+
+class Layer;
+
+#define VIRTUAL virtual
+#define STATIC static
+
+// Device-side timings, per layer and phase, from OpenCL event profiling.
+//
+// Unlike StatefulTimer, which times the host, this measures when the device
+// actually ran each region's work, so queue latency and host/device overlap
+// dont get counted against the layer.  enable() swaps the EasyCL queue for
+// one with CL_QUEUE_PROFILING_ENABLE.  NeuralNet and the trainers then wrap
+// each layer's forward, backward and weight update in begin()/end(), which
+// enqueue a marker event either side.  On our in-order queue, a marker
+// completes once everything queued before it has, so a region ran on the
+// device from its begin marker's end to its end marker's end.  Markers also
+// catch the clBLAS launches, which dont go through EasyCL.
+//
+// ForwardAuto, BackwardAuto and BackpropWeightsAuto annotate() the region
+// with the kernel index they ran, so the summary shows which variant each
+// layer used.
+//
+// All the static methods do nothing unless enabled.  Not thread-safe; the
+// net should only be driven from one thread, as for StatefulTimer.  So
+// DataParallelNet, which runs a thread per replica, refuses to run while it
+// is enabled.
+class DeepCL_EXPORT DeviceProfiler {
+public:
+    STATIC bool enabled;
+
+    struct Record {
+        int layerIndex;
+        std::string layerName;
+        std::string phase;
+        std::string detail;
+        cl_ulong queued; // nanoseconds, device clock
+        cl_ulong submit;
+        cl_ulong start;
+        cl_ulong end;
+    };
+
+private:
+    struct Region {
+        int layerIndex;
+        std::string layerName;
+        std::string phase;
+        std::string detail;
+        cl_event beginEvent;
+        cl_event endEvent;
+    };
+
+    EasyCL *cl;
+    bool inRegion;
+    Region current;
+    int numUnavailable; // regions whose markers had no profiling info
+
+    #ifdef _WIN32
+    #pragma warning(disable: 4251)
+    #endif
+    std::vector<Region> pending;
+    std::vector<Record> records;
+    #ifdef _WIN32
+    #pragma warning(default: 4251)
+    #endif
+
+    // [[[cog
+    // import cog_addheaders
+    // cog_addheaders.addv2()
+    // ]]]
+    // generated, using cog:
+
+    public:
+    STATIC DeviceProfiler *instance();
+    DeviceProfiler();
+    ~DeviceProfiler();
+    STATIC void enable(EasyCL *cl);
+    STATIC void disable();
+    STATIC void begin(int layerIndex, Layer *layer, std::string phase);
+    STATIC void begin(int layerIndex, std::string layerName, std::string phase);
+    STATIC void annotate(std::string detail);
+    STATIC void end();
+    STATIC void reset();
+    std::vector<Record> getRecords();
+    std::string getSummary();
+    void writeChromeTrace(std::string filepath);
+    STATIC std::string escapeJson(std::string value);
+
+    private:
+    void enableProfiling(EasyCL *cl);
+    cl_event enqueueMarker();
+    void collect();
+    void releasePending();
+
+    // [[[end]]]
+};
+
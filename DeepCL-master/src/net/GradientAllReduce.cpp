@@ -0,0 +1,159 @@
+// Copyright Hugh Perkins 2016 hughperkins at gmail
+//
+// This Source Code Form is subject to the terms of the Mozilla Public License,
+// v. 2.0. If a copy of the MPL was not distributed with this file, You can
+// obtain one at http://mozilla.org/MPL/2.0/.
+
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+
+#include "EasyCL.h"
+#include "net/GradientAllReduce.h"
+#include "net/NeuralNet.h"
+#include "layer/Layer.h"
+#include "util/stringhelper.h"
+
+using namespace std;
+
+#undef STATIC
+#define STATIC
+#undef VIRTUAL
+#define VIRTUAL
+
+PUBLIC GradientAllReduce::GradientAllReduce(int numReplicas) :
+        numReplicas(numReplicas),
+        numContributors(numReplicas),
+        replicaGradients(numReplicas),
+        replicaSizes(numReplicas),
+        numArrived(0),
+        generation(0),
+        aborted(false),
+        milliseconds(0) {
+}
+PUBLIC int GradientAllReduce::getNumReplicas() {
+    return numReplicas;
+}
+// gradients of replicas [0, numContributors) go into the following sums; set
+// it between batches only
+PUBLIC void GradientAllReduce::setNumContributors(int numContributors) {
+    if(numContributors < 1 || numContributors > numReplicas) {
+        throw runtime_error("GradientAllReduce: numContributors " + toString(numContributors) + " should be in [1, " + toString(numReplicas) + "]");
+    }
+    this->numContributors = numContributors;
+}
+PUBLIC int GradientAllReduce::getNumContributors() {
+    return numContributors;
+}
+PUBLIC void GradientAllReduce::allReduce(NeuralNet *net, int replica) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    vector<CLWrapper *> wrappers;
+    getGradientWrappers(net, &wrappers);
+    const int numBuffers = (int)wrappers.size();
+    for(int b = 0; b < numBuffers; b++) {
+        wrappers[b]->copyToHost();
+    }
+    std::unique_lock<std::mutex> lock(mutex);
+    replicaGradients[replica].resize(numBuffers);
+    replicaSizes[replica].resize(numBuffers);
+    if((int)sums.size() < numBuffers) {
+        sums.resize(numBuffers);
+    }
+    for(int b = 0; b < numBuffers; b++) {
+        replicaGradients[replica][b] = (float *)wrappers[b]->getHostArray();
+        replicaSizes[replica][b] = wrappers[b]->size();
+        if((int)sums[b].size() < wrappers[b]->size()) {
+            sums[b].resize(wrappers[b]->size());
+        }
+    }
+    barrier(lock);
+    lock.unlock();
+
+    // our slice of each buffer, summed across all contributors
+    for(int b = 0; b < numBuffers; b++) {
+        const int size = replicaSizes[replica][b];
+        const int begin = (int)((long long)size * replica / numReplicas);
+        const int end = (int)((long long)size * (replica + 1) / numReplicas);
+        float *sum = &sums[b][0];
+        memcpy(sum + begin, replicaGradients[0][b] + begin, sizeof(float) * (end - begin));
+        for(int other = 1; other < numContributors; other++) {
+            float const *gradients = replicaGradients[other][b];
+            for(int i = begin; i < end; i++) {
+                sum[i] += gradients[i];
+            }
+        }
+    }
+
+    lock.lock();
+    barrier(lock);
+    lock.unlock();
+    for(int b = 0; b < numBuffers; b++) {
+        memcpy(replicaGradients[replica][b], &sums[b][0], sizeof(float) * replicaSizes[replica][b]);
+        wrappers[b]->copyToDevice();
+    }
+    if(replica == 0) {
+        milliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+}
+// wakes the replicas waiting in allReduce, which then throw; the first error
+// passed in is the one reset returns
+PUBLIC void GradientAllReduce::abort(std::exception_ptr error) {
+    std::unique_lock<std::mutex> lock(mutex);
+    if(!aborted) {
+        aborted = true;
+        abortError = error;
+    }
+    barrierReleased.notify_all();
+}
+// call only when no replica is inside allReduce
+PUBLIC std::exception_ptr GradientAllReduce::reset() {
+    std::unique_lock<std::mutex> lock(mutex);
+    std::exception_ptr error = abortError;
+    abortError = std::exception_ptr();
+    aborted = false;
+    numArrived = 0;
+    generation++;
+    return error;
+}
+PUBLIC double GradientAllReduce::getMilliseconds() {
+    return milliseconds;
+}
+PUBLIC void GradientAllReduce::resetMilliseconds() {
+    milliseconds = 0;
+}
+// the gradients our trainers use: layers from the top down, as far as
+// backprop goes, that have trainer state
+PUBLIC STATIC void GradientAllReduce::getGradientWrappers(NeuralNet *net, std::vector<CLWrapper *> *wrappers) {
+    wrappers->clear();
+    for(int layerIdx = net->getNumLayers() - 2; layerIdx > 0; layerIdx--) {
+        Layer *layer = net->getLayer(layerIdx);
+        if(!layer->needsBackProp()) {
+            break;
+        }
+        if(layer->needsTrainerState()) {
+            wrappers->push_back(layer->getGradWeightsWrapper());
+            if(layer->biased()) {
+                wrappers->push_back(layer->getGradBiasWrapper());
+            }
+        }
+    }
+}
+PRIVATE void GradientAllReduce::barrier(std::unique_lock<std::mutex> &lock) {
+    if(aborted) {
+        throw runtime_error("GradientAllReduce: aborted, another replica failed");
+    }
+    long long thisGeneration = generation;
+    numArrived++;
+    if(numArrived == numReplicas) {
+        numArrived = 0;
+        generation++;
+        barrierReleased.notify_all();
+        return;
+    }
+    while(generation == thisGeneration && !aborted) {
+        barrierReleased.wait(lock);
+    }
+    if(generation == thisGeneration) {
+        throw runtime_error("GradientAllReduce: aborted, another replica failed");
+    }
+}
@@ -0,0 +1,88 @@
+// Copyright Hugh Perkins 2016 hughperkins at gmail
+//
+// This Source Code Form is subject to the terms of the Mozilla Public License,
+// v. 2.0. If a copy of the MPL was not distributed with this file, You can
+// obtain one at http://mozilla.org/MPL/2.0/.
+
+#pragma once
+
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+
+#include "DeepCLDllExport.h"
+
+class NeuralNet;
+class CLWrapper;
+
+#define VIRTUAL virtual
+#define STATIC static
+
+// Sums the weight and bias gradients of several replicas of one network, each
+// on its own device, so each replica ends up holding the gradient of the whole
+// batch.  Used by DataParallelNet.
+//
+// Each replica's thread calls allReduce from the end of NeuralNet::backward,
+// ie after the gradients are computed and before its trainer updates the
+// weights.  The calls meet at a barrier, so every participating replica must
+// call it exactly once per batch, concurrently.  Gradients go through the
+// host: each replica copies its own to the host, then sums one slice of every
+// buffer across all replicas, then copies the sums back to its device, so the
+// host work is split evenly across the replica threads.
+//
+// DeepCL gradients are sums over the batch, not means, so the sum over
+// replicas is exactly the gradient the full batch would give on one device.
+// Replicas past numContributors, which had no examples this batch, still call
+// allReduce and receive the sum, but add nothing to it.
+//
+// A replica that fails before it reaches allReduce calls abort with its
+// error: the replicas already waiting, and any that arrive later, throw
+// instead of waiting for it.  Once every replica thread has returned, reset
+// hands back that first error and rearms the barrier for the next batch.
+class DeepCL_EXPORT GradientAllReduce {
+private:
+    int numReplicas;
+    int numContributors;
+
+    #ifdef _WIN32
+    #pragma warning(disable: 4251)
+    #endif
+    std::mutex mutex;
+    std::condition_variable barrierReleased;
+    std::vector< std::vector<float *> > replicaGradients; // [replica][buffer], host arrays
+    std::vector< std::vector<int> > replicaSizes;
+    std::vector< std::vector<float> > sums; // [buffer]
+    std::exception_ptr abortError;
+    #ifdef _WIN32
+    #pragma warning(default: 4251)
+    #endif
+    int numArrived;
+    long long generation;
+    bool aborted;
+    double milliseconds; // time replica 0 spent in allReduce, including waiting
+
+    // [[[cog
+    // import cog_addheaders
+    // cog_addheaders.addv2()
+    // ]]]
+    // generated, using cog:
+
+    public:
+    GradientAllReduce(int numReplicas);
+    int getNumReplicas();
+    void setNumContributors(int numContributors);
+    int getNumContributors();
+    void allReduce(NeuralNet *net, int replica);
+    void abort(std::exception_ptr error);
+    std::exception_ptr reset();
+    double getMilliseconds();
+    void resetMilliseconds();
+    STATIC void getGradientWrappers(NeuralNet *net, std::vector<CLWrapper *> *wrappers);
+
+    private:
+    void barrier(std::unique_lock<std::mutex> &lock);
+
+    // [[[end]]]
+};
+
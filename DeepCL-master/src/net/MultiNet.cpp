@@ -11,6 +11,8 @@
 #include "input/InputLayer.h"
 #include "layer/LayerMaker.h"
 #include "input/InputLayerMaker.h"
+#include "clmath/EnsembleSoftMax.h"
+#include "EasyCL.h"
 
 #include "net/MultiNet.h"
 
@@ -23,8 +25,11 @@ using namespace std;
 
 MultiNet::MultiNet(int numNets, NeuralNet *model) :
         output(0),
+        outputWrapper(0),
+        ensembleSoftMax(0),
         batchSize(0),
         allocatedSize(0),
+        training(true),
         proxyInputLayer(0),
         lossLayer(0) {
 //    trainables.push_back(model);
@@ -44,6 +49,12 @@ VIRTUAL MultiNet::~MultiNet() {
     if(lossLayer != 0) {
         delete lossLayer;
     }
+    if(ensembleSoftMax != 0) {
+        delete ensembleSoftMax;
+    }
+    if(outputWrapper != 0) {
+        delete outputWrapper;
+    }
     if(output != 0) {
         delete[] output;
     }
@@ -113,6 +124,10 @@ VIRTUAL void MultiNet::setBatchSize(int batchSize) {
         this->batchSize = batchSize;
         return;
     }
+    if(outputWrapper != 0) {
+        delete outputWrapper;
+        outputWrapper = 0;
+    }
     if(output != 0) {
         delete[] output;
     }
@@ -121,6 +136,7 @@ VIRTUAL void MultiNet::setBatchSize(int batchSize) {
     output = new float[ trainables[0]->getOutputNumElements() ];
 }
 VIRTUAL void MultiNet::setTraining(bool training) {
+    this->training = training;
     for(vector< Trainable * >::iterator it = trainables.begin(); it != trainables.end(); it++) {
         (*it)->setTraining(training);
     }
@@ -161,7 +177,66 @@ void MultiNet::forwardToOurselves() {
     memcpy(dynamic_cast< SoftMaxLayer * >(lossLayer)->output, output, sizeof(float) * lossLayer->getOutputNumElements());
 //    proxyInputLayer->in(output);
 }
+// true if every member is a NeuralNet on the same EasyCL, ending in a
+// SoftMaxLayer whose input is already on the gpu
+bool MultiNet::canEnsembleOnGpu() {
+    SoftMaxLayer *softMaxLayer = dynamic_cast< SoftMaxLayer *>(lossLayer);
+    if(softMaxLayer == 0) {
+        return false;
+    }
+    if(!softMaxLayer->perPlane && softMaxLayer->imageSize != 1) {
+        return false;
+    }
+    EasyCL *cl = 0;
+    for(vector< Trainable * >::iterator it = trainables.begin(); it != trainables.end(); it++) {
+        NeuralNet *net = dynamic_cast< NeuralNet *>(*it);
+        if(net == 0 || net->getNumLayers() < 2) {
+            return false;
+        }
+        if(dynamic_cast< SoftMaxLayer *>(net->getLastLayer()) == 0) {
+            return false;
+        }
+        if(!net->getLayer(net->getNumLayers() - 2)->hasOutputWrapper()) {
+            return false;
+        }
+        if(cl != 0 && net->getCl() != cl) {
+            return false;
+        }
+        cl = net->getCl();
+    }
+    return true;
+}
+// the members still run one after another, since they share one in-order
+// queue.  What we save is each member's softmax, readback and sync: the only
+// host transfer is the final average
+void MultiNet::forwardEnsembleOnGpu(float const*images) {
+    EasyCL *cl = dynamic_cast< NeuralNet *>(trainables[0])->getCl();
+    if(ensembleSoftMax == 0) {
+        ensembleSoftMax = new EnsembleSoftMax(cl);
+    }
+    if(outputWrapper == 0) {
+        outputWrapper = cl->wrap(trainables[0]->getOutputNumElements(), output);
+        outputWrapper->createOnDevice();
+    }
+    SoftMaxLayer *softMaxLayer = dynamic_cast< SoftMaxLayer *>(lossLayer);
+    const int segmentSize = softMaxLayer->perPlane ? softMaxLayer->imageSizeSquared : softMaxLayer->numPlanes;
+    const int numSegments = softMaxLayer->perPlane ? batchSize * softMaxLayer->numPlanes : batchSize;
+    const int numChildren = (int)trainables.size();
+    const float weight = 1.0f / numChildren;
+    for(int i = 0; i < numChildren; i++) {
+        NeuralNet *net = dynamic_cast< NeuralNet *>(trainables[i]);
+        net->forwardLayers(images, net->getNumLayers() - 1);
+        CLWrapper *logitsWrapper = net->getLayer(net->getNumLayers() - 2)->getOutputWrapper();
+        ensembleSoftMax->accumulate(numSegments, segmentSize, weight, i == 0, logitsWrapper, outputWrapper);
+    }
+    outputWrapper->copyToHost();
+    memcpy(softMaxLayer->output, output, sizeof(float) * lossLayer->getOutputNumElements());
+}
 VIRTUAL void MultiNet::forward(float const*images) {
+    if(!training && canEnsembleOnGpu()) {
+        forwardEnsembleOnGpu(images);
+        return;
+    }
     for(vector< Trainable * >::iterator it = trainables.begin(); it != trainables.end(); it++) {
         (*it)->forward(images);
     }
@@ -18,15 +18,27 @@
 #include "DeepCLDllExport.h"
 
 class LossLayer;
+class CLWrapper;
+class EnsembleSoftMax;
 
 class NeuralNet;
 
 // This handles grouping several NeuralNets into one single MultiNet
+//
+// When every member is a NeuralNet ending in a SoftMaxLayer, and we are not
+// training, forward() queues all the members up to their penultimate layer,
+// then softmaxes and averages their outputs on the gpu, and reads back just
+// the average.  The members' own SoftMaxLayers are not run in that case, so
+// their getOutput() is stale.  Training runs every member's SoftMaxLayer,
+// since backward starts from it
 class DeepCL_EXPORT MultiNet : public Trainable {
     std::vector<Trainable * > trainables;
     float *output;
+    CLWrapper *outputWrapper; // wraps output, for averaging on the gpu
+    EnsembleSoftMax *ensembleSoftMax;
     int batchSize;
     int allocatedSize;
+    bool training; // the gpu ensemble path is for inference only
     InputLayer *proxyInputLayer; // used to feed in output from children, to give to lossLayer
     LossLayer *lossLayer;
 
@@ -50,6 +62,8 @@ public:
     VIRTUAL void setTraining(bool training);
     VIRTUAL int calcNumRight(int const *labels);
     void forwardToOurselves();
+    bool canEnsembleOnGpu();
+    void forwardEnsembleOnGpu(float const*images);
     VIRTUAL void forward(float const*images);
     VIRTUAL void backwardFromLabels(int const *labels);
     VIRTUAL void backward(float const *expectedOutput);
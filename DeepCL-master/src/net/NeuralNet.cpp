@@ -9,6 +9,9 @@
 
 #include "util/Timer.h"
 #include "conv/ConvolutionalLayer.h"
+#include "activate/ActivationLayer.h"
+#include "pooling/PoolingLayer.h"
+#include "clmath/HalfStorage.h"
 #include "layer/LayerMaker.h"
 #include "net/NeuralNetMould.h"
 #include "activate/ActivationFunction.h"
@@ -28,6 +31,8 @@
 #include "CppRuntimeBoundary.h"
 
 #include "net/NeuralNet.h"
+#include "net/DeviceProfiler.h"
+#include "net/GradientAllReduce.h"
 
 using namespace std;
 
@@ -38,8 +43,21 @@ using namespace std;
 #undef STATIC
 #define STATIC
 
+namespace {
+    // the prefix is shared by every thread, so leave it alone unless timing
+    // is on.  DataParallelNet wont run its replicas with timing on
+    void setTimerPrefix(std::string prefix) {
+        if(StatefulTimer::enabled) {
+            StatefulTimer::setPrefix(prefix);
+        }
+    }
+}
+
 NeuralNet::NeuralNet(EasyCL *cl) :
-        cl(cl) {
+        cl(cl),
+        halfStorage(0),
+        gradientAllReduce(0),
+        replicaIndex(0) {
     trainer = 0;
     isTraining = true;
 }
@@ -57,7 +75,10 @@ void NeuralNet::deleteMe() {
 }
 /// Constructor
 NeuralNet::NeuralNet(EasyCL *cl, int numPlanes, int imageSize) :
-        cl(cl) {
+        cl(cl),
+        halfStorage(0),
+        gradientAllReduce(0),
+        replicaIndex(0) {
     addLayer(InputLayerMaker::instance()->numPlanes(numPlanes)->imageSize(imageSize) );
     trainer = 0;
 }
@@ -65,6 +86,7 @@ NeuralNet::~NeuralNet() {
     for(int i = 0; i < (int)layers.size(); i++) {
         delete layers[i];
     }
+    delete halfStorage;
 }
 STATIC NeuralNetMould *NeuralNet::maker(EasyCL *cl) {
     return new NeuralNetMould(cl);
@@ -77,6 +99,13 @@ NeuralNet *NeuralNet::clone() {
         LayerMaker2 *makerCopy = maker->clone();
         copy->addLayer(makerCopy);
     }
+    for(vector<Layer *>::iterator it = layers.begin(); it != layers.end(); it++) {
+        ConvolutionalLayer *convLayer = dynamic_cast<ConvolutionalLayer *>(*it);
+        if(convLayer != 0 && convLayer->isFused()) {
+            copy->fuseLayers();
+            break;
+        }
+    }
     copy->print();
     cout << "outputimagesize: " << copy->getOutputSize() << endl;
     return copy;
@@ -184,14 +213,74 @@ PUBLICAPI int NeuralNet::calcNumRight(int const *labels) {
     return acceptsLabels->calcNumRightFromLabels(labels);
 }
 PUBLICAPI void NeuralNet::forward(float const*images) {
-    // forward...
+    forwardLayers(images, (int)layers.size());
+}
+// forwards through the first numLayers layers only, eg MultiNet stops before
+// the loss layer, and does the softmax itself, on the gpu
+void NeuralNet::forwardLayers(float const*images, int numLayers) {
     dynamic_cast<InputLayer *>(layers[0])->in(images);
-    for(int layerId = 0; layerId < (int)layers.size(); layerId++) {
-        StatefulTimer::setPrefix("layer" + toString(layerId) + " ");
+    for(int layerId = 0; layerId < numLayers; layerId++) {
+        setTimerPrefix("layer" + toString(layerId) + " ");
+        DeviceProfiler::begin(layerId, layers[layerId], "forward");
         layers[layerId]->forward();
-        StatefulTimer::setPrefix("");
+        DeviceProfiler::end();
+        setTimerPrefix("");
     }
 }
+/// \brief fuse each convolution -> activation (-> max-pooling) chain into the convolution
+///
+/// The convolution then applies bias, activation and pooling in one extra
+/// kernel, forward and backward, instead of one pass per layer.  Fused layers
+/// stay in the net, but an activation layer fused with pooling no longer has
+/// its own output.  Returns the number of chains fused
+PUBLICAPI int NeuralNet::fuseLayers() {
+    int numFused = 0;
+    for(int layerId = 1; layerId + 1 < (int)layers.size(); layerId++) {
+        ConvolutionalLayer *convLayer = dynamic_cast<ConvolutionalLayer *>(layers[layerId]);
+        if(convLayer == 0 || convLayer->isFused()) {
+            continue;
+        }
+        ActivationLayer *activationLayer = dynamic_cast<ActivationLayer *>(layers[layerId + 1]);
+        if(activationLayer == 0) {
+            continue;
+        }
+        PoolingLayer *poolingLayer = 0;
+        if(layerId + 2 < (int)layers.size()) {
+            poolingLayer = dynamic_cast<PoolingLayer *>(layers[layerId + 2]);
+        }
+        convLayer->fuse(activationLayer, poolingLayer);
+        numFused++;
+    }
+    return numFused;
+}
+/// \brief keep convolutional and fully-connected weights on the device as half-precision
+///
+/// Halves the device memory used by weights.  Layer outputs stay float, so
+/// this does not shrink the activation memory, which is what grows with the
+/// batch size.  Forward unpacks each layer's weights into a float buffer
+/// shared by all layers, so kernels still compute in float.  Inference only:
+/// backward will throw.  Call after loading weights
+PUBLICAPI void NeuralNet::enableHalfStorage() {
+    if(halfStorage == 0) {
+        halfStorage = new HalfStorage(cl);
+    }
+    for(int layerId = 0; layerId < (int)layers.size(); layerId++) {
+        ConvolutionalLayer *convLayer = dynamic_cast<ConvolutionalLayer *>(layers[layerId]);
+        FullyConnectedLayer *fcLayer = dynamic_cast<FullyConnectedLayer *>(layers[layerId]);
+        if(fcLayer != 0) {
+            convLayer = fcLayer->convolutionalLayer;
+        }
+        if(convLayer != 0) {
+            convLayer->enableHalfStorage(halfStorage);
+        }
+    }
+}
+/// Makes backward end by summing our weight and bias gradients with those of
+/// the other replicas, see DataParallelNet.  Pass 0 to stop
+void NeuralNet::setGradientAllReduce(GradientAllReduce *gradientAllReduce, int replicaIndex) {
+    this->gradientAllReduce = gradientAllReduce;
+    this->replicaIndex = replicaIndex;
+}
 /// \brief note: this does no learning, just calculates the gradients
 PUBLICAPI void NeuralNet::backwardFromLabels(int const *labels) {
     IAcceptsLabels *acceptsLabels = dynamic_cast<IAcceptsLabels*>(getLastLayer());
@@ -200,12 +289,17 @@ PUBLICAPI void NeuralNet::backwardFromLabels(int const *labels) {
     }
     acceptsLabels->calcGradInputFromLabels(labels);
     for(int layerIdx = (int)layers.size() - 2; layerIdx >= 1; layerIdx--) { // no point in propagating to input layer :-P
-        StatefulTimer::setPrefix("layer" + toString(layerIdx) + " ");
+        setTimerPrefix("layer" + toString(layerIdx) + " ");
         Layer *layer = layers[layerIdx];
         if(layer->needsBackProp()) {
+            DeviceProfiler::begin(layerIdx, layer, "backward");
             layer->backward();
+            DeviceProfiler::end();
         }
-        StatefulTimer::setPrefix("");
+        setTimerPrefix("");
+    }
+    if(gradientAllReduce != 0) {
+        gradientAllReduce->allReduce(this, replicaIndex);
     }
 }
 /// \brief note: this does no learning, just calculates the gradients
@@ -216,9 +310,14 @@ PUBLICAPI void NeuralNet::backward(float const *expectedOutput) {
     }
     lossLayer->calcGradInput(expectedOutput);
     for(int layerIdx = (int)layers.size() - 2; layerIdx >= 1; layerIdx--) { // no point in propagating to input layer
-        StatefulTimer::setPrefix("layer" + toString(layerIdx) + " ");
+        setTimerPrefix("layer" + toString(layerIdx) + " ");
+        DeviceProfiler::begin(layerIdx, layers[layerIdx], "backward");
         layers[layerIdx]->backward();
-        StatefulTimer::setPrefix("");
+        DeviceProfiler::end();
+        setTimerPrefix("");
+    }
+    if(gradientAllReduce != 0) {
+        gradientAllReduce->allReduce(this, replicaIndex);
     }
 }
 void NeuralNet::backward(OutputData *outputData) {
@@ -229,9 +328,14 @@ void NeuralNet::backward(OutputData *outputData) {
         if(!layer->needsBackProp()) {
             break;
         }
-        StatefulTimer::setPrefix("layer" + toString(layerIdx) + " ");
+        setTimerPrefix("layer" + toString(layerIdx) + " ");
+        DeviceProfiler::begin(layerIdx, layer, "backward");
         layer->backward();
-        StatefulTimer::setPrefix("");
+        DeviceProfiler::end();
+        setTimerPrefix("");
+    }
+    if(gradientAllReduce != 0) {
+        gradientAllReduce->allReduce(this, replicaIndex);
     }
 }
 PUBLICAPI int NeuralNet::getNumLayers() {
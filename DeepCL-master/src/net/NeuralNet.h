@@ -26,6 +26,8 @@ class EpochMaker;
 class InputMaker;
 class InputLayer;
 class OutputData;
+class HalfStorage;
+class GradientAllReduce;
 
 #define VIRTUAL virtual
 #define STATIC static
@@ -43,6 +45,9 @@ protected:
 #endif
     EasyCL *cl; // NOT owned by us, dont delete
     Trainer *trainer; // NOT owned by us, dont delete
+    HalfStorage *halfStorage; // owned by us, 0 unless enableHalfStorage was called
+    GradientAllReduce *gradientAllReduce; // NOT owned; set when we are one replica of a DataParallelNet
+    int replicaIndex;
 
 public:
     int isTraining; // = true;
@@ -83,6 +88,10 @@ public:
     PUBLICAPI void setTraining(bool training);
     PUBLICAPI int calcNumRight(int const *labels);
     PUBLICAPI void forward(float const*images);
+    void forwardLayers(float const*images, int numLayers);
+    PUBLICAPI int fuseLayers();
+    PUBLICAPI void enableHalfStorage();
+    void setGradientAllReduce(GradientAllReduce *gradientAllReduce, int replicaIndex);
     PUBLICAPI void backwardFromLabels(int const *labels);
     PUBLICAPI void backward(float const *expectedOutput);
     void backward(OutputData *outputData);
@@ -0,0 +1,265 @@
+// Copyright Hugh Perkins 2016 hughperkins at gmail
+//
+// This Source Code Form is subject to the terms of the Mozilla Public License,
+// v. 2.0. If a copy of the MPL was not distributed with this file, You can
+// obtain one at http://mozilla.org/MPL/2.0/.
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#include "net/StreamingPredictor.h"
+#include "net/NeuralNet.h"
+#include "layer/Layer.h"
+#include "input/InputLayer.h"
+#include "loss/SoftMaxLayer.h"
+#include "util/stringhelper.h"
+
+using namespace std;
+
+#undef STATIC
+#define STATIC
+#undef VIRTUAL
+#define VIRTUAL
+
+PUBLIC StreamingPredictor::StreamingPredictor(NeuralNet *net, int batchSize, int outputLayer, bool writeLabels, int depth) :
+        net(net),
+        batchSize(batchSize),
+        outputLayer(outputLayer),
+        writeLabels(writeLabels),
+        depth(std::max(1, depth)),
+        readerDone(false),
+        computeDone(false),
+        numImages(0),
+        seconds(0) {
+    if(outputLayer < 0 || outputLayer >= net->getNumLayers()) {
+        throw runtime_error("StreamingPredictor: outputLayer " + toString(outputLayer) + " should be the layer number of one of the layers in the network");
+    }
+    if(dynamic_cast<InputLayer *>(net->getLayer(0)) == 0) {
+        throw runtime_error("StreamingPredictor: layer 0 should be an input layer");
+    }
+    if(writeLabels && dynamic_cast<SoftMaxLayer *>(net->getLayer(outputLayer)) == 0) {
+        throw runtime_error("StreamingPredictor: must choose a softmax layer, to write labels");
+    }
+    net->setBatchSize(batchSize);
+    inputCubeSize = net->getLayer(0)->getOutputCubeSize();
+    outputCubeSize = net->getLayer(outputLayer)->getOutputCubeSize();
+    inputSlots.resize(this->depth);
+    outputSlots.resize(this->depth);
+    for(int i = 0; i < this->depth; i++) {
+        inputSlots[i].data = new float[batchSize * inputCubeSize];
+        if(writeLabels) {
+            outputSlots[i].labels = new int[batchSize];
+        } else {
+            outputSlots[i].data = new float[batchSize * outputCubeSize];
+        }
+    }
+}
+PUBLIC StreamingPredictor::~StreamingPredictor() {
+    for(int i = 0; i < depth; i++) {
+        delete[] inputSlots[i].data;
+        delete[] outputSlots[i].data;
+        delete[] outputSlots[i].labels;
+    }
+}
+PUBLIC int StreamingPredictor::getOutputCubeSize() {
+    return outputCubeSize;
+}
+// the calling thread is the compute stage; returns once every batch read has
+// been written
+PUBLIC void StreamingPredictor::run(Reader reader, Writer writer) {
+    freeInputs.clear();
+    filledInputs.clear();
+    freeOutputs.clear();
+    filledOutputs.clear();
+    for(int i = 0; i < depth; i++) {
+        freeInputs.push_back(i);
+        freeOutputs.push_back(i);
+    }
+    error = std::exception_ptr();
+    latenciesMilliseconds.clear();
+    readerDone = false;
+    computeDone = false;
+    numImages = 0;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    std::thread readerThread(&StreamingPredictor::readerLoop, this, reader);
+    std::thread writerThread(&StreamingPredictor::writerLoop, this, writer);
+    try {
+        while(true) {
+            int inputSlot;
+            int outputSlot;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                while(!error && filledInputs.empty() && !readerDone) {
+                    changed.wait(lock);
+                }
+                if(error || filledInputs.empty()) {
+                    break;
+                }
+                inputSlot = filledInputs.front();
+                filledInputs.pop_front();
+                while(!error && freeOutputs.empty()) {
+                    changed.wait(lock);
+                }
+                if(error) {
+                    break;
+                }
+                outputSlot = freeOutputs.front();
+                freeOutputs.pop_front();
+            }
+            compute(&inputSlots[inputSlot], &outputSlots[outputSlot]);
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                freeInputs.push_back(inputSlot);
+                filledOutputs[outputSlots[outputSlot].sequence] = outputSlot;
+            }
+            changed.notify_all();
+        }
+    } catch(...) {
+        fail(std::current_exception());
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        computeDone = true;
+    }
+    changed.notify_all();
+    readerThread.join();
+    writerThread.join();
+    seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if(error) {
+        std::rethrow_exception(error);
+    }
+}
+PUBLIC long long StreamingPredictor::getNumImages() {
+    return numImages;
+}
+PUBLIC int StreamingPredictor::getNumBatches() {
+    return (int)latenciesMilliseconds.size();
+}
+PUBLIC double StreamingPredictor::getSeconds() {
+    return seconds;
+}
+PUBLIC double StreamingPredictor::getImagesPerSecond() {
+    return seconds > 0 ? numImages / seconds : 0;
+}
+// nearest-rank percentile of the per-batch latencies, in milliseconds;
+// percentile is in [0, 100]
+PUBLIC double StreamingPredictor::getLatencyPercentile(double percentile) {
+    if(latenciesMilliseconds.size() == 0) {
+        return 0;
+    }
+    vector<double> sorted(latenciesMilliseconds);
+    std::sort(sorted.begin(), sorted.end());
+    int rank = (int)(percentile / 100.0 * sorted.size() + 0.999999);
+    rank = std::min((int)sorted.size(), std::max(1, rank));
+    return sorted[rank - 1];
+}
+PUBLIC void StreamingPredictor::printStats(std::ostream &os) {
+    os << "streaming predict: " << numImages << " images in " << getNumBatches() << " batches, "
+        << seconds << "s, " << getImagesPerSecond() << " images/s" << endl;
+    os << "batch latency ms: p50 " << getLatencyPercentile(50)
+        << " p90 " << getLatencyPercentile(90)
+        << " p99 " << getLatencyPercentile(99)
+        << " max " << getLatencyPercentile(100) << endl;
+}
+PRIVATE void StreamingPredictor::readerLoop(Reader reader) {
+    long long sequence = 0;
+    try {
+        while(true) {
+            int slot;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                while(!error && !computeDone && freeInputs.empty()) {
+                    changed.wait(lock);
+                }
+                if(error || computeDone) {
+                    break;
+                }
+                slot = freeInputs.front();
+                freeInputs.pop_front();
+            }
+            PredictBatch *batch = &inputSlots[slot];
+            batch->readStart = std::chrono::steady_clock::now();
+            int numRead = reader(batch->data, batchSize);
+            if(numRead <= 0) {
+                break;
+            }
+            if(numRead < batchSize) {
+                memset(batch->data + numRead * inputCubeSize, 0, sizeof(float) * (batchSize - numRead) * inputCubeSize);
+            }
+            batch->numImages = numRead;
+            batch->sequence = sequence++;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                filledInputs.push_back(slot);
+            }
+            changed.notify_all();
+        }
+    } catch(...) {
+        fail(std::current_exception());
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        readerDone = true;
+    }
+    changed.notify_all();
+}
+PRIVATE void StreamingPredictor::writerLoop(Writer writer) {
+    long long nextSequence = 0;
+    try {
+        while(true) {
+            int slot;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                while(!error && filledOutputs.find(nextSequence) == filledOutputs.end()
+                        && !(computeDone && filledOutputs.empty())) {
+                    changed.wait(lock);
+                }
+                map<long long, int>::iterator it = filledOutputs.find(nextSequence);
+                if(error || it == filledOutputs.end()) {
+                    break;
+                }
+                slot = it->second;
+                filledOutputs.erase(it);
+            }
+            PredictBatch *batch = &outputSlots[slot];
+            writer(batch->numImages, batch->data, batch->labels);
+            double latency = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - batch->readStart).count();
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                latenciesMilliseconds.push_back(latency);
+                numImages += batch->numImages;
+                freeOutputs.push_back(slot);
+                nextSequence++;
+            }
+            changed.notify_all();
+        }
+    } catch(...) {
+        fail(std::current_exception());
+    }
+}
+PRIVATE void StreamingPredictor::compute(PredictBatch *input, PredictBatch *output) {
+    dynamic_cast<InputLayer *>(net->getLayer(0))->in(input->data);
+    for(int layerId = 0; layerId <= outputLayer; layerId++) {
+        net->getLayer(layerId)->forward();
+    }
+    output->sequence = input->sequence;
+    output->numImages = input->numImages;
+    output->readStart = input->readStart;
+    if(writeLabels) {
+        dynamic_cast<SoftMaxLayer *>(net->getLayer(outputLayer))->getLabels(output->labels);
+    } else {
+        memcpy(output->data, net->getLayer(outputLayer)->getOutput(), sizeof(float) * input->numImages * outputCubeSize);
+    }
+}
+// keeps the first error, and wakes every stage so they can stop
+PRIVATE void StreamingPredictor::fail(std::exception_ptr error) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if(!this->error) {
+            this->error = error;
+        }
+    }
+    changed.notify_all();
+}
@@ -0,0 +1,127 @@
+// Copyright Hugh Perkins 2016 hughperkins at gmail
+//
+// This Source Code Form is subject to the terms of the Mozilla Public License,
+// v. 2.0. If a copy of the MPL was not distributed with this file, You can
+// obtain one at http://mozilla.org/MPL/2.0/.
+
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <exception>
+#include <chrono>
+#include <iostream>
+
+#include "DeepCLDllExport.h"
+
+class NeuralNet;
+
+#define VIRTUAL virtual
+#define STATIC static
+
+// one batch in flight, either images waiting for the net, or outputs waiting
+// to be written
+class DeepCL_EXPORT PredictBatch {
+public:
+    long long sequence;
+    int numImages;
+    float *data;
+    int *labels;
+    std::chrono::steady_clock::time_point readStart;
+    PredictBatch() :
+        sequence(0),
+        numImages(0),
+        data(0),
+        labels(0) {
+    }
+};
+
+// Runs a persistent net over a stream of batches as three overlapping stages,
+// as deepcl_predict does with pipelinedepth=:
+//
+//   reader thread:  reader(inputData, batchSize) into a free input slot
+//   calling thread: forward through the net, copy the outputs into a free
+//                   output slot, hand the input slot back to the reader
+//   writer thread:  writer(numImages, output, labels), in sequence order
+//
+// so reading batch k+1 and writing batch k-1 overlap with the net running on
+// batch k.  Each stage has `depth` slots, so depth 2 is double buffering.  The
+// net, and its OpenCL queue, are only touched from the calling thread.  reader
+// and writer run on threads of their own, concurrently with the net, so they
+// must not touch anything the net does either, such as StatefulTimer; eg read
+// with GenericLoaderv2::loadFromBackgroundThread, not load.
+//
+// reader returns how many images it read, up to batchSize; 0 ends the stream.
+// A short batch is zero-padded before going through the net, and only its
+// numImages outputs are written.  If any stage throws, the others stop, and
+// run rethrows the first exception.
+//
+// Latency is per batch, from the reader starting on it to the writer
+// finishing with it.
+class DeepCL_EXPORT StreamingPredictor {
+public:
+    typedef std::function<int(float *inputData, int maxImages)> Reader;
+    typedef std::function<void(int numImages, float const *output, int const *labels)> Writer;
+
+private:
+    NeuralNet *net; // NOT delete
+    int batchSize;
+    int outputLayer;
+    bool writeLabels;
+    int depth;
+    int inputCubeSize;
+    int outputCubeSize;
+
+    #ifdef _WIN32
+    #pragma warning(disable: 4251)
+    #endif
+    std::vector<PredictBatch> inputSlots;
+    std::vector<PredictBatch> outputSlots;
+    std::deque<int> freeInputs;
+    std::deque<int> filledInputs;
+    std::deque<int> freeOutputs;
+    std::map<long long, int> filledOutputs; // by sequence
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::exception_ptr error;
+    std::vector<double> latenciesMilliseconds;
+    #ifdef _WIN32
+    #pragma warning(default: 4251)
+    #endif
+    bool readerDone;
+    bool computeDone;
+    long long numImages;
+    double seconds;
+
+    // [[[cog
+    // import cog_addheaders
+    // cog_addheaders.addv2()
+    // ]]]
+    // generated, using cog:
+
+    public:
+    StreamingPredictor(NeuralNet *net, int batchSize, int outputLayer, bool writeLabels, int depth);
+    ~StreamingPredictor();
+    int getOutputCubeSize();
+    void run(Reader reader, Writer writer);
+    long long getNumImages();
+    int getNumBatches();
+    double getSeconds();
+    double getImagesPerSecond();
+    double getLatencyPercentile(double percentile);
+    void printStats(std::ostream &os);
+
+    private:
+    void readerLoop(Reader reader);
+    void writerLoop(Writer writer);
+    void compute(PredictBatch *input, PredictBatch *output);
+    void fail(std::exception_ptr error);
+
+    // [[[end]]]
+};
+
@@ -0,0 +1,291 @@
+// Copyright Hugh Perkins 2016 hughperkins at gmail
+//
+// This Source Code Form is subject to the terms of the Mozilla Public License,
+// v. 2.0. If a copy of the MPL was not distributed with this file, You can
+// obtain one at http://mozilla.org/MPL/2.0/.
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <vector>
+#include <map>
+#include <cmath>
+#include <thread>
+#include <exception>
+#include <stdexcept>
+#include <algorithm>
+
+#include "normalize/DatasetStatistics.h"
+#include "loaders/GenericLoaderv2.h"
+#include "util/ThreadPool.h"
+#include "util/FileHelper.h"
+#include "util/stringhelper.h"
+
+using namespace std;
+
+#undef STATIC
+#define STATIC
+#undef VIRTUAL
+#define VIRTUAL
+
+namespace {
+    const int blockSize = 2048; // floats; 8KB, so both passes over a block hit L1
+    const int numLanes = 8;
+    const int blocksPerTask = 8;
+
+    // the two passes over one block, then merge it into statistics
+    template< typename T > void addBlock(T const*values, int length, DatasetStatistics *statistics) {
+        float laneSums[numLanes] = {0};
+        int vectorLength = length / numLanes * numLanes;
+        for(int i = 0; i < vectorLength; i += numLanes) {
+            for(int lane = 0; lane < numLanes; lane++) {
+                laneSums[lane] += (float)values[i + lane];
+            }
+        }
+        float sum = 0;
+        for(int lane = 0; lane < numLanes; lane++) {
+            sum += laneSums[lane];
+        }
+        for(int i = vectorLength; i < length; i++) {
+            sum += (float)values[i];
+        }
+        float blockMean = sum / length;
+
+        float laneM2s[numLanes] = {0};
+        float laneMins[numLanes];
+        float laneMaxs[numLanes];
+        for(int lane = 0; lane < numLanes; lane++) {
+            laneMins[lane] = (float)values[0];
+            laneMaxs[lane] = (float)values[0];
+        }
+        for(int i = 0; i < vectorLength; i += numLanes) {
+            for(int lane = 0; lane < numLanes; lane++) {
+                float value = (float)values[i + lane];
+                float diff = value - blockMean;
+                laneM2s[lane] += diff * diff;
+                laneMins[lane] = value < laneMins[lane] ? value : laneMins[lane];
+                laneMaxs[lane] = value > laneMaxs[lane] ? value : laneMaxs[lane];
+            }
+        }
+        DatasetStatistics block;
+        block.count = length;
+        block.mean = blockMean;
+        block.minY = laneMins[0];
+        block.maxY = laneMaxs[0];
+        for(int lane = 0; lane < numLanes; lane++) {
+            block.m2 += laneM2s[lane];
+            block.minY = std::min(block.minY, laneMins[lane]);
+            block.maxY = std::max(block.maxY, laneMaxs[lane]);
+        }
+        for(int i = vectorLength; i < length; i++) {
+            float value = (float)values[i];
+            float diff = value - blockMean;
+            block.m2 += diff * diff;
+            block.minY = std::min(block.minY, value);
+            block.maxY = std::max(block.maxY, value);
+        }
+        statistics->merge(block);
+    }
+    template< typename T > void addValues(T const*values, long long length, DatasetStatistics *statistics) {
+        for(long long start = 0; start < length; start += blockSize) {
+            addBlock(values + start, (int)std::min<long long>(blockSize, length - start), statistics);
+        }
+    }
+    // splits values into tasks of blocksPerTask blocks, and merges their results
+    // in task order.  The split depends only on length, never on the number of
+    // threads, so neither does the order of the float additions
+    template< typename T > DatasetStatistics computeParallel(T const*values, long long length, ThreadPool *threadPool) {
+        const long long taskLength = (long long)blocksPerTask * blockSize;
+        const int numTasks = (int)std::max<long long>(1, (length + taskLength - 1) / taskLength);
+        vector<DatasetStatistics> taskStatistics(numTasks);
+        threadPool->parallelFor(numTasks, [&](int task, int threadId) {
+            long long begin = task * taskLength;
+            long long end = std::min(length, begin + taskLength);
+            addValues(values + begin, end - begin, &taskStatistics[task]);
+        });
+        DatasetStatistics statistics;
+        for(int task = 0; task < numTasks; task++) {
+            statistics.merge(taskStatistics[task]);
+        }
+        return statistics;
+    }
+}
+
+PUBLIC DatasetStatistics::DatasetStatistics() :
+        count(0),
+        mean(0),
+        m2(0),
+        minY(0),
+        maxY(0) {
+}
+PUBLIC void DatasetStatistics::add(float const*values, long long length) {
+    addValues(values, length, this);
+}
+PUBLIC void DatasetStatistics::add(unsigned char const*values, long long length) {
+    addValues(values, length, this);
+}
+PUBLIC void DatasetStatistics::merge(DatasetStatistics const&other) {
+    if(other.count == 0) {
+        return;
+    }
+    if(count == 0) {
+        *this = other;
+        return;
+    }
+    long long newCount = count + other.count;
+    double delta = other.mean - mean;
+    mean += delta * other.count / newCount;
+    m2 += other.m2 + delta * delta * ((double)count * other.count / newCount);
+    count = newCount;
+    minY = std::min(minY, other.minY);
+    maxY = std::max(maxY, other.maxY);
+}
+PUBLIC float DatasetStatistics::getMean() const {
+    return (float)mean;
+}
+// sample stddev, ie over count - 1, as NormalizationHelper::getMeanAndStdDev
+PUBLIC float DatasetStatistics::getStdDev() const {
+    if(count < 2) {
+        return 0;
+    }
+    return (float)std::sqrt(m2 / (count - 1));
+}
+PUBLIC STATIC DatasetStatistics DatasetStatistics::compute(float const*values, long long length, ThreadPool *threadPool) {
+    return computeParallel(values, length, threadPool);
+}
+// statistics of the first numExamples images from loader.  If the loader is
+// mapped, the threads read the records straight out of the mapping.
+// Otherwise it loads chunkExamples images at a time, on a background thread,
+// into one of two buffers, while the threads work through the other
+PUBLIC STATIC DatasetStatistics DatasetStatistics::compute(GenericLoaderv2 *loader, int numExamples, int chunkExamples, ThreadPool *threadPool) {
+    const long long cubeSize = (long long)loader->getPlanes() * loader->getImageSize() * loader->getImageSize();
+    unsigned char const*records = loader->getRecords(0, numExamples);
+    if(records != 0) {
+        return computeParallel(records, numExamples * cubeSize, threadPool);
+    }
+    chunkExamples = std::max(1, std::min(chunkExamples, numExamples));
+    vector<float> buffers[2];
+    vector<int> labels[2]; // not used, but not all loaders can skip them
+    for(int i = 0; i < 2; i++) {
+        buffers[i].resize(chunkExamples * cubeSize);
+        labels[i].resize(chunkExamples);
+    }
+    DatasetStatistics statistics;
+    int thisChunkExamples = std::min(chunkExamples, numExamples);
+    if(numExamples > 0) {
+        loader->load(&buffers[0][0], &labels[0][0], 0, thisChunkExamples);
+    }
+    int current = 0;
+    for(int start = 0; start < numExamples; start += chunkExamples) {
+        int nextStart = start + chunkExamples;
+        int nextChunkExamples = std::min(chunkExamples, numExamples - nextStart);
+        std::thread loadThread;
+        std::exception_ptr loadError;
+        if(nextChunkExamples > 0) {
+            float *nextBuffer = &buffers[1 - current][0];
+            int *nextLabels = &labels[1 - current][0];
+            loadThread = std::thread([=, &loadError]() {
+                try {
+                    loader->loadFromBackgroundThread(nextBuffer, nextLabels, nextStart, nextChunkExamples);
+                } catch(...) {
+                    loadError = std::current_exception();
+                }
+            });
+        }
+        DatasetStatistics chunkStatistics;
+        try {
+            chunkStatistics = computeParallel(&buffers[current][0], thisChunkExamples * cubeSize, threadPool);
+        } catch(...) {
+            if(loadThread.joinable()) {
+                loadThread.join();
+            }
+            throw;
+        }
+        if(loadThread.joinable()) {
+            loadThread.join();
+        }
+        if(loadError) {
+            std::rethrow_exception(loadError);
+        }
+        statistics.merge(chunkStatistics);
+        current = 1 - current;
+        thisChunkExamples = nextChunkExamples;
+    }
+    return statistics;
+}
+// as compute(), but looks in statsFile first, and adds the result to it
+// otherwise.  Entries are keyed by the dataset's path, its file size, and
+// numExamples, so a changed dataset is computed again.  Empty statsFile means
+// always compute
+PUBLIC STATIC DatasetStatistics DatasetStatistics::computeCached(std::string statsFile, std::string datasetFilepath, GenericLoaderv2 *loader, int numExamples, int chunkExamples, ThreadPool *threadPool) {
+    if(statsFile == "") {
+        return compute(loader, numExamples, chunkExamples, threadPool);
+    }
+    string key = datasetFilepath + "\t" + toString(FileHelper::getFilesize(datasetFilepath)) + "\t" + toString(numExamples);
+    DatasetStatistics statistics;
+    if(load(statsFile, key, &statistics)) {
+        cout << "DatasetStatistics: read statistics of " << datasetFilepath << " from " << statsFile << endl;
+        return statistics;
+    }
+    statistics = compute(loader, numExamples, chunkExamples, threadPool);
+    save(statsFile, key, statistics);
+    return statistics;
+}
+// statsFile has one line per dataset: the key, then count, mean, m2, min and
+// max, tab-separated
+PUBLIC STATIC bool DatasetStatistics::load(std::string statsFile, std::string key, DatasetStatistics *statistics) {
+    if(!FileHelper::exists(statsFile)) {
+        return false;
+    }
+    ifstream f(FileHelper::localizePath(statsFile).c_str());
+    string line;
+    string prefix = key + "\t";
+    while(getline(f, line)) {
+        if(line.compare(0, prefix.size(), prefix) != 0) {
+            continue;
+        }
+        istringstream values(line.substr(prefix.size()));
+        DatasetStatistics loaded;
+        if(values >> loaded.count >> loaded.mean >> loaded.m2 >> loaded.minY >> loaded.maxY) {
+            *statistics = loaded;
+            return true;
+        }
+        cout << "DatasetStatistics: ignoring malformed line in " << statsFile << ": " << line << endl;
+    }
+    return false;
+}
+// replaces any line for key, keeping the others; written to a temporary file
+// first, then renamed, as TuningDatabase does
+PUBLIC STATIC void DatasetStatistics::save(std::string statsFile, std::string key, DatasetStatistics const&statistics) {
+    vector<string> lines;
+    string prefix = key + "\t";
+    if(FileHelper::exists(statsFile)) {
+        ifstream f(FileHelper::localizePath(statsFile).c_str());
+        string line;
+        while(getline(f, line)) {
+            if(line != "" && line.compare(0, prefix.size(), prefix) != 0) {
+                lines.push_back(line);
+            }
+        }
+    }
+    ostringstream entry;
+    entry << setprecision(17) << prefix << statistics.count << "\t" << statistics.mean << "\t" << statistics.m2
+        << "\t" << setprecision(9) << statistics.minY << "\t" << statistics.maxY;
+    lines.push_back(entry.str());
+    string tempPath = statsFile + "~";
+    {
+        ofstream f(FileHelper::localizePath(tempPath).c_str());
+        if(!f.is_open()) {
+            throw runtime_error("DatasetStatistics: cannot open " + tempPath + " for writing");
+        }
+        for(int i = 0; i < (int)lines.size(); i++) {
+            f << lines[i] << endl;
+        }
+    }
+    #ifdef _WIN32
+    FileHelper::remove(statsFile);
+    #endif
+    FileHelper::rename(tempPath, statsFile);
+}
+
@@ -0,0 +1,60 @@
+// Copyright Hugh Perkins 2016 hughperkins at gmail
+//
+// This Source Code Form is subject to the terms of the Mozilla Public License,
+// v. 2.0. If a copy of the MPL was not distributed with this file, You can
+// obtain one at http://mozilla.org/MPL/2.0/.
+
+#pragma once
+
+#include <string>
+
+#include "DeepCLDllExport.h"
+
+class GenericLoaderv2;
+class ThreadPool;
+
+#define VIRTUAL virtual
+#define STATIC static
+
+// Count, mean, sum of squared deviations from the mean (m2), min and max of a
+// set of values, for stddev normalization.
+//
+// add() works through its values in blocks that fit in L1: one pass for the
+// block's mean, a second for its m2, min and max, each over eight independent
+// lanes, so the compiler can vectorize them without reassociating anything.
+// The block is then merged in with Chan et al's pairwise update, as merge()
+// does for whole partial results, so there is no catastrophic cancellation
+// of sum(y^2) - sum(y)^2 / n, as with Statistics, however many values there
+// are.
+//
+// The compute() functions split the values into fixed-size tasks, run them
+// on a ThreadPool, and merge the per-task results in task order, so the
+// answer doesnt depend on the number of threads.
+class DeepCL_EXPORT DatasetStatistics {
+public:
+    long long count;
+    double mean;
+    double m2;
+    float minY;
+    float maxY;
+
+    // [[[cog
+    // import cog_addheaders
+    // cog_addheaders.add()
+    // ]]]
+    // generated, using cog:
+    DatasetStatistics();
+    void add(float const*values, long long length);
+    void add(unsigned char const*values, long long length);
+    void merge(DatasetStatistics const&other);
+    float getMean() const;
+    float getStdDev() const;
+    STATIC DatasetStatistics compute(float const*values, long long length, ThreadPool *threadPool);
+    STATIC DatasetStatistics compute(GenericLoaderv2 *loader, int numExamples, int chunkExamples, ThreadPool *threadPool);
+    STATIC DatasetStatistics computeCached(std::string statsFile, std::string datasetFilepath, GenericLoaderv2 *loader, int numExamples, int chunkExamples, ThreadPool *threadPool);
+    STATIC bool load(std::string statsFile, std::string key, DatasetStatistics *statistics);
+    STATIC void save(std::string statsFile, std::string key, DatasetStatistics const&statistics);
+
+    // [[[end]]]
+};
+
@@ -4,7 +4,9 @@
 // v. 2.0. If a copy of the MPL was not distributed with this file, You can 
 // obtain one at http://mozilla.org/MPL/2.0/.
 
+#include "EasyCL.h"
 #include "normalize/NormalizationLayerMaker.h"
+#include "clmath/CLMathExpr.h"
 
 #include "normalize/NormalizationLayer.h"
 
@@ -19,11 +21,16 @@ NormalizationLayer::NormalizationLayer(Layer *previousLayer, NormalizationLayerM
     scale(maker->_scale),
     outputPlanes(previousLayer->getOutputPlanes()),
     outputSize(previousLayer->getOutputSize()),
+    cl(maker->cl),
     batchSize(0),
     allocatedSize(0),
-    output(0) {
+    output(0),
+    outputWrapper(0) {
 }
 VIRTUAL NormalizationLayer::~NormalizationLayer() {
+    if(outputWrapper != 0) {
+        delete outputWrapper;
+    }
     if(output != 0) {
         delete[] output;
     }
@@ -31,7 +38,11 @@ VIRTUAL NormalizationLayer::~NormalizationLayer() {
 VIRTUAL std::string NormalizationLayer::getClassName() const {
     return "NormalizationLayer";
 }
+// 0 until setBatchSize
 VIRTUAL float *NormalizationLayer::getOutput() {
+    if(outputWrapper != 0 && outputWrapper->isDeviceDirty()) {
+        outputWrapper->copyToHost();
+    }
     return output;
 }
 VIRTUAL ActivationFunction const *NormalizationLayer::getActivationFunction() {
@@ -94,23 +105,46 @@ VIRTUAL void NormalizationLayer::print() const {
 VIRTUAL bool NormalizationLayer::needErrorsBackprop() {
     return false;
 }
+VIRTUAL bool NormalizationLayer::hasOutputWrapper() const {
+    return true;
+}
+VIRTUAL CLWrapper *NormalizationLayer::getOutputWrapper() {
+    return outputWrapper;
+}
 VIRTUAL void NormalizationLayer::setBatchSize(int batchSize) {
     if(batchSize <= allocatedSize) {
         this->batchSize = batchSize;
         return;
     }
+    if(outputWrapper != 0) {
+        delete outputWrapper;
+    }
     if(output != 0) {
         delete[] output;
     }
     this->batchSize = batchSize;
-    this->allocatedSize = allocatedSize;
+    this->allocatedSize = batchSize;
     output = new float[ getOutputNumElements() ];
+    outputWrapper = cl->wrap(getOutputNumElements(), output);
+    outputWrapper->createOnDevice();
 }
+// one kernel, and one pass over the batch, where CLMathWrapper would take a
+// copy, an add and a multiply.  Only the current batch is touched, though the
+// buffers can be allocated for a larger one
 VIRTUAL void NormalizationLayer::forward() {
     int totalLinearLength = getOutputNumElements();
-    float *upstreamOutput = previousLayer->getOutput();
-    for(int i = 0; i < totalLinearLength; i++) {
-        output[i] = (upstreamOutput[i] + translate) * scale;
+    CLWrapper *upstreamOutputWrapper = 0;
+    if(previousLayer->hasOutputWrapper()) {
+        upstreamOutputWrapper = previousLayer->getOutputWrapper();
+    } else {
+        float *upstreamOutput = previousLayer->getOutput();
+        upstreamOutputWrapper = cl->wrap(totalLinearLength, upstreamOutput);
+        upstreamOutputWrapper->copyToDevice();
+    }
+    CLMathExpr normalized = (CLMathExpr(upstreamOutputWrapper, totalLinearLength) + translate) * scale;
+    normalized.assignTo(cl, dynamic_cast< CLFloatWrapper * >(outputWrapper), totalLinearLength);
+    if(!previousLayer->hasOutputWrapper()) {
+        delete upstreamOutputWrapper;
     }
 }
 VIRTUAL void NormalizationLayer::backward(float learningRate, float const *gradOutput) {
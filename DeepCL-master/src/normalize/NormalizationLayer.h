@@ -12,8 +12,13 @@
 
 #define VIRTUAL virtual
 
+class EasyCL;
+class CLWrapper;
+
 class NormalizationLayerMaker;
 
+// output = (input + translate) * scale, as one CLMathExpr kernel on the
+// device, so the next layer reads it straight from outputWrapper
 class NormalizationLayer : public Layer, IHasToString {
 public:
     float translate; // apply translate first
@@ -22,9 +27,12 @@ public:
     const int outputPlanes;
     const int outputSize;
 
+    EasyCL *const cl; // NOT owned by us
+
     int batchSize;
     int allocatedSize;
     float *output;
+    CLWrapper *outputWrapper;
 
     inline int getResultIndex(int n, int outPlane, int outRow, int outCol) const {
         return (( n
@@ -53,6 +61,8 @@ public:
     VIRTUAL void printOutput() const;
     VIRTUAL void print() const;
     VIRTUAL bool needErrorsBackprop();
+    VIRTUAL bool hasOutputWrapper() const;
+    VIRTUAL CLWrapper *getOutputWrapper();
     VIRTUAL void setBatchSize(int batchSize);
     VIRTUAL void forward();
     VIRTUAL void backward(float learningRate, float const *gradOutput);
@@ -10,8 +10,7 @@
 #include "layer/Layer.h"
 #include "RandomPatches.h"
 #include "RandomPatchesMaker.h"
-#include "util/RandomSingleton.h"
-#include "PatchExtractor.h"
+#include "clmath/PhiloxRandom.h"
 
 using namespace std;
 
@@ -20,13 +19,15 @@ using namespace std;
 #undef STATIC
 #define STATIC
 
-RandomPatches::RandomPatches(Layer *previousLayer, RandomPatchesMaker *maker) :
+RandomPatches::RandomPatches(EasyCL *cl, Layer *previousLayer, RandomPatchesMaker *maker) :
         Layer(previousLayer, maker),
         patchSize(maker->_patchSize),
         numPlanes (previousLayer->getOutputPlanes()),
         inputSize(previousLayer->getOutputSize()),
         outputSize(maker->_patchSize),
+        cl(cl),
         output(0),
+        outputWrapper(0),
         batchSize(0),
         allocatedSize(0) {
     if(inputSize == 0) {
@@ -40,8 +41,13 @@ RandomPatches::RandomPatches(Layer *previousLayer, RandomPatchesMaker *maker) :
     if(previousLayer->needsBackProp()) {
         throw runtime_error("Error: RandomPatches layer does not provide backprop currently, so you cannot put it after a layer that needs backprop");
     }
+    random = new PhiloxRandom(cl);
 }
 VIRTUAL RandomPatches::~RandomPatches() {
+    delete random;
+    if(outputWrapper != 0) {
+        delete outputWrapper;
+    }
     if(output != 0) {
         delete[] output;
     }
@@ -54,17 +60,25 @@ VIRTUAL void RandomPatches::setBatchSize(int batchSize) {
         this->batchSize = batchSize;
         return;
     }
+    if(outputWrapper != 0) {
+        delete outputWrapper;
+    }
     if(output != 0) {
         delete[] output;
     }
     this->batchSize = batchSize;
     this->allocatedSize = batchSize;
     output = new float[ getOutputNumElements() ];
+    outputWrapper = cl->wrap(getOutputNumElements(), output);
+    outputWrapper->createOnDevice();
 }
 VIRTUAL int RandomPatches::getOutputNumElements() {
     return batchSize * numPlanes * outputSize * outputSize;
 }
 VIRTUAL float *RandomPatches::getOutput() {
+    if(outputWrapper->isDeviceDirty()) {
+        outputWrapper->copyToHost();
+    }
     return output;
 }
 VIRTUAL bool RandomPatches::needsBackProp() {
@@ -86,19 +100,25 @@ VIRTUAL bool RandomPatches::providesGradInputWrapper() const {
     return false;
 }
 VIRTUAL bool RandomPatches::hasOutputWrapper() const {
-    return false;
+    return true;
+}
+VIRTUAL CLWrapper *RandomPatches::getOutputWrapper() {
+    return outputWrapper;
 }
+// offsets are drawn on the device, per image, see PhiloxRandom.  When not
+// training, takes the centre patch
 VIRTUAL void RandomPatches::forward() {
-    float *upstreamOutput = previousLayer->getOutput();
-    for(int n = 0; n < batchSize; n++) {
-        int patchMargin = inputSize - outputSize;
-        int patchRow = patchMargin / 2;
-        int patchCol = patchMargin / 2;
-        if(training) {
-            patchRow = RandomSingleton::instance()->uniformInt(0, patchMargin);
-            patchCol = RandomSingleton::instance()->uniformInt(0, patchMargin);
-        }
-        PatchExtractor::extractPatch(n, numPlanes, inputSize, patchSize, patchRow, patchCol, upstreamOutput, output);
+    CLWrapper *upstreamOutputWrapper = 0;
+    if(previousLayer->hasOutputWrapper()) {
+        upstreamOutputWrapper = previousLayer->getOutputWrapper();
+    } else {
+        float *upstreamOutput = previousLayer->getOutput();
+        upstreamOutputWrapper = cl->wrap(previousLayer->getOutputNumElements(), upstreamOutput);
+        upstreamOutputWrapper->copyToDevice();
+    }
+    random->randomPatches(batchSize, numPlanes, inputSize, patchSize, training, upstreamOutputWrapper, outputWrapper);
+    if(!previousLayer->hasOutputWrapper()) {
+        delete upstreamOutputWrapper;
     }
 }
 VIRTUAL std::string RandomPatches::asString() const {
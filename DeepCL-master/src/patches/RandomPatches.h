@@ -16,6 +16,7 @@ class CLWrapper;
 class PoolingForward;
 class PoolingBackward;
 class RandomPatchesMaker;
+class PhiloxRandom;
 
 class RandomPatches : public Layer {
 public:
@@ -25,7 +26,11 @@ public:
 
     const int outputSize;
 
+    EasyCL *const cl; // NOT owned by us
+    PhiloxRandom *random;
+
     float *output;
+    CLWrapper *outputWrapper;
 
     int batchSize;
     int allocatedSize;
@@ -35,7 +40,7 @@ public:
     // cog_addheaders.add()
     // ]]]
     // generated, using cog:
-    RandomPatches(Layer *previousLayer, RandomPatchesMaker *maker);
+    RandomPatches(EasyCL *cl, Layer *previousLayer, RandomPatchesMaker *maker);
     VIRTUAL ~RandomPatches();
     VIRTUAL std::string getClassName() const;
     VIRTUAL void setBatchSize(int batchSize);
@@ -48,6 +53,7 @@ public:
     VIRTUAL int getPersistSize(int version) const;
     VIRTUAL bool providesGradInputWrapper() const;
     VIRTUAL bool hasOutputWrapper() const;
+    VIRTUAL CLWrapper *getOutputWrapper();
     VIRTUAL void forward();
     VIRTUAL std::string asString() const;
 
@@ -11,6 +11,6 @@
 using namespace std;
 
 Layer *RandomPatchesMaker::createLayer(Layer *previousLayer) {
-    return new RandomPatches(previousLayer, this);
+    return new RandomPatches(cl, previousLayer, this);
 }
 
@@ -10,8 +10,8 @@
 #include "layer/Layer.h"
 #include "RandomTranslations.h"
 #include "RandomTranslationsMaker.h"
-#include "util/RandomSingleton.h"
-#include "Translator.h"
+#include "clmath/PhiloxRandom.h"
+#include "clmath/CopyBuffer.h"
 
 using namespace std;
 
@@ -20,13 +20,15 @@ using namespace std;
 #undef STATIC
 #define STATIC
 
-RandomTranslations::RandomTranslations(Layer *previousLayer, RandomTranslationsMaker *maker) :
+RandomTranslations::RandomTranslations(EasyCL *cl, Layer *previousLayer, RandomTranslationsMaker *maker) :
         Layer(previousLayer, maker),
         translateSize(maker->_translateSize),
         numPlanes (previousLayer->getOutputPlanes()),
         inputSize(previousLayer->getOutputSize()),
         outputSize(previousLayer->getOutputSize()),
+        cl(cl),
         output(0),
+        outputWrapper(0),
         batchSize(0),
         allocatedSize(0) {
     if(inputSize == 0) {
@@ -40,8 +42,15 @@ RandomTranslations::RandomTranslations(Layer *previousLayer, RandomTranslationsM
     if(previousLayer->needsBackProp()) {
         throw runtime_error("Error: RandomTranslations layer does not provide backprop currently, so you cannot put it after a layer that needs backprop");
     }
+    random = new PhiloxRandom(cl);
+    copyBuffer = new CopyBuffer(cl);
 }
 VIRTUAL RandomTranslations::~RandomTranslations() {
+    delete random;
+    delete copyBuffer;
+    if(outputWrapper != 0) {
+        delete outputWrapper;
+    }
     if(output != 0) {
         delete[] output;
     }
@@ -54,17 +63,25 @@ VIRTUAL void RandomTranslations::setBatchSize(int batchSize) {
         this->batchSize = batchSize;
         return;
     }
+    if(outputWrapper != 0) {
+        delete outputWrapper;
+    }
     if(output != 0) {
         delete[] output;
     }
     this->batchSize = batchSize;
     this->allocatedSize = batchSize;
     output = new float[ getOutputNumElements() ];
+    outputWrapper = cl->wrap(getOutputNumElements(), output);
+    outputWrapper->createOnDevice();
 }
 VIRTUAL int RandomTranslations::getOutputNumElements() {
     return batchSize * numPlanes * outputSize * outputSize;
 }
 VIRTUAL float *RandomTranslations::getOutput() {
+    if(outputWrapper->isDeviceDirty()) {
+        outputWrapper->copyToHost();
+    }
     return output;
 }
 VIRTUAL bool RandomTranslations::needsBackProp() {
@@ -92,18 +109,28 @@ VIRTUAL bool RandomTranslations::providesGradInputWrapper() const {
     return false;
 }
 VIRTUAL bool RandomTranslations::hasOutputWrapper() const {
-    return false;
+    return true;
 }
+VIRTUAL CLWrapper *RandomTranslations::getOutputWrapper() {
+    return outputWrapper;
+}
+// offsets are drawn on the device, per image, see PhiloxRandom
 VIRTUAL void RandomTranslations::forward() {
-    float *upstreamOutput = previousLayer->getOutput();
-    if(!training) {
-        memcpy(output, upstreamOutput, sizeof(float) * getOutputNumElements());
-        return;
+    CLWrapper *upstreamOutputWrapper = 0;
+    if(previousLayer->hasOutputWrapper()) {
+        upstreamOutputWrapper = previousLayer->getOutputWrapper();
+    } else {
+        float *upstreamOutput = previousLayer->getOutput();
+        upstreamOutputWrapper = cl->wrap(previousLayer->getOutputNumElements(), upstreamOutput);
+        upstreamOutputWrapper->copyToDevice();
+    }
+    if(training) {
+        random->randomTranslations(batchSize, numPlanes, inputSize, translateSize, upstreamOutputWrapper, outputWrapper);
+    } else {
+        copyBuffer->copy(getOutputNumElements(), upstreamOutputWrapper, outputWrapper);
     }
-    for(int n = 0; n < batchSize; n++) {
-        const int translateRows = RandomSingleton::instance()->uniformInt(- translateSize, translateSize);
-        const int translateCols = RandomSingleton::instance()->uniformInt(- translateSize, translateSize);
-        Translator::translate(n, numPlanes, inputSize, translateRows, translateCols, upstreamOutput, output);
+    if(!previousLayer->hasOutputWrapper()) {
+        delete upstreamOutputWrapper;
     }
 }
 VIRTUAL std::string RandomTranslations::asString() const {
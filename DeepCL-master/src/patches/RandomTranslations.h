@@ -16,6 +16,8 @@ class CLWrapper;
 class PoolingForward;
 class PoolingBackward;
 class RandomTranslationsMaker;
+class PhiloxRandom;
+class CopyBuffer;
 
 class RandomTranslations : public Layer {
 public:
@@ -25,7 +27,12 @@ public:
 
     const int outputSize;
 
+    EasyCL *const cl; // NOT owned by us
+    PhiloxRandom *random;
+    CopyBuffer *copyBuffer; // when not training
+
     float *output;
+    CLWrapper *outputWrapper;
 
     int batchSize;
     int allocatedSize;
@@ -35,7 +42,7 @@ public:
     // cog_addheaders.add()
     // ]]]
     // generated, using cog:
-    RandomTranslations(Layer *previousLayer, RandomTranslationsMaker *maker);
+    RandomTranslations(EasyCL *cl, Layer *previousLayer, RandomTranslationsMaker *maker);
     VIRTUAL ~RandomTranslations();
     VIRTUAL std::string getClassName() const;
     VIRTUAL void setBatchSize(int batchSize);
@@ -50,6 +57,7 @@ public:
     VIRTUAL int getPersistSize(int version) const;
     VIRTUAL bool providesGradInputWrapper() const;
     VIRTUAL bool hasOutputWrapper() const;
+    VIRTUAL CLWrapper *getOutputWrapper();
     VIRTUAL void forward();
     VIRTUAL std::string asString() const;
 
@@ -9,6 +9,6 @@
 #include "RandomTranslationsMaker.h"
 
 Layer *RandomTranslationsMaker::createLayer(Layer *previousLayer) {
-    return new RandomTranslations(previousLayer, this);
+    return new RandomTranslations(cl, previousLayer, this);
 }
 
@@ -14,6 +14,7 @@
 #include "util/stringhelper.h"
 
 #include "PoolingBackwardGpuNaive.h"
+#include "util/ProgramCache.h"
 
 using namespace std;
 
@@ -116,7 +117,7 @@ PoolingBackwardGpuNaive::PoolingBackwardGpuNaive(EasyCL *cl, bool padZeros, int
     "}\n"
     "\n"
     "";
-    kernel = cl->buildKernelFromString(kernelSource, "backward", options, "cl/PoolingBackwardGpuNaive.cl");
+    kernel = ProgramCache::buildKernelFromString(cl, kernelSource, "backward", options, "cl/PoolingBackwardGpuNaive.cl");
     // generated using cog, from cl/memset.cl:
     const char * kMemsetSource =  
     "// Copyright Hugh Perkins 2015 hughperkins at gmail\n"
@@ -133,7 +134,7 @@ PoolingBackwardGpuNaive::PoolingBackwardGpuNaive(EasyCL *cl, bool padZeros, int
     "}\n"
     "\n"
     "";
-    kMemset = cl->buildKernelFromString(kMemsetSource, "cl_memset", "", "cl/memset.cl");
+    kMemset = ProgramCache::buildKernelFromString(cl, kMemsetSource, "cl_memset", "", "cl/memset.cl");
     // [[[end]]]
 }
 
@@ -13,6 +13,7 @@
 #include "util/stringhelper.h"
 
 #include "PoolingForwardGpuNaive.h"
+#include "util/ProgramCache.h"
 
 //#include "test/PrintBuffer.h"
 
@@ -107,7 +108,7 @@ PoolingForwardGpuNaive::PoolingForwardGpuNaive(EasyCL *cl, bool padZeros, int nu
     "}\n"
     "\n"
     "";
-    kernel = cl->buildKernelFromString(kernelSource, "forwardNaive", options, "cl/pooling.cl");
+    kernel = ProgramCache::buildKernelFromString(cl, kernelSource, "forwardNaive", options, "cl/pooling.cl");
     // [[[end]]]
 //    kernel = cl->buildKernel("pooling.cl", "forwardNaive", options);
 }
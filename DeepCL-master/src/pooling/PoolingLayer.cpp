@@ -39,7 +39,8 @@ PoolingLayer::PoolingLayer(EasyCL *cl, Layer *previousLayer, PoolingMaker *maker
 //        outputCopiedToHost(false),
 //        gradInputCopiedToHost(false),
         batchSize(0),
-        allocatedSize(0){
+        allocatedSize(0),
+        fusedInto(0) {
     if(inputSize == 0){
 //        maker->net->print();
         throw runtime_error("Error: Pooling layer " + toString(layerIndex) + ": input image size is 0");
@@ -165,6 +166,9 @@ VIRTUAL ActivationFunction const *PoolingLayer::getActivationFunction() {
     return new LinearActivation();
 }
 VIRTUAL void PoolingLayer::forward() {
+    if(fusedInto != 0) {
+        return;
+    }
     CLWrapper *upstreamOutputWrapper = 0;
     if(previousLayer->hasOutputWrapper()) {
         upstreamOutputWrapper = previousLayer->getOutputWrapper();
@@ -191,6 +195,9 @@ VIRTUAL void PoolingLayer::forward() {
 }
 VIRTUAL void PoolingLayer::backward() {
     // have no weights to backprop to, just need to backprop the errors
+    if(fusedInto != 0) {
+        return;
+    }
 
     CLWrapper *gradOutputWrapper = 0;
     bool weOwnErrorsWrapper = false;
@@ -247,7 +254,14 @@ VIRTUAL void PoolingLayer::backward() {
     }
 }
 VIRTUAL std::string PoolingLayer::asString() const {
+    if(fusedInto != 0) {
+        return "PoolingLayer{ inputPlanes=" + toString(numPlanes) + " inputSize=" + toString(inputSize) + " poolingSize=" + toString(poolingSize) + " fused into layer " + toString(fusedInto->layerIndex) + " }";
+    }
     return "PoolingLayer{ inputPlanes=" + toString(numPlanes) + " inputSize=" + toString(inputSize) + " poolingSize=" + toString(poolingSize) + " }";
 }
+// called by ConvolutionalLayer::fuse, which then writes our output and selectors
+void PoolingLayer::fuseInto(Layer *convLayer) {
+    fusedInto = convLayer;
+}
 
 
@@ -45,6 +45,8 @@ public:
     int batchSize;
     int allocatedSize;
 
+    Layer *fusedInto; // NOT owned by us; the ConvolutionalLayer doing our work, if fused
+
     // [[[cog
     // import cog_addheaders
     // cog_addheaders.add()
@@ -73,6 +75,7 @@ public:
     VIRTUAL void forward();
     VIRTUAL void backward();
     VIRTUAL std::string asString() const;
+    void fuseInto(Layer *convLayer);
 
     // [[[end]]]
 };
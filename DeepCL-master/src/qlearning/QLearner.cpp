@@ -6,6 +6,7 @@
 
 #include "net/NeuralNet.h"
 #include "qlearning/array_helper.h"
+#include "qlearning/ReplayMemory.h"
 #include "trainers/Trainer.h"
 #include "qlearning/QLearner.h"
 
@@ -19,6 +20,7 @@ QLearner::QLearner(Trainer *trainer, Scenario *scenario, NeuralNet *net) :
     lambda = 0.9f;
     maxSamples = 32;
     epsilon = 0.1f;
+    historySize = 100000;
 //    learningRate = 0.1f;
 
     size = scenario->getPerceptionSize();
@@ -28,102 +30,93 @@ QLearner::QLearner(Trainer *trainer, Scenario *scenario, NeuralNet *net) :
     lastPerception = new float[ size * size * planes ];
     game = 0;
     lastAction = -1;
+
+    replayMemory = new ReplayMemory(size * size * planes, historySize);
+    allocatedSamples = 0;
+    sampleIndices = 0;
+    inputs = 0;
+    expectedValues = 0;
 }
 
 QLearner::~QLearner() {
     delete[] lastPerception;
+    delete replayMemory;
+    delete[] sampleIndices;
+    delete[] inputs;
+    delete[] expectedValues;
 }
 
-void QLearner::learnFromPast() {
-    const int availableSamples = history.size();
-    int batchSize = availableSamples >= maxSamples ? maxSamples : availableSamples;
-//    batchSize = ;
-    const int size = scenario->getPerceptionSize();
-    const int numActions = scenario->getNumActions();
-    net->setBatchSize(batchSize);
-
-//    cout << "batchSize: " << batchSize << endl;
+void QLearner::setHistorySize(int historySize) {
+    this->historySize = historySize;
+    replayMemory->setCapacity(historySize);
+}
 
-    // draw samples
-    Experience **experiences = new Experience *[ batchSize ];
-    for(int n = 0; n < batchSize; n++) {
-        int sampleIdx = myrand() % availableSamples;
-        Experience *experience = history[sampleIdx];
-        experiences[n] = experience;
-    }    
-
-    // copy in data 
-    float *afters = new float[ batchSize * planes * size * size ];
-    float *befores = new float[ batchSize * planes * size * size ];
-    for(int n = 0; n < batchSize; n++) {
-        Experience *experience = experiences[n]; 
-        arrayCopy(afters + n * planes * size * size, experience->after, planes * size * size);
-        arrayCopy(befores + n * planes * size * size, experience->before, planes * size * size);
+void QLearner::ensureScratch(int numSamples) {
+    if(numSamples <= allocatedSamples) {
+        return;
     }
+    delete[] sampleIndices;
+    delete[] inputs;
+    delete[] expectedValues;
+    allocatedSamples = numSamples;
+    sampleIndices = new int[ numSamples ];
+    inputs = new float[ 2 * numSamples * planes * size * size ];
+    expectedValues = new float[ numSamples * numActions ];
+}
 
-    // get next q values, based on forward prop 'afters'
-    net->forward(afters);
-    float const *allOutput = net->getOutput();
-    float *bestQ = new float[ batchSize ];
-    int *bestAction = new int[ batchSize ];
-    for(int n = 0; n < batchSize; n++) {
-        float const *output = allOutput + n * numActions;
-        float thisBestQ = output[0];
-        int thisBestAction = 0;
-        for(int action = 1; action < numActions; action++) {
-            if(output[action] > thisBestQ) {
-                thisBestQ = output[action];
-                thisBestAction = action;
-            }
-        }
-        bestQ[n] = thisBestQ;
-        bestAction[n] = thisBestAction;
-    }
-    // forward prop 'befores', set up expected values, and backprop
-    // new q values
-    net->forward(befores);
-    allOutput = net->getOutput();
-    float *expectedValues = new float[ numActions * batchSize ];
-    arrayCopy(expectedValues, allOutput, batchSize * numActions);
+void QLearner::learnFromPast() {
+    const int availableSamples = replayMemory->getSize();
+    int batchSize = availableSamples >= maxSamples ? maxSamples : availableSamples;
+    const int cubeSize = planes * size * size;
+    ensureScratch(batchSize);
+
+    // draw samples, and copy their states into one input array, afters first,
+    // so we get the next q values, and the current ones, in a single forward
+    replayMemory->sampleIndices(myrand, batchSize, sampleIndices);
+    float *afters = inputs;
+    float *befores = inputs + batchSize * cubeSize;
+    replayMemory->gather(batchSize, sampleIndices, befores, afters);
+    net->setBatchSize(2 * batchSize);
+    net->forward(inputs);
+    float const *afterOutput = net->getOutput();
+    float const *beforeOutput = afterOutput + batchSize * numActions;
+
+    // expected values are the current q values, except for the action taken,
+    // which gets the reward, plus the discounted best next q value
+    arrayCopy(expectedValues, beforeOutput, batchSize * numActions);
     for(int n = 0; n < batchSize; n++) {
-        Experience *experience = experiences[n]; 
-        if(experience->isEndState) {
-            expectedValues[ n * numActions + experience->action ] = experience->reward; 
+        const int sampleIdx = sampleIndices[n];
+        const int action = replayMemory->getAction(sampleIdx);
+        const float reward = replayMemory->getReward(sampleIdx);
+        if(replayMemory->getIsEndState(sampleIdx)) {
+            expectedValues[ n * numActions + action ] = reward;
         } else {
-            expectedValues[ n * numActions + experience->action ] = experience->reward + lambda * bestQ[n];        
+            float const *output = afterOutput + n * numActions;
+            float bestQ = output[0];
+            for(int nextAction = 1; nextAction < numActions; nextAction++) {
+                if(output[nextAction] > bestQ) {
+                    bestQ = output[nextAction];
+                }
+            }
+            expectedValues[ n * numActions + action ] = reward + lambda * bestQ;
         }
     }
     // backprop...
-//    throw runtime_error("need to implement this");
+    // shrinking the batch size doesnt reallocate, so the layers keep their
+    // 2 * batchSize buffers from above
+    net->setBatchSize(batchSize);
     TrainingContext context(epoch, 0);
     trainer->train(net, &context, befores, expectedValues);
-//    net->backward(learningRate / batchSize, expectedValues);
     net->setBatchSize(1);
 
     epoch++;
-
-    delete[] expectedValues;
-    delete[] bestQ;
-    delete[] bestAction;
-    delete[] afters;
-    delete[] befores;
-    delete[] experiences;
 }
 
 // this is now a scenario-free zone, and therefore no callbacks, and easy to wrap with
 // swig, cython etc.
 int QLearner::step(float lastReward, bool wasReset, float *perception) { // do one frame
     if(lastAction != -1) {
-        Experience *experience = new Experience(); 
-        experience->action = lastAction;
-        experience->reward = lastReward;
-        experience->isEndState = wasReset;
-        experience->before = new float[ size * size * planes ];
-        arrayCopy(experience->before, this->lastPerception, size * size * planes);
-//        scenario->getPerception(perception);
-        experience->after = new float[ size * size * planes ];
-        arrayCopy(experience->after, perception, size * size * planes);
-        history.push_back(experience);
+        replayMemory->add(this->lastPerception, lastAction, lastReward, wasReset, perception);
         if(wasReset) {
             game++;
         }
@@ -16,15 +16,7 @@
 #include "DeepCLDllExport.h"
 
 class NeuralNet;
-
-class Experience {
-public:
-    float *before;
-    int action;
-    float reward;
-    bool isEndState;
-    float *after;
-};
+class ReplayMemory;
 
 class DeepCL_EXPORT QLearner {
 public:
@@ -34,6 +26,7 @@ public:
     float lambda; // means: how far into the future do we look? (any number from 0.0 to 1.0 is possible)
     int maxSamples;  // how many samples from history do we revise after each action? (default: 32)
     float epsilon; // probability of exploring, instead of exploiting, 0.0 to 1.0 ok
+    int historySize; // how many past experiences do we keep, to sample from? (default: 100000)
 //    float learningRate; // learning rate for the neuralnet; depends on what is appropriate for your particular
 //                        // network design
 
@@ -48,6 +41,7 @@ public:
     void setLambda(float lambda) { this->lambda = lambda; }
     void setMaxSamples(int maxSamples) { this->maxSamples = maxSamples; }
     void setEpsilon(float epsilon) { this->epsilon = epsilon; }
+    void setHistorySize(int historySize); // forgets the history so far
 //    void setLearningRate(float learningRate) { this->learningRate = learningRate; }
 
 protected:
@@ -63,7 +57,16 @@ protected:
 
     MT19937 myrand;
 
-    std::vector< Experience * > history;
+    ReplayMemory *replayMemory;
+
+    // scratch for learnFromPast, for up to allocatedSamples samples
+    int allocatedSamples;
+    int *sampleIndices;
+    float *inputs; // afters, then befores, [2][sample][plane][row][col]
+    float *expectedValues;
+
+    void ensureScratch(int numSamples);
+
     Scenario *scenario; // NOT belong to us, dont delete
     NeuralNet *net; // NOT belong to us, dont delete
 };
@@ -0,0 +1,90 @@
+// Copyright Hugh Perkins 2016 hughperkins at gmail
+//
+// This Source Code Form is subject to the terms of the Mozilla Public License,
+// v. 2.0. If a copy of the MPL was not distributed with this file, You can
+// obtain one at http://mozilla.org/MPL/2.0/.
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#include "util/stringhelper.h"
+#include "qlearning/ReplayMemory.h"
+
+using namespace std;
+
+ReplayMemory::ReplayMemory(int cubeSize, int capacity) :
+        cubeSize(cubeSize),
+        capacity(capacity),
+        size(0),
+        next(0),
+        allocated(0) {
+    if(capacity <= 0) {
+        throw runtime_error("ReplayMemory: capacity should be positive, but is " + toString(capacity));
+    }
+}
+
+void ReplayMemory::add(float const *before, int action, float reward, bool isEndState, float const *after) {
+    if(next == allocated) {
+        grow();
+    }
+    memcpy(&befores[(long)next * cubeSize], before, sizeof(float) * cubeSize);
+    memcpy(&afters[(long)next * cubeSize], after, sizeof(float) * cubeSize);
+    actions[next] = action;
+    rewards[next] = reward;
+    isEndStates[next] = isEndState ? 1 : 0;
+    next = (next + 1) % capacity;
+    size = std::min(size + 1, capacity);
+}
+
+// numSamples indices, uniformly, with replacement
+void ReplayMemory::sampleIndices(MT19937 &myrand, int numSamples, int *indices) {
+    if(size == 0) {
+        throw runtime_error("ReplayMemory: cannot sample from an empty memory");
+    }
+    for(int n = 0; n < numSamples; n++) {
+        indices[n] = myrand() % size;
+    }
+}
+
+// copies the before and after states of the given experiences into befores
+// and afters, as [numSamples][cubeSize]
+void ReplayMemory::gather(int numSamples, int const *indices, float *befores, float *afters) {
+    for(int n = 0; n < numSamples; n++) {
+        long src = (long)indices[n] * cubeSize;
+        memcpy(befores + (long)n * cubeSize, &this->befores[src], sizeof(float) * cubeSize);
+        memcpy(afters + (long)n * cubeSize, &this->afters[src], sizeof(float) * cubeSize);
+    }
+}
+
+// also clears the memory
+void ReplayMemory::setCapacity(int capacity) {
+    if(capacity <= 0) {
+        throw runtime_error("ReplayMemory: capacity should be positive, but is " + toString(capacity));
+    }
+    this->capacity = capacity;
+    clear();
+}
+
+// forgets every experience, and frees the slabs
+void ReplayMemory::clear() {
+    size = 0;
+    next = 0;
+    allocated = 0;
+    vector<float>().swap(befores);
+    vector<float>().swap(afters);
+    vector<int>().swap(actions);
+    vector<float>().swap(rewards);
+    vector<char>().swap(isEndStates);
+}
+
+// only called while still filling up, when next == allocated < capacity
+void ReplayMemory::grow() {
+    allocated = std::min(capacity, std::max(1024, allocated * 2));
+    befores.resize((long)allocated * cubeSize);
+    afters.resize((long)allocated * cubeSize);
+    actions.resize(allocated);
+    rewards.resize(allocated);
+    isEndStates.resize(allocated);
+}
+
@@ -0,0 +1,65 @@
+// Copyright Hugh Perkins 2016 hughperkins at gmail
+//
+// This Source Code Form is subject to the terms of the Mozilla Public License,
+// v. 2.0. If a copy of the MPL was not distributed with this file, You can
+// obtain one at http://mozilla.org/MPL/2.0/.
+
+#pragma once
+
+#include <vector>
+
+#include "util/mt19937defs.h"
+
+#include "DeepCLDllExport.h"
+
+// Experience replay memory for QLearner, as a ring buffer of up to capacity
+// experiences.  Once full, each new experience overwrites the oldest.
+//
+// The before and after states are each kept in one packed float slab,
+// cubeSize floats per experience, so gathering a minibatch is one copy per
+// sample, straight into the net's input layout.  The slabs grow by doubling
+// up to capacity, so small runs dont pay for the whole capacity up front,
+// and once grown, adding an experience doesnt allocate.
+//
+// Indices are slots, in [0, getSize()), in no particular order, which is all
+// uniform sampling needs.
+class DeepCL_EXPORT ReplayMemory {
+public:
+    ReplayMemory(int cubeSize, int capacity);
+    void add(float const *before, int action, float reward, bool isEndState, float const *after);
+    void sampleIndices(MT19937 &myrand, int numSamples, int *indices);
+    void gather(int numSamples, int const *indices, float *befores, float *afters);
+    void setCapacity(int capacity);
+    void clear();
+
+    int getSize() { return size; }
+    int getCapacity() { return capacity; }
+    int getCubeSize() { return cubeSize; }
+    float const *getBefore(int index) { return &befores[(long)index * cubeSize]; }
+    float const *getAfter(int index) { return &afters[(long)index * cubeSize]; }
+    int getAction(int index) { return actions[index]; }
+    float getReward(int index) { return rewards[index]; }
+    bool getIsEndState(int index) { return isEndStates[index] != 0; }
+
+protected:
+    void grow();
+
+    const int cubeSize;
+    int capacity;
+    int size;
+    int next; // slot the next add() writes to
+    int allocated; // slots the slabs currently hold
+
+#ifdef _WIN32
+#pragma warning(disable: 4251)
+#endif
+    std::vector<float> befores;
+    std::vector<float> afters;
+    std::vector<int> actions;
+    std::vector<float> rewards;
+    std::vector<char> isEndStates;
+#ifdef _WIN32
+#pragma warning(default: 4251)
+#endif
+};
+
@@ -15,8 +15,9 @@
 #include "trainers/Adadelta.h"
 #include "loss/IAcceptsLabels.h"
 #include "batch/NetAction.h"
-#include "clmath/CLMathWrapper.h"
+#include "trainers/FusedUpdate.h"
 #include "batch/BatchData.h"
+#include "net/DeviceProfiler.h"
 
 //#include "test/Sampler.h"
 
@@ -35,47 +36,12 @@ VIRTUAL std::string Adadelta::asString() {
 }
 VIRTUAL void Adadelta::updateWeights(CLWrapper *weightsWrapper, CLWrapper *gradWeightsWrapper,
         AdadeltaState *trainerState) {
-    // need to calculate
     // sumGradSquared = decay * sumGradSquared + (1 - decay) * grad.square()
     // update = - sumUpdateSquared.sqrt() / sumGradSquared.sqrt() * grad
     // sumUpdateSquared = decay * sumUpdateSquared + (1 - decay) * update.squared()
     // weights += update
-
-    int numWeights = trainerState->numWeights;
-    float *working = new float[ numWeights ];
-    CLWrapper *workingWrapper = cl->wrap(numWeights, working);
-    workingWrapper->createOnDevice();
-
-    CLMathWrapper clWeights(weightsWrapper);
-    CLMathWrapper clGradWeights(gradWeightsWrapper);
-    CLMathWrapper clSumGradSquared(trainerState->sumGradSquaredWrapper);
-    CLMathWrapper clSumUpdateSquared(trainerState->sumUpdateSquaredWrapper);
-    CLMathWrapper clWorking(workingWrapper);
-
-    // following all happens on gpu, via clmathwrapper:
-    clWorking = clGradWeights;
-    clWorking.squared();
-    clWorking *= (1 - decay);
-    clSumGradSquared *= decay;
-    clSumGradSquared += clWorking;
-
-    clWorking = clSumGradSquared;
-    clWorking += 0.0000001f;
-    clWorking.inv();
-    clWorking *= clSumUpdateSquared;
-    clWorking.sqrt();
-    clWorking *= clGradWeights;
-    clWorking *= - 1;
-
-    clWeights += clWorking;
-
-    clSumUpdateSquared *= decay;
-    clWorking.squared();
-    clWorking *= (1 - decay);
-    clSumUpdateSquared += clWorking;
-
-    delete workingWrapper;
-    delete[] working;
+    fusedUpdate->adadelta(trainerState->numWeights, decay, trainerState->sumGradSquaredWrapper,
+        trainerState->sumUpdateSquaredWrapper, gradWeightsWrapper, weightsWrapper);
 }
 VIRTUAL BatchResult Adadelta::trainNet(NeuralNet *net, TrainingContext *context,
     float const*input, OutputData *outputData) {
@@ -96,12 +62,14 @@ VIRTUAL BatchResult Adadelta::trainNet(NeuralNet *net, TrainingContext *context,
             break;
         }
         if(layer->needsTrainerState()) {
+            DeviceProfiler::begin(layerIdx, layer, "update");
             updateWeights(layer->getWeightsWrapper(), layer->getGradWeightsWrapper(), 
                 dynamic_cast< AdadeltaState * >(layer->getTrainerState()) );
             if(layer->biased()) {
                 updateWeights(layer->getBiasWrapper(), layer->getGradBiasWrapper(),
                     dynamic_cast< AdadeltaState * >(layer->getBiasTrainerState()) );
             }
+            DeviceProfiler::end();
         }
     }
     return BatchResult(loss, numRight);
@@ -15,8 +15,9 @@
 #include "trainers/Adagrad.h"
 #include "loss/IAcceptsLabels.h"
 #include "batch/NetAction.h"
-#include "clmath/CLMathWrapper.h"
+#include "trainers/FusedUpdate.h"
 #include "batch/BatchData.h"
+#include "net/DeviceProfiler.h"
 
 //#include "test/Sampler.h"
 
@@ -39,31 +40,10 @@ VIRTUAL std::string Adagrad::asString() {
 }
 VIRTUAL void Adagrad::updateWeights(CLWrapper *weightsWrapper, CLWrapper *gradWeightsWrapper,
         AdagradState *trainerState) {
-
-    int numWeights = trainerState->numWeights;
-    float *working = new float[ numWeights ];
-    CLWrapper *workingWrapper = cl->wrap(numWeights, working);
-    workingWrapper->createOnDevice();
-
-    CLMathWrapper clWeights(weightsWrapper);
-    CLMathWrapper clGradWeights(gradWeightsWrapper);
-    CLMathWrapper clSumSquares(trainerState->sumSquaresWrapper);
-    CLMathWrapper clWorking(workingWrapper);
-
-    // following all happens on gpu, via clmathwrapper:
-    clWorking = clGradWeights;
-    clWorking.squared();
-    clSumSquares += clWorking;
-
-    clWorking = clSumSquares;
-    clWorking.sqrt();
-    clWorking.inv();
-    clWorking *= clGradWeights;
-    clWorking *= - learningRate;
-    clWeights += clWorking;
-
-    delete workingWrapper;
-    delete[] working;
+    // sumSquares += grad.squared()
+    // weights -= learningRate * grad / sumSquares.sqrt()
+    fusedUpdate->adagrad(trainerState->numWeights, learningRate, trainerState->sumSquaresWrapper,
+        gradWeightsWrapper, weightsWrapper);
 }
 VIRTUAL BatchResult Adagrad::trainNet(NeuralNet *net, TrainingContext *context,
     float const*input, OutputData *outputData) {
@@ -84,12 +64,14 @@ VIRTUAL BatchResult Adagrad::trainNet(NeuralNet *net, TrainingContext *context,
             break;
         }
         if(layer->needsTrainerState()) {
+            DeviceProfiler::begin(layerIdx, layer, "update");
             updateWeights(layer->getWeightsWrapper(), layer->getGradWeightsWrapper(), 
                 dynamic_cast< AdagradState * >(layer->getTrainerState()) );
             if(layer->biased()) {
                 updateWeights(layer->getBiasWrapper(), layer->getGradBiasWrapper(),
                     dynamic_cast< AdagradState * >(layer->getBiasTrainerState()) );
             }
+            DeviceProfiler::end();
         }
     }
     return BatchResult(loss, numRight);
@@ -12,10 +12,11 @@
 #include "util/stringhelper.h"
 #include "net/NeuralNet.h"
 #include "layer/Layer.h"
-#include "clmath/CLMathWrapper.h"
+#include "trainers/FusedUpdate.h"
 #include "loss/LossLayer.h"
 #include "loss/IAcceptsLabels.h"
 #include "batch/BatchData.h"
+#include "net/DeviceProfiler.h"
 
 using namespace std;
 
@@ -54,24 +55,7 @@ VIRTUAL void Annealer::updateWeights(float annealedLearningRate, CLWrapper *weig
     // hmmmm, so all we need to do is calculate:
     // annealedLearningRate = learningRate * pow(anneal, epoch)
     // weightsWrapper = weightsWrapper - annealedLearningRate * gradWeightsWrapper
-
-    int numWeights = weightsWrapper->size();
-
-    float *gradWeightsCopy = new float[ numWeights ];
-    CLWrapper *gradWeightsCopyWrapper = cl->wrap(numWeights, gradWeightsCopy);
-    gradWeightsCopyWrapper->createOnDevice();
-
-    CLMathWrapper gradWeights_(gradWeightsWrapper);
-    CLMathWrapper gradWeightsCopy_(gradWeightsCopyWrapper);
-    CLMathWrapper weights_(weightsWrapper);
-
-    // following all happens on gpu, via CLMathWrapper:
-    gradWeightsCopy_ = gradWeights_;
-    gradWeightsCopy_ *= - annealedLearningRate;
-    weights_ += gradWeightsCopy_;
-
-    delete gradWeightsCopyWrapper;
-    delete[] gradWeightsCopy;
+    fusedUpdate->plain(weightsWrapper->size(), annealedLearningRate, gradWeightsWrapper, weightsWrapper);
 }
 VIRTUAL BatchResult Annealer::trainNet( 
         NeuralNet *net, TrainingContext *context,
@@ -101,10 +85,12 @@ VIRTUAL BatchResult Annealer::trainNet(
             break;
         }
         if(layer->needsTrainerState()) {
+            DeviceProfiler::begin(layerIdx, layer, "update");
             updateWeights(annealedLearningRate, layer->getWeightsWrapper(), layer->getGradWeightsWrapper());
             if(layer->biased()) {
                 updateWeights(annealedLearningRate, layer->getBiasWrapper(), layer->getGradBiasWrapper());
             }
+            DeviceProfiler::end();
         }
     }
     return BatchResult(loss, numRight);
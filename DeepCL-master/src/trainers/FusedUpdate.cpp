@@ -0,0 +1,253 @@
+// Copyright Hugh Perkins 2016 hughperkins at gmail
+//
+// This Source Code Form is subject to the terms of the Mozilla Public License,
+// v. 2.0. If a copy of the MPL was not distributed with this file, You can
+// obtain one at http://mozilla.org/MPL/2.0/.
+
+#include <iostream>
+
+#include "EasyCL.h"
+#include "util/StatefulTimer.h"
+#include "trainers/FusedUpdate.h"
+#include "util/ProgramCache.h"
+
+using namespace std;
+
+#undef STATIC
+#undef VIRTUAL
+#define STATIC
+#define VIRTUAL
+
+PUBLIC FusedUpdate::FusedUpdate(EasyCL *cl) :
+        cl(cl) {
+}
+PUBLIC void FusedUpdate::plain(int N, float learningRate, CLWrapper *gradWeights, CLWrapper *weights) {
+    CLKernel *kernel = getKernel("plain_update");
+    kernel->in(N)
+        ->in(learningRate)
+        ->in(gradWeights)
+        ->inout(weights);
+    run(kernel, N);
+}
+PUBLIC void FusedUpdate::sgd(int N, float learningRate, float momentum, float weightDecay,
+        CLWrapper *lastUpdate, CLWrapper *gradWeights, CLWrapper *weights) {
+    CLKernel *kernel = getKernel("sgd_update");
+    kernel->in(N)
+        ->in(learningRate)
+        ->in(momentum)
+        ->in(weightDecay)
+        ->inout(lastUpdate)
+        ->in(gradWeights)
+        ->inout(weights);
+    run(kernel, N);
+}
+PUBLIC void FusedUpdate::adagrad(int N, float learningRate, CLWrapper *sumSquares, CLWrapper *gradWeights, CLWrapper *weights) {
+    CLKernel *kernel = getKernel("adagrad_update");
+    kernel->in(N)
+        ->in(learningRate)
+        ->inout(sumSquares)
+        ->in(gradWeights)
+        ->inout(weights);
+    run(kernel, N);
+}
+PUBLIC void FusedUpdate::rmsprop(int N, float learningRate, CLWrapper *meanSquares, CLWrapper *gradWeights, CLWrapper *weights) {
+    CLKernel *kernel = getKernel("rmsprop_update");
+    kernel->in(N)
+        ->in(learningRate)
+        ->inout(meanSquares)
+        ->in(gradWeights)
+        ->inout(weights);
+    run(kernel, N);
+}
+PUBLIC void FusedUpdate::adadelta(int N, float decay, CLWrapper *sumGradSquared, CLWrapper *sumUpdateSquared,
+        CLWrapper *gradWeights, CLWrapper *weights) {
+    CLKernel *kernel = getKernel("adadelta_update");
+    kernel->in(N)
+        ->in(decay)
+        ->inout(sumGradSquared)
+        ->inout(sumUpdateSquared)
+        ->in(gradWeights)
+        ->inout(weights);
+    run(kernel, N);
+}
+PUBLIC void FusedUpdate::nesterovLookahead(int N, float momentum, CLWrapper *oldWeights, CLWrapper *gradWeights, CLWrapper *weights) {
+    CLKernel *kernel = getKernel("nesterov_lookahead");
+    kernel->in(N)
+        ->in(momentum)
+        ->out(oldWeights)
+        ->in(gradWeights)
+        ->inout(weights);
+    run(kernel, N);
+}
+// leaves gradWeights scaled by -learningRate, which nesterovLookahead uses
+PUBLIC void FusedUpdate::nesterovUpdate(int N, float learningRate, float momentum,
+        CLWrapper *lastUpdate, CLWrapper *oldWeights, CLWrapper *gradWeights, CLWrapper *weights) {
+    CLKernel *kernel = getKernel("nesterov_update");
+    kernel->in(N)
+        ->in(learningRate)
+        ->in(momentum)
+        ->inout(lastUpdate)
+        ->in(oldWeights)
+        ->inout(gradWeights)
+        ->out(weights);
+    run(kernel, N);
+}
+PRIVATE CLKernel *FusedUpdate::getKernel(std::string name) {
+    string kernelName = "trainer_updates." + name;
+    if(cl->kernelExists(kernelName)) {
+        return cl->getKernel(kernelName);
+    }
+    string options = "";
+
+    // [[[cog
+    // import stringify
+    // stringify.write_kernel("kernel", "cl/trainer_updates.cl")
+    // ]]]
+    // generated using cog, from cl/trainer_updates.cl:
+    const char * kernelSource =  
+    "// Copyright Hugh Perkins 2016 hughperkins at gmail\n"
+    "//\n"
+    "// This Source Code Form is subject to the terms of the Mozilla Public License,\n"
+    "// v. 2.0. If a copy of the MPL was not distributed with this file, You can\n"
+    "// obtain one at http://mozilla.org/MPL/2.0/.\n"
+    "\n"
+    "// one kernel per trainer update, reading the gradient and trainer state, and\n"
+    "// writing the weights and state, in a single pass.  Same maths, in the same\n"
+    "// order, as the CLMathWrapper sequences they replace\n"
+    "\n"
+    "kernel void plain_update(\n"
+    "        const int N,\n"
+    "        const float learningRate,\n"
+    "        global const float *gradWeights,\n"
+    "        global float *weights) {\n"
+    "    const int globalId = get_global_id(0);\n"
+    "    if (globalId >= N) {\n"
+    "        return;\n"
+    "    }\n"
+    "    weights[globalId] += - learningRate * gradWeights[globalId];\n"
+    "}\n"
+    "\n"
+    "// weightDecay of 0 means no decay\n"
+    "kernel void sgd_update(\n"
+    "        const int N,\n"
+    "        const float learningRate,\n"
+    "        const float momentum,\n"
+    "        const float weightDecay,\n"
+    "        global float *lastUpdate,\n"
+    "        global const float *gradWeights,\n"
+    "        global float *weights) {\n"
+    "    const int globalId = get_global_id(0);\n"
+    "    if (globalId >= N) {\n"
+    "        return;\n"
+    "    }\n"
+    "    float update = momentum * lastUpdate[globalId] - learningRate * gradWeights[globalId];\n"
+    "    lastUpdate[globalId] = update;\n"
+    "    float weight = weights[globalId] + update;\n"
+    "    if (weightDecay > 0) {\n"
+    "        weight *= 1.0f - weightDecay;\n"
+    "    }\n"
+    "    weights[globalId] = weight;\n"
+    "}\n"
+    "\n"
+    "kernel void adagrad_update(\n"
+    "        const int N,\n"
+    "        const float learningRate,\n"
+    "        global float *sumSquares,\n"
+    "        global const float *gradWeights,\n"
+    "        global float *weights) {\n"
+    "    const int globalId = get_global_id(0);\n"
+    "    if (globalId >= N) {\n"
+    "        return;\n"
+    "    }\n"
+    "    float grad = gradWeights[globalId];\n"
+    "    float sumSquare = sumSquares[globalId] + grad * grad;\n"
+    "    sumSquares[globalId] = sumSquare;\n"
+    "    weights[globalId] += - learningRate * grad / sqrt(sumSquare);\n"
+    "}\n"
+    "\n"
+    "kernel void rmsprop_update(\n"
+    "        const int N,\n"
+    "        const float learningRate,\n"
+    "        global float *meanSquares,\n"
+    "        global const float *gradWeights,\n"
+    "        global float *weights) {\n"
+    "    const int globalId = get_global_id(0);\n"
+    "    if (globalId >= N) {\n"
+    "        return;\n"
+    "    }\n"
+    "    float grad = gradWeights[globalId];\n"
+    "    float meanSquare = 0.9f * meanSquares[globalId] + 0.1f * grad * grad;\n"
+    "    meanSquares[globalId] = meanSquare;\n"
+    "    weights[globalId] += - learningRate * grad / sqrt(meanSquare);\n"
+    "}\n"
+    "\n"
+    "// http://arxiv.org/pdf/1212.5701v1.pdf , page 3, Algorithm 1\n"
+    "kernel void adadelta_update(\n"
+    "        const int N,\n"
+    "        const float decay,\n"
+    "        global float *sumGradSquared,\n"
+    "        global float *sumUpdateSquared,\n"
+    "        global const float *gradWeights,\n"
+    "        global float *weights) {\n"
+    "    const int globalId = get_global_id(0);\n"
+    "    if (globalId >= N) {\n"
+    "        return;\n"
+    "    }\n"
+    "    float grad = gradWeights[globalId];\n"
+    "    float gradSquared = decay * sumGradSquared[globalId] + (1 - decay) * grad * grad;\n"
+    "    sumGradSquared[globalId] = gradSquared;\n"
+    "    float update = - sqrt(sumUpdateSquared[globalId] / (gradSquared + 0.0000001f)) * grad;\n"
+    "    weights[globalId] += update;\n"
+    "    sumUpdateSquared[globalId] = decay * sumUpdateSquared[globalId] + (1 - decay) * update * update;\n"
+    "}\n"
+    "\n"
+    "// saves the weights in oldWeights, and moves the weights to where the\n"
+    "// momentum will take them.  gradWeights still holds - learningRate * grad from\n"
+    "// the last nesterov_update\n"
+    "kernel void nesterov_lookahead(\n"
+    "        const int N,\n"
+    "        const float momentum,\n"
+    "        global float *oldWeights,\n"
+    "        global const float *gradWeights,\n"
+    "        global float *weights) {\n"
+    "    const int globalId = get_global_id(0);\n"
+    "    if (globalId >= N) {\n"
+    "        return;\n"
+    "    }\n"
+    "    float weight = weights[globalId];\n"
+    "    oldWeights[globalId] = weight;\n"
+    "    weights[globalId] = momentum * gradWeights[globalId] + weight;\n"
+    "}\n"
+    "\n"
+    "// gradWeights is the gradient at the lookahead weights.  It is left scaled by\n"
+    "// - learningRate, for the next nesterov_lookahead\n"
+    "kernel void nesterov_update(\n"
+    "        const int N,\n"
+    "        const float learningRate,\n"
+    "        const float momentum,\n"
+    "        global float *lastUpdate,\n"
+    "        global const float *oldWeights,\n"
+    "        global float *gradWeights,\n"
+    "        global float *weights) {\n"
+    "    const int globalId = get_global_id(0);\n"
+    "    if (globalId >= N) {\n"
+    "        return;\n"
+    "    }\n"
+    "    float scaledGrad = - learningRate * gradWeights[globalId];\n"
+    "    gradWeights[globalId] = scaledGrad;\n"
+    "    float update = momentum * lastUpdate[globalId] + scaledGrad;\n"
+    "    lastUpdate[globalId] = update;\n"
+    "    weights[globalId] = oldWeights[globalId] + update;\n"
+    "}\n"
+    "";
+    // [[[end]]]
+    CLKernel *kernel = ProgramCache::buildKernelFromString(cl, kernelSource, name, options, "cl/trainer_updates.cl");
+    cl->storeKernel(kernelName, kernel, true);
+    return kernel;
+}
+PRIVATE void FusedUpdate::run(CLKernel *kernel, int N) {
+    int workgroupSize = 64;
+    int numWorkgroups = (N + workgroupSize - 1) / workgroupSize;
+    kernel->run_1d(numWorkgroups * workgroupSize, workgroupSize);
+    StatefulTimer::instance()->timeCheck("FusedUpdate::run end");
+}
@@ -0,0 +1,58 @@
+// Copyright Hugh Perkins 2016 hughperkins at gmail
+//
+// This Source Code Form is subject to the terms of the Mozilla Public License,
+// v. 2.0. If a copy of the MPL was not distributed with this file, You can
+// obtain one at http://mozilla.org/MPL/2.0/.
+
+#pragma once
+
+#include <string>
+
+class EasyCL;
+class CLKernel;
+class CLWrapper;
+
+#include "DeepCLDllExport.h"
+
+#define VIRTUAL virtual
+#define STATIC static
+
+// Trainer weight updates as single kernels, from cl/trainer_updates.cl.
+//
+// Each call reads the gradient and the trainer state, and writes the weights
+// and the state, in one launch, without a cl->finish().  Replaces the
+// CLMathWrapper sequences the trainers used to run, which cost around a dozen
+// launches, each followed by a finish, plus a temporary device buffer, per
+// weights or bias array per batch.
+//
+// Kernels are built on first use, and stored in the EasyCL object, so they
+// are shared by all trainers on that device.
+class DeepCL_EXPORT FusedUpdate {
+    EasyCL *cl; // NOT delete
+
+    // [[[cog
+    // import cog_addheaders
+    // cog_addheaders.addv2()
+    // ]]]
+    // generated, using cog:
+
+    public:
+    FusedUpdate(EasyCL *cl);
+    void plain(int N, float learningRate, CLWrapper *gradWeights, CLWrapper *weights);
+    void sgd(int N, float learningRate, float momentum, float weightDecay,
+    CLWrapper *lastUpdate, CLWrapper *gradWeights, CLWrapper *weights);
+    void adagrad(int N, float learningRate, CLWrapper *sumSquares, CLWrapper *gradWeights, CLWrapper *weights);
+    void rmsprop(int N, float learningRate, CLWrapper *meanSquares, CLWrapper *gradWeights, CLWrapper *weights);
+    void adadelta(int N, float decay, CLWrapper *sumGradSquared, CLWrapper *sumUpdateSquared,
+    CLWrapper *gradWeights, CLWrapper *weights);
+    void nesterovLookahead(int N, float momentum, CLWrapper *oldWeights, CLWrapper *gradWeights, CLWrapper *weights);
+    void nesterovUpdate(int N, float learningRate, float momentum,
+    CLWrapper *lastUpdate, CLWrapper *oldWeights, CLWrapper *gradWeights, CLWrapper *weights);
+
+    private:
+    CLKernel *getKernel(std::string name);
+    void run(CLKernel *kernel, int N);
+
+    // [[[end]]]
+};
+
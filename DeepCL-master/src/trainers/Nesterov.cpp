@@ -15,8 +15,9 @@
 #include "trainers/Nesterov.h"
 #include "loss/IAcceptsLabels.h"
 #include "batch/NetAction.h"
-#include "clmath/CLMathWrapper.h"
+#include "trainers/FusedUpdate.h"
 #include "batch/BatchData.h"
+#include "net/DeviceProfiler.h"
 
 using namespace std;
 
@@ -40,17 +41,8 @@ VIRTUAL void Nesterov::loadFutureWeights(
         NesterovState *trainerState) {
     // this will save the old weights, into the trainerState,
     // and then add mom * dweights to them
-
-    // create CLMathWrapper objects, so we can do per-element maths on the gpu:
-    CLMathWrapper clOldWeights(trainerState->oldWeightsWrapper);
-    CLMathWrapper clWeights(weightsWrapper);
-    CLMathWrapper clGradWeights(gradWeightsWrapper);
-
-    // following happens on the gpu:
-    clOldWeights = clWeights;
-    clWeights = clGradWeights;
-    clWeights *= momentum;
-    clWeights += clOldWeights;
+    fusedUpdate->nesterovLookahead(trainerState->numWeights, momentum, trainerState->oldWeightsWrapper,
+        gradWeightsWrapper, weightsWrapper);
 }
 VIRTUAL void Nesterov::updateWeights(CLWrapper *weightsWrapper,
         CLWrapper *gradWeightsWrapper,
@@ -62,20 +54,8 @@ VIRTUAL void Nesterov::updateWeights(CLWrapper *weightsWrapper,
     //      dweights[t+1] = mom * dweights[t] - learningrate * gradient( 
     //                          weights[t] + mom * dweights[t])
     //      weights[t+1] = weights[t] + dweights[t+1]
-
-    // create CLMathWrapper objects, so we can do per-element maths on the gpu:
-    CLMathWrapper clLastUpdate(trainerState->lastUpdateWrapper);
-    CLMathWrapper clOldWeights(trainerState->oldWeightsWrapper);
-    CLMathWrapper clGradWeights(gradWeightsWrapper);
-    CLMathWrapper clWeights(weightsWrapper);
-
-    // following happens on the gpu, via CLMathWrapper:
-
-    clGradWeights *= - learningRate;
-    clLastUpdate *= momentum;
-    clLastUpdate += clGradWeights;
-    clWeights = clOldWeights;
-    clWeights += clLastUpdate;
+    fusedUpdate->nesterovUpdate(trainerState->numWeights, learningRate, momentum,
+        trainerState->lastUpdateWrapper, trainerState->oldWeightsWrapper, gradWeightsWrapper, weightsWrapper);
 }
 VIRTUAL BatchResult Nesterov::trainNet( 
     NeuralNet *net, TrainingContext *context,
@@ -105,12 +85,14 @@ VIRTUAL BatchResult Nesterov::trainNet(
             break;
         }
         if(layer->needsTrainerState()) {
+            DeviceProfiler::begin(layerIdx, layer, "lookahead");
             loadFutureWeights(layer->getWeightsWrapper(), layer->getGradWeightsWrapper(), 
                 dynamic_cast< NesterovState * >(layer->getTrainerState()) );
             if(layer->biased()) {
                 loadFutureWeights(layer->getBiasWrapper(), layer->getGradBiasWrapper(),
                     dynamic_cast< NesterovState * >(layer->getBiasTrainerState()) );
             }
+            DeviceProfiler::end();
         }
     }
 
@@ -128,12 +110,14 @@ VIRTUAL BatchResult Nesterov::trainNet(
             break;
         }
         if(layer->needsTrainerState()) {
+            DeviceProfiler::begin(layerIdx, layer, "update");
             updateWeights(layer->getWeightsWrapper(), layer->getGradWeightsWrapper(), 
                 dynamic_cast< NesterovState * >(layer->getTrainerState()) );
             if(layer->biased()) {
                 updateWeights(layer->getBiasWrapper(), layer->getGradBiasWrapper(),
                     dynamic_cast< NesterovState * >(layer->getBiasTrainerState()) );
             }
+            DeviceProfiler::end();
         }
     }
 
@@ -15,8 +15,9 @@
 #include "trainers/Rmsprop.h"
 #include "loss/IAcceptsLabels.h"
 #include "batch/NetAction.h"
-#include "clmath/CLMathWrapper.h"
+#include "trainers/FusedUpdate.h"
 #include "batch/BatchData.h"
+#include "net/DeviceProfiler.h"
 
 //#include "test/Sampler.h"
 
@@ -35,33 +36,10 @@ VIRTUAL std::string Rmsprop::asString() {
 }
 VIRTUAL void Rmsprop::updateWeights(CLWrapper *weightsWrapper, CLWrapper *gradWeightsWrapper,
         RmspropState *trainerState) {
-
-    int numWeights = trainerState->numWeights;
-    float *working = new float[ numWeights ];
-    CLWrapper *workingWrapper = cl->wrap(numWeights, working);
-    workingWrapper->createOnDevice();
-
-    CLMathWrapper clWeights(weightsWrapper);
-    CLMathWrapper clGradWeights(gradWeightsWrapper);
-    CLMathWrapper clMeanSquares(trainerState->meanSquareWrapper);
-    CLMathWrapper clWorking(workingWrapper);
-
-    // following all happens on gpu, via clmathwrapper:
-    clWorking = clGradWeights;
-    clWorking.squared();
-    clWorking *= 0.1f; // I guess this should be a hyper-parameter?
-    clMeanSquares *= 0.9f;
-    clMeanSquares += clWorking;
-
-    clWorking = clMeanSquares;
-    clWorking.sqrt();
-    clWorking.inv();
-    clWorking *= clGradWeights;
-    clWorking *= - learningRate;
-    clWeights += clWorking;
-
-    delete workingWrapper;
-    delete[] working;
+    // meanSquares = 0.9 * meanSquares + 0.1 * grad.squared()
+    // weights -= learningRate * grad / meanSquares.sqrt()
+    fusedUpdate->rmsprop(trainerState->numWeights, learningRate, trainerState->meanSquareWrapper,
+        gradWeightsWrapper, weightsWrapper);
 }
 VIRTUAL BatchResult Rmsprop::trainNet(NeuralNet *net, TrainingContext *context,
     float const*input, OutputData *outputData) {
@@ -82,12 +60,14 @@ VIRTUAL BatchResult Rmsprop::trainNet(NeuralNet *net, TrainingContext *context,
             break;
         }
         if(layer->needsTrainerState()) {
+            DeviceProfiler::begin(layerIdx, layer, "update");
             updateWeights(layer->getWeightsWrapper(), layer->getGradWeightsWrapper(), 
                 dynamic_cast< RmspropState * >(layer->getTrainerState()) );
             if(layer->biased()) {
                 updateWeights(layer->getBiasWrapper(), layer->getGradBiasWrapper(),
                     dynamic_cast< RmspropState * >(layer->getBiasTrainerState()) );
             }
+            DeviceProfiler::end();
         }
     }
     return BatchResult(loss, numRight);
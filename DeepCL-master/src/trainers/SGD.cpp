@@ -15,8 +15,9 @@
 #include "trainers/SGD.h"
 #include "loss/IAcceptsLabels.h"
 #include "batch/NetAction.h"
-#include "clmath/CLMathWrapper.h"
+#include "trainers/FusedUpdate.h"
 #include "batch/BatchData.h"
+#include "net/DeviceProfiler.h"
 
 using namespace std;
 
@@ -40,33 +41,12 @@ VIRTUAL std::string SGD::asString() {
 }
 VIRTUAL void SGD::updateWeights(CLWrapper *weightsWrapper, CLWrapper *gradWeightsWrapper,
         SGDState *trainerState) {
-    int numWeights = trainerState->numWeights;
-    CLWrapper *lastUpdateWrapper = trainerState->lastUpdateWrapper;
-    float *gradWeightsCopy = new float[ numWeights ];
-    CLWrapper *gradWeightsCopyWrapper = cl->wrap(numWeights, gradWeightsCopy);
-    gradWeightsCopyWrapper->createOnDevice();
-
-    CLMathWrapper lastUpdates_(lastUpdateWrapper);
-    CLMathWrapper gradWeights_(gradWeightsWrapper);
-    CLMathWrapper gradWeightsCopy_(gradWeightsCopyWrapper);
-    CLMathWrapper weights_(weightsWrapper);
-
-    // following all happens on gpu, via clmathwrapper:
-    lastUpdates_ *= momentum;
-    gradWeightsCopy_ = gradWeights_;
-    gradWeightsCopy_ *= - learningRate;
-    lastUpdates_ += gradWeightsCopy_;
-    weights_ += lastUpdates_;
-
-    if(weightDecay > 0) {
-        // apply weight decay, by multiplying the weights by (1.0f - weightDecay)
-        // so weightDecay == 0 means no decay; and weightDecay == 1.0f means
-        // weights go immediately to zero
-        weights_ *= 1.0f - weightDecay;
-    }
-
-    delete gradWeightsCopyWrapper;
-    delete[] gradWeightsCopy;
+    // lastUpdate = momentum * lastUpdate - learningRate * gradWeights
+    // weights += lastUpdate
+    // then, if weightDecay > 0, weights *= 1 - weightDecay, so weightDecay == 0
+    // means no decay, and weightDecay == 1.0f means weights go immediately to zero
+    fusedUpdate->sgd(trainerState->numWeights, learningRate, momentum, weightDecay,
+        trainerState->lastUpdateWrapper, gradWeightsWrapper, weightsWrapper);
 }
 VIRTUAL BatchResult SGD::trainNet(NeuralNet *net, TrainingContext *context,
     float const*input, OutputData *outputData) {
@@ -87,12 +67,14 @@ VIRTUAL BatchResult SGD::trainNet(NeuralNet *net, TrainingContext *context,
             break;
         }
         if(layer->needsTrainerState()) {
+            DeviceProfiler::begin(layerIdx, layer, "update");
             updateWeights(layer->getWeightsWrapper(), layer->getGradWeightsWrapper(), 
                 dynamic_cast< SGDState * >(layer->getTrainerState()) );
             if(layer->biased()) {
                 updateWeights(layer->getBiasWrapper(), layer->getGradBiasWrapper(),
                     dynamic_cast< SGDState * >(layer->getBiasTrainerState()) );
             }
+            DeviceProfiler::end();
         }
     }
     return BatchResult(loss, numRight);
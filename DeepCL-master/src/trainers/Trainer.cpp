@@ -11,10 +11,12 @@
 #include "util/stringhelper.h"
 #include "trainers/Trainer.h"
 #include "net/MultiNet.h"
+#include "net/DataParallelNet.h"
 #include "batch/NetAction.h"
 #include "trainers/TrainerStateMaker.h"
 #include "trainers/TrainerState.h"
 #include "layer/Layer.h"
+#include "trainers/FusedUpdate.h"
 
 using namespace std;
 
@@ -27,8 +29,10 @@ using namespace std;
 Trainer::Trainer(EasyCL *cl) :
     cl(cl),
     learningRate(0) {
+    fusedUpdate = new FusedUpdate(cl);
 }
 VIRTUAL Trainer::~Trainer() {
+    delete fusedUpdate;
 }
 VIRTUAL void Trainer::setLearningRate(float learningRate) {
     this->learningRate = learningRate;
@@ -39,6 +43,10 @@ VIRTUAL std::string Trainer::asString() {
 VIRTUAL BatchResult Trainer::train(Trainable *trainable, 
         TrainingContext *context,
         float const*input, float const*expectedOutput) {
+    DataParallelNet *dataParallel = dynamic_cast< DataParallelNet *>(trainable);
+    if(dataParallel != 0) {
+        return dataParallel->train(this, context, input, expectedOutput);
+    }
     MultiNet *multiNet = dynamic_cast< MultiNet *>(trainable);
     float loss = 0;
     if(multiNet != 0) {
@@ -56,6 +64,10 @@ VIRTUAL BatchResult Trainer::train(Trainable *trainable,
 VIRTUAL BatchResult Trainer::trainFromLabels(Trainable *trainable,
     TrainingContext *context,
     float const*input, int const*labels) {
+    DataParallelNet *dataParallel = dynamic_cast< DataParallelNet *>(trainable);
+    if(dataParallel != 0) {
+        return dataParallel->trainFromLabels(this, context, input, labels);
+    }
     MultiNet *multiNet = dynamic_cast< MultiNet *>(trainable);
     float loss = 0;
     int numRight = 0;
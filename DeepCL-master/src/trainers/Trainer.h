@@ -17,6 +17,7 @@ class Trainable;
 class EpochResult;
 class TrainerStateMaker;
 class BatchResult;
+class FusedUpdate;
 
 #include "trainers/TrainingContext.h"
 
@@ -58,6 +59,7 @@ public:
 //    NeuralNet *net;
 
     float learningRate;
+    FusedUpdate *fusedUpdate; // single-kernel weight updates, for the children
 
     virtual BatchResult trainNet(NeuralNet *net, TrainingContext *context,
         float const*input, float const*expectedOutput) = 0;
@@ -15,6 +15,8 @@
 #include "windows.h"
 #else
 #include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
 #endif
 
 #include "FileHelper.h"
@@ -108,6 +110,33 @@ PUBLIC STATIC void FileHelper::rename(std::string oldname, std::string newname)
     ::rename(localizePath(oldname).c_str(), localizePath(newname).c_str());
 }
 
+// blocks until what has been written to filepath is on the disk, not just in
+// the os cache, so it survives a power loss.  Except on Windows, filepath can
+// also be a directory, to make a rename within it durable
+PUBLIC STATIC void FileHelper::syncToDisk(std::string filepath) {
+    std::string localPath = localizePath(filepath);
+    #ifdef _WIN32
+        HANDLE file = CreateFile(localPath.c_str(), GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        if(file == INVALID_HANDLE_VALUE) {
+            throw std::runtime_error("failed to open file: " + localPath);
+        }
+        BOOL flushed = FlushFileBuffers(file);
+        CloseHandle(file);
+        if(!flushed) {
+            throw std::runtime_error("failed to sync " + localPath + " to disk");
+        }
+    #else
+        int fd = ::open(localPath.c_str(), O_RDONLY);
+        if(fd == -1) {
+            throw std::runtime_error("failed to open file: " + localPath);
+        }
+        int result = ::fsync(fd);
+        ::close(fd);
+        if(result == -1) {
+            throw std::runtime_error("failed to sync " + localPath + " to disk");
+        }
+    #endif
+}
 PUBLIC STATIC void FileHelper::remove(std::string filename) {
     ::remove(localizePath(filename).c_str());
 }
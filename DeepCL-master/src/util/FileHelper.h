@@ -32,6 +32,7 @@ class DeepCL_EXPORT FileHelper {
     STATIC void writeBinaryChunk(std::string filepath, char const*data, long startPos, long filesize);
     STATIC bool exists(const std::string filepath);
     STATIC void rename(std::string oldname, std::string newname);
+    STATIC void syncToDisk(std::string filepath);
     STATIC void remove(std::string filename);
     STATIC std::string localizePath(std::string path);
     STATIC std::string pathSeparator();
@@ -0,0 +1,115 @@
+// Copyright Hugh Perkins 2016 hughperkins at gmail
+//
+// This Source Code Form is subject to the terms of the Mozilla Public License,
+// v. 2.0. If a copy of the MPL was not distributed with this file, You can
+// obtain one at http://mozilla.org/MPL/2.0/.
+
+#include <stdexcept>
+#include <string>
+
+#ifdef _WIN32
+#include "windows.h"
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "util/FileHelper.h"
+#include "util/stringhelper.h"
+#include "util/MappedFile.h"
+
+using namespace std;
+
+#undef STATIC
+#undef VIRTUAL
+#define STATIC
+#define VIRTUAL
+
+PUBLIC MappedFile::MappedFile(std::string filepath) :
+        filepath(filepath),
+        data(0),
+        size(0) {
+    string localPath = FileHelper::localizePath(filepath);
+    #ifdef _WIN32
+    fileHandle = CreateFile(localPath.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL, NULL);
+    if(fileHandle == INVALID_HANDLE_VALUE) {
+        throw runtime_error("MappedFile: couldnt open file " + localPath);
+    }
+    LARGE_INTEGER fileSize;
+    GetFileSizeEx(fileHandle, &fileSize);
+    size = fileSize.QuadPart;
+    mappingHandle = CreateFileMapping(fileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+    if(mappingHandle == NULL) {
+        CloseHandle(fileHandle);
+        throw runtime_error("MappedFile: couldnt map file " + localPath);
+    }
+    data = (unsigned char *)MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0);
+    if(data == 0) {
+        CloseHandle(mappingHandle);
+        CloseHandle(fileHandle);
+        throw runtime_error("MappedFile: couldnt map file " + localPath);
+    }
+    #else
+    int fd = open(localPath.c_str(), O_RDONLY);
+    if(fd == -1) {
+        throw runtime_error("MappedFile: couldnt open file " + localPath);
+    }
+    struct stat status;
+    if(fstat(fd, &status) == -1) {
+        close(fd);
+        throw runtime_error("MappedFile: couldnt stat file " + localPath);
+    }
+    size = status.st_size;
+    void *mapped = mmap(0, size, PROT_READ, MAP_SHARED, fd, 0);
+    // the mapping keeps its own reference to the file
+    close(fd);
+    if(mapped == MAP_FAILED) {
+        throw runtime_error("MappedFile: couldnt map file " + localPath);
+    }
+    data = (unsigned char *)mapped;
+    #endif
+}
+PUBLIC MappedFile::~MappedFile() {
+    #ifdef _WIN32
+    UnmapViewOfFile(data);
+    CloseHandle(mappingHandle);
+    CloseHandle(fileHandle);
+    #else
+    munmap(data, size);
+    #endif
+}
+PUBLIC std::string MappedFile::getFilepath() {
+    return filepath;
+}
+PUBLIC const unsigned char *MappedFile::getData() {
+    return data;
+}
+PUBLIC long long MappedFile::getSize() {
+    return size;
+}
+// throws if [offset, offset + length) runs off the end of the file, eg for a
+// truncated dataset, rather than letting a later read fault
+PUBLIC void MappedFile::checkRange(long long offset, long long length) {
+    if(offset < 0 || length < 0 || offset + length > size) {
+        throw runtime_error("MappedFile: " + filepath + " is " + toString(size) + " bytes, cannot read "
+            + toString(length) + " bytes from offset " + toString(offset));
+    }
+}
+// hint that [offset, offset + length) will be read soon.  Clipped to the file,
+// and widened to whole pages, as madvise needs
+PUBLIC void MappedFile::willNeed(long long offset, long long length) {
+    #ifndef _WIN32
+    if(offset >= size || length <= 0) {
+        return;
+    }
+    if(offset + length > size) {
+        length = size - offset;
+    }
+    long long pageSize = sysconf(_SC_PAGESIZE);
+    long long start = offset - offset % pageSize;
+    madvise(data + start, length + (offset - start), MADV_WILLNEED);
+    #endif
+}
@@ -0,0 +1,49 @@
+// Copyright Hugh Perkins 2016 hughperkins at gmail
+//
+// This Source Code Form is subject to the terms of the Mozilla Public License,
+// v. 2.0. If a copy of the MPL was not distributed with this file, You can
+// obtain one at http://mozilla.org/MPL/2.0/.
+
+#pragma once
+
+#include <string>
+
+#include "DeepCLDllExport.h"
+
+#define VIRTUAL virtual
+#define STATIC static
+
+// Read-only memory mapping of a whole file.
+//
+// getData() points straight at the page cache, so reading records from it
+// costs no read() calls and no second copy of the file in our own buffers.
+// willNeed() asks the os to start reading a byte range in, ahead of when we
+// touch it; on platforms without madvise it does nothing.
+class DeepCL_EXPORT MappedFile {
+private:
+    std::string filepath;
+    unsigned char *data;
+    long long size;
+    #ifdef _WIN32
+    void *fileHandle;
+    void *mappingHandle;
+    #endif
+
+    // [[[cog
+    // import cog_addheaders
+    // cog_addheaders.addv2()
+    // ]]]
+    // generated, using cog:
+
+    public:
+    MappedFile(std::string filepath);
+    ~MappedFile();
+    std::string getFilepath();
+    const unsigned char *getData();
+    long long getSize();
+    void checkRange(long long offset, long long length);
+    void willNeed(long long offset, long long length);
+
+    // [[[end]]]
+};
+
@@ -0,0 +1,183 @@
+// Copyright Hugh Perkins 2016 hughperkins at gmail
+//
+// This Source Code Form is subject to the terms of the Mozilla Public License,
+// v. 2.0. If a copy of the MPL was not distributed with this file, You can
+// obtain one at http://mozilla.org/MPL/2.0/.
+
+#include <iostream>
+#include <vector>
+#include <cstring>
+#include <cstdio>
+#include <algorithm>
+
+#include "EasyCL.h"
+#include "util/ProgramCache.h"
+#include "util/FileHelper.h"
+#include "util/stringhelper.h"
+
+using namespace std;
+
+#undef STATIC
+#define STATIC
+#undef VIRTUAL
+#define VIRTUAL
+
+PUBLIC ProgramCache::ProgramCache() :
+        directory(""),
+        numHits(0),
+        numMisses(0) {
+}
+PUBLIC STATIC ProgramCache *ProgramCache::instance() {
+    static ProgramCache *thisinstance = new ProgramCache();
+    return thisinstance;
+}
+PUBLIC void ProgramCache::setDirectory(std::string directory) {
+    std::lock_guard<std::mutex> lock(mutex);
+    this->directory = directory;
+}
+PUBLIC std::string ProgramCache::getDirectory() {
+    return directory;
+}
+PUBLIC bool ProgramCache::enabled() {
+    return directory != "";
+}
+PUBLIC int ProgramCache::getNumHits() {
+    return numHits;
+}
+PUBLIC int ProgramCache::getNumMisses() {
+    return numMisses;
+}
+// drop-in replacement for cl->buildKernelFromString, using the singleton
+PUBLIC STATIC CLKernel *ProgramCache::buildKernelFromString(EasyCL *cl, std::string source, std::string kernelName, std::string options, std::string sourceFilename) {
+    return instance()->build(cl, source, kernelName, options, sourceFilename);
+}
+// The cache never makes a build fail: a missing, stale or unreadable entry just
+// means we build from source, via EasyCL, so compile errors are reported
+// exactly as before
+PUBLIC CLKernel *ProgramCache::build(EasyCL *cl, std::string source, std::string kernelName, std::string options, std::string sourceFilename) {
+    if(!enabled()) {
+        return cl->buildKernelFromString(source, kernelName, options, sourceFilename);
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    string key = makeKey(cl, source, options);
+    CLKernel *kernel = buildFromBinary(cl, key, source, kernelName, options, sourceFilename);
+    if(kernel != 0) {
+        numHits++;
+        return kernel;
+    }
+    numMisses++;
+    kernel = cl->buildKernelFromString(source, kernelName, options, sourceFilename);
+    storeBinary(cl, key, kernel);
+    return kernel;
+}
+// the source itself goes in as its hash and length, to keep the file headers
+// small
+PUBLIC STATIC std::string ProgramCache::makeKey(EasyCL *cl, std::string source, std::string options) {
+    char sourceHash[32];
+    sprintf(sourceHash, "%016llx", hash(source));
+    string key = getDeviceString(cl, CL_DEVICE_NAME);
+    key += "\n" + getDeviceString(cl, CL_DRIVER_VERSION);
+    key += "\n" + getDeviceString(cl, CL_DEVICE_VERSION);
+    key += "\n" + options;
+    key += "\n" + string(sourceHash) + " " + toString((int)source.size());
+    return key;
+}
+// 64-bit FNV-1a
+PUBLIC STATIC unsigned long long ProgramCache::hash(std::string value) {
+    unsigned long long result = 14695981039346656037ULL;
+    for(size_t i = 0; i < value.size(); i++) {
+        result ^= (unsigned char)value[i];
+        result *= 1099511628211ULL;
+    }
+    return result;
+}
+PRIVATE std::string ProgramCache::getFilepath(std::string key) {
+    char filename[32];
+    sprintf(filename, "%016llx.clbin", hash(key));
+    return directory + "/" + filename;
+}
+// file format: 4-byte key length, the key, then the program binary.  Returns 0
+// if there is no usable entry
+PRIVATE CLKernel *ProgramCache::buildFromBinary(EasyCL *cl, std::string key, std::string source, std::string kernelName, std::string options, std::string sourceFilename) {
+    string filepath = getFilepath(key);
+    if(!FileHelper::exists(filepath)) {
+        return 0;
+    }
+    long fileSize = 0;
+    char *data = FileHelper::readBinary(filepath, &fileSize);
+    unsigned int keyLength = 0;
+    if(fileSize >= (long)sizeof(keyLength)) {
+        memcpy(&keyLength, data, sizeof(keyLength));
+    }
+    long headerSize = (long)sizeof(keyLength) + keyLength;
+    CLKernel *kernel = 0;
+    if(fileSize > headerSize && string(data + sizeof(keyLength), keyLength) == key) {
+        size_t binarySize = fileSize - headerSize;
+        const unsigned char *binary = (const unsigned char *)(data + headerSize);
+        cl_int binaryStatus = CL_SUCCESS;
+        cl_int err = CL_SUCCESS;
+        cl_program program = clCreateProgramWithBinary(*cl->context, 1, &cl->device, &binarySize, &binary, &binaryStatus, &err);
+        if(err == CL_SUCCESS && binaryStatus == CL_SUCCESS) {
+            err = clBuildProgram(program, 1, &cl->device, options.c_str(), 0, 0);
+            cl_kernel clKernel = 0;
+            if(err == CL_SUCCESS) {
+                clKernel = clCreateKernel(program, kernelName.c_str(), &err);
+            }
+            if(err == CL_SUCCESS) {
+                kernel = new CLKernel(cl, sourceFilename, kernelName, source, program, clKernel);
+            } else {
+                clReleaseProgram(program);
+            }
+        } else if(err == CL_SUCCESS) {
+            clReleaseProgram(program);
+        }
+    } else {
+        cout << "ProgramCache: ignoring mismatched entry " << filepath << endl;
+    }
+    delete[] data;
+    return kernel;
+}
+// written to a temporary file, then renamed, so a concurrent reader never sees
+// a half-written entry.  Failures just mean no entry
+PRIVATE void ProgramCache::storeBinary(EasyCL *cl, std::string key, CLKernel *kernel) {
+    cl_program program = 0;
+    size_t binarySize = 0;
+    if(clGetKernelInfo(kernel->kernel, CL_KERNEL_PROGRAM, sizeof(program), &program, 0) != CL_SUCCESS
+            || clGetProgramInfo(program, CL_PROGRAM_BINARY_SIZES, sizeof(binarySize), &binarySize, 0) != CL_SUCCESS
+            || binarySize == 0) {
+        return;
+    }
+    unsigned int keyLength = (unsigned int)key.size();
+    size_t headerSize = sizeof(keyLength) + keyLength;
+    vector<char> data(headerSize + binarySize);
+    memcpy(&data[0], &keyLength, sizeof(keyLength));
+    memcpy(&data[sizeof(keyLength)], key.c_str(), keyLength);
+    unsigned char *binary = (unsigned char *)&data[headerSize];
+    if(clGetProgramInfo(program, CL_PROGRAM_BINARIES, sizeof(binary), &binary, 0) != CL_SUCCESS) {
+        return;
+    }
+    string filepath = getFilepath(key);
+    string tempPath = filepath + "~";
+    try {
+        if(!FileHelper::folderExists(directory)) {
+            FileHelper::createDirectory(directory);
+        }
+        FileHelper::writeBinary(tempPath, &data[0], (long)data.size());
+        if(FileHelper::exists(filepath)) {
+            FileHelper::remove(filepath);
+        }
+        FileHelper::rename(tempPath, filepath);
+    } catch(runtime_error &e) {
+        cout << "ProgramCache: failed to write " << filepath << ": " << e.what() << endl;
+    }
+}
+PRIVATE STATIC std::string ProgramCache::getDeviceString(EasyCL *cl, int info) {
+    char buffer[1024];
+    size_t size = 0;
+    cl_int err = clGetDeviceInfo(cl->device, (cl_device_info)info, sizeof(buffer) - 1, buffer, &size);
+    if(err != CL_SUCCESS) {
+        return "unknown";
+    }
+    buffer[std::min(size, sizeof(buffer) - 1)] = 0;
+    return trim(string(buffer));
+}
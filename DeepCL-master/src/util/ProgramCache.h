@@ -0,0 +1,73 @@
+// Copyright Hugh Perkins 2016 hughperkins at gmail
+//
+// This Source Code Form is subject to the terms of the Mozilla Public License,
+// v. 2.0. If a copy of the MPL was not distributed with this file, You can
+// obtain one at http://mozilla.org/MPL/2.0/.
+
+#pragma once
+
+#include <string>
+#include <mutex>
+
+#include "DeepCLDllExport.h"
+
+class EasyCL;
+class CLKernel;
+
+#define VIRTUAL virtual
+#define STATIC static
+
+// Persistent cache of compiled OpenCL program binaries, so that a second run of
+// deepcl_train or deepcl_predict on the same device skips the OpenCL compiler.
+//
+// Call ProgramCache::buildKernelFromString wherever we would call
+// cl->buildKernelFromString.  The key is the device name, driver version and
+// device version, the build options, and the kernel source, so any change to a
+// template parameter, a define, or the driver gives a new entry.  On a hit we
+// create the program with clCreateProgramWithBinary; on a miss, or if the
+// binary is rejected, we build from source as before, then write the binary.
+//
+// Nothing is read or written until a directory has been set, eg via
+// `kernelcachedir=` in deepcl_train.  One file per program:
+//   <directory>/<64-bit key hash, in hex>.clbin
+class DeepCL_EXPORT ProgramCache {
+private:
+    #ifdef _WIN32
+    #pragma warning(disable: 4251)
+    #endif
+    std::mutex mutex;
+    #ifdef _WIN32
+    #pragma warning(default: 4251)
+    #endif
+    std::string directory;
+    int numHits;
+    int numMisses;
+
+    // [[[cog
+    // import cog_addheaders
+    // cog_addheaders.addv2()
+    // ]]]
+    // generated, using cog:
+
+    public:
+    ProgramCache();
+    STATIC ProgramCache *instance();
+    void setDirectory(std::string directory);
+    std::string getDirectory();
+    bool enabled();
+    int getNumHits();
+    int getNumMisses();
+    STATIC CLKernel *buildKernelFromString(EasyCL *cl, std::string source, std::string kernelName, std::string options, std::string sourceFilename);
+    CLKernel *build(EasyCL *cl, std::string source, std::string kernelName, std::string options, std::string sourceFilename);
+    STATIC std::string makeKey(EasyCL *cl, std::string source, std::string options);
+    STATIC unsigned long long hash(std::string value);
+
+    private:
+    std::string getFilepath(std::string key);
+    CLKernel *buildFromBinary(EasyCL *cl, std::string key, std::string source, std::string kernelName, std::string options, std::string sourceFilename);
+    void storeBinary(EasyCL *cl, std::string key, CLKernel *kernel);
+    STATIC std::string getDeviceString(EasyCL *cl, int info);
+
+    // [[[end]]]
+};
+
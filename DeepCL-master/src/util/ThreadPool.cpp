@@ -0,0 +1,112 @@
+// Copyright Hugh Perkins 2016 hughperkins at gmail
+//
+// This Source Code Form is subject to the terms of the Mozilla Public License,
+// v. 2.0. If a copy of the MPL was not distributed with this file, You can
+// obtain one at http://mozilla.org/MPL/2.0/.
+
+#include <algorithm>
+
+#include "util/ThreadPool.h"
+
+using namespace std;
+
+#undef STATIC
+#define STATIC
+#undef VIRTUAL
+#define VIRTUAL
+
+// numThreads <= 0 means defaultNumThreads()
+PUBLIC ThreadPool::ThreadPool(int numThreads) :
+        numThreads(numThreads <= 0 ? defaultNumThreads() : numThreads),
+        numTasks(0),
+        nextTask(0),
+        tasksRemaining(0),
+        stopping(false) {
+    // with a single thread, parallelFor just runs inline, on the caller's thread
+    if(this->numThreads > 1) {
+        for(int i = 0; i < this->numThreads; i++) {
+            threads.push_back(std::thread(&ThreadPool::workerLoop, this, i));
+        }
+    }
+}
+PUBLIC ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    workAvailable.notify_all();
+    for(int i = 0; i < (int)threads.size(); i++) {
+        threads[i].join();
+    }
+}
+PUBLIC int ThreadPool::getNumThreads() {
+    return numThreads;
+}
+PUBLIC void ThreadPool::parallelFor(int numTasks, std::function<void(int, int)> fn) {
+    if(numTasks <= 0) {
+        return;
+    }
+    if(threads.size() == 0) {
+        for(int task = 0; task < numTasks; task++) {
+            fn(task, 0);
+        }
+        return;
+    }
+    std::lock_guard<std::mutex> callLock(callMutex);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        job = fn;
+        error = std::exception_ptr();
+        this->numTasks = numTasks;
+        nextTask = 0;
+        tasksRemaining = numTasks;
+    }
+    workAvailable.notify_all();
+    std::exception_ptr thisError;
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        while(tasksRemaining > 0) {
+            workDone.wait(lock);
+        }
+        job = std::function<void(int, int)>();
+        this->numTasks = 0;
+        nextTask = 0;
+        thisError = error;
+        error = std::exception_ptr();
+    }
+    if(thisError) {
+        std::rethrow_exception(thisError);
+    }
+}
+// one per hardware thread, or 1 if the runtime cant tell us
+PUBLIC STATIC int ThreadPool::defaultNumThreads() {
+    return std::max(1, (int)std::thread::hardware_concurrency());
+}
+PRIVATE void ThreadPool::workerLoop(int threadId) {
+    std::unique_lock<std::mutex> lock(mutex);
+    while(true) {
+        while(!stopping && nextTask >= numTasks) {
+            workAvailable.wait(lock);
+        }
+        if(stopping) {
+            return;
+        }
+        int task = nextTask++;
+        lock.unlock();
+        // job is only reset once tasksRemaining reaches 0, so safe to use unlocked
+        try {
+            job(task, threadId);
+        } catch(...) {
+            lock.lock();
+            if(!error) {
+                error = std::current_exception();
+            }
+            lock.unlock();
+        }
+        lock.lock();
+        tasksRemaining--;
+        if(tasksRemaining == 0) {
+            workDone.notify_all();
+        }
+    }
+}
@@ -0,0 +1,67 @@
+// Copyright Hugh Perkins 2016 hughperkins at gmail
+//
+// This Source Code Form is subject to the terms of the Mozilla Public License,
+// v. 2.0. If a copy of the MPL was not distributed with this file, You can
+// obtain one at http://mozilla.org/MPL/2.0/.
+
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <exception>
+
+#include "DeepCLDllExport.h"
+
+#define VIRTUAL virtual
+#define STATIC static
+
+// Fixed set of worker threads, created once, that run parallelFor jobs.
+//
+// parallelFor(numTasks, fn) calls fn(task, threadId) once for every task in
+// [0, numTasks), and blocks until they have all finished.  threadId is in
+// [0, getNumThreads()), and no two concurrently running tasks share one, so
+// callers can use it to index per-thread scratch buffers.  If a task throws,
+// the first exception is rethrown from parallelFor, after all tasks are done.
+class DeepCL_EXPORT ThreadPool {
+private:
+    #ifdef _WIN32
+    #pragma warning(disable: 4251)
+    #endif
+    std::vector<std::thread> threads;
+    std::mutex mutex;
+    std::mutex callMutex; // serializes concurrent parallelFor callers
+    std::condition_variable workAvailable;
+    std::condition_variable workDone;
+    std::function<void(int, int)> job;
+    std::exception_ptr error;
+    #ifdef _WIN32
+    #pragma warning(default: 4251)
+    #endif
+    int numThreads;
+    int numTasks;
+    int nextTask;
+    int tasksRemaining;
+    bool stopping;
+
+    // [[[cog
+    // import cog_addheaders
+    // cog_addheaders.addv2()
+    // ]]]
+    // generated, using cog:
+
+    public:
+    ThreadPool(int numThreads);
+    ~ThreadPool();
+    int getNumThreads();
+    void parallelFor(int numTasks, std::function<void(int, int)> fn);
+    STATIC int defaultNumThreads();
+
+    private:
+    void workerLoop(int threadId);
+
+    // [[[end]]]
+};
+
@@ -91,5 +91,20 @@ public:
       last = thistime;
       return timemilliseconds;
    }
+
+   // same as lap(), but doesnt truncate to whole milliseconds, so we can
+   // time short kernel runs
+   double lapMicroseconds() {
+    #ifdef WINNOCHRONO
+       DWORD thistime = getCount();
+      double timemicroseconds = (thistime - last) * 1000.0;
+       #else
+      std::chrono::time_point<std::chrono::high_resolution_clock> thistime = getCount();
+    std::chrono::duration<double> change = thistime - last;
+      double timemicroseconds = static_cast<double>(std::chrono::duration_cast<std::chrono::microseconds> (change).count());
+       #endif
+      last = thistime;
+      return timemicroseconds;
+   }
 };
 
@@ -0,0 +1,135 @@
+// Copyright Hugh Perkins 2016 hughperkins at gmail
+//
+// This Source Code Form is subject to the terms of the Mozilla Public License,
+// v. 2.0. If a copy of the MPL was not distributed with this file, You can
+// obtain one at http://mozilla.org/MPL/2.0/.
+
+#include <iostream>
+#include <chrono>
+
+#include "weights/CheckpointWriter.h"
+#include "weights/WeightsPersister.h"
+#include "util/stringhelper.h"
+
+using namespace std;
+
+#undef STATIC
+#define STATIC
+#undef VIRTUAL
+#define VIRTUAL
+
+// fileVersion is WeightsPersister::latestVersion or
+// WeightsPersister::perLayerVersion
+PUBLIC CheckpointWriter::CheckpointWriter(int fileVersion) :
+        fileVersion(fileVersion),
+        havePending(false),
+        busy(false),
+        stopping(false),
+        numWritten(0),
+        numDropped(0),
+        snapshotMilliseconds(0) {
+    writerThread = std::thread(&CheckpointWriter::writerLoop, this);
+}
+PUBLIC CheckpointWriter::~CheckpointWriter() {
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        while(havePending || busy) {
+            changed.wait(lock);
+        }
+        stopping = true;
+        changed.notify_all();
+    }
+    writerThread.join();
+    if(error) {
+        try {
+            std::rethrow_exception(error);
+        } catch(std::exception &e) {
+            cout << "CheckpointWriter: writing weights failed: " << e.what() << endl;
+        }
+    }
+}
+PUBLIC void CheckpointWriter::persistWeights(std::string filepath, std::string trainingConfigString, NeuralNet *net, int epoch, int batch, float annealedLearningRate, int numRight, float loss) {
+    rethrowError();
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    WeightsPersister::serialize(fileVersion, &staging, trainingConfigString, net, epoch, batch, annealedLearningRate, numRight, loss);
+    std::unique_lock<std::mutex> lock(mutex);
+    if(havePending) {
+        if(pendingFilepath != filepath) {
+            // a different file: wait for its turn, rather than lose it
+            while(havePending) {
+                changed.wait(lock);
+            }
+        } else {
+            numDropped++;
+        }
+    }
+    staging.swap(pending);
+    pendingFilepath = filepath;
+    havePending = true;
+    snapshotMilliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    changed.notify_all();
+}
+// waits until every snapshot so far is on disk
+PUBLIC void CheckpointWriter::flush() {
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        while(havePending || busy) {
+            changed.wait(lock);
+        }
+    }
+    rethrowError();
+}
+PUBLIC int CheckpointWriter::getNumWritten() {
+    std::unique_lock<std::mutex> lock(mutex);
+    return numWritten;
+}
+PUBLIC int CheckpointWriter::getNumDropped() {
+    std::unique_lock<std::mutex> lock(mutex);
+    return numDropped;
+}
+// time the calling thread spent in persistWeights, ie what checkpointing
+// costs training
+PUBLIC double CheckpointWriter::getSnapshotMilliseconds() {
+    std::unique_lock<std::mutex> lock(mutex);
+    return snapshotMilliseconds;
+}
+PRIVATE void CheckpointWriter::rethrowError() {
+    std::exception_ptr thisError;
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        thisError = error;
+        error = std::exception_ptr();
+    }
+    if(thisError) {
+        std::rethrow_exception(thisError);
+    }
+}
+PRIVATE void CheckpointWriter::writerLoop() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while(true) {
+        while(!havePending && !stopping) {
+            changed.wait(lock);
+        }
+        if(!havePending) {
+            return;
+        }
+        pending.swap(writing);
+        writingFilepath = pendingFilepath;
+        havePending = false;
+        busy = true;
+        changed.notify_all();
+        lock.unlock();
+        try {
+            WeightsPersister::writeAtomically(writingFilepath, &writing[0], (long)writing.size());
+            cout << "wrote weights to file " + writingFilepath + ", filesize " + toString(writing.size() / 1024) + "KB\n" << std::flush;
+            lock.lock();
+            numWritten++;
+        } catch(...) {
+            lock.lock();
+            error = std::current_exception();
+        }
+        busy = false;
+        changed.notify_all();
+    }
+}
+
@@ -0,0 +1,84 @@
+// Copyright Hugh Perkins 2016 hughperkins at gmail
+//
+// This Source Code Form is subject to the terms of the Mozilla Public License,
+// v. 2.0. If a copy of the MPL was not distributed with this file, You can
+// obtain one at http://mozilla.org/MPL/2.0/.
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+
+#include "DeepCLDllExport.h"
+
+class NeuralNet;
+
+#define VIRTUAL virtual
+#define STATIC static
+
+// Writes weights files on a background thread, so training only pauses for as
+// long as it takes to copy the weights off the device.
+//
+// persistWeights snapshots the net into a staging buffer, using
+// WeightsPersister::serialize, on the calling thread, since that is the thread
+// that owns the net's OpenCL queue, then hands the buffer to the writer
+// thread, which writes it with WeightsPersister::writeAtomically.  If the
+// writer is still busy with an earlier file when a newer snapshot for it
+// arrives, the snapshot that hadnt started yet is dropped, since the newer
+// one replaces it anyway.  The three buffers are reused, so after the first
+// checkpoint nothing is allocated.
+//
+// An exception on the writer thread comes out of the next persistWeights, or
+// flush.  The destructor waits for the pending write.
+class DeepCL_EXPORT CheckpointWriter {
+private:
+    int fileVersion;
+
+    #ifdef _WIN32
+    #pragma warning(disable: 4251)
+    #endif
+    std::vector<char> staging; // filled by the training thread
+    std::vector<char> pending; // waiting for the writer
+    std::vector<char> writing; // being written
+    std::string pendingFilepath;
+    std::string writingFilepath;
+    std::thread writerThread;
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::exception_ptr error;
+    #ifdef _WIN32
+    #pragma warning(default: 4251)
+    #endif
+    bool havePending;
+    bool busy;
+    bool stopping;
+    int numWritten;
+    int numDropped;
+    double snapshotMilliseconds;
+
+    // [[[cog
+    // import cog_addheaders
+    // cog_addheaders.addv2()
+    // ]]]
+    // generated, using cog:
+
+    public:
+    CheckpointWriter(int fileVersion);
+    ~CheckpointWriter();
+    void persistWeights(std::string filepath, std::string trainingConfigString, NeuralNet *net, int epoch, int batch, float annealedLearningRate, int numRight, float loss);
+    void flush();
+    int getNumWritten();
+    int getNumDropped();
+    double getSnapshotMilliseconds();
+
+    private:
+    void rethrowError();
+    void writerLoop();
+
+    // [[[end]]]
+};
+
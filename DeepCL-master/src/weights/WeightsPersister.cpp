@@ -6,8 +6,10 @@
 
 #include <iostream>
 #include <cstring>
+#include <vector>
 
 #include "util/FileHelper.h"
+#include "util/MappedFile.h"
 #include "net/NeuralNet.h"
 #include "layer/Layer.h"
 #include "weights/WeightsPersister.h"
@@ -75,47 +77,122 @@ STATIC int WeightsPersister::getArrayOffsetForLayer(int version, NeuralNet *net,
     }
     return pos;
 }
-// this will either succeed or fail in general
-// in the worst case, you can find the weights in a file postfixed with '~', if 
-// the machine fails right in between the 'delete' and the 'rename', but you 
-// should ideally never actually lose the weights file (unless the drive itself
-// fails of course...)
 STATIC void WeightsPersister::persistWeights(std::string filepath, std::string trainingConfigString, NeuralNet *net, int epoch, int batch, float annealedLearningRate, int numRight, float loss) { // we should probably rename 'weights' to 'model' now that we are storing normalization data too?
-    int headerLength = 1024;
-    int totalWeightsSize = getTotalNumWeights(latestVersion, net);
-    char *persistArray = new char[headerLength + totalWeightsSize * sizeof(float) ];
+    persistWeights(latestVersion, filepath, trainingConfigString, net, epoch, batch, annealedLearningRate, numRight, loss);
+}
+// fileVersion is latestVersion, for one array of all the weights, or
+// perLayerVersion, for a section per layer, see serialize
+STATIC void WeightsPersister::persistWeights(int fileVersion, std::string filepath, std::string trainingConfigString, NeuralNet *net, int epoch, int batch, float annealedLearningRate, int numRight, float loss) {
+    vector<char> buffer;
+    serialize(fileVersion, &buffer, trainingConfigString, net, epoch, batch, annealedLearningRate, numRight, loss);
+    writeAtomically(filepath, &buffer[0], (long)buffer.size());
+    std::cout << "wrote weights to file, filesize " << (buffer.size() / 1024) << "KB" << std::endl;
+}
+// copies the weights off the device into buffer, which is resized to hold the
+// whole file.  buffer can be reused from one checkpoint to the next, to save
+// reallocating it.
+//
+// Both file versions start with the same 1024 byte header.  After it, version
+// 3 has all the layers' weights as one array.  perLayerVersion has the layer
+// persist version, the number of sections, then per section the layer index,
+// number of floats, and the byte offset of its floats from the start of the
+// file, 64-byte aligned, so a mapping of the file can be used directly
+STATIC void WeightsPersister::serialize(int fileVersion, std::vector<char> *buffer, std::string trainingConfigString, NeuralNet *net, int epoch, int batch, float annealedLearningRate, int numRight, float loss) {
+    const int headerLength = 1024;
+    if(fileVersion == latestVersion) {
+        int totalWeightsSize = getTotalNumWeights(latestVersion, net);
+        buffer->resize(headerLength + totalWeightsSize * sizeof(float));
+        copyNetWeightsToArray(latestVersion, net, reinterpret_cast<float *>(&(*buffer)[headerLength]));
+    } else if(fileVersion == perLayerVersion) {
+        vector<int> layers;
+        for(int layerIdx = 1; layerIdx < net->getNumLayers(); layerIdx++) {
+            if(net->getLayer(layerIdx)->getPersistSize(latestVersion) > 0) {
+                layers.push_back(layerIdx);
+            }
+        }
+        const int numSections = (int)layers.size();
+        long long offset = alignSection(headerLength + 2 * sizeof(int) + numSections * sectionEntrySize);
+        vector<long long> offsets(numSections);
+        for(int i = 0; i < numSections; i++) {
+            offsets[i] = offset;
+            offset = alignSection(offset + net->getLayer(layers[i])->getPersistSize(latestVersion) * sizeof(float));
+        }
+        buffer->resize(offset);
+        memset(&(*buffer)[headerLength], 0, offset - headerLength);
+        char *table = &(*buffer)[headerLength];
+        reinterpret_cast<int *>(table)[0] = latestVersion;
+        reinterpret_cast<int *>(table)[1] = numSections;
+        for(int i = 0; i < numSections; i++) {
+            Layer *layer = net->getLayer(layers[i]);
+            char *entry = table + 2 * sizeof(int) + i * sectionEntrySize;
+            reinterpret_cast<int *>(entry)[0] = layers[i];
+            reinterpret_cast<int *>(entry)[1] = layer->getPersistSize(latestVersion);
+            memcpy(entry + 2 * sizeof(int), &offsets[i], sizeof(long long));
+            layer->persistToArray(latestVersion, reinterpret_cast<float *>(&(*buffer)[offsets[i]]));
+        }
+    } else {
+        throw runtime_error("cannot write weights file version " + toString(fileVersion));
+    }
+    char *persistArray = &(*buffer)[0];
     int *persistArrayInts = reinterpret_cast<int *>(persistArray);
     float *persistArrayFloats = reinterpret_cast<float *>(persistArray);
+    memset(persistArray, 0, headerLength);
     strcpy_safe(persistArray, "ClCn", 4); // so easy to recognise file type
-    persistArrayInts[1] = latestVersion; // data file version number
+    persistArrayInts[1] = fileVersion; // data file version number
     persistArrayInts[2] = epoch;
     persistArrayInts[3] = batch;
     persistArrayInts[4] = numRight;
     persistArrayFloats[5] = loss;
     persistArrayFloats[6] = annealedLearningRate;
     strcpy_safe(persistArray + 7 * 4, trainingConfigString.c_str(), 800);
-    copyNetWeightsToArray(latestVersion, net, reinterpret_cast<float *>(persistArray + headerLength));
-    FileHelper::writeBinary(filepath + "~", reinterpret_cast<char *>(persistArray), 
-        headerLength + totalWeightsSize * sizeof(float));
+}
+// writes to filepath + '~', syncs it to disk, then renames it over filepath
+// and syncs the directory, so a crash, or a power loss, leaves either the old
+// file or the new one, never half of one.  Without the first sync, the rename
+// can reach the disk before the data, and leave an empty or truncated file.
+// On Windows rename doesnt replace an existing file, so we have to delete it
+// first; in the worst case, if the machine fails right in between the
+// 'delete' and the 'rename', you can find the weights in the file postfixed
+// with '~'
+STATIC void WeightsPersister::writeAtomically(std::string filepath, char const*data, long size) {
+    FileHelper::writeBinary(filepath + "~", data, size);
+    FileHelper::syncToDisk(filepath + "~");
+    #ifdef _WIN32
     FileHelper::remove(filepath);
+    #endif
     FileHelper::rename(filepath + "~", filepath);
-    std::cout << "wrote weights to file, filesize " << (( headerLength + totalWeightsSize) *sizeof(float)/1024) << "KB" << std::endl;
-    delete[] persistArray;
+    #ifndef _WIN32
+    size_t lastSlash = filepath.rfind('/');
+    if(lastSlash == std::string::npos) {
+        FileHelper::syncToDisk(".");
+    } else {
+        FileHelper::syncToDisk(lastSlash == 0 ? "/" : filepath.substr(0, lastSlash));
+    }
+    #endif
+}
+STATIC long long WeightsPersister::alignSection(long long offset) {
+    return (offset + sectionAlignment - 1) / sectionAlignment * sectionAlignment;
 }
 STATIC bool WeightsPersister::loadWeights(std::string filepath, std::string trainingConfigString, NeuralNet *net, int *p_epoch, int *p_batch, float *p_annealedLearningRate, int *p_numRight, float *p_loss) {
     if(FileHelper::exists(filepath) ){
         int headerSize = 1024;
-        long fileSize;
-        char * data = FileHelper::readBinary(filepath, &fileSize);
-
-        if(!checkData(data, headerSize, fileSize) ){
-            delete [] data;
+        long fileSize = FileHelper::getFilesize(filepath);
+        if(fileSize < headerSize) {
+            std::cout << "weights file has invalid size" << std::endl;
             return false;
         }
-        int *dataAsInts = reinterpret_cast<int *>(data);
-        int version = dataAsInts[1];
+        MappedFile mappedFile(filepath);
+        char const*mapped = reinterpret_cast<char const*>(mappedFile.getData());
+        if(!checkData(mapped, headerSize, fileSize) ){
+            return false;
+        }
+        int version = reinterpret_cast<int const*>(mapped)[1];
         if(version == 1 || version == 3) {
+            char *data = new char[fileSize];
+            memcpy(data, mapped, fileSize);
             return loadWeightsv1or3(data, fileSize, trainingConfigString, net, p_epoch, p_batch, p_annealedLearningRate, p_numRight, p_loss);
+        } else if(version == perLayerVersion) {
+            return loadWeightsPerLayer(&mappedFile, trainingConfigString, net, p_epoch, p_batch, p_annealedLearningRate, p_numRight, p_loss);
         } else {
             throw std::runtime_error("weights version " + toString(version) + " not recognized");
         }
@@ -163,6 +240,62 @@ STATIC bool WeightsPersister::loadWeightsv1or3(char *data, long fileSize, std::s
         delete [] data;
         return true;
 }
+// each layer's weights are copied to its device straight out of the mapping,
+// so the file is never read into a buffer of our own
+STATIC bool WeightsPersister::loadWeightsPerLayer(MappedFile *mappedFile, std::string trainingConfigString, NeuralNet *net, int *p_epoch, int *p_batch, float *p_annealedLearningRate, int *p_numRight, float *p_loss) {
+    const int headerSize = 1024;
+    char const*data = reinterpret_cast<char const*>(mappedFile->getData());
+    std::string fileConfigString(data + 7 * 4, strnlen(data + 7 * 4, headerSize - 7 * 4));
+    if(trainingConfigString != fileConfigString) {
+        std::cout << "training options dont match weights file" << std::endl;
+        std::cout << "in file: [" + fileConfigString + "]" << std::endl;
+        std::cout << "current options: [" + trainingConfigString + "]" << std::endl;
+        return false;
+    }
+    int const*dataAsInts = reinterpret_cast<int const*>(data);
+    float const*dataAsFloats = reinterpret_cast<float const*>(data);
+
+    mappedFile->checkRange(headerSize, 2 * sizeof(int));
+    int const*table = reinterpret_cast<int const*>(data + headerSize);
+    const int layerVersion = table[0];
+    const int numSections = table[1];
+    if(numSections < 0) {
+        throw std::runtime_error("weights file " + mappedFile->getFilepath() + " has " + toString(numSections) + " sections");
+    }
+    mappedFile->checkRange(headerSize + 2 * sizeof(int), (long long)numSections * sectionEntrySize);
+    vector<float const*> layerWeights(net->getNumLayers(), 0);
+    vector<int> layerSizes(net->getNumLayers(), 0);
+    for(int i = 0; i < numSections; i++) {
+        char const*entry = data + headerSize + 2 * sizeof(int) + i * sectionEntrySize;
+        int layerIdx = reinterpret_cast<int const*>(entry)[0];
+        int numFloats = reinterpret_cast<int const*>(entry)[1];
+        long long offset;
+        memcpy(&offset, entry + 2 * sizeof(int), sizeof(long long));
+        if(layerIdx < 1 || layerIdx >= net->getNumLayers()) {
+            throw std::runtime_error("weights file has weights for layer " + toString(layerIdx) + ", but the network has " + toString(net->getNumLayers()) + " layers.  So there is probably some mismatch between the weights file, and the settings, or network version, used.");
+        }
+        mappedFile->checkRange(offset, (long long)numFloats * sizeof(float));
+        layerWeights[layerIdx] = reinterpret_cast<float const*>(data + offset);
+        layerSizes[layerIdx] = numFloats;
+    }
+    for(int layerIdx = 1; layerIdx < net->getNumLayers(); layerIdx++) {
+        int expectedSize = net->getLayer(layerIdx)->getPersistSize(layerVersion);
+        if(expectedSize != layerSizes[layerIdx]) {
+            throw std::runtime_error("weights file contains " + toString(layerSizes[layerIdx]) + " floats for layer " + toString(layerIdx) + ", but we expect to see: " + toString(expectedSize) + ".  So there is probably some mismatch between the weights file, and the settings, or network version, used.");
+        }
+    }
+    *p_epoch = dataAsInts[2];
+    *p_batch = dataAsInts[3];
+    *p_numRight = dataAsInts[4];
+    *p_loss = dataAsFloats[5];
+    *p_annealedLearningRate = dataAsFloats[6];
+    for(int layerIdx = 1; layerIdx < net->getNumLayers(); layerIdx++) {
+        if(layerSizes[layerIdx] > 0) {
+            net->getLayer(layerIdx)->unpersistFromArray(layerVersion, layerWeights[layerIdx]);
+        }
+    }
+    return true;
+}
 STATIC bool WeightsPersister::checkData(const char * data, long headerSize, long fileSize) {
     if(fileSize < headerSize) {
         std::cout << "weights file has invalid size" << std::endl;
@@ -175,7 +308,7 @@ STATIC bool WeightsPersister::checkData(const char * data, long headerSize, long
     }
 
     const int *dataAsInts = reinterpret_cast<const int *>(data);
-    if(dataAsInts[1] != 1 && dataAsInts[1] != 3) {
+    if(dataAsInts[1] != 1 && dataAsInts[1] != 3 && dataAsInts[1] != perLayerVersion) {
         std::cout << "weights file version not known" << std::endl;
         return false;
     }
@@ -198,7 +331,7 @@ STATIC bool WeightsPersister::loadConfigString(std::string filepath, std::string
         // + skip the 'netdef='
         const int *dataAsInts = reinterpret_cast<const int *>(data);
         int version = dataAsInts[1];
-        if(version == 1 || version == 3) {
+        if(version == 1 || version == 3 || version == perLayerVersion) {
             configString = std::string(data + 7 * 4 + 7);
         } else {
             throw std::runtime_error("unknown versoin " + toString(version));
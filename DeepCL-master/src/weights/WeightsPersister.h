@@ -8,8 +8,10 @@
 
 #include <iostream>
 #include <string>
+#include <vector>
 
 class NeuralNet;
+class MappedFile;
 
 #define VIRTUAL virtual
 #define STATIC static
@@ -25,11 +27,16 @@ class NeuralNet;
 ///
 /// Target usage for this class is quickly snapshotting the weights after each epoch.  
 /// Therefore should be: fast, low IO :-)
+///
+/// To keep the training thread from waiting on the disk, see CheckpointWriter.
 /// 
 PUBLICAPI
 class DeepCL_EXPORT WeightsPersister {
 public:
     static const int latestVersion = 3;
+    static const int perLayerVersion = 4; // file version with a section per layer, see serialize
+    static const int sectionEntrySize = 16;
+    static const int sectionAlignment = 64;
 
     // [[[cog
     // import cog_addheaders
@@ -46,8 +53,13 @@ public:
     STATIC int getArrayOffsetForLayer(NeuralNet *net, int layer);
     STATIC int getArrayOffsetForLayer(int version, NeuralNet *net, int layer);
     STATIC void persistWeights(std::string filepath, std::string trainingConfigString, NeuralNet *net, int epoch, int batch, float annealedLearningRate, int numRight, float loss);  // we should probably rename 'weights' to 'model' now that we are storing normalization data too?
+    STATIC void persistWeights(int fileVersion, std::string filepath, std::string trainingConfigString, NeuralNet *net, int epoch, int batch, float annealedLearningRate, int numRight, float loss);
+    STATIC void serialize(int fileVersion, std::vector<char> *buffer, std::string trainingConfigString, NeuralNet *net, int epoch, int batch, float annealedLearningRate, int numRight, float loss);
+    STATIC void writeAtomically(std::string filepath, char const*data, long size);
+    STATIC long long alignSection(long long offset);
     STATIC bool loadWeights(std::string filepath, std::string trainingConfigString, NeuralNet *net, int *p_epoch, int *p_batch, float *p_annealedLearningRate, int *p_numRight, float *p_loss);
     STATIC bool loadWeightsv1or3(char *data, long fileSize, std::string trainingConfigString, NeuralNet *net, int *p_epoch, int *p_batch, float *p_annealedLearningRate, int *p_numRight, float *p_loss);
+    STATIC bool loadWeightsPerLayer(MappedFile *mappedFile, std::string trainingConfigString, NeuralNet *net, int *p_epoch, int *p_batch, float *p_annealedLearningRate, int *p_numRight, float *p_loss);
     STATIC bool checkData(const char * data, long headerSize, long fileSize);
     STATIC bool loadConfigString(std::string filepath, std::string & configString);
 
@@ -4,9 +4,16 @@
 // v. 2.0. If a copy of the MPL was not distributed with this file, You can 
 // obtain one at http://mozilla.org/MPL/2.0/.
 
+#include <cmath>
+#include <stdexcept>
+
 #include "EasyCL.h"
 
 #include "clmath/CLMathWrapper.h"
+#include "clmath/CLMathExpr.h"
+#include "net/NeuralNet.h"
+#include "layer/LayerMakers.h"
+#include "layer/Layer.h"
 
 #include "gtest/gtest.h"
 #include "test/gtest_supp.h"
@@ -233,3 +240,84 @@ TEST(testCLMathWrapper, perelementmult) {
     delete cl;
 }
 
+TEST(testCLMathWrapper, expression) {
+    EasyCL *cl = DeepCLGtestGlobals_createEasyCL();
+    float adat[] = { 1,3,9,12.5f,2.5f };
+    float bdat[] = { 4,2.1f, 5,3,9.2f };
+    float cdat[] = { 0.5f,1,2,-1,3 };
+    CLWrapper *a_ = cl->wrap(5,adat);
+    CLWrapper *b_ = cl->wrap(5,bdat);
+    CLWrapper *c_ = cl->wrap(5,cdat);
+    a_->copyToDevice();
+    b_->copyToDevice();
+    c_->copyToDevice();
+
+    CLMathWrapper a(a_);
+    CLMathWrapper b(b_);
+    CLMathWrapper c(c_);
+    float expected[5];
+    for(int i = 0; i < 5; i++) {
+        expected[i] = - cdat[i] / std::sqrt(bdat[i] * bdat[i] * 0.1f + adat[i] * 0.9f);
+    }
+    // reads a, as well as writing it.  nb b.squared() would square b in place, now
+    a = (CLMathExpr(b).squared() * 0.1f + a * 0.9f).sqrt().inv() * -c;
+    a_->copyToHost();
+    for(int i = 0; i < 5; i++) {
+        EXPECT_NEAR(expected[i], adat[i], 1e-3f);
+    }
+
+    // same expression, different scalars, reuses the kernel
+    a = b * 2.0f - 1.0f;
+    a_->copyToHost();
+    EXPECT_FLOAT_NEAR(7.0f, adat[0]);
+    a = b * 3.0f - 0.5f;
+    a_->copyToHost();
+    EXPECT_FLOAT_NEAR(11.5f, adat[0]);
+    EXPECT_FLOAT_NEAR(3 * 9.2f - 0.5f, adat[4]);
+
+    a += b / c;
+    a_->copyToHost();
+    EXPECT_FLOAT_NEAR(11.5f + 8.0f, adat[0]);
+
+    float ddat[] = { 1,2,3 };
+    CLWrapper *d_ = cl->wrap(3,ddat);
+    d_->copyToDevice();
+    CLMathWrapper d(d_);
+    EXPECT_THROW(a = b + d, runtime_error);
+
+    delete a_;
+    delete b_;
+    delete c_;
+    delete d_;
+    delete cl;
+}
+
+
+// NormalizationLayer runs as a CLMathExpr over the first batchSize examples of
+// its buffers, so check a smaller batch than was allocated, too
+TEST(testCLMathWrapper, normalizationLayer) {
+    EasyCL *cl = DeepCLGtestGlobals_createEasyCL();
+    NeuralNet *net = new NeuralNet(cl, 2, 3);
+    net->addLayer(NormalizationLayerMaker::instance()->translate(-0.5f)->scale(2.0f));
+    EXPECT_EQ(0, net->getLayer(1)->getOutput());
+    const int cubeSize = net->getInputCubeSize();
+    float input[4 * 18];
+    WeightRandomizer::randomize(1, input, 4 * cubeSize, -1.0f, 1.0f);
+    for(int batchSize = 4; batchSize >= 2; batchSize -= 2) {
+        net->setBatchSize(batchSize);
+        net->forward(input);
+        ASSERT_EQ(batchSize * cubeSize, net->getOutputNumElements());
+        float const *output = net->getOutput();
+        for(int i = 0; i < batchSize * cubeSize; i++) {
+            EXPECT_FLOAT_NEAR((input[i] - 0.5f) * 2.0f, output[i]);
+        }
+    }
+
+    float adat[] = { 1,3,9 };
+    CLWrapper *a_ = cl->wrap(3,adat);
+    EXPECT_THROW(CLMathExpr(a_, 4), runtime_error);
+
+    delete a_;
+    delete net;
+    delete cl;
+}
@@ -0,0 +1,109 @@
+#include <iostream>
+#include <vector>
+#include <stdexcept>
+
+#include "EasyCL.h"
+#include "net/NeuralNet.h"
+#include "layer/LayerMakers.h"
+#include "weights/WeightsPersister.h"
+#include "weights/CheckpointWriter.h"
+#include "util/FileHelper.h"
+#include "clblas/ClBlasInstance.h"
+
+#include "test/DeepCLGtestGlobals.h"
+#include "test/WeightRandomizer.h"
+
+#include "gtest/gtest.h"
+
+using namespace std;
+
+namespace testCheckpointWriter {
+
+NeuralNet *createNet(EasyCL *cl, int numFilters) {
+    NeuralNet *net = new NeuralNet(cl, 1, 6);
+    net->addLayer(ConvolutionalMaker::instance()->numFilters(numFilters)->filterSize(3)->biased()->padZeros());
+    net->addLayer(ActivationMaker::instance()->relu());
+    net->addLayer(FullyConnectedMaker::instance()->numPlanes(3)->imageSize(1)->biased());
+    net->addLayer(SoftMaxMaker::instance());
+    return net;
+}
+
+void checkRoundTrip(int fileVersion, bool async) {
+    EasyCL *cl = DeepCLGtestGlobals_createEasyCL();
+    ClBlasInstance blasInstance;
+    NeuralNet *net = createNet(cl, 4);
+    vector<float> weights(WeightsPersister::getTotalNumWeights(net));
+    WeightRandomizer::randomize(fileVersion, &weights[0], (int)weights.size(), -1.0f, 1.0f);
+    WeightsPersister::copyArrayToNetWeights(&weights[0], net);
+
+    string filepath = "testcheckpointwriter.dat";
+    if(async) {
+        CheckpointWriter writer(fileVersion);
+        writer.persistWeights(filepath, "netDef=test", net, 3, 7, 0.5f, 11, 1.5f);
+        writer.flush();
+        EXPECT_EQ(1, writer.getNumWritten());
+    } else {
+        WeightsPersister::persistWeights(fileVersion, filepath, "netDef=test", net, 3, 7, 0.5f, 11, 1.5f);
+    }
+    EXPECT_FALSE(FileHelper::exists(filepath + "~"));
+
+    NeuralNet *loaded = createNet(cl, 4);
+    int epoch, batch, numRight;
+    float annealedLearningRate, loss;
+    EXPECT_TRUE(WeightsPersister::loadWeights(filepath, "netDef=test", loaded, &epoch, &batch, &annealedLearningRate, &numRight, &loss));
+    EXPECT_EQ(3, epoch);
+    EXPECT_EQ(7, batch);
+    EXPECT_EQ(11, numRight);
+    EXPECT_FLOAT_EQ(0.5f, annealedLearningRate);
+    EXPECT_FLOAT_EQ(1.5f, loss);
+    vector<float> loadedWeights(weights.size());
+    WeightsPersister::copyNetWeightsToArray(loaded, &loadedWeights[0]);
+    for(int i = 0; i < (int)weights.size(); i++) {
+        EXPECT_EQ(weights[i], loadedWeights[i]);
+    }
+    string configString;
+    EXPECT_TRUE(WeightsPersister::loadConfigString(filepath, configString));
+    EXPECT_EQ("test", configString);
+
+    // different options, and a different network, are refused
+    EXPECT_FALSE(WeightsPersister::loadWeights(filepath, "netDef=other", loaded, &epoch, &batch, &annealedLearningRate, &numRight, &loss));
+    NeuralNet *other = createNet(cl, 5);
+    EXPECT_THROW(WeightsPersister::loadWeights(filepath, "netDef=test", other, &epoch, &batch, &annealedLearningRate, &numRight, &loss), runtime_error);
+
+    FileHelper::remove(filepath);
+    delete other;
+    delete loaded;
+    delete net;
+    delete cl;
+}
+
+TEST(testCheckpointWriter, version3) {
+    checkRoundTrip(WeightsPersister::latestVersion, false);
+}
+
+TEST(testCheckpointWriter, perLayer) {
+    checkRoundTrip(WeightsPersister::perLayerVersion, false);
+}
+
+TEST(testCheckpointWriter, asyncVersion3) {
+    checkRoundTrip(WeightsPersister::latestVersion, true);
+}
+
+TEST(testCheckpointWriter, asyncPerLayer) {
+    checkRoundTrip(WeightsPersister::perLayerVersion, true);
+}
+
+// a write that fails on the writer thread comes out of flush
+TEST(testCheckpointWriter, errorPropagates) {
+    EasyCL *cl = DeepCLGtestGlobals_createEasyCL();
+    ClBlasInstance blasInstance;
+    NeuralNet *net = createNet(cl, 4);
+    CheckpointWriter writer(WeightsPersister::perLayerVersion);
+    writer.persistWeights("nosuchdirectory/testcheckpointwriter.dat", "netDef=test", net, 0, 0, 0, 0, 0);
+    EXPECT_THROW(writer.flush(), runtime_error);
+    delete net;
+    delete cl;
+}
+
+}
+
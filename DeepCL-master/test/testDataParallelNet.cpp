@@ -0,0 +1,246 @@
+#include <iostream>
+#include <vector>
+#include <string>
+#include <stdexcept>
+
+#include "EasyCL.h"
+#include "net/NeuralNet.h"
+#include "net/DataParallelNet.h"
+#include "net/GradientAllReduce.h"
+#include "layer/LayerMakers.h"
+#include "layer/Layer.h"
+#include "trainers/SGD.h"
+#include "trainers/TrainingContext.h"
+#include "weights/WeightsPersister.h"
+#include "clblas/ClBlasInstance.h"
+#include "util/StatefulTimer.h"
+
+#include "test/DeepCLGtestGlobals.h"
+#include "test/WeightRandomizer.h"
+
+#include "gtest/gtest.h"
+
+using namespace std;
+
+namespace testDataParallelNet {
+
+NeuralNet *createNet(EasyCL *cl) {
+    NeuralNet *net = new NeuralNet(cl, 2, 5);
+    net->addLayer(ConvolutionalMaker::instance()->numFilters(3)->filterSize(3)->biased()->padZeros());
+    net->addLayer(ActivationMaker::instance()->tanh());
+    net->addLayer(FullyConnectedMaker::instance()->numPlanes(4)->imageSize(1)->biased());
+    net->addLayer(SoftMaxMaker::instance());
+    return net;
+}
+
+SGD *createSGD(EasyCL *cl) {
+    SGD *sgd = new SGD(cl);
+    sgd->setLearningRate(0.1f);
+    sgd->setMomentum(0.5f);
+    return sgd;
+}
+
+// two replicas, each training on half of each batch, end up with the same
+// weights as one net training on the whole batch; also a batch of 1, which
+// only the first replica trains on
+TEST(testDataParallelNet, matchesSingleNet) {
+    EasyCL *cl = DeepCLGtestGlobals_createEasyCL();
+    ClBlasInstance blasInstance;
+    NeuralNet *single = createNet(cl);
+    NeuralNet *replica0 = createNet(cl);
+    NeuralNet *replica1 = createNet(cl);
+    vector<float> weights(WeightsPersister::getTotalNumWeights(single));
+    WeightRandomizer::randomize(1, &weights[0], (int)weights.size(), -0.5f, 0.5f);
+    WeightsPersister::copyArrayToNetWeights(&weights[0], single);
+    WeightsPersister::copyArrayToNetWeights(&weights[0], replica0);
+    // replica1 keeps its own initial weights; construction overwrites them
+
+    SGD *singleSgd = createSGD(cl);
+    vector<NeuralNet *> replicas;
+    replicas.push_back(replica0);
+    replicas.push_back(replica1);
+    vector<Trainer *> trainers;
+    trainers.push_back(createSGD(cl));
+    trainers.push_back(createSGD(cl));
+    DataParallelNet dataParallel(replicas, trainers);
+    SGD *sgd = createSGD(cl);
+
+    const int batchSize = 6;
+    const int inputCubeSize = single->getInputCubeSize();
+    vector<float> input(batchSize * inputCubeSize);
+    vector<int> labels(batchSize);
+    const int batchSizes[] = {6, 6, 1, 6};
+    for(int batch = 0; batch < 4; batch++) {
+        const int thisBatchSize = batchSizes[batch];
+        WeightRandomizer::randomize(batch + 1, &input[0], thisBatchSize * inputCubeSize, -1.0f, 1.0f);
+        for(int n = 0; n < thisBatchSize; n++) {
+            labels[n] = (n + batch) % 4;
+        }
+        TrainingContext context(0, batch);
+        single->setBatchSize(thisBatchSize);
+        singleSgd->trainFromLabels(single, &context, &input[0], &labels[0]);
+        dataParallel.setBatchSize(thisBatchSize);
+        sgd->trainFromLabels(&dataParallel, &context, &input[0], &labels[0]);
+    }
+
+    vector<float> replicaWeights(weights.size());
+    WeightsPersister::copyNetWeightsToArray(single, &weights[0]);
+    for(int r = 0; r < 2; r++) {
+        WeightsPersister::copyNetWeightsToArray(replicas[r], &replicaWeights[0]);
+        for(int i = 0; i < (int)weights.size(); i++) {
+            EXPECT_NEAR(weights[i], replicaWeights[i], 0.0001f);
+        }
+    }
+
+    delete sgd;
+    delete trainers[1];
+    delete trainers[0];
+    delete singleSgd;
+    delete replica1;
+    delete replica0;
+    delete single;
+    delete cl;
+}
+
+// fails in its replica's thread before that replica reaches the allreduce,
+// while failing is set
+class FailingSGD : public SGD {
+public:
+    bool failing;
+    FailingSGD(EasyCL *cl) : SGD(cl), failing(true) {
+        setLearningRate(0.1f);
+    }
+    virtual BatchResult trainNetFromLabels(NeuralNet *net, TrainingContext *context,
+            float const*input, int const*labels) {
+        if(failing) {
+            throw runtime_error("replica failed");
+        }
+        return SGD::trainNetFromLabels(net, context, input, labels);
+    }
+};
+
+// the error of the failing replica reaches the caller, instead of the other
+// replica waiting for it at the allreduce forever, and the next batch trains
+// normally
+TEST(testDataParallelNet, replicaThrows) {
+    EasyCL *cl = DeepCLGtestGlobals_createEasyCL();
+    ClBlasInstance blasInstance;
+    vector<NeuralNet *> replicas;
+    replicas.push_back(createNet(cl));
+    replicas.push_back(createNet(cl));
+    vector<Trainer *> trainers;
+    trainers.push_back(createSGD(cl));
+    FailingSGD *failing = new FailingSGD(cl);
+    trainers.push_back(failing);
+    DataParallelNet dataParallel(replicas, trainers);
+    SGD *sgd = createSGD(cl);
+
+    const int batchSize = 4;
+    const int inputCubeSize = replicas[0]->getInputCubeSize();
+    vector<float> input(batchSize * inputCubeSize);
+    vector<int> labels(batchSize);
+    WeightRandomizer::randomize(1, &input[0], batchSize * inputCubeSize, -1.0f, 1.0f);
+    for(int n = 0; n < batchSize; n++) {
+        labels[n] = n % 4;
+    }
+    dataParallel.setBatchSize(batchSize);
+    TrainingContext context(0, 0);
+    string message;
+    try {
+        sgd->trainFromLabels(&dataParallel, &context, &input[0], &labels[0]);
+    } catch(runtime_error &e) {
+        message = e.what();
+    }
+    EXPECT_EQ("replica failed", message);
+
+    failing->failing = false;
+    sgd->trainFromLabels(&dataParallel, &context, &input[0], &labels[0]);
+    vector<float> weights0(WeightsPersister::getTotalNumWeights(replicas[0]));
+    vector<float> weights1(weights0.size());
+    WeightsPersister::copyNetWeightsToArray(replicas[0], &weights0[0]);
+    WeightsPersister::copyNetWeightsToArray(replicas[1], &weights1[0]);
+    for(int i = 0; i < (int)weights0.size(); i++) {
+        EXPECT_NEAR(weights0[i], weights1[i], 0.0001f);
+    }
+
+    delete sgd;
+    delete trainers[1];
+    delete trainers[0];
+    delete replicas[1];
+    delete replicas[0];
+    delete cl;
+}
+
+// forward and backward on three replicas at once, over an uneven split of the
+// batch, give the single net's output, and its gradients once allreduced.
+// With the timer on, the replicas refuse to run, since it isnt thread-safe
+TEST(testDataParallelNet, forwardBackward) {
+    EasyCL *cl = DeepCLGtestGlobals_createEasyCL();
+    ClBlasInstance blasInstance;
+    NeuralNet *single = createNet(cl);
+    vector<NeuralNet *> replicas;
+    vector<Trainer *> trainers;
+    for(int r = 0; r < 3; r++) {
+        replicas.push_back(createNet(cl));
+        trainers.push_back(createSGD(cl));
+    }
+    vector<float> weights(WeightsPersister::getTotalNumWeights(single));
+    WeightRandomizer::randomize(2, &weights[0], (int)weights.size(), -0.5f, 0.5f);
+    WeightsPersister::copyArrayToNetWeights(&weights[0], single);
+    WeightsPersister::copyArrayToNetWeights(&weights[0], replicas[0]);
+    DataParallelNet dataParallel(replicas, trainers);
+
+    const int batchSize = 7;
+    const int inputCubeSize = single->getInputCubeSize();
+    vector<float> input(batchSize * inputCubeSize);
+    vector<int> labels(batchSize);
+    WeightRandomizer::randomize(3, &input[0], batchSize * inputCubeSize, -1.0f, 1.0f);
+    for(int n = 0; n < batchSize; n++) {
+        labels[n] = n % 4;
+    }
+    single->setBatchSize(batchSize);
+    dataParallel.setBatchSize(batchSize);
+    for(int pass = 0; pass < 2; pass++) {
+        single->forward(&input[0]);
+        dataParallel.forward(&input[0]);
+        float const *singleOutput = single->getOutput();
+        float const *output = dataParallel.getOutput();
+        for(int i = 0; i < dataParallel.getOutputNumElements(); i++) {
+            EXPECT_NEAR(singleOutput[i], output[i], 0.0001f);
+        }
+
+        single->backwardFromLabels(&labels[0]);
+        dataParallel.backwardFromLabels(&labels[0]);
+        vector<CLWrapper *> singleGradients;
+        GradientAllReduce::getGradientWrappers(single, &singleGradients);
+        for(int r = 0; r < 3; r++) {
+            vector<CLWrapper *> gradients;
+            GradientAllReduce::getGradientWrappers(replicas[r], &gradients);
+            ASSERT_EQ(singleGradients.size(), gradients.size());
+            for(int b = 0; b < (int)gradients.size(); b++) {
+                singleGradients[b]->copyToHost();
+                gradients[b]->copyToHost();
+                float const *expected = (float *)singleGradients[b]->getHostArray();
+                float const *actual = (float *)gradients[b]->getHostArray();
+                for(int i = 0; i < gradients[b]->size(); i++) {
+                    EXPECT_NEAR(expected[i], actual[i], 0.0001f);
+                }
+            }
+        }
+    }
+
+    StatefulTimer::setEnabled(true);
+    EXPECT_THROW(dataParallel.forward(&input[0]), runtime_error);
+    EXPECT_THROW(dataParallel.backwardFromLabels(&labels[0]), runtime_error);
+    StatefulTimer::setEnabled(false);
+    dataParallel.forward(&input[0]);
+
+    for(int r = 2; r >= 0; r--) {
+        delete trainers[r];
+        delete replicas[r];
+    }
+    delete single;
+    delete cl;
+}
+
+}
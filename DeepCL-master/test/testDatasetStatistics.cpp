@@ -0,0 +1,108 @@
+#include <iostream>
+#include <vector>
+#include <cmath>
+#include <algorithm>
+
+#include "normalize/DatasetStatistics.h"
+#include "util/ThreadPool.h"
+#include "util/FileHelper.h"
+
+#include "test/WeightRandomizer.h"
+
+#include "gtest/gtest.h"
+
+using namespace std;
+
+namespace testDatasetStatistics {
+
+void referenceMeanStdDev(vector<float> const&values, double *p_mean, double *p_stdDev) {
+    double sum = 0;
+    for(int i = 0; i < (int)values.size(); i++) {
+        sum += values[i];
+    }
+    double mean = sum / values.size();
+    double sumSquaredDiff = 0;
+    for(int i = 0; i < (int)values.size(); i++) {
+        sumSquaredDiff += (values[i] - mean) * (values[i] - mean);
+    }
+    *p_mean = mean;
+    *p_stdDev = sqrt(sumSquaredDiff / (values.size() - 1));
+}
+
+// values far from zero, with a small spread, which is where sum of squares
+// minus square of sum loses everything in float
+TEST(testDatasetStatistics, matchesTwoPass) {
+    const int N = 100003; // not a multiple of the block or lane count
+    vector<float> values(N);
+    WeightRandomizer::randomize(2, &values[0], N, 1000.0f, 1001.0f);
+    double mean, stdDev;
+    referenceMeanStdDev(values, &mean, &stdDev);
+
+    ThreadPool threadPool(4);
+    DatasetStatistics statistics = DatasetStatistics::compute(&values[0], N, &threadPool);
+    EXPECT_EQ(N, statistics.count);
+    EXPECT_NEAR(mean, statistics.getMean(), 0.0001);
+    EXPECT_NEAR(stdDev, statistics.getStdDev(), stdDev * 0.001);
+    EXPECT_EQ(*std::min_element(values.begin(), values.end()), statistics.minY);
+    EXPECT_EQ(*std::max_element(values.begin(), values.end()), statistics.maxY);
+}
+
+// the result doesnt depend on how many threads there are, and merging the
+// statistics of two halves gives those of the whole
+TEST(testDatasetStatistics, threadsAndMerge) {
+    const int N = 50000;
+    vector<float> values(N);
+    WeightRandomizer::randomize(1, &values[0], N, 0.0f, 255.0f);
+    ThreadPool onePool(1);
+    ThreadPool fourPool(4);
+    DatasetStatistics one = DatasetStatistics::compute(&values[0], N, &onePool);
+    DatasetStatistics four = DatasetStatistics::compute(&values[0], N, &fourPool);
+    EXPECT_EQ(one.mean, four.mean);
+    EXPECT_EQ(one.m2, four.m2);
+
+    DatasetStatistics halves;
+    halves.add(&values[0], 12345);
+    DatasetStatistics secondHalf;
+    secondHalf.add(&values[12345], N - 12345);
+    halves.merge(secondHalf);
+    EXPECT_EQ(N, halves.count);
+    EXPECT_NEAR(one.getMean(), halves.getMean(), 0.001);
+    EXPECT_NEAR(one.getStdDev(), halves.getStdDev(), 0.001);
+
+    vector<unsigned char> bytes(N);
+    for(int i = 0; i < N; i++) {
+        bytes[i] = (unsigned char)(i % 256);
+        values[i] = (float)bytes[i];
+    }
+    DatasetStatistics fromBytes;
+    fromBytes.add(&bytes[0], N);
+    DatasetStatistics fromFloats;
+    fromFloats.add(&values[0], N);
+    EXPECT_FLOAT_EQ(fromFloats.getMean(), fromBytes.getMean());
+    EXPECT_FLOAT_EQ(fromFloats.getStdDev(), fromBytes.getStdDev());
+}
+
+TEST(testDatasetStatistics, saveAndLoad) {
+    string statsFile = "testdatasetstatistics.txt";
+    FileHelper::remove(statsFile);
+    DatasetStatistics statistics;
+    statistics.count = 1000;
+    statistics.mean = 33.318421449829934;
+    statistics.m2 = 6.1e9;
+    statistics.minY = 0;
+    statistics.maxY = 255;
+    DatasetStatistics loaded;
+    EXPECT_FALSE(DatasetStatistics::load(statsFile, "mnist\t47040016\t1000", &loaded));
+    DatasetStatistics::save(statsFile, "mnist\t47040016\t1000", statistics);
+    DatasetStatistics::save(statsFile, "norb\t1234\t1000", DatasetStatistics());
+    EXPECT_TRUE(DatasetStatistics::load(statsFile, "mnist\t47040016\t1000", &loaded));
+    EXPECT_EQ(statistics.count, loaded.count);
+    EXPECT_EQ(statistics.mean, loaded.mean);
+    EXPECT_EQ(statistics.m2, loaded.m2);
+    EXPECT_EQ(statistics.maxY, loaded.maxY);
+    EXPECT_FALSE(DatasetStatistics::load(statsFile, "mnist\t47040016\t2000", &loaded));
+    FileHelper::remove(statsFile);
+}
+
+}
+
@@ -0,0 +1,58 @@
+// Copyright Hugh Perkins 2016 hughperkins at gmail
+//
+// This Source Code Form is subject to the terms of the Mozilla Public License,
+// v. 2.0. If a copy of the MPL was not distributed with this file, You can
+// obtain one at http://mozilla.org/MPL/2.0/.
+
+#include <iostream>
+#include <vector>
+using namespace std;
+
+#include "loaders/DecodedImageCache.h"
+#include "util/FileHelper.h"
+
+#include "gtest/gtest.h"
+#include "test/gtest_supp.h"
+
+#include "DeepCLDllExport.h" // contains uchar typedef
+
+TEST(testDecodedImageCache, writereopenread) {
+    string filepath = "~testdecodedcache.decoded";
+    if(FileHelper::exists(filepath)) {
+        FileHelper::remove(filepath);
+    }
+    const int N = 10;
+    const int cubeSize = 12;
+    vector<uchar> data(N * cubeSize);
+    for(int i = 0; i < N * cubeSize; i++) {
+        data[i] = (uchar)(i % 251);
+    }
+    vector<char> present;
+    {
+        DecodedImageCache cache(filepath, N, cubeSize, "sig1");
+        EXPECT_EQ(0, cache.getNumPresent());
+        vector<uchar> readBack(5 * cubeSize);
+        EXPECT_EQ(0, cache.read(2, 5, &readBack[0], present));
+        cache.write(2, 5, &data[2 * cubeSize], present);
+        EXPECT_EQ(5, cache.getNumPresent());
+    }
+    {
+        // reopening with the same signature keeps the records
+        DecodedImageCache cache(filepath, N, cubeSize, "sig1");
+        EXPECT_EQ(5, cache.getNumPresent());
+        vector<uchar> readBack(N * cubeSize, 0);
+        EXPECT_EQ(5, cache.read(0, N, &readBack[0], present));
+        for(int n = 0; n < N; n++) {
+            EXPECT_EQ(n >= 2 && n < 7, present[n] != 0);
+        }
+        for(int i = 2 * cubeSize; i < 7 * cubeSize; i++) {
+            EXPECT_EQ(data[i], readBack[i]);
+        }
+    }
+    {
+        // a different signature means a different manifest, so start again
+        DecodedImageCache cache(filepath, N, cubeSize, "sig2");
+        EXPECT_EQ(0, cache.getNumPresent());
+    }
+    FileHelper::remove(filepath);
+}
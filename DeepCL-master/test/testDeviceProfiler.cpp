@@ -0,0 +1,92 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <set>
+
+#include "EasyCL.h"
+#include "net/NeuralNet.h"
+#include "net/DeviceProfiler.h"
+#include "layer/LayerMakers.h"
+#include "trainers/SGD.h"
+#include "trainers/TrainingContext.h"
+#include "clblas/ClBlasInstance.h"
+#include "util/stringhelper.h"
+
+#include "test/DeepCLGtestGlobals.h"
+#include "test/WeightRandomizer.h"
+
+#include "gtest/gtest.h"
+
+using namespace std;
+
+TEST(testDeviceProfiler, escapejson) {
+    EXPECT_EQ("plain", DeviceProfiler::escapeJson("plain"));
+    EXPECT_EQ("a\\\"b\\\\c", DeviceProfiler::escapeJson("a\"b\\c"));
+    EXPECT_EQ("x\\u000ay\\u0009", DeviceProfiler::escapeJson("x\ny\t"));
+}
+
+TEST(testDeviceProfiler, disabled_records_nothing) {
+    DeviceProfiler::begin(1, "layer", "forward");
+    DeviceProfiler::annotate("forward kernel 0");
+    DeviceProfiler::end();
+    EXPECT_EQ(0u, DeviceProfiler::instance()->getRecords().size());
+}
+
+// one training batch should give a forward and backward region per layer, and
+// an update region for each layer with weights, in order on the device
+TEST(testDeviceProfiler, trainbatch) {
+    EasyCL *cl = DeepCLGtestGlobals_createEasyCL();
+    ClBlasInstance blasInstance;
+    NeuralNet *net = new NeuralNet(cl, 2, 9);
+    net->addLayer(ConvolutionalMaker::instance()->numFilters(4)->filterSize(3)->biased()->padZeros());
+    net->addLayer(ActivationMaker::instance()->relu());
+    net->addLayer(FullyConnectedMaker::instance()->numPlanes(5)->imageSize(1)->biased());
+    net->addLayer(SoftMaxMaker::instance());
+    const int batchSize = 4;
+    net->setBatchSize(batchSize);
+    vector<float> input(net->getInputCubeSize() * batchSize);
+    WeightRandomizer::randomize(1, &input[0], (int)input.size(), -1.0f, 1.0f);
+    int labels[batchSize] = {0, 3, 1, 4};
+    SGD *sgd = SGD::instance(cl, 0.01f, 0.0f);
+
+    DeviceProfiler::enable(cl);
+    TrainingContext context(0, 0);
+    sgd->trainFromLabels(net, &context, &input[0], labels);
+    vector<DeviceProfiler::Record> records = DeviceProfiler::instance()->getRecords();
+
+    set<string> seen;
+    cl_ulong previousEnd = 0;
+    for(int i = 0; i < (int)records.size(); i++) {
+        const DeviceProfiler::Record &record = records[i];
+        seen.insert(toString(record.layerIndex) + " " + record.phase);
+        EXPECT_LE(record.queued, record.start);
+        EXPECT_LE(record.start, record.end);
+        EXPECT_LE(previousEnd, record.start);
+        previousEnd = record.end;
+        if(record.layerIndex == 1 && record.phase == "forward") {
+            EXPECT_NE(string::npos, record.detail.find("forward kernel"));
+        }
+    }
+    for(int layerId = 0; layerId < net->getNumLayers(); layerId++) {
+        EXPECT_EQ(1u, seen.count(toString(layerId) + " forward"));
+    }
+    EXPECT_EQ(1u, seen.count("1 backward"));
+    EXPECT_EQ(1u, seen.count("1 update"));
+    EXPECT_EQ(1u, seen.count("3 update"));
+    EXPECT_NE(string::npos, DeviceProfiler::instance()->getSummary().find("update"));
+
+    DeviceProfiler::instance()->writeChromeTrace("testDeviceProfiler.json");
+    ifstream in("testDeviceProfiler.json");
+    stringstream trace;
+    trace << in.rdbuf();
+    EXPECT_EQ(0u, trace.str().find("{\"displayTimeUnit\""));
+    EXPECT_NE(string::npos, trace.str().find("\"cat\": \"backward\""));
+    remove("testDeviceProfiler.json");
+
+    DeviceProfiler::disable();
+    EXPECT_EQ(0u, DeviceProfiler::instance()->getRecords().size());
+    delete sgd;
+    delete net;
+    delete cl;
+}
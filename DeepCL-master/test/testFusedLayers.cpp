@@ -0,0 +1,91 @@
+#include <iostream>
+#include <vector>
+
+#include "EasyCL.h"
+#include "net/NeuralNet.h"
+#include "layer/LayerMakers.h"
+#include "conv/ConvolutionalLayer.h"
+#include "clblas/ClBlasInstance.h"
+
+#include "test/DeepCLGtestGlobals.h"
+#include "test/WeightRandomizer.h"
+
+#include "gtest/gtest.h"
+
+using namespace std;
+
+namespace testFusedLayers {
+
+NeuralNet *createNet(EasyCL *cl) {
+    NeuralNet *net = new NeuralNet(cl, 2, 9);
+    net->addLayer(ConvolutionalMaker::instance()->numFilters(4)->filterSize(3)->biased()->padZeros());
+    net->addLayer(ActivationMaker::instance()->relu());
+    net->addLayer(PoolingMaker::instance()->poolingSize(2)->padZeros());
+    net->addLayer(ConvolutionalMaker::instance()->numFilters(3)->filterSize(3)->biased()->padZeros());
+    net->addLayer(ActivationMaker::instance()->tanh());
+    net->addLayer(FullyConnectedMaker::instance()->numPlanes(5)->imageSize(1)->biased());
+    net->addLayer(SoftMaxMaker::instance());
+    return net;
+}
+
+// fused and unfused nets, with the same weights, should give the same output,
+// and the same weight gradients
+TEST(testFusedLayers, matches_unfused) {
+    EasyCL *cl = DeepCLGtestGlobals_createEasyCL();
+    ClBlasInstance blasInstance;
+    NeuralNet *net = createNet(cl);
+    NeuralNet *fusedNet = createNet(cl);
+    for(int i = 0; i < net->getNumLayers(); i++) {
+        int persistSize = net->getLayer(i)->getPersistSize(1);
+        if(persistSize > 0) {
+            vector<float> persisted(persistSize);
+            net->getLayer(i)->persistToArray(1, &persisted[0]);
+            fusedNet->getLayer(i)->unpersistFromArray(1, &persisted[0]);
+        }
+    }
+    EXPECT_EQ(2, fusedNet->fuseLayers());
+
+    const int batchSize = 4;
+    net->setBatchSize(batchSize);
+    fusedNet->setBatchSize(batchSize);
+    const int inputTotalSize = net->getInputCubeSize() * batchSize;
+    float *input = new float[inputTotalSize];
+    WeightRandomizer::randomize(1, input, inputTotalSize, -1.0f, 1.0f);
+    int labels[] = {0, 3, 1, 4};
+
+    net->forward(input);
+    fusedNet->forward(input);
+    const int outputTotalSize = net->getOutputNumElements();
+    float const *output = net->getOutput();
+    float const *fusedOutput = fusedNet->getOutput();
+    for(int i = 0; i < outputTotalSize; i++) {
+        EXPECT_NEAR(output[i], fusedOutput[i], 1e-5f);
+    }
+
+    net->backwardFromLabels(labels);
+    fusedNet->backwardFromLabels(labels);
+    int convLayers[] = {1, 4};
+    for(int c = 0; c < 2; c++) {
+        ConvolutionalLayer *layer = dynamic_cast<ConvolutionalLayer *>(net->getLayer(convLayers[c]));
+        ConvolutionalLayer *fusedLayer = dynamic_cast<ConvolutionalLayer *>(fusedNet->getLayer(convLayers[c]));
+        EXPECT_TRUE(fusedLayer->isFused());
+        float const *gradWeights = layer->getGradWeights();
+        float const *fusedGradWeights = fusedLayer->getGradWeights();
+        for(int i = 0; i < layer->getWeightsSize(); i++) {
+            EXPECT_NEAR(gradWeights[i], fusedGradWeights[i], 1e-4f);
+        }
+        float const *gradBias = layer->getGradBias();
+        float const *fusedGradBias = fusedLayer->getGradBias();
+        for(int i = 0; i < layer->getBiasSize(); i++) {
+            EXPECT_NEAR(gradBias[i], fusedGradBias[i], 1e-4f);
+        }
+    }
+
+    delete[] input;
+    delete fusedNet;
+    delete net;
+    delete cl;
+}
+
+}
+
@@ -0,0 +1,155 @@
+#include <iostream>
+#include <vector>
+#include <cmath>
+
+#include "EasyCL.h"
+#include "trainers/FusedUpdate.h"
+
+#include "test/DeepCLGtestGlobals.h"
+#include "test/WeightRandomizer.h"
+
+#include "gtest/gtest.h"
+
+using namespace std;
+
+// each fused kernel against the per-element maths of the CLMathWrapper
+// sequence it replaced, on the host.  N is not a multiple of the workgroup size
+namespace {
+    const int N = 1000;
+
+    class FusedUpdateFixture {
+    public:
+        EasyCL *cl;
+        FusedUpdate *fusedUpdate;
+        vector<float> weights, grad, state1, state2;
+        vector<CLWrapper *> wrappers;
+        FusedUpdateFixture() :
+                weights(N), grad(N), state1(N), state2(N) {
+            cl = DeepCLGtestGlobals_createEasyCL();
+            fusedUpdate = new FusedUpdate(cl);
+            WeightRandomizer::randomize(1, &weights[0], N, -1.0f, 1.0f);
+            WeightRandomizer::randomize(2, &grad[0], N, -1.0f, 1.0f);
+            WeightRandomizer::randomize(3, &state1[0], N, 0.01f, 1.0f);
+            WeightRandomizer::randomize(4, &state2[0], N, 0.01f, 1.0f);
+        }
+        ~FusedUpdateFixture() {
+            for(int i = 0; i < (int)wrappers.size(); i++) {
+                delete wrappers[i];
+            }
+            delete fusedUpdate;
+            delete cl;
+        }
+        CLWrapper *wrap(vector<float> &values) {
+            CLWrapper *wrapper = cl->wrap(N, &values[0]);
+            wrapper->copyToDevice();
+            wrappers.push_back(wrapper);
+            return wrapper;
+        }
+        void copyAllToHost() {
+            for(int i = 0; i < (int)wrappers.size(); i++) {
+                wrappers[i]->copyToHost();
+            }
+        }
+    };
+}
+
+TEST(testFusedUpdate, sgd) {
+    FusedUpdateFixture f;
+    vector<float> expectedWeights(f.weights), expectedLastUpdate(f.state1);
+    const float learningRate = 0.1f, momentum = 0.9f, weightDecay = 0.01f;
+    for(int i = 0; i < N; i++) {
+        expectedLastUpdate[i] = momentum * expectedLastUpdate[i] - learningRate * f.grad[i];
+        expectedWeights[i] = (expectedWeights[i] + expectedLastUpdate[i]) * (1.0f - weightDecay);
+    }
+    f.fusedUpdate->sgd(N, learningRate, momentum, weightDecay, f.wrap(f.state1), f.wrap(f.grad), f.wrap(f.weights));
+    f.copyAllToHost();
+    for(int i = 0; i < N; i++) {
+        EXPECT_NEAR(expectedLastUpdate[i], f.state1[i], 1e-5f);
+        EXPECT_NEAR(expectedWeights[i], f.weights[i], 1e-5f);
+    }
+}
+
+TEST(testFusedUpdate, plain) {
+    FusedUpdateFixture f;
+    vector<float> expectedWeights(f.weights);
+    for(int i = 0; i < N; i++) {
+        expectedWeights[i] -= 0.3f * f.grad[i];
+    }
+    f.fusedUpdate->plain(N, 0.3f, f.wrap(f.grad), f.wrap(f.weights));
+    f.copyAllToHost();
+    for(int i = 0; i < N; i++) {
+        EXPECT_NEAR(expectedWeights[i], f.weights[i], 1e-5f);
+    }
+}
+
+TEST(testFusedUpdate, adagrad_rmsprop) {
+    for(int rmsprop = 0; rmsprop <= 1; rmsprop++) {
+        FusedUpdateFixture f;
+        vector<float> expectedWeights(f.weights), expectedSquares(f.state1);
+        for(int i = 0; i < N; i++) {
+            float gradSquared = f.grad[i] * f.grad[i];
+            expectedSquares[i] = rmsprop ? 0.9f * expectedSquares[i] + 0.1f * gradSquared : expectedSquares[i] + gradSquared;
+            expectedWeights[i] -= 0.05f * f.grad[i] / sqrt(expectedSquares[i]);
+        }
+        if(rmsprop) {
+            f.fusedUpdate->rmsprop(N, 0.05f, f.wrap(f.state1), f.wrap(f.grad), f.wrap(f.weights));
+        } else {
+            f.fusedUpdate->adagrad(N, 0.05f, f.wrap(f.state1), f.wrap(f.grad), f.wrap(f.weights));
+        }
+        f.copyAllToHost();
+        for(int i = 0; i < N; i++) {
+            EXPECT_NEAR(expectedSquares[i], f.state1[i], 1e-5f);
+            EXPECT_NEAR(expectedWeights[i], f.weights[i], 1e-4f);
+        }
+    }
+}
+
+TEST(testFusedUpdate, adadelta) {
+    FusedUpdateFixture f;
+    vector<float> expectedWeights(f.weights), expectedSumGrad(f.state1), expectedSumUpdate(f.state2);
+    const float decay = 0.9f;
+    for(int i = 0; i < N; i++) {
+        expectedSumGrad[i] = decay * expectedSumGrad[i] + (1 - decay) * f.grad[i] * f.grad[i];
+        float update = - sqrt(expectedSumUpdate[i] / (expectedSumGrad[i] + 0.0000001f)) * f.grad[i];
+        expectedWeights[i] += update;
+        expectedSumUpdate[i] = decay * expectedSumUpdate[i] + (1 - decay) * update * update;
+    }
+    f.fusedUpdate->adadelta(N, decay, f.wrap(f.state1), f.wrap(f.state2), f.wrap(f.grad), f.wrap(f.weights));
+    f.copyAllToHost();
+    for(int i = 0; i < N; i++) {
+        EXPECT_NEAR(expectedSumGrad[i], f.state1[i], 1e-5f);
+        EXPECT_NEAR(expectedSumUpdate[i], f.state2[i], 1e-4f);
+        EXPECT_NEAR(expectedWeights[i], f.weights[i], 1e-4f);
+    }
+}
+
+TEST(testFusedUpdate, nesterov) {
+    FusedUpdateFixture f;
+    const float learningRate = 0.1f, momentum = 0.8f;
+    vector<float> oldWeights(N);
+    vector<float> expectedOld(f.weights), expectedWeights(N), expectedLastUpdate(f.state1), expectedGrad(N);
+    for(int i = 0; i < N; i++) {
+        // the net would compute a new gradient at the lookahead weights; reuse grad
+        expectedGrad[i] = - learningRate * f.grad[i];
+        expectedLastUpdate[i] = momentum * expectedLastUpdate[i] + expectedGrad[i];
+        expectedWeights[i] = expectedOld[i] + expectedLastUpdate[i];
+    }
+    CLWrapper *oldWeightsWrapper = f.wrap(oldWeights);
+    CLWrapper *gradWrapper = f.wrap(f.grad);
+    CLWrapper *weightsWrapper = f.wrap(f.weights);
+    CLWrapper *lastUpdateWrapper = f.wrap(f.state1);
+    f.fusedUpdate->nesterovLookahead(N, momentum, oldWeightsWrapper, gradWrapper, weightsWrapper);
+    weightsWrapper->copyToHost();
+    oldWeightsWrapper->copyToHost();
+    for(int i = 0; i < N; i++) {
+        EXPECT_FLOAT_EQ(expectedOld[i], oldWeights[i]);
+        EXPECT_NEAR(momentum * f.grad[i] + expectedOld[i], f.weights[i], 1e-5f);
+    }
+    f.fusedUpdate->nesterovUpdate(N, learningRate, momentum, lastUpdateWrapper, oldWeightsWrapper, gradWrapper, weightsWrapper);
+    f.copyAllToHost();
+    for(int i = 0; i < N; i++) {
+        EXPECT_NEAR(expectedGrad[i], f.grad[i], 1e-5f);
+        EXPECT_NEAR(expectedLastUpdate[i], f.state1[i], 1e-5f);
+        EXPECT_NEAR(expectedWeights[i], f.weights[i], 1e-5f);
+    }
+}
@@ -0,0 +1,86 @@
+#include <iostream>
+#include <vector>
+
+#include "EasyCL.h"
+#include "net/NeuralNet.h"
+#include "layer/LayerMakers.h"
+#include "layer/Layer.h"
+#include "clmath/HalfStorage.h"
+#include "clblas/ClBlasInstance.h"
+
+#include "test/DeepCLGtestGlobals.h"
+#include "test/WeightRandomizer.h"
+
+#include "gtest/gtest.h"
+
+using namespace std;
+
+TEST(testHalfStorage, conversions) {
+    EXPECT_EQ(0x3c00, HalfStorage::floatToHalf(1.0f));
+    EXPECT_EQ(0xc000, HalfStorage::floatToHalf(-2.0f));
+    EXPECT_EQ(0x7bff, HalfStorage::floatToHalf(65504.0f));
+    EXPECT_EQ(0x7c00, HalfStorage::floatToHalf(65520.0f)); // rounds up to inf
+    EXPECT_EQ(0x0001, HalfStorage::floatToHalf(5.9604645e-8f)); // smallest subnormal
+    EXPECT_EQ(0x3555, HalfStorage::floatToHalf(1.0f / 3.0f));
+    EXPECT_EQ(0x3c00, HalfStorage::floatToHalf(1.0f + 1.0f / 2048)); // tie, to even
+    EXPECT_EQ(0x3c02, HalfStorage::floatToHalf(1.0f + 3.0f / 2048)); // tie, to even
+    EXPECT_FLOAT_EQ(0.333251953125f, HalfStorage::roundToHalf(1.0f / 3.0f));
+    for(int i = 0; i < 0x7c00; i++) {
+        EXPECT_EQ(i, HalfStorage::floatToHalf(HalfStorage::halfToFloat((unsigned short)i)));
+    }
+}
+
+// a net storing its weights as half should give exactly the output of a float
+// net whose weights were rounded to half on the host.  run with a cpu device to
+// validate against a cpu reference
+TEST(testHalfStorage, forward_matches_rounded_weights) {
+    EasyCL *cl = DeepCLGtestGlobals_createEasyCL();
+    ClBlasInstance blasInstance;
+    NeuralNet *nets[2];
+    for(int i = 0; i < 2; i++) {
+        nets[i] = new NeuralNet(cl, 2, 9);
+        nets[i]->addLayer(ConvolutionalMaker::instance()->numFilters(4)->filterSize(3)->biased()->padZeros());
+        nets[i]->addLayer(ActivationMaker::instance()->relu());
+        nets[i]->addLayer(PoolingMaker::instance()->poolingSize(2));
+        nets[i]->addLayer(FullyConnectedMaker::instance()->numPlanes(5)->imageSize(1)->biased());
+        nets[i]->addLayer(SoftMaxMaker::instance());
+    }
+    NeuralNet *roundedNet = nets[0];
+    NeuralNet *halfNet = nets[1];
+    for(int layerId = 0; layerId < halfNet->getNumLayers(); layerId++) {
+        int persistSize = halfNet->getLayer(layerId)->getPersistSize(1);
+        if(persistSize == 0) {
+            continue;
+        }
+        vector<float> persisted(persistSize);
+        halfNet->getLayer(layerId)->persistToArray(1, &persisted[0]);
+        // weights come first, and only they are stored as half, not bias
+        int weightsSize = halfNet->getLayer(layerId)->getWeightsSize();
+        for(int i = 0; i < weightsSize; i++) {
+            persisted[i] = HalfStorage::roundToHalf(persisted[i]);
+        }
+        roundedNet->getLayer(layerId)->unpersistFromArray(1, &persisted[0]);
+    }
+    halfNet->enableHalfStorage();
+
+    const int batchSize = 3;
+    roundedNet->setBatchSize(batchSize);
+    halfNet->setBatchSize(batchSize);
+    const int inputTotalSize = halfNet->getInputCubeSize() * batchSize;
+    float *input = new float[inputTotalSize];
+    WeightRandomizer::randomize(1, input, inputTotalSize, -1.0f, 1.0f);
+    roundedNet->forward(input);
+    halfNet->forward(input);
+
+    float const *expected = roundedNet->getOutput();
+    float const *output = halfNet->getOutput();
+    for(int i = 0; i < halfNet->getOutputNumElements(); i++) {
+        EXPECT_NEAR(expected[i], output[i], 1e-5f);
+    }
+
+    delete[] input;
+    delete halfNet;
+    delete roundedNet;
+    delete cl;
+}
+
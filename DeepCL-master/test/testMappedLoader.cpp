@@ -0,0 +1,195 @@
+// Copyright Hugh Perkins 2016 hughperkins at gmail
+//
+// This Source Code Form is subject to the terms of the Mozilla Public License,
+// v. 2.0. If a copy of the MPL was not distributed with this file, You can
+// obtain one at http://mozilla.org/MPL/2.0/.
+
+#include <iostream>
+#include <vector>
+#include <cstring>
+using namespace std;
+
+#include "loaders/MappedLoader.h"
+#include "loaders/GenericLoader.h"
+#include "loaders/GenericLoaderv2.h"
+#include "loaders/NorbLoader.h"
+#include "loaders/MnistLoader.h"
+#include "loaders/Kgsv2Loader.h"
+#include "util/FileHelper.h"
+
+#include "gtest/gtest.h"
+#include "test/gtest_supp.h"
+
+#include "DeepCLDllExport.h" // contains uchar typedef
+
+namespace testMappedLoader {
+
+const int N = 20;
+const int planes = 2;
+const int size = 8; // GenericLoader needs files of at least 1024 bytes
+const int cubeSize = planes * size * size;
+
+void writeNorb(string imagesPath, vector<uchar> &images, vector<int> &labels) {
+    images.resize(N * cubeSize);
+    labels.resize(N);
+    for(int i = 0; i < N * cubeSize; i++) {
+        images[i] = (uchar)((i * 7) % 256);
+    }
+    for(int n = 0; n < N; n++) {
+        labels[n] = (n * 3) % 5;
+    }
+    NorbLoader::writeImages(imagesPath, &images[0], N, planes, size);
+    NorbLoader::writeLabels(replace(imagesPath, "-dat.mat", "-cat.mat"), &labels[0], N);
+}
+void writeMnist(string imagesPath, vector<uchar> &images, vector<int> &labels) {
+    images.resize(N * size * size);
+    labels.resize(N);
+    vector<uchar> imagesFile(16 + N * size * size);
+    MnistLoader::writeUInt(&imagesFile[0], 0, 0x00000803);
+    MnistLoader::writeUInt(&imagesFile[0], 1, N);
+    MnistLoader::writeUInt(&imagesFile[0], 2, size);
+    MnistLoader::writeUInt(&imagesFile[0], 3, size);
+    for(int i = 0; i < N * size * size; i++) {
+        images[i] = (uchar)((i * 11) % 256);
+        imagesFile[16 + i] = images[i];
+    }
+    vector<uchar> labelsFile(8 + N);
+    MnistLoader::writeUInt(&labelsFile[0], 0, 0x00000801);
+    MnistLoader::writeUInt(&labelsFile[0], 1, N);
+    for(int n = 0; n < N; n++) {
+        labels[n] = n % 10;
+        labelsFile[8 + n] = (uchar)labels[n];
+    }
+    FileHelper::writeBinary(imagesPath, (char *)&imagesFile[0], imagesFile.size());
+    FileHelper::writeBinary(replace(imagesPath, "-images-idx3-ubyte", "-labels-idx1-ubyte"), (char *)&labelsFile[0], labelsFile.size());
+}
+void writeKgs(string imagesPath) {
+    int recordSize = Kgsv2Loader::getRecordSize(planes, size);
+    vector<char> data(1024 + N * recordSize + 4, 0);
+    string header = "mlv2-n=" + toString(N) + "-numplanes=" + toString(planes) + "-imagewidth="
+        + toString(size) + "-imageheight=" + toString(size) + "-datatype=int-bpp=1\n";
+    memcpy(&data[0], header.c_str(), header.size());
+    for(int n = 0; n < N; n++) {
+        char *record = &data[1024 + n * recordSize];
+        record[0] = 'G';
+        record[1] = 'O';
+        int label = n * 2;
+        memcpy(record + 2, &label, 4);
+        for(int i = 6; i < recordSize; i++) {
+            record[i] = (char)((n * 31 + i * 17) % 256);
+        }
+    }
+    memcpy(&data[1024 + N * recordSize], "END", 4);
+    FileHelper::writeBinary(imagesPath, &data[0], data.size());
+}
+// mapped loads must match the stream loads exactly, for every chunking
+void checkMatchesGenericLoader(string imagesPath) {
+    int n, p, s;
+    GenericLoader::getDimensions(imagesPath.c_str(), &n, &p, &s);
+    const int thisCubeSize = p * s * s;
+    vector<uchar> expectedImages(N * thisCubeSize);
+    vector<int> expectedLabels(N);
+    GenericLoader::load(imagesPath.c_str(), &expectedImages[0], &expectedLabels[0], 0, N);
+
+    ASSERT_TRUE(MappedLoader::isFormatFor(imagesPath));
+    MappedLoader loader(imagesPath);
+    EXPECT_EQ(N, loader.getN());
+    EXPECT_EQ(p, loader.getPlanes());
+    EXPECT_EQ(s, loader.getImageSize());
+    for(int chunk = 1; chunk <= N; chunk += 4) {
+        for(int start = 0; start < N; start += chunk) {
+            int thisChunk = std::min(chunk, N - start);
+            vector<uchar> images(thisChunk * thisCubeSize);
+            vector<int> labels(thisChunk);
+            loader.load(&images[0], &labels[0], start, thisChunk);
+            for(int i = 0; i < thisChunk * thisCubeSize; i++) {
+                ASSERT_EQ(expectedImages[start * thisCubeSize + i], images[i]);
+            }
+            for(int i = 0; i < thisChunk; i++) {
+                ASSERT_EQ(expectedLabels[start + i], labels[i]);
+            }
+        }
+    }
+
+    GenericLoaderv2::setUseMappedFiles(true);
+    GenericLoaderv2 mapped(imagesPath);
+    GenericLoaderv2::setUseMappedFiles(false);
+    GenericLoaderv2 unmapped(imagesPath);
+    EXPECT_TRUE(mapped.isMapped());
+    EXPECT_FALSE(unmapped.isMapped());
+    vector<float> mappedImages((N - 3) * thisCubeSize);
+    vector<float> unmappedImages((N - 3) * thisCubeSize);
+    vector<int> mappedLabels(N - 3);
+    vector<int> unmappedLabels(N - 3);
+    mapped.loadFromBackgroundThread(&mappedImages[0], &mappedLabels[0], 3, N - 3);
+    unmapped.loadFromBackgroundThread(&unmappedImages[0], &unmappedLabels[0], 3, N - 3);
+    for(int i = 0; i < (N - 3) * thisCubeSize; i++) {
+        ASSERT_EQ(unmappedImages[i], mappedImages[i]);
+    }
+    for(int i = 0; i < N - 3; i++) {
+        ASSERT_EQ(unmappedLabels[i], mappedLabels[i]);
+    }
+}
+
+TEST(testMappedLoader, norb) {
+    string imagesPath = "~testmappedloader-dat.mat";
+    vector<uchar> images;
+    vector<int> labels;
+    writeNorb(imagesPath, images, labels);
+    checkMatchesGenericLoader(imagesPath);
+
+    // norb records are plain image cubes, so we get a pointer into the file
+    MappedLoader loader(imagesPath);
+    const uchar *records = loader.getRecords(4, 6);
+    ASSERT_TRUE(records != 0);
+    for(int i = 0; i < 6 * cubeSize; i++) {
+        EXPECT_EQ(images[4 * cubeSize + i], records[i]);
+    }
+    FileHelper::remove(imagesPath);
+    FileHelper::remove(replace(imagesPath, "-dat.mat", "-cat.mat"));
+}
+
+TEST(testMappedLoader, mnist) {
+    string imagesPath = "~testmappedloader-images-idx3-ubyte";
+    vector<uchar> images;
+    vector<int> labels;
+    writeMnist(imagesPath, images, labels);
+    checkMatchesGenericLoader(imagesPath);
+
+    MappedLoader loader(imagesPath);
+    const uchar *records = loader.getRecords(0, N);
+    ASSERT_TRUE(records != 0);
+    for(int i = 0; i < N * size * size; i++) {
+        EXPECT_EQ(images[i], records[i]);
+    }
+    FileHelper::remove(imagesPath);
+    FileHelper::remove(replace(imagesPath, "-images-idx3-ubyte", "-labels-idx1-ubyte"));
+}
+
+TEST(testMappedLoader, kgsv2) {
+    string imagesPath = "~testmappedloader.dat";
+    writeKgs(imagesPath);
+    checkMatchesGenericLoader(imagesPath);
+
+    // kgs records are bit-packed, so can only be unpacked, not pointed at
+    MappedLoader loader(imagesPath);
+    EXPECT_TRUE(loader.getRecords(0, N) == 0);
+    FileHelper::remove(imagesPath);
+}
+
+TEST(testMappedLoader, truncatedfile) {
+    string imagesPath = "~testmappedloadertrunc-dat.mat";
+    vector<uchar> images;
+    vector<int> labels;
+    writeNorb(imagesPath, images, labels);
+    long filesize = 0;
+    char *data = FileHelper::readBinary(imagesPath, &filesize);
+    FileHelper::writeBinary(imagesPath, data, filesize - cubeSize);
+    delete[] data;
+    EXPECT_THROW(MappedLoader loader(imagesPath), runtime_error);
+    FileHelper::remove(imagesPath);
+    FileHelper::remove(replace(imagesPath, "-dat.mat", "-cat.mat"));
+}
+
+}
+
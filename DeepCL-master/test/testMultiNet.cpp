@@ -0,0 +1,130 @@
+#include <iostream>
+#include <vector>
+
+#include "EasyCL.h"
+#include "net/NeuralNet.h"
+#include "net/MultiNet.h"
+#include "net/GradientAllReduce.h"
+#include "weights/WeightsPersister.h"
+#include "layer/LayerMakers.h"
+#include "clblas/ClBlasInstance.h"
+
+#include "test/DeepCLGtestGlobals.h"
+#include "test/WeightRandomizer.h"
+
+#include "gtest/gtest.h"
+
+using namespace std;
+
+// when not training, the gpu ensemble path should give the same output as
+// running each member fully, and averaging their softmax outputs on the host
+TEST(testMultiNet, ensembleongpu_matches_host) {
+    EasyCL *cl = DeepCLGtestGlobals_createEasyCL();
+    ClBlasInstance blasInstance;
+    NeuralNet *model = new NeuralNet(cl, 2, 7);
+    model->addLayer(ConvolutionalMaker::instance()->numFilters(4)->filterSize(3)->biased()->padZeros());
+    model->addLayer(ActivationMaker::instance()->relu());
+    model->addLayer(FullyConnectedMaker::instance()->numPlanes(5)->imageSize(1)->biased());
+    model->addLayer(SoftMaxMaker::instance());
+
+    const int numNets = 3;
+    MultiNet *multiNet = new MultiNet(numNets, model);
+    const int batchSize = 6;
+    multiNet->setBatchSize(batchSize);
+    multiNet->setTraining(false);
+
+    const int inputTotalSize = model->getInputCubeSize() * batchSize;
+    const int outputTotalSize = multiNet->getOutputNumElements();
+    float *input = new float[inputTotalSize];
+    WeightRandomizer::randomize(1, input, inputTotalSize, -1.0f, 1.0f);
+
+    multiNet->forward(input);
+    float *ensembled = new float[outputTotalSize];
+    memcpy(ensembled, multiNet->getOutput(), sizeof(float) * outputTotalSize);
+
+    vector<float> expected(outputTotalSize, 0.0f);
+    for(int n = 0; n < numNets; n++) {
+        Trainable *child = multiNet->getNet(n);
+        child->forward(input);
+        float const *childOutput = child->getOutput();
+        for(int i = 0; i < outputTotalSize; i++) {
+            expected[i] += childOutput[i] / numNets;
+        }
+    }
+    for(int i = 0; i < outputTotalSize; i++) {
+        EXPECT_NEAR(expected[i], ensembled[i], 1e-5f);
+    }
+
+    delete[] ensembled;
+    delete[] input;
+    delete multiNet;
+    delete model;
+    delete cl;
+}
+
+
+// a training step through the MultiNet gives each member the same gradients
+// as a standalone copy of it, forwarded and backpropagated on its own, ie the
+// members' SoftMaxLayers ran; also the same ensemble output as inference
+TEST(testMultiNet, trainstep_matches_members) {
+    EasyCL *cl = DeepCLGtestGlobals_createEasyCL();
+    ClBlasInstance blasInstance;
+    NeuralNet *model = new NeuralNet(cl, 2, 7);
+    model->addLayer(ConvolutionalMaker::instance()->numFilters(4)->filterSize(3)->biased()->padZeros());
+    model->addLayer(ActivationMaker::instance()->relu());
+    model->addLayer(FullyConnectedMaker::instance()->numPlanes(5)->imageSize(1)->biased());
+    model->addLayer(SoftMaxMaker::instance());
+
+    const int numNets = 3;
+    MultiNet *multiNet = new MultiNet(numNets, model);
+    const int batchSize = 6;
+    multiNet->setBatchSize(batchSize);
+
+    const int inputTotalSize = model->getInputCubeSize() * batchSize;
+    const int outputTotalSize = multiNet->getOutputNumElements();
+    float *input = new float[inputTotalSize];
+    WeightRandomizer::randomize(2, input, inputTotalSize, -1.0f, 1.0f);
+    int labels[] = {0, 4, 2, 1, 3, 2};
+
+    multiNet->setTraining(false);
+    multiNet->forward(input);
+    vector<float> inferred(multiNet->getOutput(), multiNet->getOutput() + outputTotalSize);
+    multiNet->setTraining(true);
+    multiNet->forward(input);
+    float const *trained = multiNet->getOutput();
+    for(int i = 0; i < outputTotalSize; i++) {
+        EXPECT_NEAR(inferred[i], trained[i], 1e-5f);
+    }
+    multiNet->backwardFromLabels(labels);
+
+    NeuralNet *standalone = model->clone();
+    standalone->setBatchSize(batchSize);
+    vector<float> weights(WeightsPersister::getTotalNumWeights(standalone));
+    for(int n = 0; n < numNets; n++) {
+        NeuralNet *child = dynamic_cast< NeuralNet * >(multiNet->getNet(n));
+        WeightsPersister::copyNetWeightsToArray(child, &weights[0]);
+        WeightsPersister::copyArrayToNetWeights(&weights[0], standalone);
+        standalone->forward(input);
+        standalone->backwardFromLabels(labels);
+        vector<CLWrapper *> expected;
+        vector<CLWrapper *> actual;
+        GradientAllReduce::getGradientWrappers(standalone, &expected);
+        GradientAllReduce::getGradientWrappers(child, &actual);
+        ASSERT_EQ(expected.size(), actual.size());
+        for(int b = 0; b < (int)actual.size(); b++) {
+            expected[b]->copyToHost();
+            actual[b]->copyToHost();
+            float const *expectedGradients = (float *)expected[b]->getHostArray();
+            float const *actualGradients = (float *)actual[b]->getHostArray();
+            for(int i = 0; i < actual[b]->size(); i++) {
+                EXPECT_NEAR(expectedGradients[i], actualGradients[i], 1e-5f);
+            }
+        }
+    }
+
+    delete standalone;
+    delete[] input;
+    delete multiNet;
+    delete model;
+    delete cl;
+}
@@ -0,0 +1,177 @@
+// Copyright Hugh Perkins 2016 hughperkins at gmail
+//
+// This Source Code Form is subject to the terms of the Mozilla Public License,
+// v. 2.0. If a copy of the MPL was not distributed with this file, You can
+// obtain one at http://mozilla.org/MPL/2.0/.
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <stdexcept>
+using namespace std;
+
+#include "batch/OnDemandBatcherv2.h"
+#include "batch/NetAction.h"
+#include "net/Trainable.h"
+#include "loaders/GenericLoaderv2.h"
+#include "loaders/NorbLoader.h"
+#include "util/FileHelper.h"
+#include "util/stringhelper.h"
+
+#include "gtest/gtest.h"
+
+#include "DeepCLDllExport.h" // contains uchar typedef
+
+namespace testOnDemandBatcherv2 {
+
+const int N = 23;
+const int planes = 2;
+const int size = 8; // GenericLoader needs files of at least 1024 bytes
+const int cubeSize = planes * size * size;
+const int batchSize = 3;
+const int fileReadBatches = 2; // so 4 file batches, the last one short
+
+const string imagesPath = "~testondemandbatcherv2-dat.mat";
+
+void writeNorb() {
+    vector<uchar> images(N * cubeSize);
+    vector<int> labels(N);
+    for(int i = 0; i < N * cubeSize; i++) {
+        images[i] = (uchar)((i * 7) % 256);
+    }
+    for(int n = 0; n < N; n++) {
+        labels[n] = n;
+    }
+    NorbLoader::writeImages(imagesPath, &images[0], N, planes, size);
+    NorbLoader::writeLabels(replace(imagesPath, "-dat.mat", "-cat.mat"), &labels[0], N);
+}
+void removeNorb() {
+    FileHelper::remove(imagesPath);
+    FileHelper::remove(replace(imagesPath, "-dat.mat", "-cat.mat"));
+}
+
+// stands in for a net: its loss is the sum of the batch the action last saw,
+// so the epoch results depend on every value loaded
+class FakeNet : public Trainable {
+public:
+    int batchSize;
+    float dataSum;
+    FakeNet() : batchSize(0), dataSum(0) {
+    }
+    virtual int getOutputNumElements() const { return batchSize; }
+    virtual float calcLoss(float const *expectedValues) { return dataSum; }
+    virtual float calcLossFromLabels(int const *labels) { return dataSum; }
+    virtual void setBatchSize(int batchSize) { this->batchSize = batchSize; }
+    virtual void setTraining(bool training) {}
+    virtual int calcNumRight(int const *labels) { return labels[0] % 2; }
+    virtual void forward(float const*images) {}
+    virtual void backwardFromLabels(int const *labels) {}
+    virtual void backward(float const *expectedOutput) {}
+    virtual float const *getOutput() const { return 0; }
+    virtual LossLayerMaker *cloneLossLayerMaker() const { return 0; }
+    virtual int getOutputPlanes() const { return 1; }
+    virtual int getOutputSize() const { return 1; }
+    virtual int getInputCubeSize() const { return cubeSize; }
+    virtual int getOutputCubeSize() const { return 1; }
+};
+
+// records the labels of every example it is given, in order
+class RecordingAction : public NetAction {
+public:
+    vector<int> labels;
+    virtual void run(Trainable *net, int epoch, int batch, float const*const batchData, int const*const batchLabels) {
+        FakeNet *fakeNet = (FakeNet *)net;
+        fakeNet->dataSum = 0;
+        for(int i = 0; i < fakeNet->batchSize * cubeSize; i++) {
+            fakeNet->dataSum += batchData[i];
+        }
+        for(int n = 0; n < fakeNet->batchSize; n++) {
+            labels.push_back(batchLabels[n]);
+        }
+    }
+};
+
+class EpochsRun {
+public:
+    vector<int> labels;
+    vector<float> losses;
+    vector<int> numRights;
+};
+
+// two whole epochs, so prefetching wraps round into the second, then a restart
+// from the middle of the third
+EpochsRun runEpochs(int numPrefetchBuffers) {
+    GenericLoaderv2 loader(imagesPath);
+    FakeNet net;
+    RecordingAction action;
+    OnDemandBatcherv2 batcher(&net, &action, &loader, N, fileReadBatches, batchSize);
+    batcher.setNumPrefetchBuffers(numPrefetchBuffers);
+    EpochsRun run;
+    for(int epoch = 0; epoch < 2; epoch++) {
+        EpochResult result = batcher.run(epoch);
+        run.losses.push_back(result.loss);
+        run.numRights.push_back(result.numRight);
+    }
+    EXPECT_TRUE(batcher.tick(2));
+    batcher.setBatchState(2 * fileReadBatches, 0, 0);
+    EpochResult result = batcher.run(2);
+    run.losses.push_back(result.loss);
+    run.numRights.push_back(result.numRight);
+    EXPECT_EQ(2 * N + fileReadBatches * batchSize + (N - 2 * fileReadBatches * batchSize), (int)action.labels.size());
+    run.labels = action.labels;
+    return run;
+}
+
+TEST(testOnDemandBatcherv2, prefetchMatchesDirect) {
+    writeNorb();
+    EpochsRun direct = runEpochs(0);
+    EpochsRun prefetched = runEpochs(2);
+    removeNorb();
+
+    vector<int> expectedLabels;
+    for(int epoch = 0; epoch < 2; epoch++) {
+        for(int n = 0; n < N; n++) {
+            expectedLabels.push_back(n);
+        }
+    }
+    for(int n = 0; n < fileReadBatches * batchSize; n++) {
+        expectedLabels.push_back(n);
+    }
+    for(int n = 2 * fileReadBatches * batchSize; n < N; n++) {
+        expectedLabels.push_back(n);
+    }
+    EXPECT_EQ(expectedLabels, direct.labels);
+    EXPECT_EQ(expectedLabels, prefetched.labels);
+    EXPECT_EQ(direct.losses, prefetched.losses);
+    EXPECT_EQ(direct.numRights, prefetched.numRights);
+    EXPECT_EQ(direct.losses[0], direct.losses[1]);
+}
+
+// a failed load is rethrown from tick, which leaves the batcher where it was,
+// so the next tick retries the same file batch
+TEST(testOnDemandBatcherv2, loaderErrorRethrown) {
+    for(int numPrefetchBuffers = 0; numPrefetchBuffers <= 2; numPrefetchBuffers += 2) {
+        writeNorb();
+        GenericLoaderv2 loader(imagesPath);
+        FakeNet net;
+        RecordingAction action;
+        OnDemandBatcherv2 batcher(&net, &action, &loader, N, fileReadBatches, batchSize);
+        batcher.setNumPrefetchBuffers(numPrefetchBuffers);
+        removeNorb();
+        EXPECT_THROW(batcher.tick(0), runtime_error);
+        EXPECT_EQ(0, batcher.getNextFileBatch());
+        EXPECT_EQ(0, (int)action.labels.size());
+
+        writeNorb();
+        batcher.run(0);
+        removeNorb();
+        EXPECT_TRUE(batcher.getEpochDone());
+        ASSERT_EQ(N, (int)action.labels.size());
+        for(int n = 0; n < N; n++) {
+            EXPECT_EQ(n, action.labels[n]);
+        }
+    }
+}
+
+}
+
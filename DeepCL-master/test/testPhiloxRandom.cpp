@@ -0,0 +1,116 @@
+#include <iostream>
+#include <vector>
+#include <cstring>
+
+#include "EasyCL.h"
+#include "clmath/PhiloxRandom.h"
+#include "patches/Translator.h"
+
+#include "test/DeepCLGtestGlobals.h"
+#include "test/WeightRandomizer.h"
+
+#include "gtest/gtest.h"
+
+using namespace std;
+
+// known-answer vectors from the Random123 distribution, kat_vectors
+TEST(testPhiloxRandom, hostKnownAnswers) {
+    unsigned int counters[3][4] = {
+        {0, 0, 0, 0},
+        {0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff},
+        {0x243f6a88, 0x85a308d3, 0x13198a2e, 0x03707344}};
+    unsigned int keys[3][2] = {{0, 0}, {0xffffffff, 0xffffffff}, {0xa4093822, 0x299f31d0}};
+    unsigned int expected[3][4] = {
+        {0x6627e8d5, 0xe169c58d, 0xbc57ac4c, 0x9b00dbd8},
+        {0x408f276d, 0x41c83b0e, 0xa20bc7c6, 0x6d5451fd},
+        {0xd16cfe09, 0x94fdcceb, 0x5001e420, 0x24126ea1}};
+    for(int i = 0; i < 3; i++) {
+        unsigned int result[4];
+        PhiloxRandom::philox4x32(counters[i], keys[i], result);
+        for(int j = 0; j < 4; j++) {
+            EXPECT_EQ(expected[i][j], result[j]);
+        }
+    }
+}
+
+// device masks against the host generator, and the same seed giving the same
+// masks.  N is not a multiple of 4
+TEST(testPhiloxRandom, dropoutMasks) {
+    EasyCL *cl = DeepCLGtestGlobals_createEasyCL();
+    const int N = 10001;
+    const float dropRatio = 0.3f;
+    const unsigned long long seed = 0x123456789abcdefULL;
+    vector<unsigned char> masks(N);
+    CLWrapper *masksWrapper = cl->wrap(N, &masks[0]);
+    masksWrapper->createOnDevice();
+
+    PhiloxRandom random(cl);
+    random.seed(seed);
+    random.dropoutMasks(N, dropRatio, masksWrapper);
+    random.dropoutMasks(N, dropRatio, masksWrapper);
+    masksWrapper->copyToHost();
+    EXPECT_EQ(2u, random.getStep());
+
+    unsigned int key[2] = {(unsigned int)(seed & 0xffffffffULL), (unsigned int)(seed >> 32)};
+    int numDropped = 0;
+    for(int i = 0; i < N; i++) {
+        unsigned int counter[4] = {(unsigned int)(i / 4), 1, 0, 0};
+        unsigned int result[4];
+        PhiloxRandom::philox4x32(counter, key, result);
+        float uniform = (result[i % 4] >> 8) * (1.0f / 16777216.0f);
+        EXPECT_EQ(uniform <= dropRatio ? 0 : 1, (int)masks[i]);
+        if(masks[i] == 0) {
+            numDropped++;
+        }
+    }
+    EXPECT_NEAR(dropRatio, numDropped / (float)N, 0.02f);
+
+    vector<unsigned char> firstMasks(masks);
+    PhiloxRandom random2(cl);
+    random2.seed(seed);
+    random2.setStep(1);
+    random2.dropoutMasks(N, dropRatio, masksWrapper);
+    masksWrapper->copyToHost();
+    EXPECT_EQ(0, memcmp(&firstMasks[0], &masks[0], N));
+
+    delete masksWrapper;
+    delete cl;
+}
+
+// each image shifted as Translator::translate would, with offsets from the
+// host generator
+TEST(testPhiloxRandom, randomTranslations) {
+    EasyCL *cl = DeepCLGtestGlobals_createEasyCL();
+    const int batchSize = 7, numPlanes = 3, imageSize = 9, translateSize = 2;
+    const int N = batchSize * numPlanes * imageSize * imageSize;
+    const unsigned long long seed = 12345;
+    vector<float> input(N), output(N), expected(N);
+    WeightRandomizer::randomize(1, &input[0], N, -1.0f, 1.0f);
+    CLWrapper *inputWrapper = cl->wrap(N, &input[0]);
+    CLWrapper *outputWrapper = cl->wrap(N, &output[0]);
+    inputWrapper->copyToDevice();
+    outputWrapper->createOnDevice();
+
+    PhiloxRandom random(cl);
+    random.seed(seed);
+    random.randomTranslations(batchSize, numPlanes, imageSize, translateSize, inputWrapper, outputWrapper);
+    outputWrapper->copyToHost();
+
+    unsigned int key[2] = {(unsigned int)seed, 0};
+    for(int n = 0; n < batchSize; n++) {
+        unsigned int counter[4] = {(unsigned int)n, 0, 0, 0};
+        unsigned int result[4];
+        PhiloxRandom::philox4x32(counter, key, result);
+        int translateRows = (int)(result[0] % (2 * translateSize + 1)) - translateSize;
+        int translateCols = (int)(result[1] % (2 * translateSize + 1)) - translateSize;
+        Translator::translate(n, numPlanes, imageSize, translateRows, translateCols, &input[0], &expected[0]);
+    }
+    for(int i = 0; i < N; i++) {
+        EXPECT_EQ(expected[i], output[i]);
+    }
+
+    delete outputWrapper;
+    delete inputWrapper;
+    delete cl;
+}
+
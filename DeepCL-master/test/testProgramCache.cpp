@@ -0,0 +1,68 @@
+#include <iostream>
+#include <vector>
+
+#include "EasyCL.h"
+#include "util/ProgramCache.h"
+
+#include "test/DeepCLGtestGlobals.h"
+
+#include "gtest/gtest.h"
+
+using namespace std;
+
+namespace testProgramCache {
+
+const char *kernelSource =
+    "kernel void scale(const int N, const float multiplier, global float *data) {\n"
+    "    const int globalId = get_global_id(0);\n"
+    "    if(globalId < N) {\n"
+    "        data[globalId] *= multiplier;\n"
+    "    }\n"
+    "}\n";
+
+void runScale(EasyCL *cl, CLKernel *kernel, int N, float multiplier, CLWrapper *dataWrapper) {
+    kernel->in(N);
+    kernel->in(multiplier);
+    kernel->inout(dataWrapper);
+    int workgroupSize = cl->getMaxWorkgroupSize();
+    kernel->run_1d((N + workgroupSize - 1) / workgroupSize * workgroupSize, workgroupSize);
+    cl->finish();
+}
+
+// the second build of the same source and options is loaded from the binary
+// written by the first, and runs the same
+TEST(testProgramCache, missThenHit) {
+    EasyCL *cl = DeepCLGtestGlobals_createEasyCL();
+    ProgramCache *cache = ProgramCache::instance();
+    cache->setDirectory("testprogramcache");
+    const int N = 1000;
+    vector<float> data(N);
+    for(int i = 0; i < N; i++) {
+        data[i] = (float)i;
+    }
+    CLWrapper *dataWrapper = cl->wrap(N, &data[0]);
+    dataWrapper->copyToDevice();
+
+    int hitsBefore = cache->getNumHits();
+    CLKernel *first = ProgramCache::buildKernelFromString(cl, kernelSource, "scale", "-DUNUSED=1", "testProgramCache");
+    runScale(cl, first, N, 2.0f, dataWrapper);
+    CLKernel *second = ProgramCache::buildKernelFromString(cl, kernelSource, "scale", "-DUNUSED=1", "testProgramCache");
+    EXPECT_LE(hitsBefore + 1, cache->getNumHits());
+    runScale(cl, second, N, 3.0f, dataWrapper);
+    dataWrapper->copyToHost();
+    for(int i = 0; i < N; i++) {
+        EXPECT_EQ(6.0f * i, data[i]);
+    }
+
+    // different options is a different program
+    EXPECT_NE(ProgramCache::makeKey(cl, kernelSource, "-DUNUSED=1"), ProgramCache::makeKey(cl, kernelSource, "-DUNUSED=2"));
+
+    cache->setDirectory("");
+    delete second;
+    delete first;
+    delete dataWrapper;
+    delete cl;
+}
+
+}
+
@@ -0,0 +1,102 @@
+// Copyright Hugh Perkins 2016 hughperkins at gmail
+//
+// This Source Code Form is subject to the terms of the Mozilla Public License,
+// v. 2.0. If a copy of the MPL was not distributed with this file, You can
+// obtain one at http://mozilla.org/MPL/2.0/.
+
+#include <iostream>
+#include <vector>
+using namespace std;
+
+#include "qlearning/ReplayMemory.h"
+
+#include "gtest/gtest.h"
+#include "test/gtest_supp.h"
+
+namespace testReplayMemory {
+
+// experience i has before states i*100 + j, after states -(i*100 + j), action
+// i % 4, reward i / 2, and every third one is an end state
+void addExperience(ReplayMemory *memory, int i) {
+    const int cubeSize = memory->getCubeSize();
+    vector<float> before(cubeSize);
+    vector<float> after(cubeSize);
+    for(int j = 0; j < cubeSize; j++) {
+        before[j] = i * 100.0f + j;
+        after[j] = -(i * 100.0f + j);
+    }
+    memory->add(&before[0], i % 4, i / 2.0f, i % 3 == 0, &after[0]);
+}
+// which experience is in this slot, according to its first before value
+int experienceAt(ReplayMemory *memory, int slot) {
+    return (int)(memory->getBefore(slot)[0] / 100.0f);
+}
+
+TEST(testReplayMemory, addandgather) {
+    const int cubeSize = 5;
+    ReplayMemory memory(cubeSize, 10);
+    for(int i = 0; i < 7; i++) {
+        addExperience(&memory, i);
+    }
+    EXPECT_EQ(7, memory.getSize());
+    int indices[] = { 3, 0, 6, 3 };
+    vector<float> befores(4 * cubeSize);
+    vector<float> afters(4 * cubeSize);
+    memory.gather(4, indices, &befores[0], &afters[0]);
+    for(int n = 0; n < 4; n++) {
+        int i = experienceAt(&memory, indices[n]);
+        EXPECT_EQ(i % 4, memory.getAction(indices[n]));
+        EXPECT_FLOAT_EQ(i / 2.0f, memory.getReward(indices[n]));
+        EXPECT_EQ(i % 3 == 0, memory.getIsEndState(indices[n]));
+        for(int j = 0; j < cubeSize; j++) {
+            EXPECT_FLOAT_EQ(i * 100.0f + j, befores[n * cubeSize + j]);
+            EXPECT_FLOAT_EQ(-(i * 100.0f + j), afters[n * cubeSize + j]);
+        }
+    }
+}
+
+TEST(testReplayMemory, wrapsround) {
+    // more than the initial 1024-slot allocation, so it grows, then wraps
+    const int capacity = 1500;
+    ReplayMemory memory(3, capacity);
+    const int numAdded = 4000;
+    for(int i = 0; i < numAdded; i++) {
+        addExperience(&memory, i);
+    }
+    EXPECT_EQ(capacity, memory.getSize());
+    // exactly the most recent capacity experiences remain
+    vector<int> seen(numAdded, 0);
+    for(int slot = 0; slot < capacity; slot++) {
+        int i = experienceAt(&memory, slot);
+        ASSERT_GE(i, numAdded - capacity);
+        ASSERT_LT(i, numAdded);
+        seen[i]++;
+        EXPECT_EQ(i % 4, memory.getAction(slot));
+        EXPECT_FLOAT_EQ(-(i * 100.0f + 2), memory.getAfter(slot)[2]);
+    }
+    for(int i = numAdded - capacity; i < numAdded; i++) {
+        EXPECT_EQ(1, seen[i]);
+    }
+}
+
+TEST(testReplayMemory, sampleindices) {
+    ReplayMemory memory(2, 100);
+    MT19937 myrand;
+    myrand.seed(0);
+    int indices[64];
+    EXPECT_THROW(memory.sampleIndices(myrand, 64, indices), runtime_error);
+    for(int i = 0; i < 9; i++) {
+        addExperience(&memory, i);
+    }
+    memory.sampleIndices(myrand, 64, indices);
+    for(int n = 0; n < 64; n++) {
+        EXPECT_GE(indices[n], 0);
+        EXPECT_LT(indices[n], 9);
+    }
+    memory.setCapacity(5);
+    EXPECT_EQ(0, memory.getSize());
+    EXPECT_EQ(5, memory.getCapacity());
+}
+
+}
+
@@ -0,0 +1,109 @@
+#include <iostream>
+#include <vector>
+#include <stdexcept>
+
+#include "EasyCL.h"
+#include "net/NeuralNet.h"
+#include "net/StreamingPredictor.h"
+#include "layer/LayerMakers.h"
+#include "layer/Layer.h"
+#include "clblas/ClBlasInstance.h"
+
+#include "test/DeepCLGtestGlobals.h"
+#include "test/WeightRandomizer.h"
+
+#include "gtest/gtest.h"
+
+using namespace std;
+
+namespace testStreamingPredictor {
+
+NeuralNet *createNet(EasyCL *cl) {
+    NeuralNet *net = new NeuralNet(cl, 2, 9);
+    net->addLayer(ConvolutionalMaker::instance()->numFilters(4)->filterSize(3)->biased()->padZeros());
+    net->addLayer(ActivationMaker::instance()->relu());
+    net->addLayer(FullyConnectedMaker::instance()->numPlanes(5)->imageSize(1)->biased());
+    net->addLayer(SoftMaxMaker::instance());
+    return net;
+}
+
+// 3 full batches, and a short one, through the pipeline give the same
+// outputs, in the same order, as forwarding each batch directly
+TEST(testStreamingPredictor, matchesForward) {
+    EasyCL *cl = DeepCLGtestGlobals_createEasyCL();
+    ClBlasInstance blasInstance;
+    NeuralNet *net = createNet(cl);
+    const int batchSize = 4;
+    const int N = 3 * batchSize + 2;
+    const int inputCubeSize = net->getInputCubeSize();
+    vector<float> input(N * inputCubeSize);
+    WeightRandomizer::randomize(1, &input[0], (int)input.size(), -1.0f, 1.0f);
+
+    net->setBatchSize(batchSize);
+    const int outputCubeSize = net->getOutputCubeSize();
+    vector<float> expected(N * outputCubeSize);
+    vector<float> batchInput(batchSize * inputCubeSize);
+    for(int n = 0; n < N; n += batchSize) {
+        int numImages = std::min(batchSize, N - n);
+        std::fill(batchInput.begin(), batchInput.end(), 0.0f);
+        std::copy(&input[n * inputCubeSize], &input[(n + numImages) * inputCubeSize], batchInput.begin());
+        net->forward(&batchInput[0]);
+        std::copy(net->getOutput(), net->getOutput() + numImages * outputCubeSize, &expected[n * outputCubeSize]);
+    }
+
+    StreamingPredictor predictor(net, batchSize, net->getNumLayers() - 1, false, 2);
+    int numRead = 0;
+    vector<float> output;
+    predictor.run(
+        [&](float *inputData, int maxImages) -> int {
+            int numImages = std::min(maxImages, N - numRead);
+            std::copy(&input[numRead * inputCubeSize], &input[(numRead + numImages) * inputCubeSize], inputData);
+            numRead += numImages;
+            return numImages;
+        },
+        [&](int numImages, float const *batchOutput, int const *labels) {
+            output.insert(output.end(), batchOutput, batchOutput + numImages * outputCubeSize);
+        });
+    EXPECT_EQ(N, predictor.getNumImages());
+    EXPECT_EQ(4, predictor.getNumBatches());
+    ASSERT_EQ(expected.size(), output.size());
+    for(int i = 0; i < (int)expected.size(); i++) {
+        EXPECT_FLOAT_EQ(expected[i], output[i]);
+    }
+    EXPECT_LE(predictor.getLatencyPercentile(50), predictor.getLatencyPercentile(100));
+
+    delete net;
+    delete cl;
+}
+
+// an exception in the writer stops the reader and the net, and comes out of
+// run
+TEST(testStreamingPredictor, writerErrorPropagates) {
+    EasyCL *cl = DeepCLGtestGlobals_createEasyCL();
+    ClBlasInstance blasInstance;
+    NeuralNet *net = createNet(cl);
+    const int batchSize = 4;
+    StreamingPredictor predictor(net, batchSize, net->getNumLayers() - 1, true, 2);
+    const int inputCubeSize = net->getInputCubeSize();
+    bool threw = false;
+    try {
+        predictor.run(
+            [&](float *inputData, int maxImages) -> int {
+                std::fill(inputData, inputData + maxImages * inputCubeSize, 0.5f);
+                return maxImages; // never ends by itself
+            },
+            [&](int numImages, float const *output, int const *labels) {
+                throw runtime_error("writer failed");
+            });
+    } catch(runtime_error &e) {
+        threw = true;
+        EXPECT_EQ(string("writer failed"), string(e.what()));
+    }
+    EXPECT_TRUE(threw);
+
+    delete net;
+    delete cl;
+}
+
+}
+
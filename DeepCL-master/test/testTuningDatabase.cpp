@@ -0,0 +1,64 @@
+// Copyright Hugh Perkins 2016 hughperkins at gmail
+//
+// This Source Code Form is subject to the terms of the Mozilla Public License, 
+// v. 2.0. If a copy of the MPL was not distributed with this file, You can 
+// obtain one at http://mozilla.org/MPL/2.0/.
+
+#include <iostream>
+#include <vector>
+using namespace std;
+
+#include "conv/TuningDatabase.h"
+#include "conv/LayerDimensions.h"
+#include "util/FileHelper.h"
+
+#include "gtest/gtest.h"
+#include "test/gtest_supp.h"
+
+TEST( testTuningDatabase, median ) {
+    vector<float> values;
+    EXPECT_EQ( 0, TuningDatabase::median( values ) );
+    values.push_back( 5 );
+    values.push_back( 1 );
+    values.push_back( 100 );
+    EXPECT_EQ( 5, TuningDatabase::median( values ) );
+    values.push_back( 3 );
+    EXPECT_EQ( 4, TuningDatabase::median( values ) );
+}
+
+TEST( testTuningDatabase, dimensionskey ) {
+    LayerDimensions dim( 8, 28, 16, 5, true, true );
+    EXPECT_EQ( "i8x28f16x5p1b1s0", TuningDatabase::dimensionsKey( dim ) );
+    dim.setSkip( 1 ).setBiased( false );
+    EXPECT_EQ( "i8x28f16x5p1b0s1", TuningDatabase::dimensionsKey( dim ) );
+}
+
+TEST( testTuningDatabase, recordandreload ) {
+    string filepath = "testtuningdatabase.txt";
+    if( FileHelper::exists( filepath ) ) {
+        FileHelper::remove( filepath );
+    }
+    string key1 = "somedevice\t1.2\tforward\t128\t" + TuningDatabase::dimensionsKey( LayerDimensions( 1, 28, 8, 5, true, true ) );
+    string key2 = "somedevice\t1.2\tbackward\t128\t" + TuningDatabase::dimensionsKey( LayerDimensions( 1, 28, 8, 5, true, true ) );
+
+    TuningDatabase db;
+    EXPECT_FALSE( db.enabled() );
+    EXPECT_EQ( -1, db.lookup( key1 ) );
+    db.setFilepath( filepath );
+    EXPECT_TRUE( db.enabled() );
+    EXPECT_EQ( -1, db.lookup( key1 ) );
+    db.record( key1, 3, 1.25f );
+    db.record( key2, 2, 4.5f );
+    EXPECT_EQ( 3, db.lookup( key1 ) );
+
+    TuningDatabase db2;
+    db2.setFilepath( filepath );
+    EXPECT_EQ( 2, db2.size() );
+    EXPECT_EQ( 3, db2.lookup( key1 ) );
+    EXPECT_EQ( 2, db2.lookup( key2 ) );
+    db2.setRetune( true );
+    EXPECT_EQ( -1, db2.lookup( key1 ) );
+
+    FileHelper::remove( filepath );
+}
+
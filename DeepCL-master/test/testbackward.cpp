@@ -10,6 +10,8 @@
 
 #include "net/NeuralNet.h"
 #include "conv/Backward.h"
+#include "conv/CpuConvolution.h"
+#include "util/ThreadPool.h"
 #include "activate/ActivationFunction.h"
 #include "loss/LossLayer.h"
 #include "forcebackprop/ForceBackpropLayerMaker.h"
@@ -808,6 +810,9 @@ TEST(testbackward, compare_1_n_kgsgo_32c5) {
 
     compareSpecific(0, 1, 1, batchSize, dim);
     for(int instance=2; instance < Backward::getNumImplementations(); instance++) {
+        if(!Backward::plausiblyOptimal(instance, batchSize, dim)) {
+            continue; // eg winograd, which is 3x3 only
+        }
         cout << "instance " << instance << endl;
         dim.setInputSize(19);
         if(instance == 2 && maxWorkgroupSize < 19 * 19) {
@@ -817,6 +822,38 @@ TEST(testbackward, compare_1_n_kgsgo_32c5) {
     }
 }
 
+// winograd F(2x2, 3x3) and F(4x4, 3x3), indices 5 and 6, with and without
+// padding.  19 is not a multiple of either tile size
+TEST(testbackward, compare_1_winograd) {
+    int batchSize = 4;
+    LayerDimensions dim;
+    dim.setInputPlanes(8).setInputSize(19).setNumFilters(8).setFilterSize(3)
+        .setBiased(true);
+    for(int instance = 5; instance <= 6; instance++) {
+        dim.setPadZeros(true);
+        compareSpecific(1, instance, 1, batchSize, dim);
+        dim.setPadZeros(false);
+        compareSpecific(1, instance, 1, batchSize, dim);
+    }
+}
+
+// cpu im2col, index 4, against the gpu naive version.  A batch with fewer
+// images than CpuConvolution has threads also splits each image across its
+// input planes, so try one image, and one fewer than the thread count
+TEST(testbackward, compare_1_4_cpuim2col) {
+    const int numThreads = CpuConvolution::sharedThreadPool()->getNumThreads();
+    LayerDimensions dim;
+    dim.setInputPlanes(8).setInputSize(13).setNumFilters(6).setFilterSize(5)
+        .setBiased(true);
+    const int batchSizes[] = {5, 1, std::max(1, numThreads - 1)};
+    for(int i = 0; i < 3; i++) {
+        dim.setPadZeros(true);
+        compareSpecific(1, 4, 1, batchSizes[i], dim);
+        dim.setPadZeros(false);
+        compareSpecific(1, 4, 1, batchSizes[i], dim);
+    }
+}
+
 TEST(SLOW_testbackward, compare_kgsgo_32c5mini) {
     int batchSize = 4;
     LayerDimensions dim;
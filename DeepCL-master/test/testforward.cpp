@@ -557,6 +557,55 @@ TEST( testforward, compare_0_1_biased_pad ) {
     compareSpecific( false, N, batchSize, dim, 0, 1 );
 }
 
+// cpu im2col (index 8) against the naive cpu version
+TEST( testforward, compare_0_8_biased_nopad ) {
+    LayerDimensions dim;
+    int batchSize = 4;
+    int N = 4;
+    dim.setInputPlanes( 8 ).setInputSize(19).setNumFilters( 8 )
+        .setFilterSize( 5 )
+        .setPadZeros( false ).setBiased( true );
+    compareSpecific( false, N, batchSize, dim, 0, 8 );
+}
+
+TEST( testforward, compare_0_8_biased_pad ) {
+    LayerDimensions dim;
+    int batchSize = 4;
+    int N = 4;
+    dim.setInputPlanes( 8 ).setInputSize(19).setNumFilters( 8 )
+        .setFilterSize( 5 )
+        .setPadZeros( true ).setBiased( true );
+    compareSpecific( false, N, batchSize, dim, 0, 8 );
+}
+
+// gpu im2col (index 7) runs the batch as one gemm, with the bias in the
+// epilogue; check the unbiased epilogue too, with an odd batch size
+TEST( testforward, compare_1_7_unbiased_pad ) {
+    LayerDimensions dim;
+    int batchSize = 5;
+    int N = 10;
+    dim.setInputPlanes( 8 ).setInputSize(19).setNumFilters( 8 )
+        .setFilterSize( 5 )
+        .setPadZeros( true ).setBiased( false );
+    compareSpecific( false, N, batchSize, dim, 1, 7 );
+}
+
+// winograd F(2x2, 3x3) and F(4x4, 3x3), indices 9 and 10.  19 is not a
+// multiple of either tile size
+TEST( testforward, compare_1_winograd ) {
+    LayerDimensions dim;
+    int batchSize = 4;
+    int N = 4;
+    dim.setInputPlanes( 8 ).setInputSize(19).setNumFilters( 8 )
+        .setFilterSize( 3 ).setBiased( true );
+    for( int instance = 9; instance <= 10; instance++ ) {
+        dim.setPadZeros( true );
+        compareSpecific( false, N, batchSize, dim, 1, instance );
+        dim.setPadZeros( false );
+        compareSpecific( false, N, batchSize, dim, 1, instance );
+    }
+}
+
 TEST( testforward, compare_1_n_biased_nopad ) {
     LayerDimensions dim;
     int batchSize = 4;
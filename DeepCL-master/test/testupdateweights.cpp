@@ -851,6 +851,20 @@ TEST(SLOW_testupdateweights, compare_args) {
     compareSpecific(debug, learningRate, its, batchSize, dim, instance0, instance1);        
 }
 
+TEST(testupdateweights, compare_0_5_biased_pad) {
+    LayerDimensions dim;
+    dim.setInputSize(19).setInputPlanes(4).setNumFilters(8).setFilterSize(5)
+        .setBiased(1).setPadZeros(1);
+    compareSpecific(false, 1.0f, 1, 4, dim, 0, 5);
+}
+
+TEST(testupdateweights, compare_0_5_biased_nopad) {
+    LayerDimensions dim;
+    dim.setInputSize(19).setInputPlanes(4).setNumFilters(8).setFilterSize(5)
+        .setBiased(1).setPadZeros(0);
+    compareSpecific(false, 1.0f, 1, 4, dim, 0, 5);
+}
+
 //    TEST(testupdateweights, compare_instance3_smaller2) {
 //        LayerDimensions dim;
 //        dim.setInputSize(96).setInputPlanes(1).setNumFilters(1).setFilterSize(6)
@@ -96,6 +96,10 @@ private:
 
 class Context;
 
+namespace cpu {
+    class ThreadPool;
+}
+
 ///
 /// This class is used to pass cl::Events that the kernel should wait for and/or signal event completion
 ///
@@ -411,6 +415,15 @@ public:
         return q;
     }
 
+    ///
+    /// Get thread pool used by operators of CPU context, all copies of the context share it.
+    /// Its size defaults to DLPRIM_CPU_THREADS environment variable or the number of hardware threads
+    ///
+    cpu::ThreadPool &thread_pool()
+    {
+        return *thread_pool_;
+    }
+
     /// Generate ExecutionContext (queue + events)
     ExecutionContext make_execution_context(cl_command_queue_properties props=0)
     {
@@ -428,6 +441,7 @@ private:
     ContextType type_;;
     std::map<std::string,bool> ext_cache_;
     std::string ext_;
+    std::shared_ptr<cpu::ThreadPool> thread_pool_;
 };
 
 
@@ -0,0 +1,84 @@
+///////////////////////////////////////////////////////////////////////////////
+///
+/// Copyright (c) 2021-2022 Artyom Beilis <artyomtnk@yahoo.com>
+///
+/// MIT License, see LICENSE.TXT
+///
+///////////////////////////////////////////////////////////////////////////////
+#pragma once
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <vector>
+
+namespace dlprim {
+    namespace cpu {
+        ///
+        /// Pool of worker threads used by operators of CPU context, it is owned by Context
+        /// and shared between all its copies.
+        ///
+        /// Threads are started on first use, so creating a context that never runs
+        /// CPU kernels costs nothing.
+        ///
+        class ThreadPool {
+        public:
+            ///
+            /// Create a pool of \a threads threads including the calling one. If threads <= 0
+            /// it is taken from DLPRIM_CPU_THREADS environment variable, and if it isn't
+            /// set, from the number of hardware threads
+            ///
+            ThreadPool(int threads = 0);
+            ~ThreadPool();
+
+            ThreadPool(ThreadPool const &) = delete;
+            void operator=(ThreadPool const &) = delete;
+
+            ///
+            /// Number of threads, including the calling one, that parallel_for uses. Operators
+            /// that need per-thread workspace should allocate size() slices
+            ///
+            int size() const
+            {
+                return size_;
+            }
+
+            ///
+            /// Change number of threads. Note: operators size their workspace in setup/reshape
+            /// so call it before Net::setup()
+            ///
+            void resize(int threads);
+
+            ///
+            /// Split range [0,n) into at most size() contiguous chunks and call f(begin,end,thread_id)
+            /// for each, thread_id is in [0,size()). The first chunk runs in the calling thread;
+            /// the call returns when all chunks are done. If f throws, the first exception is rethrown.
+            ///
+            /// Calls from inside f run serially in the calling thread with thread_id = 0
+            ///
+            void parallel_for(size_t n,std::function<void(size_t,size_t,int)> const &f);
+
+        private:
+            void start();
+            void stop();
+            void worker(int id,long long seen);
+            void run_chunk(int id);
+
+            int size_;
+            std::vector<std::thread> threads_;
+            std::mutex call_lock_;
+
+            std::mutex lock_;
+            std::condition_variable job_ready_;
+            std::condition_variable job_done_;
+            long long generation_;
+            bool shutdown_;
+            int chunks_;
+            int running_;
+            size_t n_;
+            std::function<void(size_t,size_t,int)> const *job_;
+            std::exception_ptr error_;
+        };
+    } // cpu
+} // dlprim
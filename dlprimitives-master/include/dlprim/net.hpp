@@ -103,6 +103,69 @@ namespace dlprim {
             keep_intermediate_tensors_ = keep;
         }
 
+        ///
+        /// True if the graph is optimized for inference in setup(), default true
+        ///
+        bool optimize_graph() const
+        {
+            return optimize_graph_;
+        }
+        ///
+        /// Set if setup() optimizes the graph when the network is in predict mode and intermediate
+        /// tensors aren't kept: BatchNorm following Convolution2D or InnerProduct is folded into
+        /// its weights and bias, and Activation is fused into the preceding Convolution2D, InnerProduct
+        /// or Elementwise operator or removed if it is identity. Parameters keep their original names and
+        /// shapes, folded weights are recomputed by copy_parameters_to_device()
+        ///
+        void optimize_graph(bool optimize)
+        {
+            optimize_graph_ = optimize;
+        }
+
+        ///
+        /// Enable activation checkpointing for training. setup() splits the operators into segments such that
+        /// forward tensors fit into \a memory_budget bytes with least recomputation. Only network inputs, outputs
+        /// and tensors used by several segments are kept after forward(), intermediate tensors of a segment share
+        /// memory with other segments and are recomputed by backward(). If the budget can't be met the plan
+        /// using least memory is taken, so 0 means minimal memory.
+        ///
+        /// Used in train mode when intermediate tensors aren't kept, call before setup()
+        ///
+        void activation_checkpointing(size_t memory_budget)
+        {
+            checkpointing_ = true;
+            checkpoint_budget_ = memory_budget;
+            checkpoint_names_.clear();
+        }
+        ///
+        /// Enable activation checkpointing with segments starting at given operators rather than planning them
+        /// by memory budget. An operator can't start a segment if a tensor is modified in-place across it
+        ///
+        void activation_checkpointing(std::vector<std::string> const &checkpoints)
+        {
+            checkpointing_ = true;
+            checkpoint_names_ = checkpoints;
+        }
+        ///
+        /// Disable activation checkpointing, default
+        ///
+        void disable_activation_checkpointing()
+        {
+            checkpointing_ = false;
+            checkpoint_names_.clear();
+        }
+        ///
+        /// Operators that start recomputed segments as planned by setup(), empty if checkpointing isn't used
+        ///
+        std::vector<std::string> activation_checkpoints() const;
+        ///
+        /// Memory allocated by setup() for forward tensors in bytes, excluding gradients
+        ///
+        size_t activation_memory() const
+        {
+            return activation_memory_;
+        }
+
         ///
         /// Add an operator \a op to the network. name should be unique
         ///
@@ -278,12 +341,36 @@ namespace dlprim {
             bool frozen;
         };
 
+        /// BatchNorm folded into the weights of a Convolution2D or InnerProduct connection
+        struct BatchNormFold {
+            std::string connection;
+            std::unique_ptr<Operator> source_op;
+            std::unique_ptr<Operator> batch_norm;
+            std::vector<std::string> source_parameters;
+            std::vector<std::string> batch_norm_parameters;
+            Tensor weight;
+            Tensor bias;
+        };
+
+        void optimize_for_inference();
+        bool fold_batch_norm(unsigned producer,unsigned index);
+        bool fuse_activation(unsigned producer,unsigned index);
+        int fusable_producer(unsigned index);
+        void merge_into_producer(unsigned producer,unsigned index);
+        void replace_operator(Connection &conn,std::unique_ptr<Operator> op);
+        void fold_batch_norms();
+
         void setup_ws();
         void mark_backpropagating_edges();
         void allocate_tensors();
         void allocate_aliases();
         bool is_loss(std::string const &name);
         void allocate_optimized_chunks(bool forward_only);
+        void plan_activation_checkpoints();
+        std::vector<unsigned> find_checkpoints(std::vector<std::pair<int,int> > const &used_at,
+                                               std::vector<size_t> const &sizes,
+                                               std::vector<bool> const &valid);
+        void recompute_segment(unsigned begin,unsigned end,ExecutionContext const &e,bool sync);
         void tensor_use_list(std::vector<std::list<std::string> > &start,
                               std::vector<std::list<std::string> > &stop);
         void allocate_chunks();
@@ -311,7 +398,19 @@ namespace dlprim {
 
         std::shared_ptr<SharedResource> shared_resource_;
 
+        std::vector<BatchNormFold> bn_folds_;
+
         CalculationsMode mode_;
         bool keep_intermediate_tensors_;
+        bool optimize_graph_;
+
+        bool checkpointing_;
+        size_t checkpoint_budget_;
+        std::vector<std::string> checkpoint_names_;
+        std::vector<unsigned> segments_; // starts of recomputed segments, first is 0
+        std::vector<bool> recompute_; // per segment, set if its tensors are released after forward
+        std::map<std::string,size_t> recomputed_offsets_; // offsets of released tensors in the shared chunk
+        size_t recompute_chunk_size_;
+        size_t activation_memory_;
     };
 };
@@ -138,7 +138,21 @@ namespace dlprim {
                              std::vector<Tensor> &parameters,
                              Tensor &workspace,
                              ExecutionContext const &ctx) = 0;
-		
+
+        ///
+        /// Repeat forward propogation to recompute activations released by activation checkpointing,
+        /// see Net::activation_checkpointing(). Same as forward() but the state that forward() updates,
+        /// like running statistics of BatchNorm, must not be updated second time
+        ///
+		virtual void recompute_forward(std::vector<Tensor> &input,
+                                       std::vector<Tensor> &output,
+                                       std::vector<Tensor> &parameters,
+                                       Tensor &workspace,
+                                       ExecutionContext const &ctx)
+        {
+            forward(input,output,parameters,workspace,ctx);
+        }
+
         ///
         /// Enqueue backward propogation computations
         ///
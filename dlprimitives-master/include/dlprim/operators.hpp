@@ -10,4 +10,5 @@
 #include <dlprim/ops/conv2d.hpp>
 #include <dlprim/ops/batch_normalization.hpp>
 #include <dlprim/ops/parameter.hpp>
+#include <dlprim/ops/quantization.hpp>
 
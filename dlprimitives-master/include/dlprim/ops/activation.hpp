@@ -27,6 +27,14 @@ namespace dlprim {
             return "Activation";
         }
 
+        ///
+        /// Configuration the operator was created with
+        ///
+        ActivationConfig const &config() const
+        {
+            return config_;
+        }
+
 		virtual void setup(std::vector<TensorSpecs> const &in,
                            std::vector<TensorSpecs> &out,
                            std::vector<TensorSpecs> &parameters,
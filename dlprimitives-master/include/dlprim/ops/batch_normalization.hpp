@@ -31,6 +31,14 @@ namespace dlprim {
         {
             return "BatchNorm";
         }
+
+        ///
+        /// Configuration the operator was created with
+        ///
+        BatchNormConfig const &config() const
+        {
+            return config_;
+        }
         
         virtual void initialize_params(std::vector<Tensor> &parameters,ExecutionContext const &e);
         virtual void mode(CalculationsMode m);
@@ -51,22 +59,47 @@ namespace dlprim {
                              Tensor &workspace,
                              ExecutionContext const &ctx);
 
+        /// same as forward() but running statistics aren't updated
+		virtual void recompute_forward(std::vector<Tensor> &input,
+                                       std::vector<Tensor> &output,
+                                       std::vector<Tensor> &parameters,
+                                       Tensor &workspace,
+                                       ExecutionContext const &ctx);
+
         virtual void backward(std::vector<TensorAndGradient> &input,
                               std::vector<TensorAndGradient> &output,
                               std::vector<TensorAndGradient> &parameters,
                               Tensor &workspace,
                               ExecutionContext const &ctx);
 
+        ///
+        /// Fold inference mode batch normalization into the layer before it:
+        /// weight holds \a channels rows of \a row values each and is scaled in
+        /// place, bias holds \a channels values, the layer's own bias or zeros,
+        /// and is replaced by the folded bias. gamma and beta are used only
+        /// if cfg.affine
+        ///
+        static void fold_into(BatchNormConfig const &cfg,int channels,size_t row,
+                              float const *mean,float const *var,float const *gamma,float const *beta,
+                              float *weight,float *bias);
+
 
     private:
         void backward_cpu(std::vector<TensorAndGradient> &input,
                           std::vector<TensorAndGradient> &output,
                           std::vector<TensorAndGradient> &parameters,
                           Tensor &workspace);
+        void forward_impl(std::vector<Tensor> &input,
+                          std::vector<Tensor> &output,
+                          std::vector<Tensor> &parameters,
+                          Tensor &workspace,
+                          ExecutionContext const &ctx,
+                          bool update_stats);
 	    void forward_cpu(std::vector<Tensor> &input,
                              std::vector<Tensor> &output,
                              std::vector<Tensor> &parameters,
-                             Tensor &workspace);
+                             Tensor &workspace,
+                             bool update_stats);
         void cpu_backward_data(Tensor &x,Tensor &dx,Tensor &dy,float *mean,float *var,float *dy_sum,float *dyx_sum,float *gamma_in);
         void cpu_forward_data(Tensor &x,Tensor &y,Tensor &scale,Tensor &offset);
         void get_batch_stats(Tensor &x,Tensor &mean,Tensor &var);
@@ -30,8 +30,15 @@ namespace dlprim {
     protected:
         template<typename Op,typename DType>
         static void im2col(Shape const &in,Shape const &outs,DType *img_in,DType *mat_in,Convolution2DConfig const &config);
-        static void fwd_bwd_cpu(GemmOpMode mode,Tensor &in,Tensor &out,Tensor &W,Tensor *bias_tensor,void *ws,Convolution2DConfig const &config,float fwd_beta=0.0f);
+        ///
+        /// Run convolution on CPU using \a pool threads, ws should have pool.size() im2col slices
+        ///
+        static void fwd_bwd_cpu(cpu::ThreadPool &pool,GemmOpMode mode,Tensor &in,Tensor &out,Tensor &W,Tensor *bias_tensor,void *ws,Convolution2DConfig const &config,float fwd_beta=0.0f);
         static void scale_cpu(Tensor &t,float v);
+        ///
+        /// im2col for int8 images used by QuantizedConvolution2D
+        ///
+        static void im2col_cpu(Shape const &in,Shape const &outs,int8_t *img_in,int8_t *mat_in,Convolution2DConfig const &config);
     };
 
     class Convolution2D : public Operator, public Convolution2DBase {
@@ -44,6 +51,14 @@ namespace dlprim {
         {
             return "Convolution2D";
         }
+
+        ///
+        /// Configuration the operator was created with
+        ///
+        Convolution2DConfig const &config() const
+        {
+            return config_;
+        }
         
         void initialize_params(std::vector<Tensor> &parameters,ExecutionContext const &e);
 
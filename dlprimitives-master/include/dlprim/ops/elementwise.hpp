@@ -37,6 +37,14 @@ namespace dlprim {
             return "Elementwise";
         }
 
+        ///
+        /// Configuration the operator was created with
+        ///
+        ElementwiseConfig const &config() const
+        {
+            return config_;
+        }
+
 		virtual void setup(std::vector<TensorSpecs> const &in,
                            std::vector<TensorSpecs> &out,
                            std::vector<TensorSpecs> &parameters,
@@ -32,6 +32,14 @@ namespace dlprim {
         {
             return "InnerProduct";
         }
+
+        ///
+        /// Configuration the operator was created with
+        ///
+        InnerProductConfig const &config() const
+        {
+            return config_;
+        }
         void initialize_params(std::vector<Tensor> &parameters,ExecutionContext const &e);
 		
         virtual void setup(std::vector<TensorSpecs> const &in,
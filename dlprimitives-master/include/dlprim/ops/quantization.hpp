@@ -0,0 +1,268 @@
+///////////////////////////////////////////////////////////////////////////////
+///
+/// Copyright (c) 2021-2022 Artyom Beilis <artyomtnk@yahoo.com>
+///
+/// MIT License, see LICENSE.TXT
+///
+///////////////////////////////////////////////////////////////////////////////
+#pragma once
+#include <dlprim/operator.hpp>
+#include <dlprim/ops/conv2d.hpp>
+#include <dlprim/ops/inner_product.hpp>
+#include <dlprim/ops/pooling.hpp>
+#include <dlprim/ops/activation.hpp>
+
+///
+/// INT8 inference operators.
+///
+/// Quantization is symmetric: int8 value q represents real value q * scale. Activations have a per-tensor
+/// scale given in operator options, weights of convolution and inner product have per output channel
+/// scale stored as a float parameter. Products are accumulated in int32, then scaled to float, bias and
+/// activation are applied and the result is requantized by output scale with rounding to nearest even
+/// and saturation to [-128,127].
+///
+/// The operators support inference only, use `dlprim_calibrate` tool to convert a float network.
+///
+namespace dlprim {
+    namespace json { class value; }
+
+    struct QuantizeConfig {
+        float scale = 1.0f;
+        static QuantizeConfig from_json(json::value const &v);
+    };
+
+    ///
+    /// Convert float tensor to int8: y = saturate(round(x / scale))
+    ///
+    class Quantize : public Operator {
+    public:
+        Quantize(Context &ctx,QuantizeConfig const &config = QuantizeConfig());
+        virtual ~Quantize();
+
+        virtual char const *operator_type() const
+        {
+            return "Quantize";
+        }
+
+		virtual void setup(std::vector<TensorSpecs> const &in,
+                           std::vector<TensorSpecs> &out,
+                           std::vector<TensorSpecs> &parameters,
+                           size_t &workspace);
+
+        virtual void reshape(std::vector<Shape> const &in,
+                             std::vector<Shape> &out,
+                             size_t &ws);
+
+		virtual void forward(std::vector<Tensor> &input,
+                             std::vector<Tensor> &output,
+                             std::vector<Tensor> &parameters,
+                             Tensor &workspace,
+                             ExecutionContext const &ctx);
+    private:
+        QuantizeConfig config_;
+        cl::Kernel kernel_;
+    };
+
+    ///
+    /// Convert int8 tensor to float: y = x * scale
+    ///
+    class Dequantize : public Operator {
+    public:
+        Dequantize(Context &ctx,QuantizeConfig const &config = QuantizeConfig());
+        virtual ~Dequantize();
+
+        virtual char const *operator_type() const
+        {
+            return "Dequantize";
+        }
+
+		virtual void setup(std::vector<TensorSpecs> const &in,
+                           std::vector<TensorSpecs> &out,
+                           std::vector<TensorSpecs> &parameters,
+                           size_t &workspace);
+
+        virtual void reshape(std::vector<Shape> const &in,
+                             std::vector<Shape> &out,
+                             size_t &ws);
+
+		virtual void forward(std::vector<Tensor> &input,
+                             std::vector<Tensor> &output,
+                             std::vector<Tensor> &parameters,
+                             Tensor &workspace,
+                             ExecutionContext const &ctx);
+    private:
+        QuantizeConfig config_;
+        cl::Kernel kernel_;
+    };
+
+    struct QuantizedConvolution2DConfig : public Convolution2DConfig {
+        float input_scale = 1.0f;
+        float output_scale = 1.0f;
+        static QuantizedConvolution2DConfig from_json(json::value const &v);
+    };
+
+    ///
+    /// INT8 convolution, parameters: int8 weights, float per output channel weight scale and
+    /// optional float bias
+    ///
+    class QuantizedConvolution2D : public Operator, public Convolution2DBase {
+    public:
+        QuantizedConvolution2D(Context &ctx,QuantizedConvolution2DConfig const &config);
+        virtual ~QuantizedConvolution2D();
+
+        virtual char const *operator_type() const
+        {
+            return "QuantizedConvolution2D";
+        }
+
+        QuantizedConvolution2DConfig const &config() const
+        {
+            return config_;
+        }
+
+		virtual void setup(std::vector<TensorSpecs> const &in,
+                           std::vector<TensorSpecs> &out,
+                           std::vector<TensorSpecs> &parameters,
+                           size_t &workspace);
+
+        virtual void reshape(std::vector<Shape> const &in,
+                             std::vector<Shape> &out,
+                             size_t &ws);
+
+		virtual void forward(std::vector<Tensor> &input,
+                             std::vector<Tensor> &output,
+                             std::vector<Tensor> &parameters,
+                             Tensor &workspace,
+                             ExecutionContext const &ctx);
+    private:
+        Shape get_output_shape(Shape const &in);
+        size_t calc_workspace(Shape const &out);
+        void forward_cpu(Tensor &in,Tensor &out,Tensor &W,Tensor &W_scale,Tensor *bias,Tensor &ws);
+        void forward_gpu(Tensor &in,Tensor &out,Tensor &W,Tensor &W_scale,Tensor *bias,ExecutionContext const &ctx);
+
+        QuantizedConvolution2DConfig config_;
+        cl::Kernel kernel_;
+    };
+
+    struct QuantizedInnerProductConfig : public InnerProductConfig {
+        float input_scale = 1.0f;
+        float output_scale = 1.0f;
+        static QuantizedInnerProductConfig from_json(json::value const &v);
+    };
+
+    ///
+    /// INT8 inner product, parameters: int8 weights, float per output weight scale and optional float bias
+    ///
+    class QuantizedInnerProduct : public Operator {
+    public:
+        QuantizedInnerProduct(Context &ctx,QuantizedInnerProductConfig const &config);
+        virtual ~QuantizedInnerProduct();
+
+        virtual char const *operator_type() const
+        {
+            return "QuantizedInnerProduct";
+        }
+
+        QuantizedInnerProductConfig const &config() const
+        {
+            return config_;
+        }
+
+		virtual void setup(std::vector<TensorSpecs> const &in,
+                           std::vector<TensorSpecs> &out,
+                           std::vector<TensorSpecs> &parameters,
+                           size_t &workspace);
+
+        virtual void reshape(std::vector<Shape> const &in,
+                             std::vector<Shape> &out,
+                             size_t &ws);
+
+		virtual void forward(std::vector<Tensor> &input,
+                             std::vector<Tensor> &output,
+                             std::vector<Tensor> &parameters,
+                             Tensor &workspace,
+                             ExecutionContext const &ctx);
+    private:
+        void forward_cpu(Tensor &in,Tensor &out,Tensor &W,Tensor &W_scale,Tensor *bias);
+        void forward_gpu(Tensor &in,Tensor &out,Tensor &W,Tensor &W_scale,Tensor *bias,ExecutionContext const &ctx);
+
+        QuantizedInnerProductConfig config_;
+        cl::Kernel kernel_;
+    };
+
+    ///
+    /// INT8 pooling, output has the scale of the input. Averages are rounded to nearest even
+    ///
+    class QuantizedPooling2D : public Operator {
+    public:
+        QuantizedPooling2D(Context &ctx,Pooling2DConfig const &config = Pooling2DConfig());
+        virtual ~QuantizedPooling2D();
+
+        virtual char const *operator_type() const
+        {
+            return "QuantizedPooling2D";
+        }
+
+		virtual void setup(std::vector<TensorSpecs> const &in,
+                           std::vector<TensorSpecs> &out,
+                           std::vector<TensorSpecs> &parameters,
+                           size_t &workspace);
+
+        virtual void reshape(std::vector<Shape> const &in,
+                             std::vector<Shape> &out,
+                             size_t &ws);
+
+		virtual void forward(std::vector<Tensor> &input,
+                             std::vector<Tensor> &output,
+                             std::vector<Tensor> &parameters,
+                             Tensor &workspace,
+                             ExecutionContext const &ctx);
+    private:
+        Shape calc_shape(Shape const &ins);
+        void forward_cpu(Tensor &in,Tensor &out);
+        void forward_gpu(Tensor &in,Tensor &out,ExecutionContext const &ctx);
+
+        Pooling2DConfig config_;
+        cl::Kernel kernel_;
+    };
+
+    struct QuantizedActivationConfig : public ActivationConfig {
+        float input_scale = 1.0f;
+        float output_scale = 1.0f;
+        static QuantizedActivationConfig from_json(json::value const &v);
+    };
+
+    ///
+    /// INT8 activation: y = saturate(round(act(x * input_scale) / output_scale))
+    ///
+    class QuantizedActivation : public Operator {
+    public:
+        QuantizedActivation(Context &ctx,QuantizedActivationConfig const &config = QuantizedActivationConfig());
+        virtual ~QuantizedActivation();
+
+        virtual char const *operator_type() const
+        {
+            return "QuantizedActivation";
+        }
+
+		virtual void setup(std::vector<TensorSpecs> const &in,
+                           std::vector<TensorSpecs> &out,
+                           std::vector<TensorSpecs> &parameters,
+                           size_t &workspace);
+
+        virtual void reshape(std::vector<Shape> const &in,
+                             std::vector<Shape> &out,
+                             size_t &ws);
+
+		virtual void forward(std::vector<Tensor> &input,
+                             std::vector<Tensor> &output,
+                             std::vector<Tensor> &parameters,
+                             Tensor &workspace,
+                             ExecutionContext const &ctx);
+    private:
+        QuantizedActivationConfig config_;
+        int8_t table_[256]; // CPU lookup, indexed by x + 128
+        cl::Kernel kernel_;
+    };
+
+} // namespace
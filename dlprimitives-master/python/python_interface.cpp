@@ -55,6 +55,15 @@ namespace dlprim {
     {
         return vec_to_plist(n.output_names());
     }
+    static bp::list net_get_activation_checkpoints(Net &n)
+    {
+        return vec_to_plist(n.activation_checkpoints());
+    }
+    static void net_set_activation_checkpoints(Net &n,bp::list const &names)
+    {
+        n.activation_checkpointing(std::vector<std::string>(bp::stl_input_iterator<std::string>(names),
+                                                            bp::stl_input_iterator<std::string>()));
+    }
 
     static void compare_specs(Tensor &t,np::ndarray const &ar)
     {
@@ -315,6 +324,13 @@ BOOST_PYTHON_MODULE(_pydlprim)
             static_cast<bool (Net::*)() const>(&Net::keep_intermediate_tensors),
             static_cast<void (Net::*)(bool)>(&Net::keep_intermediate_tensors),
             "set to true to keed intermediate results for debugging. Default is false - optimise memory use and reuse intermediate memory chunks").
+        def("activation_checkpointing",static_cast<void (Net::*)(size_t)>(&Net::activation_checkpointing),
+            "Enable activation checkpointing for training, intermediate tensors are released after forward and recomputed in backward, checkpoints are chosen by setup() to fit given memory budget in bytes for forward tensors with least recomputation").
+        def("activation_checkpointing",net_set_activation_checkpoints,
+            "Enable activation checkpointing with recomputed segments starting at given list of operators").
+        def("disable_activation_checkpointing",&Net::disable_activation_checkpointing,"Disable activation checkpointing, default").
+        add_property("activation_checkpoints",&net_get_activation_checkpoints,"List of operators starting recomputed segments as planned by setup()").
+        add_property("activation_memory",&Net::activation_memory,"Memory of forward tensors allocated by setup() in bytes").
         add_property("mode",net_mode_get,net_mode_set,
             "Property for changing network behavior, by default network is created for PREDICT mode for inference, if you want to train network, set to TRAIN before calling setup\n"
             "note: network created for inference can't be switched to train mode, but network created for training can work in both PREDICT and TRAIN mode").
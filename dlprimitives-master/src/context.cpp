@@ -7,12 +7,14 @@
 ///////////////////////////////////////////////////////////////////////////////
 /// vim: tabstop=4 expandtab shiftwidth=4 softtabstop=4
 #include <dlprim/context.hpp>
+#include <dlprim/cpu/thread_pool.hpp>
 #include <sstream>
 #include <iostream>
 
 namespace dlprim {
     
-    Context::Context(ExecutionContext const &ec)
+    Context::Context(ExecutionContext const &ec) :
+        thread_pool_(new cpu::ThreadPool())
     {
         if(!ec.queue_) {
             type_ = cpu;
@@ -35,11 +37,13 @@ namespace dlprim {
         platform_(p),
         device_(d),
         context_(c),
-        type_(Context::ocl)
+        type_(Context::ocl),
+        thread_pool_(new cpu::ThreadPool())
     {
     }
     
-    Context::Context(std::string const &dev_id)
+    Context::Context(std::string const &dev_id) :
+        thread_pool_(new cpu::ThreadPool())
     {
         if(dev_id == "cpu") {
             type_ = cpu;
@@ -57,7 +61,8 @@ namespace dlprim {
     }
 
     Context::Context(ContextType dt,int platform,int device) :
-        type_(dt)
+        type_(dt),
+        thread_pool_(new cpu::ThreadPool())
     {
         if(dt == cpu)
             return;
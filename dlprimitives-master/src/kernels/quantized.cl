@@ -0,0 +1,229 @@
+///////////////////////////////////////////////////////////////////////////////
+///
+/// Copyright (c) 2021-2022 Artyom Beilis <artyomtnk@yahoo.com>
+///
+/// MIT License, see LICENSE.TXT
+///
+///////////////////////////////////////////////////////////////////////////////
+#include "defs.h"
+
+#ifndef BIAS
+#define BIAS 0
+#endif
+
+#ifndef GROUPS
+#define GROUPS 1
+#endif
+
+#ifndef KERNEL_H
+#define KERNEL_H 1
+#endif
+#ifndef KERNEL_W
+#define KERNEL_W 1
+#endif
+#ifndef STRIDE_H
+#define STRIDE_H 1
+#endif
+#ifndef STRIDE_W
+#define STRIDE_W 1
+#endif
+#ifndef PAD_H
+#define PAD_H 0
+#endif
+#ifndef PAD_W
+#define PAD_W 0
+#endif
+#ifndef DILATE_H
+#define DILATE_H 1
+#endif
+#ifndef DILATE_W
+#define DILATE_W 1
+#endif
+
+#ifndef POOL_MODE
+#define POOL_MODE 0
+#endif
+#ifndef COUNT_INCLUDE_PAD
+#define COUNT_INCLUDE_PAD 0
+#endif
+
+// round to nearest even and saturate to [-128,127]
+#define REQUANTIZE(x) convert_char_sat_rte(x)
+
+__kernel
+void quantize(ulong size,__global const float *x,ulong x_offset,__global char *y,ulong y_offset,float inv_scale)
+{
+    ulong pos = get_global_id(0);
+    if(pos >= size)
+        return;
+    y[y_offset + pos] = REQUANTIZE(x[x_offset + pos] * inv_scale);
+}
+
+__kernel
+void dequantize(ulong size,__global const char *x,ulong x_offset,__global float *y,ulong y_offset,float scale)
+{
+    ulong pos = get_global_id(0);
+    if(pos >= size)
+        return;
+    y[y_offset + pos] = x[x_offset + pos] * scale;
+}
+
+__kernel
+void activation(ulong size,__global const char *x,ulong x_offset,__global char *y,ulong y_offset,float in_scale,float inv_out_scale)
+{
+    ulong pos = get_global_id(0);
+    if(pos >= size)
+        return;
+    float v = x[x_offset + pos] * in_scale;
+    v = ACTIVATION_F(v);
+    y[y_offset + pos] = REQUANTIZE(v * inv_out_scale);
+}
+
+// scale int32 accumulator to float, add bias, apply activation and requantize
+inline char requantize_output(int acc,float scale,float bias,float inv_out_scale)
+{
+    float v = acc * scale + bias;
+    v = ACTIVATION_F(v);
+    return REQUANTIZE(v * inv_out_scale);
+}
+
+///
+/// Direct convolution, each work item computes single output pixel
+///
+/// dims: [out_h*out_w, channels_out, batch]
+///
+__kernel
+void conv(int batch,int channels_in,int in_h,int in_w,int channels_out,int out_h,int out_w,
+          __global const char *x,ulong x_offset,
+          __global const char *w,ulong w_offset,
+          __global const float *w_scale,ulong w_scale_offset,
+#if BIAS
+          __global const float *bias,ulong bias_offset,
+#endif
+          __global char *y,ulong y_offset,
+          float in_scale,float inv_out_scale)
+{
+    int pix = get_global_id(0);
+    int oc  = get_global_id(1);
+    int b   = get_global_id(2);
+    if(pix >= out_h * out_w || oc >= channels_out || b >= batch)
+        return;
+    int r = pix / out_w;
+    int c = pix % out_w;
+    int group_in  = channels_in / GROUPS;
+    int group = oc / (channels_out / GROUPS);
+
+    x += x_offset + (b * channels_in + group * group_in) * in_h * in_w;
+    w += w_offset + oc * group_in * (KERNEL_H * KERNEL_W);
+
+    int row0 = r * STRIDE_H - PAD_H;
+    int col0 = c * STRIDE_W - PAD_W;
+    int acc = 0;
+    for(int ch = 0;ch < group_in;ch++, x += in_h * in_w, w += KERNEL_H * KERNEL_W) {
+        #pragma unroll
+        for(int dr = 0;dr < KERNEL_H;dr++) {
+            int row = row0 + dr * DILATE_H;
+            if(row < 0 || row >= in_h)
+                continue;
+            #pragma unroll
+            for(int dc = 0;dc < KERNEL_W;dc++) {
+                int col = col0 + dc * DILATE_W;
+                if(col < 0 || col >= in_w)
+                    continue;
+                acc += (int)(x[row * in_w + col]) * (int)(w[dr * KERNEL_W + dc]);
+            }
+        }
+    }
+#if BIAS
+    float bias_val = bias[bias_offset + oc];
+#else
+    float bias_val = 0.0f;
+#endif
+    y[y_offset + (b * channels_out + oc) * out_h * out_w + pix] = requantize_output(acc,in_scale * w_scale[w_scale_offset + oc],bias_val,inv_out_scale);
+}
+
+///
+/// dims: [outputs, batch]
+///
+__kernel
+void ip(int batch,int inputs,int outputs,
+        __global const char *x,ulong x_offset,
+        __global const char *w,ulong w_offset,
+        __global const float *w_scale,ulong w_scale_offset,
+#if BIAS
+        __global const float *bias,ulong bias_offset,
+#endif
+        __global char *y,ulong y_offset,
+        float in_scale,float inv_out_scale)
+{
+    int o = get_global_id(0);
+    int b = get_global_id(1);
+    if(o >= outputs || b >= batch)
+        return;
+    x += x_offset + b * inputs;
+    w += w_offset + o * inputs;
+    int acc = 0;
+    int i = 0;
+    for(;i + 4 <= inputs;i+=4) {
+        int4 xv = convert_int4(vload4(0,x + i));
+        int4 wv = convert_int4(vload4(0,w + i));
+        int4 p = xv * wv;
+        acc += p.s0 + p.s1 + p.s2 + p.s3;
+    }
+    for(;i < inputs;i++)
+        acc += (int)(x[i]) * (int)(w[i]);
+#if BIAS
+    float bias_val = bias[bias_offset + o];
+#else
+    float bias_val = 0.0f;
+#endif
+    y[y_offset + b * outputs + o] = requantize_output(acc,in_scale * w_scale[w_scale_offset + o],bias_val,inv_out_scale);
+}
+
+///
+/// dims: [out_h*out_w, batch*channels]
+///
+__kernel
+void pooling(int BC,int in_h,int in_w,int out_h,int out_w,
+             __global const char *x,ulong x_offset,
+             __global char *y,ulong y_offset)
+{
+    int pix = get_global_id(0);
+    int bc  = get_global_id(1);
+    if(pix >= out_h * out_w || bc >= BC)
+        return;
+    int r = pix / out_w;
+    int c = pix % out_w;
+    x += x_offset + bc * in_h * in_w;
+
+    int row0 = r * STRIDE_H - PAD_H;
+    int col0 = c * STRIDE_W - PAD_W;
+    int row1 = row0 + KERNEL_H;
+    int col1 = col0 + KERNEL_W;
+#if COUNT_INCLUDE_PAD
+    int count = (min(row1,in_h + PAD_H) - max(row0,-PAD_H)) * (min(col1,in_w + PAD_W) - max(col0,-PAD_W));
+#endif
+    row0 = max(row0,0);
+    col0 = max(col0,0);
+    row1 = min(row1,in_h);
+    col1 = min(col1,in_w);
+#if COUNT_INCLUDE_PAD == 0
+    int count = (row1 - row0) * (col1 - col0);
+#endif
+
+#if POOL_MODE == 0
+    int val = -128;
+    for(int row = row0;row < row1;row++)
+        for(int col = col0;col < col1;col++)
+            val = max(val,(int)(x[row * in_w + col]));
+    char res = val;
+#else
+    int val = 0;
+    for(int row = row0;row < row1;row++)
+        for(int col = col0;col < col1;col++)
+            val += x[row * in_w + col];
+    char res = REQUANTIZE((float)(val) / count);
+#endif
+    y[y_offset + bc * out_h * out_w + pix] = res;
+}
+
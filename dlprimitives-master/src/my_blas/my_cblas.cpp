@@ -8,6 +8,15 @@
 #include <my_cblas.hpp>
 #ifdef USE_INTERNAL_BLAS
 #include <string.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <vector>
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define DLPRIM_BLAS_X86_KERNELS
+#include <immintrin.h>
+#endif
+
 namespace dlprim {
 namespace my_cblas {
     void cblas_saxpby(int size,float a,float *x,int lx,float b, float *y,int ly)
@@ -32,74 +41,263 @@ namespace my_cblas {
             for(int r=0;r<M;r++)
                 memset(C + ldc*r,0,N*sizeof(float));
         }
-        else {
+        else if(beta != 1) {
             for(int r=0;r<M;r++)
                 cblas_sscal(N,beta,C + ldc*r,1);
         }
     }
 
-    void cblas_sgemm_nn(int M,int N,int K,float alpha,float const *A,int lda,float const *B,int ldb,float *C,int ldc)
-    {
-        for(int r=0;r<M;r++) {
-            for(int k=0;k<K;k++) {
-                float av = A[r*lda+k] * alpha;
-                for(int c=0;c<N;c++) {
-                    C[r*ldc+c] += av*B[k*ldb+c];
+    //
+    // GEMM is implemented in BLIS style: C is processed in NC x KC blocks of B and MC x KC blocks of A
+    // that are packed to contiguous panels of NR columns and MR rows, so the micro-kernel
+    // that computes MR x NR tile of C reads both operands sequentially. Packing also handles
+    // transposition so a single kernel serves all four cases
+    //
+    namespace {
+        constexpr int KC = 256;
+        constexpr int MC = 144;
+        constexpr int NC = 3072;
+        constexpr int max_mr = 6;
+        constexpr int max_nr = 32;
+
+        // C[0:mr,0:nr] += alpha * sum_k a[k*mr + r] * b[k*nr + c]
+        typedef void (*micro_kernel_type)(int K,float const *a,float const *b,float alpha,float *C,int ldc);
+
+        struct MicroKernel {
+            char const *name;
+            int mr;
+            int nr;
+            micro_kernel_type run;
+        };
+
+        template<int MR,int NR>
+        void micro_kernel_generic(int K,float const *a,float const *b,float alpha,float *C,int ldc)
+        {
+            float acc[MR][NR] = {};
+            for(int k=0;k<K;k++,a+=MR,b+=NR) {
+                for(int r=0;r<MR;r++) {
+                    float av = a[r];
+                    for(int c=0;c<NR;c++)
+                        acc[r][c] += av * b[c];
                 }
             }
+            for(int r=0;r<MR;r++) {
+                for(int c=0;c<NR;c++)
+                    C[r*ldc+c] += alpha * acc[r][c];
+            }
         }
-    }
-    void cblas_sgemm_tn(int M,int N,int K,float alpha,float const *A,int lda,float const *B,int ldb,float *C,int ldc)
-    {
-        for(int k=0;k<K;k++) {
-            for(int r=0;r<M;r++) {
-                float av = A[r+lda*k] * alpha;
-                for(int c=0;c<N;c++) {
-                    C[r*ldc+c] += av*B[k*ldb+c];
+
+#ifdef DLPRIM_BLAS_X86_KERNELS
+        #define DLPRIM_FMA_ROW(S,i) \
+            av = S##_set1_ps(a[i]); \
+            c##i##0 = S##_fmadd_ps(av,b0,c##i##0); \
+            c##i##1 = S##_fmadd_ps(av,b1,c##i##1);
+        #define DLPRIM_STORE_ROW(S,i,W) \
+            S##_storeu_ps(C + i*ldc,     S##_fmadd_ps(va,c##i##0,S##_loadu_ps(C + i*ldc))); \
+            S##_storeu_ps(C + i*ldc + W, S##_fmadd_ps(va,c##i##1,S##_loadu_ps(C + i*ldc + W)));
+
+        // 6x16 tile, 12 accumulators + 2 B vectors + broadcast out of 16 ymm registers
+        __attribute__((target("avx2,fma")))
+        void micro_kernel_avx2(int K,float const *a,float const *b,float alpha,float *C,int ldc)
+        {
+            __m256 c00 = _mm256_setzero_ps(), c01 = _mm256_setzero_ps();
+            __m256 c10 = _mm256_setzero_ps(), c11 = _mm256_setzero_ps();
+            __m256 c20 = _mm256_setzero_ps(), c21 = _mm256_setzero_ps();
+            __m256 c30 = _mm256_setzero_ps(), c31 = _mm256_setzero_ps();
+            __m256 c40 = _mm256_setzero_ps(), c41 = _mm256_setzero_ps();
+            __m256 c50 = _mm256_setzero_ps(), c51 = _mm256_setzero_ps();
+            for(int k=0;k<K;k++,a+=6,b+=16) {
+                __m256 b0 = _mm256_loadu_ps(b);
+                __m256 b1 = _mm256_loadu_ps(b + 8);
+                __m256 av;
+                DLPRIM_FMA_ROW(_mm256,0)
+                DLPRIM_FMA_ROW(_mm256,1)
+                DLPRIM_FMA_ROW(_mm256,2)
+                DLPRIM_FMA_ROW(_mm256,3)
+                DLPRIM_FMA_ROW(_mm256,4)
+                DLPRIM_FMA_ROW(_mm256,5)
+            }
+            __m256 va = _mm256_set1_ps(alpha);
+            DLPRIM_STORE_ROW(_mm256,0,8)
+            DLPRIM_STORE_ROW(_mm256,1,8)
+            DLPRIM_STORE_ROW(_mm256,2,8)
+            DLPRIM_STORE_ROW(_mm256,3,8)
+            DLPRIM_STORE_ROW(_mm256,4,8)
+            DLPRIM_STORE_ROW(_mm256,5,8)
+        }
+
+        // same register layout over zmm: 6x32 tile
+        __attribute__((target("avx512f")))
+        void micro_kernel_avx512(int K,float const *a,float const *b,float alpha,float *C,int ldc)
+        {
+            __m512 c00 = _mm512_setzero_ps(), c01 = _mm512_setzero_ps();
+            __m512 c10 = _mm512_setzero_ps(), c11 = _mm512_setzero_ps();
+            __m512 c20 = _mm512_setzero_ps(), c21 = _mm512_setzero_ps();
+            __m512 c30 = _mm512_setzero_ps(), c31 = _mm512_setzero_ps();
+            __m512 c40 = _mm512_setzero_ps(), c41 = _mm512_setzero_ps();
+            __m512 c50 = _mm512_setzero_ps(), c51 = _mm512_setzero_ps();
+            for(int k=0;k<K;k++,a+=6,b+=32) {
+                __m512 b0 = _mm512_loadu_ps(b);
+                __m512 b1 = _mm512_loadu_ps(b + 16);
+                __m512 av;
+                DLPRIM_FMA_ROW(_mm512,0)
+                DLPRIM_FMA_ROW(_mm512,1)
+                DLPRIM_FMA_ROW(_mm512,2)
+                DLPRIM_FMA_ROW(_mm512,3)
+                DLPRIM_FMA_ROW(_mm512,4)
+                DLPRIM_FMA_ROW(_mm512,5)
+            }
+            __m512 va = _mm512_set1_ps(alpha);
+            DLPRIM_STORE_ROW(_mm512,0,16)
+            DLPRIM_STORE_ROW(_mm512,1,16)
+            DLPRIM_STORE_ROW(_mm512,2,16)
+            DLPRIM_STORE_ROW(_mm512,3,16)
+            DLPRIM_STORE_ROW(_mm512,4,16)
+            DLPRIM_STORE_ROW(_mm512,5,16)
+        }
+        #undef DLPRIM_FMA_ROW
+        #undef DLPRIM_STORE_ROW
+#endif
+
+        MicroKernel const kernels[] = {
+#ifdef DLPRIM_BLAS_X86_KERNELS
+            { "avx512", 6, 32, micro_kernel_avx512 },
+            { "avx2",   6, 16, micro_kernel_avx2 },
+#endif
+            { "generic", 4, 4, micro_kernel_generic<4,4> },
+        };
+
+        bool kernel_supported(MicroKernel const &k)
+        {
+#ifdef DLPRIM_BLAS_X86_KERNELS
+            __builtin_cpu_init();
+            if(strcmp(k.name,"avx512") == 0)
+                return __builtin_cpu_supports("avx512f");
+            if(strcmp(k.name,"avx2") == 0)
+                return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#endif
+            return true;
+        }
+
+        // best kernel the CPU supports; DLPRIM_BLAS_KERNEL=avx512|avx2|generic limits the choice
+        MicroKernel const &select_kernel()
+        {
+            char const *env = getenv("DLPRIM_BLAS_KERNEL");
+            bool allowed = !env || !*env;
+            for(MicroKernel const &k : kernels) {
+                if(!allowed && strcmp(k.name,env) == 0)
+                    allowed = true;
+                if(allowed && kernel_supported(k))
+                    return k;
+            }
+            return kernels[sizeof(kernels)/sizeof(kernels[0]) - 1];
+        }
+
+        MicroKernel const &micro_kernel()
+        {
+            static MicroKernel const &k = select_kernel();
+            return k;
+        }
+
+        // Element (r,c) of a matrix is M[r*rs + c*cs], so transposition is just swapped strides
+
+        // rows [0,m) x cols [0,k) of A -> panels of mr rows, each stored k-major, zero padded
+        void pack_a(int m,int k,float const *A,int rs,int cs,int mr,float *buf)
+        {
+            for(int i0=0;i0<m;i0+=mr) {
+                int rows = std::min(mr,m - i0);
+                for(int p=0;p<k;p++) {
+                    float const *src = A + i0*rs + p*cs;
+                    int i=0;
+                    for(;i<rows;i++)
+                        *buf++ = src[i*rs];
+                    for(;i<mr;i++)
+                        *buf++ = 0;
                 }
             }
         }
-    }
-    void cblas_sgemm_nt(int M,int N,int K,float alpha,float const *A,int lda,float const *B,int ldb,float *C,int ldc)
-    {
-        for(int r=0;r<M;r++) {
-            for(int c=0;c<N;c++) {
-                for(int k=0;k<K;k++) {
-                    float bv = B[k+ldb*c];
-                    float av = A[r*lda+k] * alpha;
-                    C[r*ldc+c] += av*bv;
+
+        // rows [0,k) x cols [0,n) of B -> panels of nr columns, each stored k-major, zero padded
+        void pack_b(int k,int n,float const *B,int rs,int cs,int nr,float *buf)
+        {
+            for(int j0=0;j0<n;j0+=nr) {
+                int cols = std::min(nr,n - j0);
+                for(int p=0;p<k;p++) {
+                    float const *src = B + p*rs + j0*cs;
+                    int j=0;
+                    if(cs == 1) {
+                        memcpy(buf,src,cols*sizeof(float));
+                        j = cols;
+                    }
+                    else {
+                        for(;j<cols;j++)
+                            buf[j] = src[j*cs];
+                    }
+                    for(;j<nr;j++)
+                        buf[j] = 0;
+                    buf += nr;
                 }
             }
         }
-    }
-    void cblas_sgemm_tt(int M,int N,int K,float alpha,float const *A,int lda,float const *B,int ldb,float *C,int ldc)
-    {
-        for(int c=0;c<N;c++) {
-            for(int k=0;k<K;k++) {
-                float bv = B[k+ldb*c]*alpha;
-                for(int r=0;r<M;r++) {
-                    float av = A[r+lda*k];
-                    C[r*ldc+c] += av*bv;
+
+        void sgemm_packed(int M,int N,int K,float alpha,
+                          float const *A,int a_rs,int a_cs,
+                          float const *B,int b_rs,int b_cs,
+                          float *C,int ldc)
+        {
+            MicroKernel const &kernel = micro_kernel();
+            int const mr = kernel.mr;
+            int const nr = kernel.nr;
+            // cblas_sgemm is called concurrently from the CPU thread pool
+            thread_local std::vector<float> a_pack,b_pack;
+            a_pack.resize(size_t(MC) * KC);
+            b_pack.resize(size_t(NC) * KC);
+            float tail[max_mr*max_nr];
+
+            for(int jc=0;jc<N;jc+=NC) {
+                int nc = std::min(NC,N - jc);
+                for(int pc=0;pc<K;pc+=KC) {
+                    int kc = std::min(KC,K - pc);
+                    pack_b(kc,nc,B + pc*b_rs + jc*b_cs,b_rs,b_cs,nr,b_pack.data());
+                    for(int ic=0;ic<M;ic+=MC) {
+                        int mc = std::min(MC,M - ic);
+                        pack_a(mc,kc,A + ic*a_rs + pc*a_cs,a_rs,a_cs,mr,a_pack.data());
+                        for(int jr=0;jr<nc;jr+=nr) {
+                            int n = std::min(nr,nc - jr);
+                            float const *bp = b_pack.data() + size_t(jr)*kc;
+                            for(int ir=0;ir<mc;ir+=mr) {
+                                int m = std::min(mr,mc - ir);
+                                float const *ap = a_pack.data() + size_t(ir)*kc;
+                                float *c = C + size_t(ic + ir)*ldc + jc + jr;
+                                if(m == mr && n == nr) {
+                                    kernel.run(kc,ap,bp,alpha,c,ldc);
+                                    continue;
+                                }
+                                // partial tile at the edge of C
+                                memset(tail,0,sizeof(float)*mr*nr);
+                                kernel.run(kc,ap,bp,alpha,tail,nr);
+                                for(int r=0;r<m;r++)
+                                    for(int j=0;j<n;j++)
+                                        c[r*ldc+j] += tail[r*nr+j];
+                            }
+                        }
+                    }
                 }
             }
         }
-    }
+    } // anonymous
 
     void cblas_sgemm(int,bool ta,bool tb,int M,int N,int K,float alpha,float const *A,int lda,float const *B,int ldb,float beta,float *C,int ldc)
     {
         cblas_sgemm_apply_beta(M,N,beta,C,ldc);
-        if(ta) {
-            if(tb)
-                cblas_sgemm_tt(M,N,K,alpha,A,lda,B,ldb,C,ldc);
-            else
-                cblas_sgemm_tn(M,N,K,alpha,A,lda,B,ldb,C,ldc);
-        }
-        else {
-            if(tb)
-                cblas_sgemm_nt(M,N,K,alpha,A,lda,B,ldb,C,ldc);
-            else
-                cblas_sgemm_nn(M,N,K,alpha,A,lda,B,ldb,C,ldc);
-        }
+        if(M <= 0 || N <= 0 || K <= 0 || alpha == 0)
+            return;
+        // A(r,k) and B(k,c) strides
+        int a_rs = ta ? 1 : lda;
+        int a_cs = ta ? lda : 1;
+        int b_rs = tb ? 1 : ldb;
+        int b_cs = tb ? ldb : 1;
+        sgemm_packed(M,N,K,alpha,A,a_rs,a_cs,B,b_rs,b_cs,C,ldc);
     }
 
 } // cblas
@@ -9,12 +9,20 @@
 #include <dlprim/json.hpp>
 #include <dlprim/shared_resource.hpp>
 #include <dlprim/ops/initialization.hpp>
+#include <dlprim/ops/activation.hpp>
+#include <dlprim/ops/batch_normalization.hpp>
+#include <dlprim/ops/conv2d.hpp>
+#include <dlprim/ops/elementwise.hpp>
+#include <dlprim/ops/inner_product.hpp>
 #include <dlprim/model.hpp>
 #include <sstream>
 #include <fstream>
 #include <set>
 #include <list>
+#include <functional>
 #include <algorithm>
+#include <numeric>
+#include <cmath>
 
 #ifndef DISABLE_HDF5
 #include "H5Cpp.h"
@@ -25,7 +33,12 @@ namespace dlprim {
         ctx_(ctx),
         shared_resource_(new SharedResource()),
         mode_(CalculationsMode::predict),
-        keep_intermediate_tensors_(false)
+        keep_intermediate_tensors_(false),
+        optimize_graph_(true),
+        checkpointing_(false),
+        checkpoint_budget_(0),
+        recompute_chunk_size_(0),
+        activation_memory_(0)
     {
     }
 
@@ -193,6 +206,22 @@ namespace dlprim {
         for(auto &conn : connections_) {
             conn.op->initialize_params(conn.parameters,e);
         }
+        if(!bn_folds_.empty()) {
+            std::vector<Tensor> params;
+            for(auto &fold : bn_folds_) {
+                params.clear();
+                for(auto const &name : fold.source_parameters)
+                    params.push_back(parameters_[name]);
+                fold.source_op->initialize_params(params,e);
+                params.clear();
+                for(auto const &name : fold.batch_norm_parameters)
+                    params.push_back(parameters_[name]);
+                fold.batch_norm->initialize_params(params,e);
+            }
+            if(ctx_.is_opencl_context())
+                e.queue().finish();
+            copy_parameters_to_host(); // recomputes folded weights
+        }
         if(mode() == CalculationsMode::train) {
             // set loss diff
             for(auto const &name : output_names()) {
@@ -459,11 +488,219 @@ namespace dlprim {
     void Net::setup()
     {
         clear_memory();
+        if(mode_ == CalculationsMode::predict && optimize_graph_ && !keep_intermediate_tensors_)
+            optimize_for_inference();
         mark_backpropagating_edges();
+        plan_activation_checkpoints();
         setup_ws();
         allocate_tensors();
     }
 
+    void Net::optimize_for_inference()
+    {
+        // merged connection is removed, so the one that follows it is checked at same index
+        for(unsigned i=0;i<connections_.size();) {
+            int producer = fusable_producer(i);
+            bool merged = false;
+            if(producer >= 0) {
+                std::string type = connections_[i].op->operator_type();
+                if(type == "BatchNorm")
+                    merged = fold_batch_norm(producer,i);
+                else if(type == "Activation")
+                    merged = fuse_activation(producer,i);
+            }
+            if(!merged)
+                i++;
+        }
+    }
+
+    // Find the connection that produces the single input of connection index such that index
+    // can be merged into it: nothing else reads the intermediate tensor, or if index is an in-place
+    // operation nothing reads it between the producer and index. Returns -1 if there is none
+    int Net::fusable_producer(unsigned index)
+    {
+        Connection const &conn = connections_[index];
+        if(conn.input_names.size() != 1 || conn.output_names.size() != 1)
+            return -1;
+        std::string const &name = conn.input_names[0];
+        bool in_place = name == conn.output_names[0];
+        if(alias_sources_.count(name) > 0 || alias_sources_.count(conn.output_names[0]) > 0)
+            return -1;
+        if(!in_place && std::find(outputs_.begin(),outputs_.end(),name) != outputs_.end())
+            return -1;
+        auto uses = [&](std::vector<std::string> const &names) {
+            return std::find(names.begin(),names.end(),name) != names.end();
+        };
+        int producer = -1;
+        for(int i=int(index)-1;i>=0;i--) {
+            if(uses(connections_[i].output_names)) {
+                producer = i;
+                break;
+            }
+            if(uses(connections_[i].input_names))
+                return -1;
+        }
+        if(producer < 0 || connections_[producer].output_names.size() != 1)
+            return -1;
+        if(!in_place) {
+            for(size_t i=index+1;i<connections_.size();i++) {
+                if(uses(connections_[i].input_names) || uses(connections_[i].output_names))
+                    return -1;
+            }
+        }
+        return producer;
+    }
+
+    void Net::merge_into_producer(unsigned producer,unsigned index)
+    {
+        std::string name = connections_[producer].output_names[0];
+        std::string target = connections_[index].output_names[0];
+        connections_[producer].output_names[0] = target;
+        connections_.erase(connections_.begin() + index);
+        if(name != target) {
+            bool used = false;
+            for(auto const &conn : connections_) {
+                if(std::find(conn.input_names.begin(),conn.input_names.end(),name) != conn.input_names.end()
+                   || std::find(conn.output_names.begin(),conn.output_names.end(),name) != conn.output_names.end())
+                {
+                    used = true;
+                    break;
+                }
+            }
+            if(!used)
+                tensor_specs_.erase(name);
+        }
+        connections_index_.clear();
+        for(unsigned i=0;i<connections_.size();i++)
+            connections_index_[connections_[i].name] = i;
+    }
+
+    void Net::replace_operator(Connection &conn,std::unique_ptr<Operator> op)
+    {
+        op->shared_resource(shared_resource());
+        op->mode(mode_);
+        std::vector<TensorSpecs> output_specs,parameter_specs;
+        size_t ws_size = 0;
+        op->setup(conn.input_specs,output_specs,parameter_specs,ws_size);
+        if(conn.frozen) {
+            for(auto &spec : parameter_specs)
+                spec.freeze();
+        }
+        conn.op = std::move(op);
+        conn.output_specs = output_specs;
+        conn.parameter_specs = parameter_specs;
+        conn.ws_size = ws_size;
+    }
+
+    bool Net::fold_batch_norm(unsigned producer,unsigned index)
+    {
+        Connection &src = connections_[producer];
+        std::string type = src.op->operator_type();
+        // empty parameter names - already folded
+        if(src.parameter_names.empty() || src.output_specs[0].dtype() != float_data)
+            return false;
+        std::unique_ptr<Operator> op;
+        if(type == "Convolution2D") {
+            Convolution2DConfig cfg = static_cast<Convolution2D &>(*src.op).config();
+            if(cfg.activation != StandardActivations::identity)
+                return false;
+            cfg.bias = true;
+            op.reset(new Convolution2D(ctx_,cfg));
+        }
+        else if(type == "InnerProduct") {
+            InnerProductConfig cfg = static_cast<InnerProduct &>(*src.op).config();
+            if(cfg.activation != StandardActivations::identity)
+                return false;
+            cfg.bias = true;
+            op.reset(new InnerProduct(ctx_,cfg));
+        }
+        else {
+            return false;
+        }
+        Connection &bn = connections_[index];
+        BatchNormFold fold;
+        fold.connection = src.name;
+        fold.source_parameters = src.parameter_names;
+        fold.batch_norm_parameters = bn.parameter_names;
+        fold.batch_norm = std::move(bn.op);
+        fold.source_op = std::move(src.op);
+        replace_operator(src,std::move(op));
+        src.parameter_names.clear(); // bound to fold.weight and fold.bias in allocate_tensors
+        bn_folds_.push_back(std::move(fold));
+        merge_into_producer(producer,index);
+        return true;
+    }
+
+    bool Net::fuse_activation(unsigned producer,unsigned index)
+    {
+        Connection &src = connections_[producer];
+        StandardActivations act = static_cast<Activation &>(*connections_[index].op).config().activation;
+        if(act == StandardActivations::identity) {
+            merge_into_producer(producer,index);
+            return true;
+        }
+        std::string type = src.op->operator_type();
+        std::unique_ptr<Operator> op;
+        if(type == "Convolution2D") {
+            Convolution2DConfig cfg = static_cast<Convolution2D &>(*src.op).config();
+            if(cfg.activation != StandardActivations::identity)
+                return false;
+            cfg.activation = act;
+            op.reset(new Convolution2D(ctx_,cfg));
+        }
+        else if(type == "InnerProduct") {
+            InnerProductConfig cfg = static_cast<InnerProduct &>(*src.op).config();
+            if(cfg.activation != StandardActivations::identity)
+                return false;
+            cfg.activation = act;
+            op.reset(new InnerProduct(ctx_,cfg));
+        }
+        else if(type == "Elementwise") {
+            ElementwiseConfig cfg = static_cast<Elementwise &>(*src.op).config();
+            if(cfg.activation != StandardActivations::identity)
+                return false;
+            cfg.activation = act;
+            op.reset(new Elementwise(ctx_,cfg));
+        }
+        else {
+            return false;
+        }
+        replace_operator(src,std::move(op));
+        merge_into_producer(producer,index);
+        return true;
+    }
+
+    void Net::fold_batch_norms()
+    {
+        if(bn_folds_.empty())
+            return;
+        cl::CommandQueue q = ctx_.make_queue();
+        for(auto &fold : bn_folds_) {
+            BatchNormConfig const &cfg = static_cast<BatchNorm &>(*fold.batch_norm).config();
+            std::vector<std::string> const &bn_names = fold.batch_norm_parameters;
+            float const *mean  = parameters_[bn_names[0]].data<float>();
+            float const *var   = parameters_[bn_names[1]].data<float>();
+            float const *gamma = cfg.affine ? parameters_[bn_names[2]].data<float>() : nullptr;
+            float const *beta  = cfg.affine ? parameters_[bn_names[3]].data<float>() : nullptr;
+            Tensor &weight = parameters_[fold.source_parameters[0]];
+            float const *bias = nullptr;
+            if(fold.source_parameters.size() > 1)
+                bias = parameters_[fold.source_parameters[1]].data<float>();
+
+            int channels = fold.bias.shape()[0];
+            size_t row = weight.shape().total_size() / channels;
+            float const *w = weight.data<float>();
+            float *folded_w = fold.weight.data<float>();
+            float *folded_b = fold.bias.data<float>();
+            std::copy(w,w + channels * row,folded_w);
+            for(int c=0;c<channels;c++)
+                folded_b[c] = bias ? bias[c] : 0.0f;
+            BatchNorm::fold_into(cfg,channels,row,mean,var,gamma,beta,folded_w,folded_b);
+            fold.weight.to_device(q);
+            fold.bias.to_device(q);
+        }
+    }
+
     void Net::setup_ws()
     {
         size_t ws = 0;
@@ -633,6 +870,13 @@ namespace dlprim {
         for(size_t i=0;i<chunks.size();i++) {
             memory_.push_back(Tensor(ctx_,Shape(chunks[i]),uint8_data));
         }
+        // tensors released by activation checkpointing share single chunk
+        Tensor recompute_chunk;
+        if(!forward && recompute_chunk_size_ > 0) {
+            recompute_chunk = Tensor(ctx_,Shape(recompute_chunk_size_),uint8_data);
+            memory_.push_back(recompute_chunk);
+        }
+        activation_memory_ = forward ? std::accumulate(chunks.begin(),chunks.end(),size_t(0)) : recompute_chunk_size_;
         tensors_.clear();
         tensors_diff_.clear();
         for(auto const &ts : tensor_specs_) {
@@ -645,13 +889,233 @@ namespace dlprim {
                 tensors_[ts.first ] = actual_tensor;
             }
             else {
-                tensors_[ts.first ] = Tensor(ctx_,ts.second.shape(),ts.second.dtype());
+                auto p = recomputed_offsets_.find(ts.first);
+                if(p != recomputed_offsets_.end()) {
+                    tensors_[ts.first ] = recompute_chunk.sub_tensor(p->second,ts.second.shape(),ts.second.dtype());
+                }
+                else {
+                    tensors_[ts.first ] = Tensor(ctx_,ts.second.shape(),ts.second.dtype());
+                    activation_memory_ += ts.second.memory_size();
+                }
                 tensors_diff_[ts.first ] = actual_tensor;
             }
         }
         allocate_aliases();
 
     }
+    std::vector<std::string> Net::activation_checkpoints() const
+    {
+        std::vector<std::string> names;
+        for(size_t i=1;i<segments_.size();i++)
+            names.push_back(connections_[segments_[i]].name);
+        return names;
+    }
+
+    void Net::plan_activation_checkpoints()
+    {
+        segments_.clear();
+        recompute_.clear();
+        recomputed_offsets_.clear();
+        recompute_chunk_size_ = 0;
+        if(!checkpointing_ || mode_ != CalculationsMode::train || keep_intermediate_tensors_ || connections_.empty())
+            return;
+
+        int n = connections_.size();
+        std::map<std::string,int> ids;
+        std::vector<std::string> names;
+        for(auto const &ts : tensor_specs_) {
+            if(alias_sources_.count(ts.first) > 0)
+                continue;
+            ids[ts.first] = names.size();
+            names.push_back(ts.first);
+        }
+        auto id = [&](std::string const &name) {
+            auto p = alias_sources_.find(name);
+            return ids.at(p == alias_sources_.end() ? name : p->second);
+        };
+        auto mark = [](std::pair<int,int> &range,int index) {
+            range.first = std::min(range.first,index);
+            range.second = std::max(range.second,index);
+        };
+        std::vector<std::pair<int,int> > used_at(names.size(),std::make_pair(n,-1));
+        std::vector<std::pair<int,int> > written_at(names.size(),std::make_pair(n,-1));
+        for(int i=0;i<n;i++) {
+            Connection const &conn = connections_[i];
+            for(auto const &name : conn.input_names)
+                mark(used_at[id(name)],i);
+            for(auto const &name : conn.output_names) {
+                mark(used_at[id(name)],i);
+                if(!conn.op->alias_generator())
+                    mark(written_at[id(name)],i);
+            }
+        }
+        std::vector<bool> kept(names.size(),false);
+        for(auto const &name : inputs_) {
+            kept[id(name)] = true;
+            mark(written_at[id(name)],-1);
+        }
+        for(auto const &name : outputs_)
+            kept[id(name)] = true;
+
+        // a segment can't start between two writes of the same tensor since the tensor
+        // would not have the value it had at the beginning of the segment when it is recomputed
+        std::vector<bool> valid(n+1,true);
+        for(auto const &range : written_at) {
+            for(int b=std::max(range.first + 1,1);b<=range.second;b++)
+                valid[b] = false;
+        }
+
+        std::vector<size_t> sizes(names.size());
+        std::vector<std::pair<int,int> > planned_use = used_at;
+        for(size_t i=0;i<names.size();i++) {
+            sizes[i] = tensor_specs_[names[i]].memory_size();
+            if(kept[i])
+                planned_use[i] = std::make_pair(n,-1);
+        }
+
+        std::vector<unsigned> starts;
+        if(checkpoint_names_.empty()) {
+            starts = find_checkpoints(planned_use,sizes,valid);
+        }
+        else {
+            starts.push_back(0);
+            for(auto const &name : checkpoint_names_) {
+                auto p = connections_index_.find(name);
+                if(p == connections_index_.end())
+                    throw ValidationError("No such operator for checkpoint " + name);
+                if(!valid[p->second])
+                    throw ValidationError("Operator " + name + " can't start a checkpointed segment, a tensor is modified in-place across it");
+                starts.push_back(p->second);
+            }
+            std::sort(starts.begin(),starts.end());
+            starts.erase(std::unique(starts.begin(),starts.end()),starts.end());
+        }
+        if(starts.size() < 2)
+            return;
+        segments_ = starts;
+
+        auto segment_of = [&](int index) {
+            return std::upper_bound(segments_.begin(),segments_.end(),unsigned(index)) - segments_.begin() - 1;
+        };
+        // network inputs modified in-place can't be recomputed
+        std::vector<bool> replayable(segments_.size(),true);
+        for(size_t i=0;i<names.size();i++) {
+            if(written_at[i].first < 0 && written_at[i].second >= 0)
+                replayable[segment_of(written_at[i].second)] = false;
+        }
+        std::vector<bool> has_backward(segments_.size(),false);
+        for(int i=0;i<n;i++) {
+            if(connections_[i].gradient_flags == 3)
+                has_backward[segment_of(i)] = true;
+        }
+        std::vector<size_t> offsets(segments_.size(),0);
+        recompute_.assign(segments_.size(),false);
+        for(size_t i=0;i<names.size();i++) {
+            if(kept[i] || used_at[i].second < 0)
+                continue;
+            int segment = segment_of(used_at[i].first);
+            if(segment != segment_of(used_at[i].second) || !replayable[segment])
+                continue;
+            size_t const alignment = 256;
+            recomputed_offsets_[names[i]] = offsets[segment];
+            offsets[segment] += (sizes[i] + alignment - 1) / alignment * alignment;
+            // last segment is still valid after forward
+            if(size_t(segment) + 1 < segments_.size() && has_backward[segment])
+                recompute_[segment] = true;
+        }
+        recompute_chunk_size_ = *std::max_element(offsets.begin(),offsets.end());
+    }
+
+    // Choose segment starts such that memory of kept tensors and largest segment fits the budget with least
+    // recomputation. A tensor is released if it is used within single segment [b,e), for given limit on
+    // released memory of each segment dynamic programming finds the segmentation that releases most memory
+    std::vector<unsigned> Net::find_checkpoints(std::vector<std::pair<int,int> > const &used_at,
+                                                std::vector<size_t> const &sizes,
+                                                std::vector<bool> const &valid)
+    {
+        int n = connections_.size();
+        size_t total = 0;
+        std::vector<std::vector<std::pair<int,size_t> > > by_last_use(n);
+        for(size_t i=0;i<sizes.size();i++) {
+            total += sizes[i];
+            if(used_at[i].second >= 0)
+                by_last_use[used_at[i].second].push_back(std::make_pair(used_at[i].first,sizes[i]));
+        }
+        // calls f(e,released) for segments [b,e) while released memory does not exceed limit
+        auto for_each_end = [&](int b,size_t limit,std::function<void(int,size_t)> const &f) {
+            size_t released = 0;
+            for(int e=b+1;e<=n;e++) {
+                for(auto const &t : by_last_use[e-1]) {
+                    if(t.first >= b)
+                        released += t.second;
+                }
+                if(released > limit)
+                    break;
+                if(valid[e])
+                    f(e,released);
+            }
+        };
+
+        std::vector<size_t> limits;
+        for(int b=0;b<n;b++) {
+            if(valid[b])
+                for_each_end(b,total,[&](int,size_t released) { limits.push_back(released); });
+        }
+        std::sort(limits.begin(),limits.end());
+        limits.erase(std::unique(limits.begin(),limits.end()),limits.end());
+        size_t const max_limits = 32;
+        if(limits.size() > max_limits) {
+            std::vector<size_t> sampled;
+            for(size_t i=0;i<max_limits;i++)
+                sampled.push_back(limits[i * (limits.size() - 1) / (max_limits - 1)]);
+            limits.swap(sampled);
+        }
+
+        struct Plan {
+            std::vector<unsigned> starts;
+            size_t memory;
+            size_t recompute;
+        };
+        Plan best,least;
+        for(size_t limit : limits) {
+            std::vector<long long> released(n+1,-1);
+            std::vector<size_t> largest(n+1,0);
+            std::vector<int> prev(n+1,-1);
+            released[0] = 0;
+            for(int b=0;b<n;b++) {
+                if(released[b] < 0 || !valid[b])
+                    continue;
+                for_each_end(b,limit,[&](int e,size_t segment) {
+                    if(released[b] + (long long)(segment) > released[e]) {
+                        released[e] = released[b] + segment;
+                        largest[e] = std::max(largest[b],segment);
+                        prev[e] = b;
+                    }
+                });
+            }
+            if(released[n] < 0)
+                continue;
+            Plan plan;
+            for(int e=n;e>0;e=prev[e])
+                plan.starts.push_back(prev[e]);
+            std::reverse(plan.starts.begin(),plan.starts.end());
+            plan.memory = total - released[n] + largest[n];
+            plan.recompute = plan.starts.back(); // operators before last segment run twice
+            if(plan.memory <= checkpoint_budget_
+               && (best.starts.empty() || plan.recompute < best.recompute
+                   || (plan.recompute == best.recompute && plan.memory < best.memory)))
+            {
+                best = plan;
+            }
+            if(least.starts.empty() || plan.memory < least.memory
+               || (plan.memory == least.memory && plan.recompute < least.recompute))
+            {
+                least = plan;
+            }
+        }
+        return best.starts.empty() ? least.starts : best.starts;
+    }
+
     void Net::allocate_chunks()
     {
         tensors_.clear();
@@ -659,10 +1123,12 @@ namespace dlprim {
         memory_.clear();
         bool train = mode_ == CalculationsMode::train;
         // normal
+        activation_memory_ = 0;
         for(auto const &ts : tensor_specs_) {
             if(alias_sources_.count(ts.first) != 0)
                 continue;
             tensors_[ts.first ] = Tensor(ctx_,ts.second.shape(),ts.second.dtype());
+            activation_memory_ += ts.second.memory_size();
             if(train)
                 tensors_diff_[ts.first ] = Tensor(ctx_,ts.second.shape(),ts.second.dtype());
         }
@@ -720,6 +1186,14 @@ namespace dlprim {
                 conn.parameters.push_back(parameters_[name]);
             }
         }
+        for(auto &fold : bn_folds_) {
+            Connection &conn = connections_[connections_index_[fold.connection]];
+            fold.weight = Tensor(ctx_,conn.parameter_specs[0].shape(),conn.parameter_specs[0].dtype(),false);
+            fold.bias   = Tensor(ctx_,conn.parameter_specs[1].shape(),conn.parameter_specs[1].dtype(),false);
+            conn.parameters.clear();
+            conn.parameters.push_back(fold.weight);
+            conn.parameters.push_back(fold.bias);
+        }
 
         /// BWD Connections
         std::set<std::string> zeroed_grad;
@@ -786,6 +1260,7 @@ namespace dlprim {
         for(auto &pr : parameters_) {
             pr.second.to_device(q);
         }
+        fold_batch_norms();
     }
     void Net::copy_parameters_to_host()
     {
@@ -793,6 +1268,7 @@ namespace dlprim {
         for(auto &pr : parameters_) {
             pr.second.to_host(q);
         }
+        fold_batch_norms();
     }
 
 
@@ -853,9 +1329,16 @@ namespace dlprim {
     void Net::backward(ExecutionContext const &e,bool sync)
     {
         ExecGuard g(e,"backward");
+        size_t segment = segments_.size(); // segments that follow connection i
         for(int i=connections_.size() - 1,it=0;i >= 0;i--,it++) {
             ExecGuard g(e,connections_[i].name.c_str());
             ExecutionContext ec = e.generate_series_context(it,connections_.size());
+            size_t segment_end = segment < segments_.size() ? segments_[segment] : connections_.size();
+            if(segment > 0 && size_t(i) + 1 == segment_end) {
+                segment--;
+                if(recompute_[segment])
+                    recompute_segment(segments_[segment],i + 1,ec,sync);
+            }
             if(connections_[i].gradient_flags != 3)
                 continue;
             connections_[i].op->backward(
@@ -870,5 +1353,21 @@ namespace dlprim {
 
         }
     }
+
+    void Net::recompute_segment(unsigned begin,unsigned end,ExecutionContext const &e,bool sync)
+    {
+        ExecGuard g(e,"recompute");
+        for(unsigned i=begin;i<end;i++) {
+            ExecGuard g(e,connections_[i].name.c_str());
+            connections_[i].op->recompute_forward(
+                connections_[i].input_tensors,
+                connections_[i].output_tensors,
+                connections_[i].parameters,
+                workspace_,
+                e);
+            if(sync && ctx_.is_opencl_context())
+                e.queue().finish();
+        }
+    }
       
 } 
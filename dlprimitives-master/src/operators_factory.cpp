@@ -152,6 +152,42 @@ static std::map<std::string,std::function<Operator *(Context &,json::value const
             return new Interpolation(ctx,InterpolationConfig::from_json(p));
         }
     },
+    {
+        "Quantize", 
+        [](Context &ctx,json::value const &p) {
+            return new Quantize(ctx,QuantizeConfig::from_json(p));
+        }
+    },
+    {
+        "Dequantize", 
+        [](Context &ctx,json::value const &p) {
+            return new Dequantize(ctx,QuantizeConfig::from_json(p));
+        }
+    },
+    {
+        "QuantizedConvolution2D", 
+        [](Context &ctx,json::value const &p) {
+            return new QuantizedConvolution2D(ctx,QuantizedConvolution2DConfig::from_json(p));
+        }
+    },
+    {
+        "QuantizedInnerProduct", 
+        [](Context &ctx,json::value const &p) {
+            return new QuantizedInnerProduct(ctx,QuantizedInnerProductConfig::from_json(p));
+        }
+    },
+    {
+        "QuantizedPooling2D", 
+        [](Context &ctx,json::value const &p) {
+            return new QuantizedPooling2D(ctx,Pooling2DConfig::from_json(p));
+        }
+    },
+    {
+        "QuantizedActivation", 
+        [](Context &ctx,json::value const &p) {
+            return new QuantizedActivation(ctx,QuantizedActivationConfig::from_json(p));
+        }
+    },
 };
     
 std::unique_ptr<Operator> create_by_name(Context &ctx,
@@ -11,6 +11,7 @@
 #include <dlprim/json.hpp>
 #include <dlprim/utils/json_helpers.hpp>
 #include <dlprim/cpu/cpu_ops.hpp>
+#include <dlprim/cpu/thread_pool.hpp>
 #include <math.h>
 #include <my_cblas.hpp>
 
@@ -94,10 +95,12 @@ void Activation::forward_cpu(Tensor &in,Tensor &out)
     size_t size = in.shape().total_size();
     float *a=in.data<float>();
     float *b=out.data<float>();
-    if(a!=b) {
-        memmove(b,a,size*sizeof(float));
-    }
-    cpu::apply_activation(b,size,config_.activation);
+    ctx_.thread_pool().parallel_for(size,[&](size_t begin,size_t end,int) {
+        if(a!=b) {
+            memmove(b + begin,a + begin,(end - begin)*sizeof(float));
+        }
+        cpu::apply_activation(b + begin,end - begin,config_.activation);
+    });
 }
 
 void Activation::backward_cpu(Tensor &y,Tensor &dy,Tensor &dx,float beta)
@@ -106,7 +109,9 @@ void Activation::backward_cpu(Tensor &y,Tensor &dy,Tensor &dx,float beta)
     float *p_y =y.data<float>();
     float *p_dy=dy.data<float>();
     float *p_dx=dx.data<float>();
-    cpu::apply_activation_diff(size,p_y,p_dy,p_dx,beta,config_.activation);
+    ctx_.thread_pool().parallel_for(size,[&](size_t begin,size_t end,int) {
+        cpu::apply_activation_diff(end - begin,p_y + begin,p_dy + begin,p_dx + begin,beta,config_.activation);
+    });
 }
 
 
@@ -9,6 +9,7 @@
 #include <dlprim/json.hpp>
 #include <dlprim/core/common.hpp>
 #include <dlprim/core/bn.hpp>
+#include <dlprim/cpu/thread_pool.hpp>
 #include <dlprim/ops/initialization.hpp>
 #include <cmath>
 #include <my_cblas.hpp>
@@ -33,6 +34,20 @@ namespace dlprim {
             return cfg;
         }
 
+        void BatchNorm::fold_into(BatchNormConfig const &cfg,int channels,size_t row,
+                                  float const *mean,float const *var,float const *gamma,float const *beta,
+                                  float *weight,float *bias)
+        {
+            for(int c=0;c<channels;c++) {
+                float scale = 1.0f / std::sqrt(var[c] + cfg.eps);
+                if(cfg.affine)
+                    scale *= gamma[c];
+                for(size_t k=0;k<row;k++)
+                    weight[c*row + k] *= scale;
+                bias[c] = (bias[c] - mean[c]) * scale + (cfg.affine ? beta[c] : 0.0f);
+            }
+        }
+
         BatchNorm::~BatchNorm() {}
         void BatchNorm::setup(std::vector<TensorSpecs> const &in,
                                 std::vector<TensorSpecs> &out,
@@ -111,9 +126,28 @@ namespace dlprim {
                                   std::vector<Tensor> &parameters,
                                   Tensor &ws,
                                   ExecutionContext const &e)
+        {
+            forward_impl(input,output,parameters,ws,e,true);
+        }
+
+        void BatchNorm::recompute_forward(std::vector<Tensor> &input,
+                                          std::vector<Tensor> &output,
+                                          std::vector<Tensor> &parameters,
+                                          Tensor &ws,
+                                          ExecutionContext const &e)
+        {
+            forward_impl(input,output,parameters,ws,e,false);
+        }
+
+        void BatchNorm::forward_impl(std::vector<Tensor> &input,
+                                     std::vector<Tensor> &output,
+                                     std::vector<Tensor> &parameters,
+                                     Tensor &ws,
+                                     ExecutionContext const &e,
+                                     bool update_stats)
         {
             if(ctx_.is_cpu_context()) {
-                forward_cpu(input,output,parameters,ws);
+                forward_cpu(input,output,parameters,ws,update_stats);
             }
             else {
                 Tensor mean,var;
@@ -125,12 +159,14 @@ namespace dlprim {
                             current_mean_,current_var_,
                             ws,e.generate_series_context(0,3));
 
-                    bn_gpu_->enqueue_update_running_stats(
-                            config_.momentum,(1.0f-config_.momentum),
-                            current_mean_,parameters[0],
-                            (config_.momentum * M) / (M-1),(1.0f-config_.momentum),
-                            current_var_,parameters[1],
-                            ws,e.generate_series_context(1,3));
+                    if(update_stats) {
+                        bn_gpu_->enqueue_update_running_stats(
+                                config_.momentum,(1.0f-config_.momentum),
+                                current_mean_,parameters[0],
+                                (config_.momentum * M) / (M-1),(1.0f-config_.momentum),
+                                current_var_,parameters[1],
+                                ws,e.generate_series_context(1,3));
+                    }
                     mean = current_mean_;
                     var = current_var_;
                     elast = e.generate_series_context(2,3);
@@ -161,12 +197,14 @@ namespace dlprim {
         void BatchNorm::forward_cpu(std::vector<Tensor> &input,
                                   std::vector<Tensor> &output,
                                   std::vector<Tensor> &parameters,
-                                  Tensor &workspace)
+                                  Tensor &workspace,
+                                  bool update_stats)
         {
             DLPRIM_CHECK(parameters.size() == 2u * (1 + config_.affine));
             if(mode() == CalculationsMode::train && !config_.use_global_stats) {
                 get_batch_stats(input[0],current_mean_,current_var_);
-                update_sums(input[0].shape().total_size() / config_.features, current_mean_,current_var_,parameters[0],parameters[1]);
+                if(update_stats)
+                    update_sums(input[0].shape().total_size() / config_.features, current_mean_,current_var_,parameters[0],parameters[1]);
                 if(config_.affine)
                     compute_conv_parameters(current_mean_,current_var_,&parameters.at(2),&parameters.at(3));
                 else
@@ -191,20 +229,24 @@ namespace dlprim {
 
         void BatchNorm::cpu_forward_data(Tensor &x,Tensor &y,Tensor &scale,Tensor &offset)
         {
-            float *xp = x.data<float>();
-            float *yp = y.data<float>();
+            float *x_base = x.data<float>();
+            float *y_base = y.data<float>();
             float *a  = scale.data<float>();
             float *b  = offset.data<float>();
             int batches=x.shape()[0];
             int rc = plane_size(x.shape());
-            for(int bt=0;bt<batches;bt++) {
-                for(int f=0;f<config_.features;f++) {
+            // planes of batch x features
+            ctx_.thread_pool().parallel_for(size_t(batches) * config_.features,[&](size_t begin,size_t end,int) {
+                float *xp = x_base + begin * rc;
+                float *yp = y_base + begin * rc;
+                for(size_t plane=begin;plane<end;plane++) {
+                    int f = plane % config_.features;
                     float A=a[f];
                     float B=b[f];
                     for(int i=0;i<rc;i++)
                         *yp++ = A* *xp++ + B;
                 }
-            }
+            });
         }
 
         void BatchNorm::compute_conv_parameters(Tensor &mean,Tensor &var,Tensor *at,Tensor *bt)
@@ -244,23 +286,25 @@ namespace dlprim {
             size_t rc_size = plane_size(x.shape());
             int M = x.shape()[0]*rc_size;
             float factor = 1.0f / M;
-            for(int f=0;f<config_.features;f++) {
-                m[f] = 0;
-                v[f] = 0;
-                float s=0,s2=0;
-                for(unsigned b=0;b<x.shape()[0];b++) {
-                    float *ptr = img + (b*config_.features + f)*rc_size;
-                    for(unsigned rc=0;rc < rc_size;rc++) {
-                        float val = *ptr++;
-                        s+= val;
-                        s2 += val*val;
+            ctx_.thread_pool().parallel_for(config_.features,[&](size_t begin,size_t end,int) {
+                for(int f=begin;f<int(end);f++) {
+                    m[f] = 0;
+                    v[f] = 0;
+                    float s=0,s2=0;
+                    for(unsigned b=0;b<x.shape()[0];b++) {
+                        float *ptr = img + (b*config_.features + f)*rc_size;
+                        for(unsigned rc=0;rc < rc_size;rc++) {
+                            float val = *ptr++;
+                            s+= val;
+                            s2 += val*val;
+                        }
                     }
+                    s*=factor;
+                    s2*=factor;
+                    m[f] = s;
+                    v[f] = s2 - s*s;
                 }
-                s*=factor;
-                s2*=factor;
-                m[f] = s;
-                v[f] = s2 - s*s;
-            }
+            });
         }
 
         void BatchNorm::cpu_backward_data(Tensor &x,Tensor &dx,Tensor &dy,float *mean,float *var,float *dy_sum,float *dyx_sum,float *gamma_in)
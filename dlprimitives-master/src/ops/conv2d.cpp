@@ -7,6 +7,7 @@
 ///////////////////////////////////////////////////////////////////////////////
 #include <dlprim/ops/conv2d.hpp>
 #include <dlprim/cpu/cpu_ops.hpp>
+#include <dlprim/cpu/thread_pool.hpp>
 #include <dlprim/ops/scal.hpp>
 #include <dlprim/gpu/program_cache.hpp>
 #include <dlprim/gpu/gemm.hpp>
@@ -143,7 +144,9 @@ namespace dlprim {
         size_t ws = 0;
         if(ctx_.is_cpu_context()) {
             Shape output_shape = get_output_shape(in);
-            ws = output_shape[2] * output_shape[3] * size_of_data_type(dtype_) * get_im2col_width();
+            // im2col slice per thread
+            ws = output_shape[2] * output_shape[3] * size_of_data_type(dtype_) * get_im2col_width()
+                 * ctx_.thread_pool().size();
         }
         else {
             if(conv_)
@@ -408,6 +411,11 @@ namespace dlprim {
         }
     }
    
+    void Convolution2DBase::im2col_cpu(Shape const &in,Shape const &outs,int8_t *img_in,int8_t *mat_in,Convolution2DConfig const &config)
+    {
+        im2col<details::Im2ColOp>(in,outs,img_in,mat_in,config);
+    }
+
     void Convolution2DBase::scale_cpu(Tensor &t,float v)
     {
         size_t items = t.shape().total_size();
@@ -420,27 +428,36 @@ namespace dlprim {
     
     void Convolution2D::forward_cpu(Tensor &in,Tensor &out,Tensor &M,Tensor *bias,void *ws)
     {
-        fwd_bwd_cpu(GemmOpMode::forward,in,out,M,bias,ws,config_);
-        cpu::apply_activation(out.data<float>(),out.shape().total_size(),config_.activation);
+        fwd_bwd_cpu(ctx_.thread_pool(),GemmOpMode::forward,in,out,M,bias,ws,config_);
+        if(config_.activation != StandardActivations::identity) {
+            float *ptr = out.data<float>();
+            ctx_.thread_pool().parallel_for(out.shape().total_size(),[&](size_t begin,size_t end,int) {
+                cpu::apply_activation(ptr + begin,end - begin,config_.activation);
+            });
+        }
     }
     void Convolution2D::backward_data_cpu(Tensor &dy,Tensor &K,Tensor &dx,Tensor &ws,float factor)
     {
         scale_cpu(dx,factor);
-        fwd_bwd_cpu(GemmOpMode::backward_data,dx,dy,K,nullptr,ws.host_data(),config_);
+        fwd_bwd_cpu(ctx_.thread_pool(),GemmOpMode::backward_data,dx,dy,K,nullptr,ws.host_data(),config_);
     }
     void Convolution2D::backward_filter_cpu(Tensor &dy,Tensor &x,Tensor &dK,Tensor &ws,float factor)
     {
         scale_cpu(dK,factor);
-        fwd_bwd_cpu(GemmOpMode::backward_filter,x,dy,dK,nullptr,ws.host_data(),config_);
+        fwd_bwd_cpu(ctx_.thread_pool(),GemmOpMode::backward_filter,x,dy,dK,nullptr,ws.host_data(),config_);
     }
 
-    void Convolution2DBase::fwd_bwd_cpu(GemmOpMode mode,Tensor &in,Tensor &out,Tensor &W,Tensor *bias_tensor,void *ws,Convolution2DConfig const &config,float fwd_beta)
+    void Convolution2DBase::fwd_bwd_cpu(cpu::ThreadPool &pool,GemmOpMode mode,Tensor &in,Tensor &out,Tensor &W,Tensor *bias_tensor,void *ws,Convolution2DConfig const &config,float fwd_beta)
     {
         int batch = in.shape()[0];
-        float *imcols = static_cast<float *>(ws);
+        float *workspace = static_cast<float *>(ws);
         float *kernel = W.data<float>();
+        float *in_data = in.data<float>();
+        float *out_data = out.data<float>();
+        float *bias_data = bias_tensor ? bias_tensor->data<float>() : nullptr;
         int im2col_rows = out.shape()[2]*out.shape()[3];
         int kernel_cols = config.channels_in / config.groups * config.kernel[0] * config.kernel[1];
+        size_t im2col_size = size_t(im2col_rows) * kernel_cols;
         int in_size_no_batch = in.shape().size_no_batch();
         int out_size_no_batch = out.shape().size_no_batch();
         int step_groups_out = config.channels_out / config.groups;
@@ -448,55 +465,92 @@ namespace dlprim {
         int step_kernel = step_groups_out * step_groups_in * config.kernel[0] * config.kernel[1];
         Shape  in_shape(in.shape()[0],in.shape()[1]/config.groups,in.shape()[2],in.shape()[3]);
         Shape out_shape(out.shape()[0],out.shape()[1]/config.groups,out.shape()[2],out.shape()[3]);
-        for(int b=0;b<batch;b++) {
-            for(int g=0;g<config.groups;g++) {
-                float *img = in.data<float>()  + in_size_no_batch *b + g * step_groups_in * in.shape()[2] * in.shape()[3];
-                float *omg = out.data<float>() + out_size_no_batch*b + g * step_groups_out * out.shape()[2] * out.shape()[3];
-                switch(mode) {
-                case GemmOpMode::forward: {
-                        im2col<details::Im2ColOp>(in_shape,out_shape,img,imcols,config);
-                        cblas_sgemm(CblasRowMajor,CblasNoTrans, CblasTrans,
-                                config.channels_out / config.groups,im2col_rows,kernel_cols,
-                                1.0f,
-                                kernel + step_kernel * g,kernel_cols,
-                                imcols,kernel_cols,
-                                fwd_beta,
-                                omg,
-                                im2col_rows);
-                        if(config.bias) {
-                            float *bias = bias_tensor->data<float>() + g * step_groups_out;
-                            int plane_size = out.shape()[2]*out.shape()[3];
-                            for(int i=0;i<step_groups_out;i++) {
-                                cblas_saxpy(plane_size,1.0f,bias + i,0,omg + plane_size*i,1);
-                            }
+
+        auto image = [&](int b,int g) {
+            return in_data  + in_size_no_batch *b + g * step_groups_in * in.shape()[2] * in.shape()[3];
+        };
+        auto out_image = [&](int b,int g) {
+            return out_data + out_size_no_batch*b + g * step_groups_out * out.shape()[2] * out.shape()[3];
+        };
+        // gemm of a single image and group split into tiles of output channels, or im2col rows for backward_data
+        int tiles = mode == GemmOpMode::backward_data ? im2col_rows : step_groups_out;
+        auto gemm = [&](int b,int g,float *imcols,int begin,int end) {
+            float *omg = out_image(b,g);
+            switch(mode) {
+            case GemmOpMode::forward: {
+                    cblas_sgemm(CblasRowMajor,CblasNoTrans, CblasTrans,
+                            end - begin,im2col_rows,kernel_cols,
+                            1.0f,
+                            kernel + step_kernel * g + begin * kernel_cols,kernel_cols,
+                            imcols,kernel_cols,
+                            fwd_beta,
+                            omg + begin * im2col_rows,
+                            im2col_rows);
+                    if(config.bias) {
+                        float *bias = bias_data + g * step_groups_out;
+                        int plane_size = out.shape()[2]*out.shape()[3];
+                        for(int i=begin;i<end;i++) {
+                            cblas_saxpy(plane_size,1.0f,bias + i,0,omg + plane_size*i,1);
                         }
                     }
-                    break;
-                case GemmOpMode::backward_filter: {
-                        im2col<details::Im2ColOp>(in_shape,out_shape,img,imcols,config);
-                        cblas_sgemm(CblasRowMajor,CblasNoTrans, CblasNoTrans,
-                                config.channels_out / config.groups,kernel_cols,im2col_rows,
-                                1.0f,
-                                omg,im2col_rows,
-                                imcols,kernel_cols,
-                                1.0f,
-                                kernel + step_kernel * g,kernel_cols
-                                );
-                    }
-                    break;
-                case GemmOpMode::backward_data: {
-                        cblas_sgemm(CblasRowMajor,CblasTrans, CblasNoTrans,
-                                im2col_rows, kernel_cols, config.channels_out / config.groups,
-                                1.0f,
-                                omg,im2col_rows,
-                                kernel + step_kernel * g,kernel_cols,
-                                0.0f,
-                                imcols,kernel_cols
-                                );
-                        im2col<details::Col2ImOp>(in_shape,out_shape,img,imcols,config);
-                    }
-                    break;
-                } // switch
+                }
+                break;
+            case GemmOpMode::backward_filter: {
+                    cblas_sgemm(CblasRowMajor,CblasNoTrans, CblasNoTrans,
+                            end - begin,kernel_cols,im2col_rows,
+                            1.0f,
+                            omg + begin * im2col_rows,im2col_rows,
+                            imcols,kernel_cols,
+                            1.0f,
+                            kernel + step_kernel * g + begin * kernel_cols,kernel_cols
+                            );
+                }
+                break;
+            case GemmOpMode::backward_data: {
+                    cblas_sgemm(CblasRowMajor,CblasTrans, CblasNoTrans,
+                            end - begin, kernel_cols, config.channels_out / config.groups,
+                            1.0f,
+                            omg + begin,im2col_rows,
+                            kernel + step_kernel * g,kernel_cols,
+                            0.0f,
+                            imcols + size_t(begin) * kernel_cols,kernel_cols
+                            );
+                }
+                break;
+            } // switch
+        };
+        auto run = [&](int b,int g,float *imcols,bool split) {
+            if(mode != GemmOpMode::backward_data)
+                im2col<details::Im2ColOp>(in_shape,out_shape,image(b,g),imcols,config);
+            if(split) {
+                pool.parallel_for(tiles,[&](size_t begin,size_t end,int) {
+                    gemm(b,g,imcols,begin,end);
+                });
+            }
+            else {
+                gemm(b,g,imcols,0,tiles);
+            }
+            if(mode == GemmOpMode::backward_data)
+                im2col<details::Col2ImOp>(in_shape,out_shape,image(b,g),imcols,config);
+        };
+
+        // Images are independent for forward and backward_data, so with enough of them each
+        // thread processes whole images using its own im2col slice of the workspace. backward_filter
+        // accumulates all images into same kernel gradient so it, as well as small batches, is split
+        // over gemm tiles instead
+        if(mode != GemmOpMode::backward_filter && batch >= pool.size()) {
+            pool.parallel_for(batch,[&](size_t begin,size_t end,int thread_id) {
+                float *imcols = workspace + im2col_size * thread_id;
+                for(int b=begin;b<int(end);b++) {
+                    for(int g=0;g<config.groups;g++)
+                        run(b,g,imcols,false);
+                }
+            });
+        }
+        else {
+            for(int b=0;b<batch;b++) {
+                for(int g=0;g<config.groups;g++)
+                    run(b,g,workspace,true);
             }
         }
     }
@@ -673,7 +727,9 @@ namespace dlprim {
     {
         size_t ws = 0;
         if(ctx_.is_cpu_context()) {
-            ws = in[2] * in[3] * size_of_data_type(dtype_) * get_im2col_width();
+            // im2col slice per thread
+            ws = in[2] * in[3] * size_of_data_type(dtype_) * get_im2col_width()
+                 * ctx_.thread_pool().size();
         }
         else {
             if(conv_fwd_)
@@ -779,7 +835,7 @@ namespace dlprim {
             else {
                 memset(out[0].data<float>(),0,sizeof(float) * out[0].shape().total_size());
             }
-            fwd_bwd_cpu(GemmOpMode::backward_data,out[0],in[0],parameters[0],nullptr,ws.host_data(),conv_config_);
+            fwd_bwd_cpu(ctx_.thread_pool(),GemmOpMode::backward_data,out[0],in[0],parameters[0],nullptr,ws.host_data(),conv_config_);
         }
         else {
             int total = 1 + bool(bias) + bool(activation_);
@@ -829,7 +885,7 @@ namespace dlprim {
             }
             else {
                 scale_cpu(parameters[0].diff,parameters[0].accumulate_gradient);
-                fwd_bwd_cpu(GemmOpMode::backward_filter,output[0].diff,input[0].data,parameters[0].diff,nullptr,workspace.host_data(),conv_config_);
+                fwd_bwd_cpu(ctx_.thread_pool(),GemmOpMode::backward_filter,output[0].diff,input[0].data,parameters[0].diff,nullptr,workspace.host_data(),conv_config_);
             }
         }
 
@@ -846,7 +902,7 @@ namespace dlprim {
                     memset(input[0].diff.host_data(),0,sizeof(float)*input[0].diff.shape().total_size());
                     beta = 0.0f;
                 }
-                fwd_bwd_cpu(GemmOpMode::forward,output[0].diff,input[0].diff,parameters[0].data,nullptr,workspace.host_data(),conv_config_,beta);
+                fwd_bwd_cpu(ctx_.thread_pool(),GemmOpMode::forward,output[0].diff,input[0].diff,parameters[0].data,nullptr,workspace.host_data(),conv_config_,beta);
             }
         }
     }
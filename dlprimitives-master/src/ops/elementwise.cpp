@@ -10,6 +10,7 @@
 #include <dlprim/json.hpp>
 #include <dlprim/utils/json_helpers.hpp>
 #include <dlprim/cpu/cpu_ops.hpp>
+#include <dlprim/cpu/thread_pool.hpp>
 #include <dlprim/core/pointwise.hpp>
 #include <math.h>
 
@@ -527,34 +528,45 @@ void Elementwise::forward_cpu(Tensor &a,Tensor &b,Tensor &c)
 
     Shape as = shrank[0].broadcast_strides(shrank_c);
     Shape bs = shrank[1].broadcast_strides(shrank_c);
-    switch(config_.op) {
-    case ElementwiseConfig::elementwise_sum:
-        {
-            float c0 = config_.coeff[0];
-            float c1 = config_.coeff[1];
-            loop_strides(shrank_c,ap,as,bp,bs,cp,[=](float x0,float x1) {
-                return x0*c0 + x1*c1;
-            });
-        }
-        break;
-    case ElementwiseConfig::elementwise_prod:
-        {
-            float w = config_.coeff[0] * config_.coeff[1];
-            loop_strides(shrank_c,ap,as,bp,bs,cp,[=](float x0,float x1) {
-                return x0*x1*w;
-            });
-        }
-        break;
-    case ElementwiseConfig::elementwise_max:
-        {
-            float c0 = config_.coeff[0];
-            float c1 = config_.coeff[1];
-            loop_strides(shrank_c,ap,as,bp,bs,cp,[=](float x0,float x1) {
-                return std::max(x0*c0,x1*c1);
-            });
+    auto run = [&](Shape const &range,float *ap,float *bp,float *cp) {
+        switch(config_.op) {
+        case ElementwiseConfig::elementwise_sum:
+            {
+                float c0 = config_.coeff[0];
+                float c1 = config_.coeff[1];
+                loop_strides(range,ap,as,bp,bs,cp,[=](float x0,float x1) {
+                    return x0*c0 + x1*c1;
+                });
+            }
+            break;
+        case ElementwiseConfig::elementwise_prod:
+            {
+                float w = config_.coeff[0] * config_.coeff[1];
+                loop_strides(range,ap,as,bp,bs,cp,[=](float x0,float x1) {
+                    return x0*x1*w;
+                });
+            }
+            break;
+        case ElementwiseConfig::elementwise_max:
+            {
+                float c0 = config_.coeff[0];
+                float c1 = config_.coeff[1];
+                loop_strides(range,ap,as,bp,bs,cp,[=](float x0,float x1) {
+                    return std::max(x0*c0,x1*c1);
+                });
+            }
+            break;
         }
-        break;
+    };
+    if(shrank_c.size() == 1 && as[0] == 1 && bs[0] == 1) {
+        // no broadcasting, split into contiguous chunks
+        ctx_.thread_pool().parallel_for(size,[&](size_t begin,size_t end,int) {
+            run(Shape(end - begin),ap + begin,bp + begin,cp + begin);
+            cpu::apply_activation(cp + begin,end - begin,config_.activation);
+        });
+        return;
     }
+    run(shrank_c,ap,bp,cp);
     cpu::apply_activation(c.data<float>(),size,config_.activation);
 }
 
@@ -11,6 +11,7 @@
 #include <dlprim/utils/json_helpers.hpp>
 #include <math.h>
 #include <dlprim/cpu/cpu_ops.hpp>
+#include <dlprim/cpu/thread_pool.hpp>
 #include <dlprim/ops/scal.hpp>
 #include <dlprim/core/pool.hpp>
 #include <my_cblas.hpp>
@@ -175,15 +176,15 @@ void Pooling2D::forward(std::vector<Tensor> &input,std::vector<Tensor> &output,
 
 void Pooling2D::backward_cpu_max(Tensor &xt,Tensor &dxt,Tensor &dyt,float factor)
 {
-    float *dx = dxt.data<float>();
-    float *dy = dyt.data<float>();
-    float *x  = xt.data<float>();
+    float *dx_base = dxt.data<float>();
+    float *dy_base = dyt.data<float>();
+    float *x_base  = xt.data<float>();
     
     size_t N = xt.shape().total_size();
     if(factor == 0)
-        memset(dx,0,sizeof(float)*N);
+        memset(dx_base,0,sizeof(float)*N);
     else 
-        cblas_sscal(N,factor,dx,1);
+        cblas_sscal(N,factor,dx_base,1);
 
     int bc = xt.shape()[0]*xt.shape()[1];
     
@@ -193,49 +194,54 @@ void Pooling2D::backward_cpu_max(Tensor &xt,Tensor &dxt,Tensor &dyt,float factor
     int out_h = dyt.shape()[2];
     int out_w = dyt.shape()[3];
     
-    for(int bc_count = 0;bc_count < bc;bc_count ++, x+= in_h*in_w,dx+= in_h*in_w,dy+= out_h*out_w) {
-        for(int out_r=0;out_r<out_h;out_r++) {
-            for(int out_c = 0;out_c <out_w;out_c++) {
-                int row0 = out_r * config_.stride[0] - config_.pad[0];
-                int col0 = out_c * config_.stride[1] - config_.pad[1];
-                int row1 = row0 + config_.kernel[0];
-                int col1 = col0 + config_.kernel[1];
+    ctx_.thread_pool().parallel_for(bc,[&](size_t begin,size_t end,int) {
+        float *x  = x_base  + begin * in_h * in_w;
+        float *dx = dx_base + begin * in_h * in_w;
+        float *dy = dy_base + begin * out_h * out_w;
+        for(int bc_count = begin;bc_count < int(end);bc_count ++, x+= in_h*in_w,dx+= in_h*in_w,dy+= out_h*out_w) {
+            for(int out_r=0;out_r<out_h;out_r++) {
+                for(int out_c = 0;out_c <out_w;out_c++) {
+                    int row0 = out_r * config_.stride[0] - config_.pad[0];
+                    int col0 = out_c * config_.stride[1] - config_.pad[1];
+                    int row1 = row0 + config_.kernel[0];
+                    int col1 = col0 + config_.kernel[1];
                 
-                float val = -std::numeric_limits<float>::max();
-                int pos=0;
+                    float val = -std::numeric_limits<float>::max();
+                    int pos=0;
 
-                row0 = std::max(0,row0);
-                col0 = std::max(0,col0);
-                row1 = std::min(row1,in_h);
-                col1 = std::min(col1,in_w);
+                    row0 = std::max(0,row0);
+                    col0 = std::max(0,col0);
+                    row1 = std::min(row1,in_h);
+                    col1 = std::min(col1,in_w);
                 
-                for(int r=row0;r<row1;r++) {
-                    for(int c=col0;c<col1;c++) {
-                        float tmp = x[r*in_w + c];
-                        if(tmp > val) {
-                            pos = r*in_w + c;
-                            val = tmp;
+                    for(int r=row0;r<row1;r++) {
+                        for(int c=col0;c<col1;c++) {
+                            float tmp = x[r*in_w + c];
+                            if(tmp > val) {
+                                pos = r*in_w + c;
+                                val = tmp;
+                            }
                         }
                     }
-                }
 
-                dx[pos] += dy[out_r*out_w + out_c];
+                    dx[pos] += dy[out_r*out_w + out_c];
+                }
             }
         }
-    }
+    });
 }
 
 template<typename Reduce>
 void Pooling2D::backward_cpu_ave(Tensor &dxt,Tensor &dyt,float factor,Reduce rop)
 {
-    float *dx = dxt.data<float>();
-    float *dy = dyt.data<float>();
+    float *dx_base = dxt.data<float>();
+    float *dy_base = dyt.data<float>();
     
     size_t N = dxt.shape().total_size();
     if(factor == 0)
-        memset(dx,0,sizeof(float)*N);
+        memset(dx_base,0,sizeof(float)*N);
     else 
-        cblas_sscal(N,factor,dx,1);
+        cblas_sscal(N,factor,dx_base,1);
 
     int bc = dxt.shape()[0]*dxt.shape()[1];
     
@@ -245,31 +251,35 @@ void Pooling2D::backward_cpu_ave(Tensor &dxt,Tensor &dyt,float factor,Reduce rop
     int out_h = dyt.shape()[2];
     int out_w = dyt.shape()[3];
     
-    for(int bc_count = 0;bc_count < bc;bc_count ++,dx+= in_h*in_w,dy+= out_h*out_w) {
-        for(int out_r=0;out_r<out_h;out_r++) {
-            for(int out_c = 0;out_c <out_w;out_c++) {
-                int row0 = out_r * config_.stride[0] - config_.pad[0];
-                int col0 = out_c * config_.stride[1] - config_.pad[1];
-                int row1 = row0 + config_.kernel[0];
-                int col1 = col0 + config_.kernel[1];
-
-                int dr_with_pad = std::min(row1,in_h + config_.pad[0]) - std::max(-config_.pad[0],row0);
-                int dc_with_pad = std::min(col1,in_w + config_.pad[1]) - std::max(-config_.pad[1],col0);
-
-                row0 = std::max(0,row0);
-                col0 = std::max(0,col0);
-                row1 = std::min(row1,in_h);
-                col1 = std::min(col1,in_w);
+    ctx_.thread_pool().parallel_for(bc,[&](size_t begin,size_t end,int) {
+        float *dx = dx_base + begin * in_h * in_w;
+        float *dy = dy_base + begin * out_h * out_w;
+        for(int bc_count = begin;bc_count < int(end);bc_count ++,dx+= in_h*in_w,dy+= out_h*out_w) {
+            for(int out_r=0;out_r<out_h;out_r++) {
+                for(int out_c = 0;out_c <out_w;out_c++) {
+                    int row0 = out_r * config_.stride[0] - config_.pad[0];
+                    int col0 = out_c * config_.stride[1] - config_.pad[1];
+                    int row1 = row0 + config_.kernel[0];
+                    int col1 = col0 + config_.kernel[1];
+
+                    int dr_with_pad = std::min(row1,in_h + config_.pad[0]) - std::max(-config_.pad[0],row0);
+                    int dc_with_pad = std::min(col1,in_w + config_.pad[1]) - std::max(-config_.pad[1],col0);
+
+                    row0 = std::max(0,row0);
+                    col0 = std::max(0,col0);
+                    row1 = std::min(row1,in_h);
+                    col1 = std::min(col1,in_w);
                 
-                float dy_norm = rop.norm_valid(dy[out_r*out_w + out_c],row1-row0,col1-col0,dr_with_pad,dc_with_pad);
-                for(int r=row0;r<row1;r++) {
-                    for(int c=col0;c<col1;c++) {
-                        dx[r*in_w + c] += dy_norm;
+                    float dy_norm = rop.norm_valid(dy[out_r*out_w + out_c],row1-row0,col1-col0,dr_with_pad,dc_with_pad);
+                    for(int r=row0;r<row1;r++) {
+                        for(int c=col0;c<col1;c++) {
+                            dx[r*in_w + c] += dy_norm;
+                        }
                     }
                 }
             }
         }
-    }
+    });
 }
 
 void Pooling2D::backward_gpu(Tensor &x,Tensor &dx,Tensor &dy,float factor,ExecutionContext const &ex)
@@ -281,8 +291,8 @@ void Pooling2D::backward_gpu(Tensor &x,Tensor &dx,Tensor &dy,float factor,Execut
 template<typename Dtype,typename Reduce>
 void Pooling2D::forward_cpu(Tensor &in,Tensor &out,Reduce rop)
 {
-    Dtype *src = in.data<Dtype>();
-    Dtype *tgt = out.data<Dtype>();
+    Dtype *src_base = in.data<Dtype>();
+    Dtype *tgt_base = out.data<Dtype>();
     
     int bc = in.shape()[0]*in.shape()[1];
     
@@ -292,39 +302,43 @@ void Pooling2D::forward_cpu(Tensor &in,Tensor &out,Reduce rop)
     int out_h = out.shape()[2];
     int out_w = out.shape()[3];
     
-    for(int bc_count = 0;bc_count < bc;bc_count ++, src+= in_h*in_w,tgt+= out_h*out_w) {
-        for(int out_r=0;out_r<out_h;out_r++) {
-            for(int out_c = 0;out_c <out_w;out_c++) {
-                int row0 = out_r * config_.stride[0] - config_.pad[0];
-                int col0 = out_c * config_.stride[1] - config_.pad[1];
-                int row1 = row0 + config_.kernel[0];
-                int col1 = col0 + config_.kernel[1];
+    ctx_.thread_pool().parallel_for(bc,[&](size_t begin,size_t end,int) {
+        Dtype *src = src_base + begin * in_h * in_w;
+        Dtype *tgt = tgt_base + begin * out_h * out_w;
+        for(int bc_count = begin;bc_count < int(end);bc_count ++, src+= in_h*in_w,tgt+= out_h*out_w) {
+            for(int out_r=0;out_r<out_h;out_r++) {
+                for(int out_c = 0;out_c <out_w;out_c++) {
+                    int row0 = out_r * config_.stride[0] - config_.pad[0];
+                    int col0 = out_c * config_.stride[1] - config_.pad[1];
+                    int row1 = row0 + config_.kernel[0];
+                    int col1 = col0 + config_.kernel[1];
                 
-                Dtype val = rop.init_val;
+                    Dtype val = rop.init_val;
 
-                int dr_with_pad = std::min(row1,in_h + config_.pad[0]) - std::max(-config_.pad[0],row0);
-                int dc_with_pad = std::min(col1,in_w + config_.pad[1]) - std::max(-config_.pad[1],col0);
+                    int dr_with_pad = std::min(row1,in_h + config_.pad[0]) - std::max(-config_.pad[0],row0);
+                    int dc_with_pad = std::min(col1,in_w + config_.pad[1]) - std::max(-config_.pad[1],col0);
                 
-                row0 = std::max(0,row0);
-                col0 = std::max(0,col0);
-                row1 = std::min(row1,in_h);
-                col1 = std::min(col1,in_w);
+                    row0 = std::max(0,row0);
+                    col0 = std::max(0,col0);
+                    row1 = std::min(row1,in_h);
+                    col1 = std::min(col1,in_w);
                 
-                for(int r=row0;r<row1;r++) {
-                    for(int c=col0;c<col1;c++) {
-                        val = rop.apply(val,src[r*in_w + c]);
+                    for(int r=row0;r<row1;r++) {
+                        for(int c=col0;c<col1;c++) {
+                            val = rop.apply(val,src[r*in_w + c]);
+                        }
                     }
+                    int dr = row1 - row0;
+                    int dc = col1 - col0;
+                    if(dr == config_.kernel[0] && dc == config_.kernel[1])
+                        val = rop.norm_full(val);
+                    else
+                        val = rop.norm_valid(val,dr,dc,dr_with_pad,dc_with_pad);
+                    tgt[out_r*out_w + out_c] = val;
                 }
-                int dr = row1 - row0;
-                int dc = col1 - col0;
-                if(dr == config_.kernel[0] && dc == config_.kernel[1])
-                    val = rop.norm_full(val);
-                else
-                    val = rop.norm_valid(val,dr,dc,dr_with_pad,dc_with_pad);
-                tgt[out_r*out_w + out_c] = val;
             }
         }
-    }
+    });
 }
 
 void Pooling2D::forward_gpu(Tensor &in,Tensor &out,ExecutionContext const &ctx)
@@ -427,27 +441,31 @@ void GlobalPooling::reshape(std::vector<Shape> const &in,std::vector<Shape> &out
 void GlobalPooling::forward_cpu(Tensor &input,Tensor &output)
 {
     Shape in_shape = input.shape();
-    float *in  = input.data<float>();
-    float *out = output.data<float>();
     size_t total = in_shape[0]*in_shape[1];
     size_t over = in_shape[2]*in_shape[3];
-    if(cfg_.mode == PoolingBase::max) {
-        for(size_t i=0;i<total;i++) {
-            float start = *in++;
-            for(size_t i=1;i<over;i++)
-                start = std::max(start,*in++);
-            *out++= start;
+    float *in_base  = input.data<float>();
+    float *out_base = output.data<float>();
+    ctx_.thread_pool().parallel_for(total,[&](size_t begin,size_t end,int) {
+        float *in  = in_base + begin * over;
+        float *out = out_base + begin;
+        if(cfg_.mode == PoolingBase::max) {
+            for(size_t i=begin;i<end;i++) {
+                float start = *in++;
+                for(size_t i=1;i<over;i++)
+                    start = std::max(start,*in++);
+                *out++= start;
+            }
         }
-    }
-    else {
-        float factor = 1.0f / over;
-        for(size_t i=0;i<total;i++) {
-            float sum = 0;
-            for(size_t i=0;i<over;i++)
-                sum += *in++;
-            *out++= sum * factor;
+        else {
+            float factor = 1.0f / over;
+            for(size_t i=begin;i<end;i++) {
+                float sum = 0;
+                for(size_t i=0;i<over;i++)
+                    sum += *in++;
+                *out++= sum * factor;
+            }
         }
-    }
+    });
 }
 
 
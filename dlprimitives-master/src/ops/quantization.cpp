@@ -0,0 +1,627 @@
+///////////////////////////////////////////////////////////////////////////////
+///
+/// Copyright (c) 2021-2022 Artyom Beilis <artyomtnk@yahoo.com>
+///
+/// MIT License, see LICENSE.TXT
+///
+///////////////////////////////////////////////////////////////////////////////
+#include <dlprim/ops/quantization.hpp>
+#include <dlprim/cpu/cpu_ops.hpp>
+#include <dlprim/cpu/thread_pool.hpp>
+#include <dlprim/gpu/program_cache.hpp>
+#include <dlprim/core/pool.hpp>
+#include <dlprim/utils/json_helpers.hpp>
+#include <dlprim/json.hpp>
+#include <algorithm>
+#include <cmath>
+#include <initializer_list>
+
+namespace dlprim {
+    namespace {
+        // same as convert_char_sat_rte of OpenCL kernels, assuming default rounding mode
+        inline int8_t requantize(float v)
+        {
+            v = std::nearbyint(v);
+            return int8_t(std::min(127.0f,std::max(-128.0f,v)));
+        }
+
+        void check_scale(float scale)
+        {
+            if(!(scale > 0))
+                throw ValidationError("Quantization scale must be positive");
+        }
+
+        // kernel(size,x,y,scales...)
+        void enqueue_pointwise(cl::Kernel &k,Tensor &x,Tensor &y,std::initializer_list<float> scales,ExecutionContext const &e,char const *name)
+        {
+            size_t size = x.shape().total_size();
+            int p = 0;
+            k.setArg(p++,cl_ulong(size));
+            x.set_arg(k,p);
+            y.set_arg(k,p);
+            for(float s : scales)
+                k.setArg(p++,s);
+            cl::NDRange l(size >= 1024 ? 256 : 64);
+            cl::NDRange g = gpu::round_range(size,l);
+            e.queue().enqueueNDRangeKernel(k,cl::NullRange,g,l,e.events(),e.event(name));
+        }
+    }
+
+    QuantizeConfig QuantizeConfig::from_json(json::value const &v)
+    {
+        QuantizeConfig cfg;
+        cfg.scale = v.get("scale",cfg.scale);
+        return cfg;
+    }
+
+    Quantize::Quantize(Context &ctx,QuantizeConfig const &config) :
+        Operator(ctx),
+        config_(config)
+    {
+        check_scale(config_.scale);
+    }
+    Quantize::~Quantize()
+    {
+    }
+    void Quantize::setup(std::vector<TensorSpecs> const &in,std::vector<TensorSpecs> &out,std::vector<TensorSpecs> &p,size_t &ws)
+    {
+        DLPRIM_CHECK(in.size() == 1);
+        DLPRIM_CHECK(in[0].dtype() == float_data);
+        out.assign({TensorSpecs(in[0].shape(),int8_data)});
+        p.clear();
+        ws = 0;
+        if(ctx_.is_cpu_context())
+            return;
+        cl::Program const &prog = gpu::Cache::instance().get_program(ctx_,"quantized");
+        kernel_ = cl::Kernel(prog,"quantize");
+    }
+    void Quantize::reshape(std::vector<Shape> const &in,std::vector<Shape> &out,size_t &ws)
+    {
+        DLPRIM_CHECK(in.size() == 1);
+        out = in;
+        ws = 0;
+    }
+    void Quantize::forward(std::vector<Tensor> &input,std::vector<Tensor> &output,std::vector<Tensor> &,Tensor &,ExecutionContext const &e)
+    {
+        DLPRIM_CHECK(input.size() == 1 && output.size() == 1);
+        DLPRIM_CHECK(input[0].shape() == output[0].shape());
+        float inv_scale = 1.0f / config_.scale;
+        if(ctx_.is_cpu_context()) {
+            float *x = input[0].data<float>();
+            int8_t *y = output[0].data<int8_t>();
+            ctx_.thread_pool().parallel_for(input[0].shape().total_size(),[&](size_t begin,size_t end,int) {
+                for(size_t i=begin;i<end;i++)
+                    y[i] = requantize(x[i] * inv_scale);
+            });
+        }
+        else {
+            enqueue_pointwise(kernel_,input[0],output[0],{inv_scale},e,"quantize");
+        }
+    }
+
+    Dequantize::Dequantize(Context &ctx,QuantizeConfig const &config) :
+        Operator(ctx),
+        config_(config)
+    {
+        check_scale(config_.scale);
+    }
+    Dequantize::~Dequantize()
+    {
+    }
+    void Dequantize::setup(std::vector<TensorSpecs> const &in,std::vector<TensorSpecs> &out,std::vector<TensorSpecs> &p,size_t &ws)
+    {
+        DLPRIM_CHECK(in.size() == 1);
+        DLPRIM_CHECK(in[0].dtype() == int8_data);
+        out.assign({TensorSpecs(in[0].shape(),float_data)});
+        p.clear();
+        ws = 0;
+        if(ctx_.is_cpu_context())
+            return;
+        cl::Program const &prog = gpu::Cache::instance().get_program(ctx_,"quantized");
+        kernel_ = cl::Kernel(prog,"dequantize");
+    }
+    void Dequantize::reshape(std::vector<Shape> const &in,std::vector<Shape> &out,size_t &ws)
+    {
+        DLPRIM_CHECK(in.size() == 1);
+        out = in;
+        ws = 0;
+    }
+    void Dequantize::forward(std::vector<Tensor> &input,std::vector<Tensor> &output,std::vector<Tensor> &,Tensor &,ExecutionContext const &e)
+    {
+        DLPRIM_CHECK(input.size() == 1 && output.size() == 1);
+        DLPRIM_CHECK(input[0].shape() == output[0].shape());
+        float scale = config_.scale;
+        if(ctx_.is_cpu_context()) {
+            int8_t *x = input[0].data<int8_t>();
+            float *y = output[0].data<float>();
+            ctx_.thread_pool().parallel_for(input[0].shape().total_size(),[&](size_t begin,size_t end,int) {
+                for(size_t i=begin;i<end;i++)
+                    y[i] = x[i] * scale;
+            });
+        }
+        else {
+            enqueue_pointwise(kernel_,input[0],output[0],{scale},e,"dequantize");
+        }
+    }
+
+    QuantizedConvolution2DConfig QuantizedConvolution2DConfig::from_json(json::value const &v)
+    {
+        QuantizedConvolution2DConfig cfg;
+        static_cast<Convolution2DConfig &>(cfg) = Convolution2DConfig::from_json(v);
+        cfg.input_scale = v.get("input_scale",cfg.input_scale);
+        cfg.output_scale = v.get("output_scale",cfg.output_scale);
+        return cfg;
+    }
+
+    QuantizedConvolution2D::QuantizedConvolution2D(Context &ctx,QuantizedConvolution2DConfig const &config) :
+        Operator(ctx),
+        config_(config)
+    {
+        DLPRIM_CHECK(config_.channels_out > 0);
+        check_scale(config_.input_scale);
+        check_scale(config_.output_scale);
+    }
+    QuantizedConvolution2D::~QuantizedConvolution2D()
+    {
+    }
+
+    Shape QuantizedConvolution2D::get_output_shape(Shape const &in)
+    {
+        DLPRIM_CHECK(in.size() == 4);
+        DLPRIM_CHECK(int(in[1]) == config_.channels_in);
+        int ohw[2];
+        for(int i=0;i<2;i++)
+            ohw[i] = (int(in[2+i]) + 2 * config_.pad[i] - config_.dilate[i] * (config_.kernel[i] - 1) - 1) / config_.stride[i] + 1;
+        DLPRIM_CHECK(ohw[0] > 0);
+        DLPRIM_CHECK(ohw[1] > 0);
+        return Shape(in[0],config_.channels_out,ohw[0],ohw[1]);
+    }
+
+    size_t QuantizedConvolution2D::calc_workspace(Shape const &out)
+    {
+        if(ctx_.is_opencl_context())
+            return 0;
+        // int8 im2col of a single image group
+        return size_t(out[2]) * out[3] * (config_.channels_in / config_.groups) * config_.kernel[0] * config_.kernel[1];
+    }
+
+    void QuantizedConvolution2D::setup(std::vector<TensorSpecs> const &in,std::vector<TensorSpecs> &out,std::vector<TensorSpecs> &params,size_t &ws)
+    {
+        DLPRIM_CHECK(in.size() == 1);
+        DLPRIM_CHECK(in[0].dtype() == int8_data);
+        DLPRIM_CHECK(in[0].shape().size() == 4);
+        if(config_.channels_in == -1)
+            config_.channels_in = in[0].shape()[1];
+        DLPRIM_CHECK(config_.channels_in  % config_.groups == 0);
+        DLPRIM_CHECK(config_.channels_out % config_.groups == 0);
+        Shape out_shape = get_output_shape(in[0].shape());
+        out.assign({TensorSpecs(out_shape,int8_data)});
+        params.push_back(TensorSpecs(Shape(config_.channels_out,config_.channels_in / config_.groups,config_.kernel[0],config_.kernel[1]),
+                                     int8_data,false));
+        params.push_back(TensorSpecs(Shape(config_.channels_out),float_data,false));
+        if(config_.bias)
+            params.push_back(TensorSpecs(Shape(config_.channels_out),float_data,false));
+        ws = calc_workspace(out_shape);
+        if(ctx_.is_cpu_context())
+            return;
+        cl::Program const &prog = gpu::Cache::instance().get_program(ctx_,"quantized",
+                                            "BIAS",int(config_.bias),
+                                            "GROUPS",config_.groups,
+                                            "KERNEL_H",config_.kernel[0],
+                                            "KERNEL_W",config_.kernel[1],
+                                            "STRIDE_H",config_.stride[0],
+                                            "STRIDE_W",config_.stride[1],
+                                            "PAD_H",config_.pad[0],
+                                            "PAD_W",config_.pad[1],
+                                            "DILATE_H",config_.dilate[0],
+                                            "DILATE_W",config_.dilate[1],
+                                            "ACTIVATION",int(config_.activation));
+        kernel_ = cl::Kernel(prog,"conv");
+    }
+
+    void QuantizedConvolution2D::reshape(std::vector<Shape> const &in,std::vector<Shape> &out,size_t &ws)
+    {
+        DLPRIM_CHECK(in.size() == 1);
+        out.assign({get_output_shape(in[0])});
+        ws = calc_workspace(out[0]);
+    }
+
+    void QuantizedConvolution2D::forward(std::vector<Tensor> &input,std::vector<Tensor> &output,std::vector<Tensor> &parameters,
+                                         Tensor &ws,ExecutionContext const &e)
+    {
+        DLPRIM_CHECK(input.size() == 1 && output.size() == 1);
+        DLPRIM_CHECK(input[0].dtype() == int8_data);
+        DLPRIM_CHECK(output[0].shape() == get_output_shape(input[0].shape()));
+        DLPRIM_CHECK(parameters.size() == 2u + unsigned(config_.bias));
+        Tensor *bias = config_.bias ? &parameters[2] : nullptr;
+        if(ctx_.is_cpu_context())
+            forward_cpu(input[0],output[0],parameters[0],parameters[1],bias,ws);
+        else
+            forward_gpu(input[0],output[0],parameters[0],parameters[1],bias,e);
+    }
+
+    void QuantizedConvolution2D::forward_gpu(Tensor &in,Tensor &out,Tensor &W,Tensor &W_scale,Tensor *bias,ExecutionContext const &e)
+    {
+        int batch = in.shape()[0];
+        int pixels = out.shape()[2] * out.shape()[3];
+        int p = 0;
+        kernel_.setArg(p++,batch);
+        kernel_.setArg(p++,config_.channels_in);
+        kernel_.setArg(p++,int(in.shape()[2]));
+        kernel_.setArg(p++,int(in.shape()[3]));
+        kernel_.setArg(p++,config_.channels_out);
+        kernel_.setArg(p++,int(out.shape()[2]));
+        kernel_.setArg(p++,int(out.shape()[3]));
+        in.set_arg(kernel_,p);
+        W.set_arg(kernel_,p);
+        W_scale.set_arg(kernel_,p);
+        if(bias)
+            bias->set_arg(kernel_,p);
+        out.set_arg(kernel_,p);
+        kernel_.setArg(p++,config_.input_scale);
+        kernel_.setArg(p++,1.0f / config_.output_scale);
+        cl::NDRange l(64,1,1);
+        cl::NDRange g = gpu::round_range(pixels,config_.channels_out,batch,l);
+        e.queue().enqueueNDRangeKernel(kernel_,cl::NullRange,g,l,e.events(),e.event("quantized_conv"));
+    }
+
+    void QuantizedConvolution2D::forward_cpu(Tensor &in,Tensor &out,Tensor &W,Tensor &W_scale,Tensor *bias,Tensor &ws)
+    {
+        int batch = in.shape()[0];
+        int groups = config_.groups;
+        int group_in  = config_.channels_in / groups;
+        int group_out = config_.channels_out / groups;
+        int in_h = in.shape()[2], in_w = in.shape()[3];
+        int out_h = out.shape()[2], out_w = out.shape()[3];
+        int pixels = out_h * out_w;
+        int kernel_size = group_in * config_.kernel[0] * config_.kernel[1];
+        Shape group_in_shape(1,group_in,in_h,in_w);
+        Shape group_out_shape(1,group_out,out_h,out_w);
+
+        int8_t *x_base = in.data<int8_t>();
+        int8_t *y_base = out.data<int8_t>();
+        int8_t *w_base = W.data<int8_t>();
+        float *scales = W_scale.data<float>();
+        float *bias_base = bias ? bias->data<float>() : nullptr;
+        int8_t *cols = static_cast<int8_t *>(ws.host_data());
+        float inv_out_scale = 1.0f / config_.output_scale;
+        // pixels processed at once, keeps im2col rows in cache while going over channels
+        int const tile = 64;
+
+        for(int b=0;b<batch;b++) {
+            for(int g=0;g<groups;g++) {
+                int8_t *x = x_base + (size_t(b) * config_.channels_in + g * group_in) * in_h * in_w;
+                int8_t *y = y_base + (size_t(b) * config_.channels_out + g * group_out) * pixels;
+                // cols is [pixels,kernel_size] matrix
+                im2col_cpu(group_in_shape,group_out_shape,x,cols,config_);
+                ctx_.thread_pool().parallel_for(group_out,[&](size_t begin,size_t end,int) {
+                    float values[tile];
+                    for(int p0=0;p0<pixels;p0+=tile) {
+                        int n = std::min(tile,pixels - p0);
+                        for(int m=begin;m<int(end);m++) {
+                            int oc = g * group_out + m;
+                            int8_t const *w = w_base + size_t(oc) * kernel_size;
+                            float scale = config_.input_scale * scales[oc];
+                            float bias_val = bias_base ? bias_base[oc] : 0.0f;
+                            for(int i=0;i<n;i++) {
+                                int8_t const *col = cols + size_t(p0 + i) * kernel_size;
+                                int acc = 0;
+                                for(int k=0;k<kernel_size;k++)
+                                    acc += int(w[k]) * int(col[k]);
+                                values[i] = acc * scale + bias_val;
+                            }
+                            cpu::apply_activation(values,n,config_.activation);
+                            int8_t *tgt = y + size_t(m) * pixels + p0;
+                            for(int i=0;i<n;i++)
+                                tgt[i] = requantize(values[i] * inv_out_scale);
+                        }
+                    }
+                });
+            }
+        }
+    }
+
+    QuantizedInnerProductConfig QuantizedInnerProductConfig::from_json(json::value const &v)
+    {
+        QuantizedInnerProductConfig cfg;
+        static_cast<InnerProductConfig &>(cfg) = InnerProductConfig::from_json(v);
+        cfg.input_scale = v.get("input_scale",cfg.input_scale);
+        cfg.output_scale = v.get("output_scale",cfg.output_scale);
+        return cfg;
+    }
+
+    QuantizedInnerProduct::QuantizedInnerProduct(Context &ctx,QuantizedInnerProductConfig const &config) :
+        Operator(ctx),
+        config_(config)
+    {
+        DLPRIM_CHECK(config_.outputs > 0);
+        check_scale(config_.input_scale);
+        check_scale(config_.output_scale);
+    }
+    QuantizedInnerProduct::~QuantizedInnerProduct()
+    {
+    }
+
+    void QuantizedInnerProduct::setup(std::vector<TensorSpecs> const &in,std::vector<TensorSpecs> &out,std::vector<TensorSpecs> &params,size_t &ws)
+    {
+        DLPRIM_CHECK(in.size() == 1);
+        DLPRIM_CHECK(in[0].dtype() == int8_data);
+        DLPRIM_CHECK(in[0].shape().size() >= 2);
+        if(config_.inputs == -1)
+            config_.inputs = in[0].shape().size_no_batch();
+        else
+            DLPRIM_CHECK(config_.inputs == int(in[0].shape().size_no_batch()));
+        out.assign({TensorSpecs(Shape(in[0].shape()[0],config_.outputs),int8_data)});
+        params.push_back(TensorSpecs(Shape(config_.outputs,config_.inputs),int8_data,false));
+        params.push_back(TensorSpecs(Shape(config_.outputs),float_data,false));
+        if(config_.bias)
+            params.push_back(TensorSpecs(Shape(config_.outputs),float_data,false));
+        ws = 0;
+        if(ctx_.is_cpu_context())
+            return;
+        cl::Program const &prog = gpu::Cache::instance().get_program(ctx_,"quantized",
+                                            "BIAS",int(config_.bias),
+                                            "ACTIVATION",int(config_.activation));
+        kernel_ = cl::Kernel(prog,"ip");
+    }
+
+    void QuantizedInnerProduct::reshape(std::vector<Shape> const &in,std::vector<Shape> &out,size_t &ws)
+    {
+        DLPRIM_CHECK(in.size() == 1);
+        DLPRIM_CHECK(int(in[0].size_no_batch()) == config_.inputs);
+        out.assign({Shape(in[0][0],config_.outputs)});
+        ws = 0;
+    }
+
+    void QuantizedInnerProduct::forward(std::vector<Tensor> &input,std::vector<Tensor> &output,std::vector<Tensor> &parameters,
+                                        Tensor &,ExecutionContext const &e)
+    {
+        DLPRIM_CHECK(input.size() == 1 && output.size() == 1);
+        DLPRIM_CHECK(input[0].dtype() == int8_data);
+        DLPRIM_CHECK(int(input[0].shape().size_no_batch()) == config_.inputs);
+        DLPRIM_CHECK(output[0].shape() == Shape(input[0].shape()[0],config_.outputs));
+        DLPRIM_CHECK(parameters.size() == 2u + unsigned(config_.bias));
+        Tensor *bias = config_.bias ? &parameters[2] : nullptr;
+        if(ctx_.is_cpu_context())
+            forward_cpu(input[0],output[0],parameters[0],parameters[1],bias);
+        else
+            forward_gpu(input[0],output[0],parameters[0],parameters[1],bias,e);
+    }
+
+    void QuantizedInnerProduct::forward_gpu(Tensor &in,Tensor &out,Tensor &W,Tensor &W_scale,Tensor *bias,ExecutionContext const &e)
+    {
+        int batch = in.shape()[0];
+        int p = 0;
+        kernel_.setArg(p++,batch);
+        kernel_.setArg(p++,config_.inputs);
+        kernel_.setArg(p++,config_.outputs);
+        in.set_arg(kernel_,p);
+        W.set_arg(kernel_,p);
+        W_scale.set_arg(kernel_,p);
+        if(bias)
+            bias->set_arg(kernel_,p);
+        out.set_arg(kernel_,p);
+        kernel_.setArg(p++,config_.input_scale);
+        kernel_.setArg(p++,1.0f / config_.output_scale);
+        cl::NDRange l(64,1);
+        cl::NDRange g = gpu::round_range(config_.outputs,batch,l);
+        e.queue().enqueueNDRangeKernel(kernel_,cl::NullRange,g,l,e.events(),e.event("quantized_ip"));
+    }
+
+    void QuantizedInnerProduct::forward_cpu(Tensor &in,Tensor &out,Tensor &W,Tensor &W_scale,Tensor *bias)
+    {
+        int batch = in.shape()[0];
+        int inputs = config_.inputs;
+        int outputs = config_.outputs;
+        int8_t *x_base = in.data<int8_t>();
+        int8_t *y_base = out.data<int8_t>();
+        int8_t *w_base = W.data<int8_t>();
+        float *scales = W_scale.data<float>();
+        float *bias_base = bias ? bias->data<float>() : nullptr;
+        float inv_out_scale = 1.0f / config_.output_scale;
+        ctx_.thread_pool().parallel_for(outputs,[&](size_t begin,size_t end,int) {
+            for(int b=0;b<batch;b++) {
+                int8_t const *x = x_base + size_t(b) * inputs;
+                for(int o=begin;o<int(end);o++) {
+                    int8_t const *w = w_base + size_t(o) * inputs;
+                    int acc = 0;
+                    for(int i=0;i<inputs;i++)
+                        acc += int(x[i]) * int(w[i]);
+                    float v = acc * (config_.input_scale * scales[o]) + (bias_base ? bias_base[o] : 0.0f);
+                    cpu::apply_activation(&v,1,config_.activation);
+                    y_base[size_t(b) * outputs + o] = requantize(v * inv_out_scale);
+                }
+            }
+        });
+    }
+
+    QuantizedPooling2D::QuantizedPooling2D(Context &ctx,Pooling2DConfig const &config) :
+        Operator(ctx),
+        config_(config)
+    {
+        DLPRIM_CHECK(config_.kernel[0] > 0 && config_.kernel[1] > 0);
+        DLPRIM_CHECK(config_.stride[0] > 0 && config_.stride[1] > 0);
+        DLPRIM_CHECK(config_.pad[0] >= 0 && config_.pad[1] >= 0);
+        DLPRIM_CHECK(config_.max <= config_.mode  && config_.mode <= config_.avg);
+    }
+    QuantizedPooling2D::~QuantizedPooling2D()
+    {
+    }
+
+    Shape QuantizedPooling2D::calc_shape(Shape const &ins)
+    {
+        DLPRIM_CHECK(ins.size() == 4);
+        int oh = core::calc_pooling_output_size(ins[2],config_.kernel[0],config_.pad[0],config_.stride[0],config_.ceil_mode);
+        int ow = core::calc_pooling_output_size(ins[3],config_.kernel[1],config_.pad[1],config_.stride[1],config_.ceil_mode);
+        return Shape(ins[0],ins[1],oh,ow);
+    }
+
+    void QuantizedPooling2D::setup(std::vector<TensorSpecs> const &in,std::vector<TensorSpecs> &out,std::vector<TensorSpecs> &p,size_t &ws)
+    {
+        DLPRIM_CHECK(in.size() == 1);
+        DLPRIM_CHECK(in[0].dtype() == int8_data);
+        out.assign({TensorSpecs(calc_shape(in[0].shape()),int8_data)});
+        p.clear();
+        ws = 0;
+        if(ctx_.is_cpu_context())
+            return;
+        cl::Program const &prog = gpu::Cache::instance().get_program(ctx_,"quantized",
+                                            "KERNEL_H",config_.kernel[0],
+                                            "KERNEL_W",config_.kernel[1],
+                                            "STRIDE_H",config_.stride[0],
+                                            "STRIDE_W",config_.stride[1],
+                                            "PAD_H",config_.pad[0],
+                                            "PAD_W",config_.pad[1],
+                                            "POOL_MODE",int(config_.mode),
+                                            "COUNT_INCLUDE_PAD",int(config_.count_include_pad));
+        kernel_ = cl::Kernel(prog,"pooling");
+    }
+
+    void QuantizedPooling2D::reshape(std::vector<Shape> const &in,std::vector<Shape> &out,size_t &ws)
+    {
+        DLPRIM_CHECK(in.size() == 1);
+        out.assign({calc_shape(in[0])});
+        ws = 0;
+    }
+
+    void QuantizedPooling2D::forward(std::vector<Tensor> &input,std::vector<Tensor> &output,std::vector<Tensor> &,Tensor &,ExecutionContext const &e)
+    {
+        DLPRIM_CHECK(input.size() == 1 && output.size() == 1);
+        DLPRIM_CHECK(input[0].dtype() == int8_data);
+        DLPRIM_CHECK(output[0].shape() == calc_shape(input[0].shape()));
+        if(ctx_.is_cpu_context())
+            forward_cpu(input[0],output[0]);
+        else
+            forward_gpu(input[0],output[0],e);
+    }
+
+    void QuantizedPooling2D::forward_gpu(Tensor &in,Tensor &out,ExecutionContext const &e)
+    {
+        int bc = in.shape()[0] * in.shape()[1];
+        int out_h = out.shape()[2];
+        int out_w = out.shape()[3];
+        int p = 0;
+        kernel_.setArg(p++,bc);
+        kernel_.setArg(p++,int(in.shape()[2]));
+        kernel_.setArg(p++,int(in.shape()[3]));
+        kernel_.setArg(p++,out_h);
+        kernel_.setArg(p++,out_w);
+        in.set_arg(kernel_,p);
+        out.set_arg(kernel_,p);
+        cl::NDRange l(64,1);
+        cl::NDRange g = gpu::round_range(out_h * out_w,bc,l);
+        e.queue().enqueueNDRangeKernel(kernel_,cl::NullRange,g,l,e.events(),e.event("quantized_pooling"));
+    }
+
+    void QuantizedPooling2D::forward_cpu(Tensor &in,Tensor &out)
+    {
+        int bc = in.shape()[0] * in.shape()[1];
+        int in_h = in.shape()[2], in_w = in.shape()[3];
+        int out_h = out.shape()[2], out_w = out.shape()[3];
+        int8_t *src_base = in.data<int8_t>();
+        int8_t *tgt_base = out.data<int8_t>();
+        ctx_.thread_pool().parallel_for(bc,[&](size_t begin,size_t end,int) {
+            for(int plane = begin;plane < int(end);plane++) {
+                int8_t const *src = src_base + size_t(plane) * in_h * in_w;
+                int8_t *tgt = tgt_base + size_t(plane) * out_h * out_w;
+                for(int out_r=0;out_r<out_h;out_r++) {
+                    for(int out_c=0;out_c<out_w;out_c++) {
+                        int row0 = out_r * config_.stride[0] - config_.pad[0];
+                        int col0 = out_c * config_.stride[1] - config_.pad[1];
+                        int row1 = row0 + config_.kernel[0];
+                        int col1 = col0 + config_.kernel[1];
+                        int count_with_pad = (std::min(row1,in_h + config_.pad[0]) - std::max(-config_.pad[0],row0))
+                                           * (std::min(col1,in_w + config_.pad[1]) - std::max(-config_.pad[1],col0));
+                        row0 = std::max(0,row0);
+                        col0 = std::max(0,col0);
+                        row1 = std::min(row1,in_h);
+                        col1 = std::min(col1,in_w);
+                        int8_t res;
+                        if(config_.mode == PoolingBase::max) {
+                            int val = -128;
+                            for(int r=row0;r<row1;r++)
+                                for(int c=col0;c<col1;c++)
+                                    val = std::max(val,int(src[r*in_w + c]));
+                            res = val;
+                        }
+                        else {
+                            int val = 0;
+                            for(int r=row0;r<row1;r++)
+                                for(int c=col0;c<col1;c++)
+                                    val += src[r*in_w + c];
+                            int count = config_.count_include_pad ? count_with_pad : (row1 - row0) * (col1 - col0);
+                            res = requantize(float(val) / count);
+                        }
+                        tgt[out_r * out_w + out_c] = res;
+                    }
+                }
+            }
+        });
+    }
+
+    QuantizedActivationConfig QuantizedActivationConfig::from_json(json::value const &v)
+    {
+        QuantizedActivationConfig cfg;
+        static_cast<ActivationConfig &>(cfg) = ActivationConfig::from_json(v);
+        cfg.input_scale = v.get("input_scale",cfg.input_scale);
+        cfg.output_scale = v.get("output_scale",cfg.output_scale);
+        return cfg;
+    }
+
+    QuantizedActivation::QuantizedActivation(Context &ctx,QuantizedActivationConfig const &config) :
+        Operator(ctx),
+        config_(config)
+    {
+        check_scale(config_.input_scale);
+        check_scale(config_.output_scale);
+        float inv_out_scale = 1.0f / config_.output_scale;
+        for(int i=0;i<256;i++) {
+            float v = (i - 128) * config_.input_scale;
+            cpu::apply_activation(&v,1,config_.activation);
+            table_[i] = requantize(v * inv_out_scale);
+        }
+    }
+    QuantizedActivation::~QuantizedActivation()
+    {
+    }
+
+    void QuantizedActivation::setup(std::vector<TensorSpecs> const &in,std::vector<TensorSpecs> &out,std::vector<TensorSpecs> &p,size_t &ws)
+    {
+        DLPRIM_CHECK(in.size() == 1);
+        DLPRIM_CHECK(in[0].dtype() == int8_data);
+        out = in;
+        p.clear();
+        ws = 0;
+        if(ctx_.is_cpu_context())
+            return;
+        cl::Program const &prog = gpu::Cache::instance().get_program(ctx_,"quantized",
+                                            "ACTIVATION",int(config_.activation));
+        kernel_ = cl::Kernel(prog,"activation");
+    }
+
+    void QuantizedActivation::reshape(std::vector<Shape> const &in,std::vector<Shape> &out,size_t &ws)
+    {
+        DLPRIM_CHECK(in.size() == 1);
+        out = in;
+        ws = 0;
+    }
+
+    void QuantizedActivation::forward(std::vector<Tensor> &input,std::vector<Tensor> &output,std::vector<Tensor> &,Tensor &,ExecutionContext const &e)
+    {
+        DLPRIM_CHECK(input.size() == 1 && output.size() == 1);
+        DLPRIM_CHECK(input[0].shape() == output[0].shape());
+        DLPRIM_CHECK(input[0].dtype() == int8_data);
+        if(ctx_.is_cpu_context()) {
+            int8_t *x = input[0].data<int8_t>();
+            int8_t *y = output[0].data<int8_t>();
+            ctx_.thread_pool().parallel_for(input[0].shape().total_size(),[&](size_t begin,size_t end,int) {
+                for(size_t i=begin;i<end;i++)
+                    y[i] = table_[x[i] + 128];
+            });
+        }
+        else {
+            enqueue_pointwise(kernel_,input[0],output[0],{config_.input_scale,1.0f / config_.output_scale},e,"quantized_activation");
+        }
+    }
+
+} // namespace
@@ -12,6 +12,7 @@
 #include <dlprim/json.hpp>
 #include <dlprim/utils/json_helpers.hpp>
 #include <math.h>
+#include <dlprim/cpu/thread_pool.hpp>
 #include <my_cblas.hpp>
 
 namespace dlprim {
@@ -194,31 +195,33 @@ void Softmax::forward_cpu(Tensor &input,Tensor &output)
     float *in0 = input.data<float>();
     float *out0 = output.data<float>();
     int step = in_shape[2];
-    for(int i=0;i<int(in_shape[0]);i++) {
-        for(int k=0;k<int(in_shape[2]);k++) {
-            int offset = i*in_shape[1]*in_shape[2] + k;
-            float *in = in0   + offset;
-            float *out = out0 + offset;
-            float maxv = in[0];
-            for(int j=1;j<int(in_shape[1]);j++)
-                maxv = std::max(in[j*step],maxv);
-            float sum = 0.0f;
-            if(cfg_.log) {
-                for(int j=0;j<int(in_shape[1]);j++) 
-                    sum += expf(in[j*step] - maxv);
-                float factor = -logf(sum);
-                for(int j=0;j<int(in_shape[1]);j++) 
-                    out[j*step] = in[j*step] - maxv + factor;
-            }
-            else {
-                for(int j=0;j<int(in_shape[1]);j++) 
-                    sum += out[j*step] = expf(in[j*step] - maxv);
-                float factor = 1.0f/sum;
-                for(int j=0;j<int(in_shape[1]);j++) 
-                    out[j*step] *= factor;
+    ctx_.thread_pool().parallel_for(in_shape[0],[&](size_t begin,size_t end,int) {
+        for(int i=begin;i<int(end);i++) {
+            for(int k=0;k<int(in_shape[2]);k++) {
+                int offset = i*in_shape[1]*in_shape[2] + k;
+                float *in = in0   + offset;
+                float *out = out0 + offset;
+                float maxv = in[0];
+                for(int j=1;j<int(in_shape[1]);j++)
+                    maxv = std::max(in[j*step],maxv);
+                float sum = 0.0f;
+                if(cfg_.log) {
+                    for(int j=0;j<int(in_shape[1]);j++) 
+                        sum += expf(in[j*step] - maxv);
+                    float factor = -logf(sum);
+                    for(int j=0;j<int(in_shape[1]);j++) 
+                        out[j*step] = in[j*step] - maxv + factor;
+                }
+                else {
+                    for(int j=0;j<int(in_shape[1]);j++) 
+                        sum += out[j*step] = expf(in[j*step] - maxv);
+                    float factor = 1.0f/sum;
+                    for(int j=0;j<int(in_shape[1]);j++) 
+                        out[j*step] *= factor;
+                }
             }
         }
-    }
+    });
 }
 
 void SoftmaxWithLoss::forward_gpu_loss(Tensor &input,Tensor &label, Tensor &output, ExecutionContext const &ctx)
@@ -289,36 +292,38 @@ void Softmax::backward_cpu(Tensor &tdx,Tensor &ty,Tensor &tdy,float accum)
     else
         cblas_sscal(tdx.shape().total_size(),accum,dx,1);
 
-    if(cfg_.log) {
-        for(int b=0;b<batch;b++) {
-            for(int b2=0;b2<step;b2++) {
-                float sum_dy = 0;
-                for(int c=0;c<chan;c++) {
-                    int pos = (b*chan+c)*step + b2;
-                    sum_dy += dy[pos];
-                }
-                for(int c=0;c<chan;c++) {
-                    int pos = (b*chan+c)*step + b2;
-                    dx[pos] += dy[pos] - expf(y[pos]) * sum_dy;
+    ctx_.thread_pool().parallel_for(batch,[&](size_t begin,size_t end,int) {
+        if(cfg_.log) {
+            for(int b=begin;b<int(end);b++) {
+                for(int b2=0;b2<step;b2++) {
+                    float sum_dy = 0;
+                    for(int c=0;c<chan;c++) {
+                        int pos = (b*chan+c)*step + b2;
+                        sum_dy += dy[pos];
+                    }
+                    for(int c=0;c<chan;c++) {
+                        int pos = (b*chan+c)*step + b2;
+                        dx[pos] += dy[pos] - expf(y[pos]) * sum_dy;
+                    }
                 }
             }
         }
-    }
-    else {
-        for(int b=0;b<batch;b++) {
-            for(int b2=0;b2<step;b2++) {
-                float sum_ydy = 0;
-                for(int c=0;c<chan;c++) {
-                    int pos = (b*chan+c)*step + b2;
-                    sum_ydy += y[pos] * dy[pos];
-                }
-                for(int c=0;c<chan;c++) {
-                    int pos = (b*chan+c)*step + b2;
-                    dx[pos] += (dy[pos] - sum_ydy) * y[pos];
+        else {
+            for(int b=begin;b<int(end);b++) {
+                for(int b2=0;b2<step;b2++) {
+                    float sum_ydy = 0;
+                    for(int c=0;c<chan;c++) {
+                        int pos = (b*chan+c)*step + b2;
+                        sum_ydy += y[pos] * dy[pos];
+                    }
+                    for(int c=0;c<chan;c++) {
+                        int pos = (b*chan+c)*step + b2;
+                        dx[pos] += (dy[pos] - sum_ydy) * y[pos];
+                    }
                 }
             }
         }
-    }
+    });
 }
 
 void Softmax::backward( std::vector<TensorAndGradient> &input,
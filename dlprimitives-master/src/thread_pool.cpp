@@ -0,0 +1,143 @@
+///////////////////////////////////////////////////////////////////////////////
+///
+/// Copyright (c) 2021-2022 Artyom Beilis <artyomtnk@yahoo.com>
+///
+/// MIT License, see LICENSE.TXT
+///
+///////////////////////////////////////////////////////////////////////////////
+#include <dlprim/cpu/thread_pool.hpp>
+#include <algorithm>
+#include <cstdlib>
+
+namespace dlprim {
+namespace cpu {
+    namespace {
+        thread_local bool inside_parallel_for = false;
+
+        int default_threads()
+        {
+            char const *env = getenv("DLPRIM_CPU_THREADS");
+            if(env && atoi(env) > 0)
+                return atoi(env);
+            int n = std::thread::hardware_concurrency();
+            return std::max(1,n);
+        }
+    }
+
+    ThreadPool::ThreadPool(int threads) :
+        size_(threads > 0 ? threads : default_threads()),
+        generation_(0),
+        shutdown_(false),
+        chunks_(0),
+        running_(0),
+        n_(0),
+        job_(nullptr)
+    {
+    }
+
+    ThreadPool::~ThreadPool()
+    {
+        stop();
+    }
+
+    void ThreadPool::resize(int threads)
+    {
+        std::unique_lock<std::mutex> call_guard(call_lock_);
+        stop();
+        size_ = threads > 0 ? threads : default_threads();
+    }
+
+    void ThreadPool::start()
+    {
+        shutdown_ = false;
+        for(int i=1;i<size_;i++)
+            threads_.push_back(std::thread(&ThreadPool::worker,this,i,generation_));
+    }
+
+    void ThreadPool::stop()
+    {
+        if(threads_.empty())
+            return;
+        {
+            std::unique_lock<std::mutex> guard(lock_);
+            shutdown_ = true;
+        }
+        job_ready_.notify_all();
+        for(auto &t : threads_)
+            t.join();
+        threads_.clear();
+    }
+
+    void ThreadPool::run_chunk(int id)
+    {
+        size_t begin = n_ * id / chunks_;
+        size_t end   = n_ * (id + 1) / chunks_;
+        try {
+            inside_parallel_for = true;
+            (*job_)(begin,end,id);
+            inside_parallel_for = false;
+        }
+        catch(...) {
+            inside_parallel_for = false;
+            std::unique_lock<std::mutex> guard(lock_);
+            if(!error_)
+                error_ = std::current_exception();
+        }
+    }
+
+    void ThreadPool::worker(int id,long long seen)
+    {
+        std::unique_lock<std::mutex> guard(lock_);
+        for(;;) {
+            while(!shutdown_ && generation_ == seen)
+                job_ready_.wait(guard);
+            if(shutdown_)
+                return;
+            seen = generation_;
+            if(id >= chunks_)
+                continue;
+            guard.unlock();
+            run_chunk(id);
+            guard.lock();
+            if(--running_ == 0)
+                job_done_.notify_one();
+        }
+    }
+
+    void ThreadPool::parallel_for(size_t n,std::function<void(size_t,size_t,int)> const &f)
+    {
+        if(n == 0)
+            return;
+        if(size_ <= 1 || n == 1 || inside_parallel_for) {
+            f(0,n,0);
+            return;
+        }
+        std::unique_lock<std::mutex> call_guard(call_lock_);
+        if(threads_.empty())
+            start();
+        {
+            std::unique_lock<std::mutex> guard(lock_);
+            job_ = &f;
+            n_ = n;
+            chunks_ = int(std::min<size_t>(n,size_));
+            running_ = chunks_ - 1;
+            error_ = nullptr;
+            generation_++;
+        }
+        job_ready_.notify_all();
+        run_chunk(0);
+        std::exception_ptr error;
+        {
+            std::unique_lock<std::mutex> guard(lock_);
+            while(running_ > 0)
+                job_done_.wait(guard);
+            job_ = nullptr;
+            error = error_;
+            error_ = nullptr;
+        }
+        if(error)
+            std::rethrow_exception(error);
+    }
+
+} // cpu
+} // dlprim
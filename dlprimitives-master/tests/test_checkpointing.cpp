@@ -0,0 +1,176 @@
+///////////////////////////////////////////////////////////////////////////////
+///
+/// Copyright (c) 2021-2022 Artyom Beilis <artyomtnk@yahoo.com>
+///
+/// MIT License, see LICENSE.TXT
+///
+///////////////////////////////////////////////////////////////////////////////
+#include <dlprim/net.hpp>
+#include <dlprim/json.hpp>
+#include <dlprim/ops/initialization.hpp>
+#include "test.hpp"
+#include <iostream>
+#include <random>
+#include <cstring>
+
+namespace dp = dlprim;
+using dp::Tensor;
+
+static char const *net_json = R"xx(
+{
+    "inputs" : [ { "name" : "data", "shape" : [4,3,12,12] }, { "name" : "label", "shape" : [4,1] } ],
+    "outputs" : [ "loss" ],
+    "operators" : [
+        { "name" : "conv1", "type" : "Convolution2D", "inputs" : ["data"], "outputs" : ["c1"],
+          "options" : { "channels_out" : 8, "kernel" : 3, "pad" : 1, "bias" : false } },
+        { "name" : "bn1", "type" : "BatchNorm", "inputs" : ["c1"], "outputs" : ["c1"] },
+        { "name" : "relu1", "type" : "Activation", "inputs" : ["c1"], "outputs" : ["c1"],
+          "options" : { "activation" : "relu" } },
+        { "name" : "conv2", "type" : "Convolution2D", "inputs" : ["c1"], "outputs" : ["c2"],
+          "options" : { "channels_out" : 8, "kernel" : 3, "pad" : 1, "bias" : false } },
+        { "name" : "bn2", "type" : "BatchNorm", "inputs" : ["c2"], "outputs" : ["b2"] },
+        { "name" : "relu2", "type" : "Activation", "inputs" : ["b2"], "outputs" : ["b2"],
+          "options" : { "activation" : "relu" } },
+        { "name" : "add", "type" : "Elementwise", "inputs" : ["b2","c1"], "outputs" : ["s"],
+          "options" : { "operation" : "sum" } },
+        { "name" : "pool", "type" : "Pooling2D", "inputs" : ["s"], "outputs" : ["p"],
+          "options" : { "kernel" : 2, "stride" : 2 } },
+        { "name" : "conv3", "type" : "Convolution2D", "inputs" : ["p"], "outputs" : ["c3"],
+          "options" : { "channels_out" : 16, "kernel" : 3, "pad" : 1, "activation" : "relu" } },
+        { "name" : "gp", "type" : "GlobalPooling", "inputs" : ["c3"], "outputs" : ["g"],
+          "options" : { "mode" : "avg" } },
+        { "name" : "flatten", "type" : "Flatten", "inputs" : ["g"], "outputs" : ["f"] },
+        { "name" : "ip", "type" : "InnerProduct", "inputs" : ["f"], "outputs" : ["fc"],
+          "options" : { "outputs" : 5 } },
+        { "name" : "loss", "type" : "SoftmaxWithLoss", "inputs" : ["fc","label"], "outputs" : ["loss"] }
+    ]
+}
+)xx";
+
+void make_net(dp::Net &net,dp::ExecutionContext const &q)
+{
+    dp::json::value v;
+    char const *begin = net_json;
+    char const *end = net_json + strlen(net_json);
+    if(!v.load(begin,end,true))
+        throw std::runtime_error("Failed to parse net");
+    net.mode(dp::CalculationsMode::train);
+    net.load_from_json(v);
+    net.setup();
+    net.initialize_parameters(q);
+
+    std::mt19937 gen(42);
+    std::uniform_real_distribution<float> weights(-0.5f,0.5f);
+    std::uniform_real_distribution<float> stats(0.5f,1.5f);
+    for(auto &pr : net.params()) {
+        bool bn = pr.first.compare(0,2,"bn") == 0;
+        float *p = pr.second.data<float>();
+        size_t n = pr.second.shape().total_size();
+        for(size_t i=0;i<n;i++)
+            p[i] = bn ? stats(gen) : weights(gen);
+    }
+    net.copy_parameters_to_device();
+
+    Tensor data = net.tensor("data");
+    Tensor label = net.tensor("label");
+    std::uniform_real_distribution<float> dist(-1.0f,1.0f);
+    for(size_t i=0;i<data.shape().total_size();i++)
+        data.data<float>()[i] = dist(gen);
+    for(size_t i=0;i<label.shape().total_size();i++)
+        label.data<float>()[i] = float(i % 5);
+    data.to_device(q);
+    label.to_device(q);
+}
+
+void train_step(dp::Net &net,dp::ExecutionContext const &q)
+{
+    for(auto &pr : net.param_diffs())
+        dp::set_to_zero(pr.second,q);
+    net.forward(q);
+    net.backward(q);
+}
+
+void compare(dp::Net &ref,dp::Net &net,dp::ExecutionContext const &q)
+{
+    Tensor ref_loss = ref.tensor("loss"), loss = net.tensor("loss");
+    ref_loss.to_host(q);
+    loss.to_host(q);
+    TESTEQF(ref_loss.data<float>()[0],loss.data<float>()[0],1e-5f);
+    for(int diffs=0;diffs<2;diffs++) {
+        for(auto &pr : (diffs ? ref.param_diffs() : ref.params())) {
+            Tensor a = pr.second;
+            Tensor b = diffs ? net.param_diff(pr.first) : net.param(pr.first);
+            a.to_host(q);
+            b.to_host(q);
+            for(size_t i=0;i<a.shape().total_size();i++)
+                TESTEQF(a.data<float>()[i],b.data<float>()[i],1e-4f);
+        }
+    }
+}
+
+int main(int argc,char **argv)
+{
+    if(argc!=2) {
+        std::cerr << "test_checkpointing device" << std::endl;
+        return 1;
+    }
+    try {
+        dp::Context ctx(argv[1]);
+        std::cout << "Testing for " << ctx.name() << std::endl;
+        dp::ExecutionContext q = ctx.make_execution_context();
+
+        dp::Net ref(ctx);
+        make_net(ref,q);
+        TEST(ref.activation_checkpoints().empty());
+
+        std::cout << "Test planner" << std::endl;
+        dp::Net least(ctx);
+        least.activation_checkpointing(0);
+        make_net(least,q);
+        TEST(!least.activation_checkpoints().empty());
+        TEST(least.activation_memory() < ref.activation_memory());
+        std::cout << "- memory " << ref.activation_memory() << " -> " << least.activation_memory() << " with checkpoints:";
+        for(auto const &name : least.activation_checkpoints())
+            std::cout << " " << name;
+        std::cout << std::endl;
+
+        dp::Net unlimited(ctx);
+        unlimited.activation_checkpointing(ref.activation_memory());
+        make_net(unlimited,q);
+        TEST(unlimited.activation_checkpoints().empty());
+        TESTEQ(unlimited.activation_memory(),ref.activation_memory());
+
+        std::cout << "Test explicit checkpoints" << std::endl;
+        dp::Net given(ctx);
+        given.activation_checkpointing(std::vector<std::string>{"conv3","conv2"});
+        make_net(given,q);
+        TEST(given.activation_checkpoints() == std::vector<std::string>({"conv2","conv3"}));
+        TEST(given.activation_memory() < ref.activation_memory());
+
+        dp::Net invalid(ctx);
+        invalid.activation_checkpointing(std::vector<std::string>{"relu1"}); // c1 is modified in-place across it
+        bool thrown = false;
+        try {
+            make_net(invalid,q);
+        }
+        catch(dp::ValidationError const &) {
+            thrown = true;
+        }
+        TEST(thrown);
+
+        std::cout << "Test gradients" << std::endl;
+        for(int step=0;step<2;step++) {
+            train_step(ref,q);
+            train_step(least,q);
+            train_step(given,q);
+            compare(ref,least,q);
+            compare(ref,given,q);
+        }
+    }
+    catch(std::exception const &e) {
+        std::cerr << "Failed: " << e.what() << std::endl;
+        return 1;
+    }
+    std::cout << "Ok" << std::endl;
+    return 0;
+}
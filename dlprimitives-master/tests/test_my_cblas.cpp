@@ -0,0 +1,112 @@
+///////////////////////////////////////////////////////////////////////////////
+///
+/// Copyright (c) 2021-2022 Artyom Beilis <artyomtnk@yahoo.com>
+///
+/// MIT License, see LICENSE.TXT
+///
+///////////////////////////////////////////////////////////////////////////////
+#include <my_cblas.hpp>
+#include "test.hpp"
+#include <iostream>
+#include <random>
+#include <vector>
+#include <cmath>
+#include <stdlib.h>
+
+namespace dp = dlprim;
+
+void ref_sgemm(bool ta,bool tb,int M,int N,int K,float alpha,float const *A,int lda,float const *B,int ldb,float beta,float *C,int ldc)
+{
+    for(int r=0;r<M;r++) {
+        for(int c=0;c<N;c++) {
+            double sum = 0;
+            for(int k=0;k<K;k++) {
+                float a = ta ? A[k*lda + r] : A[r*lda + k];
+                float b = tb ? B[c*ldb + k] : B[k*ldb + c];
+                sum += double(a) * b;
+            }
+            float prev = beta == 0 ? 0 : beta * C[r*ldc + c];
+            C[r*ldc + c] = prev + alpha * float(sum);
+        }
+    }
+}
+
+void test_case(std::mt19937 &gen,bool ta,bool tb,int M,int N,int K,float alpha,float beta)
+{
+    std::uniform_real_distribution<float> dist(-1.0f,1.0f);
+    // padded leading dimensions to test strides
+    int lda = (ta ? M : K) + 3;
+    int ldb = (tb ? K : N) + 5;
+    int ldc = N + 2;
+    std::vector<float> A(size_t(ta ? K : M) * lda),B(size_t(tb ? N : K) * ldb),C(size_t(M) * ldc);
+    for(float &v : A) v = dist(gen);
+    for(float &v : B) v = dist(gen);
+    for(float &v : C) v = dist(gen);
+    std::vector<float> ref = C;
+    dp::cblas_sgemm(dp::CblasRowMajor,ta ? dp::CblasTrans : dp::CblasNoTrans,tb ? dp::CblasTrans : dp::CblasNoTrans,
+                    M,N,K,alpha,A.data(),lda,B.data(),ldb,beta,C.data(),ldc);
+    ref_sgemm(ta,tb,M,N,K,alpha,A.data(),lda,B.data(),ldb,beta,ref.data(),ldc);
+    float eps = 1e-5f * (K + 1);
+    for(int r=0;r<M;r++) {
+        for(int c=0;c<ldc;c++) {
+            float v = C[r*ldc+c];
+            float v_ref = ref[r*ldc+c];
+            if(c >= N) {
+                TEST(v == v_ref); // outside of C untouched
+                continue;
+            }
+            if(std::fabs(v - v_ref) > eps) {
+                std::cerr << "ta=" << ta << " tb=" << tb << " M=" << M << " N=" << N << " K=" << K
+                          << " at " << r << "," << c << ": " << v << "!=" << v_ref << std::endl;
+                TEST(!"Value mismatch");
+            }
+        }
+    }
+}
+
+int main(int argc,char **argv)
+{
+    if(argc > 2) {
+        std::cerr << "test_my_cblas [avx512|avx2|generic]" << std::endl;
+        return 1;
+    }
+    if(argc == 2) {
+        // kernel is selected on first call
+#ifdef _WIN32
+        _putenv_s("DLPRIM_BLAS_KERNEL",argv[1]);
+#else
+        setenv("DLPRIM_BLAS_KERNEL",argv[1],1);
+#endif
+    }
+    try {
+        std::mt19937 gen(12);
+        int const sizes[][3] = {
+            {1,1,1},
+            {5,3,7},
+            {6,16,8},
+            {7,33,13},
+            {64,64,64},
+            {150,70,300},     // crosses MC and KC
+            {13,3100,5},      // crosses NC
+            {3,200,600},
+        };
+        for(auto const &s : sizes) {
+            std::cout << "Test " << s[0] << "x" << s[1] << "x" << s[2] << std::endl;
+            for(int ta=0;ta<2;ta++) {
+                for(int tb=0;tb<2;tb++) {
+                    test_case(gen,ta,tb,s[0],s[1],s[2],1.0f,0.0f);
+                    test_case(gen,ta,tb,s[0],s[1],s[2],0.5f,1.0f);
+                    test_case(gen,ta,tb,s[0],s[1],s[2],-2.0f,0.25f);
+                }
+            }
+        }
+        std::cout << "Test alpha=0" << std::endl;
+        test_case(gen,false,false,9,9,9,0.0f,0.5f);
+    }
+    catch(std::exception const &e) {
+        std::cerr << "Failed: " << e.what() << std::endl;
+        return 1;
+    }
+    std::cout << "Ok" << std::endl;
+    return 0;
+}
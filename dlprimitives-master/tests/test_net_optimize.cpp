@@ -0,0 +1,136 @@
+///////////////////////////////////////////////////////////////////////////////
+///
+/// Copyright (c) 2021-2022 Artyom Beilis <artyomtnk@yahoo.com>
+///
+/// MIT License, see LICENSE.TXT
+///
+///////////////////////////////////////////////////////////////////////////////
+#include <dlprim/net.hpp>
+#include <dlprim/json.hpp>
+#include "test.hpp"
+#include <iostream>
+#include <random>
+#include <cstring>
+
+namespace dp = dlprim;
+using dp::Tensor;
+
+static char const *net_json = R"xx(
+{
+    "inputs" : [ { "name" : "data", "shape" : [2,3,8,8] } ],
+    "outputs" : [ "fc" ],
+    "operators" : [
+        { "name" : "conv1", "type" : "Convolution2D", "inputs" : ["data"], "outputs" : ["c1"],
+          "options" : { "channels_out" : 4, "kernel" : 3, "pad" : 1, "bias" : false } },
+        { "name" : "bn1", "type" : "BatchNorm", "inputs" : ["c1"], "outputs" : ["c1"] },
+        { "name" : "relu1", "type" : "Activation", "inputs" : ["c1"], "outputs" : ["r1"],
+          "options" : { "activation" : "relu" } },
+        { "name" : "conv2", "type" : "Convolution2D", "inputs" : ["r1"], "outputs" : ["c2"],
+          "options" : { "channels_out" : 4, "kernel" : 3, "pad" : 1 } },
+        { "name" : "bn2", "type" : "BatchNorm", "inputs" : ["c2"], "outputs" : ["b2"],
+          "options" : { "affine" : false } },
+        { "name" : "add", "type" : "Elementwise", "inputs" : ["b2","r1"], "outputs" : ["s"],
+          "options" : { "operation" : "sum" } },
+        { "name" : "relu2", "type" : "Activation", "inputs" : ["s"], "outputs" : ["s2"],
+          "options" : { "activation" : "relu" } },
+        { "name" : "ident", "type" : "Activation", "inputs" : ["s2"], "outputs" : ["i"] },
+        { "name" : "ip", "type" : "InnerProduct", "inputs" : ["i"], "outputs" : ["fc"],
+          "options" : { "outputs" : 5 } }
+    ]
+}
+)xx";
+
+void make_net(dp::Net &net,bool optimize)
+{
+    dp::json::value v;
+    char const *begin = net_json;
+    char const *end = net_json + strlen(net_json);
+    if(!v.load(begin,end,true))
+        throw std::runtime_error("Failed to parse net");
+    net.optimize_graph(optimize);
+    net.load_from_json(v);
+    net.setup();
+}
+
+void set_parameters(dp::Net &net)
+{
+    std::mt19937 gen(42);
+    std::uniform_real_distribution<float> weights(-1.0f,1.0f);
+    std::uniform_real_distribution<float> stats(0.5f,1.5f); // positive variance
+    for(auto &pr : net.params()) {
+        bool bn = pr.first.compare(0,2,"bn") == 0;
+        float *p = pr.second.data<float>();
+        size_t n = pr.second.shape().total_size();
+        for(size_t i=0;i<n;i++)
+            p[i] = bn ? stats(gen) : weights(gen);
+    }
+    net.copy_parameters_to_device();
+}
+
+int main(int argc,char **argv)
+{
+    if(argc!=2) {
+        std::cerr << "test_net_optimize device" << std::endl;
+        return 1;
+    }
+    try {
+        dp::Context ctx(argv[1]);
+        std::cout << "Testing for " << ctx.name() << std::endl;
+        dp::ExecutionContext q = ctx.make_execution_context();
+
+        dp::Net ref(ctx);
+        dp::Net opt(ctx);
+        make_net(ref,false);
+        make_net(opt,true);
+
+        std::cout << "Test graph" << std::endl;
+        TESTEQ(ref.params().size(),opt.params().size());
+        TEST(ref.tensors().count("c1") == 1);
+        for(char const *name : {"c1","c2","s","s2"})
+            TEST(opt.tensors().count(name) == 0);
+        for(char const *name : {"r1","b2","i","fc"})
+            TEST(opt.tensors().count(name) == 1);
+
+        std::cout << "Test forward" << std::endl;
+        set_parameters(ref);
+        set_parameters(opt);
+        std::mt19937 gen(7);
+        std::uniform_real_distribution<float> dist(-1.0f,1.0f);
+        Tensor ref_data = ref.tensor("data");
+        Tensor opt_data = opt.tensor("data");
+        size_t size = ref_data.shape().total_size();
+        for(size_t i=0;i<size;i++)
+            ref_data.data<float>()[i] = opt_data.data<float>()[i] = dist(gen);
+        ref_data.to_device(q);
+        opt_data.to_device(q);
+        ref.forward(q);
+        opt.forward(q);
+        Tensor ref_out = ref.tensor("fc");
+        Tensor opt_out = opt.tensor("fc");
+        ref_out.to_host(q);
+        opt_out.to_host(q);
+        TESTEQ(ref_out.shape(),opt_out.shape());
+        for(size_t i=0;i<ref_out.shape().total_size();i++)
+            TESTEQF(ref_out.data<float>()[i],opt_out.data<float>()[i],1e-3f);
+
+        std::cout << "Test parameters reload" << std::endl;
+        for(auto &pr : opt.params()) {
+            if(pr.first.compare(0,3,"bn1") == 0)
+                ref.param(pr.first).data<float>()[0] = pr.second.data<float>()[0] = 2.0f;
+        }
+        ref.copy_parameters_to_device();
+        opt.copy_parameters_to_device();
+        ref.forward(q);
+        opt.forward(q);
+        ref_out.to_host(q);
+        opt_out.to_host(q);
+        for(size_t i=0;i<ref_out.shape().total_size();i++)
+            TESTEQF(ref_out.data<float>()[i],opt_out.data<float>()[i],1e-3f);
+    }
+    catch(std::exception const &e) {
+        std::cerr << "Failed: " << e.what() << std::endl;
+        return 1;
+    }
+    std::cout << "Ok" << std::endl;
+    return 0;
+}
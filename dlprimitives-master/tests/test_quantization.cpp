@@ -0,0 +1,249 @@
+///////////////////////////////////////////////////////////////////////////////
+///
+/// Copyright (c) 2021-2022 Artyom Beilis <artyomtnk@yahoo.com>
+///
+/// MIT License, see LICENSE.TXT
+///
+///////////////////////////////////////////////////////////////////////////////
+#include <dlprim/operator.hpp>
+#include <dlprim/operators.hpp>
+#include <dlprim/json.hpp>
+#include <dlprim/cpu/cpu_ops.hpp>
+#include "test.hpp"
+#include <iostream>
+#include <random>
+#include <cstring>
+#include <algorithm>
+
+namespace dp = dlprim;
+using dp::Tensor;
+using dp::Shape;
+
+std::mt19937 gen(11);
+
+int8_t sat(float v)
+{
+    v = std::nearbyint(v);
+    return int8_t(std::min(127.0f,std::max(-128.0f,v)));
+}
+
+Tensor random_int8(dp::Context &ctx,Shape s)
+{
+    std::uniform_int_distribution<int> dist(-128,127);
+    Tensor t(ctx,s,dp::int8_data);
+    for(size_t i=0;i<s.total_size();i++)
+        t.data<int8_t>()[i] = dist(gen);
+    return t;
+}
+
+Tensor random_float(dp::Context &ctx,Shape s,float low,float high)
+{
+    std::uniform_real_distribution<float> dist(low,high);
+    Tensor t(ctx,s);
+    for(size_t i=0;i<s.total_size();i++)
+        t.data<float>()[i] = dist(gen);
+    return t;
+}
+
+std::vector<Tensor> run(dp::Context &ctx,dp::ExecutionContext const &q,std::string const &type,char const *options,
+                        std::vector<Tensor> in,std::vector<Tensor> params = std::vector<Tensor>())
+{
+    dp::json::value v;
+    char const *end = options + strlen(options);
+    TEST(v.load(options,end,true));
+    std::unique_ptr<dp::Operator> op = dp::create_by_name(ctx,type,v);
+    std::vector<dp::TensorSpecs> in_specs,out_specs,param_specs;
+    for(auto &t : in) {
+        in_specs.push_back(t.specs());
+        t.to_device(q);
+    }
+    size_t ws_size = 0;
+    op->setup(in_specs,out_specs,param_specs,ws_size);
+    TESTEQ(param_specs.size(),params.size());
+    for(size_t i=0;i<params.size();i++) {
+        TEST(param_specs[i].shape() == params[i].shape());
+        TEST(param_specs[i].dtype() == params[i].dtype());
+        params[i].to_device(q);
+    }
+    std::vector<Tensor> out;
+    for(auto &s : out_specs)
+        out.push_back(Tensor(ctx,s.shape(),s.dtype()));
+    Tensor ws;
+    if(ws_size > 0)
+        ws = Tensor(ctx,Shape(ws_size),dp::uint8_data);
+    op->forward(in,out,params,ws,q);
+    for(auto &t : out)
+        t.to_host(q);
+    return out;
+}
+
+void compare(Tensor &res,std::vector<int8_t> const &ref)
+{
+    TESTEQ(res.shape().total_size(),ref.size());
+    int8_t *p = res.data<int8_t>();
+    for(size_t i=0;i<ref.size();i++) {
+        if(std::abs(int(p[i]) - int(ref[i])) > 1) {
+            std::cerr << "At " << i << " " << int(p[i]) << "!=" << int(ref[i]) << std::endl;
+            TEST(!"Values differ");
+        }
+    }
+}
+
+void test_conv(dp::Context &ctx,dp::ExecutionContext const &q,char const *options,Shape in_shape,int cout,int k,int pad,int stride,int groups,
+               bool bias,dp::StandardActivations act)
+{
+    float in_scale = 0.05f, out_scale = 0.5f;
+    int cin = in_shape[1];
+    int cin_g = cin / groups,cout_g = cout / groups;
+    Tensor x = random_int8(ctx,in_shape);
+    Tensor w = random_int8(ctx,Shape(cout,cin_g,k,k));
+    Tensor ws = random_float(ctx,Shape(cout),0.001f,0.01f);
+    std::vector<Tensor> params = {w,ws};
+    if(bias)
+        params.push_back(random_float(ctx,Shape(cout),-1.0f,1.0f));
+    std::vector<Tensor> out = run(ctx,q,"QuantizedConvolution2D",options,{x},params);
+    int B = in_shape[0],H = in_shape[2],W = in_shape[3];
+    int oh = (H + 2*pad - k) / stride + 1;
+    int ow = (W + 2*pad - k) / stride + 1;
+    TEST(out[0].shape() == Shape(B,cout,oh,ow));
+    TEST(out[0].dtype() == dp::int8_data);
+    std::vector<int8_t> ref;
+    for(int b=0;b<B;b++) {
+        for(int oc=0;oc<cout;oc++) {
+            int g = oc / cout_g;
+            for(int r=0;r<oh;r++) {
+                for(int c=0;c<ow;c++) {
+                    int acc = 0;
+                    for(int ic=0;ic<cin_g;ic++) {
+                        for(int dr=0;dr<k;dr++) {
+                            for(int dc=0;dc<k;dc++) {
+                                int y = r*stride - pad + dr;
+                                int x0 = c*stride - pad + dc;
+                                if(y < 0 || y >= H || x0 < 0 || x0 >= W)
+                                    continue;
+                                int xv = x.data<int8_t>()[((b*cin + g*cin_g + ic)*H + y)*W + x0];
+                                int wv = w.data<int8_t>()[((oc*cin_g + ic)*k + dr)*k + dc];
+                                acc += xv * wv;
+                            }
+                        }
+                    }
+                    float v = acc * (in_scale * ws.data<float>()[oc]) + (bias ? params[2].data<float>()[oc] : 0.0f);
+                    dp::cpu::apply_activation(&v,1,act);
+                    ref.push_back(sat(v * (1.0f / out_scale)));
+                }
+            }
+        }
+    }
+    compare(out[0],ref);
+}
+
+void test_pooling(dp::Context &ctx,dp::ExecutionContext const &q,char const *options,Shape in_shape,int k,int pad,int stride,bool avg)
+{
+    Tensor x = random_int8(ctx,in_shape);
+    std::vector<Tensor> out = run(ctx,q,"QuantizedPooling2D",options,{x});
+    int BC = in_shape[0]*in_shape[1],H = in_shape[2],W = in_shape[3];
+    int oh = (H + 2*pad - k) / stride + 1;
+    int ow = (W + 2*pad - k) / stride + 1;
+    TEST(out[0].shape() == Shape(in_shape[0],in_shape[1],oh,ow));
+    std::vector<int8_t> ref;
+    for(int bc=0;bc<BC;bc++) {
+        for(int r=0;r<oh;r++) {
+            for(int c=0;c<ow;c++) {
+                int m = -128, sum = 0, count = 0;
+                for(int y = r*stride - pad;y < r*stride - pad + k;y++) {
+                    for(int x0 = c*stride - pad;x0 < c*stride - pad + k;x0++) {
+                        if(y < 0 || y >= H || x0 < 0 || x0 >= W)
+                            continue;
+                        int v = x.data<int8_t>()[(bc*H + y)*W + x0];
+                        m = std::max(m,v);
+                        sum += v;
+                        count ++;
+                    }
+                }
+                ref.push_back(avg ? sat(float(sum) / count) : int8_t(m));
+            }
+        }
+    }
+    compare(out[0],ref);
+}
+
+int main(int argc,char **argv)
+{
+    if(argc!=2) {
+        std::cerr << "test_quantization device" << std::endl;
+        return 1;
+    }
+    try {
+        dp::Context ctx(argv[1]);
+        std::cout << "Testing for " << ctx.name() << std::endl;
+        dp::ExecutionContext q = ctx.make_execution_context();
+        {
+            std::cout << "Test quantize/dequantize" << std::endl;
+            float scale = 2.0f / 127;
+            Tensor x = random_float(ctx,Shape(3,1000),-2.5f,2.5f);
+            std::vector<Tensor> qx = run(ctx,q,"Quantize",R"xx({"scale":0.015748031})xx",{x});
+            TEST(qx[0].dtype() == dp::int8_data);
+            std::vector<int8_t> ref;
+            for(size_t i=0;i<x.shape().total_size();i++)
+                ref.push_back(sat(x.data<float>()[i] * (1.0f / scale)));
+            compare(qx[0],ref);
+            std::vector<Tensor> y = run(ctx,q,"Dequantize",R"xx({"scale":0.015748031})xx",{qx[0]});
+            TEST(y[0].dtype() == dp::float_data);
+            for(size_t i=0;i<x.shape().total_size();i++) {
+                float xv = std::min(127*scale,std::max(-128*scale,x.data<float>()[i]));
+                TESTEQF(y[0].data<float>()[i],xv,scale * 0.51f);
+            }
+        }
+        std::cout << "Test conv" << std::endl;
+        test_conv(ctx,q,R"xx({"channels_out":6,"kernel":3,"pad":1,"stride":2,"groups":2,"activation":"relu",
+                           "input_scale":0.05,"output_scale":0.5})xx",
+                  Shape(2,4,7,6),6,3,1,2,2,true,dp::StandardActivations::relu);
+        test_conv(ctx,q,R"xx({"channels_out":5,"kernel":1,"bias":false,"input_scale":0.05,"output_scale":0.5})xx",
+                  Shape(3,8,5,5),5,1,0,1,1,false,dp::StandardActivations::identity);
+        {
+            std::cout << "Test inner product" << std::endl;
+            float in_scale = 0.02f, out_scale = 0.25f;
+            Tensor x = random_int8(ctx,Shape(3,2,5));
+            Tensor w = random_int8(ctx,Shape(7,10));
+            Tensor ws = random_float(ctx,Shape(7),0.001f,0.01f);
+            Tensor bias = random_float(ctx,Shape(7),-1.0f,1.0f);
+            std::vector<Tensor> out = run(ctx,q,"QuantizedInnerProduct",
+                                          R"xx({"outputs":7,"activation":"tanh","input_scale":0.02,"output_scale":0.25})xx",
+                                          {x},{w,ws,bias});
+            TEST(out[0].shape() == Shape(3,7));
+            std::vector<int8_t> ref;
+            for(int b=0;b<3;b++) {
+                for(int o=0;o<7;o++) {
+                    int acc = 0;
+                    for(int i=0;i<10;i++)
+                        acc += int(x.data<int8_t>()[b*10+i]) * int(w.data<int8_t>()[o*10+i]);
+                    float v = std::tanh(acc * (in_scale * ws.data<float>()[o]) + bias.data<float>()[o]);
+                    ref.push_back(sat(v * (1.0f / out_scale)));
+                }
+            }
+            compare(out[0],ref);
+        }
+        std::cout << "Test pooling" << std::endl;
+        test_pooling(ctx,q,R"xx({"mode":"max","kernel":3,"stride":2,"pad":1})xx",Shape(2,3,9,8),3,1,2,false);
+        test_pooling(ctx,q,R"xx({"mode":"avg","kernel":2,"stride":2})xx",Shape(2,3,8,6),2,0,2,true);
+        test_pooling(ctx,q,R"xx({"mode":"avg","kernel":3,"stride":1,"pad":1})xx",Shape(1,2,5,5),3,1,1,true);
+        {
+            std::cout << "Test activation" << std::endl;
+            Tensor x = random_int8(ctx,Shape(4,100));
+            std::vector<Tensor> out = run(ctx,q,"QuantizedActivation",
+                                          R"xx({"activation":"relu6","input_scale":0.1,"output_scale":0.05})xx",{x});
+            std::vector<int8_t> ref;
+            for(size_t i=0;i<400;i++) {
+                float v = std::min(6.0f,std::max(0.0f,x.data<int8_t>()[i] * 0.1f));
+                ref.push_back(sat(v * (1.0f / 0.05f)));
+            }
+            compare(out[0],ref);
+        }
+    }
+    catch(std::exception const &e) {
+        std::cerr << "Failed: " << e.what() << std::endl;
+        return 1;
+    }
+    std::cout << "Ok" << std::endl;
+    return 0;
+}
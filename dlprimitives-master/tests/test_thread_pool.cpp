@@ -0,0 +1,99 @@
+///////////////////////////////////////////////////////////////////////////////
+///
+/// Copyright (c) 2021-2022 Artyom Beilis <artyomtnk@yahoo.com>
+///
+/// MIT License, see LICENSE.TXT
+///
+///////////////////////////////////////////////////////////////////////////////
+#include <dlprim/context.hpp>
+#include <dlprim/cpu/thread_pool.hpp>
+#include "test.hpp"
+#include <iostream>
+#include <vector>
+
+int main()
+{
+    try {
+        using dlprim::cpu::ThreadPool;
+        {
+            std::cout << "Test chunks" << std::endl;
+            ThreadPool pool(4);
+            TESTEQ(pool.size(),4);
+            for(size_t n : {1,3,4,5,1000}) {
+                std::vector<int> hits(n,0);
+                std::vector<int> owner(n,-1);
+                pool.parallel_for(n,[&](size_t begin,size_t end,int id) {
+                    TEST(begin < end);
+                    TEST(id >= 0 && id < 4);
+                    for(size_t i=begin;i<end;i++) {
+                        hits[i]++;
+                        owner[i] = id;
+                    }
+                });
+                for(size_t i=0;i<n;i++) {
+                    TEST(hits[i] == 1);
+                    if(i > 0)
+                        TEST(owner[i-1] <= owner[i]);
+                }
+            }
+        }
+        {
+            std::cout << "Test nested and resize" << std::endl;
+            ThreadPool pool(3);
+            std::vector<int> v(100,0);
+            pool.parallel_for(v.size(),[&](size_t begin,size_t end,int) {
+                pool.parallel_for(end-begin,[&](size_t b,size_t e,int id) {
+                    TESTEQ(id,0);
+                    for(size_t i=b;i<e;i++)
+                        v[begin + i]++;
+                });
+            });
+            for(int x : v)
+                TESTEQ(x,1);
+            pool.resize(2);
+            TESTEQ(pool.size(),2);
+            int calls = 0;
+            pool.parallel_for(10,[&](size_t,size_t,int id) {
+                if(id == 0)
+                    calls++;
+            });
+            TESTEQ(calls,1);
+        }
+        {
+            std::cout << "Test exceptions" << std::endl;
+            ThreadPool pool(4);
+            bool thrown = false;
+            try {
+                pool.parallel_for(8,[&](size_t begin,size_t,int) {
+                    if(begin > 0)
+                        throw std::runtime_error("failed");
+                });
+            }
+            catch(std::runtime_error const &) {
+                thrown = true;
+            }
+            TEST(thrown);
+            // pool is usable after an error
+            std::vector<int> v(8,0);
+            pool.parallel_for(v.size(),[&](size_t begin,size_t end,int) {
+                for(size_t i=begin;i<end;i++)
+                    v[i] = 1;
+            });
+            for(int x : v)
+                TESTEQ(x,1);
+        }
+        {
+            std::cout << "Test context" << std::endl;
+            dlprim::Context ctx;
+            dlprim::Context copy = ctx;
+            TEST(&ctx.thread_pool() == &copy.thread_pool());
+            TEST(ctx.thread_pool().size() >= 1);
+        }
+    }
+    catch(std::exception const &e) {
+        std::cerr << "Failed: " << e.what() << std::endl;
+        return 1;
+    }
+    std::cout << "Ok" << std::endl;
+    return 0;
+}
@@ -0,0 +1,528 @@
+///////////////////////////////////////////////////////////////////////////////
+///
+/// Copyright (c) 2021-2022 Artyom Beilis <artyomtnk@yahoo.com>
+///
+/// MIT License, see LICENSE.TXT
+///
+///////////////////////////////////////////////////////////////////////////////
+#include <dlprim/net.hpp>
+#include <dlprim/json.hpp>
+#include <dlprim/ops/conv2d.hpp>
+#include <dlprim/ops/inner_product.hpp>
+#include <dlprim/ops/batch_normalization.hpp>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <set>
+
+namespace dp = dlprim;
+namespace json = dp::json;
+
+namespace {
+
+    bool is_net_input(json::value const &net,std::string const &name)
+    {
+        for(auto const &input : net["inputs"].array()) {
+            if(input.get("name","data") == name)
+                return true;
+        }
+        return false;
+    }
+
+    // Give every version of in-place modified tensor its own name such that it can be calibrated
+    // separately. The last version keeps the original name unless the tensor is a network input
+    void ssa_rename(json::value &net)
+    {
+        std::map<std::string,int> versions;
+        for(auto const &input : net["inputs"].array())
+            versions[input.get("name","data")]++;
+        for(auto const &op : net["operators"].array()) {
+            for(auto const &name : op.get("outputs",std::vector<std::string>()))
+                versions[name]++;
+        }
+        std::map<std::string,int> current_version;
+        std::map<std::string,std::string> current;
+        for(auto const &input : net["inputs"].array()) {
+            std::string name = input.get("name","data");
+            current[name] = name;
+            current_version[name] = 1;
+        }
+        for(auto &op : net["operators"].array()) {
+            std::vector<std::string> inputs = op.get("inputs",std::vector<std::string>());
+            std::vector<std::string> outputs = op.get("outputs",std::vector<std::string>());
+            for(auto &name : inputs) {
+                if(current.find(name) == current.end())
+                    throw dp::ValidationError("Tensor " + name + " is used before it is created");
+                name = current[name];
+            }
+            for(auto &name : outputs) {
+                int ver = current_version[name]++;
+                std::string new_name = name;
+                if(ver != (is_net_input(net,name) ? 0 : versions[name] - 1))
+                    new_name = name + "_v" + std::to_string(ver);
+                current[name] = new_name;
+                name = new_name;
+            }
+            op["inputs"] = inputs;
+            op["outputs"] = outputs;
+        }
+        for(auto &output : net["outputs"].array()) {
+            if(output.type() == json::is_string)
+                output = current[output.str()];
+            else
+                output["name"] = current[output.get<std::string>("name")];
+        }
+    }
+
+    std::string param_name(json::value const &op,size_t index)
+    {
+        std::vector<std::string> params = op.get("params",std::vector<std::string>());
+        if(index < params.size() && !params[index].empty() && params[index] != "auto")
+            return params[index];
+        return op.get<std::string>("name") + "." + std::to_string(index);
+    }
+
+    json::value const &options(json::value const &op)
+    {
+        static json::value const empty = json::object();
+        json::value const &opts = op.find("options");
+        return opts.is_undefined() ? empty : opts;
+    }
+
+    void check(bool cond,std::string const &param)
+    {
+        if(!cond)
+            throw dp::ValidationError("Unexpected shape or type of parameter " + param);
+    }
+
+    float scale_for(float max_abs)
+    {
+        return max_abs > 0 ? max_abs / 127 : 1.0f;
+    }
+
+    int8_t quantize(float v,float scale)
+    {
+        v = std::nearbyint(v / scale);
+        return int8_t(std::max(-128.0f,std::min(127.0f,v)));
+    }
+
+    // Convolution2D or InnerProduct with a folded BatchNorm and fused activation
+    struct WeightedLayer {
+        std::vector<float> weight;
+        std::vector<float> bias;
+        std::string activation = "identity";
+        std::string output;
+    };
+
+    class Calibrator {
+    public:
+        Calibrator(dp::Context &ctx,json::value const &net,bool per_tensor) :
+            ctx_(ctx),
+            net_json_(net),
+            per_tensor_(per_tensor),
+            net_(ctx)
+        {
+            ssa_rename(net_json_);
+            net_.keep_intermediate_tensors(true);
+            net_.load_from_json(net_json_);
+            net_.setup();
+            if(net_.input_names().size() != 1 || net_.input(0).dtype() != dp::float_data)
+                throw dp::ValidationError("Calibration supports networks with single float input only");
+        }
+
+        void load_parameters(std::string const &file)
+        {
+            net_.load_parameters(file);
+        }
+
+        void set_samples(std::vector<float> const &samples)
+        {
+            samples_ = samples;
+        }
+
+        void calibrate()
+        {
+            dp::ExecutionContext q = ctx_.make_execution_context();
+            for_each_batch(net_,samples_,[&](int) {
+                for(auto &pr : net_.tensors()) {
+                    dp::Tensor &t = pr.second;
+                    if(t.dtype() != dp::float_data)
+                        continue;
+                    t.to_host(q);
+                    float const *p = t.data<float>();
+                    float &m = max_abs_[pr.first];
+                    for(size_t i=0;i<t.shape().total_size();i++)
+                        m = std::max(m,std::abs(p[i]));
+                }
+                std::vector<std::vector<float> > res;
+                for(unsigned i=0;i<net_.output_names().size();i++) {
+                    dp::Tensor &t = net_.output(i);
+                    res.emplace_back(t.data<float>(),t.data<float>() + t.shape().total_size());
+                }
+                reference_.push_back(std::move(res));
+            });
+            for(auto const &pr : max_abs_)
+                scales_[pr.first] = scale_for(pr.second);
+        }
+
+        void convert()
+        {
+            find_consumers();
+            json::array const &ops = net_json_["operators"].array();
+            std::set<size_t> merged;
+            for(size_t i=0;i<ops.size();i++) {
+                if(merged.count(i))
+                    continue;
+                json::value const &op = ops[i];
+                std::string type = op.get<std::string>("type");
+                std::vector<std::string> inputs = op.get("inputs",std::vector<std::string>());
+                if(type == "Convolution2D" || type == "InnerProduct") {
+                    add_weighted(i,merged);
+                }
+                else if((type == "Pooling2D" || type == "GlobalPooling" || type == "Activation")
+                        && inputs.size() == 1 && int8_.count(inputs[0]))
+                {
+                    add_int8_pointwise(op);
+                }
+                else {
+                    json::value new_op = op;
+                    for(auto &name : inputs)
+                        name = ensure_float(name);
+                    new_op["inputs"] = inputs;
+                    ops_.push_back(new_op);
+                    for(auto const &name : op.get("outputs",std::vector<std::string>()))
+                        float_.insert(name);
+                }
+            }
+            for(auto const &name : net_.output_names())
+                ensure_float(name);
+            result_ = json::object();
+            result_["inputs"] = net_json_["inputs"];
+            result_["outputs"] = net_json_["outputs"];
+            result_["operators"] = ops_;
+        }
+
+        void save(std::string const &net_file,std::string const &weights_file)
+        {
+            {
+                std::ofstream f(net_file);
+                result_.save(f,json::readable);
+                f << std::endl;
+                if(!f)
+                    throw dp::ValidationError("Failed to write " + net_file);
+            }
+            dp::Net qnet(ctx_);
+            qnet.load_from_json(result_);
+            qnet.setup();
+            for(auto &pr : qnet.params()) {
+                dp::Tensor &t = pr.second;
+                if(int8_params_.count(pr.first)) {
+                    std::vector<int8_t> const &v = int8_params_[pr.first];
+                    check(v.size() == t.shape().total_size() && t.dtype() == dp::int8_data,pr.first);
+                    std::copy(v.begin(),v.end(),t.data<int8_t>());
+                }
+                else if(float_params_.count(pr.first)) {
+                    std::vector<float> const &v = float_params_[pr.first];
+                    check(v.size() == t.shape().total_size() && t.dtype() == dp::float_data,pr.first);
+                    std::copy(v.begin(),v.end(),t.data<float>());
+                }
+                else {
+                    dp::Tensor &src = net_.param(pr.first);
+                    check(src.memory_size() == t.memory_size(),pr.first);
+                    memcpy(t.host_data(),src.host_data(),t.memory_size());
+                }
+            }
+            qnet.copy_parameters_to_device();
+            qnet.save_parameters(weights_file);
+            qnet.reshape();
+            report(qnet);
+        }
+    private:
+        template<typename Callback>
+        void for_each_batch(dp::Net &net,std::vector<float> const &samples,Callback cb)
+        {
+            dp::ExecutionContext q = ctx_.make_execution_context();
+            dp::Tensor &data = net.input(0);
+            size_t batch_size = data.shape().total_size();
+            size_t batches = samples.size() / batch_size;
+            if(batches == 0)
+                throw dp::ValidationError("Calibration data is smaller than a single batch of " + std::to_string(data.shape()[0]));
+            for(size_t b=0;b<batches;b++) {
+                std::copy(samples.begin() + b * batch_size,samples.begin() + (b+1) * batch_size,data.data<float>());
+                data.to_device(q);
+                net.forward(q);
+                for(unsigned i=0;i<net.output_names().size();i++)
+                    net.output(i).to_host(q);
+                cb(b);
+            }
+        }
+
+        void report(dp::Net &qnet)
+        {
+            std::vector<float> max_diff(qnet.output_names().size()),max_ref(max_diff.size());
+            for_each_batch(qnet,samples_,[&](int b) {
+                for(unsigned i=0;i<qnet.output_names().size();i++) {
+                    float const *p = qnet.output(i).data<float>();
+                    std::vector<float> const &ref = reference_.at(b).at(i);
+                    for(size_t j=0;j<ref.size();j++) {
+                        max_diff[i] = std::max(max_diff[i],std::abs(p[j] - ref[j]));
+                        max_ref[i] = std::max(max_ref[i],std::abs(ref[j]));
+                    }
+                }
+            });
+            for(unsigned i=0;i<qnet.output_names().size();i++) {
+                std::cout << "- " << qnet.output_names()[i] << " max |float - int8| " << max_diff[i]
+                          << " of max |float| " << max_ref[i] << std::endl;
+            }
+        }
+
+        void find_consumers()
+        {
+            for(auto const &op : net_json_["operators"].array()) {
+                for(auto const &name : op.get("inputs",std::vector<std::string>()))
+                    consumers_[name]++;
+            }
+            for(auto const &name : net_.output_names())
+                consumers_[name]++;
+            for(auto const &name : net_.input_names())
+                float_.insert(name);
+        }
+
+        // index of the operator that reads the tensor if it is its only user
+        int single_consumer(size_t after,std::string const &name)
+        {
+            if(consumers_[name] != 1)
+                return -1;
+            json::array const &ops = net_json_["operators"].array();
+            for(size_t i=after+1;i<ops.size();i++) {
+                std::vector<std::string> inputs = ops[i].get("inputs",std::vector<std::string>());
+                if(std::find(inputs.begin(),inputs.end(),name) != inputs.end())
+                    return inputs.size() == 1 ? int(i) : -1;
+            }
+            return -1;
+        }
+
+        std::string ensure_int8(std::string const &name)
+        {
+            std::string qname = name + "_int8";
+            if(int8_.count(name))
+                return qname;
+            json::value op;
+            op["name"] = name + "_quantize";
+            op["type"] = "Quantize";
+            op["inputs"][0] = name;
+            op["outputs"][0] = qname;
+            op["options"]["scale"] = scales_.at(name);
+            ops_.push_back(op);
+            int8_.insert(name);
+            return qname;
+        }
+
+        std::string ensure_float(std::string const &name)
+        {
+            if(float_.count(name))
+                return name;
+            json::value op;
+            op["name"] = name + "_dequantize";
+            op["type"] = "Dequantize";
+            op["inputs"][0] = name + "_int8";
+            op["outputs"][0] = name;
+            op["options"]["scale"] = scales_.at(name);
+            ops_.push_back(op);
+            float_.insert(name);
+            return name;
+        }
+
+        void add_weighted(size_t index,std::set<size_t> &merged)
+        {
+            json::array const &ops = net_json_["operators"].array();
+            json::value const &op = ops[index];
+            bool conv = op.get<std::string>("type") == "Convolution2D";
+            json::value const &opts = options(op);
+            bool bias = conv ? dp::Convolution2DConfig::from_json(opts).bias : dp::InnerProductConfig::from_json(opts).bias;
+
+            WeightedLayer layer;
+            dp::Tensor &w = net_.param(param_name(op,0));
+            int channels = w.shape()[0];
+            layer.weight.assign(w.data<float>(),w.data<float>() + w.shape().total_size());
+            if(bias) {
+                dp::Tensor &b = net_.param(param_name(op,1));
+                layer.bias.assign(b.data<float>(),b.data<float>() + channels);
+            }
+            layer.activation = opts.get("activation","identity");
+            layer.output = op.get<std::vector<std::string> >("outputs").at(0);
+
+            int next;
+            if(layer.activation == "identity" && (next = single_consumer(index,layer.output)) >= 0
+               && ops[next].get<std::string>("type") == "BatchNorm")
+            {
+                fold_batch_norm(ops[next],layer,channels);
+                merged.insert(next);
+                index = next;
+            }
+            if(layer.activation == "identity" && (next = single_consumer(index,layer.output)) >= 0
+               && ops[next].get<std::string>("type") == "Activation")
+            {
+                layer.activation = options(ops[next]).get("activation","identity");
+                layer.output = ops[next].get<std::vector<std::string> >("outputs").at(0);
+                merged.insert(next);
+            }
+
+            std::string input = op.get<std::vector<std::string> >("inputs").at(0);
+            json::value new_op;
+            std::string name = op.get<std::string>("name");
+            new_op["name"] = name;
+            new_op["type"] = conv ? "QuantizedConvolution2D" : "QuantizedInnerProduct";
+            new_op["inputs"][0] = ensure_int8(input);
+            new_op["outputs"][0] = layer.output + "_int8";
+            new_op["options"] = opts;
+            new_op["options"]["bias"] = !layer.bias.empty();
+            new_op["options"]["activation"] = layer.activation;
+            new_op["options"]["input_scale"] = scales_.at(input);
+            new_op["options"]["output_scale"] = scales_.at(layer.output);
+            ops_.push_back(new_op);
+            int8_.insert(layer.output);
+
+            size_t row = layer.weight.size() / channels;
+            std::vector<int8_t> &qw = int8_params_[name + ".0"];
+            std::vector<float> &w_scale = float_params_[name + ".1"];
+            qw.resize(layer.weight.size());
+            w_scale.resize(channels);
+            float tensor_max = 0;
+            for(float v : layer.weight)
+                tensor_max = std::max(tensor_max,std::abs(v));
+            for(int c=0;c<channels;c++) {
+                float const *wc = layer.weight.data() + c * row;
+                float channel_max = 0;
+                for(size_t k=0;k<row;k++)
+                    channel_max = std::max(channel_max,std::abs(wc[k]));
+                float s = scale_for(per_tensor_ ? tensor_max : channel_max);
+                w_scale[c] = s;
+                for(size_t k=0;k<row;k++)
+                    qw[c*row + k] = quantize(wc[k],s);
+            }
+            if(!layer.bias.empty())
+                float_params_[name + ".2"] = layer.bias;
+        }
+
+        // same folding as Net::fold_batch_norms, through BatchNorm::fold_into
+        void fold_batch_norm(json::value const &op,WeightedLayer &layer,int channels)
+        {
+            dp::BatchNormConfig cfg = dp::BatchNormConfig::from_json(options(op));
+            float const *mean  = net_.param(param_name(op,0)).data<float>();
+            float const *var   = net_.param(param_name(op,1)).data<float>();
+            float const *gamma = cfg.affine ? net_.param(param_name(op,2)).data<float>() : nullptr;
+            float const *beta  = cfg.affine ? net_.param(param_name(op,3)).data<float>() : nullptr;
+            if(layer.bias.empty())
+                layer.bias.resize(channels,0.0f);
+            dp::BatchNorm::fold_into(cfg,channels,layer.weight.size() / channels,mean,var,gamma,beta,
+                                     layer.weight.data(),layer.bias.data());
+            layer.output = op.get<std::vector<std::string> >("outputs").at(0);
+        }
+
+        void add_int8_pointwise(json::value const &op)
+        {
+            std::string type = op.get<std::string>("type");
+            std::string input = op.get<std::vector<std::string> >("inputs").at(0);
+            std::string output = op.get<std::vector<std::string> >("outputs").at(0);
+            json::value new_op;
+            new_op["name"] = op.get<std::string>("name");
+            new_op["inputs"][0] = input + "_int8";
+            new_op["outputs"][0] = output + "_int8";
+            new_op["options"] = options(op);
+            if(type == "Activation") {
+                new_op["type"] = "QuantizedActivation";
+                new_op["options"]["input_scale"] = scales_.at(input);
+                new_op["options"]["output_scale"] = scales_.at(output);
+            }
+            else {
+                new_op["type"] = "QuantizedPooling2D";
+                if(type == "GlobalPooling") {
+                    dp::Shape s = net_.tensor(input).shape();
+                    new_op["options"]["kernel"][0] = s[2];
+                    new_op["options"]["kernel"][1] = s[3];
+                }
+                // pooling keeps the scale of its input
+                scales_[output] = scales_.at(input);
+            }
+            ops_.push_back(new_op);
+            int8_.insert(output);
+        }
+
+        dp::Context ctx_;
+        json::value net_json_;
+        bool per_tensor_;
+        dp::Net net_;
+        std::vector<float> samples_;
+        std::map<std::string,float> max_abs_;
+        std::map<std::string,float> scales_;
+        std::vector<std::vector<std::vector<float> > > reference_;
+
+        std::map<std::string,int> consumers_;
+        std::set<std::string> int8_;  // tensors with "_int8" version available
+        std::set<std::string> float_; // tensors with float version available
+        json::array ops_;
+        json::value result_;
+        std::map<std::string,std::vector<int8_t> > int8_params_;
+        std::map<std::string,std::vector<float> > float_params_;
+    };
+
+} // namespace
+
+
+int main(int argc,char **argv)
+{
+    try {
+        bool per_tensor = false;
+        while(argc >= 2 && argv[1][0] == '-') {
+            std::string flag = argv[1];
+            if(flag == "-t")
+                per_tensor = true;
+            else {
+                std::cerr << "Invalid Flag " << flag << std::endl;
+                return 1;
+            }
+            argv++;
+            argc--;
+        }
+        if(argc != 7) {
+            std::cerr << "Usage [-t] device net.json net.dlp samples.bin int8_net.json int8_net.dlp" << std::endl;
+            std::cerr << "  -t use per tensor rather than per channel weight scale\n"
+                         "  samples.bin - raw float32 calibration input, a multiple of network input batch\n";
+            return 1;
+        }
+        dp::Context ctx(argv[1]);
+        std::cout << "Using: " << ctx.name() << std::endl;
+
+        json::value net;
+        {
+            std::ifstream f(argv[2]);
+            int line = -1;
+            if(!net.load(f,true,&line))
+                throw dp::ValidationError(std::string("Failed to load json from ") + argv[2] + ", syntax error at line " + std::to_string(line));
+        }
+        std::vector<float> samples;
+        {
+            std::ifstream f(argv[4],std::ifstream::binary);
+            if(!f)
+                throw dp::ValidationError(std::string("Failed to open ") + argv[4]);
+            f.seekg(0,std::ios::end);
+            samples.resize(size_t(f.tellg()) / sizeof(float));
+            f.seekg(0);
+            f.read(reinterpret_cast<char *>(samples.data()),samples.size() * sizeof(float));
+        }
+        Calibrator calibrator(ctx,net,per_tensor);
+        calibrator.load_parameters(argv[3]);
+        calibrator.set_samples(samples);
+        calibrator.calibrate();
+        calibrator.convert();
+        calibrator.save(argv[5],argv[6]);
+    }
+    catch(std::exception const &e) {
+        std::cerr << "Failed: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}